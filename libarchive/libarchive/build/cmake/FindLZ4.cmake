@@ -0,0 +1,27 @@
+# - Find lz4
+# Find the native LZ4 includes and library
+#
+#  LZ4_INCLUDE_DIR    - where to find lz4frame.h, etc.
+#  LZ4_LIBRARIES      - List of libraries when using liblz4.
+#  LZ4_FOUND          - True if liblz4 found.
+
+IF (LZ4_INCLUDE_DIR)
+  # Already in cache, be silent
+  SET(LZ4_FIND_QUIETLY TRUE)
+ENDIF (LZ4_INCLUDE_DIR)
+
+FIND_PATH(LZ4_INCLUDE_DIR lz4frame.h)
+FIND_LIBRARY(LZ4_LIBRARY NAMES lz4 )
+
+# handle the QUIETLY and REQUIRED arguments and set LZ4_FOUND to TRUE if 
+# all listed variables are TRUE
+INCLUDE(FindPackageHandleStandardArgs)
+FIND_PACKAGE_HANDLE_STANDARD_ARGS(LZ4 DEFAULT_MSG LZ4_LIBRARY LZ4_INCLUDE_DIR)
+
+IF(LZ4_FOUND)
+  SET( LZ4_LIBRARIES ${LZ4_LIBRARY} )
+ELSE(LZ4_FOUND)
+  SET( LZ4_LIBRARIES )
+ENDIF(LZ4_FOUND)
+
+MARK_AS_ADVANCED( LZ4_LIBRARY LZ4_INCLUDE_DIR )
@@ -0,0 +1,152 @@
+/*
+ * This file is in the public domain.
+ *
+ * Feel free to use it as you wish.
+ */
+
+/*
+ * This example program measures gzip or xz compression throughput as
+ * the number of compression threads goes from 1 up to a maximum.  The
+ * file named on the command line is read into memory and written as a
+ * single ustar entry, over and over, to a callback that throws the
+ * output away.
+ *
+ *   compress_bench [-x] [-l level] [-t maxthreads] file
+ *
+ * -x selects xz instead of gzip; the default maximum is 8 threads.
+ *
+ * To compile:
+ * gcc -Wall -o compress_bench compress_bench.c -larchive -lz -llzma
+ */
+
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <archive.h>
+#include <archive_entry.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static void
+die(const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	fprintf(stderr, "\n");
+	exit(1);
+}
+
+static ssize_t
+discard(struct archive *a, void *client_data, const void *buff, size_t n)
+{
+	(void)a; /* UNUSED */
+	(void)buff; /* UNUSED */
+	*(size_t *)client_data += n;
+	return (n);
+}
+
+static double
+now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (tv.tv_sec + tv.tv_usec / 1000000.0);
+}
+
+/* Compresses the data once; returns the compressed size. */
+static size_t
+run(int xz, const char *level, int threads, const char *data, size_t size)
+{
+	struct archive *a;
+	struct archive_entry *entry;
+	char options[64];
+	size_t out = 0;
+
+	a = archive_write_new();
+	archive_write_set_format_ustar(a);
+	if ((xz ? archive_write_set_compression_xz(a)
+	    : archive_write_set_compression_gzip(a)) != ARCHIVE_OK)
+		die("%s", archive_error_string(a));
+	snprintf(options, sizeof(options), "threads=%d%s%s", threads,
+	    level != NULL ? ",compression-level=" : "",
+	    level != NULL ? level : "");
+	if (archive_write_set_compressor_options(a, options) != ARCHIVE_OK)
+		die("%s: %s", options, archive_error_string(a));
+	if (archive_write_open(a, &out, NULL, discard, NULL) != ARCHIVE_OK)
+		die("%s", archive_error_string(a));
+	entry = archive_entry_new();
+	archive_entry_set_pathname(entry, "data");
+	archive_entry_set_filetype(entry, AE_IFREG);
+	archive_entry_set_perm(entry, 0644);
+	archive_entry_set_size(entry, size);
+	if (archive_write_header(a, entry) != ARCHIVE_OK)
+		die("%s", archive_error_string(a));
+	if (archive_write_data(a, data, size) != (ssize_t)size)
+		die("%s", archive_error_string(a));
+	archive_entry_free(entry);
+	if (archive_write_close(a) != ARCHIVE_OK)
+		die("%s", archive_error_string(a));
+	archive_write_finish(a);
+	return (out);
+}
+
+int
+main(int argc, char **argv)
+{
+	const char *level = NULL;
+	struct stat st;
+	FILE *f;
+	char *data;
+	double start, elapsed, base = 0;
+	size_t out;
+	int c, xz = 0, maxthreads = 8, threads;
+
+	while ((c = getopt(argc, argv, "l:t:x")) != -1) {
+		switch (c) {
+		case 'l':
+			level = optarg;
+			break;
+		case 't':
+			maxthreads = atoi(optarg);
+			break;
+		case 'x':
+			xz = 1;
+			break;
+		default:
+			die("usage: compress_bench [-x] [-l level]"
+			    " [-t maxthreads] file");
+		}
+	}
+	if (optind + 1 != argc || maxthreads < 1)
+		die("usage: compress_bench [-x] [-l level]"
+		    " [-t maxthreads] file");
+
+	if ((f = fopen(argv[optind], "rb")) == NULL ||
+	    fstat(fileno(f), &st) != 0)
+		die("%s: can't open", argv[optind]);
+	if ((data = malloc(st.st_size)) == NULL ||
+	    fread(data, 1, st.st_size, f) != (size_t)st.st_size)
+		die("%s: can't read", argv[optind]);
+	fclose(f);
+
+	printf("%s, %ld bytes\n", xz ? "xz" : "gzip", (long)st.st_size);
+	printf("threads      MB/s   speedup   ratio\n");
+	for (threads = 1; threads <= maxthreads; threads *= 2) {
+		start = now();
+		out = run(xz, level, threads, data, st.st_size);
+		elapsed = now() - start;
+		if (threads == 1)
+			base = elapsed;
+		printf("%7d %9.1f %8.2fx %7.3f\n", threads,
+		    st.st_size / elapsed / 1000000.0, base / elapsed,
+		    (double)out / st.st_size);
+	}
+	free(data);
+	return (0);
+}
@@ -0,0 +1,198 @@
+/*
+ * This file is in the public domain.
+ *
+ * Feel free to use it as you wish.
+ */
+
+/*
+ * This example program measures how fast libarchive checksums entry
+ * data.  It writes a buffer of random bytes as a single stored zip
+ * entry to a callback that throws the output away, then reads that
+ * archive back from memory; both passes are dominated by the crc32.
+ * For comparison it also times the byte-at-a-time crc32 that
+ * libarchive used to carry and zlib's crc32().
+ *
+ *   crc32_bench [-m megabytes] [-r rounds]
+ *
+ * To compile:
+ * gcc -Wall -O2 -o crc32_bench crc32_bench.c -larchive -lz
+ */
+
+#include <sys/time.h>
+#include <archive.h>
+#include <archive_entry.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+
+static void
+die(const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	fprintf(stderr, "\n");
+	exit(1);
+}
+
+static double
+now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (tv.tv_sec + tv.tv_usec / 1000000.0);
+}
+
+static void
+report(const char *what, size_t bytes, double seconds)
+{
+	printf("%-24s %8.1f MB/s\n", what, bytes / seconds / 1000000.0);
+}
+
+static unsigned long
+crc32_bytewise(unsigned long crc, const unsigned char *p, size_t len)
+{
+	static unsigned long tbl[256];
+	unsigned long c;
+	int b, i;
+
+	if (tbl[1] == 0) {
+		for (b = 0; b < 256; b++) {
+			c = b;
+			for (i = 0; i < 8; i++)
+				c = (c & 1) ? (c >> 1) ^ 0xedb88320UL : c >> 1;
+			tbl[b] = c;
+		}
+	}
+	crc ^= 0xffffffffUL;
+	while (len--)
+		crc = tbl[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+	return (crc ^ 0xffffffffUL);
+}
+
+struct sink {
+	char	*buff;
+	size_t	 size;
+	size_t	 used;
+};
+
+static ssize_t
+sink_write(struct archive *a, void *client_data, const void *buff, size_t n)
+{
+	struct sink *s = client_data;
+
+	(void)a; /* UNUSED */
+	if (s->buff != NULL && s->used + n <= s->size)
+		memcpy(s->buff + s->used, buff, n);
+	s->used += n;
+	return (n);
+}
+
+/* Write 'data' as one stored zip entry; keep the output if s->buff. */
+static void
+write_zip(struct sink *s, const char *data, size_t size)
+{
+	struct archive *a;
+	struct archive_entry *ae;
+
+	a = archive_write_new();
+	archive_write_set_format_zip(a);
+	if (archive_write_set_format_options(a, "zip:compression=store")
+	    != ARCHIVE_OK)
+		die("%s", archive_error_string(a));
+	archive_write_set_bytes_in_last_block(a, 1);
+	s->used = 0;
+	if (archive_write_open(a, s, NULL, sink_write, NULL) != ARCHIVE_OK)
+		die("%s", archive_error_string(a));
+	ae = archive_entry_new();
+	archive_entry_copy_pathname(ae, "data");
+	archive_entry_set_mode(ae, 0100644);
+	archive_entry_set_size(ae, size);
+	archive_write_header(a, ae);
+	archive_entry_free(ae);
+	if (archive_write_data(a, data, size) != (ssize_t)size)
+		die("%s", archive_error_string(a));
+	archive_write_close(a);
+	archive_write_finish(a);
+}
+
+static void
+read_zip(const char *zip, size_t size)
+{
+	struct archive *a;
+	struct archive_entry *ae;
+	const void *p;
+	size_t n;
+	off_t offset;
+	int r;
+
+	a = archive_read_new();
+	archive_read_support_format_zip(a);
+	if (archive_read_open_memory(a, (void *)zip, size) != ARCHIVE_OK ||
+	    archive_read_next_header(a, &ae) != ARCHIVE_OK)
+		die("%s", archive_error_string(a));
+	while ((r = archive_read_data_block(a, &p, &n, &offset)) == ARCHIVE_OK)
+		;
+	if (r != ARCHIVE_EOF)
+		die("%s", archive_error_string(a));
+	archive_read_finish(a);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct sink s;
+	char *data;
+	size_t size = 64, i;
+	unsigned long crc = 0;
+	double t;
+	int opt, rounds = 10, r;
+
+	while ((opt = getopt(argc, argv, "m:r:")) != -1) {
+		switch (opt) {
+		case 'm': size = atoi(optarg); break;
+		case 'r': rounds = atoi(optarg); break;
+		default: die("usage: crc32_bench [-m megabytes] [-r rounds]");
+		}
+	}
+	size *= 1000000;
+	if ((data = malloc(size)) == NULL)
+		die("out of memory");
+	srand(1);
+	for (i = 0; i < size; i++)
+		data[i] = (char)rand();
+
+	t = now();
+	crc = crc32_bytewise(0, (unsigned char *)data, size);
+	report("byte-at-a-time crc32", size, now() - t);
+
+	t = now();
+	for (r = 0; r < rounds; r++)
+		crc ^= crc32(0, (const Bytef *)data, size);
+	report("zlib crc32", size * rounds, now() - t);
+
+	memset(&s, 0, sizeof(s));
+	t = now();
+	for (r = 0; r < rounds; r++)
+		write_zip(&s, data, size);
+	report("zip write (stored)", size * rounds, now() - t);
+
+	s.size = s.used;
+	if ((s.buff = malloc(s.size)) == NULL)
+		die("out of memory");
+	write_zip(&s, data, size);
+	t = now();
+	for (r = 0; r < rounds; r++)
+		read_zip(s.buff, s.used);
+	report("zip read (stored)", size * rounds, now() - t);
+
+	free(s.buff);
+	free(data);
+	return (crc == 1);
+}
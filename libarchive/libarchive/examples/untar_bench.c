@@ -0,0 +1,263 @@
+/*
+ * This file is in the public domain.
+ *
+ * Feel free to use it as you wish.
+ */
+
+/*
+ * This example program measures how fast archive_write_disk restores
+ * a tree of many small files, where the cost is almost all per-entry
+ * system calls rather than data.  It builds a ustar archive in memory
+ * holding a synthetic tree, then extracts it with the same options
+ * bsdtar uses, into a fresh directory for each round.
+ *
+ *   untar_bench [-p] [-n files] [-w files-per-dir] [-l levels]
+ *               [-s bytes] [-r rounds] [-C dir]
+ *
+ * -p adds the options of bsdtar -p (owner, permissions, ACLs, xattrs,
+ * file flags).  Files are spread over dirs nested -l levels deep.
+ *
+ * To compile:
+ * gcc -Wall -O2 -o untar_bench untar_bench.c -larchive
+ */
+
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <archive.h>
+#include <archive_entry.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static void
+die(const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	fprintf(stderr, "\n");
+	exit(1);
+}
+
+static double
+now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (tv.tv_sec + tv.tv_usec / 1000000.0);
+}
+
+struct sink {
+	char	*buff;
+	size_t	 size;
+	size_t	 used;
+};
+
+static ssize_t
+sink_write(struct archive *a, void *client_data, const void *buff, size_t n)
+{
+	struct sink *s = client_data;
+
+	(void)a; /* UNUSED */
+	if (s->used + n > s->size) {
+		s->size = (s->used + n) * 2;
+		if ((s->buff = realloc(s->buff, s->size)) == NULL)
+			die("out of memory");
+	}
+	memcpy(s->buff + s->used, buff, n);
+	s->used += n;
+	return (n);
+}
+
+static void
+add(struct archive *a, const char *name, mode_t mode, const char *data,
+    size_t size)
+{
+	struct archive_entry *ae;
+
+	ae = archive_entry_new();
+	archive_entry_copy_pathname(ae, name);
+	archive_entry_set_mode(ae, mode);
+	archive_entry_set_size(ae, size);
+	archive_entry_set_mtime(ae, 1000000000, 0);
+	archive_entry_set_uid(ae, getuid());
+	archive_entry_set_gid(ae, getgid());
+	archive_entry_copy_uname(ae, "root");
+	archive_entry_copy_gname(ae, "root");
+	if (archive_write_header(a, ae) != ARCHIVE_OK)
+		die("%s", archive_error_string(a));
+	archive_entry_free(ae);
+	if (size > 0 && archive_write_data(a, data, size) != (ssize_t)size)
+		die("%s", archive_error_string(a));
+}
+
+/*
+ * Name of the dir holding file 'i': one path element per level,
+ * so that consecutive files share dirs the way a real tree does.
+ */
+static void
+dir_name(char *buff, int i, int per_dir, int levels)
+{
+	int d = i / per_dir, l;
+
+	buff[0] = '\0';
+	for (l = levels - 1; l >= 0; l--) {
+		int div = 1, k;
+		for (k = 0; k < l; k++)
+			div *= 10;
+		sprintf(buff + strlen(buff), "%sd%d", buff[0] ? "/" : "",
+		    l == levels - 1 ? d / div : (d / div) % 10);
+	}
+}
+
+static void
+build(struct sink *s, int files, int per_dir, int levels, size_t size)
+{
+	struct archive *a;
+	char dir[256], last[256], name[512], *data;
+	int i;
+
+	if ((data = malloc(size + 1)) == NULL)
+		die("out of memory");
+	memset(data, 'x', size);
+	a = archive_write_new();
+	archive_write_set_format_ustar(a);
+	archive_write_set_bytes_in_last_block(a, 1);
+	if (archive_write_open(a, s, NULL, sink_write, NULL) != ARCHIVE_OK)
+		die("%s", archive_error_string(a));
+	last[0] = '\0';
+	for (i = 0; i < files; i++) {
+		dir_name(dir, i, per_dir, levels);
+		if (strcmp(dir, last) != 0) {
+			/* Dirs come before their contents, as in tar -c. */
+			char *p = dir;
+			while ((p = strchr(p + 1, '/')) != NULL) {
+				*p = '\0';
+				if (strncmp(last, dir, strlen(dir)) != 0
+				    || (last[strlen(dir)] != '/'
+					&& last[strlen(dir)] != '\0'))
+					add(a, dir, AE_IFDIR | 0755, NULL, 0);
+				*p = '/';
+			}
+			add(a, dir, AE_IFDIR | 0755, NULL, 0);
+			strcpy(last, dir);
+		}
+		snprintf(name, sizeof(name), "%s/f%07d", dir, i);
+		add(a, name, AE_IFREG | 0644, data, size);
+	}
+	archive_write_close(a);
+	archive_write_finish(a);
+	free(data);
+}
+
+static void
+extract(const struct sink *s, int flags)
+{
+	struct archive *a, *ad;
+	struct archive_entry *ae;
+	const void *p;
+	size_t n;
+	off_t offset;
+	int r;
+
+	a = archive_read_new();
+	archive_read_support_format_tar(a);
+	if (archive_read_open_memory(a, s->buff, s->used) != ARCHIVE_OK)
+		die("%s", archive_error_string(a));
+	ad = archive_write_disk_new();
+	archive_write_disk_set_options(ad, flags);
+	archive_write_disk_set_standard_lookup(ad);
+	while ((r = archive_read_next_header(a, &ae)) == ARCHIVE_OK) {
+		if (archive_write_header(ad, ae) < ARCHIVE_WARN)
+			die("%s", archive_error_string(ad));
+		while ((r = archive_read_data_block(a, &p, &n, &offset))
+		    == ARCHIVE_OK)
+			if (archive_write_data_block(ad, p, n, offset)
+			    < ARCHIVE_WARN)
+				die("%s", archive_error_string(ad));
+		if (r != ARCHIVE_EOF)
+			die("%s", archive_error_string(a));
+		if (archive_write_finish_entry(ad) < ARCHIVE_WARN)
+			die("%s", archive_error_string(ad));
+	}
+	if (r != ARCHIVE_EOF)
+		die("%s", archive_error_string(a));
+	if (archive_write_finish(ad) != ARCHIVE_OK)
+		die("%s", archive_error_string(ad));
+	archive_read_finish(a);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct sink s;
+	const char *top = "untar_bench.tmp";
+	char round_dir[64], cmd[128];
+	int files = 100000, per_dir = 100, levels = 2, rounds = 3;
+	size_t size = 100;
+	int flags, opt, r;
+	double t, best = 0;
+
+	flags = ARCHIVE_EXTRACT_TIME | ARCHIVE_EXTRACT_SECURE_SYMLINKS
+	    | ARCHIVE_EXTRACT_SECURE_NODOTDOT;
+	while ((opt = getopt(argc, argv, "C:l:n:pr:s:w:")) != -1) {
+		switch (opt) {
+		case 'C': top = optarg; break;
+		case 'l': levels = atoi(optarg); break;
+		case 'n': files = atoi(optarg); break;
+		case 'p':
+			flags |= ARCHIVE_EXTRACT_OWNER | ARCHIVE_EXTRACT_PERM
+			    | ARCHIVE_EXTRACT_ACL | ARCHIVE_EXTRACT_XATTR
+			    | ARCHIVE_EXTRACT_FFLAGS;
+			break;
+		case 'r': rounds = atoi(optarg); break;
+		case 's': size = atoi(optarg); break;
+		case 'w': per_dir = atoi(optarg); break;
+		default:
+			die("usage: untar_bench [-p] [-n files] "
+			    "[-w files-per-dir] [-l levels] [-s bytes] "
+			    "[-r rounds] [-C dir]");
+		}
+	}
+	if (files < 1 || per_dir < 1 || levels < 1 || levels > 8)
+		die("bad arguments");
+
+	memset(&s, 0, sizeof(s));
+	build(&s, files, per_dir, levels, size);
+	printf("%d files of %zu bytes, %d per dir, %d levels: "
+	    "%.1f MB archive\n", files, size, per_dir, levels,
+	    s.used / 1000000.0);
+
+	if (mkdir(top, 0755) != 0 && errno != EEXIST)
+		die("%s: %s", top, strerror(errno));
+	if (chdir(top) != 0)
+		die("%s: %s", top, strerror(errno));
+	for (r = 0; r < rounds; r++) {
+		snprintf(round_dir, sizeof(round_dir), "round%d", r);
+		if (mkdir(round_dir, 0755) != 0 || chdir(round_dir) != 0)
+			die("%s: %s", round_dir, strerror(errno));
+		t = now();
+		extract(&s, flags);
+		t = now() - t;
+		if (chdir("..") != 0)
+			die("..: %s", strerror(errno));
+		printf("round %d: %.3f s, %.0f files/s\n", r, t, files / t);
+		if (r == 0 || t < best)
+			best = t;
+		/* Clean up outside the timed part. */
+		snprintf(cmd, sizeof(cmd), "rm -rf %s", round_dir);
+		if (system(cmd) != 0)
+			die("%s failed", cmd);
+	}
+	printf("best: %.3f s, %.0f files/s\n", best, files / best);
+	if (chdir("..") == 0)
+		rmdir(top);
+	free(s.buff);
+	return (0);
+}
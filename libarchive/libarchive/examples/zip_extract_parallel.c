@@ -0,0 +1,138 @@
+/*
+ * This file is in the public domain.
+ *
+ * Feel free to use it as you wish.
+ */
+
+/*
+ * This example program extracts a zip file with several threads.
+ * The first archive object reads the central directory; each thread
+ * then opens its own archive object on the same descriptor, shares
+ * that index, and extracts every Nth entry.
+ *
+ *   zip_extract_parallel [-t threads] file.zip
+ *
+ * The default is 4 threads.
+ *
+ * To compile:
+ * gcc -Wall -o zip_extract_parallel zip_extract_parallel.c -larchive -lz -lpthread
+ */
+
+#include <sys/time.h>
+#include <archive.h>
+#include <archive_entry.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+struct worker {
+	pthread_t	 thread;
+	struct archive	*index;
+	int		 fd;
+	int		 first;
+	int		 step;
+	int		 count;
+};
+
+static void
+die(const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	fprintf(stderr, "\n");
+	exit(1);
+}
+
+static double
+now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (tv.tv_sec + tv.tv_usec / 1000000.0);
+}
+
+static void *
+extract(void *arg)
+{
+	struct worker *w = arg;
+	struct archive *a;
+	struct archive_entry *entry;
+	int i;
+
+	a = archive_read_new();
+	archive_read_support_format_zip_seekable(a);
+	if (archive_read_zip_share_index(a, w->index) != ARCHIVE_OK ||
+	    archive_read_open_fd(a, w->fd, 65536) != ARCHIVE_OK)
+		die("%s", archive_error_string(a));
+	for (i = w->first; i < w->count; i += w->step) {
+		if (archive_read_zip_seek_entry(a, i) != ARCHIVE_OK ||
+		    archive_read_next_header(a, &entry) != ARCHIVE_OK)
+			die("%s", archive_error_string(a));
+		if (archive_read_extract(a, entry,
+		    ARCHIVE_EXTRACT_TIME | ARCHIVE_EXTRACT_PERM) < ARCHIVE_WARN)
+			die("%s: %s", archive_entry_pathname(entry),
+			    archive_error_string(a));
+	}
+	archive_read_close(a);
+	archive_read_finish(a);
+	return (NULL);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct archive *index;
+	struct worker *workers;
+	double start;
+	int c, fd, i, count, threads = 4;
+
+	while ((c = getopt(argc, argv, "t:")) != -1) {
+		switch (c) {
+		case 't':
+			threads = atoi(optarg);
+			break;
+		default:
+			die("usage: zip_extract_parallel [-t threads] file.zip");
+		}
+	}
+	if (optind + 1 != argc || threads < 1)
+		die("usage: zip_extract_parallel [-t threads] file.zip");
+
+	if ((fd = open(argv[optind], O_RDONLY)) < 0)
+		die("%s: can't open", argv[optind]);
+	index = archive_read_new();
+	archive_read_support_format_zip_seekable(index);
+	if (archive_read_open_fd(index, fd, 65536) != ARCHIVE_OK ||
+	    (count = archive_read_zip_entry_count(index)) < 0)
+		die("%s: %s", argv[optind], archive_error_string(index));
+
+	start = now();
+	workers = calloc(threads, sizeof(*workers));
+	for (i = 0; i < threads; i++) {
+		workers[i].index = index;
+		workers[i].fd = fd;
+		workers[i].first = i;
+		workers[i].step = threads;
+		workers[i].count = count;
+		if (pthread_create(&workers[i].thread, NULL, extract,
+		    &workers[i]) != 0)
+			die("can't create thread");
+	}
+	for (i = 0; i < threads; i++)
+		pthread_join(workers[i].thread, NULL);
+	printf("%d entries, %d threads, %.3f seconds\n", count, threads,
+	    now() - start);
+
+	free(workers);
+	archive_read_close(index);
+	archive_read_finish(index);
+	close(fd);
+	return (0);
+}
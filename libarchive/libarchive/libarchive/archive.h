@@ -221,6 +221,14 @@ typedef __LA_INT64_T	archive_skip_callback(struct archive *,
 			    void *_client_data, __LA_INT64_T request);
 #endif
 
+/*
+ * Moves the read position as lseek(2) would and returns the new
+ * position, or ARCHIVE_FATAL.  Only formats that need random access,
+ * such as seekable zip, use this.
+ */
+typedef __LA_INT64_T	archive_seek_callback(struct archive *,
+			    void *_client_data, __LA_INT64_T offset, int whence);
+
 /* Returns size actually written, zero on EOF, -1 on error. */
 typedef __LA_SSIZE_T	archive_write_callback(struct archive *,
 			    void *_client_data,
@@ -245,6 +253,8 @@ typedef int	archive_close_callback(struct archive *, void *_client_data);
 #define	ARCHIVE_COMPRESSION_XZ		6
 #define	ARCHIVE_COMPRESSION_UU		7
 #define	ARCHIVE_COMPRESSION_RPM		8
+#define	ARCHIVE_COMPRESSION_ZSTD	9
+#define	ARCHIVE_COMPRESSION_LZ4		10
 
 /*
  * Codes returned by archive_format.
@@ -313,6 +323,7 @@ __LA_DECL int		 archive_read_support_compression_all(struct archive *);
 __LA_DECL int		 archive_read_support_compression_bzip2(struct archive *);
 __LA_DECL int		 archive_read_support_compression_compress(struct archive *);
 __LA_DECL int		 archive_read_support_compression_gzip(struct archive *);
+__LA_DECL int		 archive_read_support_compression_lz4(struct archive *);
 __LA_DECL int		 archive_read_support_compression_lzma(struct archive *);
 __LA_DECL int		 archive_read_support_compression_none(struct archive *);
 __LA_DECL int		 archive_read_support_compression_program(struct archive *,
@@ -324,6 +335,7 @@ __LA_DECL int		 archive_read_support_compression_program_signature
 __LA_DECL int		 archive_read_support_compression_rpm(struct archive *);
 __LA_DECL int		 archive_read_support_compression_uu(struct archive *);
 __LA_DECL int		 archive_read_support_compression_xz(struct archive *);
+__LA_DECL int		 archive_read_support_compression_zstd(struct archive *);
 
 __LA_DECL int		 archive_read_support_format_all(struct archive *);
 __LA_DECL int		 archive_read_support_format_ar(struct archive *);
@@ -336,6 +348,46 @@ __LA_DECL int		 archive_read_support_format_raw(struct archive *);
 __LA_DECL int		 archive_read_support_format_tar(struct archive *);
 __LA_DECL int		 archive_read_support_format_xar(struct archive *);
 __LA_DECL int		 archive_read_support_format_zip(struct archive *);
+__LA_DECL int		 archive_read_support_format_zip_seekable(struct archive *);
+
+/*
+ * Random access to the members of a zip archive, through the index
+ * that archive_read_support_format_zip_seekable() builds from the
+ * central directory.  After a successful seek, the next call to
+ * archive_read_next_header() returns the chosen entry; entries are
+ * numbered from zero in central directory order.
+ */
+__LA_DECL int		 archive_read_zip_entry_count(struct archive *);
+__LA_DECL int		 archive_read_zip_seek_entry(struct archive *, int);
+__LA_DECL int		 archive_read_zip_seek_name(struct archive *,
+		     const char *_pathname);
+/*
+ * Lets a second archive reuse the index of the first instead of
+ * reading the central directory again.  The first archive must stay
+ * open until the second is finished.  archive_read_open_fd() reads
+ * regular files with pread(2), so archives on different threads can
+ * share one descriptor and extract from one zip file at once.
+ */
+__LA_DECL int		 archive_read_zip_share_index(struct archive *_to,
+		     struct archive *_from);
+
+/*
+ * Random access to the members of a tar archive, through an index
+ * written by archive_write_set_tar_index().  Load the index after
+ * opening, either from a buffer holding a separate index file or, with
+ * a NULL buffer, from the end of the archive itself; both need a seek
+ * callback.  After a successful seek, the next call to
+ * archive_read_next_header() returns the chosen member; members are
+ * numbered from zero in archive order.  Trailing slashes in names are
+ * ignored.
+ */
+__LA_DECL int		 archive_read_tar_index_load(struct archive *,
+		     const void *_buff, size_t _size);
+__LA_DECL int		 archive_read_tar_entry_count(struct archive *);
+__LA_DECL const char	*archive_read_tar_entry_name(struct archive *, int);
+__LA_DECL int		 archive_read_tar_seek_entry(struct archive *, int);
+__LA_DECL int		 archive_read_tar_seek_name(struct archive *,
+		     const char *_pathname);
 
 
 /* Open the archive using callbacks for archive I/O. */
@@ -345,6 +397,16 @@ __LA_DECL int		 archive_read_open(struct archive *, void *_client_data,
 __LA_DECL int		 archive_read_open2(struct archive *, void *_client_data,
 		     archive_open_callback *, archive_read_callback *,
 		     archive_skip_callback *, archive_close_callback *);
+/* Set before opening, for formats that need to seek. */
+__LA_DECL int		 archive_read_set_seek_callback(struct archive *,
+		     archive_seek_callback *);
+/*
+ * Set before opening: decompress on a separate thread, a few blocks
+ * ahead of the format reader.  The callbacks above are still only
+ * called from the caller's thread.  No effect on uncompressed archives.
+ */
+__LA_DECL int		 archive_read_set_decompression_thread(struct archive *,
+		     int _enable);
 
 /*
  * A variety of shortcuts that invoke archive_read_open() with
@@ -354,6 +416,14 @@ __LA_DECL int		 archive_read_open2(struct archive *, void *_client_data,
 /* Use this if you know the filename.  Note: NULL indicates stdin. */
 __LA_DECL int		 archive_read_open_filename(struct archive *,
 		     const char *_filename, size_t _block_size);
+/*
+ * Map the whole file into memory instead.  Data blocks from an
+ * uncompressed archive then point straight into the mapping, and
+ * archive_read_data_into_fd() copies them within the kernel.  Falls
+ * back to archive_read_open_filename() if the file can't be mapped.
+ */
+__LA_DECL int		 archive_read_open_mmap(struct archive *,
+		     const char *_filename);
 /* archive_read_open_file() is a deprecated synonym for ..._open_filename(). */
 __LA_DECL int		 archive_read_open_file(struct archive *,
 		     const char *_filename, size_t _block_size);
@@ -522,14 +592,33 @@ __LA_DECL int		 archive_write_get_bytes_in_last_block(struct archive *);
  * to avoid recursively adding an archive to itself. */
 __LA_DECL int		 archive_write_set_skip_file(struct archive *, dev_t, ino_t);
 
+/*
+ * Record an index of a tar archive as it is written: the name, header
+ * and data offsets and size of each member and, for gzip and xz, a
+ * point every _restart_interval bytes of tar data where a new
+ * compressed stream begins, so readers can start decompressing there
+ * (0 for none).  With ARCHIVE_TAR_INDEX_TRAILER the index is also
+ * appended to the archive, which must be uncompressed or gzip.  Set
+ * before opening.  Between archive_write_close() and
+ * archive_write_finish(), archive_write_get_tar_index() returns the
+ * index for storing in a file of its own.
+ */
+#define	ARCHIVE_TAR_INDEX_TRAILER	1
+__LA_DECL int		 archive_write_set_tar_index(struct archive *,
+		     int _flags, __LA_INT64_T _restart_interval);
+__LA_DECL int		 archive_write_get_tar_index(struct archive *,
+		     const void **_buff, size_t *_size);
+
 __LA_DECL int		 archive_write_set_compression_bzip2(struct archive *);
 __LA_DECL int		 archive_write_set_compression_compress(struct archive *);
 __LA_DECL int		 archive_write_set_compression_gzip(struct archive *);
+__LA_DECL int		 archive_write_set_compression_lz4(struct archive *);
 __LA_DECL int		 archive_write_set_compression_lzma(struct archive *);
 __LA_DECL int		 archive_write_set_compression_none(struct archive *);
 __LA_DECL int		 archive_write_set_compression_program(struct archive *,
 		     const char *cmd);
 __LA_DECL int		 archive_write_set_compression_xz(struct archive *);
+__LA_DECL int		 archive_write_set_compression_zstd(struct archive *);
 /* A convenience function to set the format based on the code or name. */
 __LA_DECL int		 archive_write_set_format(struct archive *, int format_code);
 __LA_DECL int		 archive_write_set_format_by_name(struct archive *,
@@ -29,38 +29,21 @@
 #error This header is only to be used internally to libarchive.
 #endif
 
+#ifndef ARCHIVE_CRC32_H_INCLUDED
+#define	ARCHIVE_CRC32_H_INCLUDED
+
 /*
- * When zlib is unavailable, we should still be able to validate
- * uncompressed zip archives.  That requires us to be able to compute
- * the CRC32 check value.  This is a drop-in compatible replacement
- * for crc32() from zlib.  It's slower than the zlib implementation,
- * but still pretty fast: This runs about 300MB/s on my 3GHz P4
- * compared to about 800MB/s for the zlib implementation.
+ * A drop-in compatible replacement for crc32() from zlib, so that
+ * uncompressed zip archives can be validated without zlib.  It is
+ * also faster than zlib's: see archive_crc32.c.
  */
-static unsigned long
-crc32(unsigned long crc, const void *_p, size_t len)
-{
-	unsigned long crc2, b, i;
-	const unsigned char *p = _p;
-	static volatile int crc_tbl_inited = 0;
-	static unsigned long crc_tbl[256];
+unsigned long	__archive_crc32(unsigned long crc, const void *, size_t);
 
-	if (!crc_tbl_inited) {
-		for (b = 0; b < 256; ++b) {
-			crc2 = b;
-			for (i = 8; i > 0; --i) {
-				if (crc2 & 1)
-					crc2 = (crc2 >> 1) ^ 0xedb88320UL;
-				else    
-					crc2 = (crc2 >> 1);
-			}
-			crc_tbl[b] = crc2;
-		}
-		crc_tbl_inited = 1;
-	}
+/*
+ * Turn the carry-less multiply kernel off (0) or back on (1) where the
+ * CPU supports it, or just ask (-1).  Returns non-zero if it is in use.
+ * For the test suite and benchmarks.
+ */
+int		__archive_crc32_clmul(int enable);
 
-	crc = crc ^ 0xffffffffUL;
-	while (len--)
-		crc = crc_tbl[(crc ^ *p++) & 0xff] ^ (crc >> 8);
-	return (crc ^ 0xffffffffUL);
-}
+#endif
@@ -52,6 +52,7 @@ __FBSDID("$FreeBSD: head/lib/libarchive/archive_read.c 201157 2009-12-29 05:30:2
 #include "archive_entry.h"
 #include "archive_private.h"
 #include "archive_read_private.h"
+#include "archive_read_pipeline_private.h"
 
 #define minimum(a, b) (a < b ? a : b)
 
@@ -287,6 +288,38 @@ client_close_proxy(struct archive_read_filter *self)
 }
 
 
+/*
+ * Set the seek callback.  This has to be done before the archive is
+ * opened; archive_read_open_fd() and archive_read_open_filename()
+ * set one up themselves for regular files.
+ */
+int
+archive_read_set_seek_callback(struct archive *_a,
+    archive_seek_callback *client_seeker)
+{
+	struct archive_read *a = (struct archive_read *)_a;
+
+	__archive_check_magic(_a, ARCHIVE_READ_MAGIC, ARCHIVE_STATE_NEW,
+	    "archive_read_set_seek_callback");
+	a->client.seeker = client_seeker;
+	return (ARCHIVE_OK);
+}
+
+/*
+ * Ask for decompression on a thread of its own.  This has to be done
+ * before the archive is opened.
+ */
+int
+archive_read_set_decompression_thread(struct archive *_a, int enable)
+{
+	struct archive_read *a = (struct archive_read *)_a;
+
+	__archive_check_magic(_a, ARCHIVE_READ_MAGIC, ARCHIVE_STATE_NEW,
+	    "archive_read_set_decompression_thread");
+	a->decompression_thread = enable;
+	return (ARCHIVE_OK);
+}
+
 int
 archive_read_open2(struct archive *_a, void *client_data,
     archive_open_callback *client_opener,
@@ -321,6 +354,7 @@ archive_read_open2(struct archive *_a, void *client_data,
 	a->client.reader = client_reader;
 	a->client.skipper = client_skipper;
 	a->client.closer = client_closer;
+	a->client.data = client_data;
 
 	filter = calloc(1, sizeof(*filter));
 	if (filter == NULL)
@@ -338,8 +372,11 @@ archive_read_open2(struct archive *_a, void *client_data,
 
 	/* Build out the input pipeline. */
 	e = build_stream(a);
-	if (e == ARCHIVE_OK)
+	if (e == ARCHIVE_OK) {
 		a->archive.state = ARCHIVE_STATE_HEADER;
+		if (a->decompression_thread)
+			__archive_read_pipeline_start(a);
+	}
 
 	return (e);
 }
@@ -739,6 +776,7 @@ _archive_read_close(struct archive *_a)
 	/* TODO: Clean up the formatters. */
 
 	/* Release the filter objects. */
+	__archive_read_pipeline_stop(a);
 	r1 = cleanup_filters(a);
 	if (r1 < r)
 		r = r1;
@@ -910,12 +948,11 @@ __archive_read_get_bidder(struct archive_read *a)
  *    technique is used, for example, by some of the format tasting
  *    code that has uncertain look-ahead needs.
  *
- * TODO: Someday, provide a more generic __archive_read_seek() for
- * those cases where it's useful.  This is tricky because there are lots
- * of cases where seek() is not available (reading gzip data from a
- * network socket, for instance), so there needs to be a good way to
- * communicate whether seek() is available and users of that interface
- * need to use non-seeking strategies whenever seek() is not available.
+ * For formats that need real random access there is also
+ * __archive_read_seek(), but seek() is often not available (reading
+ * gzip data from a network socket, for instance), so users of that
+ * interface need to fall back to non-seeking strategies whenever it
+ * fails.
  */
 
 /*
@@ -1247,3 +1284,180 @@ __archive_read_filter_skip(struct archive_read_filter *filter, int64_t request)
 	}
 	return (total_bytes_skipped);
 }
+
+/* Drop whatever 'filter' has buffered, as after a seek. */
+static void
+reset_filter(struct archive_read_filter *filter, int64_t position)
+{
+	filter->next = filter->buffer;
+	filter->avail = 0;
+	filter->client_buff = NULL;
+	filter->client_next = NULL;
+	filter->client_total = filter->client_avail = 0;
+	filter->end_of_file = 0;
+	filter->position = position;
+}
+
+/*
+ * Move the file pointer to an arbitrary position, as lseek() would,
+ * and return the new position.  This only works when the client
+ * provided a seek callback and the data isn't being decompressed, so
+ * callers must be ready for ARCHIVE_FAILED and fall back to reading
+ * the stream in order.  Anything buffered is discarded.
+ */
+int64_t
+__archive_read_seek(struct archive_read *a, int64_t offset, int whence)
+{
+	struct archive_read_filter *filter = a->filter;
+	int64_t r;
+
+	if (a->client.seeker == NULL || filter == NULL ||
+	    filter->upstream != NULL)
+		return (ARCHIVE_FAILED);
+	if (filter->fatal)
+		return (ARCHIVE_FATAL);
+	/* The client has read ahead of us; seek from where we are. */
+	if (whence == SEEK_CUR) {
+		offset += a->archive.file_position;
+		whence = SEEK_SET;
+	}
+	r = (a->client.seeker)(&a->archive, filter->data, offset, whence);
+	if (r < 0) {
+		filter->fatal = 1;
+		return (ARCHIVE_FATAL);
+	}
+	reset_filter(filter, r);
+	a->archive.file_position = r;
+	return (r);
+}
+
+/*
+ * True if __archive_read_seek_restart() can work: the data is either
+ * not compressed, or compressed by a single filter that can start
+ * decoding afresh at a point its writer marked as a restart point.
+ */
+int
+__archive_read_can_restart(struct archive_read *a)
+{
+	struct archive_read_filter *filter = a->filter;
+
+	if (a->client.seeker == NULL || filter == NULL || filter->fatal)
+		return (0);
+	if (filter->upstream == NULL)
+		return (1);
+	/* With the decompression thread running, the upstream of the
+	 * filter is the thread's bridge, which has no upstream. */
+	return (filter->upstream->upstream == NULL && filter->restart != NULL);
+}
+
+/*
+ * Seek to a restart point: 'raw_offset' in the input, where a new
+ * compressed stream that decodes to the data at 'offset' begins.
+ * For uncompressed input the two are the same and this is just
+ * __archive_read_seek().
+ */
+int64_t
+__archive_read_seek_restart(struct archive_read *a, int64_t raw_offset,
+    int64_t offset)
+{
+	struct archive_read_filter *filter = a->filter, *client;
+	int64_t r;
+
+	if (!__archive_read_can_restart(a))
+		return (ARCHIVE_FAILED);
+	if (filter->upstream == NULL)
+		return (__archive_read_seek(a, offset, SEEK_SET));
+
+	/* The thread has read ahead; stop it and start it again after. */
+	__archive_read_pipeline_stop(a);
+	client = filter->upstream;
+	r = (a->client.seeker)(&a->archive, client->data, raw_offset,
+	    SEEK_SET);
+	if (r < 0) {
+		filter->fatal = 1;
+		return (ARCHIVE_FATAL);
+	}
+	reset_filter(client, r);
+	reset_filter(filter, offset);
+	if ((filter->restart)(filter) != ARCHIVE_OK) {
+		filter->fatal = 1;
+		return (ARCHIVE_FATAL);
+	}
+	a->archive.raw_position = r;
+	a->archive.file_position = offset;
+	if (a->decompression_thread)
+		__archive_read_pipeline_start(a);
+	return (offset);
+}
+
+/*
+ * The size of the raw input, or ARCHIVE_FAILED if the client can't
+ * seek.  The read position is left as it was.
+ */
+int64_t
+__archive_read_raw_size(struct archive_read *a)
+{
+	void *data = a->client.data;
+	int64_t cur, end;
+
+	/* The client may be behind the decompression thread's bridge,
+	 * so this goes straight to it rather than through the filters. */
+	if (a->client.seeker == NULL || a->filter == NULL)
+		return (ARCHIVE_FAILED);
+	cur = (a->client.seeker)(&a->archive, data, 0, SEEK_CUR);
+	if (cur < 0)
+		return (ARCHIVE_FAILED);
+	end = (a->client.seeker)(&a->archive, data, 0, SEEK_END);
+	if ((a->client.seeker)(&a->archive, data, cur, SEEK_SET) != cur)
+		return (ARCHIVE_FATAL);
+	return (end < 0 ? ARCHIVE_FAILED : end);
+}
+
+/*
+ * Read the last 'size' bytes (or all, if there are fewer) of the raw
+ * input into a buffer the caller must free, with the total size of
+ * the input in '*raw_size'.  This leaves the stream at an arbitrary
+ * place, so callers must follow it with __archive_read_seek_restart().
+ */
+ssize_t
+__archive_read_raw_tail(struct archive_read *a, size_t size, void **buff,
+    int64_t *raw_size)
+{
+	void *data = a->client.data;
+	const void *b;
+	char *p;
+	int64_t end, start;
+	size_t len = 0;
+	ssize_t bytes_read;
+
+	if (!__archive_read_can_restart(a))
+		return (ARCHIVE_FAILED);
+	__archive_read_pipeline_stop(a);
+	end = (a->client.seeker)(&a->archive, data, 0, SEEK_END);
+	if (end < 0)
+		return (ARCHIVE_FATAL);
+	start = end > (int64_t)size ? end - (int64_t)size : 0;
+	if ((a->client.seeker)(&a->archive, data, start, SEEK_SET) != start)
+		return (ARCHIVE_FATAL);
+	if ((p = malloc((size_t)(end - start) + 1)) == NULL) {
+		archive_set_error(&a->archive, ENOMEM,
+		    "Can't allocate buffer");
+		return (ARCHIVE_FATAL);
+	}
+	while (len < (size_t)(end - start)) {
+		bytes_read = (a->client.reader)(&a->archive, data, &b);
+		if (bytes_read < 0) {
+			free(p);
+			return (ARCHIVE_FATAL);
+		}
+		if (bytes_read == 0)
+			break;
+		if ((size_t)bytes_read > (size_t)(end - start) - len)
+			bytes_read = (size_t)(end - start) - len;
+		memcpy(p + len, b, bytes_read);
+		len += bytes_read;
+	}
+	*buff = p;
+	*raw_size = end;
+	return (len);
+}
@@ -23,6 +23,10 @@
  * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+/* copy_file_range() is a GNU extension on Linux. */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
 #include "archive_platform.h"
 __FBSDID("$FreeBSD: src/lib/libarchive/archive_read_data_into_fd.c,v 1.16 2008/05/23 05:01:29 cperciva Exp $");
 
@@ -32,16 +36,65 @@ __FBSDID("$FreeBSD: src/lib/libarchive/archive_read_data_into_fd.c,v 1.16 2008/0
 #ifdef HAVE_ERRNO_H
 #include <errno.h>
 #endif
+#ifdef HAVE_SYS_SENDFILE_H
+#include <sys/sendfile.h>
+#endif
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
 #endif
 
 #include "archive.h"
 #include "archive_private.h"
+#include "archive_read_private.h"
 
 /* Maximum amount of data to write at one time. */
 #define	MAX_WRITE	(1024 * 1024)
 
+#if defined(HAVE_COPY_FILE_RANGE) || \
+    (defined(HAVE_SENDFILE) && defined(HAVE_SYS_SENDFILE_H))
+#define	CAN_COPY_IN_KERNEL	1
+/*
+ * If the block lies in the file mapped by archive_read_open_mmap(),
+ * have the kernel copy it straight from the archive to the output.
+ * Returns the number of bytes copied, 0 if the caller should write()
+ * the block itself, or -1 on a real error.
+ */
+static ssize_t
+copy_in_kernel(struct archive_read *a, int fd, const char *p, size_t size)
+{
+	off_t in_offset;
+	ssize_t bytes;
+
+	if (a->client.mmap_base == NULL || p < a->client.mmap_base ||
+	    p + size > a->client.mmap_base + a->client.mmap_size)
+		return (0);
+	in_offset = p - a->client.mmap_base;
+#ifdef HAVE_COPY_FILE_RANGE
+	bytes = copy_file_range(a->client.mmap_fd, &in_offset,
+	    fd, NULL, size, 0);
+#else
+	bytes = sendfile(fd, a->client.mmap_fd, &in_offset, size);
+#endif
+	if (bytes > 0)
+		return (bytes);
+	if (bytes == 0)
+		return (0);
+	switch (errno) {
+	case EBADF:	/* fd opened with O_APPEND */
+	case EINVAL:
+	case ENOSYS:
+#ifdef EOPNOTSUPP
+	case EOPNOTSUPP:
+#endif
+#ifdef EXDEV
+	case EXDEV:
+#endif
+		return (0);
+	}
+	return (-1);
+}
+#endif
+
 /*
  * This implementation minimizes copying of data and is sparse-file aware.
  */
@@ -54,6 +107,9 @@ archive_read_data_into_fd(struct archive *a, int fd)
 	ssize_t bytes_written, total_written;
 	off_t offset;
 	off_t output_offset;
+#ifdef CAN_COPY_IN_KERNEL
+	int in_kernel = 1;
+#endif
 
 	__archive_check_magic(a, ARCHIVE_READ_MAGIC, ARCHIVE_STATE_DATA, "archive_read_data_into_fd");
 
@@ -75,7 +131,19 @@ archive_read_data_into_fd(struct archive *a, int fd)
 			bytes_to_write = size;
 			if (bytes_to_write > MAX_WRITE)
 				bytes_to_write = MAX_WRITE;
-			bytes_written = write(fd, p, bytes_to_write);
+			bytes_written = 0;
+#ifdef CAN_COPY_IN_KERNEL
+			if (in_kernel) {
+				bytes_written = copy_in_kernel(
+				    (struct archive_read *)a, fd,
+				    p, bytes_to_write);
+				/* Don't retry once the kernel declines. */
+				if (bytes_written == 0)
+					in_kernel = 0;
+			}
+			if (bytes_written == 0)
+#endif
+				bytes_written = write(fd, p, bytes_to_write);
 			if (bytes_written < 0) {
 				archive_set_error(a, errno, "Write error");
 				return (ARCHIVE_FATAL);
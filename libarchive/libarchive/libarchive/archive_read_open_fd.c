@@ -54,6 +54,9 @@ struct read_fd_data {
 	int	 fd;
 	size_t	 block_size;
 	char	 can_skip;
+	char	 use_pread;
+	int64_t	 start;		/* Seek offsets are relative to this. */
+	int64_t	 offset;	/* Next read position, with pread(). */
 	void	*buffer;
 };
 
@@ -64,6 +67,7 @@ static ssize_t	file_skip(struct archive *, void *, size_t request);
 #else
 static off_t	file_skip(struct archive *, void *, off_t request);
 #endif
+static int64_t	file_seek(struct archive *, void *, int64_t request, int);
 
 int
 archive_read_open_fd(struct archive *a, int fd, size_t block_size)
@@ -96,9 +100,24 @@ archive_read_open_fd(struct archive *a, int fd, size_t block_size)
 	 * way to determine if a device is a raw disk device, so we
 	 * only enable this optimization for regular files.
 	 */
+	mine->use_pread = 0;
 	if (S_ISREG(st.st_mode)) {
 		archive_read_extract_set_skip_file(a, st.st_dev, st.st_ino);
 		mine->can_skip = 1;
+		mine->start = lseek(fd, 0, SEEK_CUR);
+		if (mine->start >= 0) {
+			archive_read_set_seek_callback(a, file_seek);
+#ifdef HAVE_PREAD
+			/*
+			 * Regular files are read with pread() from our
+			 * own offset, so that several archive objects
+			 * can read the same descriptor at once without
+			 * disturbing each other.
+			 */
+			mine->offset = mine->start;
+			mine->use_pread = 1;
+#endif
+		}
 	} else
 		mine->can_skip = 0;
 #if defined(__CYGWIN__) || defined(_WIN32)
@@ -116,7 +135,15 @@ file_read(struct archive *a, void *client_data, const void **buff)
 	ssize_t bytes_read;
 
 	*buff = mine->buffer;
-	bytes_read = read(mine->fd, mine->buffer, mine->block_size);
+#ifdef HAVE_PREAD
+	if (mine->use_pread) {
+		bytes_read = pread(mine->fd, mine->buffer, mine->block_size,
+		    mine->offset);
+		if (bytes_read > 0)
+			mine->offset += bytes_read;
+	} else
+#endif
+		bytes_read = read(mine->fd, mine->buffer, mine->block_size);
 	if (bytes_read < 0) {
 		archive_set_error(a, errno, "Error reading fd %d", mine->fd);
 	}
@@ -142,6 +169,11 @@ file_skip(struct archive *a, void *client_data, off_t request)
 	if (request == 0)
 		return (0);
 
+	if (mine->use_pread) {
+		mine->offset += request;
+		return (request);
+	}
+
 	/*
 	 * Hurray for lazy evaluation: if the first lseek fails, the second
 	 * one will not be executed.
@@ -174,12 +206,57 @@ file_skip(struct archive *a, void *client_data, off_t request)
 	return (new_offset - old_offset);
 }
 
+static int64_t
+file_seek(struct archive *a, void *client_data, int64_t request, int whence)
+{
+	struct read_fd_data *mine = (struct read_fd_data *)client_data;
+	struct stat st;
+	int64_t target;
+
+	switch (whence) {
+	case SEEK_SET:
+		target = mine->start + request;
+		break;
+	case SEEK_CUR:
+		if (mine->use_pread)
+			target = mine->offset + request;
+		else
+			target = lseek(mine->fd, 0, SEEK_CUR) + request;
+		break;
+	case SEEK_END:
+		if (fstat(mine->fd, &st) != 0) {
+			archive_set_error(a, errno, "Can't stat fd %d",
+			    mine->fd);
+			return (ARCHIVE_FATAL);
+		}
+		target = st.st_size + request;
+		break;
+	default:
+		target = -1;
+		break;
+	}
+	if (target < mine->start) {
+		archive_set_error(a, EINVAL, "Error seeking fd %d", mine->fd);
+		return (ARCHIVE_FATAL);
+	}
+	if (mine->use_pread)
+		mine->offset = target;
+	else if (lseek(mine->fd, target, SEEK_SET) < 0) {
+		archive_set_error(a, errno, "Error seeking fd %d", mine->fd);
+		return (ARCHIVE_FATAL);
+	}
+	return (target - mine->start);
+}
+
 static int
 file_close(struct archive *a, void *client_data)
 {
 	struct read_fd_data *mine = (struct read_fd_data *)client_data;
 
 	(void)a; /* UNUSED */
+	/* Leave the descriptor where read() would have left it. */
+	if (mine->use_pread)
+		lseek(mine->fd, mine->offset, SEEK_SET);
 	free(mine->buffer);
 	free(mine);
 	return (ARCHIVE_OK);
@@ -60,6 +60,7 @@ struct read_file_data {
 	void	*buffer;
 	mode_t	 st_mode;  /* Mode bits for opened file. */
 	char	 can_skip; /* This file supports skipping. */
+	int64_t	 start;	   /* Seek offsets are relative to this. */
 	char	 filename[1]; /* Must be last! */
 };
 
@@ -70,6 +71,7 @@ static ssize_t	file_skip(struct archive *, void *, size_t request);
 #else
 static off_t	file_skip(struct archive *, void *, off_t request);
 #endif
+static int64_t	file_seek(struct archive *, void *, int64_t request, int);
 
 int
 archive_read_open_file(struct archive *a, const char *filename,
@@ -148,6 +150,9 @@ archive_read_open_filename(struct archive *a, const char *filename,
 		 * enable this optimization for regular files.
 		 */
 		mine->can_skip = 1;
+		mine->start = lseek(fd, 0, SEEK_CUR);
+		if (mine->start >= 0)
+			archive_read_set_seek_callback(a, file_seek);
 	}
 	return (archive_read_open2(a, mine,
 		NULL, file_read, file_skip, file_close));
@@ -230,6 +235,27 @@ file_skip(struct archive *a, void *client_data, off_t request)
 	return (new_offset - old_offset);
 }
 
+static int64_t
+file_seek(struct archive *a, void *client_data, int64_t request, int whence)
+{
+	struct read_file_data *mine = (struct read_file_data *)client_data;
+	int64_t r;
+
+	/* Offsets are relative to where stdin was positioned at open. */
+	if (whence == SEEK_SET)
+		request += mine->start;
+	r = lseek(mine->fd, request, whence);
+	if (r < mine->start) {
+		if (mine->filename[0] == '\0')
+			archive_set_error(a, errno, "Error seeking in stdin");
+		else
+			archive_set_error(a, errno, "Error seeking in '%s'",
+			    mine->filename);
+		return (ARCHIVE_FATAL);
+	}
+	return (r - mine->start);
+}
+
 static int
 file_close(struct archive *a, void *client_data)
 {
@@ -27,6 +27,7 @@
 __FBSDID("$FreeBSD: src/lib/libarchive/archive_read_open_memory.c,v 1.6 2007/07/06 15:51:59 kientzle Exp $");
 
 #include <errno.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -41,6 +42,7 @@ __FBSDID("$FreeBSD: src/lib/libarchive/archive_read_open_memory.c,v 1.6 2007/07/
  */
 
 struct read_memory_data {
+	unsigned char	*start;
 	unsigned char	*buffer;
 	unsigned char	*end;
 	ssize_t	 read_size;
@@ -54,6 +56,7 @@ static ssize_t	memory_read_skip(struct archive *, void *, size_t request);
 static off_t	memory_read_skip(struct archive *, void *, off_t request);
 #endif
 static ssize_t	memory_read(struct archive *, void *, const void **buff);
+static int64_t	memory_read_seek(struct archive *, void *, int64_t offset, int);
 
 int
 archive_read_open_memory(struct archive *a, void *buff, size_t size)
@@ -78,9 +81,10 @@ archive_read_open_memory2(struct archive *a, void *buff,
 		return (ARCHIVE_FATAL);
 	}
 	memset(mine, 0, sizeof(*mine));
-	mine->buffer = (unsigned char *)buff;
+	mine->start = mine->buffer = (unsigned char *)buff;
 	mine->end = mine->buffer + size;
 	mine->read_size = read_size;
+	archive_read_set_seek_callback(a, memory_read_seek);
 	return (archive_read_open2(a, mine, memory_read_open,
 		    memory_read, memory_read_skip, memory_read_close));
 }
@@ -143,6 +147,31 @@ memory_read_skip(struct archive *a, void *client_data, off_t skip)
 	return (skip);
 }
 
+/*
+ * Seeking is just setting the pointer.
+ */
+static int64_t
+memory_read_seek(struct archive *a, void *client_data, int64_t offset,
+    int whence)
+{
+	struct read_memory_data *mine = (struct read_memory_data *)client_data;
+
+	switch (whence) {
+	case SEEK_CUR:
+		offset += mine->buffer - mine->start;
+		break;
+	case SEEK_END:
+		offset += mine->end - mine->start;
+		break;
+	}
+	if (offset < 0 || offset > mine->end - mine->start) {
+		archive_set_error(a, EINVAL, "Seek out of range");
+		return (ARCHIVE_FATAL);
+	}
+	mine->buffer = mine->start + offset;
+	return (offset);
+}
+
 /*
  * Close is just cleaning up our one small bit of data.
  */
@@ -0,0 +1,217 @@
+/*-
+ * Copyright (c) 2026 The libarchive Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "archive_platform.h"
+__FBSDID("$FreeBSD$");
+
+#ifdef HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+#include <stdio.h>
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "archive.h"
+#include "archive_private.h"
+#include "archive_read_private.h"
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+/*
+ * Read an archive from a file by mapping all of it.  The read
+ * callback hands the whole mapping over in one block, so the
+ * read-ahead layer never has to copy data to make it contiguous,
+ * and a format reader that returns pointers into its input (tar,
+ * cpio, ar, zip's stored entries) gives the client pointers into the
+ * page cache.  The descriptor is remembered so that
+ * archive_read_data_into_fd() can copy those blocks in the kernel.
+ */
+
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+
+struct read_mmap_data {
+	int		 fd;
+	char		*base;
+	size_t		 size;
+	size_t		 position;
+};
+
+static int	mmap_close(struct archive *, void *);
+static ssize_t	mmap_read(struct archive *, void *, const void **buff);
+#if ARCHIVE_API_VERSION < 2
+static ssize_t	mmap_skip(struct archive *, void *, size_t request);
+#else
+static off_t	mmap_skip(struct archive *, void *, off_t request);
+#endif
+static int64_t	mmap_seek(struct archive *, void *, int64_t offset, int);
+
+int
+archive_read_open_mmap(struct archive *_a, const char *filename)
+{
+	struct archive_read *a = (struct archive_read *)_a;
+	struct read_mmap_data *mine;
+	struct stat st;
+	void *p;
+	int fd;
+
+	archive_clear_error(_a);
+	if (filename == NULL || filename[0] == '\0')
+		return (archive_read_open_filename(_a, filename, 10240));
+	fd = open(filename, O_RDONLY | O_BINARY);
+	if (fd < 0) {
+		archive_set_error(_a, errno, "Failed to open '%s'", filename);
+		return (ARCHIVE_FATAL);
+	}
+	/* Empty files, devices and huge files on 32-bit systems
+	 * are read the ordinary way. */
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0
+	    || (uint64_t)st.st_size > (uint64_t)(((size_t)-1) >> 1)) {
+		close(fd);
+		return (archive_read_open_filename(_a, filename, 10240));
+	}
+	p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (p == MAP_FAILED) {
+		close(fd);
+		return (archive_read_open_filename(_a, filename, 10240));
+	}
+#ifdef MADV_SEQUENTIAL
+	madvise(p, (size_t)st.st_size, MADV_SEQUENTIAL);
+#endif
+
+	mine = (struct read_mmap_data *)calloc(1, sizeof(*mine));
+	if (mine == NULL) {
+		munmap(p, (size_t)st.st_size);
+		close(fd);
+		archive_set_error(_a, ENOMEM, "No memory");
+		return (ARCHIVE_FATAL);
+	}
+	mine->fd = fd;
+	mine->base = p;
+	mine->size = (size_t)st.st_size;
+	archive_read_extract_set_skip_file(_a, st.st_dev, st.st_ino);
+	archive_read_set_seek_callback(_a, mmap_seek);
+	a->client.mmap_fd = fd;
+	a->client.mmap_base = mine->base;
+	a->client.mmap_size = mine->size;
+	return (archive_read_open2(_a, mine,
+		NULL, mmap_read, mmap_skip, mmap_close));
+}
+
+/* Everything that is left, in one block. */
+static ssize_t
+mmap_read(struct archive *a, void *client_data, const void **buff)
+{
+	struct read_mmap_data *mine = (struct read_mmap_data *)client_data;
+	size_t size;
+
+	(void)a; /* UNUSED */
+	*buff = mine->base + mine->position;
+	size = mine->size - mine->position;
+	mine->position = mine->size;
+	return ((ssize_t)size);
+}
+
+#if ARCHIVE_API_VERSION < 2
+static ssize_t
+mmap_skip(struct archive *a, void *client_data, size_t request)
+#else
+static off_t
+mmap_skip(struct archive *a, void *client_data, off_t request)
+#endif
+{
+	struct read_mmap_data *mine = (struct read_mmap_data *)client_data;
+
+	(void)a; /* UNUSED */
+	if ((uint64_t)request > mine->size - mine->position)
+		request = mine->size - mine->position;
+	mine->position += request;
+	return (request);
+}
+
+static int64_t
+mmap_seek(struct archive *a, void *client_data, int64_t offset, int whence)
+{
+	struct read_mmap_data *mine = (struct read_mmap_data *)client_data;
+
+	switch (whence) {
+	case SEEK_CUR:
+		offset += mine->position;
+		break;
+	case SEEK_END:
+		offset += mine->size;
+		break;
+	}
+	if (offset < 0 || (uint64_t)offset > mine->size) {
+		archive_set_error(a, EINVAL, "Seek out of range");
+		return (ARCHIVE_FATAL);
+	}
+	mine->position = (size_t)offset;
+	return (offset);
+}
+
+static int
+mmap_close(struct archive *_a, void *client_data)
+{
+	struct archive_read *a = (struct archive_read *)_a;
+	struct read_mmap_data *mine = (struct read_mmap_data *)client_data;
+
+	a->client.mmap_base = NULL;
+	a->client.mmap_size = 0;
+	munmap(mine->base, mine->size);
+	close(mine->fd);
+	free(mine);
+	return (ARCHIVE_OK);
+}
+
+#else /* !HAVE_MMAP */
+
+int
+archive_read_open_mmap(struct archive *a, const char *filename)
+{
+	return (archive_read_open_filename(a, filename, 10240));
+}
+
+#endif
@@ -0,0 +1,381 @@
+/*-
+ * Copyright (c) 2026 The libarchive Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "archive_platform.h"
+__FBSDID("$FreeBSD$");
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#include "archive.h"
+#include "archive_private.h"
+#include "archive_read_private.h"
+#include "archive_read_pipeline_private.h"
+
+#ifdef HAVE_PTHREAD_H
+
+/* Decompressed blocks the worker may run ahead by. */
+#define	PIPELINE_OUT_SLOTS	8
+/* Raw input queued for the worker, in pieces of at most IN_BLOCK. */
+#define	PIPELINE_IN_SLOTS	8
+#define	PIPELINE_IN_BLOCK	(64 * 1024)
+
+struct pipeline_slot {
+	char	*buff;
+	size_t	 size;
+	size_t	 len;
+};
+
+/*
+ * The chain while the worker runs:
+ *
+ *   a->filter (read = pipeline_read, on the caller's thread)
+ *      ... decompression filters, run by the worker through 'work' ...
+ *   bridge (read = bridge_read, fed from 'in')
+ *   client (read by the caller into 'in')
+ *
+ * Each ring is a queue of 'filled' slots from 'tail'; the slot at
+ * 'head' is being filled by its producer, and the slot at 'tail' is
+ * in use by the consumer while 'held' is set.
+ */
+struct archive_read_pipeline {
+	struct archive_read		*a;
+	/* Where the filters the worker runs report errors. */
+	struct archive_read		 shadow;
+	/* A copy of a->filter that the worker reads through. */
+	struct archive_read_filter	 work;
+	ssize_t				(*top_read)(struct archive_read_filter *,
+					    const void **);
+	struct archive_read_filter	*client;
+	struct archive_read_filter	*bridge;
+
+	pthread_mutex_t			 lock;
+	pthread_cond_t			 cond;
+	pthread_t			 thread;
+
+	struct pipeline_slot		 out[PIPELINE_OUT_SLOTS];
+	int				 out_head, out_tail, out_filled;
+	int				 out_held;
+	int				 done;	  /* Worker has finished. */
+	ssize_t				 status;  /* ... with this result. */
+
+	struct pipeline_slot		 in[PIPELINE_IN_SLOTS];
+	int				 in_head, in_tail, in_filled;
+	int				 in_held;
+	int				 in_eof;  /* Client has no more. */
+	ssize_t				 in_status;
+
+	int				 stop;
+};
+
+/* Runs on the worker: the next piece of raw input. */
+static ssize_t
+bridge_read(struct archive_read_filter *self, const void **buff)
+{
+	struct archive_read_pipeline *p = self->data;
+	ssize_t n;
+
+	pthread_mutex_lock(&p->lock);
+	if (p->in_held) {
+		p->in_held = 0;
+		p->in_tail = (p->in_tail + 1) % PIPELINE_IN_SLOTS;
+		p->in_filled--;
+		pthread_cond_broadcast(&p->cond);
+	}
+	while (p->in_filled == 0 && !p->in_eof && !p->stop)
+		pthread_cond_wait(&p->cond, &p->lock);
+	if (p->in_filled > 0 && !p->stop) {
+		p->in_held = 1;
+		*buff = p->in[p->in_tail].buff;
+		n = (ssize_t)p->in[p->in_tail].len;
+	} else {
+		*buff = NULL;
+		n = p->stop ? ARCHIVE_FATAL : p->in_status;
+	}
+	pthread_mutex_unlock(&p->lock);
+	return (n);
+}
+
+static void *
+worker(void *arg)
+{
+	struct archive_read_pipeline *p = arg;
+	struct pipeline_slot *s;
+	const void *b;
+	ssize_t n;
+
+	pthread_mutex_lock(&p->lock);
+	for (;;) {
+		while (p->out_filled == PIPELINE_OUT_SLOTS && !p->stop)
+			pthread_cond_wait(&p->cond, &p->lock);
+		if (p->stop) {
+			n = ARCHIVE_FATAL;
+			break;
+		}
+		s = &p->out[p->out_head];
+		pthread_mutex_unlock(&p->lock);
+
+		n = (p->top_read)(&p->work, &b);
+		if (n > 0 && s->size < (size_t)n) {
+			free(s->buff);
+			s->size = n;
+			if ((s->buff = malloc(s->size)) == NULL) {
+				s->size = 0;
+				archive_set_error(&p->shadow.archive, ENOMEM,
+				    "Can't allocate decompression buffer");
+				n = ARCHIVE_FATAL;
+			}
+		}
+		if (n > 0) {
+			memcpy(s->buff, b, n);
+			s->len = n;
+		}
+
+		pthread_mutex_lock(&p->lock);
+		if (n <= 0)
+			break;
+		p->out_head = (p->out_head + 1) % PIPELINE_OUT_SLOTS;
+		p->out_filled++;
+		pthread_cond_broadcast(&p->cond);
+	}
+	p->status = n;
+	p->done = 1;
+	pthread_cond_broadcast(&p->cond);
+	pthread_mutex_unlock(&p->lock);
+	return (NULL);
+}
+
+/* Runs on the caller: copy one piece of raw input for the worker. */
+static void
+feed(struct archive_read_pipeline *p)
+{
+	struct pipeline_slot *s = &p->in[p->in_head];
+	const void *h;
+	ssize_t avail;
+
+	h = __archive_read_filter_ahead(p->client, 1, &avail);
+	if (h != NULL) {
+		if (avail > PIPELINE_IN_BLOCK)
+			avail = PIPELINE_IN_BLOCK;
+		memcpy(s->buff, h, avail);
+		s->len = avail;
+		__archive_read_filter_consume(p->client, avail);
+	}
+	pthread_mutex_lock(&p->lock);
+	if (h != NULL) {
+		p->in_head = (p->in_head + 1) % PIPELINE_IN_SLOTS;
+		p->in_filled++;
+	} else {
+		/* The client's error, if any, is already on the archive. */
+		p->in_eof = 1;
+		p->in_status = avail < 0 ? ARCHIVE_FATAL : 0;
+	}
+	pthread_cond_broadcast(&p->cond);
+	pthread_mutex_unlock(&p->lock);
+}
+
+/* Replaces the read function of a->filter. */
+static ssize_t
+pipeline_read(struct archive_read_filter *self, const void **buff)
+{
+	struct archive_read_pipeline *p = self->archive->pipeline;
+	ssize_t n;
+
+	pthread_mutex_lock(&p->lock);
+	if (p->out_held) {
+		p->out_held = 0;
+		p->out_tail = (p->out_tail + 1) % PIPELINE_OUT_SLOTS;
+		p->out_filled--;
+		pthread_cond_broadcast(&p->cond);
+	}
+	for (;;) {
+		/* Keep the worker supplied with input. */
+		while (!p->in_eof && p->in_filled < PIPELINE_IN_SLOTS) {
+			pthread_mutex_unlock(&p->lock);
+			feed(p);
+			pthread_mutex_lock(&p->lock);
+		}
+		if (p->out_filled > 0) {
+			p->out_held = 1;
+			*buff = p->out[p->out_tail].buff;
+			n = (ssize_t)p->out[p->out_tail].len;
+			pthread_mutex_unlock(&p->lock);
+			return (n);
+		}
+		if (p->done)
+			break;
+		pthread_cond_wait(&p->cond, &p->lock);
+	}
+	n = p->status;
+	if (n < 0 && p->in_status == 0 && p->shadow.archive.error != NULL)
+		archive_copy_error(&p->a->archive, &p->shadow.archive);
+	pthread_mutex_unlock(&p->lock);
+	*buff = NULL;
+	return (n);
+}
+
+static void
+pipeline_free(struct archive_read_pipeline *p)
+{
+	int i;
+
+	for (i = 0; i < PIPELINE_OUT_SLOTS; i++)
+		free(p->out[i].buff);
+	for (i = 0; i < PIPELINE_IN_SLOTS; i++)
+		free(p->in[i].buff);
+	free(p->work.buffer);
+	if (p->bridge != NULL)
+		free(p->bridge->buffer);
+	free(p->bridge);
+	archive_string_free(&p->shadow.archive.error_string);
+	free(p);
+}
+
+/* Points each filter from 'f' down to the bridge at 'to'. */
+static void
+set_archive(struct archive_read_filter *f, struct archive_read_filter *end,
+    struct archive_read *to)
+{
+	for (; f != end; f = f->upstream)
+		f->archive = to;
+}
+
+void
+__archive_read_pipeline_start(struct archive_read *a)
+{
+	struct archive_read_pipeline *p;
+	struct archive_read_filter *top = a->filter, *f;
+	int i;
+
+	/* Nothing to decompress, or a filter that wants to skip. */
+	if (top == NULL || top->bidder == NULL || top->skip != NULL ||
+	    top->fatal || top->end_of_file || a->pipeline != NULL)
+		return;
+
+	p = calloc(1, sizeof(*p));
+	if (p == NULL)
+		return;
+	p->bridge = calloc(1, sizeof(*p->bridge));
+	if (p->bridge == NULL) {
+		pipeline_free(p);
+		return;
+	}
+	for (i = 0; i < PIPELINE_IN_SLOTS; i++) {
+		p->in[i].size = PIPELINE_IN_BLOCK;
+		if ((p->in[i].buff = malloc(PIPELINE_IN_BLOCK)) == NULL) {
+			pipeline_free(p);
+			return;
+		}
+	}
+	p->a = a;
+	p->shadow.archive.compression_code = a->archive.compression_code;
+	p->shadow.archive.compression_name = a->archive.compression_name;
+
+	/* Put the bridge between the lowest decompression filter
+	 * and the client. */
+	for (f = top; f->upstream->upstream != NULL; f = f->upstream)
+		;
+	p->client = f->upstream;
+	p->bridge->archive = &p->shadow;
+	p->bridge->read = bridge_read;
+	p->bridge->data = p;
+	p->bridge->name = "pipeline";
+	p->bridge->code = p->client->code;
+	f->upstream = p->bridge;
+	set_archive(top->upstream, p->bridge, &p->shadow);
+
+	/* The worker reads through a copy of the top filter that
+	 * reports errors to the shadow archive. */
+	p->work = *top;
+	p->work.archive = &p->shadow;
+	p->work.buffer = NULL;
+	p->work.buffer_size = 0;
+	p->top_read = top->read;
+
+	pthread_mutex_init(&p->lock, NULL);
+	pthread_cond_init(&p->cond, NULL);
+	a->pipeline = p;
+	top->read = pipeline_read;
+	if (pthread_create(&p->thread, NULL, worker, p) != 0) {
+		top->read = p->top_read;
+		a->pipeline = NULL;
+		set_archive(top->upstream, p->bridge, a);
+		f->upstream = p->client;
+		pthread_cond_destroy(&p->cond);
+		pthread_mutex_destroy(&p->lock);
+		pipeline_free(p);
+	}
+}
+
+void
+__archive_read_pipeline_stop(struct archive_read *a)
+{
+	struct archive_read_pipeline *p = a->pipeline;
+	struct archive_read_filter *f;
+
+	if (p == NULL)
+		return;
+	pthread_mutex_lock(&p->lock);
+	p->stop = 1;
+	pthread_cond_broadcast(&p->cond);
+	pthread_mutex_unlock(&p->lock);
+	pthread_join(p->thread, NULL);
+
+	a->filter->read = p->top_read;
+	for (f = a->filter; f->upstream != p->bridge; f = f->upstream)
+		;
+	f->upstream = p->client;
+	set_archive(a->filter->upstream, p->client, a);
+	a->pipeline = NULL;
+	pthread_cond_destroy(&p->cond);
+	pthread_mutex_destroy(&p->lock);
+	pipeline_free(p);
+}
+
+#else /* !HAVE_PTHREAD_H */
+
+void
+__archive_read_pipeline_start(struct archive_read *a)
+{
+	(void)a; /* UNUSED */
+}
+
+void
+__archive_read_pipeline_stop(struct archive_read *a)
+{
+	(void)a; /* UNUSED */
+}
+
+#endif
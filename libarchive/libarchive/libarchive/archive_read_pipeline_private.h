@@ -0,0 +1,56 @@
+/*-
+ * Copyright (c) 2026 The libarchive Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * $FreeBSD$
+ */
+
+#ifndef __LIBARCHIVE_BUILD
+#error This header is only to be used internally to libarchive.
+#endif
+
+#ifndef ARCHIVE_READ_PIPELINE_PRIVATE_H_INCLUDED
+#define	ARCHIVE_READ_PIPELINE_PRIVATE_H_INCLUDED
+
+#include "archive_read_private.h"
+
+/*
+ * Decompression on a separate thread, for
+ * archive_read_set_decompression_thread().
+ *
+ * Once the filter chain has been built, a worker thread takes over
+ * the decompression filters and runs a few blocks ahead of the format
+ * reader, handing finished blocks over through a small ring.  The
+ * client's callbacks are still only called on the caller's thread:
+ * the caller copies raw input to the worker whenever it asks for
+ * more output.  Errors the filters report on the worker are kept
+ * aside and passed on when the reader gets to them.
+ */
+
+/* Starts the worker, if the archive is compressed and threads are
+ * available; otherwise the archive is read as usual. */
+void	__archive_read_pipeline_start(struct archive_read *);
+/* Stops the worker and puts the filter chain back as it was. */
+void	__archive_read_pipeline_stop(struct archive_read *);
+
+#endif
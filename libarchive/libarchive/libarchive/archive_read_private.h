@@ -82,6 +82,9 @@ struct archive_read_filter {
 	int64_t (*skip)(struct archive_read_filter *self, int64_t request);
 	/* Close (just this filter) and free(self). */
 	int (*close)(struct archive_read_filter *self);
+	/* Forget the current stream and start decoding afresh at the
+	 * current upstream position.  Optional. */
+	int (*restart)(struct archive_read_filter *self);
 	/* My private data. */
 	void *data;
 
@@ -113,7 +116,14 @@ struct archive_read_filter {
 struct archive_read_client {
 	archive_read_callback	*reader;
 	archive_skip_callback	*skipper;
+	archive_seek_callback	*seeker;
 	archive_close_callback	*closer;
+	void			*data;
+	/* Set by archive_read_open_mmap(); lets data_into_fd copy
+	 * blocks that lie inside the mapping in the kernel. */
+	int			 mmap_fd;
+	const char		*mmap_base;
+	size_t			 mmap_size;
 };
 
 struct archive_read {
@@ -137,8 +147,12 @@ struct archive_read {
 	/* Callbacks to open/read/write/close client archive stream. */
 	struct archive_read_client client;
 
+	/* archive_read_set_decompression_thread() */
+	int		  decompression_thread;
+	struct archive_read_pipeline *pipeline;
+
 	/* Registered filter bidders. */
-	struct archive_read_filter_bidder bidders[8];
+	struct archive_read_filter_bidder bidders[16];
 
 	/* Last filter in chain */
 	struct archive_read_filter *filter;
@@ -164,7 +178,7 @@ struct archive_read {
 		int	(*read_data)(struct archive_read *, const void **, size_t *, off_t *);
 		int	(*read_data_skip)(struct archive_read *);
 		int	(*cleanup)(struct archive_read *);
-	}	formats[9];
+	}	formats[16];
 	struct archive_format_descriptor	*format; /* Active format. */
 
 	/*
@@ -195,5 +209,11 @@ ssize_t	__archive_read_filter_consume(struct archive_read_filter *, size_t);
 int64_t	__archive_read_skip(struct archive_read *, int64_t);
 int64_t	__archive_read_skip_lenient(struct archive_read *, int64_t);
 int64_t	__archive_read_filter_skip(struct archive_read_filter *, int64_t);
+int64_t	__archive_read_seek(struct archive_read *, int64_t, int);
+int	__archive_read_can_restart(struct archive_read *);
+int64_t	__archive_read_seek_restart(struct archive_read *, int64_t, int64_t);
+int64_t	__archive_read_raw_size(struct archive_read *);
+ssize_t	__archive_read_raw_tail(struct archive_read *, size_t, void **,
+	    int64_t *);
 int __archive_read_program(struct archive_read_filter *, const char *);
 #endif
@@ -44,6 +44,10 @@ archive_read_support_compression_all(struct archive *a)
 	archive_read_support_compression_lzma(a);
 	/* Xz falls back to "unxz" command-line program. */
 	archive_read_support_compression_xz(a);
+	/* Zstd falls back to "unzstd" command-line program. */
+	archive_read_support_compression_zstd(a);
+	/* Lz4 falls back to "unlz4" command-line program. */
+	archive_read_support_compression_lz4(a);
 	/* The decode code doesn't use an outside library. */
 	archive_read_support_compression_uu(a);
 	/* The decode code doesn't use an outside library. */
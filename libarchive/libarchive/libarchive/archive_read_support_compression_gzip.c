@@ -62,6 +62,7 @@ struct private_data {
 /* Gzip Filter. */
 static ssize_t	gzip_filter_read(struct archive_read_filter *, const void **);
 static int	gzip_filter_close(struct archive_read_filter *);
+static int	gzip_filter_restart(struct archive_read_filter *);
 #endif
 
 /*
@@ -264,6 +265,7 @@ gzip_bidder_init(struct archive_read_filter *self)
 	self->read = gzip_filter_read;
 	self->skip = NULL; /* not supported */
 	self->close = gzip_filter_close;
+	self->restart = gzip_filter_restart;
 
 	state->in_stream = 0; /* We're not actually within a stream yet. */
 
@@ -443,6 +445,29 @@ gzip_filter_read(struct archive_read_filter *self, const void **p)
 	return (decompressed);
 }
 
+/*
+ * Drop the member being decompressed; the next read expects a new
+ * member header.
+ */
+static int
+gzip_filter_restart(struct archive_read_filter *self)
+{
+	struct private_data *state;
+
+	state = (struct private_data *)self->data;
+	if (state->in_stream) {
+		state->in_stream = 0;
+		if (inflateEnd(&(state->stream)) != Z_OK) {
+			archive_set_error(&(self->archive->archive),
+			    ARCHIVE_ERRNO_MISC,
+			    "Failed to clean up gzip decompressor");
+			return (ARCHIVE_FATAL);
+		}
+	}
+	state->eof = 0;
+	return (ARCHIVE_OK);
+}
+
 /*
  * Clean up the decompressor.
  */
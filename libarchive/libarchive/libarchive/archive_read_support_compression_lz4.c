@@ -0,0 +1,289 @@
+/*-
+ * Copyright (c) 2026 The libarchive Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "archive_platform.h"
+
+__FBSDID("$FreeBSD$");
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+#include <stdio.h>
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_LZ4FRAME_H
+#include <lz4frame.h>
+#endif
+
+#include "archive.h"
+#include "archive_private.h"
+#include "archive_read_private.h"
+
+#if HAVE_LZ4FRAME_H
+struct private_data {
+	LZ4F_decompressionContext_t ctx;
+	unsigned char	*out_block;
+	size_t		 out_block_size;
+	char		 valid; /* True = in the middle of a frame */
+	char		 eof; /* True = found end of compressed data. */
+};
+
+/* Lz4 filter */
+static ssize_t	lz4_filter_read(struct archive_read_filter *, const void **);
+static int	lz4_filter_close(struct archive_read_filter *);
+#endif
+
+/*
+ * As with bzip2, the bidder is compiled even without liblz4 so that
+ * lz4 archives can be detected and handed to an external program.
+ */
+static int	lz4_reader_bid(struct archive_read_filter_bidder *, struct archive_read_filter *);
+static int	lz4_reader_init(struct archive_read_filter *);
+static int	lz4_reader_free(struct archive_read_filter_bidder *);
+
+int
+archive_read_support_compression_lz4(struct archive *_a)
+{
+	struct archive_read *a = (struct archive_read *)_a;
+	struct archive_read_filter_bidder *reader = __archive_read_get_bidder(a);
+
+	if (reader == NULL)
+		return (ARCHIVE_FATAL);
+
+	reader->data = NULL;
+	reader->bid = lz4_reader_bid;
+	reader->init = lz4_reader_init;
+	reader->options = NULL;
+	reader->free = lz4_reader_free;
+#if HAVE_LZ4FRAME_H
+	return (ARCHIVE_OK);
+#else
+	archive_set_error(_a, ARCHIVE_ERRNO_MISC,
+	    "Using external unlz4 program");
+	return (ARCHIVE_WARN);
+#endif
+}
+
+static int
+lz4_reader_free(struct archive_read_filter_bidder *self){
+	(void)self; /* UNUSED */
+	return (ARCHIVE_OK);
+}
+
+/*
+ * Test whether we can handle this data.
+ *
+ * An lz4 frame starts with the magic number 0x184D2204 (little-endian)
+ * and a FLG byte whose top two bits hold version 01 and whose bit 1
+ * is reserved.  The older "legacy" format is not recognized.
+ */
+static int
+lz4_reader_bid(struct archive_read_filter_bidder *self, struct archive_read_filter *filter)
+{
+	const unsigned char *buffer;
+	ssize_t avail;
+	int bits_checked;
+
+	(void)self; /* UNUSED */
+
+	/* Minimal lz4 frame is 11 bytes. */
+	buffer = __archive_read_filter_ahead(filter, 11, &avail);
+	if (buffer == NULL)
+		return (0);
+
+	bits_checked = 0;
+	if (memcmp(buffer, "\x04\x22\x4D\x18", 4) != 0)
+		return (0);
+	bits_checked += 32;
+
+	if ((buffer[4] & 0xC2) != 0x40)
+		return (0);
+	bits_checked += 3;
+
+	return (bits_checked);
+}
+
+#ifndef HAVE_LZ4FRAME_H
+
+/*
+ * If we don't have the library on this system, we can't actually do the
+ * decompression.  We can, however, still detect compressed archives
+ * and emit a useful message.
+ */
+static int
+lz4_reader_init(struct archive_read_filter *self)
+{
+	int r;
+
+	r = __archive_read_program(self, "unlz4");
+	/* Note: We set the format here even if __archive_read_program()
+	 * above fails.  We do, after all, know what the format is
+	 * even if we weren't able to read it. */
+	self->code = ARCHIVE_COMPRESSION_LZ4;
+	self->name = "lz4";
+	return (r);
+}
+
+
+#else
+
+/*
+ * Setup the callbacks.
+ */
+static int
+lz4_reader_init(struct archive_read_filter *self)
+{
+	static const size_t out_block_size = 64 * 1024;
+	void *out_block;
+	struct private_data *state;
+
+	self->code = ARCHIVE_COMPRESSION_LZ4;
+	self->name = "lz4";
+
+	state = (struct private_data *)calloc(sizeof(*state), 1);
+	out_block = (unsigned char *)malloc(out_block_size);
+	if (self == NULL || state == NULL || out_block == NULL) {
+		archive_set_error(&self->archive->archive, ENOMEM,
+		    "Can't allocate data for lz4 decompression");
+		free(out_block);
+		free(state);
+		return (ARCHIVE_FATAL);
+	}
+
+	self->data = state;
+	state->out_block_size = out_block_size;
+	state->out_block = out_block;
+	self->read = lz4_filter_read;
+	self->skip = NULL; /* not supported */
+	self->close = lz4_filter_close;
+
+	return (ARCHIVE_OK);
+}
+
+/*
+ * Return the next block of decompressed data.
+ */
+static ssize_t
+lz4_filter_read(struct archive_read_filter *self, const void **p)
+{
+	struct private_data *state;
+	const void *read_buf;
+	size_t decompressed, in_size, out_size, ret;
+	ssize_t avail;
+
+	state = (struct private_data *)self->data;
+
+	if (state->eof) {
+		*p = NULL;
+		return (0);
+	}
+
+	/* Try to fill the output buffer. */
+	decompressed = 0;
+	for (;;) {
+		if (!state->valid) {
+			/* Another frame may follow; anything else, such
+			 * as the zero padding after the last block, ends
+			 * the data. */
+			if (lz4_reader_bid(self->bidder, self->upstream) == 0) {
+				state->eof = 1;
+				*p = state->out_block;
+				return (decompressed);
+			}
+			if (state->ctx != NULL)
+				LZ4F_freeDecompressionContext(state->ctx);
+			state->ctx = NULL;
+			ret = LZ4F_createDecompressionContext(&state->ctx,
+			    LZ4F_VERSION);
+			if (LZ4F_isError(ret)) {
+				archive_set_error(&self->archive->archive,
+				    ARCHIVE_ERRNO_MISC,
+				    "Internal error initializing decompressor: %s",
+				    LZ4F_getErrorName(ret));
+				return (ARCHIVE_FATAL);
+			}
+			state->valid = 1;
+		}
+
+		read_buf =
+		    __archive_read_filter_ahead(self->upstream, 1, &avail);
+		if (read_buf == NULL && avail < 0)
+			return (ARCHIVE_FATAL);
+		/* There is no more data, but the frame is unfinished. */
+		if (read_buf == NULL || avail == 0) {
+			archive_set_error(&self->archive->archive,
+			    ARCHIVE_ERRNO_MISC, "Truncated lz4 input");
+			return (ARCHIVE_FATAL);
+		}
+
+		/* Decompress as much as we can in one pass. */
+		in_size = avail;
+		out_size = state->out_block_size - decompressed;
+		ret = LZ4F_decompress(state->ctx,
+		    state->out_block + decompressed, &out_size,
+		    read_buf, &in_size, NULL);
+		__archive_read_filter_consume(self->upstream, in_size);
+		if (LZ4F_isError(ret)) {
+			archive_set_error(&self->archive->archive,
+			    ARCHIVE_ERRNO_MISC, "lz4 decompression failed: %s",
+			    LZ4F_getErrorName(ret));
+			return (ARCHIVE_FATAL);
+		}
+		decompressed += out_size;
+		/* Found end of frame. */
+		if (ret == 0)
+			state->valid = 0;
+		/* If we filled our buffer, return it. */
+		if (decompressed == state->out_block_size) {
+			*p = state->out_block;
+			return (decompressed);
+		}
+	}
+}
+
+/*
+ * Clean up the decompressor.
+ */
+static int
+lz4_filter_close(struct archive_read_filter *self)
+{
+	struct private_data *state;
+
+	state = (struct private_data *)self->data;
+	if (state->ctx != NULL)
+		LZ4F_freeDecompressionContext(state->ctx);
+	free(state->out_block);
+	free(state);
+	return (ARCHIVE_OK);
+}
+
+#endif /* HAVE_LZ4FRAME_H */
@@ -65,6 +65,7 @@ struct private_data {
 /* Combined lzma/xz filter */
 static ssize_t	xz_filter_read(struct archive_read_filter *, const void **);
 static int	xz_filter_close(struct archive_read_filter *);
+static int	xz_filter_restart(struct archive_read_filter *);
 static int	xz_lzma_bidder_init(struct archive_read_filter *);
 
 #elif HAVE_LZMADEC_H && HAVE_LIBLZMADEC
@@ -355,6 +356,9 @@ xz_lzma_bidder_init(struct archive_read_filter *self)
 	self->read = xz_filter_read;
 	self->skip = NULL; /* not supported */
 	self->close = xz_filter_close;
+	/* An lzma file is a single stream, with nothing to restart at. */
+	if (self->code == ARCHIVE_COMPRESSION_XZ)
+		self->restart = xz_filter_restart;
 
 	state->stream.avail_in = 0;
 
@@ -484,6 +488,28 @@ xz_filter_read(struct archive_read_filter *self, const void **p)
 	return (decompressed);
 }
 
+/*
+ * Drop the stream being decompressed; the next read expects the
+ * header of a new xz stream.
+ */
+static int
+xz_filter_restart(struct archive_read_filter *self)
+{
+	struct private_data *state;
+
+	state = (struct private_data *)self->data;
+	lzma_end(&(state->stream));
+	memset(&(state->stream), 0, sizeof(state->stream));
+	state->eof = 0;
+	if (lzma_stream_decoder(&(state->stream), (1U << 30),/* memlimit */
+	    LZMA_CONCATENATED) != LZMA_OK) {
+		archive_set_error(&self->archive->archive, ENOMEM,
+		    "Internal error initializing compression library");
+		return (ARCHIVE_FATAL);
+	}
+	return (ARCHIVE_OK);
+}
+
 /*
  * Clean up the decompressor.
  */
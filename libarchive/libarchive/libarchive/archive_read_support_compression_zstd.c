@@ -0,0 +1,296 @@
+/*-
+ * Copyright (c) 2026 The libarchive Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "archive_platform.h"
+
+__FBSDID("$FreeBSD$");
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+#include <stdio.h>
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_ZSTD_H
+#include <zstd.h>
+#endif
+
+#include "archive.h"
+#include "archive_private.h"
+#include "archive_read_private.h"
+
+#if HAVE_ZSTD_H
+struct private_data {
+	ZSTD_DStream	*stream;
+	ZSTD_outBuffer	 out;
+	unsigned char	*out_block;
+	size_t		 out_block_size;
+	char		 valid; /* True = in the middle of a frame */
+	char		 eof; /* True = found end of compressed data. */
+};
+
+/* Zstd filter */
+static ssize_t	zstd_filter_read(struct archive_read_filter *, const void **);
+static int	zstd_filter_close(struct archive_read_filter *);
+#endif
+
+/*
+ * As with bzip2, the bidder is compiled even without libzstd so that
+ * zstd archives can be detected and handed to an external program.
+ */
+static int	zstd_reader_bid(struct archive_read_filter_bidder *, struct archive_read_filter *);
+static int	zstd_reader_init(struct archive_read_filter *);
+static int	zstd_reader_free(struct archive_read_filter_bidder *);
+
+int
+archive_read_support_compression_zstd(struct archive *_a)
+{
+	struct archive_read *a = (struct archive_read *)_a;
+	struct archive_read_filter_bidder *reader = __archive_read_get_bidder(a);
+
+	if (reader == NULL)
+		return (ARCHIVE_FATAL);
+
+	reader->data = NULL;
+	reader->bid = zstd_reader_bid;
+	reader->init = zstd_reader_init;
+	reader->options = NULL;
+	reader->free = zstd_reader_free;
+#if HAVE_ZSTD_H
+	return (ARCHIVE_OK);
+#else
+	archive_set_error(_a, ARCHIVE_ERRNO_MISC,
+	    "Using external unzstd program");
+	return (ARCHIVE_WARN);
+#endif
+}
+
+static int
+zstd_reader_free(struct archive_read_filter_bidder *self){
+	(void)self; /* UNUSED */
+	return (ARCHIVE_OK);
+}
+
+/*
+ * Test whether we can handle this data.
+ *
+ * A zstd frame starts with the magic number 0xFD2FB528 (little-endian)
+ * followed by a frame header descriptor whose bit 3 is reserved and
+ * must be zero.
+ */
+static int
+zstd_reader_bid(struct archive_read_filter_bidder *self, struct archive_read_filter *filter)
+{
+	const unsigned char *buffer;
+	ssize_t avail;
+	int bits_checked;
+
+	(void)self; /* UNUSED */
+
+	/* Minimal zstd frame is 9 bytes. */
+	buffer = __archive_read_filter_ahead(filter, 9, &avail);
+	if (buffer == NULL)
+		return (0);
+
+	bits_checked = 0;
+	if (memcmp(buffer, "\x28\xB5\x2F\xFD", 4) != 0)
+		return (0);
+	bits_checked += 32;
+
+	if (buffer[4] & 0x08)
+		return (0);
+	bits_checked += 1;
+
+	return (bits_checked);
+}
+
+#ifndef HAVE_ZSTD_H
+
+/*
+ * If we don't have the library on this system, we can't actually do the
+ * decompression.  We can, however, still detect compressed archives
+ * and emit a useful message.
+ */
+static int
+zstd_reader_init(struct archive_read_filter *self)
+{
+	int r;
+
+	r = __archive_read_program(self, "unzstd");
+	/* Note: We set the format here even if __archive_read_program()
+	 * above fails.  We do, after all, know what the format is
+	 * even if we weren't able to read it. */
+	self->code = ARCHIVE_COMPRESSION_ZSTD;
+	self->name = "zstd";
+	return (r);
+}
+
+
+#else
+
+/*
+ * Setup the callbacks.
+ */
+static int
+zstd_reader_init(struct archive_read_filter *self)
+{
+	size_t out_block_size = ZSTD_DStreamOutSize();
+	void *out_block;
+	struct private_data *state;
+
+	self->code = ARCHIVE_COMPRESSION_ZSTD;
+	self->name = "zstd";
+
+	state = (struct private_data *)calloc(sizeof(*state), 1);
+	out_block = (unsigned char *)malloc(out_block_size);
+	if (self == NULL || state == NULL || out_block == NULL) {
+		archive_set_error(&self->archive->archive, ENOMEM,
+		    "Can't allocate data for zstd decompression");
+		free(out_block);
+		free(state);
+		return (ARCHIVE_FATAL);
+	}
+	state->stream = ZSTD_createDStream();
+	if (state->stream == NULL) {
+		archive_set_error(&self->archive->archive, ENOMEM,
+		    "Can't allocate data for zstd decompression");
+		free(out_block);
+		free(state);
+		return (ARCHIVE_FATAL);
+	}
+
+	self->data = state;
+	state->out_block_size = out_block_size;
+	state->out_block = out_block;
+	self->read = zstd_filter_read;
+	self->skip = NULL; /* not supported */
+	self->close = zstd_filter_close;
+
+	return (ARCHIVE_OK);
+}
+
+/*
+ * Return the next block of decompressed data.
+ */
+static ssize_t
+zstd_filter_read(struct archive_read_filter *self, const void **p)
+{
+	struct private_data *state;
+	ZSTD_inBuffer in;
+	const void *read_buf;
+	ssize_t avail;
+	size_t ret;
+
+	state = (struct private_data *)self->data;
+
+	if (state->eof) {
+		*p = NULL;
+		return (0);
+	}
+
+	/* Empty our output buffer. */
+	state->out.dst = state->out_block;
+	state->out.size = state->out_block_size;
+	state->out.pos = 0;
+
+	/* Try to fill the output buffer. */
+	for (;;) {
+		if (!state->valid) {
+			/* Another frame may follow; anything else, such
+			 * as the zero padding after the last block, ends
+			 * the data. */
+			if (zstd_reader_bid(self->bidder, self->upstream) == 0) {
+				state->eof = 1;
+				*p = state->out_block;
+				return (state->out.pos);
+			}
+			ret = ZSTD_initDStream(state->stream);
+			if (ZSTD_isError(ret)) {
+				archive_set_error(&self->archive->archive,
+				    ARCHIVE_ERRNO_MISC,
+				    "Internal error initializing decompressor: %s",
+				    ZSTD_getErrorName(ret));
+				return (ARCHIVE_FATAL);
+			}
+			state->valid = 1;
+		}
+
+		read_buf =
+		    __archive_read_filter_ahead(self->upstream, 1, &avail);
+		if (read_buf == NULL && avail < 0)
+			return (ARCHIVE_FATAL);
+		/* There is no more data, but the frame is unfinished. */
+		if (read_buf == NULL || avail == 0) {
+			archive_set_error(&self->archive->archive,
+			    ARCHIVE_ERRNO_MISC, "Truncated zstd input");
+			return (ARCHIVE_FATAL);
+		}
+		in.src = read_buf;
+		in.size = avail;
+		in.pos = 0;
+
+		/* Decompress as much as we can in one pass. */
+		ret = ZSTD_decompressStream(state->stream, &state->out, &in);
+		__archive_read_filter_consume(self->upstream, in.pos);
+		if (ZSTD_isError(ret)) {
+			archive_set_error(&self->archive->archive,
+			    ARCHIVE_ERRNO_MISC, "zstd decompression failed: %s",
+			    ZSTD_getErrorName(ret));
+			return (ARCHIVE_FATAL);
+		}
+		/* Found end of frame. */
+		if (ret == 0)
+			state->valid = 0;
+		/* If we filled our buffer, return it. */
+		if (state->out.pos == state->out.size) {
+			*p = state->out_block;
+			return (state->out.pos);
+		}
+	}
+}
+
+/*
+ * Clean up the decompressor.
+ */
+static int
+zstd_filter_close(struct archive_read_filter *self)
+{
+	struct private_data *state;
+
+	state = (struct private_data *)self->data;
+	ZSTD_freeDStream(state->stream);
+	free(state->out_block);
+	free(state);
+	return (ARCHIVE_OK);
+}
+
+#endif /* HAVE_ZSTD_H */
@@ -107,6 +107,10 @@ struct cpio {
 	off_t			  entry_bytes_remaining;
 	off_t			  entry_offset;
 	off_t			  entry_padding;
+	/* SVR4 "crc" format: a 32-bit sum of the bytes of a regular file. */
+	int			  entry_has_sum;
+	uint32_t		  entry_sum;
+	uint32_t		  entry_expected_sum;
 };
 
 static int64_t	atol16(const char *, unsigned);
@@ -117,6 +121,7 @@ static int	archive_read_format_cpio_read_data(struct archive_read *,
 		    const void **, size_t *, off_t *);
 static int	archive_read_format_cpio_read_header(struct archive_read *,
 		    struct archive_entry *);
+static int	archive_read_format_cpio_skip(struct archive_read *);
 static int	be4(const unsigned char *);
 static int	find_odc_header(struct archive_read *);
 static int	find_newc_header(struct archive_read *);
@@ -155,7 +160,7 @@ archive_read_support_format_cpio(struct archive *_a)
 	    NULL,
 	    archive_read_format_cpio_read_header,
 	    archive_read_format_cpio_read_data,
-	    NULL,
+	    archive_read_format_cpio_skip,
 	    archive_read_format_cpio_cleanup);
 
 	if (r != ARCHIVE_OK)
@@ -197,7 +202,6 @@ archive_read_format_cpio_bid(struct archive_read *a)
 		 */
 	} else if (memcmp(p, "070702", 6) == 0) {
 		/* ASCII cpio archive (SVR4 with CRC) */
-		/* XXX TODO: Flag that we should check the CRC. XXX */
 		cpio->read_header = header_newc;
 		bid += 48;
 		/*
@@ -275,6 +279,35 @@ archive_read_format_cpio_read_header(struct archive_read *a,
 	return (r);
 }
 
+/*
+ * Add up the bytes in p, eight at a time: the bytes are summed into
+ * four 16-bit lanes of a 64-bit word, which can't overflow for 128
+ * steps.
+ */
+static uint32_t
+sum_bytes(uint32_t sum, const unsigned char *p, size_t len)
+{
+	const uint64_t m = 0x00ff00ff00ff00ffULL;
+	uint64_t acc, w;
+	size_t n;
+
+	while (len >= 8) {
+		acc = 0;
+		for (n = len / 8 > 128 ? 128 : len / 8; n > 0; n--) {
+			memcpy(&w, p, 8);
+			acc += (w & m) + ((w >> 8) & m);
+			p += 8;
+			len -= 8;
+		}
+		acc = (acc & 0x0000ffff0000ffffULL) +
+		    ((acc >> 16) & 0x0000ffff0000ffffULL);
+		sum += (uint32_t)(acc + (acc >> 32));
+	}
+	while (len-- > 0)
+		sum += *p++;
+	return (sum);
+}
+
 static int
 archive_read_format_cpio_read_data(struct archive_read *a,
     const void **buff, size_t *size, off_t *offset)
@@ -289,6 +322,9 @@ archive_read_format_cpio_read_data(struct archive_read *a,
 			return (ARCHIVE_FATAL);
 		if (bytes_read > cpio->entry_bytes_remaining)
 			bytes_read = cpio->entry_bytes_remaining;
+		if (cpio->entry_has_sum)
+			cpio->entry_sum = sum_bytes(cpio->entry_sum,
+			    *buff, bytes_read);
 		*size = bytes_read;
 		*offset = cpio->entry_offset;
 		cpio->entry_offset += bytes_read;
@@ -308,10 +344,39 @@ archive_read_format_cpio_read_data(struct archive_read *a,
 		*buff = NULL;
 		*size = 0;
 		*offset = cpio->entry_offset;
+		if (cpio->entry_has_sum) {
+			cpio->entry_has_sum = 0;
+			if (cpio->entry_sum != cpio->entry_expected_sum) {
+				archive_set_error(&a->archive,
+				    ARCHIVE_ERRNO_MISC,
+				    "cpio checksum error: 0x%lx should be 0x%lx",
+				    (unsigned long)cpio->entry_sum,
+				    (unsigned long)cpio->entry_expected_sum);
+				return (ARCHIVE_WARN);
+			}
+		}
 		return (ARCHIVE_EOF);
 	}
 }
 
+/* Skipped data isn't read, so its checksum isn't verified. */
+static int
+archive_read_format_cpio_skip(struct archive_read *a)
+{
+	struct cpio *cpio;
+	off_t bytes_skipped;
+
+	cpio = (struct cpio *)(a->format->data);
+	bytes_skipped = __archive_read_skip(a,
+	    cpio->entry_bytes_remaining + cpio->entry_padding);
+	if (bytes_skipped < 0)
+		return (ARCHIVE_FATAL);
+	cpio->entry_bytes_remaining = 0;
+	cpio->entry_padding = 0;
+	cpio->entry_has_sum = 0;
+	return (ARCHIVE_OK);
+}
+
 /*
  * Skip forward to the next cpio newc header by searching for the
  * 07070[12] string.  This should be generalized and merged with
@@ -446,6 +511,13 @@ header_newc(struct archive_read *a, struct cpio *cpio,
 	archive_entry_set_size(entry, cpio->entry_bytes_remaining);
 	/* Pad file contents to a multiple of 4. */
 	cpio->entry_padding = 3 & -cpio->entry_bytes_remaining;
+	/* Only regular files carry a checksum. */
+	cpio->entry_has_sum =
+	    a->archive.archive_format == ARCHIVE_FORMAT_CPIO_SVR4_CRC &&
+	    archive_entry_filetype(entry) == AE_IFREG;
+	cpio->entry_sum = 0;
+	cpio->entry_expected_sum =
+	    (uint32_t)atol16(header->c_crc, sizeof(header->c_crc));
 	return (r);
 }
 
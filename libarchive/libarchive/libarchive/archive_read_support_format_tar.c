@@ -71,6 +71,7 @@ static size_t wcslen(const wchar_t *s)
 #include "archive_entry.h"
 #include "archive_private.h"
 #include "archive_read_private.h"
+#include "archive_tar_index_private.h"
 
 #define tar_min(a,b) ((a) < (b) ? (a) : (b))
 
@@ -170,6 +171,8 @@ struct tar {
 	int			 sparse_gnu_major;
 	int			 sparse_gnu_minor;
 	char			 sparse_gnu_pending;
+	/* archive_read_tar_index_load() */
+	struct archive_tar_index *index;
 };
 
 static ssize_t	UTF8_mbrtowc(wchar_t *pwc, const char *s, size_t n);
@@ -286,6 +289,7 @@ archive_read_format_tar_cleanup(struct archive_read *a)
 	archive_string_free(&tar->longname);
 	archive_string_free(&tar->longlink);
 	free(tar->pax_entry);
+	__archive_tar_index_free(tar->index);
 	free(tar);
 	(a->format->data) = NULL;
 	return (ARCHIVE_OK);
@@ -2453,3 +2457,277 @@ tohex(int c)
 	else
 		return (-1);
 }
+
+/*
+ * Random access through an index.
+ */
+
+/* How much of the end of an archive to search for an index footer;
+ * there may be a block of padding after it. */
+#define	TAR_INDEX_TAIL	(1024 * 1024)
+
+/*
+ * Find the tar reader's data, committing the archive to that reader
+ * and, if 'loaded', insisting on an index.
+ */
+static struct tar *
+tar_index_data(struct archive_read *a, int loaded)
+{
+	struct archive_format_descriptor *format;
+	struct tar *tar;
+	int i, slots;
+
+	slots = sizeof(a->formats) / sizeof(a->formats[0]);
+	for (i = 0; i < slots; i++) {
+		if (a->formats[i].bid == archive_read_format_tar_bid)
+			break;
+	}
+	if (i >= slots) {
+		archive_set_error(&a->archive, ARCHIVE_ERRNO_MISC,
+		    "Tar support is not enabled");
+		return (NULL);
+	}
+	format = &(a->formats[i]);
+	if (a->format != NULL && a->format != format) {
+		archive_set_error(&a->archive, ARCHIVE_ERRNO_MISC,
+		    "Archive is not being read as a tar file");
+		return (NULL);
+	}
+	tar = (struct tar *)format->data;
+	if (loaded && tar->index == NULL) {
+		archive_set_error(&a->archive, ARCHIVE_ERRNO_MISC,
+		    "No tar index has been loaded");
+		return (NULL);
+	}
+	a->format = format;
+	return (tar);
+}
+
+/* Parse the index ending in a footer somewhere in 'buff'. */
+static struct archive_tar_index *
+tar_index_parse(struct archive_read *a, const void *buff, size_t size)
+{
+	struct archive_tar_index_footer footer;
+	struct archive_tar_index *idx;
+	ssize_t pos;
+
+	pos = __archive_tar_index_find_footer(buff, size, &footer);
+	if (pos < 0 || footer.size > pos) {
+		archive_set_error(&a->archive, ARCHIVE_ERRNO_FILE_FORMAT,
+		    "No tar index found");
+		return (NULL);
+	}
+	idx = __archive_tar_index_read((const char *)buff + pos - footer.size,
+	    (size_t)footer.size, footer.crc);
+	if (idx == NULL)
+		archive_set_error(&a->archive, ARCHIVE_ERRNO_FILE_FORMAT,
+		    "Damaged tar index");
+	return (idx);
+}
+
+/*
+ * Read the index appended to the archive: its footer is near the end
+ * of the file and says where the index itself starts.
+ */
+static struct archive_tar_index *
+tar_index_trailer(struct archive_read *a)
+{
+	struct archive_tar_index_footer footer;
+	struct archive_tar_index *idx = NULL;
+	const void *p;
+	void *tail;
+	int64_t raw_size;
+	ssize_t len;
+
+	if (a->archive.file_count != 0) {
+		archive_set_error(&a->archive, ARCHIVE_ERRNO_MISC,
+		    "The index must be loaded before reading any entries");
+		return (NULL);
+	}
+	len = __archive_read_raw_tail(a, TAR_INDEX_TAIL, &tail, &raw_size);
+	if (len == ARCHIVE_FAILED) {
+		archive_set_error(&a->archive, ARCHIVE_ERRNO_MISC,
+		    "Can't seek in this archive");
+		return (NULL);
+	}
+	if (len >= 0) {
+		if (__archive_tar_index_find_footer(tail, len, &footer) < 0)
+			archive_set_error(&a->archive,
+			    ARCHIVE_ERRNO_FILE_FORMAT,
+			    "No tar index at the end of the archive");
+		else if (__archive_read_seek_restart(a, footer.raw_offset,
+		    footer.offset) >= 0) {
+			p = __archive_read_ahead(a, (size_t)footer.size, NULL);
+			if (p != NULL)
+				idx = __archive_tar_index_read(p,
+				    (size_t)footer.size, footer.crc);
+			/* The index describes the archive before it. */
+			if (idx != NULL &&
+			    idx->archive_size != footer.raw_offset) {
+				__archive_tar_index_free(idx);
+				idx = NULL;
+			}
+			if (idx == NULL)
+				archive_set_error(&a->archive,
+				    ARCHIVE_ERRNO_FILE_FORMAT,
+				    "Damaged tar index");
+		}
+		free(tail);
+	}
+	/* Back to the start, whatever happened. */
+	if (__archive_read_seek_restart(a, 0, 0) < 0) {
+		__archive_tar_index_free(idx);
+		return (NULL);
+	}
+	return (idx);
+}
+
+int
+archive_read_tar_index_load(struct archive *_a, const void *buff,
+    size_t size)
+{
+	struct archive_read *a = (struct archive_read *)_a;
+	struct archive_tar_index *idx;
+	struct tar *tar;
+	int64_t raw_size;
+
+	__archive_check_magic(_a, ARCHIVE_READ_MAGIC,
+	    ARCHIVE_STATE_HEADER | ARCHIVE_STATE_DATA | ARCHIVE_STATE_EOF,
+	    "archive_read_tar_index_load");
+	if ((tar = tar_index_data(a, 0)) == NULL)
+		return (ARCHIVE_FATAL);
+	if (buff == NULL) {
+		if ((idx = tar_index_trailer(a)) == NULL)
+			return (a->filter->fatal ? ARCHIVE_FATAL :
+			    ARCHIVE_FAILED);
+	} else {
+		if ((idx = tar_index_parse(a, buff, size)) == NULL)
+			return (ARCHIVE_FAILED);
+		/* An index left over from an older archive would send
+		 * us to the wrong places. */
+		raw_size = __archive_read_raw_size(a);
+		if (raw_size >= 0 && raw_size != idx->archive_size) {
+			__archive_tar_index_free(idx);
+			archive_set_error(&a->archive, ARCHIVE_ERRNO_MISC,
+			    "Tar index does not match the archive");
+			return (ARCHIVE_FAILED);
+		}
+	}
+	__archive_tar_index_free(tar->index);
+	tar->index = idx;
+	return (ARCHIVE_OK);
+}
+
+int
+archive_read_tar_entry_count(struct archive *_a)
+{
+	struct archive_read *a = (struct archive_read *)_a;
+	struct tar *tar;
+
+	__archive_check_magic(_a, ARCHIVE_READ_MAGIC,
+	    ARCHIVE_STATE_HEADER | ARCHIVE_STATE_DATA | ARCHIVE_STATE_EOF,
+	    "archive_read_tar_entry_count");
+	if ((tar = tar_index_data(a, 1)) == NULL)
+		return (ARCHIVE_FATAL);
+	return ((int)tar->index->nentries);
+}
+
+const char *
+archive_read_tar_entry_name(struct archive *_a, int n)
+{
+	struct archive_read *a = (struct archive_read *)_a;
+	struct tar *tar;
+
+	__archive_check_magic(_a, ARCHIVE_READ_MAGIC,
+	    ARCHIVE_STATE_HEADER | ARCHIVE_STATE_DATA | ARCHIVE_STATE_EOF,
+	    "archive_read_tar_entry_name");
+	if ((tar = tar_index_data(a, 1)) == NULL)
+		return (NULL);
+	if (n < 0 || (size_t)n >= tar->index->nentries)
+		return (NULL);
+	return (__archive_tar_index_name(tar->index, n));
+}
+
+int
+archive_read_tar_seek_entry(struct archive *_a, int n)
+{
+	struct archive_read *a = (struct archive_read *)_a;
+	const struct archive_tar_index_restart *rs;
+	struct archive_tar_index_restart here;
+	struct tar *tar;
+	int64_t target, pos;
+
+	__archive_check_magic(_a, ARCHIVE_READ_MAGIC,
+	    ARCHIVE_STATE_HEADER | ARCHIVE_STATE_DATA | ARCHIVE_STATE_EOF,
+	    "archive_read_tar_seek_entry");
+	if ((tar = tar_index_data(a, 1)) == NULL)
+		return (ARCHIVE_FATAL);
+	if (n < 0 || (size_t)n >= tar->index->nentries) {
+		archive_set_error(&a->archive, ARCHIVE_ERRNO_MISC,
+		    "No tar entry %d", n);
+		return (ARCHIVE_FAILED);
+	}
+	target = tar->index->entries[n].header_offset;
+	pos = a->archive.file_position;
+
+	/*
+	 * Uncompressed data can be entered anywhere; compressed data
+	 * only at the last restart point before the header.  Reading
+	 * on is cheaper than restarting if we are already past it.
+	 */
+	if (a->filter->upstream == NULL) {
+		here.raw_offset = here.offset = target;
+		rs = &here;
+	} else
+		rs = __archive_tar_index_restart(tar->index, target);
+	if (pos <= target && (rs == NULL || pos >= rs->offset))
+		rs = NULL;
+	else if (rs != NULL && __archive_read_can_restart(a)) {
+		if (__archive_read_seek_restart(a, rs->raw_offset,
+		    rs->offset) < 0) {
+			a->archive.state = ARCHIVE_STATE_FATAL;
+			return (ARCHIVE_FATAL);
+		}
+		pos = rs->offset;
+	} else if (pos > target) {
+		archive_set_error(&a->archive, ARCHIVE_ERRNO_MISC,
+		    "Can't seek backward in this archive");
+		return (ARCHIVE_FAILED);
+	}
+	if (target > pos && __archive_read_skip(a, target - pos)
+	    != target - pos) {
+		archive_set_error(&a->archive, ARCHIVE_ERRNO_FILE_FORMAT,
+		    "Truncated tar archive");
+		a->archive.state = ARCHIVE_STATE_FATAL;
+		return (ARCHIVE_FATAL);
+	}
+
+	/* Nothing is left of the entry we were in. */
+	tar->entry_bytes_remaining = 0;
+	tar->entry_padding = 0;
+	tar->sparse_gnu_pending = 0;
+	gnu_clear_sparse_list(tar);
+	a->archive.state = ARCHIVE_STATE_HEADER;
+	return (ARCHIVE_OK);
+}
+
+int
+archive_read_tar_seek_name(struct archive *_a, const char *pathname)
+{
+	struct archive_read *a = (struct archive_read *)_a;
+	struct tar *tar;
+	int n;
+
+	__archive_check_magic(_a, ARCHIVE_READ_MAGIC,
+	    ARCHIVE_STATE_HEADER | ARCHIVE_STATE_DATA | ARCHIVE_STATE_EOF,
+	    "archive_read_tar_seek_name");
+	if ((tar = tar_index_data(a, 1)) == NULL)
+		return (ARCHIVE_FATAL);
+	n = __archive_tar_index_lookup(tar->index, pathname);
+	if (n < 0) {
+		archive_set_error(&a->archive, ARCHIVE_ERRNO_MISC,
+		    "No tar entry named %s", pathname);
+		return (ARCHIVE_FAILED);
+	}
+	return (archive_read_tar_seek_entry(_a, n));
+}
@@ -29,10 +29,16 @@ __FBSDID("$FreeBSD: head/lib/libarchive/archive_read_support_format_zip.c 201102
 #ifdef HAVE_ERRNO_H
 #include <errno.h>
 #endif
+#ifdef HAVE_LIMITS_H
+#include <limits.h>
+#endif
 #include <stdio.h>
 #ifdef HAVE_STDLIB_H
 #include <stdlib.h>
 #endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
 #include <time.h>
 #ifdef HAVE_ZLIB_H
 #include <zlib.h>
@@ -44,9 +50,7 @@ __FBSDID("$FreeBSD: head/lib/libarchive/archive_read_support_format_zip.c 201102
 #include "archive_read_private.h"
 #include "archive_endian.h"
 
-#ifndef HAVE_ZLIB_H
 #include "archive_crc32.h"
-#endif
 
 struct zip {
 	/* entry_bytes_remaining is the number of bytes we expect. */
@@ -92,6 +96,33 @@ struct zip {
 	struct archive_string	pathname;
 	struct archive_string	extra;
 	char	format_name[64];
+
+	/* Central directory index; only used by the seekable reader. */
+	struct zip_index	*index;
+	char			index_owned;
+	int			next_entry;
+};
+
+/*
+ * One central directory record.  The central directory is the only
+ * place the sizes and CRC are guaranteed to be, so the seekable
+ * reader takes them from here rather than the local file header.
+ */
+struct zip_index_entry {
+	int64_t		local_header_offset;
+	int64_t		compressed_size;
+	int64_t		uncompressed_size;
+	unsigned long	crc32;
+	mode_t		mode;
+	const char	*name;
+};
+
+struct zip_index {
+	struct zip_index_entry	*entries;
+	/* The same entries, sorted by name for bsearch(). */
+	struct zip_index_entry	**by_name;
+	int			 nentries;
+	struct archive_string	 names;
 };
 
 #define ZIP_LENGTH_AT_END	8
@@ -136,6 +167,12 @@ static int	zip_read_file_header(struct archive_read *a,
 		    struct archive_entry *entry, struct zip *zip);
 static time_t	zip_time(const char *);
 static int	process_extra(struct archive_read *a, const void* extra, struct zip* zip);
+static int	archive_read_format_zip_seekable_bid(struct archive_read *);
+static int	archive_read_format_zip_seekable_cleanup(struct archive_read *);
+static int	archive_read_format_zip_seekable_read_data_skip(struct archive_read *);
+static int	archive_read_format_zip_seekable_read_header(struct archive_read *,
+		    struct archive_entry *);
+static int	zip_build_index(struct archive_read *, struct zip *);
 
 int
 archive_read_support_format_zip(struct archive *_a)
@@ -166,6 +203,42 @@ archive_read_support_format_zip(struct archive *_a)
 	return (ARCHIVE_OK);
 }
 
+/*
+ * The seekable reader locates the central directory at the end of
+ * the file and reads entries in central directory order, seeking to
+ * each local file header in turn.  It only bids when the client
+ * supplied a seek callback and the data is not compressed; otherwise
+ * the streaming reader above handles the archive.
+ */
+int
+archive_read_support_format_zip_seekable(struct archive *_a)
+{
+	struct archive_read *a = (struct archive_read *)_a;
+	struct zip *zip;
+	int r;
+
+	zip = (struct zip *)malloc(sizeof(*zip));
+	if (zip == NULL) {
+		archive_set_error(&a->archive, ENOMEM, "Can't allocate zip data");
+		return (ARCHIVE_FATAL);
+	}
+	memset(zip, 0, sizeof(*zip));
+
+	r = __archive_read_register_format(a,
+	    zip,
+	    "zip",
+	    archive_read_format_zip_seekable_bid,
+	    NULL,
+	    archive_read_format_zip_seekable_read_header,
+	    archive_read_format_zip_read_data,
+	    archive_read_format_zip_seekable_read_data_skip,
+	    archive_read_format_zip_seekable_cleanup);
+
+	if (r != ARCHIVE_OK)
+		free(zip);
+	return (ARCHIVE_OK);
+}
+
 
 static int
 archive_read_format_zip_bid(struct archive_read *a)
@@ -302,7 +375,7 @@ archive_read_format_zip_read_header(struct archive_read *a,
 	zip->end_of_entry = 0;
 	zip->entry_uncompressed_bytes_read = 0;
 	zip->entry_compressed_bytes_read = 0;
-	zip->entry_crc32 = crc32(0, NULL, 0);
+	zip->entry_crc32 = __archive_crc32(0, NULL, 0);
 	if ((h = __archive_read_ahead(a, 4, NULL)) == NULL)
 		return (ARCHIVE_FATAL);
 
@@ -544,7 +617,7 @@ archive_read_format_zip_read_data(struct archive_read *a,
 		return (r);
 	/* Update checksum */
 	if (*size)
-		zip->entry_crc32 = crc32(zip->entry_crc32, *buff, *size);
+		zip->entry_crc32 = __archive_crc32(zip->entry_crc32, *buff, *size);
 	/* If we hit the end, swallow any end-of-data marker. */
 	if (zip->end_of_entry) {
 		if (zip->flags & ZIP_LENGTH_AT_END) {
@@ -919,3 +992,478 @@ process_extra(struct archive_read *a, const void* extra, struct zip* zip)
 	}
 	return ARCHIVE_OK;
 }
+
+/*
+ * Seekable reader.
+ */
+
+static int
+zip_index_cmp(const void *p1, const void *p2)
+{
+	const struct zip_index_entry *e1, *e2;
+
+	e1 = *(const struct zip_index_entry * const *)p1;
+	e2 = *(const struct zip_index_entry * const *)p2;
+	return (strcmp(e1->name, e2->name));
+}
+
+static void
+zip_free_index(struct zip_index *index)
+{
+	if (index == NULL)
+		return;
+	free(index->entries);
+	free(index->by_name);
+	archive_string_free(&index->names);
+	free(index);
+}
+
+/*
+ * Parse the central directory into 'index'.  The current read
+ * position is not preserved; zip_build_index() takes care of that.
+ */
+static int
+zip_read_directory(struct archive_read *a, struct zip_index *index)
+{
+	const char *p, *eocd, *extra;
+	struct zip_index_entry *e;
+	int64_t size, tail_pos, eocd_pos, base, cd_offset, cd_size;
+	int64_t nentries, z64_offset, pos;
+	size_t tail, name_length, extra_length, comment_length;
+	unsigned datasize, external;
+	int i, offset;
+
+	/*
+	 * The end of central directory record is 22 bytes followed
+	 * by a comment of up to 64k, so it is somewhere in the last
+	 * 65557 bytes of the file.
+	 */
+	if ((size = __archive_read_seek(a, 0, SEEK_END)) < 0)
+		return ((int)size);
+	tail = size < 22 + 65535 ? (size_t)size : 22 + 65535;
+	if ((tail_pos = __archive_read_seek(a, size - tail, SEEK_SET)) < 0)
+		return ((int)tail_pos);
+	if ((p = __archive_read_ahead(a, tail, NULL)) == NULL) {
+		archive_set_error(&a->archive, ARCHIVE_ERRNO_FILE_FORMAT,
+		    "Truncated ZIP file");
+		return (ARCHIVE_FATAL);
+	}
+	for (eocd = p + tail - 22; eocd >= p; eocd--) {
+		if (memcmp(eocd, "PK\005\006", 4) == 0
+		    && (eocd - p) + 22 + archive_le16dec(eocd + 20) <= tail)
+			break;
+	}
+	if (eocd < p) {
+		archive_set_error(&a->archive, ARCHIVE_ERRNO_FILE_FORMAT,
+		    "Can't find ZIP end of central directory");
+		return (ARCHIVE_FAILED);
+	}
+	eocd_pos = tail_pos + (eocd - p);
+	nentries = archive_le16dec(eocd + 10);
+	cd_size = archive_le32dec(eocd + 12);
+	cd_offset = archive_le32dec(eocd + 16);
+	/*
+	 * Offsets in the directory are relative to the start of the
+	 * zip data; 'base' accounts for anything prepended to it,
+	 * such as a self-extractor.
+	 */
+	base = eocd_pos - cd_size - cd_offset;
+
+	/* Zip64 end of central directory locator and record. */
+	if (eocd - p >= 20 + 56 && memcmp(eocd - 20, "PK\006\007", 4) == 0) {
+		z64_offset = archive_le64dec(eocd - 20 + 8);
+		if (memcmp(eocd - 20 - 56, "PK\006\006", 4) != 0) {
+			archive_set_error(&a->archive,
+			    ARCHIVE_ERRNO_FILE_FORMAT,
+			    "Unsupported ZIP64 end of central directory");
+			return (ARCHIVE_FAILED);
+		}
+		nentries = archive_le64dec(eocd - 20 - 56 + 32);
+		cd_size = archive_le64dec(eocd - 20 - 56 + 40);
+		cd_offset = archive_le64dec(eocd - 20 - 56 + 48);
+		base = (eocd_pos - 20 - 56) - z64_offset;
+	}
+	if (base < 0 || nentries < 0 || nentries > cd_size / 46
+	    || nentries > INT_MAX / (int64_t)sizeof(*index->entries)) {
+		archive_set_error(&a->archive, ARCHIVE_ERRNO_FILE_FORMAT,
+		    "Bad ZIP central directory");
+		return (ARCHIVE_FAILED);
+	}
+
+	index->entries = (struct zip_index_entry *)
+	    calloc(nentries + 1, sizeof(*index->entries));
+	index->by_name = (struct zip_index_entry **)
+	    calloc(nentries + 1, sizeof(*index->by_name));
+	if (index->entries == NULL || index->by_name == NULL) {
+		archive_set_error(&a->archive, ENOMEM,
+		    "Can't allocate ZIP index");
+		return (ARCHIVE_FATAL);
+	}
+
+	if ((pos = __archive_read_seek(a, base + cd_offset, SEEK_SET)) < 0)
+		return ((int)pos);
+	for (i = 0; i < nentries; i++) {
+		if ((p = __archive_read_ahead(a, 46, NULL)) == NULL
+		    || memcmp(p, "PK\001\002", 4) != 0) {
+			archive_set_error(&a->archive,
+			    ARCHIVE_ERRNO_FILE_FORMAT,
+			    "Bad ZIP central directory record");
+			return (ARCHIVE_FAILED);
+		}
+		name_length = archive_le16dec(p + 28);
+		extra_length = archive_le16dec(p + 30);
+		comment_length = archive_le16dec(p + 32);
+		p = __archive_read_ahead(a,
+		    46 + name_length + extra_length + comment_length, NULL);
+		if (p == NULL) {
+			archive_set_error(&a->archive,
+			    ARCHIVE_ERRNO_FILE_FORMAT,
+			    "Truncated ZIP central directory");
+			return (ARCHIVE_FATAL);
+		}
+
+		e = &index->entries[i];
+		e->crc32 = archive_le32dec(p + 16);
+		e->compressed_size = archive_le32dec(p + 20);
+		e->uncompressed_size = archive_le32dec(p + 24);
+		external = archive_le32dec(p + 38);
+		e->local_header_offset = archive_le32dec(p + 42);
+
+		/* Zip64 extra field holds whichever values overflowed. */
+		extra = p + 46 + name_length;
+		offset = 0;
+		while (offset + 4 <= (int)extra_length) {
+			datasize = archive_le16dec(extra + offset + 2);
+			if (offset + 4 + datasize > extra_length)
+				break;
+			if (archive_le16dec(extra + offset) == 0x0001) {
+				const char *q = extra + offset + 4;
+				const char *end = q + datasize;
+
+				if (e->uncompressed_size == 0xffffffff
+				    && q + 8 <= end) {
+					e->uncompressed_size =
+					    archive_le64dec(q);
+					q += 8;
+				}
+				if (e->compressed_size == 0xffffffff
+				    && q + 8 <= end) {
+					e->compressed_size =
+					    archive_le64dec(q);
+					q += 8;
+				}
+				if (e->local_header_offset == 0xffffffff
+				    && q + 8 <= end)
+					e->local_header_offset =
+					    archive_le64dec(q);
+			}
+			offset += 4 + datasize;
+		}
+		e->local_header_offset += base;
+		if (e->local_header_offset < 0
+		    || e->local_header_offset >= base + cd_offset) {
+			archive_set_error(&a->archive,
+			    ARCHIVE_ERRNO_FILE_FORMAT,
+			    "Bad ZIP local header offset");
+			return (ARCHIVE_FAILED);
+		}
+
+		/*
+		 * Directories are marked with a trailing '/' as in the
+		 * streaming reader; only the permission bits are taken
+		 * from a Unix external attribute.
+		 */
+		if (name_length > 0 && p[46 + name_length - 1] == '/')
+			e->mode = AE_IFDIR;
+		else
+			e->mode = AE_IFREG;
+		if (p[5] == 3 && (external >> 16) != 0)
+			e->mode |= (external >> 16) & 07777;
+		else
+			e->mode |= 0777;
+
+		/* Stash the name offset until the names are complete. */
+		e->name = (const char *)(uintptr_t)archive_strlen(&index->names);
+		archive_strncat(&index->names, p + 46, name_length);
+		archive_strappend_char(&index->names, '\0');
+
+		__archive_read_consume(a,
+		    46 + name_length + extra_length + comment_length);
+	}
+	index->nentries = (int)nentries;
+	for (i = 0; i < index->nentries; i++) {
+		e = &index->entries[i];
+		e->name = index->names.s + (uintptr_t)e->name;
+		index->by_name[i] = e;
+	}
+	qsort(index->by_name, index->nentries, sizeof(*index->by_name),
+	    zip_index_cmp);
+	return (ARCHIVE_OK);
+}
+
+/*
+ * Build the central directory index, leaving the read position
+ * where it was.
+ */
+static int
+zip_build_index(struct archive_read *a, struct zip *zip)
+{
+	struct zip_index *index;
+	int64_t saved;
+	int r;
+
+	index = (struct zip_index *)calloc(1, sizeof(*index));
+	if (index == NULL) {
+		archive_set_error(&a->archive, ENOMEM,
+		    "Can't allocate ZIP index");
+		return (ARCHIVE_FATAL);
+	}
+	saved = a->archive.file_position;
+	r = zip_read_directory(a, index);
+	if (a->archive.file_position != saved) {
+		if (__archive_read_seek(a, saved, SEEK_SET) < 0)
+			r = ARCHIVE_FATAL;
+	}
+	if (r != ARCHIVE_OK) {
+		zip_free_index(index);
+		return (r);
+	}
+	zip->index = index;
+	zip->index_owned = 1;
+	zip->next_entry = 0;
+	return (ARCHIVE_OK);
+}
+
+static int
+archive_read_format_zip_seekable_bid(struct archive_read *a)
+{
+	struct zip *zip;
+	int r;
+
+	zip = (struct zip *)(a->format->data);
+	if (zip->index == NULL) {
+		if (archive_read_format_zip_bid(a) <= 0)
+			return (0);
+		r = zip_build_index(a, zip);
+		if (r == ARCHIVE_FATAL)
+			return (ARCHIVE_FATAL);
+		if (r != ARCHIVE_OK) {
+			/* Let the streaming reader have it. */
+			archive_clear_error(&a->archive);
+			return (0);
+		}
+	}
+	/* Outbid the streaming reader. */
+	return (32);
+}
+
+static int
+archive_read_format_zip_seekable_read_header(struct archive_read *a,
+    struct archive_entry *entry)
+{
+	const char *p;
+	struct zip *zip;
+	struct zip_index_entry *e;
+	int64_t pos;
+	int r;
+
+	a->archive.archive_format = ARCHIVE_FORMAT_ZIP;
+	if (a->archive.archive_format_name == NULL)
+		a->archive.archive_format_name = "ZIP";
+
+	zip = (struct zip *)(a->format->data);
+	if (zip->next_entry >= zip->index->nentries)
+		return (ARCHIVE_EOF);
+	e = &zip->index->entries[zip->next_entry++];
+
+	zip->decompress_init = 0;
+	zip->end_of_entry = 0;
+	zip->entry_uncompressed_bytes_read = 0;
+	zip->entry_compressed_bytes_read = 0;
+	zip->entry_crc32 = __archive_crc32(0, NULL, 0);
+
+	/*
+	 * Skip forward over anything left of the previous entry
+	 * (such as its data descriptor); seek for anything else.
+	 */
+	pos = a->archive.file_position;
+	if (e->local_header_offset >= pos) {
+		if (__archive_read_skip(a, e->local_header_offset - pos) < 0)
+			return (ARCHIVE_FATAL);
+	} else if (__archive_read_seek(a, e->local_header_offset,
+	    SEEK_SET) < 0)
+		return (ARCHIVE_FATAL);
+	if ((p = __archive_read_ahead(a, 4, NULL)) == NULL
+	    || memcmp(p, "PK\003\004", 4) != 0) {
+		archive_set_error(&a->archive, ARCHIVE_ERRNO_FILE_FORMAT,
+		    "Bad ZIP file: no local file header for %s", e->name);
+		return (ARCHIVE_FATAL);
+	}
+	r = zip_read_file_header(a, entry, zip);
+	if (r != ARCHIVE_OK)
+		return (r);
+
+	/*
+	 * Trust the central directory over the local header; this
+	 * also means read_data() has no data descriptor to consume.
+	 */
+	zip->flags &= ~ZIP_LENGTH_AT_END;
+	zip->crc32 = e->crc32;
+	zip->compressed_size = e->compressed_size;
+	zip->uncompressed_size = e->uncompressed_size;
+	zip->mode = e->mode;
+	archive_entry_set_mode(entry, zip->mode);
+	archive_entry_set_size(entry, zip->uncompressed_size);
+	zip->entry_bytes_remaining = zip->compressed_size;
+	if (zip->entry_bytes_remaining < 1)
+		zip->end_of_entry = 1;
+	return (ARCHIVE_OK);
+}
+
+/* The next header seeks anyway, so there is nothing to skip. */
+static int
+archive_read_format_zip_seekable_read_data_skip(struct archive_read *a)
+{
+	struct zip *zip;
+
+	zip = (struct zip *)(a->format->data);
+	zip->end_of_entry = 1;
+	return (ARCHIVE_OK);
+}
+
+static int
+archive_read_format_zip_seekable_cleanup(struct archive_read *a)
+{
+	struct zip *zip;
+
+	zip = (struct zip *)(a->format->data);
+	if (zip->index_owned)
+		zip_free_index(zip->index);
+	return (archive_read_format_zip_cleanup(a));
+}
+
+/*
+ * Find the seekable zip reader's data, optionally building the index
+ * and committing the archive to that reader.
+ */
+static struct zip *
+zip_seekable_data(struct archive_read *a, int select)
+{
+	struct archive_format_descriptor *format;
+	struct zip *zip;
+	int i, slots;
+
+	slots = sizeof(a->formats) / sizeof(a->formats[0]);
+	for (i = 0; i < slots; i++) {
+		if (a->formats[i].bid == archive_read_format_zip_seekable_bid)
+			break;
+	}
+	if (i >= slots) {
+		archive_set_error(&a->archive, ARCHIVE_ERRNO_MISC,
+		    "Seekable ZIP support is not enabled");
+		return (NULL);
+	}
+	format = &(a->formats[i]);
+	zip = (struct zip *)format->data;
+	if (!select)
+		return (zip);
+
+	if (a->format != NULL && a->format != format) {
+		archive_set_error(&a->archive, ARCHIVE_ERRNO_MISC,
+		    "Archive is not being read as a seekable ZIP file");
+		return (NULL);
+	}
+	if (zip->index == NULL && zip_build_index(a, zip) != ARCHIVE_OK)
+		return (NULL);
+	a->format = format;
+	return (zip);
+}
+
+int
+archive_read_zip_entry_count(struct archive *_a)
+{
+	struct archive_read *a = (struct archive_read *)_a;
+	struct zip *zip;
+
+	__archive_check_magic(_a, ARCHIVE_READ_MAGIC,
+	    ARCHIVE_STATE_HEADER | ARCHIVE_STATE_DATA | ARCHIVE_STATE_EOF,
+	    "archive_read_zip_entry_count");
+	if ((zip = zip_seekable_data(a, 1)) == NULL)
+		return (ARCHIVE_FATAL);
+	return (zip->index->nentries);
+}
+
+int
+archive_read_zip_seek_entry(struct archive *_a, int n)
+{
+	struct archive_read *a = (struct archive_read *)_a;
+	struct zip *zip;
+
+	__archive_check_magic(_a, ARCHIVE_READ_MAGIC,
+	    ARCHIVE_STATE_HEADER | ARCHIVE_STATE_DATA | ARCHIVE_STATE_EOF,
+	    "archive_read_zip_seek_entry");
+	if ((zip = zip_seekable_data(a, 1)) == NULL)
+		return (ARCHIVE_FATAL);
+	if (n < 0 || n >= zip->index->nentries) {
+		archive_set_error(&a->archive, ARCHIVE_ERRNO_MISC,
+		    "No ZIP entry %d", n);
+		return (ARCHIVE_FAILED);
+	}
+	zip->next_entry = n;
+	a->archive.state = ARCHIVE_STATE_HEADER;
+	return (ARCHIVE_OK);
+}
+
+int
+archive_read_zip_seek_name(struct archive *_a, const char *pathname)
+{
+	struct archive_read *a = (struct archive_read *)_a;
+	struct zip *zip;
+	struct zip_index_entry key, *pkey, **found;
+
+	__archive_check_magic(_a, ARCHIVE_READ_MAGIC,
+	    ARCHIVE_STATE_HEADER | ARCHIVE_STATE_DATA | ARCHIVE_STATE_EOF,
+	    "archive_read_zip_seek_name");
+	if ((zip = zip_seekable_data(a, 1)) == NULL)
+		return (ARCHIVE_FATAL);
+	key.name = pathname;
+	pkey = &key;
+	found = (struct zip_index_entry **)bsearch(&pkey,
+	    zip->index->by_name, zip->index->nentries,
+	    sizeof(*zip->index->by_name), zip_index_cmp);
+	if (found == NULL) {
+		archive_set_error(&a->archive, ARCHIVE_ERRNO_MISC,
+		    "No ZIP entry named %s", pathname);
+		return (ARCHIVE_FAILED);
+	}
+	zip->next_entry = (int)(*found - zip->index->entries);
+	a->archive.state = ARCHIVE_STATE_HEADER;
+	return (ARCHIVE_OK);
+}
+
+int
+archive_read_zip_share_index(struct archive *_to, struct archive *_from)
+{
+	struct archive_read *to = (struct archive_read *)_to;
+	struct archive_read *from = (struct archive_read *)_from;
+	struct zip *zip_to, *zip_from;
+
+	__archive_check_magic(_to, ARCHIVE_READ_MAGIC, ARCHIVE_STATE_NEW,
+	    "archive_read_zip_share_index");
+	__archive_check_magic(_from, ARCHIVE_READ_MAGIC,
+	    ARCHIVE_STATE_HEADER | ARCHIVE_STATE_DATA | ARCHIVE_STATE_EOF,
+	    "archive_read_zip_share_index");
+	if ((zip_to = zip_seekable_data(to, 0)) == NULL)
+		return (ARCHIVE_FATAL);
+	if ((zip_from = zip_seekable_data(from, 1)) == NULL) {
+		archive_set_error(&to->archive, ARCHIVE_ERRNO_MISC,
+		    "%s", archive_error_string(&from->archive));
+		return (ARCHIVE_FATAL);
+	}
+	if (zip_to->index_owned)
+		zip_free_index(zip_to->index);
+	zip_to->index = zip_from->index;
+	zip_to->index_owned = 0;
+	zip_to->next_entry = 0;
+	return (ARCHIVE_OK);
+}
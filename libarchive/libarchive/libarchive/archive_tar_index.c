@@ -0,0 +1,339 @@
+/*-
+ * Copyright (c) 2026 The libarchive Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "archive_platform.h"
+__FBSDID("$FreeBSD$");
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#include "archive.h"
+#include "archive_crc32.h"
+#include "archive_endian.h"
+#include "archive_private.h"
+#include "archive_tar_index_private.h"
+
+/*
+ * On disk, all numbers are little-endian:
+ *
+ *   header:   "TARINDEX", version (4), flags (4), archive size (8),
+ *             restart count (8), entry count (8)
+ *   restarts: raw offset (8), offset (8)
+ *   entries:  header offset (8), data offset (8), size (8),
+ *             name length (4), name
+ *   footer:   raw offset (8), offset (8), index size (8),
+ *             index crc (4), footer crc (4), "TARINDEX"
+ */
+#define	TAR_INDEX_VERSION	1
+#define	HEADER_SIZE		40
+#define	RESTART_SIZE		16
+#define	ENTRY_SIZE		28
+
+struct archive_tar_index *
+__archive_tar_index_new(void)
+{
+	return (calloc(1, sizeof(struct archive_tar_index)));
+}
+
+void
+__archive_tar_index_free(struct archive_tar_index *idx)
+{
+	if (idx == NULL)
+		return;
+	free(idx->entries);
+	free(idx->by_name);
+	free(idx->restarts);
+	archive_string_free(&idx->names);
+	free(idx);
+}
+
+/* Length of a name without its trailing slashes; "/" stays. */
+static size_t
+name_length(const char *name, size_t len)
+{
+	while (len > 1 && name[len - 1] == '/')
+		len--;
+	return (len);
+}
+
+static int
+add_entry(struct archive_tar_index *idx, const char *name, size_t len,
+    int64_t header_offset, int64_t data_offset, int64_t size)
+{
+	struct archive_tar_index_entry *e;
+
+	if (idx->nentries >= idx->entries_size) {
+		size_t n = idx->entries_size == 0 ? 256 : idx->entries_size * 2;
+		e = realloc(idx->entries, n * sizeof(*e));
+		if (e == NULL)
+			return (ARCHIVE_FATAL);
+		idx->entries = e;
+		idx->entries_size = n;
+	}
+	len = name_length(name, len);
+	e = &idx->entries[idx->nentries];
+	e->header_offset = header_offset;
+	e->data_offset = data_offset;
+	e->size = size;
+	e->name = idx->names.length;
+	/* Keep each name's NUL in the buffer. */
+	if (__archive_string_append(&idx->names, name, len) == NULL ||
+	    archive_strappend_char(&idx->names, '\0') == NULL)
+		return (ARCHIVE_FATAL);
+	idx->nentries++;
+	return (ARCHIVE_OK);
+}
+
+int
+__archive_tar_index_add_entry(struct archive_tar_index *idx,
+    const char *name, int64_t header_offset, int64_t data_offset,
+    int64_t size)
+{
+	return (add_entry(idx, name, strlen(name), header_offset,
+	    data_offset, size));
+}
+
+int
+__archive_tar_index_add_restart(struct archive_tar_index *idx,
+    int64_t raw_offset, int64_t offset)
+{
+	struct archive_tar_index_restart *r;
+
+	if (idx->nrestarts >= idx->restarts_size) {
+		size_t n = idx->restarts_size == 0 ? 64 : idx->restarts_size * 2;
+		r = realloc(idx->restarts, n * sizeof(*r));
+		if (r == NULL)
+			return (ARCHIVE_FATAL);
+		idx->restarts = r;
+		idx->restarts_size = n;
+	}
+	r = &idx->restarts[idx->nrestarts++];
+	r->raw_offset = raw_offset;
+	r->offset = offset;
+	return (ARCHIVE_OK);
+}
+
+int
+__archive_tar_index_write(struct archive_tar_index *idx,
+    struct archive_string *out, int64_t raw_offset, int64_t offset)
+{
+	unsigned char *p;
+	size_t start = out->length, size, i, len;
+	uint32_t crc;
+
+	size = HEADER_SIZE + idx->nrestarts * RESTART_SIZE +
+	    idx->nentries * ENTRY_SIZE + idx->names.length -
+	    idx->nentries + TAR_INDEX_FOOTER_SIZE;
+	if (archive_string_ensure(out, start + size) == NULL)
+		return (ARCHIVE_FATAL);
+	p = (unsigned char *)out->s + start;
+
+	memcpy(p, TAR_INDEX_MAGIC, 8);
+	archive_le32enc(p + 8, TAR_INDEX_VERSION);
+	archive_le32enc(p + 12, 0);
+	archive_le64enc(p + 16, idx->archive_size);
+	archive_le64enc(p + 24, idx->nrestarts);
+	archive_le64enc(p + 32, idx->nentries);
+	p += HEADER_SIZE;
+	for (i = 0; i < idx->nrestarts; i++) {
+		archive_le64enc(p, idx->restarts[i].raw_offset);
+		archive_le64enc(p + 8, idx->restarts[i].offset);
+		p += RESTART_SIZE;
+	}
+	for (i = 0; i < idx->nentries; i++) {
+		const char *name = __archive_tar_index_name(idx, i);
+
+		len = strlen(name);
+		archive_le64enc(p, idx->entries[i].header_offset);
+		archive_le64enc(p + 8, idx->entries[i].data_offset);
+		archive_le64enc(p + 16, idx->entries[i].size);
+		archive_le32enc(p + 24, (uint32_t)len);
+		memcpy(p + ENTRY_SIZE, name, len);
+		p += ENTRY_SIZE + len;
+	}
+
+	size -= TAR_INDEX_FOOTER_SIZE;
+	crc = __archive_crc32(0, out->s + start, size);
+	archive_le64enc(p, raw_offset);
+	archive_le64enc(p + 8, offset);
+	archive_le64enc(p + 16, size);
+	archive_le32enc(p + 24, crc);
+	archive_le32enc(p + 28, __archive_crc32(0, p, 28));
+	memcpy(p + 32, TAR_INDEX_MAGIC, 8);
+	out->length = start + size + TAR_INDEX_FOOTER_SIZE;
+	return (ARCHIVE_OK);
+}
+
+ssize_t
+__archive_tar_index_find_footer(const void *buff, size_t len,
+    struct archive_tar_index_footer *footer)
+{
+	const unsigned char *b = buff, *p;
+	ssize_t i;
+
+	/* Whatever follows the footer is padding or gzip framing, so
+	 * look for the last one whose own crc is right. */
+	for (i = (ssize_t)len - TAR_INDEX_FOOTER_SIZE; i >= 0; i--) {
+		p = b + i;
+		if (p[32] != 'T' || memcmp(p + 32, TAR_INDEX_MAGIC, 8) != 0)
+			continue;
+		if (archive_le32dec(p + 28) != __archive_crc32(0, p, 28))
+			continue;
+		footer->raw_offset = archive_le64dec(p);
+		footer->offset = archive_le64dec(p + 8);
+		footer->size = archive_le64dec(p + 16);
+		footer->crc = archive_le32dec(p + 24);
+		if (footer->raw_offset < 0 || footer->offset < 0 ||
+		    footer->size < HEADER_SIZE)
+			continue;
+		return (i);
+	}
+	return (-1);
+}
+
+static int
+cmp_name(const void *a, const void *b)
+{
+	const struct archive_tar_index_name *na = a, *nb = b;
+	int r = strcmp(na->name, nb->name);
+
+	if (r != 0)
+		return (r);
+	return (na->entry < nb->entry ? -1 : na->entry > nb->entry);
+}
+
+struct archive_tar_index *
+__archive_tar_index_read(const void *buff, size_t len, uint32_t crc)
+{
+	struct archive_tar_index *idx;
+	const unsigned char *p = buff, *end = p + len;
+	uint64_t nrestarts, nentries, i;
+	size_t namelen;
+
+	if (len < HEADER_SIZE || memcmp(p, TAR_INDEX_MAGIC, 8) != 0 ||
+	    archive_le32dec(p + 8) != TAR_INDEX_VERSION ||
+	    __archive_crc32(0, buff, len) != crc)
+		return (NULL);
+	nrestarts = archive_le64dec(p + 24);
+	nentries = archive_le64dec(p + 32);
+	if (nrestarts > (len - HEADER_SIZE) / RESTART_SIZE ||
+	    nentries > (len - HEADER_SIZE) / ENTRY_SIZE)
+		return (NULL);
+	if ((idx = __archive_tar_index_new()) == NULL)
+		return (NULL);
+	idx->archive_size = archive_le64dec(p + 16);
+	p += HEADER_SIZE;
+
+	for (i = 0; i < nrestarts; i++, p += RESTART_SIZE) {
+		if (end - p < RESTART_SIZE)
+			goto fail;
+		if (__archive_tar_index_add_restart(idx,
+		    archive_le64dec(p), archive_le64dec(p + 8)) != ARCHIVE_OK)
+			goto fail;
+		/* Seeking relies on the order. */
+		if (i > 0 && (idx->restarts[i].offset <
+		    idx->restarts[i - 1].offset || idx->restarts[i].raw_offset <
+		    idx->restarts[i - 1].raw_offset))
+			goto fail;
+	}
+	for (i = 0; i < nentries; i++, p += ENTRY_SIZE + namelen) {
+		int64_t header_offset, data_offset, size;
+
+		if (end - p < ENTRY_SIZE)
+			goto fail;
+		header_offset = archive_le64dec(p);
+		data_offset = archive_le64dec(p + 8);
+		size = archive_le64dec(p + 16);
+		namelen = archive_le32dec(p + 24);
+		if (header_offset < 0 || data_offset < header_offset ||
+		    size < 0 || (size_t)(end - p - ENTRY_SIZE) < namelen ||
+		    memchr(p + ENTRY_SIZE, '\0', namelen) != NULL)
+			goto fail;
+		if (add_entry(idx, (const char *)p + ENTRY_SIZE, namelen,
+		    header_offset, data_offset, size) != ARCHIVE_OK)
+			goto fail;
+	}
+
+	idx->by_name = malloc((idx->nentries + 1) * sizeof(*idx->by_name));
+	if (idx->by_name == NULL)
+		goto fail;
+	for (i = 0; i < idx->nentries; i++) {
+		idx->by_name[i].name = __archive_tar_index_name(idx, i);
+		idx->by_name[i].entry = i;
+	}
+	qsort(idx->by_name, idx->nentries, sizeof(*idx->by_name), cmp_name);
+	return (idx);
+fail:
+	__archive_tar_index_free(idx);
+	return (NULL);
+}
+
+int
+__archive_tar_index_lookup(struct archive_tar_index *idx, const char *name)
+{
+	struct archive_string key;
+	size_t lo = 0, hi = idx->nentries, mid;
+	int found = -1;
+
+	archive_string_init(&key);
+	if (__archive_string_append(&key, name,
+	    name_length(name, strlen(name))) == NULL)
+		return (-1);
+	/* Several members may share a name; the last one wins, as it
+	 * would on extraction. */
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (strcmp(idx->by_name[mid].name, key.s) <= 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo > 0 && strcmp(idx->by_name[lo - 1].name, key.s) == 0)
+		found = (int)idx->by_name[lo - 1].entry;
+	archive_string_free(&key);
+	return (found);
+}
+
+const struct archive_tar_index_restart *
+__archive_tar_index_restart(struct archive_tar_index *idx, int64_t offset)
+{
+	size_t lo = 0, hi = idx->nrestarts, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (idx->restarts[mid].offset <= offset)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return (lo > 0 ? &idx->restarts[lo - 1] : NULL);
+}
@@ -0,0 +1,122 @@
+/*-
+ * Copyright (c) 2026 The libarchive Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * $FreeBSD$
+ */
+
+#ifndef __LIBARCHIVE_BUILD
+#error This header is only to be used internally to libarchive.
+#endif
+
+#ifndef ARCHIVE_TAR_INDEX_PRIVATE_H_INCLUDED
+#define	ARCHIVE_TAR_INDEX_PRIVATE_H_INCLUDED
+
+#include "archive_string.h"
+
+/*
+ * An index of the members of a tar archive, shared by the writer that
+ * records it (archive_write_set_tar_index()) and the tar reader that
+ * seeks with it.  See tar.5 for the layout on disk.
+ *
+ * All offsets except raw_offset are in the uncompressed tar stream.
+ * A restart point is where a compressed stream begins, so that a
+ * reader can start decompressing there; raw_offset is its position in
+ * the archive file.
+ */
+struct archive_tar_index_entry {
+	int64_t		 header_offset;
+	int64_t		 data_offset;
+	int64_t		 size;
+	size_t		 name;		/* Offset in 'names'. */
+};
+
+struct archive_tar_index_name {
+	const char	*name;
+	size_t		 entry;
+};
+
+struct archive_tar_index_restart {
+	int64_t		 raw_offset;
+	int64_t		 offset;
+};
+
+struct archive_tar_index {
+	/* Members in archive order. */
+	struct archive_tar_index_entry	*entries;
+	size_t				 nentries, entries_size;
+	/* Sorted by name, then by position; only built by
+	 * __archive_tar_index_read(). */
+	struct archive_tar_index_name	*by_name;
+	/* In order of both offsets. */
+	struct archive_tar_index_restart *restarts;
+	size_t				 nrestarts, restarts_size;
+	/* NUL-terminated names, without trailing slashes. */
+	struct archive_string		 names;
+	/* Bytes of the archive file, not counting a trailer. */
+	int64_t				 archive_size;
+};
+
+/*
+ * The footer that ends an index, whether it is in a file of its own or
+ * appended to the archive.  It says where the index starts: for a
+ * trailer, at raw_offset in the archive file, which is offset in the
+ * tar stream.
+ */
+#define	TAR_INDEX_MAGIC		"TARINDEX"
+#define	TAR_INDEX_FOOTER_SIZE	40
+
+struct archive_tar_index_footer {
+	int64_t		 raw_offset;
+	int64_t		 offset;
+	int64_t		 size;
+	uint32_t	 crc;
+};
+
+#define	__archive_tar_index_name(idx, n) \
+	((idx)->names.s + (idx)->entries[n].name)
+
+struct archive_tar_index *__archive_tar_index_new(void);
+void	__archive_tar_index_free(struct archive_tar_index *);
+int	__archive_tar_index_add_entry(struct archive_tar_index *,
+	    const char *name, int64_t header_offset, int64_t data_offset,
+	    int64_t size);
+int	__archive_tar_index_add_restart(struct archive_tar_index *,
+	    int64_t raw_offset, int64_t offset);
+/* Appends the index and a footer that places it at raw_offset/offset. */
+int	__archive_tar_index_write(struct archive_tar_index *,
+	    struct archive_string *, int64_t raw_offset, int64_t offset);
+/* Finds the last valid footer in a buffer; returns its offset or -1. */
+ssize_t	__archive_tar_index_find_footer(const void *, size_t,
+	    struct archive_tar_index_footer *);
+/* Parses an index; NULL if it is damaged or out of memory. */
+struct archive_tar_index *__archive_tar_index_read(const void *, size_t,
+	    uint32_t crc);
+/* The last member called 'name', or -1. */
+int	__archive_tar_index_lookup(struct archive_tar_index *,
+	    const char *name);
+/* The last restart point at or before 'offset', or NULL. */
+const struct archive_tar_index_restart *__archive_tar_index_restart(
+	    struct archive_tar_index *, int64_t offset);
+
+#endif
@@ -320,9 +320,13 @@ archive_write_open(struct archive *_a, void *client_data,
 	a->client_writer = writer;
 	a->client_opener = opener;
 	a->client_closer = closer;
+	a->compressor.restart = NULL;
+	a->compressor.trailer = NULL;
 	ret = (a->compressor.init)(a);
 	if (a->format_init && ret == ARCHIVE_OK)
 		ret = (a->format_init)(a);
+	if (a->index_open && ret == ARCHIVE_OK)
+		ret = (a->index_open)(a);
 	return (ret);
 }
 
@@ -339,9 +343,11 @@ _archive_write_close(struct archive *_a)
 {
 	struct archive_write *a = (struct archive_write *)_a;
 	int r = ARCHIVE_OK, r1 = ARCHIVE_OK;
+	int opened;
 
 	__archive_check_magic(&a->archive, ARCHIVE_WRITE_MAGIC,
 	    ARCHIVE_STATE_ANY, "archive_write_close");
+	opened = a->archive.state & (ARCHIVE_STATE_HEADER | ARCHIVE_STATE_DATA);
 
 	/* Finish the last entry. */
 	if (a->archive.state & ARCHIVE_STATE_DATA)
@@ -354,6 +360,13 @@ _archive_write_close(struct archive *_a)
 			r = r1;
 	}
 
+	/* The index goes after the end of the tar data. */
+	if (opened && a->index_close != NULL && r > ARCHIVE_FATAL) {
+		r1 = (a->index_close)(a);
+		if (r1 < r)
+			r = r1;
+	}
+
 	/* Release format resources. */
 	if (a->format_destroy != NULL) {
 		r1 = (a->format_destroy)(a);
@@ -394,6 +407,8 @@ _archive_write_finish(struct archive *_a)
 		r = archive_write_close(&a->archive);
 
 	/* Release various dynamic buffers. */
+	if (a->index_free != NULL)
+		(a->index_free)(a);
 	free((void *)(uintptr_t)(const void *)a->nulls);
 	archive_string_free(&a->archive.error_string);
 	a->archive.magic = 0;
@@ -428,11 +443,23 @@ _archive_write_header(struct archive *_a, struct archive_entry *entry)
 		return (ARCHIVE_FAILED);
 	}
 
+	if (a->index_pre_header != NULL) {
+		r2 = (a->index_pre_header)(a);
+		if (r2 < ARCHIVE_WARN)
+			return (r2);
+	}
+
 	/* Format and write header. */
 	r2 = ((a->format_write_header)(a, entry));
 	if (r2 < ret)
 		ret = r2;
 
+	if (a->index_post_header != NULL && r2 >= ARCHIVE_WARN) {
+		r2 = (a->index_post_header)(a, entry);
+		if (r2 < ret)
+			ret = r2;
+	}
+
 	a->archive.state = ARCHIVE_STATE_DATA;
 	return (ret);
 }
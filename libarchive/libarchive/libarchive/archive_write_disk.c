@@ -105,8 +105,29 @@ __FBSDID("$FreeBSD: head/lib/libarchive/archive_write_disk.c 201159 2009-12-29 0
 #define O_BINARY 0
 #endif
 
+/*
+ * With the POSIX.1-2008 *at() calls, the symlink check walks each
+ * path one directory at a time and keeps the deepest directory it
+ * verified open for the next entry; see check_symlinks().  Objects
+ * are then created relative to that directory.
+ */
+#if defined(HAVE_OPENAT) && defined(HAVE_FSTATAT) && \
+    defined(HAVE_UNLINKAT) && defined(HAVE_MKDIRAT) && \
+    defined(HAVE_SYMLINKAT) && defined(HAVE_LINKAT) && \
+    defined(HAVE_FCHOWNAT) && defined(HAVE_FCHMODAT) && defined(AT_FDCWD)
+#define	USE_AT_CALLS 1
+#endif
+
+/* Flags for opening a dir only to use it as the base of *at() calls. */
+#if defined(O_PATH)
+#define	O_DIR_SEARCH	(O_PATH | O_DIRECTORY | O_CLOEXEC)
+#elif defined(O_SEARCH)
+#define	O_DIR_SEARCH	(O_SEARCH | O_DIRECTORY | O_CLOEXEC)
+#else
+#define	O_DIR_SEARCH	(O_RDONLY | O_DIRECTORY | O_CLOEXEC)
+#endif
+
 struct fixup_entry {
-	struct fixup_entry	*next;
 	mode_t			 mode;
 	int64_t			 atime;
 	int64_t                  birthtime;
@@ -116,7 +137,8 @@ struct fixup_entry {
 	unsigned long		 mtime_nanos;
 	unsigned long		 fflags_set;
 	int			 fixup; /* bitmask of what needs fixing */
-	char			*name;
+	int			 depth; /* number of path elements */
+	char			 name[1]; /* allocated with the entry */
 };
 
 /*
@@ -145,11 +167,30 @@ struct fixup_entry {
 #define	TODO_ACLS		ARCHIVE_EXTRACT_ACL
 #define	TODO_XATTR		ARCHIVE_EXTRACT_XATTR
 
+/*
+ * The last few answers from a uid or gid lookup function.  Archives
+ * usually have only a handful of owners, so this saves calling the
+ * lookup function (and often getpwnam()) for every entry.
+ */
+#define	ID_CACHE_SIZE	8
+struct id_cache {
+	struct {
+		char		*name;
+		int64_t		 id;	/* Id recorded in the archive. */
+		int64_t		 result; /* What the lookup returned. */
+	} slot[ID_CACHE_SIZE];
+	int			 used;
+	int			 next;	/* Slot to replace next. */
+};
+
 struct archive_write_disk {
 	struct archive	archive;
 
 	mode_t			 user_umask;
-	struct fixup_entry	*fixup_list;
+	/* Objects to fix up at close; sorted there, deepest first. */
+	struct fixup_entry	**fixup_list;
+	size_t			 fixup_count;
+	size_t			 fixup_size;
 	struct fixup_entry	*current_fixup;
 	uid_t			 user_uid;
 	dev_t			 skip_file_dev;
@@ -162,6 +203,8 @@ struct archive_write_disk {
 	uid_t (*lookup_uid)(void *private, const char *gname, gid_t gid);
 	void  (*cleanup_uid)(void *private);
 	void			*lookup_uid_data;
+	struct id_cache		 gid_cache;
+	struct id_cache		 uid_cache;
 
 	/*
 	 * Full path of last file to satisfy symlink checks.
@@ -201,6 +244,23 @@ struct archive_write_disk {
 	/* UID/GID to use in restoring this entry. */
 	uid_t			 uid;
 	gid_t			 gid;
+#ifdef USE_AT_CALLS
+	/*
+	 * Dir held open across entries: the deepest dir along the last
+	 * path that check_symlinks() verified, its name, and the cwd
+	 * that name was relative to.
+	 */
+	int			 dir_fd;
+	struct archive_string	 dir_name;
+	dev_t			 dir_cwd_dev;
+	ino_t			 dir_cwd_ino;
+	/*
+	 * The current entry is created as at_name relative to at_fd,
+	 * which is dir_fd if that is the parent, AT_FDCWD otherwise.
+	 */
+	int			 at_fd;
+	const char		*at_name;
+#endif
 };
 
 /*
@@ -220,6 +280,11 @@ struct archive_write_disk {
 
 static int	check_symlinks_fsobj(char *path, int *error_number, struct archive_string *error_string, int flags);
 static int	check_symlinks(struct archive_write_disk *);
+#ifdef USE_AT_CALLS
+static int	check_symlinks_at(char *, char *, int, int *, size_t *,
+		    int *, struct archive_string *, int);
+static void	release_dir(struct archive_write_disk *);
+#endif
 static int	create_filesystem_object(struct archive_write_disk *);
 static struct fixup_entry *current_fixup(struct archive_write_disk *, const char *pathname);
 #ifdef HAVE_FCHDIR
@@ -245,9 +310,16 @@ static int	set_ownership(struct archive_write_disk *);
 static int	set_mode(struct archive_write_disk *, int mode);
 static int	set_time(int, int, const char *, time_t, long, time_t, long);
 static int	set_times(struct archive_write_disk *);
-static struct fixup_entry *sort_dir_list(struct fixup_entry *p);
+static int	cmp_fixup(const void *, const void *);
+static int	fixup_dir(struct archive_write_disk *, const char *,
+		    const char **);
 static gid_t	trivial_lookup_gid(void *, const char *, gid_t);
 static uid_t	trivial_lookup_uid(void *, const char *, uid_t);
+static int	id_cache_find(struct id_cache *, const char *, int64_t,
+		    int64_t *);
+static void	id_cache_add(struct id_cache *, const char *, int64_t,
+		    int64_t);
+static void	id_cache_clear(struct id_cache *);
 static ssize_t	write_data_block(struct archive_write_disk *,
 		    const char *, size_t);
 
@@ -277,7 +349,11 @@ _archive_write_disk_lazy_stat(struct archive_write_disk *a)
 	 * XXX At this point, symlinks should not be hit, otherwise
 	 * XXX a race occured.  Do we want to check explicitly for that?
 	 */
+#ifdef USE_AT_CALLS
+	if (fstatat(a->at_fd, a->at_name, &a->st, AT_SYMLINK_NOFOLLOW) == 0) {
+#else
 	if (lstat(a->name, &a->st) == 0) {
+#endif
 		a->pst = &a->st;
 		return (ARCHIVE_OK);
 	}
@@ -371,6 +447,13 @@ _archive_write_header(struct archive *_a, struct archive_entry *entry)
 	ret = cleanup_pathname(a);
 	if (ret != ARCHIVE_OK)
 		return (ret);
+#ifdef USE_AT_CALLS
+	a->at_fd = AT_FDCWD;
+	a->at_name = a->name;
+	/* Only the symlink checks keep the held dir up to date. */
+	if (!(a->flags & ARCHIVE_EXTRACT_SECURE_SYMLINKS))
+		release_dir(a);
+#endif
 
 	/*
 	 * Set the umask to zero so we get predictable mode settings.
@@ -439,6 +522,13 @@ _archive_write_header(struct archive *_a, struct archive_entry *entry)
 #ifdef HAVE_FCHDIR
 	/* If path exceeds PATH_MAX, shorten the path. */
 	edit_deep_directories(a);
+#ifdef USE_AT_CALLS
+	/* The shortened path is relative to the new cwd. */
+	if (a->restore_pwd >= 0) {
+		a->at_fd = AT_FDCWD;
+		a->at_name = a->name;
+	}
+#endif
 #endif
 
 	ret = restore_entry(a);
@@ -467,13 +557,13 @@ _archive_write_header(struct archive *_a, struct archive_entry *entry)
 #endif
 
 	/*
-	 * Fixup uses the unedited pathname from archive_entry_pathname(),
+	 * Fixup uses the full cleaned-up pathname rather than a->name,
 	 * because it is relative to the base dir and the edited path
 	 * might be relative to some intermediate dir as a result of the
 	 * deep restore logic.
 	 */
 	if (a->deferred & TODO_MODE) {
-		fe = current_fixup(a, archive_entry_pathname(entry));
+		fe = current_fixup(a, a->_name_data.s);
 		fe->fixup |= TODO_MODE_BASE;
 		fe->mode = a->mode;
 	}
@@ -481,7 +571,7 @@ _archive_write_header(struct archive *_a, struct archive_entry *entry)
 	if ((a->deferred & TODO_TIMES)
 		&& (archive_entry_mtime_is_set(entry)
 		    || archive_entry_atime_is_set(entry))) {
-		fe = current_fixup(a, archive_entry_pathname(entry));
+		fe = current_fixup(a, a->_name_data.s);
 		fe->fixup |= TODO_TIMES;
 		if (archive_entry_atime_is_set(entry)) {
 			fe->atime = archive_entry_atime(entry);
@@ -510,7 +600,7 @@ _archive_write_header(struct archive *_a, struct archive_entry *entry)
 	}
 
 	if (a->deferred & TODO_FFLAGS) {
-		fe = current_fixup(a, archive_entry_pathname(entry));
+		fe = current_fixup(a, a->_name_data.s);
 		fe->fixup |= TODO_FFLAGS;
 		/* TODO: Complete this.. defer fflags from below. */
 	}
@@ -729,16 +819,34 @@ _archive_write_finish_entry(struct archive *_a)
 	 * TODO: the TODO_SGID condition can be dropped here, can't it?
 	 */
 	if (a->todo & (TODO_OWNER | TODO_SUID | TODO_SGID)) {
-		a->uid = a->lookup_uid(a->lookup_uid_data,
-		    archive_entry_uname(a->entry),
-		    archive_entry_uid(a->entry));
+		const char *uname = archive_entry_uname(a->entry);
+		int64_t uid = archive_entry_uid(a->entry), result;
+
+		if (a->lookup_uid == trivial_lookup_uid)
+			a->uid = (uid_t)uid;
+		else if (id_cache_find(&a->uid_cache, uname, uid, &result))
+			a->uid = (uid_t)result;
+		else {
+			a->uid = a->lookup_uid(a->lookup_uid_data,
+			    uname, (uid_t)uid);
+			id_cache_add(&a->uid_cache, uname, uid, a->uid);
+		}
 	}
 	/* Look up the "real" GID only if we're going to need it. */
 	/* TODO: the TODO_SUID condition can be dropped here, can't it? */
 	if (a->todo & (TODO_OWNER | TODO_SGID | TODO_SUID)) {
-		a->gid = a->lookup_gid(a->lookup_gid_data,
-		    archive_entry_gname(a->entry),
-		    archive_entry_gid(a->entry));
+		const char *gname = archive_entry_gname(a->entry);
+		int64_t gid = archive_entry_gid(a->entry), result;
+
+		if (a->lookup_gid == trivial_lookup_gid)
+			a->gid = (gid_t)gid;
+		else if (id_cache_find(&a->gid_cache, gname, gid, &result))
+			a->gid = (gid_t)result;
+		else {
+			a->gid = a->lookup_gid(a->lookup_gid_data,
+			    gname, (gid_t)gid);
+			id_cache_add(&a->gid_cache, gname, gid, a->gid);
+		}
 	 }
 	/*
 	 * If restoring ownership, do it before trying to restore suid/sgid
@@ -810,6 +918,7 @@ archive_write_disk_set_group_lookup(struct archive *_a,
 	a->lookup_gid = lookup_gid;
 	a->cleanup_gid = cleanup_gid;
 	a->lookup_gid_data = private_data;
+	id_cache_clear(&a->gid_cache);
 	return (ARCHIVE_OK);
 }
 
@@ -826,6 +935,7 @@ archive_write_disk_set_user_lookup(struct archive *_a,
 	a->lookup_uid = lookup_uid;
 	a->cleanup_uid = cleanup_uid;
 	a->lookup_uid_data = private_data;
+	id_cache_clear(&a->uid_cache);
 	return (ARCHIVE_OK);
 }
 
@@ -849,6 +959,10 @@ archive_write_disk_new(void)
 	a->lookup_uid = trivial_lookup_uid;
 	a->lookup_gid = trivial_lookup_gid;
 	a->start_time = time(NULL);
+#ifdef USE_AT_CALLS
+	a->dir_fd = -1;
+	a->at_fd = AT_FDCWD;
+#endif
 #ifdef HAVE_GETEUID
 	a->user_uid = geteuid();
 #endif /* HAVE_GETEUID */
@@ -950,6 +1064,11 @@ restore_entry(struct archive_write_disk *a)
 	if ((en == ENOTDIR || en == ENOENT)
 	    && !(a->flags & ARCHIVE_EXTRACT_NO_AUTODIR)) {
 		/* If the parent dir doesn't exist, try creating it. */
+#ifdef USE_AT_CALLS
+		/* If it was the held dir, it went away; use the path. */
+		a->at_fd = AT_FDCWD;
+		a->at_name = a->name;
+#endif
 		create_parent_dir(a, a->name);
 		/* Now try to create the object again. */
 		en = create_filesystem_object(a);
@@ -1116,7 +1235,12 @@ create_filesystem_object(struct archive_write_disk *a)
 			return (EPERM);
 		}
 		free(linkname_copy);
+#ifdef USE_AT_CALLS
+		r = linkat(AT_FDCWD, linkname, a->at_fd, a->at_name, 0)
+		    ? errno : 0;
+#else
 		r = link(linkname, a->name) ? errno : 0;
+#endif
 		/*
 		 * New cpio and pax formats allow hardlink entries
 		 * to carry data, so we may have to open the file
@@ -1133,7 +1257,12 @@ create_filesystem_object(struct archive_write_disk *a)
 			a->todo = 0;
 			a->deferred = 0;
 		} if (r == 0 && a->filesize > 0) {
+#ifdef USE_AT_CALLS
+			a->fd = openat(a->at_fd, a->at_name,
+			    O_WRONLY | O_TRUNC | O_BINARY);
+#else
 			a->fd = open(a->name, O_WRONLY | O_TRUNC | O_BINARY);
+#endif
 			if (a->fd < 0)
 				r = errno;
 		}
@@ -1142,7 +1271,9 @@ create_filesystem_object(struct archive_write_disk *a)
 	}
 	linkname = archive_entry_symlink(a->entry);
 	if (linkname != NULL) {
-#if HAVE_SYMLINK
+#if defined(USE_AT_CALLS)
+		return symlinkat(linkname, a->at_fd, a->at_name) ? errno : 0;
+#elif HAVE_SYMLINK
 		return symlink(linkname, a->name) ? errno : 0;
 #else
 		return (EPERM);
@@ -1169,8 +1300,13 @@ create_filesystem_object(struct archive_write_disk *a)
 		/* POSIX requires that we fall through here. */
 		/* FALLTHROUGH */
 	case AE_IFREG:
+#ifdef USE_AT_CALLS
+		a->fd = openat(a->at_fd, a->at_name,
+		    O_WRONLY | O_CREAT | O_EXCL | O_BINARY, mode);
+#else
 		a->fd = open(a->name,
 		    O_WRONLY | O_CREAT | O_EXCL | O_BINARY, mode);
+#endif
 		r = (a->fd < 0);
 		break;
 	case AE_IFCHR:
@@ -1197,7 +1333,11 @@ create_filesystem_object(struct archive_write_disk *a)
 #endif /* HAVE_MKNOD */
 	case AE_IFDIR:
 		mode = (mode | MINIMUM_DIR_MODE) & MAXIMUM_DIR_MODE;
+#ifdef USE_AT_CALLS
+		r = mkdirat(a->at_fd, a->at_name, mode);
+#else
 		r = mkdir(a->name, mode);
+#endif
 		if (r == 0) {
 			/* Defer setting dir times. */
 			a->deferred |= (a->todo & TODO_TIMES);
@@ -1257,21 +1397,51 @@ static int
 _archive_write_close(struct archive *_a)
 {
 	struct archive_write_disk *a = (struct archive_write_disk *)_a;
-	struct fixup_entry *next, *p;
-	int ret;
+	struct fixup_entry *p;
+	const char *base;
+	size_t i;
+	int dfd, ret;
 
 	__archive_check_magic(&a->archive, ARCHIVE_WRITE_DISK_MAGIC,
 	    ARCHIVE_STATE_HEADER | ARCHIVE_STATE_DATA,
 	    "archive_write_disk_close");
 	ret = _archive_write_finish_entry(&a->archive);
+#ifdef USE_AT_CALLS
+	release_dir(a);
+#endif
 
-	/* Sort dir list so directories are fixed up in depth-first order. */
-	p = sort_dir_list(a->fixup_list);
+	/*
+	 * Sort so that entries are fixed up deepest first, and
+	 * entries in the same dir are adjacent.
+	 */
+	if (a->fixup_count > 1)
+		qsort(a->fixup_list, a->fixup_count,
+		    sizeof(a->fixup_list[0]), cmp_fixup);
 
-	while (p != NULL) {
+	for (i = 0; i < a->fixup_count; i++) {
+		p = a->fixup_list[i];
 		a->pst = NULL; /* Mark stat cache as out-of-date. */
+		/* Work relative to the parent, opened once per dir. */
+		dfd = fixup_dir(a, p->name, &base);
 		if (p->fixup & TODO_TIMES) {
-#ifdef HAVE_UTIMES
+#if defined(USE_AT_CALLS) && defined(HAVE_UTIMENSAT)
+			struct timespec ts[2];
+
+			ts[0].tv_sec = p->atime;
+			ts[0].tv_nsec = p->atime_nanos;
+#ifdef HAVE_STRUCT_STAT_ST_BIRTHTIME
+			/* if it's valid and not mtime, push the birthtime first */
+			if (((ts[1].tv_sec = p->birthtime) < p->mtime) &&
+			(p->birthtime > 0))
+			{
+				ts[1].tv_nsec = p->birthtime_nanos;
+				utimensat(dfd, base, ts, 0);
+			}
+#endif
+			ts[1].tv_sec = p->mtime;
+			ts[1].tv_nsec = p->mtime_nanos;
+			utimensat(dfd, base, ts, AT_SYMLINK_NOFOLLOW);
+#elif defined(HAVE_UTIMES)
 			/* {f,l,}utimes() are preferred, when available. */
 #if defined(_WIN32) && !defined(__CYGWIN__)
 			struct __timeval times[2];
@@ -1305,19 +1475,27 @@ _archive_write_close(struct archive *_a)
 			utime(p->name, &times);
 #endif
 		}
-		if (p->fixup & TODO_MODE_BASE)
+		if (p->fixup & TODO_MODE_BASE) {
+#ifdef USE_AT_CALLS
+			fchmodat(dfd, base, p->mode, 0);
+#else
 			chmod(p->name, p->mode);
+#endif
+		}
 
 		if (p->fixup & TODO_FFLAGS)
 			set_fflags_platform(a, -1, p->name,
 			    p->mode, p->fflags_set, 0);
 
-		next = p->next;
-		free(p->name);
 		free(p);
-		p = next;
 	}
-	a->fixup_list = NULL;
+	(void)dfd; /* UNUSED */
+	(void)base; /* UNUSED */
+#ifdef USE_AT_CALLS
+	release_dir(a);
+#endif
+	a->fixup_count = 0;
+	a->current_fixup = NULL;
 	return (ret);
 }
 
@@ -1331,9 +1509,15 @@ _archive_write_finish(struct archive *_a)
 		(a->cleanup_gid)(a->lookup_gid_data);
 	if (a->cleanup_uid != NULL && a->lookup_uid_data != NULL)
 		(a->cleanup_uid)(a->lookup_uid_data);
+	id_cache_clear(&a->gid_cache);
+	id_cache_clear(&a->uid_cache);
 	if (a->entry)
 		archive_entry_free(a->entry);
 	archive_string_free(&a->_name_data);
+#ifdef USE_AT_CALLS
+	archive_string_free(&a->dir_name);
+#endif
+	free(a->fixup_list);
 	archive_string_free(&a->archive.error_string);
 	archive_string_free(&a->path_safe);
 	free(a);
@@ -1341,68 +1525,41 @@ _archive_write_finish(struct archive *_a)
 }
 
 /*
- * Simple O(n log n) merge sort to order the fixup list.  In
- * particular, we want to restore dir timestamps depth-first.
+ * Order the fixup list so that dirs are fixed up after everything
+ * inside them: deepest entries first.  Within one depth, sorting by
+ * name brings the entries of each dir together.
  */
-static struct fixup_entry *
-sort_dir_list(struct fixup_entry *p)
+static int
+cmp_fixup(const void *a, const void *b)
 {
-	struct fixup_entry *a, *b, *t;
+	const struct fixup_entry *fa = *(const struct fixup_entry * const *)a;
+	const struct fixup_entry *fb = *(const struct fixup_entry * const *)b;
 
-	if (p == NULL)
-		return (NULL);
-	/* A one-item list is already sorted. */
-	if (p->next == NULL)
-		return (p);
-
-	/* Step 1: split the list. */
-	t = p;
-	a = p->next->next;
-	while (a != NULL) {
-		/* Step a twice, t once. */
-		a = a->next;
-		if (a != NULL)
-			a = a->next;
-		t = t->next;
-	}
-	/* Now, t is at the mid-point, so break the list here. */
-	b = t->next;
-	t->next = NULL;
-	a = p;
-
-	/* Step 2: Recursively sort the two sub-lists. */
-	a = sort_dir_list(a);
-	b = sort_dir_list(b);
-
-	/* Step 3: Merge the returned lists. */
-	/* Pick the first element for the merged list. */
-	if (strcmp(a->name, b->name) > 0) {
-		t = p = a;
-		a = a->next;
-	} else {
-		t = p = b;
-		b = b->next;
-	}
-
-	/* Always put the later element on the list first. */
-	while (a != NULL && b != NULL) {
-		if (strcmp(a->name, b->name) > 0) {
-			t->next = a;
-			a = a->next;
-		} else {
-			t->next = b;
-			b = b->next;
-		}
-		t = t->next;
-	}
-
-	/* Only one list is non-empty, so just splice it on. */
-	if (a != NULL)
-		t->next = a;
-	if (b != NULL)
-		t->next = b;
+	if (fa->depth != fb->depth)
+		return (fa->depth > fb->depth ? -1 : 1);
+	return (strcmp(fa->name, fb->name));
+}
 
-	return (p);
+/*
+ * Number of path elements, not counting "." and taking ".." into
+ * account, so that the depth ordering above matches the tree.
+ */
+static int
+path_depth(const char *p)
+{
+	int depth = 0;
+
+	while (*p != '\0') {
+		const char *q = p;
+		while (*q != '\0' && *q != '/')
+			q++;
+		if (q - p == 2 && p[0] == '.' && p[1] == '.')
+			depth--;
+		else if (q > p && !(q - p == 1 && p[0] == '.'))
+			depth++;
+		p = (*q == '/') ? q + 1 : q;
+	}
+	return (depth);
 }
 
 /*
@@ -1415,14 +1572,26 @@ static struct fixup_entry *
 new_fixup(struct archive_write_disk *a, const char *pathname)
 {
 	struct fixup_entry *fe;
+	size_t len = strlen(pathname);
 
-	fe = (struct fixup_entry *)malloc(sizeof(struct fixup_entry));
+	if (a->fixup_count == a->fixup_size) {
+		struct fixup_entry **list;
+		size_t size = a->fixup_size == 0 ? 64 : a->fixup_size * 2;
+
+		list = (struct fixup_entry **)realloc(a->fixup_list,
+		    size * sizeof(list[0]));
+		if (list == NULL)
+			return (NULL);
+		a->fixup_list = list;
+		a->fixup_size = size;
+	}
+	fe = (struct fixup_entry *)malloc(sizeof(*fe) + len);
 	if (fe == NULL)
 		return (NULL);
-	fe->next = a->fixup_list;
-	a->fixup_list = fe;
+	a->fixup_list[a->fixup_count++] = fe;
 	fe->fixup = 0;
-	fe->name = strdup(pathname);
+	fe->depth = path_depth(pathname);
+	memcpy(fe->name, pathname, len + 1);
 	return (fe);
 }
 
@@ -1437,6 +1606,55 @@ current_fixup(struct archive_write_disk *a, const char *pathname)
 	return (a->current_fixup);
 }
 
+#ifdef USE_AT_CALLS
+/*
+ * Closes the dir held open by check_symlinks() or fixup_dir().
+ */
+static void
+release_dir(struct archive_write_disk *a)
+{
+	if (a->dir_fd >= 0) {
+		close(a->dir_fd);
+		a->dir_fd = -1;
+	}
+	archive_string_empty(&a->dir_name);
+}
+#endif
+
+/*
+ * Returns the dir fd to fix up 'name' relative to and sets *base to
+ * the name to use there.  The parent stays open for the next call,
+ * as the sorted fixup list visits each dir's entries together.
+ * Falls back to the full path (and AT_FDCWD) if it can't be opened.
+ */
+static int
+fixup_dir(struct archive_write_disk *a, const char *name, const char **base)
+{
+#ifdef USE_AT_CALLS
+	const char *slash = strrchr(name, '/');
+	size_t len;
+
+	*base = name;
+	if (slash == NULL || slash[1] == '\0')
+		return (AT_FDCWD);
+	len = (slash == name) ? 1 : (size_t)(slash - name);
+	if (a->dir_name.length != len
+	    || memcmp(a->dir_name.s, name, len) != 0) {
+		release_dir(a);
+		archive_strncpy(&a->dir_name, name, len);
+		a->dir_fd = open(a->dir_name.s, O_DIR_SEARCH);
+	}
+	if (a->dir_fd < 0)
+		return (AT_FDCWD);
+	*base = slash + 1;
+	return (a->dir_fd);
+#else
+	(void)a; /* UNUSED */
+	*base = name;
+	return (-1);
+#endif
+}
+
 /* TODO: Make this work. */
 /*
  * TODO: The deep-directory support bypasses this; disable deep directory
@@ -1449,6 +1667,126 @@ current_fixup(struct archive_write_disk *a, const char *pathname)
  */
 /* TODO: Extend this to support symlinks on Windows Vista and later. */
 
+#ifdef USE_AT_CALLS
+/*
+ * The symlink check below, using openat(O_NOFOLLOW) to step into each
+ * dir rather than chdir().  The walk starts at 'head', a suffix of
+ * 'path' naming something relative to 'start'; 'path' is only used
+ * in error messages.  On return, *deepest is an fd for the deepest
+ * dir reached ('start' itself if none) and path[0..*dirlen) names it.
+ */
+static int
+check_symlinks_at(char *path, char *head, int start, int *deepest,
+    size_t *dirlen, int *error_number, struct archive_string *error_string,
+    int flags)
+{
+	int res = ARCHIVE_OK;
+	char *tail;
+	int last;
+	char c;
+	int fd, nfd, r;
+	struct stat st;
+
+	*deepest = fd = start;
+	tail = head;
+	last = 0;
+	/* Skip the root directory if the path is absolute. */
+	if (tail == path && tail[0] == '/')
+		++tail;
+	while (!last) {
+		/* Skip the separator we just consumed, plus any adjacent ones */
+		while (*tail == '/')
+		    ++tail;
+		/* Skip the next path element. */
+		while (*tail != '\0' && *tail != '/')
+			++tail;
+		/* is this the last path component? */
+		last = (tail[0] == '\0') || (tail[0] == '/' && tail[1] == '\0');
+		/* temporarily truncate the string here */
+		c = tail[0];
+		tail[0] = '\0';
+		if (!last) {
+			/* Usually this is a real dir, and we just step in. */
+			nfd = openat(fd, head, O_DIR_SEARCH | O_NOFOLLOW);
+			if (nfd >= 0) {
+				if (fd != start)
+					close(fd);
+				*deepest = fd = nfd;
+				*dirlen = tail - path;
+				tail[0] = c;
+				head = tail + 1;
+				tail++;
+				continue;
+			}
+		}
+		/* Otherwise, find out what it is. */
+		r = fstatat(fd, head, &st, AT_SYMLINK_NOFOLLOW);
+		if (r != 0) {
+			tail[0] = c;
+			/* We've hit a dir that doesn't exist; stop now. */
+			if (errno == ENOENT)
+				break;
+			if (error_number) *error_number = errno;
+			if (error_string)
+				archive_string_sprintf(error_string,
+				    "Could not stat %s", path);
+			res = ARCHIVE_FAILED;
+			break;
+		} else if (S_ISDIR(st.st_mode)) {
+			/*
+			 * A dir we can't open (search-only permission
+			 * without O_PATH/O_SEARCH): leave head where it
+			 * is and look up the next element through it.
+			 */
+		} else if (S_ISLNK(st.st_mode)) {
+			if (last) {
+				/*
+				 * Last element is symlink; remove it
+				 * so we can overwrite it with the
+				 * item being extracted.
+				 */
+				tail[0] = c;
+				if (unlinkat(fd, head, 0)) {
+					if (error_number) *error_number = errno;
+					if (error_string)
+						archive_string_sprintf(error_string,
+						    "Could not remove symlink %s",
+						    path);
+					res = ARCHIVE_FAILED;
+				}
+				break;
+			} else if (flags & ARCHIVE_EXTRACT_UNLINK) {
+				/* User asked us to remove problems. */
+				if (unlinkat(fd, head, 0) != 0) {
+					tail[0] = c;
+					if (error_number) *error_number = 0;
+					if (error_string)
+						archive_string_sprintf(error_string,
+						    "Cannot remove intervening symlink %s",
+						    path);
+					res = ARCHIVE_FAILED;
+					break;
+				}
+			} else {
+				tail[0] = c;
+				if (error_number) *error_number = 0;
+				if (error_string)
+					archive_string_sprintf(error_string,
+					    "Cannot extract through symlink %s",
+					    path);
+				res = ARCHIVE_FAILED;
+				break;
+			}
+		}
+		/* be sure to always maintain this */
+		tail[0] = c;
+		if (tail[0] != '\0')
+			tail++; /* Advance to the next segment. */
+	}
+	return (res);
+}
+#endif
+
 /*
  * Checks the given path to see if any elements along it are symlinks.  Returns
  * ARCHIVE_OK if there are none, otherwise puts an error in errmsg.
@@ -1464,6 +1802,18 @@ check_symlinks_fsobj(char *path, int *error_number, struct archive_string *error
 	(void)error_string; /* UNUSED */
 	(void)flags; /* UNUSED */
 	return (ARCHIVE_OK);
+#elif defined(USE_AT_CALLS)
+	size_t dirlen = 0;
+	int fd, res;
+
+	/* Nothing to do here if name is empty */
+	if(path[0] == '\0')
+	    return (ARCHIVE_OK);
+	res = check_symlinks_at(path, path, AT_FDCWD, &fd, &dirlen,
+	    error_number, error_string, flags);
+	if (fd != AT_FDCWD)
+		close(fd);
+	return (res);
 #else
 	int res = ARCHIVE_OK;
 	char *tail;
@@ -1658,8 +2008,69 @@ check_symlinks(struct archive_write_disk *a)
 	struct archive_string error_string;
 	int error_number;
 	int rc;
+#ifdef USE_AT_CALLS
+	struct stat st;
+	size_t dirlen = 0;
+	char *head = a->name, *slash;
+	int fd, start = AT_FDCWD, have_cwd = 0;
+#endif
 	archive_string_init(&error_string);
+#ifdef USE_AT_CALLS
+	/*
+	 * Pick up the walk at the dir held from the last entry if it
+	 * is an ancestor of this one.  It's no good if the application
+	 * changed the cwd since, or if this entry could replace it.
+	 */
+	if (a->dir_fd >= 0 && a->name[0] != '/') {
+		if (stat(".", &st) == 0) {
+			have_cwd = 1;
+			if (st.st_dev != a->dir_cwd_dev
+			    || st.st_ino != a->dir_cwd_ino)
+				release_dir(a);
+		} else
+			release_dir(a);
+	}
+	if (a->dir_fd >= 0) {
+		dirlen = a->dir_name.length;
+		if (strncmp(a->name, a->dir_name.s, dirlen) == 0
+		    && a->name[dirlen] == '/' && a->name[dirlen + 1] != '\0') {
+			start = a->dir_fd;
+			head = a->name + dirlen + 1;
+		} else {
+			release_dir(a);
+			dirlen = 0;
+		}
+	}
+	rc = check_symlinks_at(a->name, head, start, &fd, &dirlen,
+	    &error_number, &error_string, a->flags);
+	if (rc != ARCHIVE_OK) {
+		if (fd != start)
+			close(fd);
+		release_dir(a);
+	} else if (fd != start) {
+		/* Hold the new deepest dir for the next entry. */
+		release_dir(a);
+		a->dir_fd = fd;
+		archive_strncpy(&a->dir_name, a->name, dirlen);
+		if (a->name[0] != '/') {
+			if (!have_cwd && stat(".", &st) != 0)
+				release_dir(a);
+			else {
+				a->dir_cwd_dev = st.st_dev;
+				a->dir_cwd_ino = st.st_ino;
+			}
+		}
+	}
+	/* Create the entry relative to the held dir if that's the parent. */
+	slash = strrchr(a->name, '/');
+	if (a->dir_fd >= 0 && slash != NULL
+	    && (size_t)(slash - a->name) == a->dir_name.length) {
+		a->at_fd = a->dir_fd;
+		a->at_name = slash + 1;
+	}
+#else
 	rc = check_symlinks_fsobj(a->name, &error_number, &error_string, a->flags);
+#endif
 	if (rc != ARCHIVE_OK) {
 		archive_set_error(&a->archive, error_number, "%s", error_string.s);
 	}
@@ -1992,7 +2403,14 @@ set_ownership(struct archive_write_disk *a)
 
 	/* We prefer lchown() but will use chown() if that's all we have. */
 	/* Of course, if we have neither, this will always fail. */
-#ifdef HAVE_LCHOWN
+#if defined(USE_AT_CALLS)
+	if (fchownat(a->at_fd, a->at_name, a->uid, a->gid,
+	    AT_SYMLINK_NOFOLLOW) == 0) {
+		/* We've set owner and know uid/gid are correct. */
+		a->todo &= ~(TODO_OWNER | TODO_SGID_CHECK | TODO_SUID_CHECK);
+		return (ARCHIVE_OK);
+	}
+#elif defined(HAVE_LCHOWN)
 	if (lchown(a->name, a->uid, a->gid) == 0) {
 		/* We've set owner and know uid/gid are correct. */
 		a->todo &= ~(TODO_OWNER | TODO_SGID_CHECK | TODO_SUID_CHECK);
@@ -2262,7 +2680,11 @@ set_mode(struct archive_write_disk *a, int mode)
 #endif
 			/* If this platform lacks fchmod(), then
 			 * we'll just use chmod(). */
+#ifdef USE_AT_CALLS
+			if (fchmodat(a->at_fd, a->at_name, mode, 0) != 0) {
+#else
 			if (chmod(a->name, mode) != 0) {
+#endif
 				archive_set_error(&a->archive, errno,
 				    "Can't set permissions to 0%o", (int)mode);
 				r = ARCHIVE_WARN;
@@ -2761,6 +3183,62 @@ trivial_lookup_uid(void *private_data, const char *uname, uid_t uid)
 	return (uid);
 }
 
+/*
+ * Cache of lookup results, keyed on both name and id since the
+ * lookup functions see both.  Replacement is round-robin; with
+ * ID_CACHE_SIZE slots that is as good as LRU for real archives.
+ */
+static int
+id_cache_find(struct id_cache *c, const char *name, int64_t id,
+    int64_t *result)
+{
+	int i;
+
+	for (i = 0; i < c->used; i++) {
+		if (c->slot[i].id != id)
+			continue;
+		if (name == NULL ? c->slot[i].name == NULL :
+		    (c->slot[i].name != NULL
+			&& strcmp(c->slot[i].name, name) == 0)) {
+			*result = c->slot[i].result;
+			return (1);
+		}
+	}
+	return (0);
+}
+
+static void
+id_cache_add(struct id_cache *c, const char *name, int64_t id,
+    int64_t result)
+{
+	char *copy = NULL;
+	int i;
+
+	if (name != NULL && (copy = strdup(name)) == NULL)
+		return; /* Just don't cache it. */
+	if (c->used < ID_CACHE_SIZE)
+		i = c->used++;
+	else {
+		i = c->next;
+		c->next = (c->next + 1) % ID_CACHE_SIZE;
+		free(c->slot[i].name);
+	}
+	c->slot[i].name = copy;
+	c->slot[i].id = id;
+	c->slot[i].result = result;
+}
+
+static void
+id_cache_clear(struct id_cache *c)
+{
+	int i;
+
+	for (i = 0; i < c->used; i++)
+		free(c->slot[i].name);
+	c->used = 0;
+	c->next = 0;
+}
+
 /*
  * Test if file on disk is older than entry.
  */
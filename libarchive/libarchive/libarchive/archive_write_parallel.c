@@ -0,0 +1,405 @@
+/*-
+ * Copyright (c) 2026 The libarchive Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "archive_platform.h"
+__FBSDID("$FreeBSD$");
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "archive.h"
+#include "archive_private.h"
+#include "archive_write_private.h"
+#include "archive_write_parallel_private.h"
+
+/* Most threads a "threads" option may ask for. */
+#define	PARALLEL_MAX_THREADS	256
+
+enum slot_state {
+	SLOT_FREE,	/* Owned by the caller; the one at 'head' is filling. */
+	SLOT_QUEUED,	/* Waiting for a worker. */
+	SLOT_RUNNING,	/* Being compressed. */
+	SLOT_DONE	/* Compressed, waiting to be emitted. */
+};
+
+struct slot {
+	struct archive_write_parallel_block	 block;
+	enum slot_state				 state;
+	int					 status;
+};
+
+struct archive_write_parallel {
+	struct archive_write			*a;
+	archive_write_parallel_compress_cb	*compress;
+	archive_write_parallel_emit_cb		*emit;
+	archive_write_parallel_free_cb		*free_data;
+	void					*cookie;
+	size_t					 block_size;
+	size_t					 dict_size;
+
+	/*
+	 * Ring of blocks.  The 'inflight' slots from 'tail' on are
+	 * queued, running or done, in stream order, and the one after
+	 * them, 'head', is being filled.  'next' is the oldest one no
+	 * worker has picked up yet.
+	 */
+	struct slot				*slots;
+	int					 nslots;
+	int					 head;
+	int					 tail;
+	int					 inflight;
+	int					 next;
+	int					 queued;
+
+	/* The input just before the block at 'head'. */
+	unsigned char				*dict;
+	size_t					 dict_len;
+
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_t				 lock;
+	pthread_cond_t				 work;	/* Block queued. */
+	pthread_cond_t				 done;	/* Block compressed. */
+	pthread_t				*workers;
+	int					 nworkers;
+	int					 shutdown;
+#endif
+};
+
+#ifdef HAVE_PTHREAD_H
+static void *
+worker(void *arg)
+{
+	struct archive_write_parallel *p = arg;
+	struct slot *s;
+	int status;
+
+	pthread_mutex_lock(&p->lock);
+	for (;;) {
+		while (p->queued == 0 && !p->shutdown)
+			pthread_cond_wait(&p->work, &p->lock);
+		if (p->queued == 0)
+			break;
+		s = &p->slots[p->next];
+		p->next = (p->next + 1) % p->nslots;
+		p->queued--;
+		s->state = SLOT_RUNNING;
+		pthread_mutex_unlock(&p->lock);
+
+		status = (p->compress)(p->cookie, &s->block);
+
+		pthread_mutex_lock(&p->lock);
+		s->status = status;
+		s->state = SLOT_DONE;
+		pthread_cond_broadcast(&p->done);
+	}
+	pthread_mutex_unlock(&p->lock);
+	return (NULL);
+}
+#endif
+
+struct archive_write_parallel *
+__archive_write_parallel_new(struct archive_write *a, int threads,
+    size_t block_size, size_t dict_size, size_t out_size,
+    archive_write_parallel_compress_cb *compress,
+    archive_write_parallel_emit_cb *emit,
+    archive_write_parallel_free_cb *free_data, void *cookie)
+{
+	struct archive_write_parallel *p;
+	int i;
+
+	p = calloc(1, sizeof(*p));
+	if (p == NULL)
+		goto nomem;
+	p->a = a;
+	p->compress = compress;
+	p->emit = emit;
+	p->free_data = free_data;
+	p->cookie = cookie;
+	p->block_size = block_size;
+	p->dict_size = dict_size;
+
+	/* Two blocks per thread keep the workers busy while the
+	 * caller fills and emits. */
+	p->nslots = threads * 2;
+	if (p->nslots < 2)
+		p->nslots = 2;
+	p->slots = calloc(p->nslots, sizeof(*p->slots));
+	if (p->slots == NULL)
+		goto nomem;
+	if (dict_size > 0 && (p->dict = malloc(dict_size)) == NULL)
+		goto nomem;
+	for (i = 0; i < p->nslots; i++) {
+		struct archive_write_parallel_block *b = &p->slots[i].block;
+		b->in = malloc(block_size);
+		b->out = malloc(out_size);
+		if (b->in == NULL || b->out == NULL)
+			goto nomem;
+		if (dict_size > 0 && (b->dict = malloc(dict_size)) == NULL)
+			goto nomem;
+	}
+
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_init(&p->lock, NULL);
+	pthread_cond_init(&p->work, NULL);
+	pthread_cond_init(&p->done, NULL);
+	p->workers = calloc(threads, sizeof(*p->workers));
+	if (p->workers == NULL) {
+		pthread_cond_destroy(&p->done);
+		pthread_cond_destroy(&p->work);
+		pthread_mutex_destroy(&p->lock);
+		goto nomem;
+	}
+	/* If some threads can't be had, make do with the others, or
+	 * with none at all. */
+	for (i = 0; i < threads; i++) {
+		if (pthread_create(&p->workers[i], NULL, worker, p) != 0)
+			break;
+		p->nworkers++;
+	}
+#endif
+	return (p);
+
+nomem:
+	archive_set_error(&a->archive, ENOMEM,
+	    "Can't allocate data for compression");
+	__archive_write_parallel_free(p);
+	return (NULL);
+}
+
+/*
+ * Hands the oldest blocks that are done to the compressor, in order,
+ * waiting for the first 'need' of them if they aren't done yet.
+ */
+static int
+emit_blocks(struct archive_write_parallel *p, int need)
+{
+	struct slot *s;
+	int done, ret;
+
+	while (p->inflight > 0) {
+		s = &p->slots[p->tail];
+#ifdef HAVE_PTHREAD_H
+		/* Only the lock orders the worker's output before our
+		 * reads of it, so decide under it. */
+		pthread_mutex_lock(&p->lock);
+		while (need > 0 && s->state != SLOT_DONE)
+			pthread_cond_wait(&p->done, &p->lock);
+		done = (s->state == SLOT_DONE);
+		pthread_mutex_unlock(&p->lock);
+#else
+		done = (s->state == SLOT_DONE);
+#endif
+		if (!done)
+			break;
+		if (s->status != ARCHIVE_OK) {
+			archive_set_error(&p->a->archive, ARCHIVE_ERRNO_MISC,
+			    "%s compression failed",
+			    p->a->archive.compression_name);
+			return (ARCHIVE_FATAL);
+		}
+		ret = (p->emit)(p->a, p->cookie, &s->block);
+		if (ret != ARCHIVE_OK)
+			return (ret);
+		s->block.in_len = 0;
+		s->block.out_len = 0;
+		s->state = SLOT_FREE;
+		p->tail = (p->tail + 1) % p->nslots;
+		p->inflight--;
+		need--;
+	}
+	return (ARCHIVE_OK);
+}
+
+/*
+ * Queues the block at 'head' and moves on to the next slot, first
+ * emitting the oldest block if that one is still in flight.
+ */
+static int
+submit_block(struct archive_write_parallel *p, int last)
+{
+	struct slot *s = &p->slots[p->head];
+	struct archive_write_parallel_block *b = &s->block;
+	size_t keep;
+	int ret;
+
+	b->last = last;
+	b->dict_len = p->dict_len;
+	if (p->dict_len > 0)
+		memcpy(b->dict, p->dict, p->dict_len);
+	/* The next block's dictionary ends with this one. */
+	if (p->dict_size > 0) {
+		if (b->in_len >= p->dict_size) {
+			memcpy(p->dict, b->in + b->in_len - p->dict_size,
+			    p->dict_size);
+			p->dict_len = p->dict_size;
+		} else {
+			keep = p->dict_size - b->in_len;
+			if (keep > p->dict_len)
+				keep = p->dict_len;
+			memmove(p->dict, p->dict + p->dict_len - keep, keep);
+			memcpy(p->dict + keep, b->in, b->in_len);
+			p->dict_len = keep + b->in_len;
+		}
+	}
+
+	p->inflight++;
+#ifdef HAVE_PTHREAD_H
+	if (p->nworkers > 0) {
+		pthread_mutex_lock(&p->lock);
+		s->state = SLOT_QUEUED;
+		p->queued++;
+		pthread_cond_signal(&p->work);
+		pthread_mutex_unlock(&p->lock);
+	} else
+#endif
+	{
+		s->status = (p->compress)(p->cookie, b);
+		s->state = SLOT_DONE;
+	}
+
+	ret = emit_blocks(p, p->inflight == p->nslots ? 1 : 0);
+	p->head = (p->tail + p->inflight) % p->nslots;
+	return (ret);
+}
+
+int
+__archive_write_parallel_write(struct archive_write_parallel *p,
+    const void *buff, size_t length)
+{
+	const unsigned char *in = buff;
+	struct archive_write_parallel_block *b;
+	size_t n;
+	int ret;
+
+	while (length > 0) {
+		b = &p->slots[p->head].block;
+		n = p->block_size - b->in_len;
+		if (n > length)
+			n = length;
+		memcpy(b->in + b->in_len, in, n);
+		b->in_len += n;
+		in += n;
+		length -= n;
+		if (b->in_len == p->block_size) {
+			ret = submit_block(p, 0);
+			if (ret != ARCHIVE_OK)
+				return (ret);
+		}
+	}
+	return (ARCHIVE_OK);
+}
+
+/*
+ * Compresses whatever is left as the last block of the stream, and
+ * emits everything.
+ */
+int
+__archive_write_parallel_finish(struct archive_write_parallel *p)
+{
+	int ret;
+
+	ret = submit_block(p, 1);
+	if (ret != ARCHIVE_OK)
+		return (ret);
+	return (emit_blocks(p, p->inflight));
+}
+
+void
+__archive_write_parallel_free(struct archive_write_parallel *p)
+{
+	int i;
+
+	if (p == NULL)
+		return;
+#ifdef HAVE_PTHREAD_H
+	if (p->workers != NULL) {
+		pthread_mutex_lock(&p->lock);
+		p->shutdown = 1;
+		/* Anything still queued after an error is dropped. */
+		p->queued = 0;
+		pthread_cond_broadcast(&p->work);
+		pthread_mutex_unlock(&p->lock);
+		for (i = 0; i < p->nworkers; i++)
+			pthread_join(p->workers[i], NULL);
+		free(p->workers);
+		pthread_cond_destroy(&p->done);
+		pthread_cond_destroy(&p->work);
+		pthread_mutex_destroy(&p->lock);
+	}
+#endif
+	if (p->slots != NULL) {
+		for (i = 0; i < p->nslots; i++) {
+			struct archive_write_parallel_block *b =
+			    &p->slots[i].block;
+			if (b->data != NULL && p->free_data != NULL)
+				(p->free_data)(p->cookie, b);
+			free(b->in);
+			free(b->out);
+			free(b->dict);
+		}
+		free(p->slots);
+	}
+	free(p->dict);
+	free(p);
+}
+
+int
+__archive_write_parallel_threads(const char *value)
+{
+	long n = 0;
+
+	if (value == NULL || *value == '\0')
+		return (-1);
+	for (; *value != '\0'; value++) {
+		if (*value < '0' || *value > '9')
+			return (-1);
+		n = n * 10 + (*value - '0');
+		if (n > PARALLEL_MAX_THREADS)
+			return (-1);
+	}
+	if (n == 0) {
+#if defined(HAVE_UNISTD_H) && defined(_SC_NPROCESSORS_ONLN)
+		n = sysconf(_SC_NPROCESSORS_ONLN);
+		if (n > PARALLEL_MAX_THREADS)
+			n = PARALLEL_MAX_THREADS;
+#endif
+		if (n < 1)
+			n = 1;
+	}
+	return ((int)n);
+}
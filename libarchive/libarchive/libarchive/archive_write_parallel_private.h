@@ -0,0 +1,95 @@
+/*-
+ * Copyright (c) 2026 The libarchive Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * $FreeBSD$
+ */
+
+#ifndef __LIBARCHIVE_BUILD
+#error This header is only to be used internally to libarchive.
+#endif
+
+#ifndef ARCHIVE_WRITE_PARALLEL_PRIVATE_H_INCLUDED
+#define	ARCHIVE_WRITE_PARALLEL_PRIVATE_H_INCLUDED
+
+#include "archive_write_private.h"
+
+/*
+ * Block-parallel compression for the gzip and xz writers.
+ *
+ * The uncompressed stream is cut into blocks of a fixed size.  Each
+ * block is compressed on its own by a pool of worker threads, and the
+ * results are handed back to the compressor in the original order on
+ * the caller's thread, which stitches them into one standard stream.
+ * Without thread support, blocks are compressed as they fill up.
+ */
+
+struct archive_write_parallel_block {
+	/* Input: the uncompressed data, and a copy of up to dict_size
+	 * bytes that came right before it. */
+	unsigned char	*in;
+	size_t		 in_len;
+	unsigned char	*dict;
+	size_t		 dict_len;
+	/* Set on the final block of the stream, which may be empty. */
+	int		 last;
+
+	/* Output, filled in by the compress callback. */
+	unsigned char	*out;
+	size_t		 out_len;
+	/* Block check and sizes, whatever the compressor needs. */
+	uint64_t	 check;
+	uint64_t	 size;
+
+	/* Compressor state kept with the block and reused; see free_cb. */
+	void		*data;
+};
+
+/* Runs on a worker thread.  Returns ARCHIVE_OK or ARCHIVE_FATAL. */
+typedef int	archive_write_parallel_compress_cb(void *cookie,
+		    struct archive_write_parallel_block *);
+/* Runs on the caller's thread, for each block in order. */
+typedef int	archive_write_parallel_emit_cb(struct archive_write *,
+		    void *cookie, struct archive_write_parallel_block *);
+/* Releases block->data. */
+typedef void	archive_write_parallel_free_cb(void *cookie,
+		    struct archive_write_parallel_block *);
+
+struct archive_write_parallel;
+
+struct archive_write_parallel *__archive_write_parallel_new(
+		    struct archive_write *, int threads, size_t block_size,
+		    size_t dict_size, size_t out_size,
+		    archive_write_parallel_compress_cb *,
+		    archive_write_parallel_emit_cb *,
+		    archive_write_parallel_free_cb *, void *cookie);
+int	__archive_write_parallel_write(struct archive_write_parallel *,
+		    const void *, size_t);
+int	__archive_write_parallel_finish(struct archive_write_parallel *);
+void	__archive_write_parallel_free(struct archive_write_parallel *);
+
+/* Number of threads asked for by a "threads" option value; "0" means one
+ * per online CPU.  Returns -1 if the value isn't a number. */
+int	__archive_write_parallel_threads(const char *value);
+
+#endif
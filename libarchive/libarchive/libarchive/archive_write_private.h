@@ -85,6 +85,15 @@ struct archive_write {
 			    const char *key, const char *value);
 		int	(*finish)(struct archive_write *);
 		int	(*write)(struct archive_write *, const void *, size_t);
+		/*
+		 * Optional, set by init: end the compressed stream and
+		 * start a new one, returning the raw offset where it
+		 * begins; and queue bytes to follow the compressed data
+		 * where a reader can find them without decompressing.
+		 * Both are for archive_write_set_tar_index().
+		 */
+		int64_t	(*restart)(struct archive_write *);
+		int	(*trailer)(struct archive_write *, const void *, size_t);
 	} compressor;
 
 	/*
@@ -103,6 +112,18 @@ struct archive_write {
 		    struct archive_entry *);
 	ssize_t	(*format_write_data)(struct archive_write *,
 		    const void *buff, size_t);
+
+	/*
+	 * Hooks for archive_write_set_tar_index(), which keeps its state
+	 * in index_data so that clients that don't use it don't link it.
+	 */
+	void	 *index_data;
+	int	(*index_open)(struct archive_write *);
+	int	(*index_pre_header)(struct archive_write *);
+	int	(*index_post_header)(struct archive_write *,
+		    struct archive_entry *);
+	int	(*index_close)(struct archive_write *);
+	void	(*index_free)(struct archive_write *);
 };
 
 /*
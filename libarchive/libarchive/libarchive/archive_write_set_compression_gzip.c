@@ -44,6 +44,7 @@ __FBSDID("$FreeBSD: head/lib/libarchive/archive_write_set_compression_gzip.c 201
 #include "archive.h"
 #include "archive_private.h"
 #include "archive_write_private.h"
+#include "archive_write_parallel_private.h"
 
 #ifndef HAVE_ZLIB_H
 int
@@ -62,12 +63,33 @@ struct private_data {
 	unsigned char	*compressed;
 	size_t		 compressed_buffer_size;
 	unsigned long	 crc;
+	/* Input to the current gzip member, for its trailer. */
+	int64_t		 member_in;
+	/* A footer to carry in a last, empty member; see
+	 * archive_compressor_gzip_trailer(). */
+	unsigned char	*locator;
+	size_t		 locator_len;
+	/* Set when blocks are compressed on several threads. */
+	struct archive_write_parallel *parallel;
+	int		 threads;
+	int		 compression_level;
+	size_t		 block_out_size;
 };
 
 struct private_config {
 	int		 compression_level;
+	int		 threads;
 };
 
+/*
+ * With several threads, the input is cut into blocks that are deflated
+ * independently, each primed with the 32k of input before it so the
+ * ratio barely suffers, and ended with a sync flush so the blocks can
+ * be laid end to end in one deflate stream.
+ */
+#define	PARALLEL_BLOCK_SIZE	(128 * 1024)
+#define	PARALLEL_DICT_SIZE	(32 * 1024)
+
 
 /*
  * Yuck.  zlib.h is not const-correct, so I need this one bit
@@ -82,8 +104,23 @@ static int	archive_compressor_gzip_options(struct archive_write *,
 		    const char *, const char *);
 static int	archive_compressor_gzip_write(struct archive_write *,
 		    const void *, size_t);
+static void	build_header(unsigned char *, time_t, int flags);
+static int64_t	archive_compressor_gzip_restart(struct archive_write *);
+static int	archive_compressor_gzip_trailer(struct archive_write *,
+		    const void *, size_t);
 static int	drive_compressor(struct archive_write *, struct private_data *,
 		    int finishing);
+static int	end_member(struct archive_write *, struct private_data *);
+static int	flush_compressed(struct archive_write *, struct private_data *);
+static int	start_parallel(struct archive_write *, struct private_data *,
+		    int threads);
+static int	write_compressed(struct archive_write *, struct private_data *,
+		    const void *, size_t);
+static int	parallel_compress(void *,
+		    struct archive_write_parallel_block *);
+static int	parallel_emit(struct archive_write *, void *,
+		    struct archive_write_parallel_block *);
+static void	parallel_free(void *, struct archive_write_parallel_block *);
 
 
 /*
@@ -104,6 +141,7 @@ archive_write_set_compression_gzip(struct archive *_a)
 	a->compressor.config = config;
 	a->compressor.finish = &archive_compressor_gzip_finish;
 	config->compression_level = Z_DEFAULT_COMPRESSION;
+	config->threads = 1;
 	a->compressor.init = &archive_compressor_gzip_init;
 	a->compressor.options = &archive_compressor_gzip_options;
 	a->archive.compression_code = ARCHIVE_COMPRESSION_GZIP;
@@ -173,20 +211,26 @@ archive_compressor_gzip_init(struct archive_write *a)
 
 	/* Prime output buffer with a gzip header. */
 	t = time(NULL);
-	state->compressed[0] = 0x1f; /* GZip signature bytes */
-	state->compressed[1] = 0x8b;
-	state->compressed[2] = 0x08; /* "Deflate" compression */
-	state->compressed[3] = 0; /* No options */
-	state->compressed[4] = (t)&0xff;  /* Timestamp */
-	state->compressed[5] = (t>>8)&0xff;
-	state->compressed[6] = (t>>16)&0xff;
-	state->compressed[7] = (t>>24)&0xff;
-	state->compressed[8] = 0; /* No deflate options */
-	state->compressed[9] = 3; /* OS=Unix */
+	build_header(state->compressed, t, 0);
 	state->stream.next_out += 10;
 	state->stream.avail_out -= 10;
 
 	a->compressor.write = archive_compressor_gzip_write;
+	a->compressor.restart = archive_compressor_gzip_restart;
+	a->compressor.trailer = archive_compressor_gzip_trailer;
+
+	state->threads = config->threads;
+	if (config->threads > 1) {
+		state->compression_level = config->compression_level;
+		state->block_out_size = compressBound(PARALLEL_BLOCK_SIZE) + 64;
+		if (start_parallel(a, state, config->threads) != ARCHIVE_OK) {
+			free(state->compressed);
+			free(state);
+			return (ARCHIVE_FATAL);
+		}
+		a->compressor.data = state;
+		return (0);
+	}
 
 	/* Initialize compression library. */
 	ret = deflateInit2(&(state->stream),
@@ -245,6 +289,13 @@ archive_compressor_gzip_options(struct archive_write *a, const char *key,
 		config->compression_level = value[0] - '0';
 		return (ARCHIVE_OK);
 	}
+	if (strcmp(key, "threads") == 0) {
+		int threads = __archive_write_parallel_threads(value);
+		if (threads < 0)
+			return (ARCHIVE_WARN);
+		config->threads = threads;
+		return (ARCHIVE_OK);
+	}
 
 	return (ARCHIVE_WARN);
 }
@@ -267,9 +318,21 @@ archive_compressor_gzip_write(struct archive_write *a, const void *buff,
 		return (ARCHIVE_FATAL);
 	}
 
+	if (state->parallel != NULL) {
+		/* The blocks' crcs are added up as they come back. */
+		state->total_in += length;
+		ret = __archive_write_parallel_write(state->parallel,
+		    buff, length);
+		if (ret != ARCHIVE_OK)
+			return (ret);
+		a->archive.file_position += length;
+		return (ARCHIVE_OK);
+	}
+
 	/* Update statistics */
 	state->crc = crc32(state->crc, (const Bytef *)buff, length);
 	state->total_in += length;
+	state->member_in += length;
 
 	/* Compress input data to output buffer */
 	SET_NEXT_IN(state, buff);
@@ -291,7 +354,6 @@ archive_compressor_gzip_finish(struct archive_write *a)
 	int ret;
 	struct private_data *state;
 	unsigned tocopy;
-	unsigned char trailer[8];
 
 	state = (struct private_data *)a->compressor.data;
 	ret = 0;
@@ -309,6 +371,17 @@ archive_compressor_gzip_finish(struct archive_write *a)
 		if (a->pad_uncompressed) {
 			tocopy = a->bytes_per_block -
 			    (state->total_in % a->bytes_per_block);
+			while (state->parallel != NULL && tocopy > 0 &&
+			    tocopy < (unsigned)a->bytes_per_block) {
+				size_t n = tocopy < a->null_length ?
+				    tocopy : a->null_length;
+				state->total_in += n;
+				tocopy -= n;
+				ret = __archive_write_parallel_write(
+				    state->parallel, a->nulls, n);
+				if (ret != ARCHIVE_OK)
+					goto cleanup;
+			}
 			while (tocopy > 0 && tocopy < (unsigned)a->bytes_per_block) {
 				SET_NEXT_IN(state, a->nulls);
 				state->stream.avail_in = tocopy < a->null_length ?
@@ -316,6 +389,7 @@ archive_compressor_gzip_finish(struct archive_write *a)
 				state->crc = crc32(state->crc, a->nulls,
 				    state->stream.avail_in);
 				state->total_in += state->stream.avail_in;
+				state->member_in += state->stream.avail_in;
 				tocopy -= state->stream.avail_in;
 				ret = drive_compressor(a, state, 0);
 				if (ret != ARCHIVE_OK)
@@ -323,42 +397,16 @@ archive_compressor_gzip_finish(struct archive_write *a)
 			}
 		}
 
-		/* Finish compression cycle */
-		if (((ret = drive_compressor(a, state, 1))) != ARCHIVE_OK)
+		ret = end_member(a, state);
+		if (ret != ARCHIVE_OK)
 			goto cleanup;
 
-		/* Build trailer: 4-byte CRC and 4-byte length. */
-		trailer[0] = (state->crc)&0xff;
-		trailer[1] = (state->crc >> 8)&0xff;
-		trailer[2] = (state->crc >> 16)&0xff;
-		trailer[3] = (state->crc >> 24)&0xff;
-		trailer[4] = (state->total_in)&0xff;
-		trailer[5] = (state->total_in >> 8)&0xff;
-		trailer[6] = (state->total_in >> 16)&0xff;
-		trailer[7] = (state->total_in >> 24)&0xff;
-
-		/* Add trailer to current block. */
-		tocopy = 8;
-		if (tocopy > state->stream.avail_out)
-			tocopy = state->stream.avail_out;
-		memcpy(state->stream.next_out, trailer, tocopy);
-		state->stream.next_out += tocopy;
-		state->stream.avail_out -= tocopy;
-
-		/* If it overflowed, flush and start a new block. */
-		if (tocopy < 8) {
-			bytes_written = (a->client_writer)(&a->archive, a->client_data,
-			    state->compressed, state->compressed_buffer_size);
-			if (bytes_written <= 0) {
-				ret = ARCHIVE_FATAL;
+		/* The footer of a tar index goes in a last member. */
+		if (state->locator != NULL) {
+			ret = write_compressed(a, state, state->locator,
+			    state->locator_len);
+			if (ret != ARCHIVE_OK)
 				goto cleanup;
-			}
-			a->archive.raw_position += bytes_written;
-			state->stream.next_out = state->compressed;
-			state->stream.avail_out = state->compressed_buffer_size;
-			memcpy(state->stream.next_out, trailer + tocopy, 8-tocopy);
-			state->stream.next_out += 8-tocopy;
-			state->stream.avail_out -= 8-tocopy;
 		}
 
 		/* Optionally, pad the final compressed block. */
@@ -392,7 +440,9 @@ archive_compressor_gzip_finish(struct archive_write *a)
 
 		/* Cleanup: shut down compressor, release memory, etc. */
 	cleanup:
-		switch (deflateEnd(&(state->stream))) {
+		if (state->threads > 1)
+			__archive_write_parallel_free(state->parallel);
+		else switch (deflateEnd(&(state->stream))) {
 		case Z_OK:
 			break;
 		default:
@@ -400,6 +450,7 @@ archive_compressor_gzip_finish(struct archive_write *a)
 			    "Failed to clean up compressor");
 			ret = ARCHIVE_FATAL;
 		}
+		free(state->locator);
 		free(state->compressed);
 		free(state);
 	}
@@ -419,29 +470,13 @@ archive_compressor_gzip_finish(struct archive_write *a)
 static int
 drive_compressor(struct archive_write *a, struct private_data *state, int finishing)
 {
-	ssize_t bytes_written;
 	int ret;
 
 	for (;;) {
 		if (state->stream.avail_out == 0) {
-			bytes_written = (a->client_writer)(&a->archive,
-			    a->client_data, state->compressed,
-			    state->compressed_buffer_size);
-			if (bytes_written <= 0) {
-				/* TODO: Handle this write failure */
-				return (ARCHIVE_FATAL);
-			} else if ((size_t)bytes_written < state->compressed_buffer_size) {
-				/* Short write: Move remaining to
-				 * front of block and keep filling */
-				memmove(state->compressed,
-				    state->compressed + bytes_written,
-				    state->compressed_buffer_size - bytes_written);
-			}
-			a->archive.raw_position += bytes_written;
-			state->stream.next_out
-			    = state->compressed +
-			    state->compressed_buffer_size - bytes_written;
-			state->stream.avail_out = bytes_written;
+			ret = flush_compressed(a, state);
+			if (ret != ARCHIVE_OK)
+				return (ret);
 		}
 
 		/* If there's nothing to do, we're done. */
@@ -474,4 +509,258 @@ drive_compressor(struct archive_write *a, struct private_data *state, int finish
 	}
 }
 
+/*
+ * Write out the full output block.
+ */
+static int
+flush_compressed(struct archive_write *a, struct private_data *state)
+{
+	ssize_t bytes_written;
+
+	bytes_written = (a->client_writer)(&a->archive,
+	    a->client_data, state->compressed,
+	    state->compressed_buffer_size);
+	if (bytes_written <= 0) {
+		/* TODO: Handle this write failure */
+		return (ARCHIVE_FATAL);
+	} else if ((size_t)bytes_written < state->compressed_buffer_size) {
+		/* Short write: Move remaining to
+		 * front of block and keep filling */
+		memmove(state->compressed,
+		    state->compressed + bytes_written,
+		    state->compressed_buffer_size - bytes_written);
+	}
+	a->archive.raw_position += bytes_written;
+	state->stream.next_out
+	    = state->compressed +
+	    state->compressed_buffer_size - bytes_written;
+	state->stream.avail_out = bytes_written;
+	return (ARCHIVE_OK);
+}
+
+/*
+ * Append bytes to the output as they are: gzip framing, or data that
+ * is already deflated.
+ */
+static int
+write_compressed(struct archive_write *a, struct private_data *state,
+    const void *buff, size_t length)
+{
+	const unsigned char *p = buff;
+	size_t n;
+	int ret;
+
+	while (length > 0) {
+		if (state->stream.avail_out == 0) {
+			ret = flush_compressed(a, state);
+			if (ret != ARCHIVE_OK)
+				return (ret);
+		}
+		n = length;
+		if (n > state->stream.avail_out)
+			n = state->stream.avail_out;
+		memcpy(state->stream.next_out, p, n);
+		state->stream.next_out += n;
+		state->stream.avail_out -= n;
+		p += n;
+		length -= n;
+	}
+	return (ARCHIVE_OK);
+}
+
+static void
+build_header(unsigned char *h, time_t t, int flags)
+{
+	h[0] = 0x1f; /* GZip signature bytes */
+	h[1] = 0x8b;
+	h[2] = 0x08; /* "Deflate" compression */
+	h[3] = flags;
+	h[4] = (t)&0xff;  /* Timestamp */
+	h[5] = (t>>8)&0xff;
+	h[6] = (t>>16)&0xff;
+	h[7] = (t>>24)&0xff;
+	h[8] = 0; /* No deflate options */
+	h[9] = 3; /* OS=Unix */
+}
+
+/*
+ * Ends the current gzip member: finishes the deflate stream and adds
+ * the 4-byte CRC and 4-byte length.
+ */
+static int
+end_member(struct archive_write *a, struct private_data *state)
+{
+	unsigned char trailer[8];
+	int ret;
+
+	if (state->threads > 1) {
+		ret = __archive_write_parallel_finish(state->parallel);
+		__archive_write_parallel_free(state->parallel);
+		state->parallel = NULL;
+	} else
+		ret = drive_compressor(a, state, 1);
+	if (ret != ARCHIVE_OK)
+		return (ret);
+
+	trailer[0] = (state->crc)&0xff;
+	trailer[1] = (state->crc >> 8)&0xff;
+	trailer[2] = (state->crc >> 16)&0xff;
+	trailer[3] = (state->crc >> 24)&0xff;
+	trailer[4] = (state->member_in)&0xff;
+	trailer[5] = (state->member_in >> 8)&0xff;
+	trailer[6] = (state->member_in >> 16)&0xff;
+	trailer[7] = (state->member_in >> 24)&0xff;
+	return (write_compressed(a, state, trailer, sizeof(trailer)));
+}
+
+static int
+start_parallel(struct archive_write *a, struct private_data *state,
+    int threads)
+{
+	state->parallel = __archive_write_parallel_new(a, threads,
+	    PARALLEL_BLOCK_SIZE, PARALLEL_DICT_SIZE, state->block_out_size,
+	    parallel_compress, parallel_emit, parallel_free, state);
+	return (state->parallel != NULL ? ARCHIVE_OK : ARCHIVE_FATAL);
+}
+
+/*
+ * Ends the gzip member and starts another, which can be decompressed
+ * without anything that came before it.  Concatenated members are
+ * one stream to gunzip.  Returns the offset of the new member.
+ */
+static int64_t
+archive_compressor_gzip_restart(struct archive_write *a)
+{
+	struct private_data *state = (struct private_data *)a->compressor.data;
+	unsigned char header[10];
+	int64_t offset;
+
+	if (end_member(a, state) != ARCHIVE_OK)
+		return (ARCHIVE_FATAL);
+	if (state->threads > 1) {
+		if (start_parallel(a, state, state->threads) != ARCHIVE_OK)
+			return (ARCHIVE_FATAL);
+	} else if (deflateReset(&(state->stream)) != Z_OK) {
+		archive_set_error(&a->archive, ARCHIVE_ERRNO_MISC,
+		    "Internal error resetting compression library");
+		return (ARCHIVE_FATAL);
+	}
+	state->crc = crc32(0L, NULL, 0);
+	state->member_in = 0;
+
+	offset = a->archive.raw_position +
+	    (state->stream.next_out - state->compressed);
+	build_header(header, time(NULL), 0);
+	if (write_compressed(a, state, header, sizeof(header)) != ARCHIVE_OK)
+		return (ARCHIVE_FATAL);
+	return (offset);
+}
+
+/*
+ * Keeps 'buff' for the extra field of an empty gzip member written
+ * after the last one, where a reader finds it at the end of the file
+ * without decompressing anything; gunzip skips it.
+ */
+static int
+archive_compressor_gzip_trailer(struct archive_write *a, const void *buff,
+    size_t length)
+{
+	struct private_data *state = (struct private_data *)a->compressor.data;
+	unsigned char *p;
+	size_t xlen = 4 + length;
+
+	if (xlen > 0xffff) {
+		archive_set_error(&a->archive, ARCHIVE_ERRNO_MISC,
+		    "Gzip trailer too large");
+		return (ARCHIVE_FATAL);
+	}
+	free(state->locator);
+	state->locator_len = 10 + 2 + xlen + 2 + 8;
+	state->locator = p = malloc(state->locator_len);
+	if (p == NULL) {
+		archive_set_error(&a->archive, ENOMEM,
+		    "Can't allocate gzip trailer");
+		return (ARCHIVE_FATAL);
+	}
+	build_header(p, 0, 4 /* FEXTRA */);
+	p[10] = xlen & 0xff;
+	p[11] = (xlen >> 8) & 0xff;
+	/* One subfield, "TI" for tar index. */
+	p[12] = 'T';
+	p[13] = 'I';
+	p[14] = length & 0xff;
+	p[15] = (length >> 8) & 0xff;
+	memcpy(p + 16, buff, length);
+	p += 16 + length;
+	/* An empty final deflate block; the crc and size of nothing. */
+	p[0] = 0x03;
+	memset(p + 1, 0, 9);
+	return (ARCHIVE_OK);
+}
+
+/*
+ * Deflate one block on a worker thread.  Each block keeps its own
+ * deflate stream, which is reset for every new block of input.
+ */
+static int
+parallel_compress(void *cookie, struct archive_write_parallel_block *b)
+{
+	struct private_data *state = (struct private_data *)cookie;
+	z_stream *stream = (z_stream *)b->data;
+	int ret;
+
+	if (stream == NULL) {
+		stream = calloc(1, sizeof(*stream));
+		if (stream == NULL)
+			return (ARCHIVE_FATAL);
+		if (deflateInit2(stream, state->compression_level,
+		    Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+			free(stream);
+			return (ARCHIVE_FATAL);
+		}
+		b->data = stream;
+	} else if (deflateReset(stream) != Z_OK)
+		return (ARCHIVE_FATAL);
+
+	if (b->dict_len > 0 &&
+	    deflateSetDictionary(stream, b->dict, b->dict_len) != Z_OK)
+		return (ARCHIVE_FATAL);
+
+	stream->next_in = b->in;
+	stream->avail_in = b->in_len;
+	stream->next_out = b->out;
+	stream->avail_out = state->block_out_size;
+	ret = deflate(stream, b->last ? Z_FINISH : Z_SYNC_FLUSH);
+	if (ret != (b->last ? Z_STREAM_END : Z_OK) ||
+	    stream->avail_in != 0 || stream->avail_out == 0)
+		return (ARCHIVE_FATAL);
+	b->out_len = state->block_out_size - stream->avail_out;
+	b->check = crc32(crc32(0L, NULL, 0), b->in, b->in_len);
+	b->size = b->in_len;
+	return (ARCHIVE_OK);
+}
+
+/*
+ * Append one deflated block to the output, in stream order.
+ */
+static int
+parallel_emit(struct archive_write *a, void *cookie,
+    struct archive_write_parallel_block *b)
+{
+	struct private_data *state = (struct private_data *)cookie;
+
+	state->crc = crc32_combine(state->crc, b->check, (z_off_t)b->size);
+	state->member_in += b->size;
+	return (write_compressed(a, state, b->out, b->out_len));
+}
+
+static void
+parallel_free(void *cookie, struct archive_write_parallel_block *b)
+{
+	(void)cookie; /* UNUSED */
+	deflateEnd((z_stream *)b->data);
+	free(b->data);
+	b->data = NULL;
+}
+
 #endif /* HAVE_ZLIB_H */
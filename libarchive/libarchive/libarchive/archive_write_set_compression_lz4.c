@@ -0,0 +1,409 @@
+/*-
+ * Copyright (c) 2026 The libarchive Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "archive_platform.h"
+
+__FBSDID("$FreeBSD$");
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+#ifdef HAVE_LZ4FRAME_H
+#include <lz4frame.h>
+#endif
+
+#include "archive.h"
+#include "archive_private.h"
+#include "archive_write_private.h"
+
+#ifndef HAVE_LZ4FRAME_H
+int
+archive_write_set_compression_lz4(struct archive *a)
+{
+	archive_set_error(a, ARCHIVE_ERRNO_MISC,
+	    "lz4 compression not supported on this platform");
+	return (ARCHIVE_FATAL);
+}
+#else
+/* Don't compile this if we don't have liblz4. */
+
+/*
+ * lz4 has no streaming interface that writes into a buffer of any
+ * size, so input is fed to it in chunks of at most this many bytes,
+ * each compressed into a staging buffer big enough for the worst case
+ * and copied from there into the output blocks.
+ */
+#define	LZ4_CHUNK_SIZE	(64 * 1024)
+
+/* Highest level; 3 and up use the slower, tighter HC compressor. */
+#define	LZ4_MAX_LEVEL	12
+
+struct private_data {
+	LZ4F_compressionContext_t ctx;
+	LZ4F_preferences_t prefs;
+	unsigned char	*staging;
+	size_t		 staging_size;
+	int64_t		 total_in;
+	unsigned char	*compressed;
+	size_t		 compressed_buffer_size;
+	unsigned char	*next_out;
+	size_t		 avail_out;
+};
+
+struct private_config {
+	int		 compression_level;
+};
+
+static int	archive_compressor_lz4_finish(struct archive_write *);
+static int	archive_compressor_lz4_init(struct archive_write *);
+static int	archive_compressor_lz4_options(struct archive_write *,
+		    const char *, const char *);
+static int	archive_compressor_lz4_write(struct archive_write *,
+		    const void *, size_t);
+static int	drive_compressor(struct archive_write *, struct private_data *,
+		    const void *, size_t);
+static int	write_compressed(struct archive_write *, struct private_data *,
+		    size_t);
+
+/*
+ * Allocate, initialize and return an archive object.
+ */
+int
+archive_write_set_compression_lz4(struct archive *_a)
+{
+	struct archive_write *a = (struct archive_write *)_a;
+	struct private_config *config;
+	__archive_check_magic(&a->archive, ARCHIVE_WRITE_MAGIC,
+	    ARCHIVE_STATE_NEW, "archive_write_set_compression_lz4");
+	config = malloc(sizeof(*config));
+	if (config == NULL) {
+		archive_set_error(&a->archive, ENOMEM, "Out of memory");
+		return (ARCHIVE_FATAL);
+	}
+	a->compressor.config = config;
+	a->compressor.finish = archive_compressor_lz4_finish;
+	config->compression_level = 1; /* default */
+	a->compressor.init = &archive_compressor_lz4_init;
+	a->compressor.options = &archive_compressor_lz4_options;
+	a->archive.compression_code = ARCHIVE_COMPRESSION_LZ4;
+	a->archive.compression_name = "lz4";
+	return (ARCHIVE_OK);
+}
+
+/*
+ * Setup callback.
+ */
+static int
+archive_compressor_lz4_init(struct archive_write *a)
+{
+	int ret;
+	size_t r;
+	struct private_data *state;
+	struct private_config *config;
+
+	config = (struct private_config *)a->compressor.config;
+	if (a->client_opener != NULL) {
+		ret = (a->client_opener)(&a->archive, a->client_data);
+		if (ret != ARCHIVE_OK)
+			return (ret);
+	}
+
+	state = (struct private_data *)calloc(1, sizeof(*state));
+	if (state == NULL) {
+		archive_set_error(&a->archive, ENOMEM,
+		    "Can't allocate data for compression");
+		return (ARCHIVE_FATAL);
+	}
+	state->prefs.compressionLevel = config->compression_level;
+	state->prefs.frameInfo.contentChecksumFlag = LZ4F_contentChecksumEnabled;
+
+	state->compressed_buffer_size = a->bytes_per_block;
+	state->compressed = (unsigned char *)malloc(state->compressed_buffer_size);
+	state->staging_size = LZ4F_compressBound(LZ4_CHUNK_SIZE, &state->prefs);
+	if (state->staging_size < LZ4F_HEADER_SIZE_MAX)
+		state->staging_size = LZ4F_HEADER_SIZE_MAX;
+	state->staging = (unsigned char *)malloc(state->staging_size);
+	if (state->compressed == NULL || state->staging == NULL) {
+		archive_set_error(&a->archive, ENOMEM,
+		    "Can't allocate data for compression buffer");
+		free(state->staging);
+		free(state->compressed);
+		free(state);
+		return (ARCHIVE_FATAL);
+	}
+	state->next_out = state->compressed;
+	state->avail_out = state->compressed_buffer_size;
+	a->compressor.write = archive_compressor_lz4_write;
+	a->compressor.data = state;
+
+	/* Initialize compression library and start the frame. */
+	if (LZ4F_isError(LZ4F_createCompressionContext(&state->ctx,
+	    LZ4F_VERSION))) {
+		archive_set_error(&a->archive, ENOMEM,
+		    "Internal error initializing compression library");
+		return (ARCHIVE_FATAL);
+	}
+	r = LZ4F_compressBegin(state->ctx, state->staging,
+	    state->staging_size, &state->prefs);
+	if (LZ4F_isError(r)) {
+		archive_set_error(&a->archive, ARCHIVE_ERRNO_MISC,
+		    "Internal error initializing compression library: %s",
+		    LZ4F_getErrorName(r));
+		return (ARCHIVE_FATAL);
+	}
+	return (write_compressed(a, state, r));
+}
+
+/*
+ * Set write options.
+ */
+static int
+archive_compressor_lz4_options(struct archive_write *a, const char *key,
+    const char *value)
+{
+	struct private_config *config;
+	int level;
+
+	config = (struct private_config *)a->compressor.config;
+	if (strcmp(key, "compression-level") == 0) {
+		if (value == NULL || *value == '\0')
+			return (ARCHIVE_WARN);
+		for (level = 0; *value != '\0'; value++) {
+			if (*value < '0' || *value > '9')
+				return (ARCHIVE_WARN);
+			level = level * 10 + (*value - '0');
+			if (level > LZ4_MAX_LEVEL)
+				return (ARCHIVE_WARN);
+		}
+		config->compression_level = level;
+		return (ARCHIVE_OK);
+	}
+
+	return (ARCHIVE_WARN);
+}
+
+/*
+ * Write data to the compressed stream.
+ */
+static int
+archive_compressor_lz4_write(struct archive_write *a, const void *buff,
+    size_t length)
+{
+	struct private_data *state;
+	int ret;
+
+	state = (struct private_data *)a->compressor.data;
+	if (a->client_writer == NULL) {
+		archive_set_error(&a->archive, ARCHIVE_ERRNO_PROGRAMMER,
+		    "No write callback is registered?  "
+		    "This is probably an internal programming error.");
+		return (ARCHIVE_FATAL);
+	}
+
+	/* Update statistics */
+	state->total_in += length;
+
+	/* Compress input data to output buffer */
+	if ((ret = drive_compressor(a, state, buff, length)) != ARCHIVE_OK)
+		return (ret);
+	a->archive.file_position += length;
+	return (ARCHIVE_OK);
+}
+
+/*
+ * Finish the compression.
+ */
+static int
+archive_compressor_lz4_finish(struct archive_write *a)
+{
+	ssize_t block_length, target_block_length, bytes_written;
+	int ret;
+	size_t r;
+	struct private_data *state;
+	unsigned tocopy;
+
+	ret = ARCHIVE_OK;
+	state = (struct private_data *)a->compressor.data;
+	if (state != NULL) {
+		if (a->client_writer == NULL) {
+			archive_set_error(&a->archive,
+			    ARCHIVE_ERRNO_PROGRAMMER,
+			    "No write callback is registered?  "
+			    "This is probably an internal programming error.");
+			ret = ARCHIVE_FATAL;
+			goto cleanup;
+		}
+
+		/* By default, always pad the uncompressed data. */
+		if (a->pad_uncompressed) {
+			tocopy = a->bytes_per_block -
+			    (state->total_in % a->bytes_per_block);
+			while (tocopy > 0 && tocopy < (unsigned)a->bytes_per_block) {
+				size_t n = tocopy < a->null_length ?
+				    tocopy : a->null_length;
+				state->total_in += n;
+				tocopy -= n;
+				ret = drive_compressor(a, state, a->nulls, n);
+				if (ret != ARCHIVE_OK)
+					goto cleanup;
+			}
+		}
+
+		/* Finish compression cycle: end mark and checksum. */
+		r = LZ4F_compressEnd(state->ctx, state->staging,
+		    state->staging_size, NULL);
+		if (LZ4F_isError(r)) {
+			archive_set_error(&a->archive, ARCHIVE_ERRNO_MISC,
+			    "lz4 compression failed:"
+			    " LZ4F_compressEnd() call returned %s",
+			    LZ4F_getErrorName(r));
+			ret = ARCHIVE_FATAL;
+			goto cleanup;
+		}
+		if ((ret = write_compressed(a, state, r)) != ARCHIVE_OK)
+			goto cleanup;
+
+		/* Optionally, pad the final compressed block. */
+		block_length = state->next_out - state->compressed;
+
+		/* Tricky calculation to determine size of last block. */
+		if (a->bytes_in_last_block <= 0)
+			/* Default or Zero: pad to full block */
+			target_block_length = a->bytes_per_block;
+		else
+			/* Round length to next multiple of bytes_in_last_block. */
+			target_block_length = a->bytes_in_last_block *
+			    ( (block_length + a->bytes_in_last_block - 1) /
+				a->bytes_in_last_block);
+		if (target_block_length > a->bytes_per_block)
+			target_block_length = a->bytes_per_block;
+		if (block_length < target_block_length) {
+			memset(state->next_out, 0,
+			    target_block_length - block_length);
+			block_length = target_block_length;
+		}
+
+		/* Write the last block */
+		bytes_written = (a->client_writer)(&a->archive, a->client_data,
+		    state->compressed, block_length);
+		if (bytes_written <= 0) {
+			ret = ARCHIVE_FATAL;
+			goto cleanup;
+		}
+		a->archive.raw_position += bytes_written;
+
+		/* Cleanup: shut down compressor, release memory, etc. */
+	cleanup:
+		LZ4F_freeCompressionContext(state->ctx);
+		free(state->staging);
+		free(state->compressed);
+		free(state);
+	}
+	/* Clean up config area even if we never initialized. */
+	free(a->compressor.config);
+	a->compressor.config = NULL;
+	return (ret);
+}
+
+/*
+ * Utility function to push input data through compressor, a chunk
+ * at a time.
+ */
+static int
+drive_compressor(struct archive_write *a, struct private_data *state,
+    const void *buff, size_t length)
+{
+	const char *p = buff;
+	size_t n, r;
+	int ret;
+
+	while (length > 0) {
+		n = length < LZ4_CHUNK_SIZE ? length : LZ4_CHUNK_SIZE;
+		r = LZ4F_compressUpdate(state->ctx, state->staging,
+		    state->staging_size, p, n, NULL);
+		if (LZ4F_isError(r)) {
+			archive_set_error(&a->archive, ARCHIVE_ERRNO_MISC,
+			    "lz4 compression failed:"
+			    " LZ4F_compressUpdate() call returned %s",
+			    LZ4F_getErrorName(r));
+			return (ARCHIVE_FATAL);
+		}
+		if ((ret = write_compressed(a, state, r)) != ARCHIVE_OK)
+			return (ret);
+		p += n;
+		length -= n;
+	}
+	return (ARCHIVE_OK);
+}
+
+/*
+ * Copy the first 'length' bytes of the staging buffer to the output,
+ * writing full output blocks as necessary.
+ */
+static int
+write_compressed(struct archive_write *a, struct private_data *state,
+    size_t length)
+{
+	const unsigned char *p = state->staging;
+	ssize_t bytes_written;
+	size_t n;
+
+	while (length > 0) {
+		if (state->avail_out == 0) {
+			bytes_written = (a->client_writer)(&a->archive,
+			    a->client_data, state->compressed,
+			    state->compressed_buffer_size);
+			if (bytes_written <= 0) {
+				/* TODO: Handle this write failure */
+				return (ARCHIVE_FATAL);
+			} else if ((size_t)bytes_written < state->compressed_buffer_size) {
+				/* Short write: Move remaining to
+				 * front of block and keep filling */
+				memmove(state->compressed,
+				    state->compressed + bytes_written,
+				    state->compressed_buffer_size - bytes_written);
+			}
+			a->archive.raw_position += bytes_written;
+			state->next_out = state->compressed +
+			    state->compressed_buffer_size - bytes_written;
+			state->avail_out = bytes_written;
+		}
+		n = length < state->avail_out ? length : state->avail_out;
+		memcpy(state->next_out, p, n);
+		state->next_out += n;
+		state->avail_out -= n;
+		p += n;
+		length -= n;
+	}
+	return (ARCHIVE_OK);
+}
+
+#endif /* HAVE_LZ4FRAME_H */
@@ -45,6 +45,7 @@ __FBSDID("$FreeBSD: head/lib/libarchive/archive_write_set_compression_xz.c 20110
 #include "archive.h"
 #include "archive_private.h"
 #include "archive_write_private.h"
+#include "archive_write_parallel_private.h"
 
 #ifndef HAVE_LZMA_H
 int
@@ -72,20 +73,47 @@ struct private_data {
 	int64_t		 total_in;
 	unsigned char	*compressed;
 	size_t		 compressed_buffer_size;
+	/*
+	 * Set when blocks are compressed on several threads.  Each one
+	 * becomes an xz block of its own; the stream header, index and
+	 * footer around them are written here.
+	 */
+	struct archive_write_parallel *parallel;
+	lzma_index	*index;
+	int		 header_written;
+	int		 threads;
 };
 
 struct private_config {
 	int		 compression_level;
+	int		 threads;
 };
 
+/* Smallest block for threaded compression; blocks are also at least
+ * three times the dictionary, as xz itself does, so that cutting the
+ * stream into independent blocks costs little in ratio. */
+#define	PARALLEL_MIN_BLOCK_SIZE	(1024 * 1024)
+
 static int	archive_compressor_xz_init(struct archive_write *);
 static int	archive_compressor_xz_options(struct archive_write *,
 		    const char *, const char *);
 static int	archive_compressor_xz_finish(struct archive_write *);
 static int	archive_compressor_xz_write(struct archive_write *,
 		    const void *, size_t);
+static int64_t	archive_compressor_xz_restart(struct archive_write *);
 static int	drive_compressor(struct archive_write *, struct private_data *,
 		    int finishing);
+static int	flush_compressed(struct archive_write *, struct private_data *);
+static int	write_compressed(struct archive_write *, struct private_data *,
+		    const void *, size_t);
+static int	archive_compressor_xz_init_parallel(struct archive_write *,
+		    struct private_data *, int threads);
+static int	archive_compressor_xz_finish_parallel(struct archive_write *,
+		    struct private_data *);
+static int	parallel_compress(void *,
+		    struct archive_write_parallel_block *);
+static int	parallel_emit(struct archive_write *, void *,
+		    struct archive_write_parallel_block *);
 
 
 /*
@@ -106,6 +134,7 @@ archive_write_set_compression_xz(struct archive *_a)
 	a->compressor.config = config;
 	a->compressor.finish = archive_compressor_xz_finish;
 	config->compression_level = LZMA_PRESET_DEFAULT;
+	config->threads = 1;
 	a->compressor.init = &archive_compressor_xz_init;
 	a->compressor.options = &archive_compressor_xz_options;
 	a->archive.compression_code = ARCHIVE_COMPRESSION_XZ;
@@ -209,7 +238,17 @@ archive_compressor_xz_init(struct archive_write *a)
 	state->lzmafilters[0].id = LZMA_FILTER_LZMA2;
 	state->lzmafilters[0].options = &state->lzma_opt;
 	state->lzmafilters[1].id = LZMA_VLI_UNKNOWN;/* Terminate */
-	ret = archive_compressor_xz_init_stream(a, state);
+	/* The lzma format has no blocks, so it always uses one thread. */
+	if (config->threads > 1 &&
+	    a->archive.compression_code == ARCHIVE_COMPRESSION_XZ) {
+		state->threads = config->threads;
+		ret = archive_compressor_xz_init_parallel(a, state,
+		    config->threads);
+	} else
+		ret = archive_compressor_xz_init_stream(a, state);
+	/* Nor can lzma files be concatenated. */
+	if (a->archive.compression_code == ARCHIVE_COMPRESSION_XZ)
+		a->compressor.restart = archive_compressor_xz_restart;
 	if (ret == LZMA_OK) {
 		a->compressor.data = state;
 		return (0);
@@ -240,6 +279,13 @@ archive_compressor_xz_options(struct archive_write *a, const char *key,
 			config->compression_level = 6;
 		return (ARCHIVE_OK);
 	}
+	if (strcmp(key, "threads") == 0) {
+		int threads = __archive_write_parallel_threads(value);
+		if (threads < 0)
+			return (ARCHIVE_WARN);
+		config->threads = threads;
+		return (ARCHIVE_OK);
+	}
 
 	return (ARCHIVE_WARN);
 }
@@ -266,9 +312,15 @@ archive_compressor_xz_write(struct archive_write *a, const void *buff,
 	state->total_in += length;
 
 	/* Compress input data to output buffer */
-	state->stream.next_in = buff;
-	state->stream.avail_in = length;
-	if ((ret = drive_compressor(a, state, 0)) != ARCHIVE_OK)
+	if (state->parallel != NULL)
+		ret = __archive_write_parallel_write(state->parallel,
+		    buff, length);
+	else {
+		state->stream.next_in = buff;
+		state->stream.avail_in = length;
+		ret = drive_compressor(a, state, 0);
+	}
+	if (ret != ARCHIVE_OK)
 		return (ret);
 
 	a->archive.file_position += length;
@@ -276,6 +328,49 @@ archive_compressor_xz_write(struct archive_write *a, const void *buff,
 }
 
 
+/*
+ * Ends the xz stream and starts another, which can be decompressed
+ * without anything that came before it.  Concatenated streams are
+ * one stream to xz.  Returns the offset of the new stream.
+ */
+static int64_t
+archive_compressor_xz_restart(struct archive_write *a)
+{
+	struct private_data *state = (struct private_data *)a->compressor.data;
+	uint8_t *next_out;
+	size_t avail_out;
+	int ret;
+
+	if (state->parallel != NULL) {
+		ret = archive_compressor_xz_finish_parallel(a, state);
+		__archive_write_parallel_free(state->parallel);
+		state->parallel = NULL;
+		lzma_index_end(state->index, NULL);
+		state->index = NULL;
+		state->header_written = 0;
+	} else {
+		ret = drive_compressor(a, state, 1);
+		lzma_end(&(state->stream));
+	}
+	if (ret != ARCHIVE_OK)
+		return (ARCHIVE_FATAL);
+
+	/* Setting up a stream empties the output buffer; keep it. */
+	next_out = state->stream.next_out;
+	avail_out = state->stream.avail_out;
+	if (state->threads > 1)
+		ret = archive_compressor_xz_init_parallel(a, state,
+		    state->threads);
+	else
+		ret = archive_compressor_xz_init_stream(a, state);
+	state->stream.next_out = next_out;
+	state->stream.avail_out = avail_out;
+	if (ret != ARCHIVE_OK)
+		return (ARCHIVE_FATAL);
+	return (a->archive.raw_position +
+	    (state->stream.next_out - state->compressed));
+}
+
 /*
  * Finish the compression...
  */
@@ -304,19 +399,29 @@ archive_compressor_xz_finish(struct archive_write *a)
 			tocopy = a->bytes_per_block -
 			    (state->total_in % a->bytes_per_block);
 			while (tocopy > 0 && tocopy < (unsigned)a->bytes_per_block) {
-				state->stream.next_in = a->nulls;
-				state->stream.avail_in = tocopy < a->null_length ?
+				size_t n = tocopy < a->null_length ?
 				    tocopy : a->null_length;
-				state->total_in += state->stream.avail_in;
-				tocopy -= state->stream.avail_in;
-				ret = drive_compressor(a, state, 0);
+				state->total_in += n;
+				tocopy -= n;
+				if (state->parallel != NULL)
+					ret = __archive_write_parallel_write(
+					    state->parallel, a->nulls, n);
+				else {
+					state->stream.next_in = a->nulls;
+					state->stream.avail_in = n;
+					ret = drive_compressor(a, state, 0);
+				}
 				if (ret != ARCHIVE_OK)
 					goto cleanup;
 			}
 		}
 
 		/* Finish compression cycle */
-		if (((ret = drive_compressor(a, state, 1))) != ARCHIVE_OK)
+		if (state->parallel != NULL)
+			ret = archive_compressor_xz_finish_parallel(a, state);
+		else
+			ret = drive_compressor(a, state, 1);
+		if (ret != ARCHIVE_OK)
 			goto cleanup;
 
 		/* Optionally, pad the final compressed block. */
@@ -350,6 +455,9 @@ archive_compressor_xz_finish(struct archive_write *a)
 
 		/* Cleanup: shut down compressor, release memory, etc. */
 	cleanup:
+		__archive_write_parallel_free(state->parallel);
+		if (state->index != NULL)
+			lzma_index_end(state->index, NULL);
 		lzma_end(&(state->stream));
 		free(state->compressed);
 		free(state);
@@ -369,29 +477,13 @@ archive_compressor_xz_finish(struct archive_write *a)
 static int
 drive_compressor(struct archive_write *a, struct private_data *state, int finishing)
 {
-	ssize_t bytes_written;
 	int ret;
 
 	for (;;) {
 		if (state->stream.avail_out == 0) {
-			bytes_written = (a->client_writer)(&a->archive,
-			    a->client_data, state->compressed,
-			    state->compressed_buffer_size);
-			if (bytes_written <= 0) {
-				/* TODO: Handle this write failure */
-				return (ARCHIVE_FATAL);
-			} else if ((size_t)bytes_written < state->compressed_buffer_size) {
-				/* Short write: Move remaining to
-				 * front of block and keep filling */
-				memmove(state->compressed,
-				    state->compressed + bytes_written,
-				    state->compressed_buffer_size - bytes_written);
-			}
-			a->archive.raw_position += bytes_written;
-			state->stream.next_out
-			    = state->compressed +
-			    state->compressed_buffer_size - bytes_written;
-			state->stream.avail_out = bytes_written;
+			ret = flush_compressed(a, state);
+			if (ret != ARCHIVE_OK)
+				return (ret);
 		}
 
 		/* If there's nothing to do, we're done. */
@@ -435,4 +527,217 @@ drive_compressor(struct archive_write *a, struct private_data *state, int finish
 	}
 }
 
+/*
+ * Write out the full output block.
+ */
+static int
+flush_compressed(struct archive_write *a, struct private_data *state)
+{
+	ssize_t bytes_written;
+
+	bytes_written = (a->client_writer)(&a->archive,
+	    a->client_data, state->compressed,
+	    state->compressed_buffer_size);
+	if (bytes_written <= 0) {
+		/* TODO: Handle this write failure */
+		return (ARCHIVE_FATAL);
+	} else if ((size_t)bytes_written < state->compressed_buffer_size) {
+		/* Short write: Move remaining to
+		 * front of block and keep filling */
+		memmove(state->compressed,
+		    state->compressed + bytes_written,
+		    state->compressed_buffer_size - bytes_written);
+	}
+	a->archive.raw_position += bytes_written;
+	state->stream.next_out
+	    = state->compressed +
+	    state->compressed_buffer_size - bytes_written;
+	state->stream.avail_out = bytes_written;
+	return (ARCHIVE_OK);
+}
+
+/*
+ * Append already-compressed bytes to the output.
+ */
+static int
+write_compressed(struct archive_write *a, struct private_data *state,
+    const void *buff, size_t length)
+{
+	const unsigned char *p = buff;
+	size_t n;
+	int ret;
+
+	while (length > 0) {
+		if (state->stream.avail_out == 0) {
+			ret = flush_compressed(a, state);
+			if (ret != ARCHIVE_OK)
+				return (ret);
+		}
+		n = length;
+		if (n > state->stream.avail_out)
+			n = state->stream.avail_out;
+		memcpy(state->stream.next_out, p, n);
+		state->stream.next_out += n;
+		state->stream.avail_out -= n;
+		p += n;
+		length -= n;
+	}
+	return (ARCHIVE_OK);
+}
+
+static int
+archive_compressor_xz_init_parallel(struct archive_write *a,
+    struct private_data *state, int threads)
+{
+	size_t block_size;
+
+	state->stream.next_out = state->compressed;
+	state->stream.avail_out = state->compressed_buffer_size;
+	state->index = lzma_index_init(NULL);
+	if (state->index == NULL) {
+		archive_set_error(&a->archive, ENOMEM,
+		    "Internal error initializing compression library: "
+		    "Cannot allocate memory");
+		return (ARCHIVE_FATAL);
+	}
+	block_size = (size_t)state->lzma_opt.dict_size * 3;
+	if (block_size < PARALLEL_MIN_BLOCK_SIZE)
+		block_size = PARALLEL_MIN_BLOCK_SIZE;
+	state->parallel = __archive_write_parallel_new(a, threads,
+	    block_size, 0, lzma_block_buffer_bound(block_size),
+	    parallel_compress, parallel_emit, NULL, state);
+	if (state->parallel == NULL) {
+		lzma_index_end(state->index, NULL);
+		state->index = NULL;
+		return (ARCHIVE_FATAL);
+	}
+	return (ARCHIVE_OK);
+}
+
+/*
+ * Writes the stream header, unless a block has done that already.
+ */
+static int
+write_stream_header(struct archive_write *a, struct private_data *state)
+{
+	lzma_stream_flags flags;
+	uint8_t header[LZMA_STREAM_HEADER_SIZE];
+
+	if (state->header_written)
+		return (ARCHIVE_OK);
+	memset(&flags, 0, sizeof(flags));
+	flags.check = LZMA_CHECK_CRC64;
+	if (lzma_stream_header_encode(&flags, header) != LZMA_OK) {
+		archive_set_error(&a->archive, ARCHIVE_ERRNO_MISC,
+		    "lzma compression failed: can't encode stream header");
+		return (ARCHIVE_FATAL);
+	}
+	state->header_written = 1;
+	return (write_compressed(a, state, header, sizeof(header)));
+}
+
+/*
+ * Compresses one xz block on a worker thread.
+ */
+static int
+parallel_compress(void *cookie, struct archive_write_parallel_block *b)
+{
+	struct private_data *state = (struct private_data *)cookie;
+	lzma_block block;
+	size_t out_pos = 0;
+
+	b->out_len = 0;
+	b->size = 0;
+	if (b->in_len == 0)
+		return (ARCHIVE_OK);
+	memset(&block, 0, sizeof(block));
+	block.version = 0;
+	block.check = LZMA_CHECK_CRC64;
+	/* Shared by all the workers; liblzma only reads it. */
+	block.filters = state->lzmafilters;
+	if (lzma_block_buffer_encode(&block, NULL, b->in, b->in_len,
+	    b->out, &out_pos, lzma_block_buffer_bound(b->in_len)) != LZMA_OK)
+		return (ARCHIVE_FATAL);
+	b->out_len = out_pos;
+	b->check = lzma_block_unpadded_size(&block);
+	b->size = block.uncompressed_size;
+	return (ARCHIVE_OK);
+}
+
+/*
+ * Appends one compressed block to the output and records it in the
+ * index, in stream order.
+ */
+static int
+parallel_emit(struct archive_write *a, void *cookie,
+    struct archive_write_parallel_block *b)
+{
+	struct private_data *state = (struct private_data *)cookie;
+	int ret;
+
+	if (b->out_len == 0)
+		return (ARCHIVE_OK);
+	ret = write_stream_header(a, state);
+	if (ret != ARCHIVE_OK)
+		return (ret);
+	if (lzma_index_append(state->index, NULL, b->check, b->size)
+	    != LZMA_OK) {
+		archive_set_error(&a->archive, ENOMEM,
+		    "lzma compression failed: can't grow the index");
+		return (ARCHIVE_FATAL);
+	}
+	return (write_compressed(a, state, b->out, b->out_len));
+}
+
+/*
+ * Compresses the last block and ends the stream with the index and
+ * stream footer.
+ */
+static int
+archive_compressor_xz_finish_parallel(struct archive_write *a,
+    struct private_data *state)
+{
+	lzma_stream_flags flags;
+	uint8_t footer[LZMA_STREAM_HEADER_SIZE];
+	unsigned char *index;
+	size_t index_size, index_pos = 0;
+	int ret;
+
+	ret = __archive_write_parallel_finish(state->parallel);
+	if (ret != ARCHIVE_OK)
+		return (ret);
+	ret = write_stream_header(a, state);
+	if (ret != ARCHIVE_OK)
+		return (ret);
+
+	index_size = (size_t)lzma_index_size(state->index);
+	index = malloc(index_size);
+	if (index == NULL) {
+		archive_set_error(&a->archive, ENOMEM,
+		    "Can't allocate data for compression");
+		return (ARCHIVE_FATAL);
+	}
+	if (lzma_index_buffer_encode(state->index, index, &index_pos,
+	    index_size) != LZMA_OK) {
+		free(index);
+		archive_set_error(&a->archive, ARCHIVE_ERRNO_MISC,
+		    "lzma compression failed: can't encode index");
+		return (ARCHIVE_FATAL);
+	}
+	ret = write_compressed(a, state, index, index_pos);
+	free(index);
+	if (ret != ARCHIVE_OK)
+		return (ret);
+
+	memset(&flags, 0, sizeof(flags));
+	flags.check = LZMA_CHECK_CRC64;
+	flags.backward_size = lzma_index_size(state->index);
+	if (lzma_stream_footer_encode(&flags, footer) != LZMA_OK) {
+		archive_set_error(&a->archive, ARCHIVE_ERRNO_MISC,
+		    "lzma compression failed: can't encode stream footer");
+		return (ARCHIVE_FATAL);
+	}
+	return (write_compressed(a, state, footer, sizeof(footer)));
+}
+
 #endif /* HAVE_LZMA_H */
@@ -69,9 +69,7 @@ __FBSDID("$FreeBSD: head/lib/libarchive/archive_write_set_format_zip.c 201168 20
 #include "archive_private.h"
 #include "archive_write_private.h"
 
-#ifndef HAVE_ZLIB_H
 #include "archive_crc32.h"
-#endif
 
 #define ZIP_SIGNATURE_LOCAL_FILE_HEADER 0x04034b50
 #define ZIP_SIGNATURE_DATA_DESCRIPTOR 0x08074b50
@@ -308,8 +306,8 @@ archive_write_zip_header(struct archive_write *a, struct archive_entry *entry)
 		return (ARCHIVE_FATAL);
 	}
 	l->entry = archive_entry_clone(entry);
-	/* Initialize the CRC variable and potentially the local crc32(). */
-	l->crc32 = crc32(0, NULL, 0);
+	/* Initialize the CRC variable. */
+	l->crc32 = __archive_crc32(0, NULL, 0);
 	l->compression = zip->compression;
 	l->compressed_size = 0;
 	l->next = NULL;
@@ -411,7 +409,7 @@ archive_write_zip_data(struct archive_write *a, const void *buff, size_t s)
 		zip->written_bytes += s;
 		zip->remaining_data_bytes -= s;
 		l->compressed_size += s;
-		l->crc32 = crc32(l->crc32, buff, s);
+		l->crc32 = __archive_crc32(l->crc32, buff, s);
 		return (s);
 #if HAVE_ZLIB_H
 	case COMPRESSION_DEFLATE:
@@ -432,8 +430,7 @@ archive_write_zip_data(struct archive_write *a, const void *buff, size_t s)
 			}
 		} while (zip->stream.avail_in != 0);
 		zip->remaining_data_bytes -= s;
-		/* If we have it, use zlib's fast crc32() */
-		l->crc32 = crc32(l->crc32, buff, s);
+		l->crc32 = __archive_crc32(l->crc32, buff, s);
 		return (s);
 #endif
 
@@ -0,0 +1,249 @@
+/*-
+ * Copyright (c) 2026 The libarchive Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "archive_platform.h"
+__FBSDID("$FreeBSD$");
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#include "archive.h"
+#include "archive_entry.h"
+#include "archive_private.h"
+#include "archive_tar_index_private.h"
+#include "archive_write_private.h"
+
+struct index_writer {
+	struct archive_tar_index *index;
+	int			 flags;
+	int64_t			 restart_interval;
+	/* Where the current compressed stream began. */
+	int64_t			 last_restart;
+	int64_t			 header_offset;
+	struct archive_string	 data;
+};
+
+static int	index_open(struct archive_write *);
+static int	index_pre_header(struct archive_write *);
+static int	index_post_header(struct archive_write *,
+		    struct archive_entry *);
+static int	index_close(struct archive_write *);
+static void	index_free(struct archive_write *);
+
+int
+archive_write_set_tar_index(struct archive *_a, int flags,
+    int64_t restart_interval)
+{
+	struct archive_write *a = (struct archive_write *)_a;
+	struct index_writer *w;
+
+	__archive_check_magic(&a->archive, ARCHIVE_WRITE_MAGIC,
+	    ARCHIVE_STATE_NEW, "archive_write_set_tar_index");
+	if (restart_interval < 0) {
+		archive_set_error(&a->archive, EINVAL,
+		    "Invalid restart interval");
+		return (ARCHIVE_FATAL);
+	}
+	if ((w = a->index_data) == NULL) {
+		w = calloc(1, sizeof(*w));
+		if (w == NULL || (w->index = __archive_tar_index_new()) == NULL) {
+			free(w);
+			archive_set_error(&a->archive, ENOMEM,
+			    "Can't allocate tar index");
+			return (ARCHIVE_FATAL);
+		}
+		a->index_data = w;
+		a->index_open = index_open;
+		a->index_pre_header = index_pre_header;
+		a->index_post_header = index_post_header;
+		a->index_close = index_close;
+		a->index_free = index_free;
+	}
+	w->flags = flags;
+	w->restart_interval = restart_interval;
+	return (ARCHIVE_OK);
+}
+
+int
+archive_write_get_tar_index(struct archive *_a, const void **buff,
+    size_t *size)
+{
+	struct archive_write *a = (struct archive_write *)_a;
+	struct index_writer *w = a->index_data;
+
+	__archive_check_magic(&a->archive, ARCHIVE_WRITE_MAGIC,
+	    ARCHIVE_STATE_CLOSED, "archive_write_get_tar_index");
+	if (w == NULL) {
+		archive_set_error(&a->archive, ARCHIVE_ERRNO_MISC,
+		    "No tar index was recorded");
+		return (ARCHIVE_FAILED);
+	}
+	/* A file of its own describes the whole archive. */
+	w->index->archive_size = a->archive.raw_position;
+	archive_string_empty(&w->data);
+	if (__archive_tar_index_write(w->index, &w->data, 0, 0) != ARCHIVE_OK) {
+		archive_set_error(&a->archive, ENOMEM,
+		    "Can't allocate tar index");
+		return (ARCHIVE_FATAL);
+	}
+	*buff = w->data.s;
+	*size = w->data.length;
+	return (ARCHIVE_OK);
+}
+
+static int
+index_open(struct archive_write *a)
+{
+	struct index_writer *w = a->index_data;
+
+	if ((a->archive.archive_format & ARCHIVE_FORMAT_BASE_MASK)
+	    != ARCHIVE_FORMAT_TAR) {
+		archive_set_error(&a->archive, ARCHIVE_ERRNO_MISC,
+		    "Only tar archives can be indexed");
+		return (ARCHIVE_FATAL);
+	}
+	if ((w->flags & ARCHIVE_TAR_INDEX_TRAILER) &&
+	    a->archive.compression_code != ARCHIVE_COMPRESSION_NONE &&
+	    a->compressor.trailer == NULL) {
+		archive_set_error(&a->archive, ARCHIVE_ERRNO_MISC,
+		    "Can't append an index to %s compressed archives",
+		    a->archive.compression_name);
+		return (ARCHIVE_FATAL);
+	}
+	/* Decompression can always start at the beginning. */
+	w->last_restart = 0;
+	if (a->compressor.restart != NULL &&
+	    __archive_tar_index_add_restart(w->index,
+	    a->archive.raw_position, 0) != ARCHIVE_OK) {
+		archive_set_error(&a->archive, ENOMEM,
+		    "Can't allocate tar index");
+		return (ARCHIVE_FATAL);
+	}
+	return (ARCHIVE_OK);
+}
+
+/*
+ * Before each header: start a new compressed stream if the current
+ * one is long enough, so that the member can be reached without
+ * decompressing too much ahead of it.
+ */
+static int
+index_pre_header(struct archive_write *a)
+{
+	struct index_writer *w = a->index_data;
+	int64_t raw;
+
+	if (a->compressor.restart != NULL && w->restart_interval > 0 &&
+	    a->archive.file_position - w->last_restart >=
+	    w->restart_interval) {
+		raw = (a->compressor.restart)(a);
+		if (raw < 0)
+			return (ARCHIVE_FATAL);
+		w->last_restart = a->archive.file_position;
+		if (__archive_tar_index_add_restart(w->index, raw,
+		    w->last_restart) != ARCHIVE_OK) {
+			archive_set_error(&a->archive, ENOMEM,
+			    "Can't allocate tar index");
+			return (ARCHIVE_FATAL);
+		}
+	}
+	w->header_offset = a->archive.file_position;
+	return (ARCHIVE_OK);
+}
+
+static int
+index_post_header(struct archive_write *a, struct archive_entry *entry)
+{
+	struct index_writer *w = a->index_data;
+	const char *name = archive_entry_pathname(entry);
+
+	if (__archive_tar_index_add_entry(w->index,
+	    name != NULL ? name : "", w->header_offset,
+	    a->archive.file_position, archive_entry_size(entry))
+	    != ARCHIVE_OK) {
+		archive_set_error(&a->archive, ENOMEM,
+		    "Can't allocate tar index");
+		return (ARCHIVE_FATAL);
+	}
+	return (ARCHIVE_OK);
+}
+
+/*
+ * Appends the index after the end of the tar data, in a compressed
+ * stream of its own, and the footer where a reader can find it:
+ * at the very end of an uncompressed archive, or in the extra field
+ * of a last, empty gzip member.  Tar readers stop at the end of the
+ * tar data and decompressors pass the index through, so the archive
+ * stays readable by anything.
+ */
+static int
+index_close(struct archive_write *a)
+{
+	struct index_writer *w = a->index_data;
+	int64_t raw, offset;
+	size_t size;
+	int ret;
+
+	if (!(w->flags & ARCHIVE_TAR_INDEX_TRAILER))
+		return (ARCHIVE_OK);
+	offset = raw = a->archive.file_position;
+	if (a->compressor.restart != NULL) {
+		raw = (a->compressor.restart)(a);
+		if (raw < 0)
+			return (ARCHIVE_FATAL);
+	}
+	w->index->archive_size = raw;
+	archive_string_empty(&w->data);
+	if (__archive_tar_index_write(w->index, &w->data, raw, offset)
+	    != ARCHIVE_OK) {
+		archive_set_error(&a->archive, ENOMEM,
+		    "Can't allocate tar index");
+		return (ARCHIVE_FATAL);
+	}
+	size = w->data.length - TAR_INDEX_FOOTER_SIZE;
+	ret = (a->compressor.write)(a, w->data.s, size);
+	if (ret != ARCHIVE_OK)
+		return (ret);
+	if (a->compressor.trailer != NULL)
+		return ((a->compressor.trailer)(a, w->data.s + size,
+		    TAR_INDEX_FOOTER_SIZE));
+	return ((a->compressor.write)(a, w->data.s + size,
+	    TAR_INDEX_FOOTER_SIZE));
+}
+
+static void
+index_free(struct archive_write *a)
+{
+	struct index_writer *w = a->index_data;
+
+	__archive_tar_index_free(w->index);
+	archive_string_free(&w->data);
+	free(w);
+	a->index_data = NULL;
+}
@@ -2,16 +2,19 @@ DEFINE_TEST(test_acl_basic)
 DEFINE_TEST(test_acl_freebsd)
 DEFINE_TEST(test_acl_pax)
 DEFINE_TEST(test_archive_api_feature)
+DEFINE_TEST(test_archive_crc32)
 DEFINE_TEST(test_bad_fd)
 DEFINE_TEST(test_compat_bzip2)
 DEFINE_TEST(test_compat_cpio)
 DEFINE_TEST(test_compat_gtar)
 DEFINE_TEST(test_compat_gzip)
+DEFINE_TEST(test_compat_lz4)
 DEFINE_TEST(test_compat_lzma)
 DEFINE_TEST(test_compat_solaris_tar_acl)
 DEFINE_TEST(test_compat_tar_hardlink)
 DEFINE_TEST(test_compat_xz)
 DEFINE_TEST(test_compat_zip)
+DEFINE_TEST(test_compat_zstd)
 DEFINE_TEST(test_empty_write)
 DEFINE_TEST(test_entry)
 DEFINE_TEST(test_entry_strmode)
@@ -24,6 +27,7 @@ DEFINE_TEST(test_open_filename)
 DEFINE_TEST(test_pax_filename_encoding)
 DEFINE_TEST(test_read_compress_program)
 DEFINE_TEST(test_read_data_large)
+DEFINE_TEST(test_read_decompression_thread)
 DEFINE_TEST(test_read_disk)
 DEFINE_TEST(test_read_disk_entry_from_file)
 DEFINE_TEST(test_read_extract)
@@ -40,6 +44,7 @@ DEFINE_TEST(test_read_format_cpio_odc)
 DEFINE_TEST(test_read_format_cpio_svr4_bzip2_rpm)
 DEFINE_TEST(test_read_format_cpio_svr4_gzip)
 DEFINE_TEST(test_read_format_cpio_svr4_gzip_rpm)
+DEFINE_TEST(test_read_format_cpio_svr4c)
 DEFINE_TEST(test_read_format_cpio_svr4c_Z)
 DEFINE_TEST(test_read_format_empty)
 DEFINE_TEST(test_read_format_gtar_gz)
@@ -67,23 +72,31 @@ DEFINE_TEST(test_read_format_txz)
 DEFINE_TEST(test_read_format_tz)
 DEFINE_TEST(test_read_format_xar)
 DEFINE_TEST(test_read_format_zip)
+DEFINE_TEST(test_read_format_zip_seekable)
 DEFINE_TEST(test_read_large)
+DEFINE_TEST(test_read_open_mmap)
 DEFINE_TEST(test_read_pax_truncated)
 DEFINE_TEST(test_read_position)
 DEFINE_TEST(test_read_truncated)
 DEFINE_TEST(test_read_uu)
 DEFINE_TEST(test_tar_filenames)
+DEFINE_TEST(test_tar_index)
 DEFINE_TEST(test_tar_large)
 DEFINE_TEST(test_ustar_filenames)
 DEFINE_TEST(test_write_compress)
 DEFINE_TEST(test_write_compress_bzip2)
 DEFINE_TEST(test_write_compress_gzip)
+DEFINE_TEST(test_write_compress_lz4)
 DEFINE_TEST(test_write_compress_lzma)
 DEFINE_TEST(test_write_compress_program)
+DEFINE_TEST(test_write_compress_threads)
 DEFINE_TEST(test_write_compress_xz)
+DEFINE_TEST(test_write_compress_zstd)
 DEFINE_TEST(test_write_disk)
+DEFINE_TEST(test_write_disk_dirs)
 DEFINE_TEST(test_write_disk_failures)
 DEFINE_TEST(test_write_disk_hardlink)
+DEFINE_TEST(test_write_disk_lookup)
 DEFINE_TEST(test_write_disk_perms)
 DEFINE_TEST(test_write_disk_secure)
 DEFINE_TEST(test_write_disk_sparse)
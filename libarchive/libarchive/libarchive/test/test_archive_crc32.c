@@ -0,0 +1,138 @@
+/*-
+ * Copyright (c) 2026 The libarchive Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "test.h"
+__FBSDID("$FreeBSD$");
+
+#ifdef HAVE_ZLIB_H
+#include <zlib.h>
+#endif
+
+/*
+ * Check the slice-by-16 and carry-less multiply crc32 code against
+ * the byte-at-a-time implementation it replaced and, when we have
+ * it, zlib, over random buffers, lengths, alignments and seeds.
+ */
+
+/* Internal to libarchive; see archive_crc32.h. */
+unsigned long	__archive_crc32(unsigned long, const void *, size_t);
+int		__archive_crc32_clmul(int);
+
+static unsigned long
+crc32_bytewise(unsigned long crc, const void *_p, size_t len)
+{
+	unsigned long crc2, b, i;
+	const unsigned char *p = _p;
+	static unsigned long crc_tbl[256];
+
+	if (crc_tbl[1] == 0) {
+		for (b = 0; b < 256; ++b) {
+			crc2 = b;
+			for (i = 8; i > 0; --i) {
+				if (crc2 & 1)
+					crc2 = (crc2 >> 1) ^ 0xedb88320UL;
+				else
+					crc2 = (crc2 >> 1);
+			}
+			crc_tbl[b] = crc2;
+		}
+	}
+
+	crc = crc ^ 0xffffffffUL;
+	while (len--)
+		crc = crc_tbl[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+	return (crc ^ 0xffffffffUL);
+}
+
+static void
+check_random(const unsigned char *buff, size_t buffsize)
+{
+	unsigned long seed, expected, got;
+	size_t offset, len, split;
+	int i;
+
+	for (i = 0; i < 2000; i++) {
+		offset = rand() % 64;
+		if (i % 4 == 0)
+			len = rand() % 300;
+		else
+			len = rand() % (buffsize - offset);
+		seed = i % 3 == 0 ? 0 : (((unsigned long)rand() << 16) ^
+		    (unsigned long)rand()) & 0xffffffffUL;
+		expected = crc32_bytewise(seed, buff + offset, len);
+		got = __archive_crc32(seed, buff + offset, len);
+		failure("offset=%d len=%d seed=0x%lx",
+		    (int)offset, (int)len, seed);
+		assertEqualInt(expected, got);
+#ifdef HAVE_ZLIB_H
+		failure("offset=%d len=%d seed=0x%lx",
+		    (int)offset, (int)len, seed);
+		assertEqualInt(expected,
+		    crc32(seed, buff + offset, (uInt)len));
+#endif
+		/* Computing it in two pieces gives the same answer. */
+		split = len == 0 ? 0 : rand() % len;
+		got = __archive_crc32(__archive_crc32(seed,
+		    buff + offset, split), buff + offset + split, len - split);
+		failure("offset=%d len=%d split=%d",
+		    (int)offset, (int)len, (int)split);
+		assertEqualInt(expected, got);
+	}
+}
+
+DEFINE_TEST(test_archive_crc32)
+{
+	unsigned char *buff;
+	size_t buffsize = 70000;
+	size_t i;
+	int clmul;
+
+	/* Known answers. */
+	assertEqualInt(0, __archive_crc32(0, NULL, 0));
+	assertEqualInt(0xcbf43926UL, __archive_crc32(0, "123456789", 9));
+	assertEqualInt(0x414fa339UL, __archive_crc32(0,
+	    "The quick brown fox jumps over the lazy dog", 43));
+
+	buff = malloc(buffsize);
+	assert(buff != NULL);
+	srand(12345);
+	for (i = 0; i < buffsize; i++)
+		buff[i] = (unsigned char)rand();
+	/* Long runs of 0x00 and 0xff. */
+	memset(buff + 1000, 0, 5000);
+	memset(buff + 9000, 0xff, 5000);
+
+	clmul = __archive_crc32_clmul(-1);
+	if (clmul) {
+		check_random(buff, buffsize);
+		__archive_crc32_clmul(0);
+	} else {
+		skipping("carry-less multiply crc32 (not supported by CPU)");
+	}
+	assertEqualInt(0, __archive_crc32_clmul(-1));
+	check_random(buff, buffsize);
+	assertEqualInt(clmul, __archive_crc32_clmul(1));
+
+	free(buff);
+}
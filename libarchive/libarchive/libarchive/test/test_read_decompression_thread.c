@@ -0,0 +1,246 @@
+/*-
+ * Copyright (c) 2026 The libarchive Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "test.h"
+__FBSDID("$FreeBSD$");
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+/*
+ * With archive_read_set_decompression_thread(), a compressed archive
+ * must read back exactly as it does without it, the client's read
+ * callback must still be called on this thread, and decompression
+ * errors must still be reported.
+ */
+
+#define	NFILES		5
+#define	FILESIZE	300001
+
+struct source {
+	const char	*buff;
+	size_t		 size;
+	size_t		 offset;
+	size_t		 block;
+	int		 wrong_thread;
+#ifdef HAVE_PTHREAD_H
+	pthread_t	 thread;
+#endif
+};
+
+static ssize_t
+source_read(struct archive *a, void *client_data, const void **buff)
+{
+	struct source *s = client_data;
+	size_t n;
+
+	(void)a; /* UNUSED */
+#ifdef HAVE_PTHREAD_H
+	if (!pthread_equal(s->thread, pthread_self()))
+		s->wrong_thread = 1;
+#endif
+	n = s->size - s->offset;
+	if (n > s->block)
+		n = s->block;
+	*buff = s->buff + s->offset;
+	s->offset += n;
+	return ((ssize_t)n);
+}
+
+static void
+fill(char *p, size_t size, int seed)
+{
+	size_t i;
+
+	/* Compressible, but not trivially. */
+	for (i = 0; i < size; i++)
+		p[i] = "abcdefgh"[(i * seed + (i >> 7)) % 8] ^ (char)(i % 251 == 0);
+}
+
+static int
+make_archive(char *buff, size_t buffsize, size_t *used, int xz,
+    char *data)
+{
+	struct archive_entry *ae;
+	struct archive *a;
+	char name[16];
+	int i, r;
+
+	assert((a = archive_write_new()) != NULL);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_set_format_ustar(a));
+	r = xz ? archive_write_set_compression_xz(a) :
+	    archive_write_set_compression_gzip(a);
+	if (r != ARCHIVE_OK) {
+		archive_write_finish(a);
+		return (0);
+	}
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_write_open_memory(a, buff, buffsize, used));
+	for (i = 0; i < NFILES; i++) {
+		fill(data, FILESIZE, i + 3);
+		sprintf(name, "file%d", i);
+		assert((ae = archive_entry_new()) != NULL);
+		archive_entry_copy_pathname(ae, name);
+		archive_entry_set_mode(ae, S_IFREG | 0644);
+		archive_entry_set_size(ae, FILESIZE);
+		assertEqualIntA(a, ARCHIVE_OK, archive_write_header(a, ae));
+		archive_entry_free(ae);
+		assertEqualIntA(a, FILESIZE,
+		    archive_write_data(a, data, FILESIZE));
+	}
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_close(a));
+	assertEqualInt(ARCHIVE_OK, archive_write_finish(a));
+	return (1);
+}
+
+static void
+verify(const char *buff, size_t used, size_t block, char *data,
+    char *expected)
+{
+	struct archive_entry *ae;
+	struct archive *a;
+	struct source s;
+	char name[16];
+	int i;
+
+	memset(&s, 0, sizeof(s));
+	s.buff = buff;
+	s.size = used;
+	s.block = block;
+#ifdef HAVE_PTHREAD_H
+	s.thread = pthread_self();
+#endif
+	assert((a = archive_read_new()) != NULL);
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_support_format_all(a));
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_support_compression_all(a));
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_read_set_decompression_thread(a, 1));
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_read_open(a, &s, NULL, source_read, NULL));
+	for (i = 0; i < NFILES; i++) {
+		assertEqualIntA(a, ARCHIVE_OK,
+		    archive_read_next_header(a, &ae));
+		sprintf(name, "file%d", i);
+		assertEqualString(name, archive_entry_pathname(ae));
+		/* Skip one, so that skipping is covered too. */
+		if (i == 2)
+			continue;
+		fill(expected, FILESIZE, i + 3);
+		assertEqualIntA(a, FILESIZE,
+		    archive_read_data(a, data, FILESIZE + 1));
+		assertEqualMem(data, expected, FILESIZE);
+	}
+	assertEqualIntA(a, ARCHIVE_EOF, archive_read_next_header(a, &ae));
+	assertEqualInt(used, archive_position_compressed(a));
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_close(a));
+	assertEqualInt(ARCHIVE_OK, archive_read_finish(a));
+	assertEqualInt(0, s.wrong_thread);
+}
+
+/*
+ * Read a damaged archive as far as it goes, with or without the
+ * thread; returns the last result and leaves the error in 'msg'.
+ */
+static ssize_t
+read_damaged(const char *buff, size_t used, char *data, int thread,
+    char *msg, size_t msgsize)
+{
+	struct archive_entry *ae;
+	struct archive *a;
+	ssize_t r;
+
+	assert((a = archive_read_new()) != NULL);
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_support_format_all(a));
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_support_compression_all(a));
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_read_set_decompression_thread(a, thread));
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_read_open_memory(a, (void *)(uintptr_t)buff, used));
+	for (;;) {
+		r = archive_read_next_header(a, &ae);
+		if (r != ARCHIVE_OK)
+			break;
+		while ((r = archive_read_data(a, data, FILESIZE)) > 0)
+			continue;
+		if (r != 0)
+			break;
+	}
+	strncpy(msg, archive_error_string(a) != NULL ?
+	    archive_error_string(a) : "", msgsize - 1);
+	msg[msgsize - 1] = '\0';
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_close(a));
+	assertEqualInt(ARCHIVE_OK, archive_read_finish(a));
+	return (r);
+}
+
+/* Errors come out the same way, with the same message. */
+static void
+verify_damaged(char *buff, size_t used, size_t where, char *data)
+{
+	char msg1[256], msg2[256];
+	ssize_t r1, r2;
+	size_t i;
+
+	for (i = where; i < where + 64 && i < used; i++)
+		buff[i] ^= 0x55;
+	r1 = read_damaged(buff, used, data, 0, msg1, sizeof(msg1));
+	r2 = read_damaged(buff, used, data, 1, msg2, sizeof(msg2));
+	assert(r1 < ARCHIVE_OK);
+	assertEqualInt(r1, r2);
+	assertEqualString(msg1, msg2);
+	for (i = where; i < where + 64 && i < used; i++)
+		buff[i] ^= 0x55;
+}
+
+DEFINE_TEST(test_read_decompression_thread)
+{
+	size_t buffsize = 4 * 1024 * 1024, used;
+	char *buff, *data, *expected;
+	int xz;
+
+	buff = malloc(buffsize);
+	data = malloc(FILESIZE + 1);
+	expected = malloc(FILESIZE);
+	assert(buff != NULL && data != NULL && expected != NULL);
+
+	for (xz = 0; xz < 2; xz++) {
+		if (!make_archive(buff, buffsize, &used, xz, data)) {
+			skipping("%s compression", xz ? "xz" : "gzip");
+			continue;
+		}
+		/* Client blocks smaller and larger than the pipeline's. */
+		verify(buff, used, 1000, data, expected);
+		verify(buff, used, 100000, data, expected);
+		verify(buff, used, used, data, expected);
+		verify_damaged(buff, used, used / 2, data);
+		verify_damaged(buff, used, used - 70, data);
+		/* Truncated. */
+		verify_damaged(buff, used / 3, used, data);
+	}
+
+	free(buff);
+	free(data);
+	free(expected);
+}
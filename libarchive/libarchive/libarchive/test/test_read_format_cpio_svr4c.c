@@ -0,0 +1,146 @@
+/*-
+ * Copyright (c) 2026 The libarchive Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "test.h"
+__FBSDID("$FreeBSD$");
+
+/*
+ * The SVR4 "crc" cpio format stores a 32-bit sum of the bytes of each
+ * regular file.  Build such an archive by relabeling a newc archive,
+ * then check that a good sum reads cleanly, a bad one warns, and
+ * skipping an entry doesn't look at the sum at all.
+ */
+
+#define	DATASIZE	100003
+/* Offset of c_check in the 110-byte newc header. */
+#define	CHECK_OFFSET	102
+
+static void
+write_archive(char *buff, size_t buffsize, size_t *used,
+    const unsigned char *data)
+{
+	struct archive_entry *ae;
+	struct archive *a;
+
+	assert((a = archive_write_new()) != NULL);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_set_format_cpio_newc(a));
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_set_compression_none(a));
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_write_open_memory(a, buff, buffsize, used));
+	assert((ae = archive_entry_new()) != NULL);
+	archive_entry_copy_pathname(ae, "file");
+	archive_entry_set_mode(ae, S_IFREG | 0644);
+	archive_entry_set_size(ae, DATASIZE);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_header(a, ae));
+	archive_entry_free(ae);
+	assertEqualIntA(a, DATASIZE, archive_write_data(a, data, DATASIZE));
+	assert((ae = archive_entry_new()) != NULL);
+	archive_entry_copy_pathname(ae, "file2");
+	archive_entry_set_mode(ae, S_IFREG | 0644);
+	archive_entry_set_size(ae, 4);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_header(a, ae));
+	archive_entry_free(ae);
+	assertEqualIntA(a, 4, archive_write_data(a, "abcd", 4));
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_close(a));
+	assertEqualInt(ARCHIVE_OK, archive_write_finish(a));
+}
+
+/* Relabel one newc header as "070702" and store the sum. */
+static void
+set_check(char *h, unsigned long sum)
+{
+	char check[9];
+
+	memcpy(h, "070702", 6);
+	sprintf(check, "%08lX", sum & 0xffffffffUL);
+	memcpy(h + CHECK_OFFSET, check, 8);
+}
+
+static void
+read_archive(const char *buff, size_t used, int expected_first, int skip)
+{
+	struct archive_entry *ae;
+	struct archive *a;
+	char data[1024];
+	ssize_t r;
+
+	assert((a = archive_read_new()) != NULL);
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_support_format_all(a));
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_support_compression_all(a));
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_open_memory(a,
+	    (void *)(uintptr_t)buff, used));
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_next_header(a, &ae));
+	assertEqualInt(ARCHIVE_FORMAT_CPIO_SVR4_CRC, archive_format(a));
+	assertEqualString("file", archive_entry_pathname(ae));
+	if (skip)
+		assertEqualIntA(a, ARCHIVE_OK, archive_read_data_skip(a));
+	else {
+		while ((r = archive_read_data(a, data, sizeof(data))) > 0)
+			continue;
+		assertEqualIntA(a, expected_first, r);
+	}
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_next_header(a, &ae));
+	assertEqualString("file2", archive_entry_pathname(ae));
+	assertEqualIntA(a, 4, archive_read_data(a, data, sizeof(data)));
+	assertEqualMem(data, "abcd", 4);
+	assertEqualIntA(a, 0, archive_read_data(a, data, sizeof(data)));
+	assertEqualIntA(a, ARCHIVE_EOF, archive_read_next_header(a, &ae));
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_close(a));
+	assertEqualInt(ARCHIVE_OK, archive_read_finish(a));
+}
+
+DEFINE_TEST(test_read_format_cpio_svr4c)
+{
+	unsigned char *data;
+	char *buff, *h2;
+	size_t buffsize = 200000, used;
+	unsigned long sum;
+	int i;
+
+	data = malloc(DATASIZE);
+	buff = malloc(buffsize);
+	assert(data != NULL && buff != NULL);
+	/* Plenty of 0xff so a 16-bit lane overflow would show. */
+	for (i = 0, sum = 0; i < DATASIZE; i++) {
+		data[i] = (i % 7) == 0 ? (unsigned char)i : 0xff;
+		sum += data[i];
+	}
+	write_archive(buff, buffsize, &used, data);
+	h2 = buff + 116 + DATASIZE + 1;	/* header, "file\0", data, padding */
+	assertEqualMem(h2, "070701", 6);
+	set_check(buff, sum);
+	set_check(h2, 'a' + 'b' + 'c' + 'd');
+
+	read_archive(buff, used, ARCHIVE_OK, 0);
+	read_archive(buff, used, ARCHIVE_OK, 1);
+
+	/* A wrong sum warns at the end of the entry's data ... */
+	set_check(buff, sum + 1);
+	read_archive(buff, used, ARCHIVE_WARN, 0);
+	/* ... and isn't noticed if the data is skipped. */
+	read_archive(buff, used, ARCHIVE_OK, 1);
+
+	free(data);
+	free(buff);
+}
@@ -0,0 +1,289 @@
+/*-
+ * Copyright (c) 2026 The libarchive Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "test.h"
+__FBSDID("$FreeBSD$");
+
+/*
+ * Exercise the seekable zip reader: random access by name and by
+ * number, and two archive objects sharing one index and one file
+ * descriptor.
+ */
+
+static char data1[20000];
+
+/* A read callback with no seek callback behind it. */
+static ssize_t
+stream_read(struct archive *a, void *client_data, const void **buff)
+{
+	size_t *remaining = (size_t *)client_data;
+	ssize_t n;
+
+	(void)a; /* UNUSED */
+	*buff = (const char *)remaining + sizeof(size_t);
+	n = (ssize_t)*remaining;
+	*remaining = 0;
+	return (n);
+}
+
+static void
+write_archive(char *buff, size_t buffsize, size_t *used)
+{
+	struct archive_entry *ae;
+	struct archive *a;
+
+	assert((a = archive_write_new()) != NULL);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_set_format_zip(a));
+#ifdef HAVE_ZLIB_H
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_write_set_format_options(a, "zip:compression=deflate"));
+#endif
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_set_compression_none(a));
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_write_open_memory(a, buff, buffsize, used));
+
+	assert((ae = archive_entry_new()) != NULL);
+	archive_entry_copy_pathname(ae, "file1");
+	archive_entry_set_mode(ae, S_IFREG | 0644);
+	archive_entry_set_size(ae, sizeof(data1));
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_header(a, ae));
+	archive_entry_free(ae);
+	assertEqualInt(sizeof(data1),
+	    archive_write_data(a, data1, sizeof(data1)));
+
+	assert((ae = archive_entry_new()) != NULL);
+	archive_entry_copy_pathname(ae, "dir/");
+	archive_entry_set_mode(ae, S_IFDIR | 0755);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_header(a, ae));
+	archive_entry_free(ae);
+
+	assert((ae = archive_entry_new()) != NULL);
+	archive_entry_copy_pathname(ae, "dir/file2");
+	archive_entry_set_mode(ae, S_IFREG | 0600);
+	archive_entry_set_size(ae, 8);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_header(a, ae));
+	archive_entry_free(ae);
+	assertEqualInt(8, archive_write_data(a, "12345678", 8));
+
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_close(a));
+	assertEqualInt(ARCHIVE_OK, archive_write_finish(a));
+}
+
+/* Read the whole of the current entry and compare it to 'expected'. */
+static void
+verify_data(struct archive *a, const char *expected, size_t size)
+{
+	char buff[1024];
+	size_t total = 0;
+	ssize_t n;
+
+	while ((n = archive_read_data(a, buff, sizeof(buff))) > 0) {
+		if (total + n > size)
+			break;
+		assertEqualMem(buff, expected + total, n);
+		total += n;
+	}
+	assertEqualInt(0, n);
+	assertEqualInt(size, total);
+}
+
+static void
+test_memory(char *buff, size_t used)
+{
+	struct archive_entry *ae;
+	struct archive *a;
+
+	assert((a = archive_read_new()) != NULL);
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_support_format_zip(a));
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_read_support_format_zip_seekable(a));
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_open_memory(a, buff, used));
+	assertEqualIntA(a, 3, archive_read_zip_entry_count(a));
+
+	/* Jump straight to the last entry. */
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_read_zip_seek_name(a, "dir/file2"));
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_next_header(a, &ae));
+	assertEqualString("dir/file2", archive_entry_pathname(ae));
+	assertEqualInt(S_IFREG | 0600, archive_entry_mode(ae));
+	/* The writer defers sizes to a data descriptor. */
+	assertEqualInt(8, archive_entry_size(ae));
+	verify_data(a, "12345678", 8);
+	assertEqualIntA(a, ARCHIVE_EOF, archive_read_next_header(a, &ae));
+
+	/* Back to the start, then on through the directory. */
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_zip_seek_entry(a, 0));
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_next_header(a, &ae));
+	assertEqualString("file1", archive_entry_pathname(ae));
+	assertEqualInt(sizeof(data1), archive_entry_size(ae));
+	verify_data(a, data1, sizeof(data1));
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_next_header(a, &ae));
+	assertEqualString("dir/", archive_entry_pathname(ae));
+	assertEqualInt(S_IFDIR | 0755, archive_entry_mode(ae));
+
+	/* Skipping unread data is free. */
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_zip_seek_entry(a, 0));
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_next_header(a, &ae));
+	assertEqualString("file1", archive_entry_pathname(ae));
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_next_header(a, &ae));
+	assertEqualString("dir/", archive_entry_pathname(ae));
+
+	/* Missing entries leave the archive usable. */
+	assertEqualIntA(a, ARCHIVE_FAILED,
+	    archive_read_zip_seek_name(a, "nonexistent"));
+	assertEqualIntA(a, ARCHIVE_FAILED, archive_read_zip_seek_entry(a, 3));
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_next_header(a, &ae));
+	assertEqualString("dir/file2", archive_entry_pathname(ae));
+
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_close(a));
+	assertEqualInt(ARCHIVE_OK, archive_read_finish(a));
+}
+
+static void
+test_shared_fd(void)
+{
+	struct archive_entry *ae1, *ae2;
+	struct archive *a1, *a2;
+	char buff[1024];
+	size_t off1 = 0;
+	ssize_t n;
+	int fd;
+
+	fd = open("test.zip", O_RDONLY | O_BINARY);
+	assert(fd >= 0);
+
+	assert((a1 = archive_read_new()) != NULL);
+	assertEqualIntA(a1, ARCHIVE_OK,
+	    archive_read_support_format_zip_seekable(a1));
+	assertEqualIntA(a1, ARCHIVE_OK, archive_read_open_fd(a1, fd, 512));
+	assert((a2 = archive_read_new()) != NULL);
+	assertEqualIntA(a2, ARCHIVE_OK,
+	    archive_read_support_format_zip_seekable(a2));
+	assertEqualIntA(a2, ARCHIVE_OK, archive_read_zip_share_index(a2, a1));
+	assertEqualIntA(a2, ARCHIVE_OK, archive_read_open_fd(a2, fd, 512));
+	assertEqualIntA(a2, 3, archive_read_zip_entry_count(a2));
+
+	/* Interleave reads of two members through one descriptor. */
+	assertEqualIntA(a2, ARCHIVE_OK,
+	    archive_read_zip_seek_name(a2, "dir/file2"));
+	assertEqualIntA(a1, ARCHIVE_OK, archive_read_next_header(a1, &ae1));
+	assertEqualString("file1", archive_entry_pathname(ae1));
+	assertEqualIntA(a2, ARCHIVE_OK, archive_read_next_header(a2, &ae2));
+	assertEqualString("dir/file2", archive_entry_pathname(ae2));
+	while ((n = archive_read_data(a1, buff, 100)) > 0) {
+		assertEqualMem(buff, data1 + off1, n);
+		off1 += n;
+		if (off1 == 100)
+			verify_data(a2, "12345678", 8);
+	}
+	assertEqualInt(0, n);
+	assertEqualInt(sizeof(data1), off1);
+
+	assertEqualIntA(a2, ARCHIVE_OK, archive_read_close(a2));
+	assertEqualInt(ARCHIVE_OK, archive_read_finish(a2));
+	assertEqualIntA(a1, ARCHIVE_OK, archive_read_close(a1));
+	assertEqualInt(ARCHIVE_OK, archive_read_finish(a1));
+	close(fd);
+}
+
+static void
+test_reference_file(void)
+{
+	const char *refname = "test_read_format_zip.zip";
+	struct archive_entry *ae;
+	struct archive *a;
+	char buff[32];
+
+	extract_reference_file(refname);
+	assert((a = archive_read_new()) != NULL);
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_support_format_all(a));
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_read_support_format_zip_seekable(a));
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_read_open_filename(a, refname, 10240));
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_read_zip_seek_name(a, "file2"));
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_next_header(a, &ae));
+	assertEqualString("file2", archive_entry_pathname(ae));
+	assertEqualInt(1179605932, archive_entry_mtime(ae));
+	/*
+	 * Only file2's data descriptor was damaged; the central
+	 * directory has the right size and CRC.
+	 */
+	assertEqualInt(18, archive_entry_size(ae));
+	assertEqualIntA(a, 18, archive_read_data(a, buff, 19));
+	assertEqualMem(buff, "hello\nhello\nhello\n", 18);
+	assertEqualInt(ARCHIVE_FORMAT_ZIP, archive_format(a));
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_close(a));
+	assertEqualInt(ARCHIVE_OK, archive_read_finish(a));
+}
+
+static void
+test_not_seekable(char *buff, size_t used)
+{
+	struct archive_entry *ae;
+	struct archive *a;
+	char *stream;
+
+	/* The streaming reader takes over without a seek callback. */
+	stream = malloc(sizeof(size_t) + used);
+	*(size_t *)stream = used;
+	memcpy(stream + sizeof(size_t), buff, used);
+	assert((a = archive_read_new()) != NULL);
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_support_format_zip(a));
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_read_support_format_zip_seekable(a));
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_read_open(a, stream, NULL, stream_read, NULL));
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_next_header(a, &ae));
+	assertEqualString("file1", archive_entry_pathname(ae));
+	assertEqualIntA(a, ARCHIVE_FATAL, archive_read_zip_entry_count(a));
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_close(a));
+	assertEqualInt(ARCHIVE_OK, archive_read_finish(a));
+	free(stream);
+}
+
+DEFINE_TEST(test_read_format_zip_seekable)
+{
+	size_t buffsize = 100000, used;
+	char *buff;
+	FILE *f;
+	size_t i;
+
+	for (i = 0; i < sizeof(data1); i++)
+		data1[i] = "abcdefghijklmnopqrstuvwxyz0123456789"[(i * 7) % 36];
+	buff = malloc(buffsize);
+	write_archive(buff, buffsize, &used);
+
+	f = fopen("test.zip", "wb");
+	assert(f != NULL);
+	assertEqualInt(used, fwrite(buff, 1, used, f));
+	fclose(f);
+
+	test_memory(buff, used);
+	test_shared_fd();
+	test_reference_file();
+	test_not_seekable(buff, used);
+	free(buff);
+}
@@ -0,0 +1,269 @@
+/*-
+ * Copyright (c) 2026 The libarchive Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "test.h"
+__FBSDID("$FreeBSD$");
+
+/*
+ * An archive written with archive_write_set_tar_index() must still
+ * read as a plain tar archive, and with its index, loaded from a
+ * separate buffer or from the end of the archive, the reader must be
+ * able to go straight to any member, forward or back, through gzip
+ * and xz restart points and with the decompression thread.
+ */
+
+#define	NFILES		8
+#define	FILESIZE	70001
+#define	INTERVAL	100000
+
+enum { NONE, GZIP, XZ };
+
+static void
+fill(char *p, size_t size, int seed)
+{
+	size_t i;
+
+	for (i = 0; i < size; i++)
+		p[i] = "abcdefgh"[(i * seed + (i >> 7)) % 8] ^ (char)(i % 253 == 0);
+}
+
+/* Returns 0 if the compression isn't available. */
+static int
+make_archive(char *buff, size_t buffsize, size_t *used, int compression,
+    int flags, char *index, size_t *index_size, char *data)
+{
+	struct archive_entry *ae;
+	struct archive *a;
+	const void *p;
+	char name[16];
+	size_t size;
+	int i, r;
+
+	assert((a = archive_write_new()) != NULL);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_set_format_pax(a));
+	r = ARCHIVE_OK;
+	if (compression == GZIP)
+		r = archive_write_set_compression_gzip(a);
+	else if (compression == XZ)
+		r = archive_write_set_compression_xz(a);
+	if (r != ARCHIVE_OK) {
+		archive_write_finish(a);
+		return (0);
+	}
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_write_set_tar_index(a, flags, INTERVAL));
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_write_open_memory(a, buff, buffsize, used));
+
+	assert((ae = archive_entry_new()) != NULL);
+	archive_entry_copy_pathname(ae, "dir/");
+	archive_entry_set_mode(ae, S_IFDIR | 0755);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_header(a, ae));
+	archive_entry_free(ae);
+	for (i = 0; i < NFILES; i++) {
+		fill(data, FILESIZE, i + 3);
+		sprintf(name, "dir/file%d", i);
+		assert((ae = archive_entry_new()) != NULL);
+		archive_entry_copy_pathname(ae, name);
+		archive_entry_set_mode(ae, S_IFREG | 0644);
+		archive_entry_set_size(ae, FILESIZE);
+		assertEqualIntA(a, ARCHIVE_OK, archive_write_header(a, ae));
+		archive_entry_free(ae);
+		assertEqualIntA(a, FILESIZE,
+		    archive_write_data(a, data, FILESIZE));
+	}
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_close(a));
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_get_tar_index(a, &p, &size));
+	assert(size < *index_size);
+	memcpy(index, p, size);
+	*index_size = size;
+	assertEqualInt(ARCHIVE_OK, archive_write_finish(a));
+	return (1);
+}
+
+/* Read the whole archive in order, as any tar reader would. */
+static void
+verify_plain(const char *buff, size_t used)
+{
+	struct archive_entry *ae;
+	struct archive *a;
+	int i;
+
+	assert((a = archive_read_new()) != NULL);
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_support_format_all(a));
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_support_compression_all(a));
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_read_open_memory(a, (void *)(uintptr_t)buff, used));
+	for (i = 0; i < NFILES + 1; i++)
+		assertEqualIntA(a, ARCHIVE_OK,
+		    archive_read_next_header(a, &ae));
+	assertEqualIntA(a, ARCHIVE_EOF, archive_read_next_header(a, &ae));
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_close(a));
+	assertEqualInt(ARCHIVE_OK, archive_read_finish(a));
+}
+
+static void
+check_file(struct archive *a, int n, char *data, char *expected)
+{
+	struct archive_entry *ae;
+	char name[16];
+
+	sprintf(name, "dir/file%d", n);
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_tar_seek_name(a, name));
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_next_header(a, &ae));
+	assertEqualString(name, archive_entry_pathname(ae));
+	fill(expected, FILESIZE, n + 3);
+	assertEqualIntA(a, FILESIZE, archive_read_data(a, data, FILESIZE + 1));
+	assertEqualMem(data, expected, FILESIZE);
+}
+
+/* Jump around using the index; NULL means the appended one. */
+static void
+verify_seek(const char *buff, size_t used, const char *index,
+    size_t index_size, int thread, char *data, char *expected)
+{
+	struct archive_entry *ae;
+	struct archive *a;
+
+	assert((a = archive_read_new()) != NULL);
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_support_format_all(a));
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_support_compression_all(a));
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_read_set_decompression_thread(a, thread));
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_read_open_memory(a, (void *)(uintptr_t)buff, used));
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_read_tar_index_load(a, index, index_size));
+	assertEqualIntA(a, NFILES + 1, archive_read_tar_entry_count(a));
+	assertEqualString("dir", archive_read_tar_entry_name(a, 0));
+	assertEqualString("dir/file3", archive_read_tar_entry_name(a, 4));
+	assert(archive_read_tar_entry_name(a, NFILES + 1) == NULL);
+
+	/* Forward, then back, then to the last one and on to the end. */
+	check_file(a, 5, data, expected);
+	check_file(a, 1, data, expected);
+	check_file(a, 2, data, expected);
+	check_file(a, NFILES - 1, data, expected);
+	assertEqualIntA(a, ARCHIVE_EOF, archive_read_next_header(a, &ae));
+
+	/* Back from the end, in the middle of an entry, by number. */
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_tar_seek_name(a, "dir"));
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_next_header(a, &ae));
+	assertEqualString("dir/", archive_entry_pathname(ae));
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_next_header(a, &ae));
+	assertEqualIntA(a, 100, archive_read_data(a, data, 100));
+	check_file(a, 0, data, expected);
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_tar_seek_entry(a, 7));
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_next_header(a, &ae));
+	assertEqualString("dir/file6", archive_entry_pathname(ae));
+
+	assertEqualIntA(a, ARCHIVE_FAILED,
+	    archive_read_tar_seek_name(a, "dir/nothing"));
+	assertEqualIntA(a, ARCHIVE_FAILED,
+	    archive_read_tar_seek_entry(a, NFILES + 1));
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_close(a));
+	assertEqualInt(ARCHIVE_OK, archive_read_finish(a));
+}
+
+DEFINE_TEST(test_tar_index)
+{
+	static const char *names[] = { "none", "gzip", "xz" };
+	struct archive *a;
+	char *buff, *data, *expected, *index;
+	size_t buffsize = 2000000, used, index_size;
+	size_t used_none = 0, index_none_size = 0;
+	char *buff_none, *index_none;
+	int compression, flags;
+
+	buff = malloc(buffsize);
+	buff_none = malloc(buffsize);
+	index = malloc(100000);
+	index_none = malloc(100000);
+	data = malloc(FILESIZE + 1);
+	expected = malloc(FILESIZE);
+	assert(buff != NULL && buff_none != NULL && index != NULL &&
+	    index_none != NULL && data != NULL && expected != NULL);
+
+	for (compression = NONE; compression <= XZ; compression++) {
+		for (flags = 0; flags <= ARCHIVE_TAR_INDEX_TRAILER; flags++) {
+			/* xz has nowhere to put a trailer but the data. */
+			if (compression == XZ && flags != 0)
+				continue;
+			index_size = 100000;
+			if (!make_archive(buff, buffsize, &used, compression,
+			    flags, index, &index_size, data)) {
+				skipping("%s compression", names[compression]);
+				break;
+			}
+			failure("%s, flags %d", names[compression], flags);
+			verify_plain(buff, used);
+			verify_seek(buff, used, index, index_size, 0,
+			    data, expected);
+			verify_seek(buff, used, index, index_size, 1,
+			    data, expected);
+			if (flags & ARCHIVE_TAR_INDEX_TRAILER) {
+				verify_seek(buff, used, NULL, 0, 0,
+				    data, expected);
+				verify_seek(buff, used, NULL, 0, 1,
+				    data, expected);
+			}
+			if (compression == NONE && flags == 0) {
+				memcpy(buff_none, buff, used);
+				used_none = used;
+				memcpy(index_none, index, index_size);
+				index_none_size = index_size;
+			}
+		}
+	}
+
+	/* An index must match its archive, and be there to be used. */
+	assert((a = archive_read_new()) != NULL);
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_support_format_tar(a));
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_read_open_memory(a, buff_none, used_none - 512));
+	assertEqualIntA(a, ARCHIVE_FAILED,
+	    archive_read_tar_index_load(a, index_none, index_none_size));
+	assertEqualIntA(a, ARCHIVE_FAILED,
+	    archive_read_tar_index_load(a, NULL, 0));
+	assertEqualIntA(a, ARCHIVE_FATAL, archive_read_tar_seek_entry(a, 0));
+	assertEqualInt(ARCHIVE_OK, archive_read_finish(a));
+
+	/* No trailer can be added to xz data. */
+	assert((a = archive_write_new()) != NULL);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_set_format_ustar(a));
+	if (archive_write_set_compression_xz(a) == ARCHIVE_OK) {
+		assertEqualIntA(a, ARCHIVE_OK, archive_write_set_tar_index(a,
+		    ARCHIVE_TAR_INDEX_TRAILER, INTERVAL));
+		assertEqualIntA(a, ARCHIVE_FATAL,
+		    archive_write_open_memory(a, buff, buffsize, &used));
+	}
+	assertEqualInt(ARCHIVE_OK, archive_write_finish(a));
+
+	free(expected);
+	free(data);
+	free(index_none);
+	free(index);
+	free(buff_none);
+	free(buff);
+}
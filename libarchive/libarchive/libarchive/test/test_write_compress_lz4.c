@@ -0,0 +1,207 @@
+/*-
+ * Copyright (c) 2026 The libarchive Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "test.h"
+__FBSDID("$FreeBSD$");
+
+/*
+ * A basic exercise of lz4 reading and writing.
+ */
+
+static void
+write_100(struct archive *a, const char *data, size_t datasize)
+{
+	struct archive_entry *ae;
+	char path[16];
+	int i;
+
+	for (i = 0; i < 100; i++) {
+		sprintf(path, "file%03d", i);
+		assert((ae = archive_entry_new()) != NULL);
+		archive_entry_copy_pathname(ae, path);
+		archive_entry_set_size(ae, datasize);
+		archive_entry_set_filetype(ae, AE_IFREG);
+		assertA(0 == archive_write_header(a, ae));
+		failure("Writing file %s", path);
+		assertEqualIntA(a, datasize,
+		    (size_t)archive_write_data(a, data, datasize));
+		archive_entry_free(ae);
+	}
+}
+
+static void
+read_100(char *buff, size_t used, const char *data, size_t datasize)
+{
+	struct archive_entry *ae;
+	struct archive *a;
+	char path[16], *rbuff;
+	int i, r;
+
+	assert((a = archive_read_new()) != NULL);
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_support_format_all(a));
+	r = archive_read_support_compression_lz4(a);
+	if (r == ARCHIVE_WARN) {
+		skipping("Can't verify lz4 writing by reading back;"
+		    " lz4 reading not fully supported on this platform");
+		assertEqualInt(ARCHIVE_OK, archive_read_finish(a));
+		return;
+	}
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_read_support_compression_all(a));
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_open_memory(a, buff, used));
+	assert(NULL != (rbuff = (char *)malloc(datasize)));
+	for (i = 0; i < 100; i++) {
+		sprintf(path, "file%03d", i);
+		failure("Trying to read %s", path);
+		if (!assertEqualIntA(a, ARCHIVE_OK,
+			archive_read_next_header(a, &ae)))
+			break;
+		assertEqualString(path, archive_entry_pathname(ae));
+		assertEqualInt((int)datasize, archive_entry_size(ae));
+		assertEqualIntA(a, datasize,
+		    archive_read_data(a, rbuff, datasize));
+		assert(memcmp(rbuff, data, datasize) == 0);
+	}
+	assertEqualIntA(a, ARCHIVE_EOF, archive_read_next_header(a, &ae));
+	assertEqualInt(ARCHIVE_COMPRESSION_LZ4, archive_compression(a));
+	assertEqualString("lz4", archive_compression_name(a));
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_close(a));
+	assertEqualInt(ARCHIVE_OK, archive_read_finish(a));
+	free(rbuff);
+}
+
+DEFINE_TEST(test_write_compress_lz4)
+{
+	struct archive* a;
+	char *buff, *data;
+	size_t buffsize, datasize;
+	size_t used1, used2;
+	int i, r;
+
+	buffsize = 2000000;
+	assert(NULL != (buff = (char *)malloc(buffsize)));
+
+	datasize = 10000;
+	assert(NULL != (data = (char *)malloc(datasize)));
+	for (i = 0; i < (int)datasize; i++)
+		data[i] = (char)(i % 251 < 200 ? 'a' + i % 7 : i);
+
+	/*
+	 * Write a 100 files and read them all back.
+	 */
+	assert((a = archive_write_new()) != NULL);
+	assertA(0 == archive_write_set_format_ustar(a));
+	r = archive_write_set_compression_lz4(a);
+	if (r == ARCHIVE_FATAL) {
+		skipping("lz4 writing not supported on this platform");
+		assertEqualInt(ARCHIVE_OK, archive_write_finish(a));
+		free(data);
+		free(buff);
+		return;
+	}
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_write_set_bytes_per_block(a, 10));
+	assertEqualInt(ARCHIVE_COMPRESSION_LZ4, archive_compression(a));
+	assertEqualString("lz4", archive_compression_name(a));
+	assertA(0 == archive_write_open_memory(a, buff, buffsize, &used1));
+	assertEqualInt(ARCHIVE_COMPRESSION_LZ4, archive_compression(a));
+	assertEqualString("lz4", archive_compression_name(a));
+	write_100(a, data, datasize);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_close(a));
+	assert(0 == archive_write_finish(a));
+	failure("default compression wrote %d bytes", (int)used1);
+	assert(used1 < 100 * datasize / 4);
+	read_100(buff, used1, data, datasize);
+
+	/*
+	 * Repeat the cycle again, this time setting some compression
+	 * options.
+	 */
+	assert((a = archive_write_new()) != NULL);
+	assertA(0 == archive_write_set_format_ustar(a));
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_write_set_bytes_per_block(a, 10));
+	assertA(0 == archive_write_set_compression_lz4(a));
+	assertEqualIntA(a, ARCHIVE_WARN,
+	    archive_write_set_compressor_options(a, "nonexistent-option=0"));
+	assertEqualIntA(a, ARCHIVE_WARN,
+	    archive_write_set_compressor_options(a, "compression-level=abc"));
+	assertEqualIntA(a, ARCHIVE_WARN,
+	    archive_write_set_compressor_options(a, "compression-level=13"));
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_write_set_compressor_options(a, "compression-level=12"));
+	assertA(0 == archive_write_open_memory(a, buff, buffsize, &used2));
+	write_100(a, data, datasize);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_close(a));
+	assert(0 == archive_write_finish(a));
+	read_100(buff, used2, data, datasize);
+
+	/*
+	 * Repeat again, with much lower compression and the default
+	 * block size, which is larger than the compressed data.
+	 */
+	assert((a = archive_write_new()) != NULL);
+	assertA(0 == archive_write_set_format_ustar(a));
+	assertA(0 == archive_write_set_compression_lz4(a));
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_write_set_compressor_options(a, "compression-level=0"));
+	assertA(0 == archive_write_open_memory(a, buff, buffsize, &used2));
+	write_100(a, data, datasize);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_close(a));
+	assert(0 == archive_write_finish(a));
+	read_100(buff, used2, data, datasize);
+
+	/*
+	 * Test various premature shutdown scenarios to make sure we
+	 * don't crash or leak memory.
+	 */
+	assert((a = archive_write_new()) != NULL);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_set_compression_lz4(a));
+	assertEqualInt(ARCHIVE_OK, archive_write_finish(a));
+
+	assert((a = archive_write_new()) != NULL);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_set_compression_lz4(a));
+	assertEqualInt(ARCHIVE_OK, archive_write_close(a));
+	assertEqualInt(ARCHIVE_OK, archive_write_finish(a));
+
+	assert((a = archive_write_new()) != NULL);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_set_format_ustar(a));
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_set_compression_lz4(a));
+	assertEqualInt(ARCHIVE_OK, archive_write_close(a));
+	assertEqualInt(ARCHIVE_OK, archive_write_finish(a));
+
+	assert((a = archive_write_new()) != NULL);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_set_format_ustar(a));
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_set_compression_lz4(a));
+	assertA(0 == archive_write_open_memory(a, buff, buffsize, &used2));
+	assertEqualInt(ARCHIVE_OK, archive_write_close(a));
+	assertEqualInt(ARCHIVE_OK, archive_write_finish(a));
+
+	/*
+	 * Clean up.
+	 */
+	free(data);
+	free(buff);
+}
@@ -0,0 +1,157 @@
+/*-
+ * Copyright (c) 2026 The libarchive Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "test.h"
+__FBSDID("$FreeBSD$");
+
+/*
+ * Write gzip and xz on several threads, with enough data for many
+ * blocks, and make sure it all reads back.
+ */
+
+#define	DATASIZE	(6 * 1024 * 1024)
+
+/* Text-like data that compresses, but not into nothing. */
+static void
+fill(char *data, size_t size)
+{
+	static const char *words[] = { "archive ", "entry ", "block ",
+	    "stream ", "deflate ", "thread ", "xz ", "\n" };
+	unsigned int seed = 12345;
+	size_t i = 0, n;
+	const char *w;
+
+	while (i < size) {
+		seed = seed * 1103515245 + 12345;
+		if ((seed >> 24) < 16) {
+			data[i++] = (char)(seed >> 8);
+			continue;
+		}
+		w = words[(seed >> 16) % 8];
+		n = strlen(w);
+		if (n > size - i)
+			n = size - i;
+		memcpy(data + i, w, n);
+		i += n;
+	}
+}
+
+static void
+write_and_verify(const char *name,
+    int (*set_compression)(struct archive *), int code,
+    const char *options, const char *data, char *buff, size_t buffsize)
+{
+	struct archive_entry *ae;
+	struct archive *a;
+	char *rbuff;
+	size_t used, total;
+	ssize_t n;
+	int i;
+
+	/* Three files, so the blocks don't line up with the entries. */
+	assert((a = archive_write_new()) != NULL);
+	assertA(0 == archive_write_set_format_ustar(a));
+	if (set_compression(a) != ARCHIVE_OK) {
+		skipping("%s writing not supported on this platform", name);
+		assertEqualInt(ARCHIVE_OK, archive_write_finish(a));
+		return;
+	}
+	assertEqualIntA(a, ARCHIVE_WARN,
+	    archive_write_set_compressor_options(a, "threads=abc"));
+	assertEqualIntA(a, ARCHIVE_WARN,
+	    archive_write_set_compressor_options(a, "threads=99999"));
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_write_set_compressor_options(a, options));
+	assertA(0 == archive_write_open_memory(a, buff, buffsize, &used));
+	assertEqualInt(code, archive_compression(a));
+	for (i = 0; i < 3; i++) {
+		char path[16];
+		sprintf(path, "file%d", i);
+		assert((ae = archive_entry_new()) != NULL);
+		archive_entry_copy_pathname(ae, path);
+		archive_entry_set_filetype(ae, AE_IFREG);
+		archive_entry_set_size(ae, DATASIZE - i * 1000);
+		assertA(0 == archive_write_header(a, ae));
+		assertEqualIntA(a, DATASIZE - i * 1000,
+		    archive_write_data(a, data + i * 1000, DATASIZE - i * 1000));
+		archive_entry_free(ae);
+	}
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_close(a));
+	assertEqualInt(ARCHIVE_OK, archive_write_finish(a));
+	failure("%s with %s wrote %d bytes", name, options, (int)used);
+	assert(used < DATASIZE);
+
+	assert((a = archive_read_new()) != NULL);
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_support_format_all(a));
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_read_support_compression_all(a));
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_open_memory(a, buff, used));
+	assert((rbuff = malloc(DATASIZE)) != NULL);
+	for (i = 0; i < 3; i++) {
+		if (!assertEqualIntA(a, ARCHIVE_OK,
+		    archive_read_next_header(a, &ae)))
+			break;
+		total = 0;
+		while ((n = archive_read_data(a, rbuff + total,
+		    DATASIZE - total)) > 0)
+			total += n;
+		assertEqualInt(0, n);
+		assertEqualInt(DATASIZE - i * 1000, total);
+		failure("%s: file%d doesn't match", name, i);
+		assert(memcmp(rbuff, data + i * 1000, total) == 0);
+	}
+	assertEqualIntA(a, ARCHIVE_EOF, archive_read_next_header(a, &ae));
+	assertEqualInt(code, archive_compression(a));
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_close(a));
+	assertEqualInt(ARCHIVE_OK, archive_read_finish(a));
+	free(rbuff);
+}
+
+DEFINE_TEST(test_write_compress_threads)
+{
+	char *buff, *data;
+	size_t buffsize;
+
+	buffsize = 4 * DATASIZE;
+	assert(NULL != (buff = (char *)malloc(buffsize)));
+	assert(NULL != (data = (char *)malloc(DATASIZE)));
+	fill(data, DATASIZE);
+
+	write_and_verify("gzip", archive_write_set_compression_gzip,
+	    ARCHIVE_COMPRESSION_GZIP, "threads=4", data, buff, buffsize);
+	/* Few blocks in flight, so the writer keeps waiting on the
+	 * oldest one. */
+	write_and_verify("gzip", archive_write_set_compression_gzip,
+	    ARCHIVE_COMPRESSION_GZIP, "threads=2", data, buff, buffsize);
+	/* Level 1 has a 1MiB dictionary, for 3MiB xz blocks. */
+	write_and_verify("xz", archive_write_set_compression_xz,
+	    ARCHIVE_COMPRESSION_XZ, "compression-level=1,threads=4",
+	    data, buff, buffsize);
+	write_and_verify("xz", archive_write_set_compression_xz,
+	    ARCHIVE_COMPRESSION_XZ, "compression-level=0,threads=0",
+	    data, buff, buffsize);
+
+	free(data);
+	free(buff);
+}
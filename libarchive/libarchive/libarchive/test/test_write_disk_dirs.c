@@ -0,0 +1,172 @@
+/*-
+ * Copyright (c) 2026 The libarchive Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "test.h"
+__FBSDID("$FreeBSD$");
+
+/*
+ * A single archive_write_disk object extracting many entries into
+ * shared dirs: with ARCHIVE_EXTRACT_SECURE_SYMLINKS, the dir verified
+ * for one entry is reused for the next, and dir fixups are batched at
+ * close.  None of that may change where things end up.
+ */
+
+static void
+file(struct archive *ad, const char *name)
+{
+	struct archive_entry *ae;
+
+	assert((ae = archive_entry_new()) != NULL);
+	archive_entry_copy_pathname(ae, name);
+	archive_entry_set_mode(ae, S_IFREG | 0644);
+	archive_entry_set_size(ae, 0);
+	failure("%s", name);
+	assertEqualIntA(ad, ARCHIVE_OK, archive_write_header(ad, ae));
+	assertEqualIntA(ad, ARCHIVE_OK, archive_write_finish_entry(ad));
+	archive_entry_free(ae);
+}
+
+static void
+dir(struct archive *ad, const char *name, int mode, time_t mtime)
+{
+	struct archive_entry *ae;
+
+	assert((ae = archive_entry_new()) != NULL);
+	archive_entry_copy_pathname(ae, name);
+	archive_entry_set_mode(ae, S_IFDIR | mode);
+	archive_entry_set_mtime(ae, mtime, 0);
+	failure("%s", name);
+	assertEqualIntA(ad, ARCHIVE_OK, archive_write_header(ad, ae));
+	assertEqualIntA(ad, ARCHIVE_OK, archive_write_finish_entry(ad));
+	archive_entry_free(ae);
+}
+
+DEFINE_TEST(test_write_disk_dirs)
+{
+#if defined(_WIN32) && !defined(__CYGWIN__)
+	skipping("symlink checks on Windows");
+#else
+	struct archive *ad;
+	struct archive_entry *ae;
+	char name[64];
+	int i;
+
+	assertUmask(022);
+	assertMakeDir("w1", 0755);
+	assertMakeDir("w2", 0755);
+	assertMakeDir("elsewhere", 0755);
+
+	assert((ad = archive_write_disk_new()) != NULL);
+	assertEqualIntA(ad, ARCHIVE_OK, archive_write_disk_set_options(ad,
+	    ARCHIVE_EXTRACT_SECURE_SYMLINKS | ARCHIVE_EXTRACT_SECURE_NODOTDOT));
+
+	/* Entries are relative to the cwd at the time of each header. */
+	assertChdir("w1");
+	file(ad, "a/b/f1");
+	file(ad, "a/b/f2");
+	assertChdir("../w2");
+	file(ad, "a/b/f3");
+	assertChdir("..");
+	file(ad, "w1/a/b/f4");
+	assertIsReg("w1/a/b/f1", -1);
+	assertIsReg("w1/a/b/f2", -1);
+	assertIsReg("w2/a/b/f3", -1);
+	assertFileNotExists("w1/a/b/f3");
+	assertIsReg("w1/a/b/f4", -1);
+
+	/* Siblings, cousins and deeper entries in any order. */
+	for (i = 0; i < 50; i++) {
+		sprintf(name, "t/d%d/e%d/f%d", i % 3, i % 5, i);
+		file(ad, name);
+	}
+	for (i = 0; i < 50; i++) {
+		sprintf(name, "t/d%d/e%d/f%d", i % 3, i % 5, i);
+		assertIsReg(name, -1);
+	}
+
+	/* An entry in the archive can still replace a symlink... */
+	file(ad, "s/d/f1");
+	assertMakeSymlink("s/link", "../elsewhere");
+	file(ad, "s/link");
+	assertIsReg("s/link", -1);
+	/* ...and can't extract through one. */
+	assertMakeSymlink("s/link2", "../elsewhere");
+	assert((ae = archive_entry_new()) != NULL);
+	archive_entry_copy_pathname(ae, "s/link2/f2");
+	archive_entry_set_mode(ae, S_IFREG | 0644);
+	assertEqualIntA(ad, ARCHIVE_FAILED, archive_write_header(ad, ae));
+	archive_entry_free(ae);
+	assertFileNotExists("elsewhere/f2");
+
+	/*
+	 * Someone swapping a dir for a symlink behind our back can't
+	 * redirect the next entry there.
+	 */
+	file(ad, "s/d/f3");
+	assertEqualInt(0, rename("s/d", "s/d.moved"));
+	assertMakeSymlink("s/d", "../elsewhere");
+	assert((ae = archive_entry_new()) != NULL);
+	archive_entry_copy_pathname(ae, "s/d/f4");
+	archive_entry_set_mode(ae, S_IFREG | 0644);
+	archive_entry_set_size(ae, 0);
+	archive_write_header(ad, ae);
+	archive_write_finish_entry(ad);
+	archive_entry_free(ae);
+	assertFileNotExists("elsewhere/f4");
+
+	assertEqualInt(ARCHIVE_OK, archive_write_finish(ad));
+
+	/*
+	 * Dir modes and times are fixed up at close, children before
+	 * parents, so restrictive modes don't get in the way.
+	 */
+	assert((ad = archive_write_disk_new()) != NULL);
+	assertEqualIntA(ad, ARCHIVE_OK, archive_write_disk_set_options(ad,
+	    ARCHIVE_EXTRACT_SECURE_SYMLINKS | ARCHIVE_EXTRACT_PERM
+	    | ARCHIVE_EXTRACT_TIME));
+	dir(ad, "m", 0555, 100000);
+	dir(ad, "m/x", 0500, 200000);
+	dir(ad, "m/x/y", 0555, 300000);
+	file(ad, "m/x/y/f");
+	dir(ad, "m/z", 0755, 400000);
+	dir(ad, "m/x/y2", 0700, 500000);
+	file(ad, "m/x/y2/f");
+	dir(ad, "m/x2", 0755, 600000);
+	assertEqualInt(ARCHIVE_OK, archive_write_finish(ad));
+	assertIsDir("m", 0555);
+	assertIsDir("m/x", 0500);
+	assertIsDir("m/x/y", 0555);
+	assertIsDir("m/x/y2", 0700);
+	assertIsDir("m/z", 0755);
+	assertFileMtime("m", 100000, 0);
+	assertFileMtime("m/x", 200000, 0);
+	assertFileMtime("m/x/y", 300000, 0);
+	assertFileMtime("m/z", 400000, 0);
+	assertFileMtime("m/x/y2", 500000, 0);
+	assertFileMtime("m/x2", 600000, 0);
+	/* Let the test harness clean up. */
+	assertEqualInt(0, chmod("m/x", 0755));
+	assertEqualInt(0, chmod("m", 0755));
+#endif
+}
@@ -0,0 +1,131 @@
+/*-
+ * Copyright (c) 2026 The libarchive Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "test.h"
+__FBSDID("$FreeBSD$");
+
+/*
+ * archive_write_disk remembers what the uid/gid lookup functions
+ * returned, so they should be called once per distinct owner rather
+ * than once per entry.
+ */
+
+static int uid_calls, gid_calls;
+
+static uid_t
+count_uid(void *private_data, const char *uname, uid_t uid)
+{
+	(void)private_data; /* UNUSED */
+	(void)uname; /* UNUSED */
+	(void)uid; /* UNUSED */
+	uid_calls++;
+	return (getuid());
+}
+
+static gid_t
+count_gid(void *private_data, const char *gname, gid_t gid)
+{
+	(void)private_data; /* UNUSED */
+	(void)gname; /* UNUSED */
+	(void)gid; /* UNUSED */
+	gid_calls++;
+	return (getgid());
+}
+
+static void
+extract(struct archive *ad, const char *name, const char *owner, int id)
+{
+	struct archive_entry *ae;
+
+	assert((ae = archive_entry_new()) != NULL);
+	archive_entry_copy_pathname(ae, name);
+	archive_entry_set_mode(ae, S_IFREG | 0644);
+	archive_entry_set_size(ae, 0);
+	if (owner != NULL) {
+		archive_entry_copy_uname(ae, owner);
+		archive_entry_copy_gname(ae, owner);
+	}
+	archive_entry_set_uid(ae, id);
+	archive_entry_set_gid(ae, id);
+	assertEqualIntA(ad, ARCHIVE_OK, archive_write_header(ad, ae));
+	assertEqualIntA(ad, ARCHIVE_OK, archive_write_finish_entry(ad));
+	archive_entry_free(ae);
+	assertIsReg(name, -1);
+}
+
+DEFINE_TEST(test_write_disk_lookup)
+{
+#if defined(_WIN32) && !defined(__CYGWIN__)
+	skipping("archive_write_disk lookup functions");
+#else
+	struct archive *ad;
+	char name[32];
+	int i;
+
+	assert((ad = archive_write_disk_new()) != NULL);
+	assertEqualIntA(ad, ARCHIVE_OK,
+	    archive_write_disk_set_options(ad, ARCHIVE_EXTRACT_OWNER));
+	assertEqualIntA(ad, ARCHIVE_OK,
+	    archive_write_disk_set_user_lookup(ad, NULL, count_uid, NULL));
+	assertEqualIntA(ad, ARCHIVE_OK,
+	    archive_write_disk_set_group_lookup(ad, NULL, count_gid, NULL));
+
+	/* Two owners, alternating, plus one entry without names. */
+	for (i = 0; i < 20; i++) {
+		sprintf(name, "file%d", i);
+		if (i % 2)
+			extract(ad, name, "alice", 1001);
+		else
+			extract(ad, name, "bob", 1002);
+	}
+	extract(ad, "file_noname", NULL, 1003);
+	extract(ad, "file_noname2", NULL, 1003);
+	assertEqualInt(3, uid_calls);
+	assertEqualInt(3, gid_calls);
+
+	/* The same name with a different id is a different question. */
+	extract(ad, "file_newid", "alice", 2001);
+	assertEqualInt(4, uid_calls);
+	assertEqualInt(4, gid_calls);
+
+	/* Installing a lookup function forgets the old answers. */
+	assertEqualIntA(ad, ARCHIVE_OK,
+	    archive_write_disk_set_user_lookup(ad, NULL, count_uid, NULL));
+	uid_calls = gid_calls = 0;
+	extract(ad, "file_again", "alice", 1001);
+	assertEqualInt(1, uid_calls);
+	assertEqualInt(0, gid_calls);
+
+	/* More owners than the cache holds: still correct, just slower. */
+	for (i = 0; i < 40; i++) {
+		char owner[16];
+		sprintf(name, "many%d", i);
+		sprintf(owner, "user%d", i % 20);
+		extract(ad, name, owner, 3000 + i % 20);
+	}
+	assert(uid_calls > 20);
+
+	assertEqualInt(ARCHIVE_OK, archive_write_finish(ad));
+#endif
+}
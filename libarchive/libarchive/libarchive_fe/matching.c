@@ -199,6 +199,35 @@ lafe_excluded(struct lafe_matching *matching, const char *pathname)
 	return (0);
 }
 
+/*
+ * True if lafe_excluded() would let pathname through, without
+ * counting the match; for deciding what to look at in the first place.
+ */
+int
+lafe_included(struct lafe_matching *matching, const char *pathname)
+{
+	struct match *match;
+
+	if (matching == NULL)
+		return (1);
+	for (match = matching->exclusions; match != NULL; match = match->next)
+		if (match_exclusion(match, pathname))
+			return (0);
+	if (matching->inclusions == NULL)
+		return (1);
+	for (match = matching->inclusions; match != NULL; match = match->next)
+		if (match_inclusion(match, pathname))
+			return (1);
+	return (0);
+}
+
+/* True if there are inclusion patterns, so most names won't match. */
+int
+lafe_has_inclusions(struct lafe_matching *matching)
+{
+	return (matching != NULL && matching->inclusions != NULL);
+}
+
 /*
  * This is a little odd, but it matches the default behavior of
  * gtar.  In particular, 'a*b' will match 'foo/a1111/222b/bar'
@@ -39,6 +39,8 @@ int	lafe_include_from_file(struct lafe_matching **matching,
 			       const char *pathname, int nullSeparator);
 
 int	lafe_excluded(struct lafe_matching *, const char *pathname);
+int	lafe_included(struct lafe_matching *, const char *pathname);
+int	lafe_has_inclusions(struct lafe_matching *);
 void	lafe_cleanup_exclusions(struct lafe_matching **);
 int	lafe_unmatched_inclusions(struct lafe_matching *);
 int	lafe_unmatched_inclusions_warn(struct lafe_matching *, const char *msg);
@@ -240,6 +240,9 @@ main(int argc, char **argv)
 		case OPTION_CHROOT: /* NetBSD */
 			bsdtar->option_chroot = 1;
 			break;
+		case OPTION_DECOMPRESS_THREAD:
+			bsdtar->option_decompress_thread = 1;
+			break;
 		case OPTION_DISABLE_COPYFILE:
 			bsdtar->disable_copyfile = 1;
 			break;
@@ -295,6 +298,12 @@ main(int argc, char **argv)
 				    "Failed to add %s to inclusion list",
 				    bsdtar->optarg);
 			break;
+		case OPTION_INDEX:
+			bsdtar->option_index = 1;
+			break;
+		case OPTION_INDEX_TRAILER:
+			bsdtar->option_index_trailer = 1;
+			break;
 		case 'j': /* GNU tar */
 			if (bsdtar->create_compression != '\0')
 				lafe_errc(1, 0,
@@ -322,6 +331,13 @@ main(int argc, char **argv)
 			/* GNU tar 1.13  used -l for --one-file-system */
 			bsdtar->option_warn_links = 1;
 			break;
+		case OPTION_LZ4:
+			if (bsdtar->create_compression != '\0')
+				lafe_errc(1, 0,
+				    "Can't specify both -%c and -%c", opt,
+				    bsdtar->create_compression);
+			bsdtar->create_compression = opt;
+			break;
 		case OPTION_LZMA:
 			if (bsdtar->create_compression != '\0')
 				lafe_errc(1, 0,
@@ -427,6 +443,13 @@ main(int argc, char **argv)
 		case 'r': /* SUSv2 */
 			set_mode(bsdtar, opt);
 			break;
+		case OPTION_READ_AHEAD:
+			t = atoi(bsdtar->optarg);
+			if (t < 0 || t > 64)
+				lafe_errc(1, 0,
+				    "Argument to --read-ahead is out of range (0..64)");
+			bsdtar->read_ahead = t;
+			break;
 		case 'S': /* NetBSD pax-as-tar */
 			bsdtar->extract_flags |= ARCHIVE_EXTRACT_SPARSE;
 			break;
@@ -512,6 +535,13 @@ main(int argc, char **argv)
 		case OPTION_USE_COMPRESS_PROGRAM:
 			bsdtar->compress_program = bsdtar->optarg;
 			break;
+		case OPTION_ZSTD:
+			if (bsdtar->create_compression != '\0')
+				lafe_errc(1, 0,
+				    "Can't specify both -%c and -%c", opt,
+				    bsdtar->create_compression);
+			bsdtar->create_compression = opt;
+			break;
 		default:
 			usage();
 		}
@@ -539,6 +569,10 @@ main(int argc, char **argv)
 		only_mode(bsdtar, "--fast-read", "xt");
 	if (bsdtar->option_honor_nodump)
 		only_mode(bsdtar, "--nodump", "cru");
+	if (bsdtar->option_index)
+		only_mode(bsdtar, "--index", "cxt");
+	if (bsdtar->option_index_trailer)
+		only_mode(bsdtar, "--index-trailer", "c");
 	if (option_o > 0) {
 		switch (bsdtar->mode) {
 		case 'c':
@@ -671,6 +705,7 @@ static const char *long_help_msg =
 	"Create: %p -c [options] [<file> | <dir> | @<archive> | -C <dir> ]\n"
 	"  <file>, <dir>  add these items to archive\n"
 	"  -z, -j, -J, --lzma  Compress archive with gzip/bzip2/xz/lzma\n"
+	"  --zstd, --lz4  Compress archive with zstd/lz4\n"
 	"  --format {ustar|pax|cpio|shar}  Select archive format\n"
 	"  --exclude <pattern>  Skip files that match pattern\n"
 	"  -C <dir>  Change to <dir> before processing remaining files\n"
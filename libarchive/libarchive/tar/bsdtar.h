@@ -54,16 +54,20 @@ struct bsdtar {
 	int		  verbose;   /* -v */
 	int		  extract_flags; /* Flags for extract operation */
 	int		  strip_components; /* Remove this many leading dirs */
+	int		  read_ahead; /* --read-ahead */
 	char		  mode; /* Program mode: 'c', 't', 'r', 'u', 'x' */
 	char		  symlink_mode; /* H or L, per BSD conventions */
 	char		  create_compression; /* j, y, or z */
 	const char	 *compress_program;
 	char		  option_absolute_paths; /* -P */
 	char		  option_chroot; /* --chroot */
+	char		  option_decompress_thread; /* --decompress-thread */
 	char		  option_dont_traverse_mounts; /* --one-file-system */
 	char		  option_fast_read; /* --fast-read */
 	const char	 *option_options; /* --options */
 	char		  option_honor_nodump; /* --nodump */
+	char		  option_index; /* --index */
+	char		  option_index_trailer; /* --index-trailer */
 	char		  option_interactive; /* -w */
 	char		  option_no_owner; /* -o */
 	char		  option_no_subdirs; /* -n */
@@ -99,9 +103,12 @@ struct bsdtar {
 	struct archive_dir	*archive_dir;	/* for write.c */
 	struct name_cache	*gname_cache;	/* for write.c */
 	char			*buff;		/* for write.c */
+	FILE			*index_file;	/* for write.c */
 	struct lafe_matching	*matching;	/* for matching.c */
 	struct security		*security;	/* for read.c */
 	struct name_cache	*uname_cache;	/* for write.c */
+	struct prefetch		*prefetch;	/* for write.c */
+	struct write_queue	*write_queue;	/* for write.c */
 	struct siginfo_data	*siginfo;	/* for siginfo.c */
 	struct substitution	*substitution;	/* for subst.c */
 };
@@ -110,13 +117,17 @@ struct bsdtar {
 enum {
 	OPTION_CHECK_LINKS = 1,
 	OPTION_CHROOT,
+	OPTION_DECOMPRESS_THREAD,
 	OPTION_DISABLE_COPYFILE,
 	OPTION_EXCLUDE,
 	OPTION_FORMAT,
 	OPTION_OPTIONS,
 	OPTION_HELP,
 	OPTION_INCLUDE,
+	OPTION_INDEX,
+	OPTION_INDEX_TRAILER,
 	OPTION_KEEP_NEWER_FILES,
+	OPTION_LZ4,
 	OPTION_LZMA,
 	OPTION_NEWER_CTIME,
 	OPTION_NEWER_CTIME_THAN,
@@ -129,11 +140,13 @@ enum {
 	OPTION_NUMERIC_OWNER,
 	OPTION_ONE_FILE_SYSTEM,
 	OPTION_POSIX,
+	OPTION_READ_AHEAD,
 	OPTION_SAME_OWNER,
 	OPTION_STRIP_COMPONENTS,
 	OPTION_TOTALS,
 	OPTION_USE_COMPRESS_PROGRAM,
-	OPTION_VERSION
+	OPTION_VERSION,
+	OPTION_ZSTD
 };
 
 
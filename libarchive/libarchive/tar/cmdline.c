@@ -75,6 +75,7 @@ static struct option {
 	{ "compress",             0, 'Z' },
 	{ "confirmation",         0, 'w' },
 	{ "create",               0, 'c' },
+	{ "decompress-thread",    0, OPTION_DECOMPRESS_THREAD },
 	{ "dereference",	  0, 'L' },
 	{ "directory",            1, 'C' },
 	{ "disable-copyfile",     0, OPTION_DISABLE_COPYFILE },
@@ -90,11 +91,14 @@ static struct option {
 	{ "gzip",                 0, 'z' },
 	{ "help",                 0, OPTION_HELP },
 	{ "include",              1, OPTION_INCLUDE },
+	{ "index",                0, OPTION_INDEX },
+	{ "index-trailer",        0, OPTION_INDEX_TRAILER },
 	{ "interactive",          0, 'w' },
 	{ "insecure",             0, 'P' },
 	{ "keep-newer-files",     0, OPTION_KEEP_NEWER_FILES },
 	{ "keep-old-files",       0, 'k' },
 	{ "list",                 0, 't' },
+	{ "lz4",                  0, OPTION_LZ4 },
 	{ "lzma",                 0, OPTION_LZMA },
 	{ "modification-time",    0, 'm' },
 	{ "newer",		  1, OPTION_NEWER_CTIME },
@@ -113,6 +117,7 @@ static struct option {
 	{ "one-file-system",	  0, OPTION_ONE_FILE_SYSTEM },
 	{ "posix",		  0, OPTION_POSIX },
 	{ "preserve-permissions", 0, 'p' },
+	{ "read-ahead",		  1, OPTION_READ_AHEAD },
 	{ "read-full-blocks",	  0, 'B' },
 	{ "same-owner",	          0, OPTION_SAME_OWNER },
 	{ "same-permissions",     0, 'p' },
@@ -127,6 +132,7 @@ static struct option {
 	{ "verbose",              0, 'v' },
 	{ "version",              0, OPTION_VERSION },
 	{ "xz",                   0, 'J' },
+	{ "zstd",                 0, OPTION_ZSTD },
 	{ NULL, 0, 0 }
 };
 
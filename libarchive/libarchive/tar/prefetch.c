@@ -0,0 +1,247 @@
+/*-
+ * Copyright (c) 2026 The libarchive Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bsdtar_platform.h"
+__FBSDID("$FreeBSD$");
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "err.h"
+#include "prefetch.h"
+
+struct prefetch_file {
+	struct prefetch_file	*next;	/* In the work queue or free list. */
+	int			 fd;
+	char			*buff;
+	size_t			 size;	/* Bytes wanted. */
+	ssize_t			 len;	/* Bytes read, or -1. */
+	int			 err;	/* errno if len is -1. */
+	int			 done;
+};
+
+struct prefetch {
+	size_t			 chunk;
+	/* Released files, with their buffers, for reuse. */
+	struct prefetch_file	*free_list;
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_t		 lock;
+	pthread_cond_t		 work;	/* File queued. */
+	pthread_cond_t		 done;	/* File read. */
+	pthread_t		*workers;
+	int			 nworkers;
+	int			 shutdown;
+	struct prefetch_file	*head, *tail;
+#endif
+};
+
+/* Fill f->buff from f->fd; runs on a worker without the lock held. */
+static void
+prefetch_read(struct prefetch_file *f)
+{
+	ssize_t bytes_read;
+
+	f->len = 0;
+	while ((size_t)f->len < f->size) {
+		bytes_read = read(f->fd, f->buff + f->len, f->size - f->len);
+		if (bytes_read < 0) {
+			if (errno == EINTR)
+				continue;
+			f->err = errno;
+			f->len = -1;
+			return;
+		}
+		if (bytes_read == 0)
+			break;
+		f->len += bytes_read;
+	}
+}
+
+#ifdef HAVE_PTHREAD_H
+static void *
+worker(void *arg)
+{
+	struct prefetch *p = arg;
+	struct prefetch_file *f;
+
+	pthread_mutex_lock(&p->lock);
+	for (;;) {
+		while (p->head == NULL && !p->shutdown)
+			pthread_cond_wait(&p->work, &p->lock);
+		if (p->head == NULL)
+			break;
+		f = p->head;
+		p->head = f->next;
+		if (p->head == NULL)
+			p->tail = NULL;
+		pthread_mutex_unlock(&p->lock);
+
+		prefetch_read(f);
+
+		pthread_mutex_lock(&p->lock);
+		f->done = 1;
+		pthread_cond_broadcast(&p->done);
+	}
+	pthread_mutex_unlock(&p->lock);
+	return (NULL);
+}
+#endif
+
+struct prefetch *
+prefetch_new(int threads, size_t chunk)
+{
+	struct prefetch *p;
+
+	if ((p = calloc(1, sizeof(*p))) == NULL)
+		lafe_errc(1, 0, "cannot allocate memory");
+	p->chunk = chunk;
+#ifdef HAVE_PTHREAD_H
+	if (threads > PREFETCH_MAX_THREADS)
+		threads = PREFETCH_MAX_THREADS;
+	pthread_mutex_init(&p->lock, NULL);
+	pthread_cond_init(&p->work, NULL);
+	pthread_cond_init(&p->done, NULL);
+	if (threads > 0 &&
+	    (p->workers = calloc(threads, sizeof(*p->workers))) == NULL)
+		lafe_errc(1, 0, "cannot allocate memory");
+	for (; p->nworkers < threads; p->nworkers++) {
+		if (pthread_create(&p->workers[p->nworkers], NULL,
+		    worker, p) != 0)
+			break;	/* Make do with what we have. */
+	}
+#else
+	(void)threads; /* UNUSED */
+#endif
+	return (p);
+}
+
+void
+prefetch_free(struct prefetch *p)
+{
+	struct prefetch_file *f;
+#ifdef HAVE_PTHREAD_H
+	int i;
+
+	pthread_mutex_lock(&p->lock);
+	p->shutdown = 1;
+	pthread_cond_broadcast(&p->work);
+	pthread_mutex_unlock(&p->lock);
+	for (i = 0; i < p->nworkers; i++)
+		pthread_join(p->workers[i], NULL);
+	free(p->workers);
+	pthread_cond_destroy(&p->done);
+	pthread_cond_destroy(&p->work);
+	pthread_mutex_destroy(&p->lock);
+#endif
+	while ((f = p->free_list) != NULL) {
+		p->free_list = f->next;
+		free(f->buff);
+		free(f);
+	}
+	free(p);
+}
+
+struct prefetch_file *
+prefetch_start(struct prefetch *p, int fd, int64_t size)
+{
+	struct prefetch_file *f;
+
+	/*
+	 * Buffers are recycled: allocating and touching a fresh
+	 * chunk for every file costs more than the read itself
+	 * when the data is already cached.
+	 */
+	if ((f = p->free_list) != NULL)
+		p->free_list = f->next;
+	else {
+		if ((f = malloc(sizeof(*f))) == NULL ||
+		    (f->buff = malloc(p->chunk)) == NULL)
+			lafe_errc(1, 0, "cannot allocate memory");
+	}
+	f->next = NULL;
+	f->fd = fd;
+	f->size = size < (int64_t)p->chunk ? (size_t)size : p->chunk;
+	f->done = 0;
+#ifdef HAVE_PTHREAD_H
+	if (p->nworkers > 0) {
+		pthread_mutex_lock(&p->lock);
+		if (p->tail == NULL)
+			p->head = f;
+		else
+			p->tail->next = f;
+		p->tail = f;
+		pthread_cond_signal(&p->work);
+		pthread_mutex_unlock(&p->lock);
+		return (f);
+	}
+#endif
+	prefetch_read(f);
+	f->done = 1;
+	return (f);
+}
+
+const void *
+prefetch_wait(struct prefetch *p, struct prefetch_file *f, ssize_t *len)
+{
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_lock(&p->lock);
+	while (!f->done)
+		pthread_cond_wait(&p->done, &p->lock);
+	pthread_mutex_unlock(&p->lock);
+#else
+	(void)p; /* UNUSED */
+#endif
+	*len = f->len;
+	if (f->len < 0)
+		errno = f->err;
+	return (f->buff);
+}
+
+void
+prefetch_release(struct prefetch *p, struct prefetch_file *f)
+{
+	ssize_t len;
+
+	/* The read must be finished before the buffer can be reused. */
+	prefetch_wait(p, f, &len);
+	f->next = p->free_list;
+	p->free_list = f;
+}
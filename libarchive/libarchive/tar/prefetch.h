@@ -0,0 +1,64 @@
+/*-
+ * Copyright (c) 2026 The libarchive Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * $FreeBSD$
+ */
+
+/*-
+ * Read-ahead of file contents for bsdtar -c.
+ *
+ * write.c opens each regular file as soon as the tree walk reaches it
+ * and hands the descriptor to prefetch_start().  A small pool of
+ * threads then reads the first part of each file while earlier
+ * entries are still being written, so that a slow or cold disk has
+ * several requests outstanding instead of one.  The writer collects
+ * the data, in archive order, with prefetch_wait(); the descriptor is
+ * left positioned just past it.  Without thread support the read
+ * happens in prefetch_start() itself.
+ */
+
+struct prefetch;
+struct prefetch_file;
+
+/* Most worker threads --read-ahead may ask for. */
+#define	PREFETCH_MAX_THREADS	64
+
+/* Start/stop the worker pool.  Reads up to 'chunk' bytes per file. */
+struct prefetch *prefetch_new(int /* threads */, size_t /* chunk */);
+void prefetch_free(struct prefetch *);
+
+/* Queue the first min(size, chunk) bytes of 'fd' to be read. */
+struct prefetch_file *prefetch_start(struct prefetch *, int /* fd */,
+    int64_t /* size */);
+
+/*
+ * Wait for the read to finish.  Returns the data and sets *len to its
+ * length, which is short at end-of-file.  If read() failed, *len is
+ * -1 and errno is set.
+ */
+const void *prefetch_wait(struct prefetch *, struct prefetch_file *,
+    ssize_t * /* len */);
+
+/* Release the buffer; the caller still owns the descriptor. */
+void prefetch_release(struct prefetch *, struct prefetch_file *);
@@ -97,6 +97,7 @@ struct copyfile_list_entry_t {
 static void	list_item_verbose(struct bsdtar *, FILE *,
 		    struct archive_entry *);
 static void	read_archive(struct bsdtar *bsdtar, char mode);
+static int	*index_candidates(struct bsdtar *, struct archive *);
 
 void
 tar_mode_t(struct bsdtar *bsdtar)
@@ -185,6 +186,7 @@ read_archive(struct bsdtar *bsdtar, char mode)
 #endif /* HAVE_QUARANTINE */
 	LIST_HEAD(copyfile_list_t, copyfile_list_entry_t) copyfile_list;
 	struct copyfile_list_entry_t *cle;
+	int			 *candidates, next_candidate = 0;
 
 	LIST_INIT(&copyfile_list);
 
@@ -205,11 +207,15 @@ read_archive(struct bsdtar *bsdtar, char mode)
 	archive_read_support_format_all(a);
 	if (ARCHIVE_OK != archive_read_set_options(a, bsdtar->option_options))
 		lafe_errc(1, 0, "%s", archive_error_string(a));
+	if (bsdtar->option_decompress_thread)
+		archive_read_set_decompression_thread(a, 1);
 	if (archive_read_open_file(a, bsdtar->filename,
 	    bsdtar->bytes_per_block != 0 ? bsdtar->bytes_per_block :
 	    DEFAULT_BYTES_PER_BLOCK))
 		lafe_errc(1, 0, "Error opening archive: %s",
 		    archive_error_string(a));
+	/* Before -C, which may make the .idx file's name meaningless. */
+	candidates = index_candidates(bsdtar, a);
 
 	do_chdir(bsdtar);
 
@@ -249,6 +255,17 @@ read_archive(struct bsdtar *bsdtar, char mode)
 		if (bsdtar->option_fast_read &&
 		    lafe_unmatched_inclusions(bsdtar->matching) == 0)
 			break;
+		/* With an index, go straight to the next likely member. */
+		if (candidates != NULL) {
+			if (candidates[next_candidate] < 0)
+				break;
+			if (archive_read_tar_seek_entry(a,
+			    candidates[next_candidate++]) != ARCHIVE_OK) {
+				lafe_warnc(0, "%s", archive_error_string(a));
+				bsdtar->return_value = 1;
+				break;
+			}
+		}
 
 		r = archive_read_next_header(a, &entry);
 		progress_data.entry = entry;
@@ -436,6 +453,7 @@ read_archive(struct bsdtar *bsdtar, char mode)
 		    archive_format_name(a), archive_compression_name(a));
 
 	archive_read_finish(a);
+	free(candidates);
 
 #ifdef HAVE_QUARANTINE
 	if (qf != NULL) {
@@ -446,6 +464,79 @@ read_archive(struct bsdtar *bsdtar, char mode)
 }
 
 
+/*
+ * --index: if only some names are wanted, look them up in the index
+ * written by bsdtar -c --index or --index-trailer, which is either in
+ * <archive>.idx or at the end of the archive.  Returns the numbers of
+ * the members worth reading, ending in -1, or NULL to read them all.
+ */
+static int *
+index_candidates(struct bsdtar *bsdtar, struct archive *a)
+{
+	struct stat st;
+	const char *p;
+	char *name, *buff = NULL;
+	size_t size = 0, len;
+	int *list, count, i, n, r;
+	FILE *f;
+
+	if (!bsdtar->option_index ||
+	    !lafe_has_inclusions(bsdtar->matching) ||
+	    bsdtar->filename == NULL || stat(bsdtar->filename, &st) != 0 ||
+	    !S_ISREG(st.st_mode))
+		return (NULL);
+
+	name = malloc(strlen(bsdtar->filename) + 5);
+	if (name == NULL)
+		lafe_errc(1, ENOMEM, "Can't allocate memory");
+	strcpy(name, bsdtar->filename);
+	strcat(name, ".idx");
+	if ((f = fopen(name, "rb")) != NULL) {
+		if (fstat(fileno(f), &st) != 0 ||
+		    (buff = malloc(st.st_size + 1)) == NULL ||
+		    (size = fread(buff, 1, st.st_size, f))
+		    != (size_t)st.st_size)
+			lafe_errc(1, errno, "%s", name);
+		fclose(f);
+	}
+	free(name);
+	/* Without a file, look for the index at the end. */
+	r = archive_read_tar_index_load(a, buff, size);
+	free(buff);
+	if (r == ARCHIVE_FATAL)
+		lafe_errc(1, 0, "%s", archive_error_string(a));
+	if (r != ARCHIVE_OK) {
+		lafe_warnc(0, "Not using an index: %s",
+		    archive_error_string(a));
+		return (NULL);
+	}
+
+	count = archive_read_tar_entry_count(a);
+	list = malloc((count + 1) * sizeof(*list));
+	if (list == NULL)
+		lafe_errc(1, ENOMEM, "Can't allocate memory");
+	name = NULL;
+	for (i = n = 0; i < count; i++) {
+		p = archive_read_tar_entry_name(a, i);
+		len = strlen(p);
+		if (lafe_included(bsdtar->matching, p)) {
+			list[n++] = i;
+			continue;
+		}
+		/* The index drops the slash that a pattern may have. */
+		name = realloc(name, len + 2);
+		if (name == NULL)
+			lafe_errc(1, ENOMEM, "Can't allocate memory");
+		memcpy(name, p, len);
+		strcpy(name + len, "/");
+		if (lafe_included(bsdtar->matching, name))
+			list[n++] = i;
+	}
+	free(name);
+	list[n] = -1;
+	return (list);
+}
+
 /*
  * Display information about the current file.
  *
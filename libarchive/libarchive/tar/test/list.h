@@ -7,6 +7,7 @@ DEFINE_TEST(test_help)
 DEFINE_TEST(test_option_T_upper)
 DEFINE_TEST(test_option_q)
 DEFINE_TEST(test_option_r)
+DEFINE_TEST(test_option_read_ahead)
 DEFINE_TEST(test_option_s)
 DEFINE_TEST(test_patterns)
 DEFINE_TEST(test_stdio)
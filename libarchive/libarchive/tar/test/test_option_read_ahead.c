@@ -0,0 +1,133 @@
+/*-
+ * Copyright (c) 2026 The libarchive Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "test.h"
+__FBSDID("$FreeBSD$");
+
+/*
+ * --read-ahead only changes when files are read, never what is
+ * written: the archive must be byte-for-byte the same as without it.
+ * The tree has more files than read-ahead keeps open at once, files
+ * larger than what it reads ahead, empty files and a hard link.
+ */
+
+#define	NDIRS	3
+#define	NFILES	50
+
+static void
+make_file(const char *path, size_t size, unsigned int seed)
+{
+	FILE *f;
+	size_t i;
+
+	f = fopen(path, "wb");
+	if (!assert(f != NULL))
+		return;
+	for (i = 0; i < size; i++) {
+		seed = seed * 1103515245 + 12345;
+		putc((int)(seed >> 16) & 0xff, f);
+	}
+	fclose(f);
+}
+
+DEFINE_TEST(test_option_read_ahead)
+{
+	char path[64];
+	size_t size;
+	int d, i;
+
+	assertMakeDir("in", 0755);
+	for (d = 0; d < NDIRS; d++) {
+		sprintf(path, "in/d%d", d);
+		assertMakeDir(path, 0755);
+		for (i = 0; i < NFILES; i++) {
+			sprintf(path, "in/d%d/f%02d", d, i);
+			if (i % 10 == 0)
+				size = 0;
+			else if (i % 17 == 0)
+				size = 300 * 1024 + i;
+			else
+				size = i * 1000 + d;
+			make_file(path, size, d * NFILES + i);
+		}
+	}
+	assertMakeHardlink("in/d1/link", "in/d0/f01");
+
+	/* ustar, so that atimes changed by the reads aren't stored. */
+	assertEqualInt(0, systemf("%s -cf ra0.tar --format ustar "
+	    "--read-ahead 0 in >ra0.out 2>ra0.err", testprog));
+	assertEmptyFile("ra0.out");
+	assertEmptyFile("ra0.err");
+
+	assertEqualInt(0, systemf("%s -cf ra1.tar --format ustar "
+	    "--read-ahead 1 in >ra1.out 2>ra1.err", testprog));
+	assertEmptyFile("ra1.err");
+	assertEqualFile("ra1.tar", "ra0.tar");
+
+	assertEqualInt(0, systemf("%s -cf ra4.tar --format ustar "
+	    "--read-ahead 4 in >ra4.out 2>ra4.err", testprog));
+	assertEmptyFile("ra4.err");
+	assertEqualFile("ra4.tar", "ra0.tar");
+
+#if !defined(_WIN32) || defined(__CYGWIN__)
+	/*
+	 * The deepest queue, in a process that couldn't hold one
+	 * descriptor per queued entry.
+	 */
+	assertEqualInt(0, systemf("ulimit -n 64 && %s -cf ra64.tar "
+	    "--format ustar --read-ahead 64 in >ra64.out 2>ra64.err",
+	    testprog));
+	assertEmptyFile("ra64.err");
+	assertEqualFile("ra64.tar", "ra0.tar");
+#endif
+
+	/*
+	 * The members of an @archive argument go where it is on the
+	 * command line, not ahead of the files still being read ahead.
+	 */
+	assertEqualInt(0, systemf("%s -cf d1.tar --format ustar in/d1 "
+	    ">d1.out 2>d1.err", testprog));
+	assertEmptyFile("d1.err");
+	assertEqualInt(0, systemf("%s -cf mix0.tar --format ustar "
+	    "--read-ahead 0 in/d0 @d1.tar in/d2 >mix0.out 2>mix0.err",
+	    testprog));
+	assertEmptyFile("mix0.err");
+	assertEqualInt(0, systemf("%s -tf mix0.tar >mix0.list 2>mix0.lerr",
+	    testprog));
+	assertEmptyFile("mix0.lerr");
+	assertEqualInt(0, systemf("%s -cf dirs.tar --format ustar "
+	    "--read-ahead 0 in/d0 in/d1 in/d2 >dirs.out 2>dirs.err",
+	    testprog));
+	assertEmptyFile("dirs.err");
+	assertEqualInt(0, systemf("%s -tf dirs.tar >dirs.list 2>dirs.lerr",
+	    testprog));
+	assertEmptyFile("dirs.lerr");
+	assertEqualFile("mix0.list", "dirs.list");
+
+	assertEqualInt(0, systemf("%s -cf mix4.tar --format ustar "
+	    "--read-ahead 4 in/d0 @d1.tar in/d2 >mix4.out 2>mix4.err",
+	    testprog));
+	assertEmptyFile("mix4.err");
+	assertEqualFile("mix4.tar", "mix0.tar");
+}
@@ -35,6 +35,9 @@ __FBSDID("$FreeBSD: src/usr.bin/tar/write.c,v 1.79 2008/11/27 05:49:52 kientzle
 #ifdef HAVE_SYS_STAT_H
 #include <sys/stat.h>
 #endif
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
 #ifdef HAVE_ATTR_XATTR_H
 #include <attr/xattr.h>
 #endif
@@ -80,6 +83,7 @@ __FBSDID("$FreeBSD: src/usr.bin/tar/write.c,v 1.79 2008/11/27 05:49:52 kientzle
 #ifdef HAVE_STRING_H
 #include <string.h>
 #endif
+#include <time.h>
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
 #endif
@@ -92,6 +96,7 @@ __FBSDID("$FreeBSD: src/usr.bin/tar/write.c,v 1.79 2008/11/27 05:49:52 kientzle
 #include "bsdtar.h"
 #include "err.h"
 #include "line_reader.h"
+#include "prefetch.h"
 #include "tree.h"
 
 /* Size of buffer for holding file data prior to writing. */
@@ -100,6 +105,19 @@ __FBSDID("$FreeBSD: src/usr.bin/tar/write.c,v 1.79 2008/11/27 05:49:52 kientzle
 /* Fixed size of uname/gname caches. */
 #define	name_cache_size 101
 
+/* How much of each file --read-ahead reads before it is written. */
+#define	PREFETCH_CHUNK	(256 * 1024)
+/* How many entries may be waiting to be written, per read-ahead thread. */
+#define	PREFETCH_DEPTH	8
+/*
+ * How many of the waiting entries may hold an open file, whatever the
+ * depth; well under the smallest common RLIMIT_NOFILE default (256).
+ */
+#define	PREFETCH_MAX_OPEN	32
+
+/* How much tar data --index lets pass between compression restarts. */
+#define	INDEX_RESTART_INTERVAL	(1024 * 1024)
+
 #ifndef O_BINARY
 #define O_BINARY 0
 #endif
@@ -117,6 +135,38 @@ struct archive_dir {
 	struct archive_dir_entry *head, *tail;
 };
 
+/*
+ * Entries are written in the order the tree walk produces them, but
+ * with --read-ahead they wait in a short queue first.  Each file is
+ * opened when it is queued, while the walk is still in the right
+ * directory, and the prefetch pool starts reading it.  Once
+ * PREFETCH_MAX_OPEN queued files are open, the oldest entries are
+ * written out before another file is opened.
+ */
+struct pending_file {
+	struct archive_entry	*entry;
+	int			 fd;
+	int			 open_errno;
+	struct prefetch_file	*prefetch;
+};
+
+struct pending {
+	struct pending		*next;
+	char			*verbose_name;	/* For -v, or NULL. */
+	int			 nfiles;
+	struct pending_file	 files[2];	/* linkify() gives up to 2. */
+};
+
+struct write_queue {
+	struct pending		*head, *tail;
+	int			 count;
+	int			 depth;
+	int			 open_files;
+	/* For --totals. */
+	int64_t			 bytes_read;
+	int			 files_read;
+};
+
 struct name_cache {
 	int	probes;
 	int	hits;
@@ -129,6 +179,13 @@ struct name_cache {
 
 static void		 add_dir_list(struct bsdtar *bsdtar, const char *path,
 			     time_t mtime_sec, int mtime_nsec);
+static void		 flush_pending(struct bsdtar *, struct archive *);
+static void		 open_pending_file(struct bsdtar *,
+			     struct pending_file *);
+static double		 now(void);
+static void		 queue_entries(struct bsdtar *, struct archive *,
+			     struct archive_entry *, struct archive_entry *,
+			     char *verbose_name);
 static int		 append_archive(struct bsdtar *, struct archive *,
 			     struct archive *ina);
 static int		 append_archive_filename(struct bsdtar *,
@@ -143,10 +200,15 @@ static void		 report_write(struct bsdtar *, struct archive *,
 			     struct archive_entry *, int64_t progress);
 static void		 test_for_append(struct bsdtar *);
 static void		 write_archive(struct archive *, struct bsdtar *);
+static void		 write_index(struct bsdtar *, struct archive *);
 static void		 write_entry_backend(struct bsdtar *, struct archive *,
 			     struct archive_entry *);
+static void		 write_oldest(struct bsdtar *, struct archive *);
 static int		 write_file_data(struct bsdtar *, struct archive *,
-			     struct archive_entry *, int fd);
+			     struct archive_entry *, int fd,
+			     struct prefetch_file *);
+static void		 write_pending_file(struct bsdtar *, struct archive *,
+			     struct pending_file *);
 static void		 write_hierarchy(struct bsdtar *, struct archive *,
 			     const char *);
 
@@ -218,6 +280,9 @@ tar_mode_c(struct bsdtar *bsdtar)
 		case 'J':
 			r = archive_write_set_compression_xz(a);
 			break;
+		case OPTION_LZ4:
+			r = archive_write_set_compression_lz4(a);
+			break;
 		case OPTION_LZMA:
 			r = archive_write_set_compression_lzma(a);
 			break;
@@ -227,6 +292,9 @@ tar_mode_c(struct bsdtar *bsdtar)
 		case 'Z':
 			r = archive_write_set_compression_compress(a);
 			break;
+		case OPTION_ZSTD:
+			r = archive_write_set_compression_zstd(a);
+			break;
 		default:
 			lafe_errc(1, 0,
 			    "Unrecognized compression option -%c",
@@ -241,6 +309,28 @@ tar_mode_c(struct bsdtar *bsdtar)
 
 	if (ARCHIVE_OK != archive_write_set_options(a, bsdtar->option_options))
 		lafe_errc(1, 0, "%s", archive_error_string(a));
+	if (bsdtar->option_index) {
+		char *name;
+
+		if (bsdtar->filename == NULL ||
+		    strcmp(bsdtar->filename, "-") == 0)
+			lafe_errc(1, 0, "--index needs an archive file (-f)");
+		name = malloc(strlen(bsdtar->filename) + 5);
+		if (name == NULL)
+			lafe_errc(1, ENOMEM, "Can't allocate memory");
+		strcpy(name, bsdtar->filename);
+		strcat(name, ".idx");
+		if ((bsdtar->index_file = fopen(name, "wb")) == NULL)
+			lafe_errc(1, errno, "%s", name);
+		free(name);
+	}
+	if (bsdtar->option_index || bsdtar->option_index_trailer) {
+		if (archive_write_set_tar_index(a,
+		    bsdtar->option_index_trailer ?
+		    ARCHIVE_TAR_INDEX_TRAILER : 0,
+		    INDEX_RESTART_INTERVAL) != ARCHIVE_OK)
+			lafe_errc(1, 0, "%s", archive_error_string(a));
+	}
 	if (ARCHIVE_OK != archive_write_open_file(a, bsdtar->filename))
 		lafe_errc(1, 0, "%s", archive_error_string(a));
 	write_archive(a, bsdtar);
@@ -444,6 +534,7 @@ write_archive(struct archive *a, struct bsdtar *bsdtar)
 {
 	const char *arg;
 	struct archive_entry *entry, *sparse_entry;
+	double start, elapsed;
 
 	/* Allocate a buffer for file data. */
 	if ((bsdtar->buff = malloc(FILEDATABUFLEN)) == NULL)
@@ -457,6 +548,22 @@ write_archive(struct archive *a, struct bsdtar *bsdtar)
 		lafe_errc(1, 0, "Cannot create read_disk object");
 	archive_read_disk_set_standard_lookup(bsdtar->diskreader);
 
+	if ((bsdtar->write_queue = calloc(1, sizeof(*bsdtar->write_queue)))
+	    == NULL)
+		lafe_errc(1, 0, "cannot allocate memory");
+	/*
+	 * Read-ahead is off unless asked for: with a warm cache the
+	 * thread handoffs cost more than they save.  -w has to ask
+	 * about each file as it is reached, so it never reads ahead.
+	 */
+	if (bsdtar->read_ahead > 0 && !bsdtar->option_interactive) {
+		bsdtar->prefetch = prefetch_new(bsdtar->read_ahead,
+		    PREFETCH_CHUNK);
+		bsdtar->write_queue->depth =
+		    bsdtar->read_ahead * PREFETCH_DEPTH;
+	}
+	start = now();
+
 	if (bsdtar->names_from_file != NULL)
 		archive_names_from_file(bsdtar, a);
 
@@ -487,6 +594,7 @@ write_archive(struct archive *a, struct bsdtar *bsdtar)
 		}
 		bsdtar->argv++;
 	}
+	flush_pending(bsdtar, a);
 
 	entry = NULL;
 	archive_entry_linkify(bsdtar->resolver, &entry, &sparse_entry);
@@ -500,9 +608,17 @@ write_archive(struct archive *a, struct bsdtar *bsdtar)
 	if (archive_write_close(a)) {
 		lafe_warnc(0, "%s", archive_error_string(a));
 		bsdtar->return_value = 1;
-	}
+	} else if (bsdtar->index_file != NULL)
+		write_index(bsdtar, a);
 
 cleanup:
+	if (bsdtar->index_file != NULL)
+		fclose(bsdtar->index_file);
+	bsdtar->index_file = NULL;
+	flush_pending(bsdtar, a);
+	if (bsdtar->prefetch != NULL)
+		prefetch_free(bsdtar->prefetch);
+	bsdtar->prefetch = NULL;
 	/* Free file data buffer. */
 	free(bsdtar->buff);
 	archive_entry_linkresolver_free(bsdtar->resolver);
@@ -513,11 +629,41 @@ cleanup:
 	if (bsdtar->option_totals) {
 		fprintf(stderr, "Total bytes written: %s\n",
 		    tar_i64toa(archive_position_compressed(a)));
+		elapsed = now() - start;
+		fprintf(stderr, "Read %d files, %s bytes in %.2f seconds",
+		    bsdtar->write_queue->files_read,
+		    tar_i64toa(bsdtar->write_queue->bytes_read), elapsed);
+		if (elapsed > 0)
+			fprintf(stderr, " (%.1f MB/s)",
+			    bsdtar->write_queue->bytes_read / elapsed / 1000000);
+		fprintf(stderr, "\n");
 	}
+	free(bsdtar->write_queue);
+	bsdtar->write_queue = NULL;
 
 	archive_write_finish(a);
 }
 
+/*
+ * --index: store the archive's index next to it, in the file that
+ * tar_mode_c() opened before any -C.
+ */
+static void
+write_index(struct bsdtar *bsdtar, struct archive *a)
+{
+	const void *buff;
+	size_t size;
+
+	if (archive_write_get_tar_index(a, &buff, &size) != ARCHIVE_OK) {
+		lafe_warnc(0, "%s", archive_error_string(a));
+		bsdtar->return_value = 1;
+	} else if (fwrite(buff, 1, size, bsdtar->index_file) != size ||
+	    fflush(bsdtar->index_file) != 0) {
+		lafe_warnc(errno, "Can't write index");
+		bsdtar->return_value = 1;
+	}
+}
+
 /*
  * Archive names specified in file.
  *
@@ -597,6 +743,8 @@ append_archive(struct bsdtar *bsdtar, struct archive *a, struct archive *ina)
 	struct archive_entry *in_entry;
 	int e;
 
+	/* The entries copied below go after everything queued so far. */
+	flush_pending(bsdtar, a);
 	while (0 == archive_read_next_header(ina, &in_entry)) {
 		if (!new_enough(bsdtar, archive_entry_pathname(in_entry),
 			archive_entry_stat(in_entry)))
@@ -675,6 +823,7 @@ write_hierarchy(struct bsdtar *bsdtar, struct archive *a, const char *path)
 {
 	struct archive_entry *entry = NULL, *spare_entry = NULL;
 	struct tree *tree;
+	char *verbose_name = NULL;
 	char symlink_mode = bsdtar->symlink_mode;
 	dev_t first_dev = 0;
 	int dev_recorded = 0;
@@ -917,6 +1066,7 @@ write_hierarchy(struct bsdtar *bsdtar, struct archive *a, const char *path)
 					archive_entry_set_pathname(entry_p, copyfile_fname);
 					archive_entry_copy_sourcepath(entry_p, md_p);
 					archive_read_disk_entry_from_file(bsdtar->diskreader, entry_p, -1, &copyfile_stat);
+					flush_pending(bsdtar, a);
 					write_entry_backend(bsdtar, a, entry_p);
 					archive_entry_free(entry_p);
 
@@ -929,32 +1079,133 @@ write_hierarchy(struct bsdtar *bsdtar, struct archive *a, const char *path)
 		}
 #endif
 
-		/* Display entry as we process it.
-		 * This format is required by SUSv2. */
-		if (bsdtar->verbose)
-			safe_fprintf(stderr, "a %s",
-			    archive_entry_pathname(entry));
-
 		/* Non-regular files get archived with zero size. */
 		if (archive_entry_filetype(entry) != AE_IFREG)
 			archive_entry_set_size(entry, 0);
 
-		archive_entry_linkify(bsdtar->resolver, &entry, &spare_entry);
+		if (bsdtar->verbose)
+			verbose_name = strdup(archive_entry_pathname(entry));
 
-		while (entry != NULL) {
-			write_entry_backend(bsdtar, a, entry);
-			archive_entry_free(entry);
-			entry = spare_entry;
-			spare_entry = NULL;
-		}
+		archive_entry_linkify(bsdtar->resolver, &entry, &spare_entry);
 
-		if (bsdtar->verbose)
-			fprintf(stderr, "\n");
+		/* The queue takes the entries. */
+		queue_entries(bsdtar, a, entry, spare_entry, verbose_name);
+		entry = NULL;
+		spare_entry = NULL;
+		verbose_name = NULL;
 	}
 	archive_entry_free(entry);
 	tree_close(tree);
 }
 
+/*
+ * Open a file that is about to be queued, and start reading it.
+ */
+static void
+open_pending_file(struct bsdtar *bsdtar, struct pending_file *pf)
+{
+	pf->fd = -1;
+	pf->open_errno = 0;
+	pf->prefetch = NULL;
+	if (archive_entry_size(pf->entry) > 0) {
+		pf->fd = open(archive_entry_sourcepath(pf->entry),
+		    O_RDONLY | O_BINARY);
+		if (pf->fd == -1) {
+			pf->open_errno = errno;
+			return;
+		}
+		if (bsdtar->prefetch != NULL)
+			pf->prefetch = prefetch_start(bsdtar->prefetch, pf->fd,
+			    archive_entry_size(pf->entry));
+	}
+}
+
+/*
+ * Queue the entries for one file; write out the oldest ones once
+ * the queue is deeper than --read-ahead allows.  The queue takes
+ * ownership of the entries and of verbose_name.
+ */
+static void
+queue_entries(struct bsdtar *bsdtar, struct archive *a,
+    struct archive_entry *entry, struct archive_entry *spare_entry,
+    char *verbose_name)
+{
+	struct write_queue *q = bsdtar->write_queue;
+	struct pending *p;
+	int i, nopen;
+
+	if ((p = calloc(1, sizeof(*p))) == NULL)
+		lafe_errc(1, 0, "cannot allocate memory");
+	p->verbose_name = verbose_name;
+	if (entry != NULL)
+		p->files[p->nfiles++].entry = entry;
+	if (spare_entry != NULL)
+		p->files[p->nfiles++].entry = spare_entry;
+
+	/* Make room for the descriptors this entry will hold. */
+	nopen = 0;
+	for (i = 0; i < p->nfiles; i++)
+		if (archive_entry_size(p->files[i].entry) > 0)
+			nopen++;
+	while (q->head != NULL && q->open_files + nopen > PREFETCH_MAX_OPEN)
+		write_oldest(bsdtar, a);
+	for (i = 0; i < p->nfiles; i++) {
+		open_pending_file(bsdtar, &p->files[i]);
+		if (p->files[i].fd >= 0)
+			q->open_files++;
+	}
+
+	if (q->tail == NULL)
+		q->head = p;
+	else
+		q->tail->next = p;
+	q->tail = p;
+	q->count++;
+
+	while (q->count > q->depth)
+		write_oldest(bsdtar, a);
+}
+
+/*
+ * Write out everything that is queued, before something else is
+ * written to the archive.
+ */
+static void
+flush_pending(struct bsdtar *bsdtar, struct archive *a)
+{
+	while (bsdtar->write_queue->head != NULL)
+		write_oldest(bsdtar, a);
+}
+
+static void
+write_oldest(struct bsdtar *bsdtar, struct archive *a)
+{
+	struct write_queue *q = bsdtar->write_queue;
+	struct pending *p;
+	int i;
+
+	p = q->head;
+	q->head = p->next;
+	if (q->head == NULL)
+		q->tail = NULL;
+	q->count--;
+
+	/* Display entry as we process it.
+	 * This format is required by SUSv2. */
+	if (p->verbose_name != NULL)
+		safe_fprintf(stderr, "a %s", p->verbose_name);
+	for (i = 0; i < p->nfiles; i++) {
+		if (p->files[i].fd >= 0)
+			q->open_files--;
+		write_pending_file(bsdtar, a, &p->files[i]);
+		archive_entry_free(p->files[i].entry);
+	}
+	if (p->verbose_name != NULL)
+		fprintf(stderr, "\n");
+	free(p->verbose_name);
+	free(p);
+}
+
 /*
  * Backend for write_entry.
  */
@@ -962,20 +1213,29 @@ static void
 write_entry_backend(struct bsdtar *bsdtar, struct archive *a,
     struct archive_entry *entry)
 {
-	int fd = -1;
+	struct pending_file pf;
+
+	pf.entry = entry;
+	open_pending_file(bsdtar, &pf);
+	write_pending_file(bsdtar, a, &pf);
+}
+
+static void
+write_pending_file(struct bsdtar *bsdtar, struct archive *a,
+    struct pending_file *pf)
+{
+	struct archive_entry *entry = pf->entry;
+	int fd = pf->fd;
 	int e;
 
-	if (archive_entry_size(entry) > 0) {
-		const char *pathname = archive_entry_sourcepath(entry);
-		fd = open(pathname, O_RDONLY | O_BINARY);
-		if (fd == -1) {
-			if (!bsdtar->verbose)
-				lafe_warnc(errno,
-				    "%s: could not open file", pathname);
-			else
-				fprintf(stderr, ": %s", strerror(errno));
-			return;
-		}
+	if (pf->open_errno != 0) {
+		if (!bsdtar->verbose)
+			lafe_warnc(pf->open_errno,
+			    "%s: could not open file",
+			    archive_entry_sourcepath(entry));
+		else
+			fprintf(stderr, ": %s", strerror(pf->open_errno));
+		goto done;
 	}
 
 	e = archive_write_header(a, entry);
@@ -998,14 +1258,17 @@ write_entry_backend(struct bsdtar *bsdtar, struct archive *a,
 	 * that case, just skip the write.
 	 */
 	if (e >= ARCHIVE_WARN && fd >= 0 && archive_entry_size(entry) > 0) {
-		if (write_file_data(bsdtar, a, entry, fd))
+		if (write_file_data(bsdtar, a, entry, fd, pf->prefetch))
 			exit(1);
 	}
 
+done:
 	/*
 	 * If we opened a file, close it now even if there was an error
 	 * which made us decide not to write the archive body.
 	 */
+	if (pf->prefetch != NULL)
+		prefetch_release(bsdtar->prefetch, pf->prefetch);
 	if (fd >= 0)
 		close(fd);
 }
@@ -1036,19 +1299,26 @@ report_write(struct bsdtar *bsdtar, struct archive *a,
 /* Helper function to copy file to archive. */
 static int
 write_file_data(struct bsdtar *bsdtar, struct archive *a,
-    struct archive_entry *entry, int fd)
+    struct archive_entry *entry, int fd, struct prefetch_file *prefetch)
 {
+	const void *buff;
 	ssize_t	bytes_read;
 	ssize_t	bytes_written;
 	int64_t	progress = 0;
 
-	bytes_read = read(fd, bsdtar->buff, FILEDATABUFLEN);
+	/* Start with whatever was read ahead; the fd is just past it. */
+	bsdtar->write_queue->files_read++;
+	if (prefetch != NULL)
+		buff = prefetch_wait(bsdtar->prefetch, prefetch, &bytes_read);
+	else {
+		buff = bsdtar->buff;
+		bytes_read = read(fd, bsdtar->buff, FILEDATABUFLEN);
+	}
 	while (bytes_read > 0) {
 		if (need_report())
 			report_write(bsdtar, a, entry, progress);
 
-		bytes_written = archive_write_data(a, bsdtar->buff,
-		    bytes_read);
+		bytes_written = archive_write_data(a, buff, bytes_read);
 		if (bytes_written < 0) {
 			/* Write failed; this is bad */
 			lafe_warnc(0, "%s", archive_error_string(a));
@@ -1059,14 +1329,30 @@ write_file_data(struct bsdtar *bsdtar, struct archive *a,
 			lafe_warnc(0,
 			    "%s: Truncated write; file may have grown while being archived.",
 			    archive_entry_pathname(entry));
+			bsdtar->write_queue->bytes_read += progress + bytes_written;
 			return (0);
 		}
 		progress += bytes_written;
+		buff = bsdtar->buff;
 		bytes_read = read(fd, bsdtar->buff, FILEDATABUFLEN);
 	}
+	bsdtar->write_queue->bytes_read += progress;
 	return 0;
 }
 
+static double
+now(void)
+{
+#ifdef HAVE_SYS_TIME_H
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (tv.tv_sec + tv.tv_usec / 1000000.0);
+#else
+	return (time(NULL));
+#endif
+}
+
 /*
  * Test if the specified file is new enough to include in the archive.
  */
@@ -21,6 +21,10 @@
    don't. */
 #define HAVE_DECL_FD_COPY 1
 
+/* Define to 1 if you have the declaration of `IORING_FEAT_RW_CUR_POS', and to
+   0 if you don't. */
+#define HAVE_DECL_IORING_FEAT_RW_CUR_POS 0
+
 /* Define to 1 if you have the declaration of `NOTE_LOWAT', and to 0 if you
    don't. */
 #define HAVE_DECL_NOTE_LOWAT 1
@@ -151,6 +155,12 @@
 /* Define to 1 if you have the `pthread_workqueue_setdispatch_np' function. */
 #define HAVE_PTHREAD_WORKQUEUE_SETDISPATCH_NP 1
 
+/* Define to 1 if you have the `pwritev' function. */
+/* #undef HAVE_PWRITEV */
+
+/* Define to 1 if you have the `splice' function. */
+/* #undef HAVE_SPLICE */
+
 /* Define to 1 if you have the <stdint.h> header file. */
 #define HAVE_STDINT_H 1
 
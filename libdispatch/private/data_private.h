@@ -148,6 +148,34 @@ bool
 dispatch_data_apply_f(dispatch_data_t data, void *_Nullable context,
 	dispatch_data_applier_function_t applier);
 
+struct iovec;
+
+/*!
+ * @function dispatch_data_create_map_iovec
+ * Maps the memory regions represented by the specified dispatch data object
+ * into an array of iovec structures, suitable for writev(2) and sendmsg(2),
+ * and returns a new data object representing the same memory.
+ *
+ * Unlike dispatch_data_create_map, no region is copied, the iovec entries point
+ * directly at the memory of the specified object, in logical order. The array
+ * and the memory it describes remain valid until the returned data object is
+ * released, and must not be modified.
+ *
+ * @param data		The data object to map.
+ * @param iov_ptr	A pointer to a pointer variable to be filled with the
+ *			location of the iovec array, or NULL.
+ * @param iovcnt_ptr	A pointer to a size_t variable to be filled with the
+ *			number of entries in the iovec array, or NULL.
+ * @result		A newly created dispatch data object.
+ */
+API_AVAILABLE(macos(10.13), ios(11.0), tvos(11.0), watchos(4.0))
+DISPATCH_EXPORT DISPATCH_NONNULL1 DISPATCH_RETURNS_RETAINED
+DISPATCH_WARN_RESULT DISPATCH_NOTHROW
+dispatch_data_t
+dispatch_data_create_map_iovec(dispatch_data_t data,
+	const struct iovec *_Nullable *_Nullable iov_ptr,
+	size_t *_Nullable iovcnt_ptr);
+
 #if TARGET_OS_MAC
 /*!
  * @function dispatch_data_make_memory_entry
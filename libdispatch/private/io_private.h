@@ -132,6 +132,50 @@ dispatch_write_f(dispatch_fd_t fd,
 	void (*handler)(void *_Nullable context, dispatch_data_t _Nullable data,
 			int error));
 
+#if defined(__linux__)
+/*!
+ * @function dispatch_splice_f
+ * Schedule the asynchronous transfer of data from one file descriptor to
+ * another with splice(2), without copying it through user space. The
+ * specified handler is enqueued when the transfer has completed or an error
+ * occurs.
+ *
+ * The transfer completes once the specified length has been transferred or
+ * EOF is reached on the source file descriptor. Either file descriptor may be
+ * a regular file, a pipe or a socket.
+ *
+ * The system takes control of both file descriptors until the handler is
+ * enqueued, and during this time file descriptor flags such as O_NONBLOCK will
+ * be modified by the system on behalf of the application. It is an error for
+ * the application to use either file descriptor while it is under the control
+ * of the system, this includes dispatch I/O channels and convenience
+ * operations.
+ *
+ * @param from_fd	The file descriptor from which to transfer the data.
+ * @param to_fd		The file descriptor to which to transfer the data.
+ * @param length	The length of data to transfer, or SIZE_MAX to
+ *			transfer all of the data until EOF.
+ * @param queue		The dispatch queue to which the handler should be
+ *			submitted.
+ * @param context	The application-defined context parameter to pass to
+ *			the handler function.
+ * @param handler	The handler to enqueue when the transfer is done.
+ *		param context		Application-defined context parameter.
+ *		param transferred	The number of bytes written to to_fd.
+ *		param error		An errno condition for the transfer or
+ *					zero if the transfer was successful.
+ */
+API_UNAVAILABLE(macos, ios, tvos, watchos)
+DISPATCH_EXPORT DISPATCH_NONNULL4 DISPATCH_NONNULL6 DISPATCH_NOTHROW
+void
+dispatch_splice_f(dispatch_fd_t from_fd,
+	dispatch_fd_t to_fd,
+	size_t length,
+	dispatch_queue_t queue,
+	void *_Nullable context,
+	void (*handler)(void *_Nullable context, size_t transferred, int error));
+#endif
+
 /*!
  * @function dispatch_io_create_f
  * Create a dispatch I/O channel associated with a file descriptor. The system
@@ -590,6 +590,68 @@ size_t
 dispatch_source_get_extended_data(dispatch_source_t source,
 		dispatch_source_extended_data_t data, size_t size);
 
+/*!
+ * @typedef dispatch_timer_wheel_stats_t
+ *
+ * @abstract
+ * Type used by dispatch_timer_wheel_get_stats() to return the counters of the
+ * timer coalescing wheel.
+ *
+ * @field timers
+ * The number of timers currently held by the wheel.
+ *
+ * @field expired
+ * The number of timers the wheel has handed over for firing.
+ *
+ * @field batches
+ * The number of wheel ticks at which timers were handed over. The difference
+ * between expired and batches is the number of timer wakeups saved by
+ * coalescing.
+ *
+ * @field cascades
+ * The number of times a timer was moved down to a finer level of the wheel.
+ */
+typedef struct dispatch_timer_wheel_stats_s {
+	uint64_t timers;
+	uint64_t expired;
+	uint64_t batches;
+	uint64_t cascades;
+} *dispatch_timer_wheel_stats_t;
+
+/*!
+ * @function dispatch_timer_wheel_get_stats
+ *
+ * @abstract
+ * Returns a snapshot of the counters of the timer coalescing wheel.
+ *
+ * @discussion
+ * Timers with a leeway of at least a few milliseconds are held in a
+ * hierarchical timing wheel rather than in the timer heap, on platforms using
+ * the epoll event backend. The wheel can be disabled by setting the
+ * LIBDISPATCH_DISABLE_TIMER_WHEEL environment variable, the counters are then
+ * all zero. The counters are process wide and updated without
+ * synchronization, the snapshot is not atomic.
+ *
+ * @param stats
+ * A pointer to a dispatch_timer_wheel_stats_s in which the counters will be
+ * returned.
+ *
+ * @param size
+ * The size of the specified structure. Should be set to
+ * sizeof(dispatch_timer_wheel_stats_s).
+ *
+ * @result
+ * The size of the structure returned in *stats, which will never be greater
+ * than the value of the size argument. If this is less than the value of the
+ * size argument, the remaining space in stats will have been populated with
+ * zeroes.
+ */
+API_AVAILABLE(macos(10.13), ios(11.0), tvos(11.0), watchos(4.0))
+DISPATCH_EXPORT DISPATCH_NONNULL_ALL DISPATCH_NOTHROW
+size_t
+dispatch_timer_wheel_get_stats(dispatch_timer_wheel_stats_t stats,
+		size_t size);
+
 __END_DECLS
 
 DISPATCH_ASSUME_NONNULL_END
@@ -26,15 +26,164 @@ static char const * const _dispatch_apply_key = "apply";
 #define DISPATCH_APPLY_INVOKE_REDIRECT 0x1
 #define DISPATCH_APPLY_INVOKE_WAIT     0x2
 
+#pragma mark -
+#pragma mark dispatch_apply_range
+
+// Guided chunking: a thread takes this fraction of what is left in its range
+#define DISPATCH_APPLY_CHUNK_DIVISOR 4
+
+#define _dispatch_apply_range_begin(bounds) ((size_t)((bounds) & UINT32_MAX))
+#define _dispatch_apply_range_end(bounds) ((size_t)((bounds) >> 32))
+#define _dispatch_apply_range_make(begin, end) \
+		(((uint64_t)(end) << 32) | (uint64_t)(begin))
+
+static bool _dispatch_apply_ranges_disabled;
+
+static void
+_dispatch_apply_ranges_init(void *ctxt DISPATCH_UNUSED)
+{
+	_dispatch_apply_ranges_disabled =
+			slowpath(getenv("LIBDISPATCH_DISABLE_APPLY_RANGES"));
+}
+
+static dispatch_apply_ranges_t
+_dispatch_apply_ranges_create(size_t iterations, int32_t thr_cnt)
+{
+	static dispatch_once_t pred;
+	dispatch_apply_ranges_t dars;
+	void *buf;
+	uint32_t i, n = (uint32_t)thr_cnt;
+
+	dispatch_once_f(&pred, NULL, _dispatch_apply_ranges_init);
+	if (_dispatch_apply_ranges_disabled || iterations > UINT32_MAX) {
+		return NULL;
+	}
+	while (!fastpath(posix_memalign(&buf, DISPATCH_CACHELINE_SIZE,
+			sizeof(struct dispatch_apply_ranges_s) +
+			n * sizeof(struct dispatch_apply_range_s)) == 0)) {
+		_dispatch_temporary_resource_shortage();
+	}
+	dars = buf;
+	dars->dars_count = n;
+	// Contiguous slices up front, so that every thread walks its own part of
+	// the iteration space (and of the memory it indexes) in order
+	for (i = 0; i < n; i++) {
+		dars->dars_range[i].dar_bounds = _dispatch_apply_range_make(
+				(uint64_t)iterations * i / n,
+				(uint64_t)iterations * (i + 1) / n);
+	}
+	return dars;
+}
+
+DISPATCH_ALWAYS_INLINE
+static inline size_t
+_dispatch_apply_range_chunk(size_t begin, size_t end)
+{
+	size_t chunk = (end - begin) / DISPATCH_APPLY_CHUNK_DIVISOR;
+	return begin + (chunk ? chunk : 1);
+}
+
+DISPATCH_ALWAYS_INLINE
+static inline bool
+_dispatch_apply_range_steal(dispatch_apply_range_t victim, size_t *begin,
+		size_t *end)
+{
+	uint64_t bounds = os_atomic_load2o(victim, dar_bounds, relaxed);
+	size_t b, e, mid;
+
+	do {
+		b = _dispatch_apply_range_begin(bounds);
+		e = _dispatch_apply_range_end(bounds);
+		if (b >= e) {
+			return false;
+		}
+		// The victim keeps the half it is walking towards
+		mid = e - (e - b + 1) / 2;
+	} while (unlikely(!os_atomic_cmpxchgvw2o(victim, dar_bounds, bounds,
+			_dispatch_apply_range_make(b, mid), &bounds, relaxed)));
+	*begin = mid;
+	*end = e;
+	return true;
+}
+
+// Returns the first index of the next chunk for the thread owning dar and
+// sets *end past its last index, or returns da_iterations when all the
+// ranges are empty
+DISPATCH_NOINLINE
+static size_t
+_dispatch_apply_range_next(dispatch_apply_t da, dispatch_apply_range_t dar,
+		size_t *end)
+{
+	dispatch_apply_ranges_t dars = da->da_ranges;
+	uint32_t n = dars->dars_count, slot = (uint32_t)(dar - dars->dars_range);
+	uint64_t bounds = os_atomic_load2o(dar, dar_bounds, relaxed);
+	size_t b, e, c;
+
+	// Our own range is only contended by thieves, so this rarely loops
+	for (;;) {
+		b = _dispatch_apply_range_begin(bounds);
+		e = _dispatch_apply_range_end(bounds);
+		if (b >= e) {
+			break;
+		}
+		c = _dispatch_apply_range_chunk(b, e);
+		if (likely(os_atomic_cmpxchgvw2o(dar, dar_bounds, bounds,
+				_dispatch_apply_range_make(c, e), &bounds, relaxed))) {
+			*end = c;
+			return b;
+		}
+	}
+
+	// Steal half of the nearest non-empty range: ranges next to ours cover
+	// the iterations next to ours, alternate between both sides
+	for (uint32_t i = 1; i < n; i++) {
+		uint32_t v = (i & 1) ? (slot + (i + 1) / 2) % n :
+				(slot + n - i / 2) % n;
+		if (_dispatch_apply_range_steal(&dars->dars_range[v], &b, &e)) {
+			// Thieves only look at non-empty ranges, so ours is still ours
+			c = _dispatch_apply_range_chunk(b, e);
+			os_atomic_store2o(dar, dar_bounds,
+					_dispatch_apply_range_make(c, e), relaxed);
+			*end = c;
+			return b;
+		}
+	}
+	return da->da_iterations;
+}
+
+DISPATCH_ALWAYS_INLINE
+static inline size_t
+_dispatch_apply_next(dispatch_apply_t da, dispatch_apply_range_t dar,
+		size_t idx, size_t *end)
+{
+	if (!dar) {
+		return os_atomic_inc_orig2o(da, da_index, relaxed);
+	}
+	if (likely(++idx < *end)) {
+		return idx;
+	}
+	return _dispatch_apply_range_next(da, dar, end);
+}
+
+#pragma mark -
+#pragma mark dispatch_apply
+
 DISPATCH_ALWAYS_INLINE
 static inline void
 _dispatch_apply_invoke2(void *ctxt, long invoke_flags)
 {
 	dispatch_apply_t da = (dispatch_apply_t)ctxt;
 	size_t const iter = da->da_iterations;
-	size_t idx, done = 0;
+	size_t idx, end = 0, done = 0;
+	dispatch_apply_range_t dar = NULL;
 
 	idx = os_atomic_inc_orig2o(da, da_index, acquire);
+	if (da->da_ranges) {
+		// da_index hands out ranges rather than iterations
+		dispatch_assert(idx < da->da_ranges->dars_count);
+		dar = &da->da_ranges->dars_range[idx];
+		idx = _dispatch_apply_range_next(da, dar, &end);
+	}
 	if (unlikely(idx >= iter)) goto out;
 
 	// da_dc is only safe to access once the 'index lock' has been acquired
@@ -65,7 +214,7 @@ _dispatch_apply_invoke2(void *ctxt, long invoke_flags)
 			_dispatch_client_callout2(da_ctxt, idx, func);
 			_dispatch_perfmon_workitem_inc();
 			done++;
-			idx = os_atomic_inc_orig2o(da, da_index, relaxed);
+			idx = _dispatch_apply_next(da, dar, idx, &end);
 		});
 	} while (likely(idx < iter));
 
@@ -87,6 +236,9 @@ out:
 		_dispatch_thread_event_destroy(&da->da_event);
 	}
 	if (os_atomic_dec2o(da, da_thr_cnt, release) == 0) {
+		if (da->da_ranges) {
+			free(da->da_ranges);
+		}
 #if DISPATCH_INTROSPECTION
 		_dispatch_continuation_free(da->da_dc);
 #endif
@@ -181,6 +333,8 @@ _dispatch_apply_f2(dispatch_queue_t dq, dispatch_apply_t da,
 	}
 
 	_dispatch_thread_event_init(&da->da_event);
+	da->da_ranges = _dispatch_apply_ranges_create(da->da_iterations,
+			da->da_thr_cnt);
 	// FIXME: dq may not be the right queue for the priority of `head`
 	_dispatch_root_queue_push_inline(dq, head, tail, continuation_cnt);
 	// Call the first element directly
@@ -291,6 +445,7 @@ dispatch_apply_f(size_t iterations, dispatch_queue_t dq, void *ctxt,
 	da->da_iterations = iterations;
 	da->da_nested = nested;
 	da->da_thr_cnt = thr_cnt;
+	da->da_ranges = NULL;
 #if DISPATCH_INTROSPECTION
 	da->da_dc = _dispatch_continuation_alloc();
 	*da->da_dc = dc;
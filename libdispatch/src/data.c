@@ -519,6 +519,51 @@ out:
 	return data;
 }
 
+// Describe the represented buffers with an iovec array stored after the range
+// records of a new composite data object, which keeps the buffers alive.
+dispatch_data_t
+dispatch_data_create_map_iovec(dispatch_data_t dd,
+		const struct iovec **iov_ptr, size_t *iovcnt_ptr)
+{
+	dispatch_data_t data = dispatch_data_empty;
+	struct iovec *iov = NULL;
+	size_t i, n = 0;
+
+	if (!dd->size) {
+		goto out;
+	}
+
+	n = _dispatch_data_num_records(dd);
+	data = _dispatch_data_alloc(n, n * sizeof(struct iovec));
+	data->size = dd->size;
+	if (_dispatch_data_leaf(dd)) {
+		data->records[0].from = 0;
+		data->records[0].length = dd->size;
+		data->records[0].data_object = dd;
+	} else {
+		memcpy(data->records, dd->records, n * sizeof(range_record));
+	}
+	iov = (struct iovec *)&data->records[n];
+	for (i = 0; i < n; ++i) {
+		range_record *r = &data->records[i];
+		const void *buffer = _dispatch_data_map_direct(r->data_object,
+				r->from, NULL, NULL);
+		dispatch_assert(buffer);
+		_dispatch_data_retain(r->data_object);
+		iov[i].iov_base = (void *)buffer;
+		iov[i].iov_len = r->length;
+	}
+
+out:
+	if (iov_ptr) {
+		*iov_ptr = iov;
+	}
+	if (iovcnt_ptr) {
+		*iovcnt_ptr = n;
+	}
+	return data;
+}
+
 const void *
 _dispatch_data_get_flattened_bytes(dispatch_data_t dd)
 {
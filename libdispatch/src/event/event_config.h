@@ -33,6 +33,22 @@
 #	error unsupported event loop
 #endif
 
+#ifndef DISPATCH_USE_IO_URING
+#	if DISPATCH_EVENT_BACKEND_EPOLL && HAVE_DECL_IORING_FEAT_RW_CUR_POS
+#	define DISPATCH_USE_IO_URING 1
+#	else
+#	define DISPATCH_USE_IO_URING 0
+#	endif
+#endif
+
+#ifndef DISPATCH_USE_TIMER_WHEEL
+#	if DISPATCH_EVENT_BACKEND_EPOLL
+#	define DISPATCH_USE_TIMER_WHEEL 1
+#	else
+#	define DISPATCH_USE_TIMER_WHEEL 0
+#	endif
+#endif
+
 #if DISPATCH_DEBUG
 #define DISPATCH_MGR_QUEUE_DEBUG 1
 #define DISPATCH_WLH_DEBUG 1
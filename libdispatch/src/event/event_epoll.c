@@ -41,6 +41,7 @@ enum {
 	DISPATCH_EPOLL_EVENTFD    = 0x0001,
 	DISPATCH_EPOLL_CLOCK_WALL = 0x0002,
 	DISPATCH_EPOLL_CLOCK_MACH = 0x0003,
+	DISPATCH_EPOLL_IO_URING   = 0x0004,
 };
 
 typedef struct dispatch_muxnote_s {
@@ -463,6 +464,23 @@ _dispatch_epoll_init(void *context DISPATCH_UNUSED)
 #endif
 }
 
+#if DISPATCH_USE_IO_URING
+void
+_dispatch_event_loop_io_uring_register(int fd)
+{
+	dispatch_once_f(&epoll_init_pred, NULL, _dispatch_epoll_init);
+
+	// The ring descriptor polls readable while completions are pending
+	struct epoll_event ev = {
+		.events = EPOLLIN,
+		.data = { .u32 = DISPATCH_EPOLL_IO_URING, },
+	};
+	if (epoll_ctl(_dispatch_epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+		DISPATCH_INTERNAL_CRASH(errno, "epoll_ctl() failed");
+	}
+}
+#endif
+
 void
 _dispatch_event_loop_poke(dispatch_wlh_t wlh DISPATCH_UNUSED,
 		uint64_t dq_state DISPATCH_UNUSED, uint32_t flags DISPATCH_UNUSED)
@@ -596,6 +614,12 @@ retry:
 			_dispatch_event_merge_timer(DISPATCH_CLOCK_MACH);
 			break;
 
+#if DISPATCH_USE_IO_URING
+		case DISPATCH_EPOLL_IO_URING:
+			_dispatch_io_uring_drain();
+			break;
+#endif
+
 		default:
 			dmn = ev[i].data.ptr;
 			switch (dmn->dmn_filter) {
@@ -122,8 +122,29 @@ typedef struct dispatch_timer_source_refs_s {
 	struct dispatch_timer_source_s dt_timer;
 	struct dispatch_timer_config_s *dt_pending_config;
 	uint32_t dt_heap_entry[DTH_ID_COUNT];
+#if DISPATCH_USE_TIMER_WHEEL
+	LIST_ENTRY(dispatch_timer_source_refs_s) dt_wheel_list;
+#endif
 } *dispatch_timer_source_refs_t;
 
+#if DISPATCH_USE_TIMER_WHEEL
+#define DTW_TICK_SHIFT   22u // level 0 slots are 2^22ns (~4ms) wide
+#define DTW_LEVEL_SHIFT   6u
+#define DTW_LEVEL_SLOTS  (1u << DTW_LEVEL_SHIFT)
+#define DTW_LEVEL_COUNT   4u
+// dt_heap_entry[DTH_TARGET_ID] of a timer held by the wheel, its slot is then
+// kept in dt_heap_entry[DTH_DEADLINE_ID]
+#define DTH_WHEEL_ID    (~1u)
+
+typedef struct dispatch_timer_wheel_s {
+	uint64_t dtw_now; // last tick processed
+	uint32_t dtw_count;
+	uint64_t dtw_occupied[DTW_LEVEL_COUNT]; // bitmaps of non-empty slots
+	LIST_HEAD(dispatch_timer_wheel_slot_s, dispatch_timer_source_refs_s)
+			dtw_slots[DTW_LEVEL_COUNT][DTW_LEVEL_SLOTS];
+} *dispatch_timer_wheel_t;
+#endif
+
 typedef struct dispatch_timer_heap_s {
 	uint64_t dth_target, dth_deadline;
 	uint32_t dth_count;
@@ -132,6 +153,9 @@ typedef struct dispatch_timer_heap_s {
 	uint16_t dth_flags;
 	dispatch_timer_source_refs_t dth_min[DTH_ID_COUNT];
 	void **dth_heap;
+#if DISPATCH_USE_TIMER_WHEEL
+	dispatch_timer_wheel_t dth_wheel; // allocated on first use
+#endif
 } *dispatch_timer_heap_t;
 
 #if HAVE_MACH
@@ -446,4 +470,40 @@ void _dispatch_event_loop_timer_arm(unsigned int tidx,
 		dispatch_timer_delay_s range, dispatch_clock_now_cache_t nows);
 void _dispatch_event_loop_timer_delete(unsigned int tidx);
 
+#if DISPATCH_USE_IO_URING
+#pragma mark -
+#pragma mark io_uring
+
+enum {
+	DISPATCH_IO_URING_READ = 1,
+	DISPATCH_IO_URING_WRITE,
+	DISPATCH_IO_URING_WRITEV, // dur_addr is an iovec array, dur_len its count
+};
+
+// A request for the io_uring operation engine. The fields mirror the SQE that
+// gets built from it, reads and writes use the registered buffer dur_buf_index
+// unless it is -1. dur_handler is invoked with dur_res set once the completion
+// has been reaped, on the event loop thread, so it must not block.
+typedef struct dispatch_io_uring_req_s {
+	struct dispatch_io_uring_req_s *dur_next; // submission batch linkage
+	void (*dur_handler)(struct dispatch_io_uring_req_s *dur);
+	void *dur_ctxt;
+	uint64_t dur_off;
+	uint64_t dur_addr;
+	uint32_t dur_len;
+	int32_t dur_res;
+	int dur_fd;
+	uint8_t dur_opcode;
+	int16_t dur_buf_index;
+} *dispatch_io_uring_req_t;
+
+bool _dispatch_io_uring_available(void);
+void _dispatch_io_uring_submit(dispatch_io_uring_req_t dur);
+void *_dispatch_io_uring_buffer_get(size_t size, int16_t *buf_index);
+void _dispatch_io_uring_buffer_put(int16_t buf_index);
+int16_t _dispatch_io_uring_buffer_lookup(const void *buf, size_t size);
+void _dispatch_io_uring_drain(void);
+void _dispatch_event_loop_io_uring_register(int fd);
+#endif // DISPATCH_USE_IO_URING
+
 #endif /* __DISPATCH_EVENT_EVENT_INTERNAL__ */
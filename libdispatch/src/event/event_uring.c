@@ -0,0 +1,345 @@
+/*
+ * Copyright (c) 2017 Apple Inc. All rights reserved.
+ *
+ * @APPLE_APACHE_LICENSE_HEADER_START@
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @APPLE_APACHE_LICENSE_HEADER_END@
+ */
+
+#include "internal.h"
+#if DISPATCH_USE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+// One ring is shared by every dispatch_disk_t in the process. Submissions are
+// batched per pick queue run and completions are reaped by the event loop,
+// which polls the ring descriptor alongside the other epoll sources.
+#define DISPATCH_IO_URING_ENTRIES	128u
+#define DISPATCH_IO_URING_BUFFERS	8u // registered DIO_MAX_CHUNK_SIZE buffers
+
+typedef struct dispatch_io_uring_s {
+	int diu_fd;
+	uint32_t diu_sq_entries;
+	uint32_t diu_sq_mask;
+	uint32_t diu_cq_mask;
+	uint32_t *diu_sq_head;
+	uint32_t *diu_sq_tail;
+	uint32_t *diu_sq_flags;
+	uint32_t *diu_sq_array;
+	uint32_t *diu_cq_head;
+	uint32_t *diu_cq_tail;
+	struct io_uring_sqe *diu_sqes;
+	struct io_uring_cqe *diu_cqes;
+	dispatch_unfair_lock_s diu_sq_lock;
+	dispatch_unfair_lock_s diu_cq_lock;
+	char *diu_buf_base;
+	size_t diu_buf_size;
+	uint32_t diu_buf_free; // bitmap of idle registered buffers
+} *dispatch_io_uring_t;
+
+static struct dispatch_io_uring_s _dispatch_io_uring = {
+	.diu_fd = -1,
+};
+
+static dispatch_once_t _dispatch_io_uring_pred;
+
+#pragma mark dispatch_io_uring_t
+
+static void
+_dispatch_io_uring_buffers_init(dispatch_io_uring_t diu, int fd)
+{
+	struct iovec iov[DISPATCH_IO_URING_BUFFERS];
+	size_t size = DIO_MAX_CHUNK_SIZE;
+	unsigned int i;
+	char *base;
+
+	dispatch_static_assert(DISPATCH_IO_URING_BUFFERS < 32);
+	base = mmap(NULL, size * DISPATCH_IO_URING_BUFFERS, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (base == MAP_FAILED) {
+		return;
+	}
+	for (i = 0; i < DISPATCH_IO_URING_BUFFERS; i++) {
+		iov[i].iov_base = base + i * size;
+		iov[i].iov_len = size;
+	}
+	if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_BUFFERS, iov,
+			DISPATCH_IO_URING_BUFFERS) < 0) {
+		// Pinning the buffers is charged to RLIMIT_MEMLOCK on older kernels,
+		// run with plain read/write requests if that is exhausted
+		munmap(base, size * DISPATCH_IO_URING_BUFFERS);
+		return;
+	}
+	diu->diu_buf_base = base;
+	diu->diu_buf_size = size;
+	diu->diu_buf_free = (1u << DISPATCH_IO_URING_BUFFERS) - 1;
+}
+
+static void
+_dispatch_io_uring_init(void *context DISPATCH_UNUSED)
+{
+	dispatch_io_uring_t diu = &_dispatch_io_uring;
+	struct io_uring_params p;
+	size_t sq_size, cq_size, sqes_size;
+	char *sq, *cq;
+	void *sqes;
+	uint32_t i;
+	int fd;
+
+	if (slowpath(getenv("LIBDISPATCH_DISABLE_IO_URING"))) {
+		return;
+	}
+	memset(&p, 0, sizeof(p));
+	fd = (int)syscall(__NR_io_uring_setup, DISPATCH_IO_URING_ENTRIES, &p);
+	if (fd < 0) {
+		// ENOSYS without io_uring support, EPERM when it is disabled by
+		// sysctl or a seccomp filter: dispatch_io keeps its blocking path
+		return;
+	}
+	// Completions must never be dropped, and stream operations on regular
+	// files rely on offset -1 meaning the current file position
+	if ((p.features & (IORING_FEAT_NODROP | IORING_FEAT_RW_CUR_POS)) !=
+			(IORING_FEAT_NODROP | IORING_FEAT_RW_CUR_POS)) {
+		goto out_close;
+	}
+
+	sq_size = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+	cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (cq_size > sq_size) {
+			sq_size = cq_size;
+		}
+		cq_size = sq_size;
+	}
+	sq = mmap(NULL, sq_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if (!dispatch_assume(sq != MAP_FAILED)) {
+		goto out_close;
+	}
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		cq = sq;
+	} else {
+		cq = mmap(NULL, cq_size, PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+		if (!dispatch_assume(cq != MAP_FAILED)) {
+			goto out_unmap_sq;
+		}
+	}
+	sqes = mmap(NULL, sqes_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	if (!dispatch_assume(sqes != MAP_FAILED)) {
+		goto out_unmap_cq;
+	}
+
+	diu->diu_sq_entries = p.sq_entries;
+	diu->diu_sq_mask = *(uint32_t *)(sq + p.sq_off.ring_mask);
+	diu->diu_sq_head = (uint32_t *)(sq + p.sq_off.head);
+	diu->diu_sq_tail = (uint32_t *)(sq + p.sq_off.tail);
+	diu->diu_sq_flags = (uint32_t *)(sq + p.sq_off.flags);
+	diu->diu_sq_array = (uint32_t *)(sq + p.sq_off.array);
+	diu->diu_cq_mask = *(uint32_t *)(cq + p.cq_off.ring_mask);
+	diu->diu_cq_head = (uint32_t *)(cq + p.cq_off.head);
+	diu->diu_cq_tail = (uint32_t *)(cq + p.cq_off.tail);
+	diu->diu_cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+	diu->diu_sqes = sqes;
+	// SQEs are always consumed in order, so the indirection array is fixed
+	for (i = 0; i < p.sq_entries; i++) {
+		diu->diu_sq_array[i] = i;
+	}
+
+	_dispatch_io_uring_buffers_init(diu, fd);
+	_dispatch_event_loop_io_uring_register(fd);
+	diu->diu_fd = fd;
+	return;
+
+out_unmap_cq:
+	if (cq != sq) {
+		munmap(cq, cq_size);
+	}
+out_unmap_sq:
+	munmap(sq, sq_size);
+out_close:
+	close(fd);
+}
+
+bool
+_dispatch_io_uring_available(void)
+{
+	dispatch_once_f(&_dispatch_io_uring_pred, NULL, _dispatch_io_uring_init);
+	return _dispatch_io_uring.diu_fd >= 0;
+}
+
+#pragma mark registered buffers
+
+void *
+_dispatch_io_uring_buffer_get(size_t size, int16_t *buf_index)
+{
+	dispatch_io_uring_t diu = &_dispatch_io_uring;
+	uint32_t mask, new_mask;
+
+	if (!diu->diu_buf_base || size > diu->diu_buf_size) {
+		return NULL;
+	}
+	os_atomic_rmw_loop(&diu->diu_buf_free, mask, new_mask, acquire, {
+		if (!mask) {
+			os_atomic_rmw_loop_give_up(return NULL);
+		}
+		new_mask = mask & (mask - 1);
+	});
+	*buf_index = (int16_t)__builtin_ctz(mask);
+	return diu->diu_buf_base + (size_t)*buf_index * diu->diu_buf_size;
+}
+
+void
+_dispatch_io_uring_buffer_put(int16_t buf_index)
+{
+	dispatch_io_uring_t diu = &_dispatch_io_uring;
+	dispatch_assert(buf_index >= 0 &&
+			buf_index < (int16_t)DISPATCH_IO_URING_BUFFERS);
+	os_atomic_or(&diu->diu_buf_free, 1u << buf_index, release);
+}
+
+int16_t
+_dispatch_io_uring_buffer_lookup(const void *buf, size_t size)
+{
+	dispatch_io_uring_t diu = &_dispatch_io_uring;
+	const char *p = buf;
+	size_t offset;
+
+	if (!diu->diu_buf_base || p < diu->diu_buf_base ||
+			p >= diu->diu_buf_base +
+			diu->diu_buf_size * DISPATCH_IO_URING_BUFFERS) {
+		return -1;
+	}
+	offset = (size_t)(p - diu->diu_buf_base);
+	if (offset % diu->diu_buf_size + size > diu->diu_buf_size) {
+		return -1;
+	}
+	return (int16_t)(offset / diu->diu_buf_size);
+}
+
+#pragma mark submission/completion
+
+static void
+_dispatch_io_uring_enter(dispatch_io_uring_t diu, uint32_t to_submit)
+{
+	// On sq lock
+	long r;
+
+	while (to_submit) {
+		r = syscall(__NR_io_uring_enter, diu->diu_fd, to_submit, 0, 0,
+				NULL, 0);
+		if (likely(r > 0)) {
+			to_submit -= (uint32_t)r;
+			continue;
+		}
+		switch (r ? errno : EAGAIN) {
+		case EINTR:
+			break;
+		case EAGAIN:
+		case EBUSY:
+			// The completion ring is backed up: reap it to make room
+			_dispatch_io_uring_drain();
+			break;
+		default:
+			DISPATCH_INTERNAL_CRASH(errno, "io_uring_enter() failed");
+		}
+	}
+}
+
+void
+_dispatch_io_uring_submit(dispatch_io_uring_req_t dur)
+{
+	dispatch_io_uring_t diu = &_dispatch_io_uring;
+	struct io_uring_sqe *sqe;
+	uint32_t tail, n = 0;
+
+	_dispatch_unfair_lock_lock(&diu->diu_sq_lock);
+	tail = *diu->diu_sq_tail;
+	while (dur) {
+		if (n == diu->diu_sq_entries) {
+			_dispatch_io_uring_enter(diu, n);
+			n = 0;
+		}
+		sqe = &diu->diu_sqes[tail & diu->diu_sq_mask];
+		memset(sqe, 0, sizeof(*sqe));
+		switch (dur->dur_opcode) {
+		case DISPATCH_IO_URING_READ:
+			sqe->opcode = dur->dur_buf_index < 0 ? IORING_OP_READ :
+					IORING_OP_READ_FIXED;
+			break;
+		case DISPATCH_IO_URING_WRITE:
+			sqe->opcode = dur->dur_buf_index < 0 ? IORING_OP_WRITE :
+					IORING_OP_WRITE_FIXED;
+			break;
+		case DISPATCH_IO_URING_WRITEV:
+			sqe->opcode = IORING_OP_WRITEV;
+			break;
+		default:
+			DISPATCH_INTERNAL_CRASH(dur->dur_opcode, "Invalid io_uring request");
+		}
+		if (dur->dur_buf_index >= 0) {
+			sqe->buf_index = (uint16_t)dur->dur_buf_index;
+		}
+		sqe->fd = dur->dur_fd;
+		sqe->off = dur->dur_off;
+		sqe->addr = dur->dur_addr;
+		sqe->len = dur->dur_len;
+		sqe->user_data = (uint64_t)(uintptr_t)dur;
+		// dur may complete and be reused as soon as it has been submitted
+		dur = dur->dur_next;
+		os_atomic_store(diu->diu_sq_tail, ++tail, release);
+		n++;
+	}
+	_dispatch_io_uring_enter(diu, n);
+	_dispatch_unfair_lock_unlock(&diu->diu_sq_lock);
+}
+
+void
+_dispatch_io_uring_drain(void)
+{
+	dispatch_io_uring_t diu = &_dispatch_io_uring;
+	dispatch_io_uring_req_t dur;
+	struct io_uring_cqe *cqe;
+	uint32_t head;
+
+	_dispatch_unfair_lock_lock(&diu->diu_cq_lock);
+	head = *diu->diu_cq_head;
+	for (;;) {
+		while (head != os_atomic_load(diu->diu_cq_tail, acquire)) {
+			cqe = &diu->diu_cqes[head & diu->diu_cq_mask];
+			dur = (dispatch_io_uring_req_t)(uintptr_t)cqe->user_data;
+			dur->dur_res = cqe->res;
+			os_atomic_store(diu->diu_cq_head, ++head, release);
+			dur->dur_handler(dur);
+		}
+#ifdef IORING_SQ_CQ_OVERFLOW
+		// Completions that did not fit are held by the kernel
+		// (IORING_FEAT_NODROP) and only flushed back by io_uring_enter()
+		if (unlikely(os_atomic_load(diu->diu_sq_flags, relaxed) &
+				IORING_SQ_CQ_OVERFLOW)) {
+			(void)syscall(__NR_io_uring_enter, diu->diu_fd, 0, 0,
+					IORING_ENTER_GETEVENTS, NULL, 0);
+			continue;
+		}
+#endif
+		break;
+	}
+	_dispatch_unfair_lock_unlock(&diu->diu_cq_lock);
+}
+
+#endif // DISPATCH_USE_IO_URING
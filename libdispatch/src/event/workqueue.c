@@ -29,20 +29,65 @@
  *
  * The dynamic monitoring could be implemented using either
  *   (a) low-frequency user-level approximation of the number of runnable
- *       worker threads via reading the /proc file system
+ *       worker threads
  *   (b) a Linux kernel extension that hooks the process change handler
  *       to accurately track the number of runnable normal worker threads
- * This file provides an implementation of option (a).
+ * This file provides an implementation of option (a): a worker counts as
+ * runnable when it is draining its root queue and its thread CPU clock has
+ * advanced since the previous sample, i.e. it is not blocked in a work item.
  *
  * Using either form of monitoring, if (i) there appears to be
  * work available in the monitored pthread root queue, (ii) the
  * number of runnable workers is below the target size for the pool,
  * and (iii) the total number of worker threads is below an upper limit,
  * then an additional worker thread will be added to the pool.
+ *
+ * Every monitored worker also owns a Chase-Lev work-stealing deque. Items
+ * a worker pushes onto its own root queue go to the bottom of its deque
+ * as long as the shared root queue list is empty; non-worker threads, and
+ * workers while anything is waiting on the shared list or their deque is
+ * full, push to the shared list instead. Everything in a deque is thus
+ * older than everything on the shared list, and workers drain the deques
+ * first: their own from the top, oldest first, then the top of the other
+ * deques of the same pool, and only then the shared list. This keeps the
+ * FIFO order of everything submitted to a queue.
  */
 
 #pragma mark static data for monitoring subsystem
 
+#define WORKQ_MAX_TRACKED_TIDS DISPATCH_WORKQ_MAX_PTHREAD_COUNT
+#define WORKQ_OVERSUBSCRIBE_FACTOR 2
+
+#if HAVE_DISPATCH_WORKQ_MONITORING
+/*
+ * State of a monitored worker thread.
+ *
+ * Worker slots are never freed, a slot released by an exiting worker is
+ * reused by the next one to register. This lets thieves scan the slots
+ * without holding the monitor lock.
+ */
+typedef struct dispatch_workq_worker_s {
+#if DISPATCH_USE_WORKQ_DEQUE
+	/* Oldest end of the deque, the owner and the thieves take from it */
+	long volatile dww_top DISPATCH_CACHELINE_ALIGN;
+
+	/* Owner end of the deque, only ever moved by the owning worker */
+	long volatile dww_bottom DISPATCH_CACHELINE_ALIGN;
+	struct dispatch_object_s *volatile dww_items[DISPATCH_WORKQ_DEQUE_SIZE];
+	unsigned int dww_steals;
+#endif // DISPATCH_USE_WORKQ_DEQUE
+	dispatch_queue_t dww_dq;
+
+	/* Runnable tracking, the monitor samples these under its lock */
+	bool volatile dww_busy;
+	dispatch_tid dww_tid;
+	clockid_t dww_clock;
+	uint64_t dww_cputime;
+} *dispatch_workq_worker_t;
+
+static __thread dispatch_workq_worker_t _dispatch_workq_worker_self;
+#endif // HAVE_DISPATCH_WORKQ_MONITORING
+
 /*
  * State for the user-level monitoring of a workqueue.
  */
@@ -56,26 +101,188 @@ typedef struct dispatch_workq_monitor_s {
 	/* The desired number of runnable worker threads */
 	int32_t target_runnable;
 
+#if HAVE_DISPATCH_WORKQ_MONITORING
 	/*
-	 * Tracking of registered workers; all accesses must hold lock.
-	 * Invariant: registered_tids[0]...registered_tids[num_registered_tids-1]
-	 *   contain the dispatch_tids of the worker threads we are monitoring.
+	 * Tracking of registered workers; registration and sampling hold lock.
+	 * Invariant: workers[0]...workers[num_workers-1] are allocated, the
+	 *   ones with a non-zero dww_tid belong to the workers we are
+	 *   monitoring.
 	 */
 	dispatch_unfair_lock_s registered_tid_lock;
-	dispatch_tid *registered_tids;
-	int num_registered_tids;
+	dispatch_workq_worker_t *workers;
+	int volatile num_workers;
+#endif // HAVE_DISPATCH_WORKQ_MONITORING
 } dispatch_workq_monitor_s, *dispatch_workq_monitor_t;
 
 static dispatch_workq_monitor_s _dispatch_workq_monitors[DISPATCH_QOS_MAX];
 
 #pragma mark Implementation of the monitoring subsystem.
 
-#define WORKQ_MAX_TRACKED_TIDS DISPATCH_WORKQ_MAX_PTHREAD_COUNT
-#define WORKQ_OVERSUBSCRIBE_FACTOR 2
-
 static void _dispatch_workq_init_once(void *context DISPATCH_UNUSED);
 static dispatch_once_t _dispatch_workq_init_once_pred;
 
+#if HAVE_DISPATCH_WORKQ_MONITORING
+static uint64_t
+_dispatch_workq_worker_cputime(dispatch_workq_worker_t dww)
+{
+	struct timespec ts;
+	if (unlikely(clock_gettime(dww->dww_clock, &ts))) {
+		return dww->dww_cputime;
+	}
+	return _dispatch_timespec_to_nano(ts);
+}
+
+static dispatch_workq_worker_t
+_dispatch_workq_worker_alloc(void)
+{
+	void *buf;
+	while (unlikely(posix_memalign(&buf, DISPATCH_CACHELINE_SIZE,
+			sizeof(struct dispatch_workq_worker_s)))) {
+		_dispatch_temporary_resource_shortage();
+	}
+	return memset(buf, 0, sizeof(struct dispatch_workq_worker_s));
+}
+#endif // HAVE_DISPATCH_WORKQ_MONITORING
+
+#if DISPATCH_USE_WORKQ_DEQUE
+#pragma mark Work-stealing deques
+
+DISPATCH_ALWAYS_INLINE
+static inline dispatch_workq_monitor_t
+_dispatch_workq_monitor_for_queue(dispatch_queue_t root_q)
+{
+	dispatch_qos_t qos = _dispatch_priority_qos(root_q->dq_priority);
+	if (unlikely(qos == DISPATCH_QOS_UNSPECIFIED)) {
+		return NULL;
+	}
+	dispatch_workq_monitor_t mon = &_dispatch_workq_monitors[qos-1];
+	return mon->dq == root_q ? mon : NULL;
+}
+
+DISPATCH_ALWAYS_INLINE
+static inline dispatch_workq_worker_t
+_dispatch_workq_worker_for_queue(dispatch_queue_t root_q)
+{
+	dispatch_workq_worker_t dww = _dispatch_workq_worker_self;
+	// Only workers of root_q itself may use their deque for it
+	if (dww && dww->dww_dq == root_q) {
+		return dww;
+	}
+	return NULL;
+}
+
+DISPATCH_ALWAYS_INLINE
+static inline struct dispatch_object_s *
+_dispatch_workq_deque_take_top(dispatch_workq_worker_t dww, long *remaining)
+{
+	struct dispatch_object_s *dou;
+	long top, bottom;
+
+	do {
+		top = os_atomic_load2o(dww, dww_top, acquire);
+		os_atomic_thread_fence(seq_cst);
+		bottom = os_atomic_load2o(dww, dww_bottom, acquire);
+		if (top >= bottom) {
+			return NULL;
+		}
+		dou = os_atomic_load(
+				&dww->dww_items[top & (DISPATCH_WORKQ_DEQUE_SIZE - 1)],
+				relaxed);
+	} while (unlikely(!os_atomic_cmpxchg2o(dww, dww_top, top, top + 1,
+			seq_cst)));
+	*remaining = bottom - top - 1;
+	return dou;
+}
+
+bool
+_dispatch_workq_deque_push(dispatch_queue_t root_q,
+		struct dispatch_object_s *dou)
+{
+	dispatch_workq_worker_t dww = _dispatch_workq_worker_for_queue(root_q);
+	if (!dww) {
+		return false;
+	}
+	// Don't get ahead of older items from the shared list
+	if (os_atomic_load2o(root_q, dq_items_tail, relaxed)) {
+		return false;
+	}
+	long bottom = os_atomic_load2o(dww, dww_bottom, relaxed);
+	long top = os_atomic_load2o(dww, dww_top, acquire);
+	if (unlikely(bottom - top >= DISPATCH_WORKQ_DEQUE_SIZE)) {
+		return false;
+	}
+	os_atomic_store(&dww->dww_items[bottom & (DISPATCH_WORKQ_DEQUE_SIZE - 1)],
+			dou, relaxed);
+	os_atomic_thread_fence(release);
+	os_atomic_store2o(dww, dww_bottom, bottom + 1, relaxed);
+	if (bottom == top) {
+		// The deque just became non-empty, let an idle worker come steal
+		_dispatch_global_queue_poke(root_q, 1, 0);
+	}
+	return true;
+}
+
+struct dispatch_object_s *
+_dispatch_workq_deque_pop(dispatch_queue_t root_q)
+{
+	dispatch_workq_worker_t dww = _dispatch_workq_worker_for_queue(root_q);
+	long remaining;
+	if (!dww) {
+		return NULL;
+	}
+	// Oldest first: items must be dequeued in the order they were pushed
+	return _dispatch_workq_deque_take_top(dww, &remaining);
+}
+
+struct dispatch_object_s *
+_dispatch_workq_deque_steal(dispatch_queue_t root_q)
+{
+	dispatch_workq_worker_t self = _dispatch_workq_worker_for_queue(root_q);
+	dispatch_workq_monitor_t mon;
+	struct dispatch_object_s *dou;
+	long remaining;
+
+	if (!self || !(mon = _dispatch_workq_monitor_for_queue(root_q))) {
+		return NULL;
+	}
+	int n = os_atomic_load2o(mon, num_workers, acquire);
+	int start = (int)(self->dww_steals++ % (unsigned int)n);
+	for (int i = 0; i < n; i++) {
+		dispatch_workq_worker_t victim = mon->workers[(start + i) % n];
+		if (victim == self) {
+			continue;
+		}
+		if ((dou = _dispatch_workq_deque_take_top(victim, &remaining))) {
+			if (remaining) {
+				// Keep the stealing going like the shared list does
+				_dispatch_global_queue_poke(root_q, 1, 0);
+			}
+			return dou;
+		}
+	}
+	return NULL;
+}
+
+bool
+_dispatch_workq_deque_probe(dispatch_queue_t root_q)
+{
+	dispatch_workq_monitor_t mon = _dispatch_workq_monitor_for_queue(root_q);
+	if (!mon) {
+		return false;
+	}
+	int n = os_atomic_load2o(mon, num_workers, acquire);
+	for (int i = 0; i < n; i++) {
+		dispatch_workq_worker_t dww = mon->workers[i];
+		// seq_cst wrt the fence in _dispatch_workq_deque_push
+		if (os_atomic_load2o(dww, dww_bottom, ordered) >
+				os_atomic_load2o(dww, dww_top, ordered)) {
+			return true;
+		}
+	}
+	return false;
+}
+#endif // DISPATCH_USE_WORKQ_DEQUE
+
 void
 _dispatch_workq_worker_register(dispatch_queue_t root_q, qos_class_t cls)
 {
@@ -85,12 +292,30 @@ _dispatch_workq_worker_register(dispatch_queue_t root_q, qos_class_t cls)
 	dispatch_qos_t qos = _dispatch_qos_from_qos_class(cls);
 	dispatch_workq_monitor_t mon = &_dispatch_workq_monitors[qos-1];
 	dispatch_assert(mon->dq == root_q);
-	dispatch_tid tid = _dispatch_tid_self();
+	dispatch_workq_worker_t dww = NULL;
 	_dispatch_unfair_lock_lock(&mon->registered_tid_lock);
-	dispatch_assert(mon->num_registered_tids < WORKQ_MAX_TRACKED_TIDS-1);
-	int worker_id = mon->num_registered_tids++;
-	mon->registered_tids[worker_id] = tid;
+	for (int i = 0; i < mon->num_workers; i++) {
+		if (!mon->workers[i]->dww_tid) {
+			dww = mon->workers[i];
+			break;
+		}
+	}
+	if (!dww) {
+		dispatch_assert(mon->num_workers < WORKQ_MAX_TRACKED_TIDS-1);
+		dww = _dispatch_workq_worker_alloc();
+		mon->workers[mon->num_workers] = dww;
+		// publish the slot only once it is initialized, thieves read
+		// num_workers without the lock
+		(void)os_atomic_inc2o(mon, num_workers, release);
+	}
+	dww->dww_tid = _dispatch_tid_self();
+	dww->dww_dq = root_q;
+	(void)dispatch_assume_zero(pthread_getcpuclockid(pthread_self(),
+			&dww->dww_clock));
+	dww->dww_cputime = _dispatch_workq_worker_cputime(dww);
+	dww->dww_busy = false;
 	_dispatch_unfair_lock_unlock(&mon->registered_tid_lock);
+	_dispatch_workq_worker_self = dww;
 #endif // HAVE_DISPATCH_WORKQ_MONITORING
 }
 
@@ -101,78 +326,69 @@ _dispatch_workq_worker_unregister(dispatch_queue_t root_q, qos_class_t cls)
 	dispatch_qos_t qos = _dispatch_qos_from_qos_class(cls);
 	dispatch_workq_monitor_t mon = &_dispatch_workq_monitors[qos-1];
 	dispatch_assert(mon->dq == root_q);
-	dispatch_tid tid = _dispatch_tid_self();
-	_dispatch_unfair_lock_lock(&mon->registered_tid_lock);
-	for (int i = 0; i < mon->num_registered_tids; i++) {
-		if (mon->registered_tids[i] == tid) {
-			int last = mon->num_registered_tids - 1;
-			mon->registered_tids[i] = mon->registered_tids[last];
-			mon->registered_tids[last] = 0;
-			mon->num_registered_tids--;
-			break;
-		}
+	dispatch_workq_worker_t dww = _dispatch_workq_worker_self;
+	dispatch_assert(dww && dww->dww_tid == _dispatch_tid_self());
+#if DISPATCH_USE_WORKQ_DEQUE
+	// Hand whatever is left in the deque to the shared list, oldest first,
+	// thieves may still race with us for these items until it is empty
+	struct dispatch_object_s *dou;
+	long remaining;
+	while ((dou = _dispatch_workq_deque_take_top(dww, &remaining))) {
+		_dispatch_root_queue_push_inline(root_q, dou, dou, 1);
 	}
+#endif
+	_dispatch_workq_worker_self = NULL;
+	_dispatch_unfair_lock_lock(&mon->registered_tid_lock);
+	dww->dww_busy = false;
+	dww->dww_tid = 0;
 	_dispatch_unfair_lock_unlock(&mon->registered_tid_lock);
 #endif // HAVE_DISPATCH_WORKQ_MONITORING
 }
 
+void
+_dispatch_workq_worker_set_busy(bool busy)
+{
+#if HAVE_DISPATCH_WORKQ_MONITORING
+	dispatch_workq_worker_t dww = _dispatch_workq_worker_self;
+	if (dww) {
+		os_atomic_store2o(dww, dww_busy, busy, relaxed);
+	}
+#else
+	(void)busy;
+#endif // HAVE_DISPATCH_WORKQ_MONITORING
+}
+
 
 #if HAVE_DISPATCH_WORKQ_MONITORING
-#if defined(__linux__)
 /*
- * For each pid that is a registered worker, read /proc/[pid]/stat
- * to get a count of the number of them that are actually runnable.
- * See the proc(5) man page for the format of the contents of /proc/[pid]/stat
+ * A registered worker is runnable when it is draining its root queue and
+ * its thread CPU clock moved since the previous sample. Workers blocked in
+ * a work item do not accumulate CPU time, parked workers are not busy.
  */
 static void
 _dispatch_workq_count_runnable_workers(dispatch_workq_monitor_t mon)
 {
-	char path[128];
-	char buf[4096];
 	int running_count = 0;
 
 	_dispatch_unfair_lock_lock(&mon->registered_tid_lock);
 
-	for (int i = 0; i < mon->num_registered_tids; i++) {
-		dispatch_tid tid = mon->registered_tids[i];
-		int fd;
-		ssize_t bytes_read = -1;
-
-		int r = snprintf(path, sizeof(path), "/proc/%d/stat", tid);
-		dispatch_assert(r > 0 && r < (int)sizeof(path));
-
-		fd = open(path, O_RDONLY | O_NONBLOCK);
-		if (unlikely(fd == -1)) {
-			DISPATCH_CLIENT_CRASH(tid,
-					"workq: registered worker exited prematurely");
-		} else {
-			bytes_read = read(fd, buf, sizeof(buf)-1);
-			(void)close(fd);
+	for (int i = 0; i < mon->num_workers; i++) {
+		dispatch_workq_worker_t dww = mon->workers[i];
+		if (!dww->dww_tid) {
+			continue;
 		}
-
-		if (bytes_read > 0) {
-			buf[bytes_read] = '\0';
-			char state;
-			if (sscanf(buf, "%*d %*s %c", &state) == 1) {
-				// _dispatch_debug("workq: Worker %d, state %c\n", tid, state);
-				if (state == 'R') {
-					running_count++;
-				}
-			} else {
-				_dispatch_debug("workq: sscanf of state failed for %d", tid);
-			}
-		} else {
-			_dispatch_debug("workq: Failed to read %s", path);
+		uint64_t cputime = _dispatch_workq_worker_cputime(dww);
+		if (os_atomic_load2o(dww, dww_busy, relaxed) &&
+				cputime > dww->dww_cputime) {
+			running_count++;
 		}
+		dww->dww_cputime = cputime;
 	}
 
 	mon->num_runnable = running_count;
 
 	_dispatch_unfair_lock_unlock(&mon->registered_tid_lock);
 }
-#else
-#error must define _dispatch_workq_count_runnable_workers
-#endif
 
 static void
 _dispatch_workq_monitor_pools(void *context DISPATCH_UNUSED)
@@ -183,7 +399,11 @@ _dispatch_workq_monitor_pools(void *context DISPATCH_UNUSED)
 		dispatch_workq_monitor_t mon = &_dispatch_workq_monitors[i-1];
 		dispatch_queue_t dq = mon->dq;
 
-		if (!_dispatch_queue_class_probe(dq)) {
+		if (!_dispatch_queue_class_probe(dq)
+#if DISPATCH_USE_WORKQ_DEQUE
+				&& !_dispatch_workq_deque_probe(dq)
+#endif
+				) {
 			_dispatch_debug("workq: %s is empty.", dq->dq_label);
 			continue;
 		}
@@ -230,8 +450,9 @@ _dispatch_workq_init_once(void *context DISPATCH_UNUSED)
 	for (dispatch_qos_t i = DISPATCH_QOS_MAX; i > DISPATCH_QOS_UNSPECIFIED; i--) {
 		dispatch_workq_monitor_t mon = &_dispatch_workq_monitors[i-1];
 		mon->dq = _dispatch_get_root_queue(i, false);
-		void *buf = _dispatch_calloc(WORKQ_MAX_TRACKED_TIDS, sizeof(dispatch_tid));
-		mon->registered_tids = buf;
+		void *buf = _dispatch_calloc(WORKQ_MAX_TRACKED_TIDS,
+				sizeof(dispatch_workq_worker_t));
+		mon->workers = buf;
 		mon->target_runnable = target_runnable;
 	}
 
@@ -33,6 +33,7 @@
 
 void _dispatch_workq_worker_register(dispatch_queue_t root_q, qos_class_t cls);
 void _dispatch_workq_worker_unregister(dispatch_queue_t root_q, qos_class_t cls);
+void _dispatch_workq_worker_set_busy(bool busy);
 
 #if defined(__linux__)
 #define HAVE_DISPATCH_WORKQ_MONITORING 1
@@ -40,5 +41,22 @@ void _dispatch_workq_worker_unregister(dispatch_queue_t root_q, qos_class_t cls)
 #define HAVE_DISPATCH_WORKQ_MONITORING 0
 #endif
 
+// Per-worker work-stealing deques for the monitored root queues
+#ifndef DISPATCH_USE_WORKQ_DEQUE
+#define DISPATCH_USE_WORKQ_DEQUE HAVE_DISPATCH_WORKQ_MONITORING
+#endif
+
+#if DISPATCH_USE_WORKQ_DEQUE
+#define DISPATCH_WORKQ_DEQUE_SIZE 256
+
+struct dispatch_object_s;
+
+bool _dispatch_workq_deque_push(dispatch_queue_t root_q,
+		struct dispatch_object_s *dou);
+struct dispatch_object_s *_dispatch_workq_deque_pop(dispatch_queue_t root_q);
+struct dispatch_object_s *_dispatch_workq_deque_steal(dispatch_queue_t root_q);
+bool _dispatch_workq_deque_probe(dispatch_queue_t root_q);
+#endif // DISPATCH_USE_WORKQ_DEQUE
+
 #endif /* __DISPATCH_WORKQUEUE_INTERNAL__ */
 
@@ -255,6 +255,7 @@ DISPATCH_EXPORT DISPATCH_NOTHROW void dispatch_atfork_child(void);
 #endif /* __ANDROID__ */
 #include <sys/socket.h>
 #include <sys/time.h>
+#include <sys/uio.h>
 #include <sys/mman.h>
 #include <netinet/in.h>
 #endif
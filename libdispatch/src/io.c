@@ -81,9 +81,18 @@ static void _dispatch_disk_handler(void *ctx);
 static void _dispatch_disk_perform(void *ctxt);
 static void _dispatch_operation_advise(dispatch_operation_t op,
 		size_t chunk_size);
+static void _dispatch_operation_buffer_size(dispatch_operation_t op);
+static void _dispatch_operation_buffer_map(dispatch_operation_t op);
+static const struct iovec *_dispatch_operation_buffer_iov(
+		dispatch_operation_t op, size_t *skip_ptr, size_t *cnt_ptr);
 static int _dispatch_operation_perform(dispatch_operation_t op);
+static int _dispatch_operation_performed(dispatch_operation_t op,
+		ssize_t processed, int err);
 static void _dispatch_operation_deliver_data(dispatch_operation_t op,
 		dispatch_op_flags_t flags);
+#if DISPATCH_USE_IO_URING
+static void _dispatch_disk_uring_handler(dispatch_disk_t disk);
+#endif
 
 // Macros to wrap syscalls which return -1 on error, and retry on EINTR
 #define _dispatch_io_syscall_switch_noerr(_err, _syscall, ...) do { \
@@ -989,6 +998,225 @@ dispatch_write_f(dispatch_fd_t fd, dispatch_data_t data, dispatch_queue_t queue,
 	});
 }
 
+#if HAVE_SPLICE
+#pragma mark -
+#pragma mark dispatch_splice
+
+static void _dispatch_splice_pump(dispatch_splice_t ds);
+
+static int
+_dispatch_splice_set_nonblock(dispatch_fd_t fd, int *orig_flags)
+{
+	int err, flags;
+	_dispatch_io_syscall_switch(err,
+		flags = fcntl(fd, F_GETFL),
+		default: return err;
+	);
+	if (flags & O_NONBLOCK) {
+		return 0;
+	}
+	_dispatch_io_syscall_switch(err,
+		fcntl(fd, F_SETFL, flags | O_NONBLOCK),
+		default: return err;
+	);
+	*orig_flags = flags;
+	return 0;
+}
+
+static int
+_dispatch_splice_init(dispatch_splice_t ds)
+{
+	// On splice queue
+	int err, siz;
+	err = _dispatch_splice_set_nonblock(ds->from_fd, &ds->orig_from_flags);
+	if (!err) {
+		err = _dispatch_splice_set_nonblock(ds->to_fd, &ds->orig_to_flags);
+	}
+	if (err) {
+		return err;
+	}
+	_dispatch_io_syscall_switch(err,
+		pipe2(ds->pipe, O_NONBLOCK | O_CLOEXEC),
+		default: return err;
+	);
+	// Keep up to a chunk in flight if the system allows for pipes that deep
+	(void)fcntl(ds->pipe[1], F_SETPIPE_SZ,
+			(int)dispatch_io_defaults.chunk_size);
+	siz = fcntl(ds->pipe[1], F_GETPIPE_SZ);
+	ds->pipe_siz = siz > 0 ? (size_t)siz : PIPE_BUF;
+	return 0;
+}
+
+static void
+_dispatch_splice_complete(dispatch_splice_t ds, int err)
+{
+	// On splice queue
+	// The descriptors are handed back to the application only once their
+	// sources are cancelled
+	dispatch_group_t group = dispatch_group_create();
+	dispatch_source_t sources[] = { ds->read_source, ds->write_source };
+	bool armed[] = { ds->read_armed, ds->write_armed };
+	size_t i;
+	for (i = 0; i < 2; i++) {
+		if (!sources[i]) {
+			continue;
+		}
+		dispatch_group_enter(group);
+		dispatch_source_set_cancel_handler(sources[i], ^{
+			dispatch_group_leave(group);
+		});
+		dispatch_source_cancel(sources[i]);
+		if (!armed[i]) {
+			dispatch_resume(sources[i]);
+		}
+		dispatch_release(sources[i]);
+	}
+	dispatch_group_notify(group, ds->handler_q, ^{
+		if (ds->orig_from_flags != -1) {
+			_dispatch_io_syscall(fcntl(ds->from_fd, F_SETFL,
+					ds->orig_from_flags));
+		}
+		if (ds->orig_to_flags != -1) {
+			_dispatch_io_syscall(fcntl(ds->to_fd, F_SETFL, ds->orig_to_flags));
+		}
+		if (ds->pipe[0] != -1) {
+			(void)close(ds->pipe[0]);
+			(void)close(ds->pipe[1]);
+		}
+		dispatch_release(ds->queue);
+		_dispatch_fd_debug("splice handler invoke", ds->from_fd);
+		ds->handler(ds->ctxt, ds->total, err);
+		free(ds);
+	});
+	_dispatch_release(ds->handler_q);
+	dispatch_release(group);
+}
+
+static void
+_dispatch_splice_arm(dispatch_splice_t ds, dispatch_source_t *source_ptr,
+		bool *armed, dispatch_source_type_t type, dispatch_fd_t fd)
+{
+	// On splice queue
+	// Sources are only created once a descriptor would block, which regular
+	// files never do
+	dispatch_source_t source = *source_ptr;
+	if (!source) {
+		source = dispatch_source_create(type, (uintptr_t)fd, 0, ds->queue);
+		dispatch_source_set_event_handler(source, ^{
+			dispatch_suspend(source);
+			*armed = false;
+			_dispatch_splice_pump(ds);
+		});
+		*source_ptr = source;
+	}
+	if (!*armed) {
+		*armed = true;
+		dispatch_resume(source);
+	}
+}
+
+static void
+_dispatch_splice_pump(dispatch_splice_t ds)
+{
+	// On splice queue
+	// Alternate between filling the pipe from from_fd and draining it into
+	// to_fd, the data never passes through user space
+	int err = 0;
+	ssize_t n;
+	for (;;) {
+		bool progress = false, blocked_out = false;
+		size_t len = ds->length - ds->total - ds->buffered;
+		if (!ds->eof && len && ds->buffered < ds->pipe_siz) {
+			if (len > ds->pipe_siz - ds->buffered) {
+				len = ds->pipe_siz - ds->buffered;
+			}
+			_dispatch_io_syscall_switch_noerr(err,
+				n = splice(ds->from_fd, NULL, ds->pipe[1], NULL, len,
+						SPLICE_F_MOVE | SPLICE_F_NONBLOCK),
+				case 0:
+					if (n) {
+						ds->buffered += (size_t)n;
+					} else {
+						ds->eof = true;
+					}
+					progress = true;
+					break;
+				case EAGAIN:
+					err = 0;
+					break;
+			);
+			if (err) {
+				break;
+			}
+		}
+		if (ds->buffered) {
+			_dispatch_io_syscall_switch_noerr(err,
+				n = splice(ds->pipe[0], NULL, ds->to_fd, NULL, ds->buffered,
+						SPLICE_F_MOVE | SPLICE_F_NONBLOCK),
+				case 0:
+					ds->buffered -= (size_t)n;
+					ds->total += (size_t)n;
+					progress = true;
+					break;
+				case EAGAIN:
+					blocked_out = true;
+					err = 0;
+					break;
+			);
+			if (err) {
+				break;
+			}
+		}
+		if (!ds->buffered && (ds->eof || ds->total == ds->length)) {
+			break;
+		}
+		if (!progress) {
+			// With data left in the pipe a failed fill may only mean that the
+			// pipe is full, wait for to_fd in that case
+			if (blocked_out) {
+				_dispatch_splice_arm(ds, &ds->write_source, &ds->write_armed,
+						DISPATCH_SOURCE_TYPE_WRITE, ds->to_fd);
+			} else {
+				_dispatch_splice_arm(ds, &ds->read_source, &ds->read_armed,
+						DISPATCH_SOURCE_TYPE_READ, ds->from_fd);
+			}
+			return;
+		}
+	}
+	_dispatch_splice_complete(ds, err);
+}
+
+void
+dispatch_splice_f(dispatch_fd_t from_fd, dispatch_fd_t to_fd, size_t length,
+		dispatch_queue_t queue, void *context,
+		void (*handler)(void *, size_t, int))
+{
+	dispatch_splice_t ds = _dispatch_calloc(1ul,
+			sizeof(struct dispatch_splice_s));
+	ds->from_fd = from_fd;
+	ds->to_fd = to_fd;
+	ds->orig_from_flags = -1;
+	ds->orig_to_flags = -1;
+	ds->pipe[0] = -1;
+	ds->pipe[1] = -1;
+	ds->length = length;
+	ds->queue = dispatch_queue_create("com.apple.libdispatch-io.spliceq",
+			NULL);
+	_dispatch_retain(queue);
+	ds->handler_q = queue;
+	ds->ctxt = context;
+	ds->handler = handler;
+	dispatch_async(ds->queue, ^{
+		int err = _dispatch_splice_init(ds);
+		if (err) {
+			_dispatch_splice_complete(ds, err);
+		} else {
+			_dispatch_splice_pump(ds);
+		}
+	});
+}
+#endif // HAVE_SPLICE
+
 #pragma mark -
 #pragma mark dispatch_operation_t
 
@@ -1067,7 +1295,16 @@ _dispatch_operation_dispose(dispatch_operation_t op,
 	if (op->timer) {
 		dispatch_release(op->timer);
 	}
-	// For write operations, op->buf is owned by op->buf_data
+#if DISPATCH_USE_IO_URING
+	if (op->uring) {
+		if (op->buf && op->uring->buf_index >= 0) {
+			_dispatch_io_uring_buffer_put(op->uring->buf_index);
+			op->buf = NULL;
+		}
+		free(op->uring);
+	}
+#endif
+	// Write operations leave op->buf unused, their chunk is op->buf_data
 	if (op->buf && op->direction == DOP_DIR_READ) {
 		free(op->buf);
 	}
@@ -1842,6 +2079,15 @@ _dispatch_stream_cleanup_operations(dispatch_stream_t stream,
 	}
 }
 
+#if DISPATCH_USE_IO_URING
+static inline bool
+_dispatch_disk_uring_inflight(dispatch_disk_t disk, dispatch_operation_t op)
+{
+	// On pick queue
+	return op->uring && op->active && disk->advise_list[op->uring->slot] == op;
+}
+#endif
+
 static inline void
 _dispatch_disk_cleanup_specified_operations(dispatch_disk_t disk,
 		dispatch_io_t channel, bool inactive_only)
@@ -1851,6 +2097,18 @@ _dispatch_disk_cleanup_specified_operations(dispatch_disk_t disk,
 	TAILQ_FOREACH_SAFE(op, &disk->operations, operation_list, tmp) {
 		if (inactive_only && op->active) continue;
 		if (!channel || op->channel == channel) {
+#if DISPATCH_USE_IO_URING
+			if (_dispatch_disk_uring_inflight(disk, op)) {
+				// The ring still owns a request of the operation, its own
+				// completion finishes it with the error
+				if (!op->err) {
+					int err = _dispatch_io_get_error(op, NULL, false);
+					op->err = err ? err : ECANCELED;
+				}
+				_dispatch_op_debug("cleanup deferred: disk %p", op, disk);
+				continue;
+			}
+#endif
 			_dispatch_op_debug("cleanup: disk %p", op, disk);
 			_dispatch_disk_complete_operation(disk, op);
 		}
@@ -2012,6 +2270,11 @@ _dispatch_disk_handler(void *ctx)
 	if (disk->io_active) {
 		return;
 	}
+#if DISPATCH_USE_IO_URING
+	if (_dispatch_io_uring_available()) {
+		return _dispatch_disk_uring_handler(disk);
+	}
+#endif
 	_dispatch_disk_debug("disk handler", disk);
 	dispatch_operation_t op;
 	size_t i = disk->free_idx, j = disk->req_idx;
@@ -2048,6 +2311,45 @@ _dispatch_disk_handler(void *ctx)
 	}
 }
 
+static void
+_dispatch_disk_perform_complete(dispatch_disk_t disk, dispatch_operation_t op,
+		int result)
+{
+	// On pick queue
+	_dispatch_op_debug("perform completion", op);
+	switch (result) {
+	case DISPATCH_OP_DELIVER:
+		_dispatch_operation_deliver_data(op, DOP_DEFAULT);
+		break;
+	case DISPATCH_OP_COMPLETE:
+		_dispatch_disk_complete_operation(disk, op);
+		break;
+	case DISPATCH_OP_DELIVER_AND_COMPLETE:
+		_dispatch_operation_deliver_data(op, DOP_DELIVER | DOP_NO_EMPTY);
+		_dispatch_disk_complete_operation(disk, op);
+		break;
+	case DISPATCH_OP_ERR:
+		_dispatch_disk_cleanup_operations(disk, op->channel);
+		break;
+	case DISPATCH_OP_FD_ERR:
+		_dispatch_disk_cleanup_operations(disk, NULL);
+		break;
+	default:
+		dispatch_assert(result);
+		break;
+	}
+	_dispatch_op_debug("deactivate: disk %p", op, disk);
+	op->active = false;
+	disk->io_active = false;
+	_dispatch_disk_handler(disk);
+	// Balancing the retain in _dispatch_disk_handler. Note that op must be
+	// released at the very end, since it might hold the last reference to
+	// the disk
+	_dispatch_op_debug("release -> %d (disk perform complete)", op,
+			op->do_ref_cnt);
+	_dispatch_release(op);
+}
+
 static void
 _dispatch_disk_perform(void *ctxt)
 {
@@ -2095,40 +2397,178 @@ _dispatch_disk_perform(void *ctxt)
 	disk->req_idx = (++disk->req_idx)%disk->advise_list_depth;
 	_dispatch_op_debug("async perform completion: disk %p", op, disk);
 	dispatch_async(disk->pick_queue, ^{
-		_dispatch_op_debug("perform completion", op);
-		switch (result) {
-		case DISPATCH_OP_DELIVER:
-			_dispatch_operation_deliver_data(op, DOP_DEFAULT);
-			break;
-		case DISPATCH_OP_COMPLETE:
-			_dispatch_disk_complete_operation(disk, op);
+		_dispatch_disk_perform_complete(disk, op, result);
+	});
+}
+
+#if DISPATCH_USE_IO_URING
+#pragma mark -
+#pragma mark dispatch_disk_uring
+
+static void
+_dispatch_disk_uring_perform_complete(void *ctxt)
+{
+	// On pick queue
+	dispatch_operation_t op = ctxt;
+	dispatch_disk_t disk = op->fd_entry->disk;
+	int32_t res = op->uring->req.dur_res;
+	int result;
+	_dispatch_op_debug("uring perform completion: res %d", op, res);
+	disk->advise_list[op->uring->slot] = NULL;
+	if (op->err) {
+		// Cleaned up while in flight, whatever the request transferred is
+		// dropped along with the operation
+		result = DISPATCH_OP_COMPLETE;
+	} else if (res == -EINTR || res == -EAGAIN) {
+		// Nothing was transferred, the operation is simply picked again
+		result = DISPATCH_OP_DELIVER;
+	} else if (res < 0) {
+		result = _dispatch_operation_performed(op, -1, -res);
+	} else {
+		result = _dispatch_operation_performed(op, res, 0);
+	}
+	_dispatch_disk_perform_complete(disk, op, result);
+}
+
+static void
+_dispatch_disk_uring_complete(dispatch_io_uring_req_t dur)
+{
+	// On the event loop, which must not be blocked by client deliveries
+	dispatch_operation_t op = dur->dur_ctxt;
+	dispatch_async_f(op->fd_entry->disk->pick_queue, op,
+			_dispatch_disk_uring_perform_complete);
+}
+
+static void
+_dispatch_operation_uring_prepare_write(dispatch_operation_t op,
+		dispatch_io_uring_req_t dur)
+{
+	// The ring may read the iovec array after submission, copy the unwritten
+	// part of the chunk's region array into the operation's own
+	struct iovec *iov = op->uring->iov;
+	size_t i, n, skip;
+	const struct iovec *src = _dispatch_operation_buffer_iov(op, &skip, &n);
+	if (n > DIO_URING_MAX_IOV) {
+		n = DIO_URING_MAX_IOV;
+	}
+	for (i = 0; i < n; i++) {
+		iov[i] = src[i];
+	}
+	iov[0].iov_base = (char *)iov[0].iov_base + skip;
+	iov[0].iov_len -= skip;
+	if (n == 1) {
+		// Data read through a registered buffer is written back from it
+		dur->dur_opcode = DISPATCH_IO_URING_WRITE;
+		dur->dur_addr = (uintptr_t)iov[0].iov_base;
+		dur->dur_len = (uint32_t)iov[0].iov_len;
+		dur->dur_buf_index = _dispatch_io_uring_buffer_lookup(iov[0].iov_base,
+				iov[0].iov_len);
+	} else {
+		dur->dur_opcode = DISPATCH_IO_URING_WRITEV;
+		dur->dur_addr = (uintptr_t)iov;
+		dur->dur_len = (uint32_t)n;
+		dur->dur_buf_index = -1;
+	}
+}
+
+static int
+_dispatch_operation_uring_prepare(dispatch_operation_t op)
+{
+	// On pick queue
+	struct dispatch_operation_uring_s *uop = op->uring;
+	if (!uop) {
+		uop = _dispatch_calloc(1ul, sizeof(struct dispatch_operation_uring_s));
+		uop->buf_index = -1;
+		uop->req.dur_handler = _dispatch_disk_uring_complete;
+		uop->req.dur_ctxt = op;
+		op->uring = uop;
+	}
+	if (op->fd_entry->fd == -1) {
+		int err = _dispatch_fd_entry_open(op->fd_entry, op->channel);
+		if (err) {
+			return err;
+		}
+	}
+	// For performance analysis
+	if (!op->total && dispatch_io_defaults.initial_delivery) {
+		// Empty delivery to signal the start of the operation
+		_dispatch_op_debug("initial delivery", op);
+		_dispatch_operation_deliver_data(op, DOP_DELIVER);
+	}
+	dispatch_io_uring_req_t dur = &uop->req;
+	dur->dur_next = NULL;
+	dur->dur_fd = op->fd_entry->fd;
+	if (op->params.type == DISPATCH_IO_STREAM) {
+		// Continue from the current file position, like read(2)/write(2)
+		dur->dur_off = (uint64_t)-1;
+	} else {
+		dur->dur_off = (uint64_t)op->offset + op->total;
+	}
+	if (op->direction == DOP_DIR_READ) {
+		if (!op->buf) {
+			_dispatch_operation_buffer_size(op);
+			op->buf = _dispatch_io_uring_buffer_get(op->buf_siz,
+					&uop->buf_index);
+			if (!op->buf) {
+				op->buf = valloc(op->buf_siz);
+			}
+			_dispatch_op_debug("buffer allocated", op);
+		}
+		dur->dur_opcode = DISPATCH_IO_URING_READ;
+		dur->dur_addr = (uintptr_t)op->buf + op->buf_len;
+		dur->dur_len = (uint32_t)(op->buf_siz - op->buf_len);
+		dur->dur_buf_index = uop->buf_index;
+	} else if (op->direction == DOP_DIR_WRITE) {
+		if (!op->buf_data) {
+			_dispatch_operation_buffer_map(op);
+		}
+		_dispatch_operation_uring_prepare_write(op, dur);
+	}
+	return 0;
+}
+
+static void
+_dispatch_disk_uring_handler(dispatch_disk_t disk)
+{
+	// On pick queue
+	// Each free advise_list slot takes one more operation in flight, every
+	// operation newly picked in this pass goes to the kernel in one batch
+	dispatch_io_uring_req_t head = NULL, *tailp = &head;
+	dispatch_operation_t op;
+	size_t i = 0;
+	_dispatch_disk_debug("disk uring handler", disk);
+	while (i < disk->advise_list_depth) {
+		if (disk->advise_list[i]) {
+			i++;
+			continue;
+		}
+		if (!(op = _dispatch_disk_pick_next_operation(disk))) {
 			break;
-		case DISPATCH_OP_DELIVER_AND_COMPLETE:
-			_dispatch_operation_deliver_data(op, DOP_DELIVER | DOP_NO_EMPTY);
+		}
+		int err = _dispatch_io_get_error(op, NULL, true);
+		if (!err) {
+			err = _dispatch_operation_uring_prepare(op);
+		}
+		if (err) {
+			op->err = err;
 			_dispatch_disk_complete_operation(disk, op);
-			break;
-		case DISPATCH_OP_ERR:
-			_dispatch_disk_cleanup_operations(disk, op->channel);
-			break;
-		case DISPATCH_OP_FD_ERR:
-			_dispatch_disk_cleanup_operations(disk, NULL);
-			break;
-		default:
-			dispatch_assert(result);
-			break;
+			continue;
 		}
-		_dispatch_op_debug("deactivate: disk %p", op, disk);
-		op->active = false;
-		disk->io_active = false;
-		_dispatch_disk_handler(disk);
-		// Balancing the retain in _dispatch_disk_handler. Note that op must be
-		// released at the very end, since it might hold the last reference to
-		// the disk
-		_dispatch_op_debug("release -> %d (disk perform complete)", op,
-				op->do_ref_cnt);
-		_dispatch_release(op);
-	});
+		_dispatch_retain(op);
+		_dispatch_op_debug("retain -> %d", op, op->do_ref_cnt + 1);
+		disk->advise_list[i] = op;
+		op->uring->slot = i;
+		op->active = true;
+		_dispatch_op_debug("activate: disk %p", op, disk);
+		*tailp = &op->uring->req;
+		tailp = &op->uring->req.dur_next;
+		i++;
+	}
+	if (head) {
+		_dispatch_io_uring_submit(head);
+	}
 }
+#endif // DISPATCH_USE_IO_URING
 
 #pragma mark -
 #pragma mark dispatch_operation_perform
@@ -2182,66 +2622,128 @@ _dispatch_operation_advise(dispatch_operation_t op, size_t chunk_size)
 #endif
 }
 
+static void
+_dispatch_operation_buffer_size(dispatch_operation_t op)
+{
+	size_t max_buf_siz = op->params.high;
+	size_t chunk_siz = dispatch_io_defaults.chunk_size;
+	if (op->direction == DOP_DIR_READ) {
+		// If necessary, create a buffer for the ongoing operation, large
+		// enough to fit chunk_size but at most high-water
+		size_t data_siz = dispatch_data_get_size(op->data);
+		if (data_siz) {
+			dispatch_assert(data_siz < max_buf_siz);
+			max_buf_siz -= data_siz;
+		}
+		if (max_buf_siz > chunk_siz) {
+			max_buf_siz = chunk_siz;
+		}
+		if (op->length < SIZE_MAX) {
+			op->buf_siz = op->length - op->total;
+			if (op->buf_siz > max_buf_siz) {
+				op->buf_siz = max_buf_siz;
+			}
+		} else {
+			op->buf_siz = max_buf_siz;
+		}
+	} else if (op->direction == DOP_DIR_WRITE) {
+		// Always write the first data piece, if that is smaller than a
+		// chunk, accumulate further data pieces until chunk size is reached
+		if (chunk_siz > max_buf_siz) {
+			chunk_siz = max_buf_siz;
+		}
+		op->buf_siz = 0;
+		dispatch_data_apply(op->data,
+				^(dispatch_data_t region DISPATCH_UNUSED,
+				size_t offset DISPATCH_UNUSED,
+				const void* buf DISPATCH_UNUSED, size_t len) {
+			size_t siz = op->buf_siz + len;
+			if (!op->buf_siz || siz <= chunk_siz) {
+				op->buf_siz = siz;
+			}
+			return (bool)(siz < chunk_siz);
+		});
+		if (op->buf_siz > max_buf_siz) {
+			op->buf_siz = max_buf_siz;
+		}
+	}
+}
+
+static void
+_dispatch_operation_buffer_map(dispatch_operation_t op)
+{
+	// Map the next chunk of the data to write as the array of its regions,
+	// discontiguous data is gathered by writev rather than copied
+	dispatch_data_t d;
+	_dispatch_operation_buffer_size(op);
+	d = dispatch_data_create_subrange(op->data, 0, op->buf_siz);
+	op->buf_data = dispatch_data_create_map_iovec(d, &op->buf_iov,
+			&op->buf_iovcnt);
+	_dispatch_io_data_release(d);
+	_dispatch_op_debug("buffer mapped", op);
+}
+
+static const struct iovec *
+_dispatch_operation_buffer_iov(dispatch_operation_t op, size_t *skip_ptr,
+		size_t *cnt_ptr)
+{
+	// Find the first region of the chunk that is not completely written yet
+	const struct iovec *iov = op->buf_iov;
+	size_t skip = op->buf_len;
+	while (skip >= iov->iov_len) {
+		skip -= iov->iov_len;
+		iov++;
+	}
+	*skip_ptr = skip;
+	*cnt_ptr = op->buf_iovcnt - (size_t)(iov - op->buf_iov);
+	return iov;
+}
+
+static ssize_t
+_dispatch_operation_write(dispatch_operation_t op, off_t off)
+{
+	// Write the remaining regions of the chunk with a single writev, the rest
+	// of a partially written region goes out on its own first
+	dispatch_fd_t fd = op->fd_entry->fd;
+	size_t skip, cnt;
+	const struct iovec *iov = _dispatch_operation_buffer_iov(op, &skip, &cnt);
+	if (skip || cnt == 1) {
+		const void *buf = (const char *)iov->iov_base + skip;
+		size_t len = iov->iov_len - skip;
+		if (op->params.type == DISPATCH_IO_STREAM) {
+			return write(fd, buf, len);
+		}
+		return pwrite(fd, buf, len, off);
+	}
+	if (cnt > DIO_MAX_IOV) {
+		cnt = DIO_MAX_IOV;
+	}
+	if (op->params.type == DISPATCH_IO_STREAM) {
+		return writev(fd, iov, (int)cnt);
+	}
+#if HAVE_PWRITEV
+	return pwritev(fd, iov, (int)cnt, off);
+#else
+	return pwrite(fd, iov->iov_base, iov->iov_len, off);
+#endif
+}
+
 static int
 _dispatch_operation_perform(dispatch_operation_t op)
 {
 	_dispatch_op_debug("perform", op);
+	ssize_t processed = -1;
 	int err = _dispatch_io_get_error(op, NULL, true);
 	if (err) {
 		goto error;
 	}
 	_dispatch_object_debug(op, "%s", __func__);
-	if (!op->buf) {
-		size_t max_buf_siz = op->params.high;
-		size_t chunk_siz = dispatch_io_defaults.chunk_size;
-		if (op->direction == DOP_DIR_READ) {
-			// If necessary, create a buffer for the ongoing operation, large
-			// enough to fit chunk_size but at most high-water
-			size_t data_siz = dispatch_data_get_size(op->data);
-			if (data_siz) {
-				dispatch_assert(data_siz < max_buf_siz);
-				max_buf_siz -= data_siz;
-			}
-			if (max_buf_siz > chunk_siz) {
-				max_buf_siz = chunk_siz;
-			}
-			if (op->length < SIZE_MAX) {
-				op->buf_siz = op->length - op->total;
-				if (op->buf_siz > max_buf_siz) {
-					op->buf_siz = max_buf_siz;
-				}
-			} else {
-				op->buf_siz = max_buf_siz;
-			}
-			op->buf = valloc(op->buf_siz);
-			_dispatch_op_debug("buffer allocated", op);
-		} else if (op->direction == DOP_DIR_WRITE) {
-			// Always write the first data piece, if that is smaller than a
-			// chunk, accumulate further data pieces until chunk size is reached
-			if (chunk_siz > max_buf_siz) {
-				chunk_siz = max_buf_siz;
-			}
-			op->buf_siz = 0;
-			dispatch_data_apply(op->data,
-					^(dispatch_data_t region DISPATCH_UNUSED,
-					size_t offset DISPATCH_UNUSED,
-					const void* buf DISPATCH_UNUSED, size_t len) {
-				size_t siz = op->buf_siz + len;
-				if (!op->buf_siz || siz <= chunk_siz) {
-					op->buf_siz = siz;
-				}
-				return (bool)(siz < chunk_siz);
-			});
-			if (op->buf_siz > max_buf_siz) {
-				op->buf_siz = max_buf_siz;
-			}
-			dispatch_data_t d;
-			d = dispatch_data_create_subrange(op->data, 0, op->buf_siz);
-			op->buf_data = dispatch_data_create_map(d, (const void**)&op->buf,
-					NULL);
-			_dispatch_io_data_release(d);
-			_dispatch_op_debug("buffer mapped", op);
-		}
+	if (op->direction == DOP_DIR_READ && !op->buf) {
+		_dispatch_operation_buffer_size(op);
+		op->buf = valloc(op->buf_siz);
+		_dispatch_op_debug("buffer allocated", op);
+	} else if (op->direction == DOP_DIR_WRITE && !op->buf_data) {
+		_dispatch_operation_buffer_map(op);
 	}
 	if (op->fd_entry->fd == -1) {
 		err = _dispatch_fd_entry_open(op->fd_entry, op->channel);
@@ -2249,23 +2751,18 @@ _dispatch_operation_perform(dispatch_operation_t op)
 			goto error;
 		}
 	}
-	void *buf = op->buf + op->buf_len;
-	size_t len = op->buf_siz - op->buf_len;
 	off_t off = (off_t)((size_t)op->offset + op->total);
-	ssize_t processed = -1;
 syscall:
 	if (op->direction == DOP_DIR_READ) {
+		void *buf = op->buf + op->buf_len;
+		size_t len = op->buf_siz - op->buf_len;
 		if (op->params.type == DISPATCH_IO_STREAM) {
 			processed = read(op->fd_entry->fd, buf, len);
 		} else if (op->params.type == DISPATCH_IO_RANDOM) {
 			processed = pread(op->fd_entry->fd, buf, len, off);
 		}
 	} else if (op->direction == DOP_DIR_WRITE) {
-		if (op->params.type == DISPATCH_IO_STREAM) {
-			processed = write(op->fd_entry->fd, buf, len);
-		} else if (op->params.type == DISPATCH_IO_RANDOM) {
-			processed = pwrite(op->fd_entry->fd, buf, len, off);
-		}
+		processed = _dispatch_operation_write(op, off);
 	}
 	// Encountered an error on the file descriptor
 	if (processed == -1) {
@@ -2273,6 +2770,16 @@ syscall:
 		if (err == EINTR) {
 			goto syscall;
 		}
+	}
+error:
+	return _dispatch_operation_performed(op, processed, err);
+}
+
+static int
+_dispatch_operation_performed(dispatch_operation_t op, ssize_t processed,
+		int err)
+{
+	if (processed == -1) {
 		goto error;
 	}
 	// EOF is indicated by two handler invocations
@@ -2345,6 +2852,17 @@ _dispatch_operation_deliver_data(dispatch_operation_t op,
 	if (op->direction == DOP_DIR_READ) {
 		if (op->buf_len) {
 			void *buf = op->buf;
+#if DISPATCH_USE_IO_URING
+			if (op->uring && op->uring->buf_index >= 0) {
+				// Registered buffers go back to the io_uring pool once the
+				// data object handed to the client is released
+				int16_t buf_index = op->uring->buf_index;
+				op->uring->buf_index = -1;
+				data = dispatch_data_create(buf, op->buf_len, NULL, ^{
+					_dispatch_io_uring_buffer_put(buf_index);
+				});
+			} else
+#endif
 			data = dispatch_data_create(buf, op->buf_len, NULL,
 					DISPATCH_DATA_DESTRUCTOR_FREE);
 			op->buf = NULL;
@@ -2365,7 +2883,8 @@ _dispatch_operation_deliver_data(dispatch_operation_t op,
 		if (op->buf_data && op->buf_len == op->buf_siz) {
 			_dispatch_io_data_release(op->buf_data);
 			op->buf_data = NULL;
-			op->buf = NULL;
+			op->buf_iov = NULL;
+			op->buf_iovcnt = 0;
 			op->buf_len = 0;
 			// Trim newly written buffer from head of unwritten data
 			dispatch_data_t d;
@@ -46,6 +46,11 @@
 
 #define DIO_DEFAULT_LOW_WATER_CHUNKS	  1u // default low-water mark
 #define DIO_MAX_PENDING_IO_REQS			  6u // Pending I/O read advises
+#ifdef IOV_MAX
+#define DIO_MAX_IOV				IOV_MAX // regions gathered per writev
+#else
+#define DIO_MAX_IOV				 16u
+#endif
 
 typedef unsigned int dispatch_op_direction_t;
 enum {
@@ -66,6 +71,18 @@ typedef unsigned int dispatch_op_flags_t;
 #define DIO_CLOSED		1u // channel has been closed
 #define DIO_STOPPED		2u // channel has been stopped (implies closed)
 
+#if DISPATCH_USE_IO_URING
+#define DIO_URING_MAX_IOV				 16u // regions gathered per write
+
+// io_uring state of a disk operation, allocated on its first submission
+struct dispatch_operation_uring_s {
+	struct dispatch_io_uring_req_s req;
+	size_t slot; // index in the disk advise_list while in flight
+	int16_t buf_index; // registered buffer backing a read op->buf, or -1
+	struct iovec iov[DIO_URING_MAX_IOV];
+};
+#endif
+
 DISPATCH_INTERNAL_CLASS_DECL(operation);
 DISPATCH_INTERNAL_CLASS_DECL(disk);
 
@@ -158,6 +175,11 @@ struct dispatch_operation_s {
 	dispatch_op_flags_t flags;
 	size_t buf_siz, buf_len, undelivered, total;
 	dispatch_data_t buf_data, data;
+	const struct iovec *buf_iov; // write chunk regions, mapped by buf_data
+	size_t buf_iovcnt;
+#if DISPATCH_USE_IO_URING
+	struct dispatch_operation_uring_s *uring;
+#endif
 	TAILQ_ENTRY(dispatch_operation_s) operation_list;
 	// the request list in the fd_entry stream_ops
 	TAILQ_ENTRY(dispatch_operation_s) stream_list;
@@ -176,6 +198,24 @@ struct dispatch_io_s {
 	int err; // contains creation errors only
 };
 
+#if HAVE_SPLICE
+// State of a dispatch_splice_f transfer, only touched on its queue
+struct dispatch_splice_s {
+	dispatch_fd_t from_fd, to_fd;
+	int orig_from_flags, orig_to_flags;
+	int pipe[2]; // bytes moved out of from_fd, not yet into to_fd
+	size_t pipe_siz, buffered, length, total;
+	bool eof, read_armed, write_armed;
+	dispatch_queue_t queue; // serializes the transfer and its sources
+	dispatch_source_t read_source, write_source;
+	dispatch_queue_t handler_q;
+	void *ctxt;
+	void (*handler)(void *ctxt, size_t transferred, int error);
+};
+
+typedef struct dispatch_splice_s *dispatch_splice_t;
+#endif
+
 void _dispatch_io_set_target_queue(dispatch_io_t channel, dispatch_queue_t dq);
 size_t _dispatch_io_debug(dispatch_io_t channel, char* buf, size_t bufsiz);
 void _dispatch_io_dispose(dispatch_io_t channel, bool *allow_free);
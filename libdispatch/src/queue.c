@@ -4638,7 +4638,11 @@ DISPATCH_NOINLINE
 void
 _dispatch_global_queue_poke(dispatch_queue_t dq, int n, int floor)
 {
-	if (!_dispatch_queue_class_probe(dq)) {
+	if (!_dispatch_queue_class_probe(dq)
+#if DISPATCH_USE_WORKQ_DEQUE
+			&& !_dispatch_workq_deque_probe(dq)
+#endif
+			) {
 		return;
 	}
 #if DISPATCH_USE_WORKQUEUES
@@ -5448,6 +5452,12 @@ _dispatch_root_queue_push(dispatch_queue_t rq, dispatch_object_t dou,
 	}
 #else
 	(void)qos;
+#endif
+#if DISPATCH_USE_WORKQ_DEQUE
+	if (_dispatch_workq_deque_push(rq, dou._do)) {
+		_dispatch_trace_continuation_push(rq, dou);
+		return;
+	}
 #endif
 	_dispatch_root_queue_push_inline(rq, dou, dou, 1);
 }
@@ -5764,6 +5774,24 @@ out:
 	return head;
 }
 
+DISPATCH_ALWAYS_INLINE_NDEBUG
+static inline struct dispatch_object_s *
+_dispatch_root_queue_drain_next(dispatch_queue_t dq)
+{
+	struct dispatch_object_s *item;
+#if DISPATCH_USE_WORKQ_DEQUE
+	// The deques hold older items than the shared list: our own deque
+	// first, then the other workers', then the shared list
+	if ((item = _dispatch_workq_deque_pop(dq))) {
+		return item;
+	}
+	if ((item = _dispatch_workq_deque_steal(dq))) {
+		return item;
+	}
+#endif
+	return _dispatch_root_queue_drain_one(dq);
+}
+
 #if DISPATCH_USE_KEVENT_WORKQUEUE
 void
 _dispatch_root_queue_drain_deferred_wlh(dispatch_deferred_items_t ddi
@@ -5882,7 +5910,7 @@ _dispatch_root_queue_drain(dispatch_queue_t dq, pthread_priority_t pp)
 			DISPATCH_INVOKE_REDIRECTING_DRAIN;
 	_dispatch_queue_drain_init_narrowing_check_deadline(&dic, pri);
 	_dispatch_perfmon_start();
-	while ((item = fastpath(_dispatch_root_queue_drain_one(dq)))) {
+	while ((item = fastpath(_dispatch_root_queue_drain_next(dq)))) {
 		if (reset) _dispatch_wqthread_override_reset();
 		_dispatch_continuation_pop_inline(item, &dic, flags, dq);
 		reset = _dispatch_reset_basepri_override();
@@ -5993,8 +6021,14 @@ _dispatch_worker_thread(void *context)
 	const int64_t timeout = 5ull * NSEC_PER_SEC;
 	pthread_priority_t old_pri = _dispatch_get_priority();
 	do {
+#if DISPATCH_USE_INTERNAL_WORKQUEUE
+		_dispatch_workq_worker_set_busy(true);
+#endif
 		_dispatch_root_queue_drain(dq, old_pri);
 		_dispatch_reset_priority_and_voucher(old_pri, NULL);
+#if DISPATCH_USE_INTERNAL_WORKQUEUE
+		_dispatch_workq_worker_set_busy(false);
+#endif
 	} while (dispatch_semaphore_wait(&pqc->dpq_thread_mediator,
 			dispatch_time(0, timeout)) == 0);
 
@@ -963,6 +963,17 @@ _dispatch_set_priority_and_mach_voucher_slow(pthread_priority_t pri,
 #pragma mark -
 #pragma mark dispatch_apply_t
 
+// One contiguous range of iterations per participating thread, packed as
+// [begin, end) in 32 bits each so that it can be updated with a single CAS
+typedef struct dispatch_apply_range_s {
+	uint64_t volatile dar_bounds;
+} DISPATCH_CACHELINE_ALIGN *dispatch_apply_range_t;
+
+typedef struct dispatch_apply_ranges_s {
+	uint32_t dars_count;
+	struct dispatch_apply_range_s dars_range[];
+} *dispatch_apply_ranges_t;
+
 struct dispatch_apply_s {
 	size_t volatile da_index, da_todo;
 	size_t da_iterations, da_nested;
@@ -970,6 +981,7 @@ struct dispatch_apply_s {
 	dispatch_thread_event_s da_event;
 	dispatch_invoke_flags_t da_flags;
 	int32_t da_thr_cnt;
+	dispatch_apply_ranges_t da_ranges;
 };
 typedef struct dispatch_apply_s *dispatch_apply_t;
 
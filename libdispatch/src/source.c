@@ -1860,6 +1860,238 @@ _dispatch_timer_heap_update(dispatch_timer_heap_t dth,
 	_dispatch_timer_heap_resift(dth, dt, dt->dt_heap_entry[DTH_DEADLINE_ID]);
 }
 
+#if DISPATCH_USE_TIMER_WHEEL
+/*
+ * Timers whose leeway spans at least a tick are kept in a hierarchical timing
+ * wheel rather than in the heap. The wheel has DTW_LEVEL_COUNT levels of
+ * DTW_LEVEL_SLOTS slots, a level L slot spans DTW_LEVEL_SLOTS^L ticks of
+ * 2^DTW_TICK_SHIFT clock units.
+ *
+ * Each timer fires at the tick with the most trailing zeroes between its
+ * target and deadline, timers with overlapping windows thus share ticks and
+ * a whole slot of them costs one wakeup. Inserting, moving and removing a
+ * timer is O(1) instead of two heap resifts.
+ *
+ * A timer is held at the level of the most significant base DTW_LEVEL_SLOTS
+ * digit in which its tick differs from dtw_now, in the slot of that digit.
+ * When dtw_now reaches the first tick of a slot above level 0, the slot is
+ * cascaded into the lower levels. Timers due by dtw_now move to the heap,
+ * which fires them. Timers too far out for the top level stay in the heap.
+ */
+#define DTW_LEVEL_MASK ((uint64_t)DTW_LEVEL_SLOTS - 1)
+#define DTW_DIGIT(tick, level) \
+		((uint32_t)(((tick) >> ((level) * DTW_LEVEL_SHIFT)) & DTW_LEVEL_MASK))
+#define DTW_MAX_COALESCING_SHIFT (DTW_LEVEL_SHIFT * (DTW_LEVEL_COUNT - 1))
+
+static struct dispatch_timer_wheel_stats_s _dispatch_timer_wheel_stats;
+static bool _dispatch_timer_wheel_disabled;
+
+static void
+_dispatch_timer_wheel_init(void *ctxt DISPATCH_UNUSED)
+{
+	_dispatch_timer_wheel_disabled =
+			slowpath(getenv("LIBDISPATCH_DISABLE_TIMER_WHEEL"));
+}
+
+DISPATCH_ALWAYS_INLINE
+static inline bool
+_dispatch_timer_wheel_contains(dispatch_timer_source_refs_t dt)
+{
+	return dt->dt_heap_entry[DTH_TARGET_ID] == DTH_WHEEL_ID;
+}
+
+DISPATCH_ALWAYS_INLINE
+static inline uint64_t
+_dispatch_timer_wheel_tick(dispatch_timer_source_refs_t dt)
+{
+	uint64_t first, last;
+	uint32_t bit;
+
+	first = (dt->dt_timer.target >> DTW_TICK_SHIFT) +
+			!!(dt->dt_timer.target & ((1ull << DTW_TICK_SHIFT) - 1));
+	last = dt->dt_timer.deadline >> DTW_TICK_SHIFT;
+	if (last < first || !first) {
+		return 0;
+	}
+	// Clearing the bits below the highest one that differs between first - 1
+	// and last yields a tick no earlier than first
+	bit = 63 - (uint32_t)__builtin_clzll((first - 1) ^ last);
+	if (bit > DTW_MAX_COALESCING_SHIFT) {
+		bit = DTW_MAX_COALESCING_SHIFT;
+	}
+	return last & ~((1ull << bit) - 1);
+}
+
+DISPATCH_ALWAYS_INLINE
+static inline void
+_dispatch_timer_wheel_link(dispatch_timer_wheel_t dtw,
+		dispatch_timer_source_refs_t dt, uint64_t tick)
+{
+	uint64_t diff = tick ^ dtw->dtw_now;
+	uint32_t level = (63 - (uint32_t)__builtin_clzll(diff)) / DTW_LEVEL_SHIFT;
+	uint32_t slot = DTW_DIGIT(tick, level);
+
+	DISPATCH_TIMER_ASSERT(tick, >, dtw->dtw_now, "wheel tick");
+	LIST_INSERT_HEAD(&dtw->dtw_slots[level][slot], dt, dt_wheel_list);
+	dtw->dtw_occupied[level] |= 1ull << slot;
+	dt->dt_heap_entry[DTH_TARGET_ID] = DTH_WHEEL_ID;
+	dt->dt_heap_entry[DTH_DEADLINE_ID] = level * DTW_LEVEL_SLOTS + slot;
+}
+
+DISPATCH_ALWAYS_INLINE
+static inline void
+_dispatch_timer_wheel_unlink(dispatch_timer_wheel_t dtw,
+		dispatch_timer_source_refs_t dt)
+{
+	uint32_t level = dt->dt_heap_entry[DTH_DEADLINE_ID] / DTW_LEVEL_SLOTS;
+	uint32_t slot = dt->dt_heap_entry[DTH_DEADLINE_ID] % DTW_LEVEL_SLOTS;
+
+	LIST_REMOVE(dt, dt_wheel_list);
+	if (LIST_EMPTY(&dtw->dtw_slots[level][slot])) {
+		dtw->dtw_occupied[level] &= ~(1ull << slot);
+	}
+	dt->dt_heap_entry[DTH_TARGET_ID] = DTH_INVALID_ID;
+	dt->dt_heap_entry[DTH_DEADLINE_ID] = DTH_INVALID_ID;
+}
+
+// Returns the tick the timer should be held at in the wheel, or 0 if it
+// belongs to the heap
+static uint64_t
+_dispatch_timer_wheel_place(dispatch_timer_heap_t dth,
+		dispatch_timer_source_refs_t dt, uint32_t tidx)
+{
+	static dispatch_once_t pred;
+	dispatch_timer_wheel_t dtw = dth->dth_wheel;
+	uint64_t tick;
+
+	dispatch_once_f(&pred, NULL, _dispatch_timer_wheel_init);
+	if (_dispatch_timer_wheel_disabled ||
+			(dt->du_fflags & DISPATCH_TIMER_STRICT)) {
+		return 0;
+	}
+	tick = _dispatch_timer_wheel_tick(dt);
+	if (!tick) {
+		return 0;
+	}
+	if (unlikely(!dtw)) {
+		dtw = _dispatch_calloc(1ul, sizeof(struct dispatch_timer_wheel_s));
+		dth->dth_wheel = dtw;
+	}
+	if (!dtw->dtw_count) {
+		// Nothing to cascade, an empty wheel can be moved to the present
+		dispatch_clock_t clock = DISPATCH_TIMER_CLOCK(tidx);
+		dtw->dtw_now = _dispatch_time_now(clock) >> DTW_TICK_SHIFT;
+	}
+	if (tick <= dtw->dtw_now ||
+			((tick ^ dtw->dtw_now) >> (DTW_LEVEL_SHIFT * DTW_LEVEL_COUNT))) {
+		// Already due, or beyond the top level
+		return 0;
+	}
+	return tick;
+}
+
+static void
+_dispatch_timer_wheel_insert(dispatch_timer_heap_t dth,
+		dispatch_timer_source_refs_t dt, uint64_t tick)
+{
+	_dispatch_timer_wheel_link(dth->dth_wheel, dt, tick);
+	dth->dth_wheel->dtw_count++;
+	os_atomic_inc(&_dispatch_timer_wheel_stats.timers, relaxed);
+}
+
+static void
+_dispatch_timer_wheel_remove(dispatch_timer_heap_t dth,
+		dispatch_timer_source_refs_t dt)
+{
+	_dispatch_timer_wheel_unlink(dth->dth_wheel, dt);
+	dth->dth_wheel->dtw_count--;
+	os_atomic_dec(&_dispatch_timer_wheel_stats.timers, relaxed);
+}
+
+static uint64_t
+_dispatch_timer_wheel_next_tick(dispatch_timer_wheel_t dtw)
+{
+	// Slots at lower levels all come before the next slot of a higher level
+	for (uint32_t level = 0; level < DTW_LEVEL_COUNT; level++) {
+		uint32_t shift = level * DTW_LEVEL_SHIFT;
+		uint32_t digit = DTW_DIGIT(dtw->dtw_now, level);
+		uint64_t later = dtw->dtw_occupied[level];
+		later &= digit == DTW_LEVEL_MASK ? 0 : ~0ull << (digit + 1);
+		if (later) {
+			uint64_t tick = dtw->dtw_now >> (shift + DTW_LEVEL_SHIFT);
+			tick = (tick << DTW_LEVEL_SHIFT) | (uint64_t)__builtin_ctzll(later);
+			return tick << shift;
+		}
+	}
+	return UINT64_MAX;
+}
+
+DISPATCH_ALWAYS_INLINE
+static inline uint64_t
+_dispatch_timer_wheel_next(dispatch_timer_wheel_t dtw)
+{
+	if (!dtw || !dtw->dtw_count) {
+		return UINT64_MAX;
+	}
+	return _dispatch_timer_wheel_next_tick(dtw) << DTW_TICK_SHIFT;
+}
+
+// Moves the timers due by `now` over to the heap, returns whether the wheel
+// changed
+static bool
+_dispatch_timer_wheel_advance(dispatch_timer_heap_t dth, uint64_t now)
+{
+	dispatch_timer_wheel_t dtw = dth->dth_wheel;
+	dispatch_timer_source_refs_t dt;
+	uint64_t tick, limit = now >> DTW_TICK_SHIFT;
+	bool changed = false;
+
+	while (dtw->dtw_count &&
+			(tick = _dispatch_timer_wheel_next_tick(dtw)) <= limit) {
+		uint32_t level = DTW_LEVEL_COUNT, slot, expired = 0, cascaded = 0;
+		dtw->dtw_now = tick;
+		while (level-- > 0) {
+			slot = DTW_DIGIT(tick, level);
+			if (!(dtw->dtw_occupied[level] & (1ull << slot))) {
+				continue;
+			}
+			// Timers of this slot either are due or now belong to a slot
+			// after the current one of a lower level
+			while ((dt = LIST_FIRST(&dtw->dtw_slots[level][slot]))) {
+				uint64_t t = level ? _dispatch_timer_wheel_tick(dt) : tick;
+				_dispatch_timer_wheel_unlink(dtw, dt);
+				if (t > tick) {
+					_dispatch_timer_wheel_link(dtw, dt, t);
+					cascaded++;
+				} else {
+					dtw->dtw_count--;
+					_dispatch_timer_heap_insert(dth, dt);
+					expired++;
+				}
+			}
+		}
+		if (expired) {
+			os_atomic_sub(&_dispatch_timer_wheel_stats.timers, expired,
+					relaxed);
+			os_atomic_add(&_dispatch_timer_wheel_stats.expired, expired,
+					relaxed);
+			os_atomic_inc(&_dispatch_timer_wheel_stats.batches, relaxed);
+		}
+		if (cascaded) {
+			os_atomic_add(&_dispatch_timer_wheel_stats.cascades, cascaded,
+					relaxed);
+		}
+		changed = true;
+	}
+	// No slot starts before the next tick, which keeps the placement of
+	// every timer valid relative to the new dtw_now
+	if (limit > dtw->dtw_now) {
+		dtw->dtw_now = limit;
+	}
+	return changed;
+}
+#endif // DISPATCH_USE_TIMER_WHEEL
+
 DISPATCH_ALWAYS_INLINE
 static bool
 _dispatch_timer_heap_has_new_min(dispatch_timer_heap_t dth,
@@ -1867,7 +2099,7 @@ _dispatch_timer_heap_has_new_min(dispatch_timer_heap_t dth,
 {
 	dispatch_timer_source_refs_t dt;
 	bool changed = false;
-	uint64_t tmp;
+	uint64_t tmp, wheel = UINT64_MAX;
 	uint32_t tidx;
 
 	for (tidx = 0; tidx < count; tidx++) {
@@ -1875,14 +2107,20 @@ _dispatch_timer_heap_has_new_min(dispatch_timer_heap_t dth,
 			continue;
 		}
 
+#if DISPATCH_USE_TIMER_WHEEL
+		// The next wheel tick is both a target and a deadline
+		wheel = _dispatch_timer_wheel_next(dth[tidx].dth_wheel);
+#endif
 		dt = dth[tidx].dth_min[DTH_TARGET_ID];
 		tmp = dt ? dt->dt_timer.target : UINT64_MAX;
+		tmp = MIN(tmp, wheel);
 		if (dth[tidx].dth_target != tmp) {
 			dth[tidx].dth_target = tmp;
 			changed = true;
 		}
 		dt = dth[tidx].dth_min[DTH_DEADLINE_ID];
 		tmp = dt ? dt->dt_timer.deadline : UINT64_MAX;
+		tmp = MIN(tmp, wheel);
 		if (dth[tidx].dth_deadline != tmp) {
 			dth[tidx].dth_deadline = tmp;
 			changed = true;
@@ -1897,6 +2135,11 @@ _dispatch_timers_unregister(dispatch_timer_source_refs_t dt)
 	uint32_t tidx = dt->du_ident;
 	dispatch_timer_heap_t heap = &_dispatch_timers_heap[tidx];
 
+#if DISPATCH_USE_TIMER_WHEEL
+	if (_dispatch_timer_wheel_contains(dt)) {
+		_dispatch_timer_wheel_remove(heap, dt);
+	} else
+#endif
 	_dispatch_timer_heap_remove(heap, dt);
 	_dispatch_timers_reconfigure = true;
 	_dispatch_timers_processing_mask |= 1 << tidx;
@@ -1908,6 +2151,28 @@ static inline void
 _dispatch_timers_register(dispatch_timer_source_refs_t dt, uint32_t tidx)
 {
 	dispatch_timer_heap_t heap = &_dispatch_timers_heap[tidx];
+#if DISPATCH_USE_TIMER_WHEEL
+	uint64_t tick = _dispatch_timer_wheel_place(heap, dt, tidx);
+	if (_dispatch_unote_registered(dt)) {
+		DISPATCH_TIMER_ASSERT(dt->du_ident, ==, tidx, "tidx");
+		if (_dispatch_timer_wheel_contains(dt)) {
+			_dispatch_timer_wheel_remove(heap, dt);
+		} else if (tick) {
+			_dispatch_timer_heap_remove(heap, dt);
+		} else {
+			_dispatch_timer_heap_update(heap, dt);
+			goto done;
+		}
+	} else {
+		dt->du_ident = tidx;
+	}
+	if (tick) {
+		_dispatch_timer_wheel_insert(heap, dt, tick);
+	} else {
+		_dispatch_timer_heap_insert(heap, dt);
+	}
+done:
+#else
 	if (_dispatch_unote_registered(dt)) {
 		DISPATCH_TIMER_ASSERT(dt->du_ident, ==, tidx, "tidx");
 		_dispatch_timer_heap_update(heap, dt);
@@ -1915,6 +2180,7 @@ _dispatch_timers_register(dispatch_timer_source_refs_t dt, uint32_t tidx)
 		dt->du_ident = tidx;
 		_dispatch_timer_heap_insert(heap, dt);
 	}
+#endif
 	_dispatch_timers_reconfigure = true;
 	_dispatch_timers_processing_mask |= 1 << tidx;
 	dispatch_assert(dt->du_wlh == NULL || dt->du_wlh == DISPATCH_WLH_ANON);
@@ -2137,6 +2403,17 @@ _dispatch_timers_run(dispatch_clock_now_cache_t nows)
 {
 	uint32_t tidx;
 	for (tidx = 0; tidx < DISPATCH_TIMER_COUNT; tidx++) {
+#if DISPATCH_USE_TIMER_WHEEL
+		dispatch_timer_heap_t dth = &_dispatch_timers_heap[tidx];
+		if (dth->dth_wheel && dth->dth_wheel->dtw_count) {
+			dispatch_clock_t clock = DISPATCH_TIMER_CLOCK(tidx);
+			uint64_t now = _dispatch_time_now_cached(clock, nows);
+			if (_dispatch_timer_wheel_advance(dth, now)) {
+				_dispatch_timers_reconfigure = true;
+				_dispatch_timers_processing_mask |= 1 << tidx;
+			}
+		}
+#endif
 		if (_dispatch_timers_heap[tidx].dth_count) {
 			_dispatch_timers_run2(nows, tidx);
 		}
@@ -2292,6 +2569,30 @@ _dispatch_mgr_timers(void)
 	return expired;
 }
 
+size_t
+dispatch_timer_wheel_get_stats(dispatch_timer_wheel_stats_t stats, size_t size)
+{
+	struct dispatch_timer_wheel_stats_s snapshot = { };
+	size_t target_size = MIN(size,
+			sizeof(struct dispatch_timer_wheel_stats_s));
+#if DISPATCH_USE_TIMER_WHEEL
+	snapshot.timers = os_atomic_load2o(&_dispatch_timer_wheel_stats, timers,
+			relaxed);
+	snapshot.expired = os_atomic_load2o(&_dispatch_timer_wheel_stats, expired,
+			relaxed);
+	snapshot.batches = os_atomic_load2o(&_dispatch_timer_wheel_stats, batches,
+			relaxed);
+	snapshot.cascades = os_atomic_load2o(&_dispatch_timer_wheel_stats,
+			cascades, relaxed);
+#endif
+	memcpy(stats, &snapshot, target_size);
+	if (size > sizeof(struct dispatch_timer_wheel_stats_s)) {
+		memset((char *)stats + sizeof(struct dispatch_timer_wheel_stats_s),
+				0, size - sizeof(struct dispatch_timer_wheel_stats_s));
+	}
+	return target_size;
+}
+
 #pragma mark -
 #pragma mark dispatch_mgr
 
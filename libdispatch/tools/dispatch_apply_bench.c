@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) 2017 Apple Inc. All rights reserved.
+ *
+ * @APPLE_APACHE_LICENSE_HEADER_START@
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @APPLE_APACHE_LICENSE_HEADER_END@
+ */
+
+/*
+ * Per-iteration cost of dispatch_apply_f, measured with dispatch_benchmark()
+ * next to the same loop body run serially. With the empty body the apply
+ * column is the overhead dispatch_apply adds to every iteration.
+ *
+ *   dispatch_apply_bench [-a] [-r repeat]
+ *
+ * -a uses the single shared iteration index instead of per-thread ranges
+ * (LIBDISPATCH_DISABLE_APPLY_RANGES). Each size is run with an empty body
+ * and with a body touching one array element, the latter shows whether
+ * threads keep to contiguous, cache-friendly parts of the array.
+ *
+ * cc -O2 -fblocks -o dispatch_apply_bench dispatch_apply_bench.c \
+ *     -ldispatch -lBlocksRuntime
+ */
+
+#include <dispatch/dispatch.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// from <dispatch/private.h>
+extern uint64_t dispatch_benchmark_f(size_t count, void *ctxt,
+		void (*func)(void *));
+
+struct bench_s {
+	size_t iterations;
+	void (*body)(void *, size_t);
+	double *array;
+};
+
+static void
+empty_body(void *ctxt, size_t i)
+{
+	(void)ctxt; (void)i;
+	__asm__ __volatile__("" ::: "memory");
+}
+
+static void
+array_body(void *ctxt, size_t i)
+{
+	double *array = ctxt;
+	array[i] = array[i] * 1.0001 + 1.0;
+}
+
+static void
+run_apply(void *ctxt)
+{
+	struct bench_s *b = ctxt;
+	dispatch_apply_f(b->iterations, DISPATCH_APPLY_AUTO, b->array, b->body);
+}
+
+static void
+run_serial(void *ctxt)
+{
+	struct bench_s *b = ctxt;
+	for (size_t i = 0; i < b->iterations; i++) {
+		b->body(b->array, i);
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	static const size_t sizes[] = { 1000, 10000, 100000, 1000000, 10000000 };
+	size_t repeat = 20;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "ar:")) != -1) {
+		switch (opt) {
+		case 'a':
+			setenv("LIBDISPATCH_DISABLE_APPLY_RANGES", "1", 1);
+			break;
+		case 'r':
+			repeat = (size_t)atol(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: dispatch_apply_bench [-a] [-r repeat]\n");
+			return 1;
+		}
+	}
+	if (!repeat) {
+		repeat = 1;
+	}
+
+	double *array = calloc(sizes[sizeof(sizes) / sizeof(sizes[0]) - 1],
+			sizeof(double));
+	if (!array) {
+		perror("calloc");
+		return 1;
+	}
+	printf("%s index, %ld cpus\n", getenv("LIBDISPATCH_DISABLE_APPLY_RANGES") ?
+			"shared" : "ranged", sysconf(_SC_NPROCESSORS_ONLN));
+	printf("%10s %6s %14s %14s %8s\n", "iterations", "body", "apply ns/it",
+			"serial ns/it", "speedup");
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		for (int k = 0; k < 2; k++) {
+			struct bench_s b = {
+				.iterations = sizes[s],
+				.body = k ? array_body : empty_body,
+				.array = array,
+			};
+			// Warm up the thread pool before measuring
+			run_apply(&b);
+			double apply = (double)dispatch_benchmark_f(repeat, &b, run_apply);
+			double serial = (double)dispatch_benchmark_f(repeat, &b,
+					run_serial);
+			apply /= (double)b.iterations;
+			serial /= (double)b.iterations;
+			printf("%10zu %6s %14.3f %14.3f %8.2f\n", b.iterations,
+					k ? "array" : "empty", apply, serial, serial / apply);
+		}
+	}
+	free(array);
+	return 0;
+}
@@ -0,0 +1,237 @@
+/*
+ * Copyright (c) 2017 Apple Inc. All rights reserved.
+ *
+ * @APPLE_APACHE_LICENSE_HEADER_START@
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @APPLE_APACHE_LICENSE_HEADER_END@
+ */
+
+/*
+ * Random chunk reads (or writes) on regular files through dispatch_io, to
+ * compare the io_uring disk engine with the blocking pread/pwrite path:
+ *
+ *   dispatch_io_bench [-b] [-w] [-f files] [-s file-MB] [-c chunk-KB]
+ *                     [-q depth] [-n ops] [dir]
+ *
+ * Every file gets one DISPATCH_IO_RANDOM channel with -q operations kept
+ * outstanding on it. -b forces the blocking path by setting
+ * LIBDISPATCH_DISABLE_IO_URING before libdispatch is first used. The peak
+ * thread count is sampled while the operations run.
+ *
+ * cc -O2 -fblocks -o dispatch_io_bench dispatch_io_bench.c \
+ *     -ldispatch -lBlocksRuntime
+ */
+
+#include <dispatch/dispatch.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+static atomic_long remaining, issued, peak_threads;
+static dispatch_queue_t handler_q;
+static dispatch_group_t group;
+static dispatch_data_t write_data;
+static size_t chunk_size, file_chunks;
+static bool writing;
+
+static double
+now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static long
+thread_count(void)
+{
+	char line[128];
+	long n = 0;
+	FILE *f = fopen("/proc/self/status", "r");
+
+	if (f == NULL) {
+		return 0;
+	}
+	while (fgets(line, sizeof(line), f) != NULL) {
+		if (sscanf(line, "Threads: %ld", &n) == 1) {
+			break;
+		}
+	}
+	fclose(f);
+	return n;
+}
+
+static off_t
+next_offset(void)
+{
+	// Spread the chunks over the file without a shared RNG state
+	uint64_t x = (uint64_t)atomic_fetch_add(&issued, 1) + 1;
+
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccdULL;
+	x ^= x >> 33;
+	return (off_t)((x % file_chunks) * chunk_size);
+}
+
+static void
+issue(dispatch_io_t channel)
+{
+	if (atomic_fetch_sub(&remaining, 1) <= 0) {
+		dispatch_group_leave(group);
+		return;
+	}
+	dispatch_io_handler_t handler = ^(bool done, dispatch_data_t data,
+			int error) {
+		(void)data;
+		if (error) {
+			fprintf(stderr, "dispatch_io_bench: %s\n", strerror(error));
+			exit(1);
+		}
+		if (done) {
+			issue(channel);
+		}
+	};
+	if (writing) {
+		dispatch_io_write(channel, next_offset(), write_data, handler_q,
+				handler);
+	} else {
+		dispatch_io_read(channel, next_offset(), chunk_size, handler_q,
+				handler);
+	}
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: dispatch_io_bench [-b] [-w] [-f files] "
+			"[-s file-MB] [-c chunk-KB] [-q depth] [-n ops] [dir]\n");
+	exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+	int files = 4, depth = 16, opt, i;
+	long ops = 200000;
+	size_t file_size = 64u << 20;
+	const char *dir = "/tmp";
+	bool blocking = false;
+	char path[1024];
+	char *buf;
+
+	chunk_size = 64u << 10;
+	while ((opt = getopt(argc, argv, "bc:f:n:q:s:w")) != -1) {
+		switch (opt) {
+		case 'b': blocking = true; break;
+		case 'c': chunk_size = (size_t)atol(optarg) << 10; break;
+		case 'f': files = atoi(optarg); break;
+		case 'n': ops = atol(optarg); break;
+		case 'q': depth = atoi(optarg); break;
+		case 's': file_size = (size_t)atol(optarg) << 20; break;
+		case 'w': writing = true; break;
+		default: usage();
+		}
+	}
+	if (optind < argc) {
+		dir = argv[optind];
+	}
+	if (files < 1 || depth < 1 || ops < 1 || !chunk_size ||
+			file_size < chunk_size) {
+		usage();
+	}
+	if (blocking) {
+		setenv("LIBDISPATCH_DISABLE_IO_URING", "1", 1);
+	}
+	file_chunks = file_size / chunk_size;
+
+	// Lay the files out before timing anything
+	if ((buf = malloc(chunk_size)) == NULL) {
+		perror("malloc");
+		return 1;
+	}
+	memset(buf, 'x', chunk_size);
+	dispatch_fd_t fds[files];
+	for (i = 0; i < files; i++) {
+		snprintf(path, sizeof(path), "%s/dispatch_io_bench.%d.%d", dir,
+				(int)getpid(), i);
+		fds[i] = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+		if (fds[i] < 0) {
+			perror(path);
+			return 1;
+		}
+		unlink(path);
+		for (size_t off = 0; off < file_size; off += chunk_size) {
+			if (pwrite(fds[i], buf, chunk_size, (off_t)off) !=
+					(ssize_t)chunk_size) {
+				perror("pwrite");
+				return 1;
+			}
+		}
+		fsync(fds[i]);
+	}
+	write_data = dispatch_data_create(buf, chunk_size, NULL,
+			DISPATCH_DATA_DESTRUCTOR_FREE);
+
+	handler_q = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
+	group = dispatch_group_create();
+	atomic_store(&remaining, ops);
+
+	dispatch_source_t sampler = dispatch_source_create(
+			DISPATCH_SOURCE_TYPE_TIMER, 0, 0, handler_q);
+	dispatch_source_set_timer(sampler, DISPATCH_TIME_NOW,
+			10 * NSEC_PER_MSEC, NSEC_PER_MSEC);
+	dispatch_source_set_event_handler(sampler, ^{
+		long n = thread_count(), p = atomic_load(&peak_threads);
+		while (n > p && !atomic_compare_exchange_weak(&peak_threads, &p, n)) {
+		}
+	});
+	dispatch_resume(sampler);
+
+	dispatch_io_t channels[files];
+	double t = now();
+	for (i = 0; i < files; i++) {
+		channels[i] = dispatch_io_create(DISPATCH_IO_RANDOM, fds[i],
+				handler_q, ^(int error) { (void)error; });
+		// One delivery per operation
+		dispatch_io_set_low_water(channels[i], SIZE_MAX);
+		for (int j = 0; j < depth; j++) {
+			dispatch_group_enter(group);
+			issue(channels[i]);
+		}
+	}
+	dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+	t = now() - t;
+	dispatch_source_cancel(sampler);
+
+	printf("%s %s: %ld ops of %zu KB on %d files, depth %d: %.3f s, "
+			"%.0f ops/s, %.1f MB/s, peak %ld threads\n",
+			blocking ? "blocking" : "io_uring", writing ? "write" : "read",
+			ops, chunk_size >> 10, files, depth, t, ops / t,
+			ops * (double)chunk_size / t / (1 << 20),
+			atomic_load(&peak_threads));
+
+	for (i = 0; i < files; i++) {
+		dispatch_io_close(channels[i], 0);
+		dispatch_release(channels[i]);
+	}
+	return 0;
+}
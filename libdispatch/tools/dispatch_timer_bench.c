@@ -0,0 +1,190 @@
+/*
+ * Copyright (c) 2017 Apple Inc. All rights reserved.
+ *
+ * @APPLE_APACHE_LICENSE_HEADER_START@
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @APPLE_APACHE_LICENSE_HEADER_END@
+ */
+
+/*
+ * Idle-timeout workload for the timer coalescing wheel: many one-shot timer
+ * sources with a leeway, a fraction of which is pushed back every millisecond
+ * the way connection idle timeouts are, the others fire and are re-armed.
+ *
+ *   dispatch_timer_bench [-d] [-n timers] [-t timeout-ms] [-l leeway-%]
+ *                        [-r rearms-per-ms] [-s seconds]
+ *
+ * -d keeps every timer in the heap by setting
+ * LIBDISPATCH_DISABLE_TIMER_WHEEL. The process CPU time over the run is the
+ * figure to compare, the wheel counters show how many timer wakeups were
+ * saved by firing timers in batches.
+ *
+ * cc -O2 -fblocks -o dispatch_timer_bench dispatch_timer_bench.c \
+ *     -ldispatch -lBlocksRuntime
+ */
+
+#include <dispatch/dispatch.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+// from <dispatch/source_private.h>
+struct dispatch_timer_wheel_stats_s {
+	uint64_t timers;
+	uint64_t expired;
+	uint64_t batches;
+	uint64_t cascades;
+};
+extern size_t dispatch_timer_wheel_get_stats(
+		struct dispatch_timer_wheel_stats_s *stats, size_t size);
+
+static atomic_long fired, rearmed;
+static uint64_t timeout, leeway;
+
+static double
+now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static double
+cpu_time(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1000000.0 +
+			ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1000000.0;
+}
+
+static uint64_t
+next_random(uint64_t *x)
+{
+	*x ^= *x << 13;
+	*x ^= *x >> 7;
+	*x ^= *x << 17;
+	return *x;
+}
+
+static void
+arm(dispatch_source_t timer, uint64_t jitter)
+{
+	// Spread the timeouts over [timeout, 2 * timeout)
+	dispatch_time_t when = dispatch_time(DISPATCH_TIME_NOW,
+			(int64_t)(timeout + jitter % timeout));
+	dispatch_source_set_timer(timer, when, DISPATCH_TIME_FOREVER, leeway);
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: dispatch_timer_bench [-d] [-n timers] "
+			"[-t timeout-ms] [-l leeway-%%] [-r rearms-per-ms] [-s seconds]\n");
+	exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+	long count = 200000, rearms = 200, i;
+	unsigned leeway_pct = 10, seconds = 10;
+	bool disabled = false;
+	int opt;
+
+	timeout = 1000;
+	while ((opt = getopt(argc, argv, "dl:n:r:s:t:")) != -1) {
+		switch (opt) {
+		case 'd': disabled = true; break;
+		case 'l': leeway_pct = (unsigned)atoi(optarg); break;
+		case 'n': count = atol(optarg); break;
+		case 'r': rearms = atol(optarg); break;
+		case 's': seconds = (unsigned)atoi(optarg); break;
+		case 't': timeout = (uint64_t)atol(optarg); break;
+		default: usage();
+		}
+	}
+	if (count < 1 || rearms < 0 || !seconds || !timeout) {
+		usage();
+	}
+	if (disabled) {
+		setenv("LIBDISPATCH_DISABLE_TIMER_WHEEL", "1", 1);
+	}
+	timeout *= NSEC_PER_MSEC;
+	leeway = timeout * leeway_pct / 100;
+
+	dispatch_queue_t q = dispatch_get_global_queue(
+			DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
+	dispatch_source_t *timers = calloc((size_t)count, sizeof(*timers));
+	if (!timers) {
+		perror("calloc");
+		return 1;
+	}
+	for (i = 0; i < count; i++) {
+		dispatch_source_t t = dispatch_source_create(
+				DISPATCH_SOURCE_TYPE_TIMER, 0, 0, q);
+		uint64_t x = (uint64_t)i * 0x9e3779b97f4a7c15ull + 1;
+		dispatch_source_set_event_handler(t, ^{
+			uint64_t y = x + (uint64_t)atomic_fetch_add(&fired, 1);
+			arm(t, next_random(&y));
+		});
+		arm(t, next_random(&x));
+		dispatch_resume(t);
+		timers[i] = t;
+	}
+
+	// Push back a random subset of the timeouts every millisecond
+	dispatch_queue_t rq = dispatch_queue_create("rearm", NULL);
+	dispatch_source_t ticker = dispatch_source_create(
+			DISPATCH_SOURCE_TYPE_TIMER, 0, 0, rq);
+	__block uint64_t seed = 88172645463325252ull;
+	dispatch_source_set_event_handler(ticker, ^{
+		for (long k = 0; k < rearms; k++) {
+			uint64_t r = next_random(&seed);
+			arm(timers[r % (uint64_t)count], r >> 20);
+		}
+		atomic_fetch_add(&rearmed, rearms);
+	});
+	dispatch_source_set_timer(ticker, DISPATCH_TIME_NOW, NSEC_PER_MSEC, 0);
+
+	double t = now(), cpu = cpu_time();
+	dispatch_resume(ticker);
+	sleep(seconds);
+	dispatch_source_cancel(ticker);
+	t = now() - t;
+	cpu = cpu_time() - cpu;
+
+	struct dispatch_timer_wheel_stats_s s;
+	dispatch_timer_wheel_get_stats(&s, sizeof(s));
+	printf("%s: %ld timers, %llu ms timeout, %u%% leeway, %.1f s\n",
+			disabled ? "heap" : "wheel", count,
+			(unsigned long long)(timeout / NSEC_PER_MSEC), leeway_pct, t);
+	printf("  fired %ld, re-armed %ld, cpu %.3f s (%.1f%%)\n",
+			atomic_load(&fired), atomic_load(&rearmed), cpu, 100 * cpu / t);
+	printf("  wheel: %llu held, %llu expired in %llu batches, "
+			"%llu wakeups saved, %llu cascades\n",
+			(unsigned long long)s.timers, (unsigned long long)s.expired,
+			(unsigned long long)s.batches,
+			(unsigned long long)(s.expired - s.batches),
+			(unsigned long long)s.cascades);
+	return 0;
+}
@@ -25,9 +25,25 @@
 #define _MALLOC_MALLOC_H_
 
 #include <stddef.h>
+#if defined(__linux__)
+#include <stdint.h>
+#include <sys/cdefs.h>
+
+/* The subset of <mach/mach_types.h> this interface depends on */
+typedef int boolean_t;
+typedef int kern_return_t;
+typedef unsigned int task_t;
+typedef uintptr_t vm_address_t;
+typedef uintptr_t vm_size_t;
+
+#ifndef __OSX_AVAILABLE_STARTING
+#define __OSX_AVAILABLE_STARTING(_mac, _iphone)
+#endif
+#else // __linux__
 #include <mach/mach_types.h>
 #include <sys/cdefs.h>
 #include <Availability.h>
+#endif // __linux__
 
 __BEGIN_DECLS
 /*********	Type definitions	************/
@@ -27,7 +27,9 @@
 /* Here be dragons (SPIs) */
 
 #include <sys/cdefs.h>
+#if !defined(__linux__)
 #include <Availability.h>
+#endif
 
 /*********	Callbacks	************/
 
@@ -23,9 +23,11 @@
 
 #import <stdbool.h>
 #import <malloc/malloc.h>
-#import <mach/vm_statistics.h>
 #import <sys/cdefs.h>
+#if !defined(__linux__)
+#import <mach/vm_statistics.h>
 #import <os/availability.h>
+#endif
 
 #define STACK_LOGGING_MAX_STACK_SIZE 512
 
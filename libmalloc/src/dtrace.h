@@ -24,7 +24,7 @@
 #ifndef __DTRACE_H
 #define __DTRACE_H
 
-#ifndef DARWINTEST
+#if !defined(DARWINTEST) && !defined(__linux__)
 #include "magmallocProvider.h"
 #else
 #define	MAGMALLOC_ALLOCREGION(arg0, arg1, arg2, arg3)
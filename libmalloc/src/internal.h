@@ -26,6 +26,9 @@
 
 #define __OS_EXPOSE_INTERNALS__ 1
 
+#if defined(__linux__)
+#include "linux.h"
+#else // __linux__
 #include <Availability.h>
 #include <TargetConditionals.h>
 #include <_simple.h>
@@ -34,15 +37,9 @@ static size_t _platform_strlen(const char *s);
 static size_t _platform_strlcpy(char * restrict dst, const char * restrict src, size_t maxlen);
 #define memcpy _platform_memmove
 #include <platform/compat.h>
-#include <assert.h>
 #include <crt_externs.h>
-#include <dirent.h>
-#include <dlfcn.h>
-#include <errno.h>
-#include <fcntl.h>
 #include <libc.h>
 #include <libkern/OSAtomic.h>
-#include <limits.h>
 #include <mach-o/dyld.h>
 #include <mach-o/dyld_priv.h>
 #include <mach/mach.h>
@@ -59,6 +56,16 @@ static size_t _platform_strlcpy(char * restrict dst, const char * restrict src,
 #include <os/once_private.h>
 #include <os/overflow.h>
 #include <os/tsd.h>
+#include <sys/sysctl.h>
+#include <sys/vmparam.h>
+#include <xlocale.h>
+#endif // __linux__
+#include <assert.h>
+#include <dirent.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <paths.h>
 #include <signal.h>
 #include <stdarg.h>
@@ -71,12 +78,9 @@ static size_t _platform_strlcpy(char * restrict dst, const char * restrict src,
 #include <sys/mman.h>
 #include <sys/param.h>
 #include <sys/stat.h>
-#include <sys/sysctl.h>
 #include <sys/random.h>
 #include <sys/types.h>
-#include <sys/vmparam.h>
 #include <unistd.h>
-#include <xlocale.h>
 
 #include "dtrace.h"
 
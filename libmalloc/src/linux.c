@@ -0,0 +1,437 @@
+/*
+ * Copyright (c) 2017 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#include "internal.h"
+
+#if MALLOC_TARGET_LINUX
+
+#include <malloc.h>
+#include <sys/sysinfo.h>
+
+/*
+ * The out of line parts of the Darwin interfaces linux.h stands in for, and
+ * the glibc allocation entry points an LD_PRELOAD-ed libmalloc.so has to
+ * provide on top of the ones in malloc.c.
+ */
+
+#pragma mark os_unfair_lock
+
+static inline void
+_os_futex_wait(uint32_t *addr, uint32_t value)
+{
+	syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, value, NULL, NULL, 0);
+}
+
+static inline void
+_os_futex_wake(uint32_t *addr, int count)
+{
+	syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
+
+void
+_os_unfair_lock_lock_slow(os_unfair_lock_t lock)
+{
+	uint32_t *addr = &lock->_os_unfair_lock_opaque;
+
+	// Any thread that got here marks the lock contended, so that whoever
+	// owns it when it is unlocked issues the wakeup.
+	while (__atomic_exchange_n(addr, 2, __ATOMIC_ACQUIRE) != 0) {
+		_os_futex_wait(addr, 2);
+	}
+}
+
+void
+_os_unfair_lock_unlock_slow(os_unfair_lock_t lock)
+{
+	_os_futex_wake(&lock->_os_unfair_lock_opaque, 1);
+}
+
+#pragma mark os_once
+
+#define OS_ONCE_INIT 0l
+#define OS_ONCE_PENDING 1l
+#define OS_ONCE_DONE (~0l)
+
+void
+_os_once(os_once_t *pred, void *ctxt, os_function_t func)
+{
+	os_once_t value = OS_ONCE_INIT;
+
+	if (__atomic_compare_exchange_n(pred, &value, OS_ONCE_PENDING, false,
+			__ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+		func(ctxt);
+		__atomic_store_n(pred, OS_ONCE_DONE, __ATOMIC_RELEASE);
+		return;
+	}
+	// Only malloc initialization goes through here, it is short enough that
+	// the other threads can just yield until it is over.
+	while (__atomic_load_n(pred, __ATOMIC_ACQUIRE) != OS_ONCE_DONE) {
+		sched_yield();
+	}
+}
+
+#pragma mark crash log
+
+const char *_malloc_crash_log_message;
+
+#pragma mark _simple
+
+/*
+ * A _SIMPLE_STRING is one page of anonymous memory: the header, then the
+ * NUL-terminated string. Output that doesn't fit is truncated.
+ */
+struct _malloc_simple_string_s {
+	size_t len;
+	char buf[];
+};
+
+#define SIMPLE_STRING_SIZE PAGE_MAX_SIZE
+#define SIMPLE_STRING_CAPACITY \
+		(SIMPLE_STRING_SIZE - sizeof(struct _malloc_simple_string_s))
+
+_SIMPLE_STRING
+_simple_salloc(void)
+{
+	_SIMPLE_STRING b = mmap(NULL, SIMPLE_STRING_SIZE, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANON, -1, 0);
+	if (b == MAP_FAILED) {
+		return NULL;
+	}
+	return b;
+}
+
+void
+_simple_sfree(_SIMPLE_STRING b)
+{
+	if (b) {
+		munmap(b, SIMPLE_STRING_SIZE);
+	}
+}
+
+char *
+_simple_string(_SIMPLE_STRING b)
+{
+	return b->buf;
+}
+
+// Rewrites the %y byte count conversions of fmt as %d for vsnprintf
+static const char *
+_simple_format(const char *fmt, char *buf, size_t size)
+{
+	const char *p = fmt;
+	size_t n = 0;
+	bool spec = false;
+
+	for (; *p && n < size - 1; p++) {
+		char c = *p;
+		if (spec && c == 'y') {
+			c = 'd';
+		}
+		if (spec) {
+			spec = !strchr("diouxXeEfFgGaAcspny%", c);
+		} else {
+			spec = (c == '%');
+		}
+		buf[n++] = c;
+	}
+	if (*p) {
+		return fmt;
+	}
+	buf[n] = '\0';
+	return buf;
+}
+
+int
+_simple_vsprintf(_SIMPLE_STRING b, const char *fmt, va_list ap)
+{
+	size_t avail = SIMPLE_STRING_CAPACITY - b->len;
+	char buf[256];
+	int n = vsnprintf(b->buf + b->len, avail,
+			_simple_format(fmt, buf, sizeof(buf)), ap);
+
+	if (n < 0) {
+		return -1;
+	}
+	b->len += MIN((size_t)n, avail - 1);
+	return 0;
+}
+
+int
+_simple_sprintf(_SIMPLE_STRING b, const char *fmt, ...)
+{
+	va_list ap;
+	int ret;
+
+	va_start(ap, fmt);
+	ret = _simple_vsprintf(b, fmt, ap);
+	va_end(ap);
+	return ret;
+}
+
+int
+_simple_sappend(_SIMPLE_STRING b, const char *str)
+{
+	return _simple_sprintf(b, "%s", str);
+}
+
+void
+_simple_put(_SIMPLE_STRING b, int fd)
+{
+	const char *p = b->buf;
+	size_t len = b->len;
+
+	while (len) {
+		ssize_t n = write(fd, p, len);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			break;
+		}
+		p += n;
+		len -= (size_t)n;
+	}
+}
+
+void
+_simple_vdprintf(int fd, const char *fmt, va_list ap)
+{
+	_SIMPLE_STRING b = _simple_salloc();
+
+	if (b) {
+		_simple_vsprintf(b, fmt, ap);
+		_simple_put(b, fd);
+		_simple_sfree(b);
+	}
+}
+
+void
+_simple_dprintf(int fd, const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	_simple_vdprintf(fd, fmt, ap);
+	va_end(ap);
+}
+
+#pragma mark libc
+
+int
+sysctlbyname(const char *name, void *oldp, size_t *oldlenp, void *newp,
+		size_t newlen)
+{
+	// Only the physical memory size, see purgeable_create_zone()
+	if (strcmp(name, "hw.memsize") || newp || newlen || !oldlenp ||
+			*oldlenp != sizeof(uint64_t)) {
+		errno = ENOENT;
+		return -1;
+	}
+
+	struct sysinfo info;
+	if (sysinfo(&info)) {
+		return -1;
+	}
+	*(uint64_t *)oldp = (uint64_t)info.totalram * info.mem_unit;
+	return 0;
+}
+
+size_t
+_malloc_strlcpy(char *dst, const char *src, size_t size)
+{
+	size_t len = strlen(src);
+
+	if (size) {
+		size_t n = MIN(len, size - 1);
+		memcpy(dst, src, n);
+		dst[n] = '\0';
+	}
+	return len;
+}
+
+void *
+reallocf(void *ptr, size_t size)
+{
+	void *nptr = realloc(ptr, size);
+
+	if (!nptr && ptr) {
+		free(ptr);
+	}
+	return nptr;
+}
+
+void
+thread_stack_pcs(vm_address_t *buffer, unsigned max, unsigned *num)
+{
+	unsigned n = 0;
+	void *frame = __builtin_frame_address(0);
+
+	// Walk the frame pointer chain, which needs -fno-omit-frame-pointer
+	// builds to be complete. Stop at the first frame that doesn't go up the
+	// stack.
+	while (frame && n < max) {
+		void **fp = frame;
+		if (!fp[1]) {
+			break;
+		}
+		buffer[n++] = (vm_address_t)fp[1];
+		if ((uintptr_t)fp[0] <= (uintptr_t)frame) {
+			break;
+		}
+		frame = fp[0];
+	}
+	*num = n;
+}
+
+#pragma mark stack logging
+
+/*
+ * Disk and lite stack logging read the target task with the mach VM and
+ * sysctl process interfaces, they aren't built on Linux. MallocStackLogging
+ * is reported as unavailable by __prepare_to_log_stacks().
+ */
+int stack_logging_enable_logging = 0;
+int stack_logging_dontcompact = 0;
+int stack_logging_mode = stack_logging_mode_none;
+
+typedef void(malloc_logger_t)(uint32_t type,
+		uintptr_t arg1,
+		uintptr_t arg2,
+		uintptr_t arg3,
+		uintptr_t result,
+		uint32_t num_hot_frames_to_skip);
+
+malloc_logger_t *__syscall_logger = NULL;
+
+void
+__disk_stack_logging_log_stack(uint32_t type_flags, uintptr_t zone_ptr,
+		uintptr_t size, uintptr_t ptr_arg, uintptr_t return_val,
+		uint32_t num_hot_to_skip)
+{
+}
+
+boolean_t
+__prepare_to_log_stacks(boolean_t lite_mode)
+{
+	return false;
+}
+
+void
+__prepare_to_log_stacks_stage2(void)
+{
+}
+
+boolean_t
+__stack_logging_locked(void)
+{
+	return false;
+}
+
+boolean_t
+__uniquing_table_memory_was_deleted(void)
+{
+	return false;
+}
+
+void
+__stack_logging_fork_prepare(void)
+{
+}
+
+void
+__stack_logging_fork_parent(void)
+{
+}
+
+void
+__stack_logging_fork_child(void)
+{
+}
+
+malloc_zone_t *
+create_stack_logging_lite_zone(size_t initial_size, malloc_zone_t *helper_zone,
+		unsigned debug_flags)
+{
+	return NULL;
+}
+
+void
+enable_stack_logging_lite(void)
+{
+}
+
+void
+disable_stack_logging_lite(void)
+{
+}
+
+#pragma mark glibc entry points
+
+void *
+memalign(size_t alignment, size_t size)
+{
+	void *ptr;
+
+	if (alignment <= sizeof(void *)) {
+		return malloc(size);
+	}
+	ptr = malloc_zone_memalign(malloc_default_zone(), alignment, size);
+	if (!ptr) {
+		errno = (alignment & (alignment - 1)) ? EINVAL : ENOMEM;
+	}
+	return ptr;
+}
+
+void *
+aligned_alloc(size_t alignment, size_t size)
+{
+	return memalign(alignment, size);
+}
+
+void *
+pvalloc(size_t size)
+{
+	return valloc(round_page(size));
+}
+
+size_t
+malloc_usable_size(void *ptr)
+{
+	return ptr ? malloc_size(ptr) : 0;
+}
+
+#pragma mark initialization
+
+// Libc calls these around fork() on Darwin
+extern void _malloc_fork_prepare(void);
+extern void _malloc_fork_parent(void);
+extern void _malloc_fork_child(void);
+
+static void __attribute__((constructor))
+_malloc_linux_init(void)
+{
+	pthread_atfork(_malloc_fork_prepare, _malloc_fork_parent,
+			_malloc_fork_child);
+}
+
+#endif // MALLOC_TARGET_LINUX
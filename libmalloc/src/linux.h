@@ -0,0 +1,458 @@
+/*
+ * Copyright (c) 2017 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#ifndef __LINUX_H
+#define __LINUX_H
+
+/*
+ * Stand-ins for the Darwin headers internal.h includes, so that the szone
+ * magazine allocator builds as an LD_PRELOAD-able libmalloc.so on Linux.
+ * Only the subset of each interface libmalloc uses is provided. The out of
+ * line pieces live in linux.c.
+ */
+
+#include <errno.h>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/auxv.h>
+#include <sys/personality.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#pragma mark TargetConditionals.h / Availability.h
+
+#define TARGET_OS_EMBEDDED 0
+#define TARGET_OS_IOS 0
+#define TARGET_OS_SIMULATOR 0
+#define TARGET_IPHONE_SIMULATOR 0
+
+#define __OSX_AVAILABLE(_vers)
+#define __IOS_AVAILABLE(_vers)
+#define __TVOS_AVAILABLE(_vers)
+#define __WATCHOS_AVAILABLE(_vers)
+#define API_AVAILABLE(...)
+#define API_DEPRECATED(...)
+#define __DARWIN_EXTSN(_sym)
+#define __result_use_check __attribute__((__warn_unused_result__))
+#ifndef __unused
+#define __unused __attribute__((__unused__))
+#endif
+#define __printflike(fmtarg, firstvararg) \
+		__attribute__((__format__(__printf__, fmtarg, firstvararg)))
+
+#pragma mark mach
+
+typedef int kern_return_t;
+typedef int boolean_t;
+typedef unsigned int task_t;
+typedef unsigned int mach_port_t;
+typedef uintptr_t vm_address_t;
+typedef uintptr_t vm_size_t;
+typedef uint64_t mach_vm_address_t;
+typedef uint64_t mach_vm_size_t;
+typedef uint64_t mach_vm_offset_t;
+
+#define KERN_SUCCESS 0
+#define KERN_INVALID_ADDRESS 1
+#define KERN_NO_SPACE 3
+#define KERN_INVALID_ARGUMENT 4
+#define KERN_FAILURE 5
+#define KERN_RESOURCE_SHORTAGE 6
+
+#ifndef TRUE
+#define TRUE 1
+#endif
+#ifndef FALSE
+#define FALSE 0
+#endif
+
+#define MACH_PORT_NULL 0
+#define TASK_NULL 0
+#define mach_task_self() ((task_t)1)
+
+/*
+ * A compile-time page size no smaller than the kernel's. arm64 and ppc64le
+ * kernels may use 64K pages, mappings are then kept 64K aligned whatever the
+ * actual page size.
+ */
+#if defined(__i386__) || defined(__x86_64__)
+#define PAGE_MAX_SHIFT 12
+#else
+#define PAGE_MAX_SHIFT 16
+#endif
+#define PAGE_MAX_SIZE (1ul << PAGE_MAX_SHIFT)
+#define PAGE_SIZE PAGE_MAX_SIZE
+#define vm_page_size ((vm_size_t)PAGE_MAX_SIZE)
+#define vm_page_shift PAGE_MAX_SHIFT
+#define vm_page_mask (vm_page_size - 1)
+#define vm_kernel_page_size vm_page_size
+#define vm_kernel_page_shift vm_page_shift
+
+#define SIZE_T_MAX SIZE_MAX
+
+#define trunc_page(x) ((uintptr_t)(x) & ~vm_page_mask)
+#define round_page(x) trunc_page((uintptr_t)(x) + vm_page_mask)
+#define trunc_page_kernel(x) trunc_page(x)
+#define round_page_kernel(x) round_page(x)
+
+// VM tags only label regions for vmmap on Darwin
+#define VM_MEMORY_MALLOC 1
+#define VM_MEMORY_MALLOC_SMALL 2
+#define VM_MEMORY_MALLOC_LARGE 3
+#define VM_MEMORY_MALLOC_HUGE 4
+#define VM_MEMORY_MALLOC_TINY 7
+#define VM_MEMORY_MALLOC_LARGE_REUSABLE 8
+#define VM_MEMORY_MALLOC_LARGE_REUSED 9
+#define VM_MEMORY_MALLOC_NANO 11
+
+#define VM_FLAGS_ALIAS_MASK 0xFF000000
+
+#pragma mark mach/mach_vm.h
+
+/*
+ * The mach VM calls libmalloc makes, on top of mmap(), in vm.c. Only the
+ * current task is supported, tags and purgeability are ignored.
+ */
+typedef int vm_prot_t;
+typedef unsigned int vm_inherit_t;
+typedef unsigned int mem_entry_name_port_t;
+typedef uint64_t memory_object_offset_t;
+typedef int vm_purgable_t;
+
+#define VM_FLAGS_FIXED 0x0
+#define VM_FLAGS_ANYWHERE 0x1
+#define VM_FLAGS_PURGABLE 0x2
+#define VM_MAKE_TAG(tag) ((tag) << 24)
+#define MEMORY_OBJECT_NULL 0
+#define VM_PROT_NONE 0x0
+#define VM_PROT_READ 0x1
+#define VM_PROT_WRITE 0x2
+#define VM_PROT_EXECUTE 0x4
+#define VM_PROT_DEFAULT (VM_PROT_READ | VM_PROT_WRITE)
+#define VM_PROT_ALL (VM_PROT_READ | VM_PROT_WRITE | VM_PROT_EXECUTE)
+#define VM_INHERIT_DEFAULT 1
+
+#define VM_PURGABLE_SET_STATE 0
+#define VM_PURGABLE_NONVOLATILE 0
+#define VM_PURGABLE_VOLATILE 1
+#define VM_PURGABLE_EMPTY 2
+
+#define VM_MEMORY_REALLOC 6
+
+__attribute__((visibility("hidden")))
+kern_return_t
+mach_vm_map(task_t task, mach_vm_address_t *address, mach_vm_size_t size,
+		mach_vm_offset_t mask, int flags, mem_entry_name_port_t object,
+		memory_object_offset_t offset, boolean_t copy, vm_prot_t cur_protection,
+		vm_prot_t max_protection, vm_inherit_t inheritance);
+
+__attribute__((visibility("hidden")))
+kern_return_t
+mach_vm_allocate(task_t task, mach_vm_address_t *address, mach_vm_size_t size,
+		int flags);
+
+__attribute__((visibility("hidden")))
+kern_return_t
+mach_vm_deallocate(task_t task, mach_vm_address_t address,
+		mach_vm_size_t size);
+
+__attribute__((visibility("hidden")))
+kern_return_t
+vm_allocate(task_t task, vm_address_t *address, vm_size_t size, int flags);
+
+__attribute__((visibility("hidden")))
+kern_return_t
+vm_deallocate(task_t task, vm_address_t address, vm_size_t size);
+
+__attribute__((visibility("hidden")))
+kern_return_t
+vm_copy(task_t task, vm_address_t source_address, vm_size_t size,
+		vm_address_t dest_address);
+
+__attribute__((visibility("hidden")))
+kern_return_t
+vm_purgable_control(task_t task, vm_address_t address, vm_purgable_t control,
+		int *state);
+
+#pragma mark sys/mman.h
+
+/*
+ * Darwin's reusable-page advice. MADV_FREE'd pages are reused by simply
+ * writing to them on Linux, so the advice that would mark them reused again
+ * is a no-op, see mvm_madvise() in vm.c.
+ */
+#include <sys/mman.h>
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0x100000
+#endif
+
+#define MADV_FREE_REUSABLE MADV_FREE
+#define MADV_FREE_REUSE (-1)
+#define MADV_CAN_REUSE (-2)
+
+__attribute__((visibility("hidden")))
+int
+mvm_madvise(void *addr, size_t len, int advice);
+
+#define madvise(addr, len, advice) mvm_madvise((addr), (len), (advice))
+
+#define thread_switch(_port, _option, _ms) ((void)sched_yield())
+
+#pragma mark libkern/OSAtomic.h
+
+#define OSAtomicIncrement32(p) \
+		__atomic_add_fetch((p), 1, __ATOMIC_RELAXED)
+#define OSAtomicIncrement32Barrier(p) \
+		__atomic_add_fetch((p), 1, __ATOMIC_SEQ_CST)
+#define OSAtomicDecrement32Barrier(p) \
+		__atomic_sub_fetch((p), 1, __ATOMIC_SEQ_CST)
+#define OSAtomicIncrement64(p) \
+		__atomic_add_fetch((p), 1, __ATOMIC_RELAXED)
+#define OSAtomicAdd32(v, p) \
+		__atomic_add_fetch((p), (v), __ATOMIC_RELAXED)
+#define OSAtomicAdd64(v, p) \
+		__atomic_add_fetch((p), (v), __ATOMIC_RELAXED)
+#define OSAtomicCompareAndSwapLong(o, n, p) ({ \
+		long _o = (o); \
+		__atomic_compare_exchange_n((p), &_o, (n), false, \
+				__ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST); \
+})
+#define OSAtomicCompareAndSwapPtrBarrier(o, n, p) ({ \
+		void *_o = (o); \
+		__atomic_compare_exchange_n((void **)(p), &_o, (n), false, \
+				__ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST); \
+})
+#define OSMemoryBarrier() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+#pragma mark os/lock_private.h
+
+/*
+ * os_unfair_lock on top of a futex: 0 is unlocked, 1 locked and 2 locked
+ * with waiters.
+ */
+typedef struct os_unfair_lock_s {
+	uint32_t _os_unfair_lock_opaque;
+} os_unfair_lock, *os_unfair_lock_t;
+
+#define OS_UNFAIR_LOCK_INIT ((os_unfair_lock){0})
+#define OS_UNFAIR_LOCK_DATA_SYNCHRONIZATION 0
+
+__attribute__((visibility("hidden")))
+void
+_os_unfair_lock_lock_slow(os_unfair_lock_t lock);
+
+__attribute__((visibility("hidden")))
+void
+_os_unfair_lock_unlock_slow(os_unfair_lock_t lock);
+
+__attribute__((always_inline))
+static inline void
+os_unfair_lock_lock_with_options(os_unfair_lock_t lock, uint32_t options)
+{
+	uint32_t unlocked = 0;
+
+	(void)options;
+	if (!__atomic_compare_exchange_n(&lock->_os_unfair_lock_opaque,
+			&unlocked, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+		_os_unfair_lock_lock_slow(lock);
+	}
+}
+
+__attribute__((always_inline))
+static inline bool
+os_unfair_lock_trylock(os_unfair_lock_t lock)
+{
+	uint32_t unlocked = 0;
+
+	return __atomic_compare_exchange_n(&lock->_os_unfair_lock_opaque,
+			&unlocked, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+__attribute__((always_inline))
+static inline void
+os_unfair_lock_unlock(os_unfair_lock_t lock)
+{
+	if (__atomic_exchange_n(&lock->_os_unfair_lock_opaque, 0,
+			__ATOMIC_RELEASE) == 2) {
+		_os_unfair_lock_unlock_slow(lock);
+	}
+}
+
+#pragma mark os/once_private.h
+
+typedef long os_once_t;
+typedef void (*os_function_t)(void *);
+
+__attribute__((visibility("hidden")))
+void
+_os_once(os_once_t *pred, void *ctxt, os_function_t func);
+
+__attribute__((always_inline))
+static inline void
+os_once(os_once_t *pred, void *ctxt, os_function_t func)
+{
+	if (__builtin_expect(__atomic_load_n(pred, __ATOMIC_ACQUIRE) != ~0l, 0)) {
+		_os_once(pred, ctxt, func);
+	}
+}
+
+#pragma mark os/tsd.h
+
+#define __TSD_THREAD_SELF 0
+#define _os_tsd_get_direct(_key) ((void *)pthread_self())
+
+__attribute__((always_inline))
+static inline unsigned int
+_os_cpu_number(void)
+{
+	int cpu = sched_getcpu();
+	return cpu < 0 ? 0 : (unsigned int)cpu;
+}
+
+#pragma mark os/base.h
+
+#define OS_ENUM(_name, _type, ...) \
+		typedef _type _name##_t; enum { __VA_ARGS__ }
+
+#pragma mark os/overflow.h
+
+#define os_add_overflow(a, b, res) __builtin_add_overflow((a), (b), (res))
+#define os_sub_overflow(a, b, res) __builtin_sub_overflow((a), (b), (res))
+#define os_mul_overflow(a, b, res) __builtin_mul_overflow((a), (b), (res))
+
+#pragma mark os/internal/internal_shared.h
+
+#define _os_set_crash_log_cause_and_message(_cause, _msg) \
+		_os_set_crash_log_message(_msg)
+#define _os_set_crash_log_message(_msg) \
+		((void)(_malloc_crash_log_message = (_msg)))
+#define _os_set_crash_log_message_dynamic(_msg) \
+		_os_set_crash_log_message(_msg)
+
+__attribute__((visibility("hidden")))
+extern const char *_malloc_crash_log_message;
+
+#pragma mark _simple.h
+
+/*
+ * The string helpers libmalloc reports errors with, they don't call malloc.
+ * Buffers come from mmap, output is formatted with vsnprintf. Like Darwin's,
+ * they accept %y for byte counts.
+ */
+typedef struct _malloc_simple_string_s *_SIMPLE_STRING;
+
+#define ASL_LEVEL_ERR 3
+#define ASL_LEVEL_WARNING 4
+#define ASL_LEVEL_NOTICE 5
+#define ASL_LEVEL_INFO 6
+
+__attribute__((visibility("hidden")))
+_SIMPLE_STRING
+_simple_salloc(void);
+
+__attribute__((visibility("hidden")))
+void
+_simple_sfree(_SIMPLE_STRING b);
+
+__attribute__((visibility("hidden")))
+char *
+_simple_string(_SIMPLE_STRING b);
+
+__attribute__((visibility("hidden")))
+int
+_simple_sappend(_SIMPLE_STRING b, const char *str);
+
+__attribute__((visibility("hidden")))
+int
+_simple_sprintf(_SIMPLE_STRING b, const char *fmt, ...);
+
+__attribute__((visibility("hidden")))
+int
+_simple_vsprintf(_SIMPLE_STRING b, const char *fmt, va_list ap);
+
+__attribute__((visibility("hidden")))
+void
+_simple_put(_SIMPLE_STRING b, int fd);
+
+__attribute__((visibility("hidden")))
+void
+_simple_dprintf(int fd, const char *fmt, ...);
+
+__attribute__((visibility("hidden")))
+void
+_simple_vdprintf(int fd, const char *fmt, va_list ap);
+
+// There is no ASL, the message already went to malloc_debug_file
+#define _simple_asl_log(_level, _facility, _message) ((void)0)
+
+#pragma mark sys/event.h
+
+// Memory status events are never delivered, see malloc_memory_event_handler()
+#define NOTE_MEMORYSTATUS_PRESSURE_NORMAL 0x00000001
+#define NOTE_MEMORYSTATUS_PRESSURE_WARN 0x00000002
+#define NOTE_MEMORYSTATUS_PRESSURE_CRITICAL 0x00000004
+#define NOTE_MEMORYSTATUS_PROC_LIMIT_WARN 0x00000010
+#define NOTE_MEMORYSTATUS_PROC_LIMIT_CRITICAL 0x00000020
+#define NOTE_MEMORYSTATUS_MSL_STATUS 0xf0000000
+
+#pragma mark dyld
+
+#define dyld_process_is_restricted() ((bool)issetugid())
+#define NSVersionOfLinkTimeLibrary(_name) ((int32_t)-1)
+
+#pragma mark libc
+
+#define _platform_memmove memmove
+#define _platform_memset memset
+#define _platform_bzero bzero
+#define _platform_strlen strlen
+#define strtoull_l(s, end, base, loc) strtoull((s), (end), (base))
+
+__attribute__((visibility("hidden")))
+int
+sysctlbyname(const char *name, void *oldp, size_t *oldlenp, void *newp,
+		size_t newlen);
+
+__attribute__((visibility("hidden")))
+size_t
+_malloc_strlcpy(char *dst, const char *src, size_t size);
+#define strlcpy _malloc_strlcpy
+
+void *reallocf(void *ptr, size_t size);
+
+#define getprogname() ((const char *)program_invocation_short_name)
+#define issetugid() ((int)getauxval(AT_SECURE))
+
+extern char **environ;
+#define _NSGetEnviron() (&environ)
+
+#endif // __LINUX_H
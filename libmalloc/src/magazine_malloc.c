@@ -1455,7 +1455,7 @@ create_scalable_szone(size_t initial_size, unsigned debug_flags)
 {
 	szone_t *szone;
 
-#if defined(__i386__) || defined(__x86_64__)
+#if (defined(__i386__) || defined(__x86_64__)) && !MALLOC_TARGET_LINUX
 	if (_COMM_PAGE_VERSION_REQD > (*((uint16_t *)_COMM_PAGE_VERSION))) {
 		MALLOC_PRINTF_FATAL_ERROR((*((uint16_t *)_COMM_PAGE_VERSION)), "comm page version mismatch");
 	}
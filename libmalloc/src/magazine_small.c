@@ -760,7 +760,10 @@ small_get_region_from_depot(rack_t *rack, magazine_t *small_mag_ptr, mag_index_t
 	magazine_t *depot_ptr = &(rack->magazines[DEPOT_MAGAZINE_INDEX]);
 
 	/* FIXME: Would Uniprocessor benefit from recirc and MADV_FREE? */
-	if (rack->num_magazines == 1) { // Uniprocessor, single magazine, so no recirculation necessary
+	// Uniprocessor, single magazine, so no recirculation necessary. Regions
+	// are still put in the Depot by szone_pressure_relief(), and would leak if
+	// they weren't taken back out.
+	if (rack->num_magazines == 1 && !depot_ptr->firstNode) {
 		return 0;
 	}
 
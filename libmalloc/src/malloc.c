@@ -404,7 +404,11 @@ typedef struct {
 } virtual_default_zone_t;
 
 static virtual_default_zone_t virtual_default_zone
+#if MALLOC_TARGET_LINUX
+__attribute__((section("__v_zone")))
+#else // MALLOC_TARGET_LINUX
 __attribute__((section("__DATA,__v_zone")))
+#endif // MALLOC_TARGET_LINUX
 __attribute__((aligned(PAGE_MAX_SIZE))) = {
 	NULL,
 	NULL,
@@ -783,9 +787,14 @@ _malloc_initialize(void *context __unused)
 	malloc_zone_t *zone;
 
 	if (!_malloc_entropy_initialized) {
+#if MALLOC_TARGET_LINUX
+		// There is no libSystem initializer to call __malloc_init on Linux
+		__malloc_init(NULL);
+#else // MALLOC_TARGET_LINUX
 		// Lazy initialization may occur before __malloc_init (rdar://27075409)
 		// TODO: make this a fatal error
 		malloc_printf("*** malloc was initialized without entropy\n");
+#endif // MALLOC_TARGET_LINUX
 	}
 
 	set_flags_from_environment(); // will only set flags up to two times
@@ -2430,6 +2439,7 @@ malloc_zone_discharge(malloc_zone_t *zone, void *memory)
 	zone->introspect->discharge(zone, memory);
 }
 
+#ifdef __BLOCKS__
 void
 malloc_zone_enumerate_discharged_pointers(malloc_zone_t *zone, void (^report_discharged)(void *memory, void *info))
 {
@@ -2455,6 +2465,13 @@ malloc_zone_enumerate_discharged_pointers(malloc_zone_t *zone, void (^report_dis
 		zone->introspect->enumerate_discharged_pointers(zone, report_discharged);
 	}
 }
+#else // __BLOCKS__
+void
+malloc_zone_enumerate_discharged_pointers(malloc_zone_t *zone, void *report_discharged)
+{
+	// Zones can't implement enumerate_discharged_pointers without blocks
+}
+#endif // __BLOCKS__
 
 /*****************	OBSOLETE ENTRY POINTS	********************/
 
@@ -30,6 +30,12 @@
 #define MALLOC_TARGET_IOS 0
 #endif // MALLOC_TARGET_IOS
 
+#if defined(__linux__)
+#define MALLOC_TARGET_LINUX 1
+#else // __linux__
+#define MALLOC_TARGET_LINUX 0
+#endif // __linux__
+
 #ifdef __LP64__
 #define MALLOC_TARGET_64BIT 1
 #else // __LP64__
@@ -67,7 +73,11 @@
 #define CONFIG_OS_LOCK_UNFAIR 1
 #endif // MALLOC_TARGET_IOS
 
-#if MALLOC_TARGET_64BIT
+#if MALLOC_TARGET_LINUX
+// The nano allocator depends on the commpage and a reserved address range
+#define CONFIG_NANOZONE 0
+#define CONFIG_ASLR_INTERNAL 0
+#elif MALLOC_TARGET_64BIT
 #define CONFIG_NANOZONE 1
 #define CONFIG_ASLR_INTERNAL 0
 #else // MALLOC_TARGET_64BIT
@@ -106,16 +116,24 @@
 #endif
 
 // memory resource exception handling
-#if MALLOC_TARGET_IOS || TARGET_OS_SIMULATOR
+#if MALLOC_TARGET_IOS || TARGET_OS_SIMULATOR || MALLOC_TARGET_LINUX
 #define ENABLE_MEMORY_RESOURCE_EXCEPTION_HANDLING 0
 #else
 #define ENABLE_MEMORY_RESOURCE_EXCEPTION_HANDLING 1
 #endif
 
 // presence of commpage memsize
+#if MALLOC_TARGET_LINUX
+#define CONFIG_HAS_COMMPAGE_MEMSIZE 0
+#else // MALLOC_TARGET_LINUX
 #define CONFIG_HAS_COMMPAGE_MEMSIZE 1
+#endif // MALLOC_TARGET_LINUX
 
 // presence of commpage number of cpu count
+#if MALLOC_TARGET_LINUX
+#define CONFIG_HAS_COMMPAGE_NCPUS 0
+#else // MALLOC_TARGET_LINUX
 #define CONFIG_HAS_COMMPAGE_NCPUS 1
+#endif // MALLOC_TARGET_LINUX
 
 #endif // __PLATFORM_H
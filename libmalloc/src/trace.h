@@ -28,7 +28,12 @@
 //   DBG_UMALLOC_EXTERNAL - for external entry points into malloc
 //   DBG_UMALLOC_INTERNAL - for tracing internal malloc state
 
-#ifndef _MALLOC_BUILDING_CODES_
+#if defined(__linux__)
+#define MALLOC_TRACE(code,arg1,arg2,arg3,arg4) \
+	{ (void)malloc_tracing_enabled; }
+#define TRACE_CODE(name, subclass, code) \
+	enum { TRACE_##name = 0 }
+#elif !defined(_MALLOC_BUILDING_CODES_)
 #include <sys/kdebug.h>
 #define MALLOC_TRACE(code,arg1,arg2,arg3,arg4) \
 	{ if (malloc_tracing_enabled) { kdebug_trace(code, arg1, arg2, arg3, arg4); } }
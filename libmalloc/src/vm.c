@@ -38,11 +38,148 @@ uint64_t malloc_entropy[2] = {0, 0};
 #define ENTROPIC_SHIFT SMALL_BLOCKS_ALIGN
 #endif
 
+#if MALLOC_TARGET_LINUX
+#pragma mark mach VM shims
+
+kern_return_t
+mach_vm_map(task_t task, mach_vm_address_t *address, mach_vm_size_t size,
+		mach_vm_offset_t mask, int flags, mem_entry_name_port_t object,
+		memory_object_offset_t offset, boolean_t copy, vm_prot_t cur_protection,
+		vm_prot_t max_protection, vm_inherit_t inheritance)
+{
+	uintptr_t addr, aligned, end;
+	size_t len;
+	void *p;
+
+	if (object != MEMORY_OBJECT_NULL) {
+		return KERN_INVALID_ARGUMENT;
+	}
+	if (!(flags & VM_FLAGS_ANYWHERE)) {
+		// Fixed placement only succeeds where nothing is mapped yet
+		if ((*address & vm_page_mask) || (size & vm_page_mask)) {
+			return KERN_INVALID_ARGUMENT;
+		}
+		p = mmap((void *)(uintptr_t)*address, size, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+		if (p == MAP_FAILED) {
+			return KERN_NO_SPACE;
+		}
+		if ((uintptr_t)p != *address) {
+			// Kernels before 4.17 treat MAP_FIXED_NOREPLACE as a hint
+			munmap(p, size);
+			return KERN_NO_SPACE;
+		}
+		return KERN_SUCCESS;
+	}
+	// Over-allocate by the alignment and trim both ends
+	mask |= vm_page_mask;
+	len = size + (mask & ~vm_page_mask);
+	if (len < size) {
+		return KERN_NO_SPACE;
+	}
+	p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+			-1, 0);
+	if (p == MAP_FAILED) {
+		return KERN_NO_SPACE;
+	}
+	addr = (uintptr_t)p;
+	aligned = (addr + mask) & ~(uintptr_t)mask;
+	end = addr + len;
+	if (aligned > addr) {
+		munmap(p, aligned - addr);
+	}
+	if (end > aligned + size) {
+		munmap((void *)(aligned + size), end - aligned - size);
+	}
+	*address = aligned;
+	return KERN_SUCCESS;
+}
+
+kern_return_t
+mach_vm_allocate(task_t task, mach_vm_address_t *address, mach_vm_size_t size,
+		int flags)
+{
+	return mach_vm_map(task, address, size, 0, flags, MEMORY_OBJECT_NULL, 0,
+			FALSE, VM_PROT_DEFAULT, VM_PROT_ALL, VM_INHERIT_DEFAULT);
+}
+
+kern_return_t
+mach_vm_deallocate(task_t task, mach_vm_address_t address, mach_vm_size_t size)
+{
+	if (size && munmap((void *)(uintptr_t)address, size) == -1) {
+		return KERN_INVALID_ADDRESS;
+	}
+	return KERN_SUCCESS;
+}
+
+kern_return_t
+vm_allocate(task_t task, vm_address_t *address, vm_size_t size, int flags)
+{
+	mach_vm_address_t vm_addr = *address;
+	kern_return_t kr;
+
+	kr = mach_vm_allocate(task, &vm_addr, size, flags);
+	if (kr == KERN_SUCCESS) {
+		*address = (vm_address_t)vm_addr;
+	}
+	return kr;
+}
+
+kern_return_t
+vm_deallocate(task_t task, vm_address_t address, vm_size_t size)
+{
+	return mach_vm_deallocate(task, address, size);
+}
+
+kern_return_t
+vm_copy(task_t task, vm_address_t source_address, vm_size_t size,
+		vm_address_t dest_address)
+{
+	// There is no copy-on-write remapping of anonymous memory
+	memmove((void *)dest_address, (const void *)source_address, size);
+	return KERN_SUCCESS;
+}
+
+kern_return_t
+vm_purgable_control(task_t task, vm_address_t address, vm_purgable_t control,
+		int *state)
+{
+	// Purgeable memory is never emptied, the state stays what it was set to
+	return KERN_SUCCESS;
+}
+
+int
+mvm_madvise(void *addr, size_t len, int advice)
+{
+	static bool no_madv_free;
+
+	switch (advice) {
+	case MADV_FREE_REUSE:
+	case MADV_CAN_REUSE:
+		return 0;
+	case MADV_FREE:
+		// MADV_FREE appeared in Linux 4.5, dropping the pages is the
+		// closest older equivalent
+		if (!no_madv_free) {
+			if ((madvise)(addr, len, MADV_FREE) == 0 || errno != EINVAL) {
+				return 0;
+			}
+			no_madv_free = true;
+		}
+		return (madvise)(addr, len, MADV_DONTNEED);
+	default:
+		return (madvise)(addr, len, advice);
+	}
+}
+#endif // MALLOC_TARGET_LINUX
+
 void
 mvm_aslr_init(void)
 {
 	// Prepare ASLR
-#if __i386__ || __x86_64__ || __arm64__ || TARGET_OS_EMBEDDED
+#if MALLOC_TARGET_LINUX
+	// The kernel randomizes the placement of every mmap()
+#elif __i386__ || __x86_64__ || __arm64__ || TARGET_OS_EMBEDDED
 #if __i386__
 	uintptr_t stackbase = 0x8fe00000;
 	int entropic_bits = 3;
@@ -162,7 +299,7 @@ mvm_allocate_pages_securely(size_t size, unsigned char align, int vm_page_label,
 	int alloc_flags = VM_FLAGS_ANYWHERE | VM_MAKE_TAG(vm_page_label);
 	kern_return_t kr;
 
-	if (debug_flags & DISABLE_ASLR) {
+	if ((debug_flags & DISABLE_ASLR) || MALLOC_TARGET_LINUX) {
 		return mvm_allocate_pages(size, align, 0, vm_page_label);
 	}
 
@@ -28,7 +28,11 @@
 static inline bool
 mvm_aslr_enabled(void)
 {
+#if MALLOC_TARGET_LINUX
+	return !(personality(0xffffffff) & ADDR_NO_RANDOMIZE);
+#else // MALLOC_TARGET_LINUX
 	return _dyld_get_image_slide((const struct mach_header *)_NSGetMachExecuteHeader()) != 0;
+#endif // MALLOC_TARGET_LINUX
 }
 
 MALLOC_NOEXPORT
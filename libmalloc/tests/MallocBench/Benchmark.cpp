@@ -37,16 +37,25 @@
 #include "stress.h"
 #include "stress_aligned.h"
 #include "tree.h"
-#include <dispatch/dispatch.h>
+#include <algorithm>
 #include <iostream>
 #include <fstream>
-#include <mach/mach.h>
-#include <mach/task_info.h>
 #include <map>
 #include <string>
+#include <strings.h>
 #include <sys/time.h>
 #include <thread>
 #include <unistd.h>
+#include <vector>
+#if defined(__linux__)
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#else
+#include <dispatch/dispatch.h>
+#include <mach/mach.h>
+#include <mach/task_info.h>
+#endif
 
 #include "mbmalloc.h"
 
@@ -146,6 +155,17 @@ void Benchmark::runOnce()
         return;
     }
 
+#if defined(__linux__)
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < cpuCount(); ++i) {
+        threads.push_back(std::thread([this] {
+            m_benchmarkPair->function(m_isParallel);
+        }));
+    }
+
+    for (auto& thread : threads)
+        thread.join();
+#else
     dispatch_group_t group = dispatch_group_create();
 
     for (size_t i = 0; i < cpuCount(); ++i) {
@@ -157,6 +177,7 @@ void Benchmark::runOnce()
     dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
 
     dispatch_release(group);
+#endif
 }
 
 void Benchmark::run()
@@ -223,6 +244,47 @@ double Benchmark::currentTimeMS()
     return (now.tv_sec * 1000.0) + now.tv_usec / 1000.0;
 }
 
+#if defined(__linux__)
+// Sums the kB values of the given fields in a /proc/self status-style file
+static size_t procMemoryBytes(const char* path, const char* const* fields, size_t count)
+{
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        cout << "Failed to open " << path << endl;
+        exit(1);
+    }
+
+    char line[256];
+    size_t bytes = 0;
+    while (fgets(line, sizeof(line), file)) {
+        for (size_t i = 0; i < count; ++i) {
+            size_t length = strlen(fields[i]);
+            if (!strncmp(line, fields[i], length) && line[length] == ':')
+                bytes += strtoull(line + length + 1, 0, 10) * 1024;
+        }
+    }
+    fclose(file);
+    return bytes;
+}
+
+Benchmark::Memory Benchmark::currentMemoryBytes()
+{
+    Memory memory;
+
+    // Pages given back with MADV_FREE stay resident until the kernel needs
+    // them, like reusable pages on Darwin they don't count in the footprint.
+    static const char* const resident[] = { "RssAnon" };
+    static const char* const residentMax[] = { "VmHWM" };
+    static const char* const footprint[] = { "Anonymous" };
+    static const char* const lazyFree[] = { "LazyFree" };
+
+    memory.resident = procMemoryBytes("/proc/self/status", resident, 1);
+    memory.residentMax = procMemoryBytes("/proc/self/status", residentMax, 1);
+    memory.physicalFootprint = procMemoryBytes("/proc/self/smaps_rollup", footprint, 1)
+        - procMemoryBytes("/proc/self/smaps_rollup", lazyFree, 1);
+    return memory;
+}
+#else
 Benchmark::Memory Benchmark::currentMemoryBytes()
 {
     Memory memory;
@@ -239,3 +301,4 @@ Benchmark::Memory Benchmark::currentMemoryBytes()
     memory.physicalFootprint = vm_info.phys_footprint;
     return memory;
 }
+#endif
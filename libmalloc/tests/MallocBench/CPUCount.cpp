@@ -26,8 +26,12 @@
 #include "CPUCount.h"
 #include <stdlib.h>
 #include <sys/param.h>
-#include <sys/sysctl.h>
 #include <sys/types.h>
+#if defined(__linux__)
+#include <unistd.h>
+#else
+#include <sys/sysctl.h>
+#endif
 
 static size_t count;
 
@@ -36,6 +40,12 @@ size_t cpuCount()
     if (count)
         return count;
 
+#if defined(__linux__)
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    if (online < 1)
+        abort();
+    count = online;
+#else
     size_t length = sizeof(count);
     int name[] = {
             CTL_HW,
@@ -44,6 +54,7 @@ size_t cpuCount()
     int sysctlResult = sysctl(name, sizeof(name) / sizeof(int), &count, &length, 0, 0);
     if (sysctlResult < 0)
         abort();
+#endif
 
     return count;
 }
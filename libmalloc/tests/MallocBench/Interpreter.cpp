@@ -31,6 +31,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <string>
+#include <strings.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
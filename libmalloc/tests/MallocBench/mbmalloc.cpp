@@ -23,10 +23,19 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
  */
 
+#include <algorithm>
 #include <limits>
 #include <stdio.h>
 #include <stdlib.h>
+#if defined(__linux__)
+#include <malloc.h>
+
+// Only defined when libmalloc.so is loaded, glibc malloc is trimmed instead
+typedef struct _malloc_zone_t malloc_zone_t;
+extern "C" size_t malloc_zone_pressure_relief(malloc_zone_t*, size_t) __attribute__((weak));
+#else
 #import <malloc/malloc.h>
+#endif
 
 extern "C" {
 
@@ -37,8 +46,11 @@ void* mbmalloc(size_t size)
 
 void* mbmemalign(size_t alignment, size_t size)
 {
+    // posix_memalign() rejects alignments smaller than a pointer, which the
+    // memalign benchmarks ask for.
     void* result;
-    posix_memalign(&result, alignment, size);
+    if (posix_memalign(&result, std::max(alignment, sizeof(void*)), size))
+        return nullptr;
     return result;
 }
 
@@ -54,6 +66,12 @@ void* mbrealloc(void* p, size_t, size_t newSize)
 
 void mbscavenge()
 {
+#if defined(__linux__)
+    if (!malloc_zone_pressure_relief) {
+        malloc_trim(0);
+        return;
+    }
+#endif
     malloc_zone_pressure_relief(nullptr, 0);
 }
 
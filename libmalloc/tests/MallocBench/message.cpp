@@ -25,9 +25,17 @@
 
 #include "CPUCount.h"
 #include "message.h"
-#include <dispatch/dispatch.h>
 #include <stdlib.h>
 #include <strings.h>
+#if defined(__linux__)
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#else
+#include <dispatch/dispatch.h>
+#endif
 
 #include "mbmalloc.h"
 
@@ -108,6 +116,79 @@ private:
     Node** m_buffer;
 };
 
+#if defined(__linux__)
+// Stands in for a serial dispatch queue: a thread that hashes and deletes the
+// messages handed to it, in order.
+class MessageQueue {
+public:
+    MessageQueue()
+        : m_isBusy()
+        , m_isDone()
+        , m_thread([this] { drain(); })
+    {
+    }
+
+    ~MessageQueue()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_isDone = true;
+        }
+        m_ready.notify_one();
+        m_thread.join();
+    }
+
+    void async(Message* message)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_messages.push_back(message);
+        }
+        m_ready.notify_one();
+    }
+
+    void sync()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_idle.wait(lock, [this] { return m_messages.empty() && !m_isBusy; });
+    }
+
+private:
+    void drain()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for (;;) {
+            m_ready.wait(lock, [this] { return !m_messages.empty() || m_isDone; });
+            if (m_messages.empty())
+                return;
+
+            Message* message = m_messages.front();
+            m_messages.pop_front();
+            m_isBusy = true;
+            lock.unlock();
+
+            size_t hash = message->hash();
+            if (hash)
+                abort();
+            delete message;
+
+            lock.lock();
+            m_isBusy = false;
+            if (m_messages.empty())
+                m_idle.notify_all();
+        }
+    }
+
+    std::mutex m_mutex;
+    std::condition_variable m_ready;
+    std::condition_variable m_idle;
+    std::deque<Message*> m_messages;
+    bool m_isBusy;
+    bool m_isDone;
+    std::thread m_thread;
+};
+#endif
+
 } // namespace
 
 void benchmark_message_one(bool isParallel)
@@ -118,6 +199,17 @@ void benchmark_message_one(bool isParallel)
     const size_t times = 2048;
     const size_t quantum = 16;
 
+#if defined(__linux__)
+    MessageQueue queue;
+
+    for (size_t i = 0; i < times; i += quantum) {
+        for (size_t j = 0; j < quantum; ++j)
+            queue.async(new Message);
+        queue.sync();
+    }
+
+    queue.sync();
+#else
     dispatch_queue_t queue = dispatch_queue_create("message", 0);
 
     for (size_t i = 0; i < times; i += quantum) {
@@ -136,6 +228,7 @@ void benchmark_message_one(bool isParallel)
     dispatch_sync(queue, ^{ });
 
     dispatch_release(queue);
+#endif
 }
 
 void benchmark_message_many(bool isParallel)
@@ -147,6 +240,22 @@ void benchmark_message_many(bool isParallel)
     const size_t quantum = 16;
 
     const size_t queueCount = cpuCount() - 1;
+#if defined(__linux__)
+    std::unique_ptr<MessageQueue[]> queues(new MessageQueue[queueCount]);
+
+    for (size_t i = 0; i < times; i += quantum) {
+        for (size_t j = 0; j < quantum; ++j) {
+            for (size_t k = 0; k < queueCount; ++k)
+                queues[k].async(new Message);
+        }
+
+        for (size_t i = 0; i < queueCount; ++i)
+            queues[i].sync();
+    }
+
+    for (size_t i = 0; i < queueCount; ++i)
+        queues[i].sync();
+#else
     dispatch_queue_t queues[queueCount];
     for (size_t i = 0; i < queueCount; ++i)
         queues[i] = dispatch_queue_create("message", 0);
@@ -173,4 +282,5 @@ void benchmark_message_many(bool isParallel)
 
     for (size_t i = 0; i < queueCount; ++i)
         dispatch_release(queues[i]);
+#endif
 }
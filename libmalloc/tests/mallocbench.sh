@@ -0,0 +1,170 @@
+#!/bin/bash -e
+#
+# Runs the Linux MallocBench binaries (make -f Makefile.linux) and writes a
+# report, or compares two reports.
+#
+#   mallocbench.sh run [-b builddir] [-a "libmalloc glibc"] [-o report]
+#   mallocbench.sh compare [-t threshold-%] old-report new-report
+#
+# A report is a tab separated table with one line per allocator and
+# benchmark, under a header naming the commit it was built from:
+#
+#   allocator  benchmark  time_ms  memory  peakmem  phys_footprint
+#
+# memory and phys_footprint are measured after the benchmark freed everything
+# and the allocator was asked to scavenge, peakmem is the peak RSS. compare
+# prints the change of each figure and exits with 1 when a time or footprint
+# grew by more than the threshold (default 10%) for any benchmark, or when a
+# benchmark that passed fails. Only reports from the same machine compare, and
+# times on a loaded machine vary by more than the default threshold.
+
+usage() {
+	sed -n 's/^#   \(mallocbench.sh\)/\1/p' "$0" >&2
+	exit 2
+}
+
+run() {
+	local builddir=build-linux allocators="libmalloc glibc" report=
+	local opt OPTIND=1
+	while getopts "a:b:o:" opt; do
+		case $opt in
+		a) allocators=$OPTARG ;;
+		b) builddir=$OPTARG ;;
+		o) report=$OPTARG ;;
+		*) usage ;;
+		esac
+	done
+
+	local commit
+	commit=$(git rev-parse --short HEAD 2>/dev/null || echo unknown)
+	if ! git diff --quiet HEAD -- . 2>/dev/null; then
+		commit="$commit-dirty"
+	fi
+	report=${report:-mallocbench-$commit.tsv}
+
+	local tmpdir failed=0
+	tmpdir=$(mktemp -d)
+	trap 'rm -rf "$tmpdir"' EXIT
+
+	{
+		printf "# commit\t%s\n" "$commit"
+		printf "# date\t%s\n" "$(date -u +%Y-%m-%dT%H:%M:%SZ)"
+		printf "# host\t%s %s, %s cpus\n" "$(uname -sr)" "$(uname -m)" "$(nproc)"
+		printf "allocator\tbenchmark\ttime_ms\tmemory\tpeakmem\tphys_footprint\n"
+	} > "$report"
+
+	local allocator preload bench name data
+	for allocator in $allocators; do
+		case $allocator in
+		libmalloc) preload=$(cd "$builddir" && pwd)/libmalloc.so ;;
+		glibc) preload= ;;
+		*) echo "unknown allocator $allocator" >&2; exit 2 ;;
+		esac
+		for bench in "$builddir"/single-* "$builddir"/parallel-*; do
+			name=${bench##*/}
+			echo "$allocator $name" >&2
+			rm -f "$tmpdir/dtres_$name.perfdata"
+			if BATS_TMP_DIR=$tmpdir LD_PRELOAD=$preload "$bench" \
+					> "$tmpdir/out" 2>&1 &&
+					grep -q "^TEST PASS" "$tmpdir/out"; then
+				# "data": [[time], [memory], [peakmem], [phys_footprint]]
+				data=$(sed -n 's/.*"data": \[\[\(.*\)\]\]/\1/p' \
+						"$tmpdir/dtres_$name.perfdata" | sed 's/\], \[/\t/g')
+			else
+				cat "$tmpdir/out" >&2
+				data=$(printf "FAIL\tFAIL\tFAIL\tFAIL")
+				failed=1
+			fi
+			printf "%s\t%s\t%s\n" "$allocator" "$name" "$data" >> "$report"
+		done
+	done
+
+	echo "Wrote $report" >&2
+	return $failed
+}
+
+compare() {
+	local threshold=10
+	local opt OPTIND=1
+	while getopts "t:" opt; do
+		case $opt in
+		t) threshold=$OPTARG ;;
+		*) usage ;;
+		esac
+	done
+	shift $((OPTIND - 1))
+	[ $# -eq 2 ] || usage
+
+	awk -F'\t' -v threshold="$threshold" '
+	function delta(old, new) {
+		if (new == "FAIL")
+			return "FAIL"
+		if (old == "FAIL")
+			return "fixed"
+		if (old == 0)
+			return new == 0 ? "+0.0%" : "new"
+		return sprintf("%+.1f%%", (new - old) * 100 / old)
+	}
+	function regressed(old, new, floor) {
+		if (new == "FAIL")
+			return old != "FAIL"
+		return old != "FAIL" && new > floor && old > 0 &&
+				(new - old) * 100 / old > threshold
+	}
+	function ms(time) {
+		return time == "FAIL" ? time : sprintf("%.2f", time)
+	}
+	/^#/ {
+		if ($2 != "")
+			header[FILENAME == ARGV[1] ? "old" : "new", $1] = $2
+		next
+	}
+	$1 == "allocator" {
+		next
+	}
+	FILENAME == ARGV[1] {
+		old[$1 "\t" $2] = $0
+		next
+	}
+	{
+		key = $1 "\t" $2
+		if (!(key in old)) {
+			printf "%-10s %-26s only in %s\n", $1, $2, ARGV[2]
+			next
+		}
+		split(old[key], o, "\t")
+		flag = ""
+		# Sub-millisecond times are noise
+		if (regressed(o[3], $3, 1) || regressed(o[6], $6, 0)) {
+			flag = "  <-- regression"
+			regressions++
+		}
+		printf "%-10s %-26s %10s %10s %8s %12s %12s %8s%s\n", $1, $2,
+				ms(o[3]), ms($3), delta(o[3], $3), o[6], $6, delta(o[6], $6), flag
+		seen[key] = 1
+	}
+	END {
+		for (key in old) {
+			if (!(key in seen)) {
+				split(key, k, "\t")
+				printf "%-10s %-26s only in %s\n", k[1], k[2], ARGV[1]
+			}
+		}
+		printf "%d regression(s) over %s%%, %s -> %s\n", regressions, threshold,
+				header["old", "# commit"], header["new", "# commit"]
+		exit regressions > 0
+	}' "$1" "$2" | {
+		printf "%-10s %-26s %10s %10s %8s %12s %12s %8s\n" allocator benchmark \
+				old_ms new_ms time old_footprint new_footprint footprint
+		cat
+	}
+	return "${PIPESTATUS[0]}"
+}
+
+cmd=$1
+shift || usage
+case $cmd in
+run) run "$@" ;;
+compare) compare "$@" ;;
+*) usage ;;
+esac
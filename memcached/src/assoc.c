@@ -26,6 +26,7 @@
 #include <pthread.h>
 
 static pthread_cond_t maintenance_cond = PTHREAD_COND_INITIALIZER;
+static pthread_mutex_t maintenance_lock = PTHREAD_MUTEX_INITIALIZER;
 
 
 typedef  unsigned long  int  ub4;   /* unsigned 4-byte quantities */
@@ -46,12 +47,19 @@ static item** primary_hashtable = 0;
  */
 static item** old_hashtable = 0;
 
-/* Number of items in the hash table. */
+/* Number of items in the hash table. Updated under different item locks,
+ * so it has its own. */
 static unsigned int hash_items = 0;
+#ifndef HAVE_GCC_ATOMICS
+static pthread_mutex_t hash_items_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
 
 /* Flag: Are we in the middle of expanding now? */
 static bool expanding = false;
 
+/* Flag: Has an insert asked the maintenance thread for an expansion? */
+static bool started_expanding = false;
+
 /*
  * During expansion we migrate values with bucket granularity; this is how
  * far we've gotten so far. Ranges from 0 .. hashsize(hashpower - 1) - 1.
@@ -73,6 +81,32 @@ void assoc_init(const int hashtable_init) {
     STATS_UNLOCK();
 }
 
+/*
+ * Grows the still empty table so it can take this many items without
+ * expanding, for a restart that is about to link them all back in.
+ */
+void assoc_presize(const unsigned int items) {
+    unsigned int power = hashpower;
+    item **table;
+
+    assert(hash_items == 0 && !expanding);
+    while (power < 32 && items > (hashsize(power) * 3) / 2)
+        power++;
+    if (power == hashpower)
+        return;
+    /* If this fails the table just grows at runtime instead */
+    if ((table = calloc(hashsize(power), sizeof(void *))) == NULL)
+        return;
+
+    free(primary_hashtable);
+    primary_hashtable = table;
+    hashpower = power;
+    STATS_LOCK();
+    stats.hash_power_level = hashpower;
+    stats.hash_bytes = hashsize(hashpower) * sizeof(void *);
+    STATS_UNLOCK();
+}
+
 item *assoc_find(const char *key, const size_t nkey, const uint32_t hv) {
     item *it;
     unsigned int oldbucket;
@@ -99,6 +133,66 @@ item *assoc_find(const char *key, const size_t nkey, const uint32_t hv) {
     return ret;
 }
 
+#ifdef HAVE_GCC_ATOMICS
+/*
+ * Lock-free assoc_find. The caller has read seq = item_seq_read(hv) and got
+ * an even number. Returns false if a writer got in the way, and the lookup
+ * has to be redone under the item lock. Otherwise *itp is the match, or NULL
+ * for a clean miss. A match is only a candidate until the caller has taken a
+ * reference on it and checked seq once more.
+ */
+bool assoc_find_lockfree(const char *key, const size_t nkey, const uint32_t hv,
+                         const unsigned int seq, item **itp) {
+    item **bucket;
+    item *it;
+    unsigned int oldbucket;
+
+    if (expanding &&
+        (oldbucket = (hv & hashmask(hashpower - 1))) >= expand_bucket)
+    {
+        bucket = &old_hashtable[oldbucket];
+    } else {
+        bucket = &primary_hashtable[hv & hashmask(hashpower)];
+    }
+    /* The table pointer and hashpower above have to belong together, and an
+     * unchanged seq proves they do. A table we may have picked stays
+     * allocated until item_quiesce_lookups() says we're gone. */
+    if (item_seq_changed(hv, seq))
+        return false;
+    it = *bucket;
+
+    while (it) {
+        if ((nkey == it->nkey) && (memcmp(key, ITEM_key(it), nkey) == 0)) {
+            break;
+        }
+        it = it->h_next;
+        /* Items are never unmapped, but a recycled one can lead us into
+         * another chain; stop as soon as ours has changed. */
+        if (item_seq_changed(hv, seq))
+            return false;
+    }
+    /* A miss is only final if nothing was added behind our back. */
+    if (it == NULL && item_seq_changed(hv, seq))
+        return false;
+    *itp = it;
+    return true;
+}
+#endif
+
+/*
+ * Hints the CPU to start loading the bucket for hv. Lookups that know their
+ * keys in advance (multi-get) issue these for every key first, so the table
+ * misses overlap. Only a hint: nothing is dereferenced, the table may be
+ * swapped out from under us, and the instruction never faults.
+ */
+void assoc_prefetch(const uint32_t hv) {
+#if defined(__GNUC__)
+    __builtin_prefetch(&primary_hashtable[hv & hashmask(hashpower)]);
+#else
+    (void)hv;
+#endif
+}
+
 /* returns the address of the item pointer before the key.  if *item == 0,
    the item wasn't found */
 
@@ -120,11 +214,26 @@ static item** _hashitem_before (const char *key, const size_t nkey, const uint32
     return pos;
 }
 
-/* grows the hashtable to the next power of 2. */
-static void assoc_expand(void) {
+static unsigned int hash_items_add(const int delta) {
+#ifdef HAVE_GCC_ATOMICS
+    return __sync_add_and_fetch(&hash_items, delta);
+#else
+    unsigned int res;
+    mutex_lock(&hash_items_lock);
+    hash_items += delta;
+    res = hash_items;
+    pthread_mutex_unlock(&hash_items_lock);
+    return res;
+#endif
+}
+
+/* grows the hashtable to the next power of 2, swapping in new_hashtable.
+ * The caller must hold every item lock (see item_lock_all). The table is
+ * allocated beforehand so that the locks are only held for the swap. */
+static void assoc_expand(item **new_hashtable) {
     old_hashtable = primary_hashtable;
 
-    primary_hashtable = calloc(hashsize(hashpower + 1), sizeof(void *));
+    primary_hashtable = new_hashtable;
     if (primary_hashtable) {
         if (settings.verbose > 1)
             fprintf(stderr, "Hash table expansion starting\n");
@@ -136,19 +245,31 @@ static void assoc_expand(void) {
         stats.hash_bytes += hashsize(hashpower) * sizeof(void *);
         stats.hash_is_expanding = 1;
         STATS_UNLOCK();
-        pthread_cond_signal(&maintenance_cond);
     } else {
         primary_hashtable = old_hashtable;
         /* Bad news, but we can keep running. */
     }
 }
 
+/* Asks the maintenance thread to grow the table. The caller holds an item
+ * lock, so it can't do the swap itself. */
+static void assoc_start_expand(void) {
+    mutex_lock(&maintenance_lock);
+    if (!started_expanding) {
+        started_expanding = true;
+        pthread_cond_signal(&maintenance_cond);
+    }
+    pthread_mutex_unlock(&maintenance_lock);
+}
+
 /* Note: this isn't an assoc_update.  The key must not already exist to call this */
 int assoc_insert(item *it, const uint32_t hv) {
     unsigned int oldbucket;
+    unsigned int items;
 
 //    assert(assoc_find(ITEM_key(it), it->nkey) == 0);  /* shouldn't have duplicately named things defined */
 
+    item_seq_write_begin(hv);
     if (expanding &&
         (oldbucket = (hv & hashmask(hashpower - 1))) >= expand_bucket)
     {
@@ -158,13 +279,14 @@ int assoc_insert(item *it, const uint32_t hv) {
         it->h_next = primary_hashtable[hv & hashmask(hashpower)];
         primary_hashtable[hv & hashmask(hashpower)] = it;
     }
+    item_seq_write_end(hv);
 
-    hash_items++;
-    if (! expanding && hash_items > (hashsize(hashpower) * 3) / 2) {
-        assoc_expand();
+    items = hash_items_add(1);
+    if (! expanding && items > (hashsize(hashpower) * 3) / 2) {
+        assoc_start_expand();
     }
 
-    MEMCACHED_ASSOC_INSERT(ITEM_key(it), it->nkey, hash_items);
+    MEMCACHED_ASSOC_INSERT(ITEM_key(it), it->nkey, items);
     return 1;
 }
 
@@ -173,14 +295,16 @@ void assoc_delete(const char *key, const size_t nkey, const uint32_t hv) {
 
     if (*before) {
         item *nxt;
-        hash_items--;
+        hash_items_add(-1);
         /* The DTrace probe cannot be triggered as the last instruction
          * due to possible tail-optimization by the compiler
          */
         MEMCACHED_ASSOC_DELETE(key, nkey, hash_items);
+        item_seq_write_begin(hv);
         nxt = (*before)->h_next;
         (*before)->h_next = 0;   /* probably pointless, but whatever. */
         *before = nxt;
+        item_seq_write_end(hv);
         return;
     }
     /* Note:  we never actually get here.  the callers don't delete things
@@ -194,20 +318,28 @@ static volatile int do_run_maintenance_thread = 1;
 #define DEFAULT_HASH_BULK_MOVE 1
 int hash_bulk_move = DEFAULT_HASH_BULK_MOVE;
 
+/*
+ * Buckets are moved one at a time under the item lock that covers them. The
+ * item lock table is never wider than the old hash table, so all the keys of
+ * an old bucket share that one lock, and readers of other buckets never
+ * wait on the move. Lock-free readers of the bucket being moved see its
+ * sequence number change and retry under the lock.
+ */
 static void *assoc_maintenance_thread(void *arg) {
 
     while (do_run_maintenance_thread) {
         int ii = 0;
 
-        /* Lock the cache, and bulk move multiple buckets to the new
-         * hash table. */
-        mutex_lock(&cache_lock);
-
         for (ii = 0; ii < hash_bulk_move && expanding; ++ii) {
             item *it, *next;
             int bucket;
+            unsigned int moving = expand_bucket;
+            item **retired = NULL;
+
+            item_lock(moving);
+            item_seq_write_begin(moving);
 
-            for (it = old_hashtable[expand_bucket]; NULL != it; it = next) {
+            for (it = old_hashtable[moving]; NULL != it; it = next) {
                 next = it->h_next;
 
                 bucket = hash(ITEM_key(it), it->nkey, 0) & hashmask(hashpower);
@@ -215,12 +347,12 @@ static void *assoc_maintenance_thread(void *arg) {
                 primary_hashtable[bucket] = it;
             }
 
-            old_hashtable[expand_bucket] = NULL;
+            old_hashtable[moving] = NULL;
 
             expand_bucket++;
             if (expand_bucket == hashsize(hashpower - 1)) {
                 expanding = false;
-                free(old_hashtable);
+                retired = old_hashtable;
                 STATS_LOCK();
                 stats.hash_bytes -= hashsize(hashpower - 1) * sizeof(void *);
                 stats.hash_is_expanding = 0;
@@ -228,14 +360,39 @@ static void *assoc_maintenance_thread(void *arg) {
                 if (settings.verbose > 1)
                     fprintf(stderr, "Hash table expansion done\n");
             }
+
+            item_seq_write_end(moving);
+            item_unlock(moving);
+
+            if (retired != NULL) {
+                /* Lock-free readers may still be looking at the old table. */
+                item_quiesce_lookups();
+                free(retired);
+            }
         }
 
         if (!expanding) {
             /* We are done expanding.. just wait for next invocation */
-            pthread_cond_wait(&maintenance_cond, &cache_lock);
-        }
+            mutex_lock(&maintenance_lock);
+            while (!started_expanding && do_run_maintenance_thread) {
+                pthread_cond_wait(&maintenance_cond, &maintenance_lock);
+            }
+            pthread_mutex_unlock(&maintenance_lock);
+
+            if (do_run_maintenance_thread) {
+                item **new_hashtable = calloc(hashsize(hashpower + 1),
+                                              sizeof(void *));
+                /* Swapping tables moves every bucket at once; keep all
+                 * readers and writers out while that happens. */
+                item_lock_all();
+                assoc_expand(new_hashtable);
+                item_unlock_all();
+            }
 
-        pthread_mutex_unlock(&cache_lock);
+            mutex_lock(&maintenance_lock);
+            started_expanding = false;
+            pthread_mutex_unlock(&maintenance_lock);
+        }
     }
     return NULL;
 }
@@ -260,10 +417,10 @@ int start_assoc_maintenance_thread() {
 }
 
 void stop_assoc_maintenance_thread() {
-    mutex_lock(&cache_lock);
+    mutex_lock(&maintenance_lock);
     do_run_maintenance_thread = 0;
     pthread_cond_signal(&maintenance_cond);
-    pthread_mutex_unlock(&cache_lock);
+    pthread_mutex_unlock(&maintenance_lock);
 
     /* Wait for the maintenance thread to stop */
     pthread_join(maintenance_tid, NULL);
@@ -1,6 +1,12 @@
 /* associative array */
 void assoc_init(const int hashpower_init);
+void assoc_presize(const unsigned int items);
 item *assoc_find(const char *key, const size_t nkey, const uint32_t hv);
+#ifdef HAVE_GCC_ATOMICS
+bool assoc_find_lockfree(const char *key, const size_t nkey, const uint32_t hv,
+                         const unsigned int seq, item **itp);
+#endif
+void assoc_prefetch(const uint32_t hv);
 int assoc_insert(item *item, const uint32_t hv);
 void assoc_delete(const char *key, const size_t nkey, const uint32_t hv);
 void do_assoc_move_next_bucket(void);
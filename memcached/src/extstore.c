@@ -0,0 +1,368 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * Append-only object store on a flash device or plain file (-o ext_path).
+ *
+ * The file is cut into fixed size pages. Objects are appended to one page at
+ * a time, and each page counts how much was written to it and how much of
+ * that hasn't been deleted since. When the pages run out, the page that was
+ * filled first is reused, objects and all; compaction (storage.c) moves the
+ * live objects off of mostly dead pages before it comes to that. A page's
+ * version changes every time it is reused, which is what tells a stale
+ * location from a good one, so deleting or reading an object that is gone is
+ * harmless.
+ *
+ * Reads are preadv()s, done by the caller or by a pool of IO threads. Nothing
+ * in here knows about items.
+ */
+#include "memcached.h"
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+enum page_state {
+    PAGE_FREE = 0,
+    PAGE_ACTIVE,        /* being appended to */
+    PAGE_FULL,
+    PAGE_COMPACTING     /* readable, freed once compaction is done with it */
+};
+
+typedef struct {
+    enum page_state state;
+    unsigned int version;
+    unsigned int used;      /* bytes written */
+    unsigned int live;      /* bytes written and not deleted since */
+    unsigned int objects;   /* objects written and not deleted since */
+    unsigned int refcount;  /* reads in flight */
+    uint64_t seq;           /* order pages were filled in */
+} ext_page;
+
+#define NO_PAGE ((unsigned int)-1)
+
+static int ext_fd = -1;
+static ext_page *pages;
+static unsigned int page_count;
+static unsigned int page_size;
+static unsigned int active = NO_PAGE;
+static uint64_t page_seq;
+static struct extstore_stats ext_stats;
+
+/* Protects the page table and ext_stats */
+static pthread_mutex_t ext_lock = PTHREAD_MUTEX_INITIALIZER;
+/* Held across a whole write, so pages only fill up in between writes */
+static pthread_mutex_t ext_write_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Reads waiting for an IO thread */
+static ext_io *io_head;
+static ext_io *io_tail;
+static pthread_mutex_t io_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t io_cond = PTHREAD_COND_INITIALIZER;
+
+static void *extstore_io_thread(void *arg);
+
+/*
+ * Creates (or truncates) the store file at path and starts io_threads IO
+ * threads. Returns 0 on success, -1 with the reason printed on failure.
+ */
+int extstore_init(const char *path, const uint64_t size,
+                  const unsigned int psize, const int io_threads) {
+    int i, ret;
+
+    page_size = psize;
+    page_count = size / psize;
+    if (page_count < 2) {
+        fprintf(stderr, "ext_path %s: room for %u pages, need at least 2\n",
+                path, page_count);
+        return -1;
+    }
+
+    /* Nothing on flash outlives the process, the item headers pointing at
+     * it are gone. */
+    if ((ext_fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600)) == -1) {
+        fprintf(stderr, "Failed to open ext_path %s: %s\n",
+                path, strerror(errno));
+        return -1;
+    }
+    if (ftruncate(ext_fd, (off_t)page_count * page_size) != 0) {
+        fprintf(stderr, "Failed to size ext_path %s: %s\n",
+                path, strerror(errno));
+        close(ext_fd);
+        return -1;
+    }
+
+    if ((pages = calloc(page_count, sizeof(ext_page))) == NULL) {
+        fprintf(stderr, "Failed to allocate the extstore page table\n");
+        close(ext_fd);
+        return -1;
+    }
+    ext_stats.page_size = page_size;
+    ext_stats.page_count = page_count;
+
+    for (i = 0; i < io_threads; i++) {
+        pthread_t tid;
+        if ((ret = pthread_create(&tid, NULL, extstore_io_thread, NULL)) != 0) {
+            fprintf(stderr, "Can't create extstore IO thread: %s\n",
+                    strerror(ret));
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Caller holds ext_lock. Starts appending to a new page: a free one if there
+ * is any, the one filled first otherwise. Pages with reads in flight are
+ * left alone. Returns NO_PAGE if every page is busy.
+ */
+static unsigned int next_page(void) {
+    unsigned int i, pick = NO_PAGE;
+    ext_page *p;
+
+    for (i = 0; i < page_count; i++) {
+        if (pages[i].state == PAGE_FREE && pages[i].refcount == 0) {
+            pick = i;
+            break;
+        }
+    }
+
+    if (pick == NO_PAGE) {
+        for (i = 0; i < page_count; i++) {
+            if (pages[i].state == PAGE_FULL && pages[i].refcount == 0 &&
+                (pick == NO_PAGE || pages[i].seq < pages[pick].seq)) {
+                pick = i;
+            }
+        }
+        if (pick == NO_PAGE)
+            return NO_PAGE;
+        ext_stats.pages_dropped++;
+        ext_stats.objects_dropped += pages[pick].objects;
+    }
+
+    p = &pages[pick];
+    p->state = PAGE_ACTIVE;
+    p->version++;
+    p->used = p->live = p->objects = 0;
+    p->seq = ++page_seq;
+    return pick;
+}
+
+/*
+ * Appends the object in iov and sets *loc to where it went. Returns -1 if it
+ * couldn't be written.
+ */
+int extstore_write(const struct iovec *iov, const int iovcnt, ext_loc *loc) {
+    size_t len = 0;
+    ssize_t written;
+    ext_page *p;
+    int i;
+
+    for (i = 0; i < iovcnt; i++)
+        len += iov[i].iov_len;
+    if (len == 0 || len > page_size)
+        return -1;
+
+    pthread_mutex_lock(&ext_write_lock);
+    pthread_mutex_lock(&ext_lock);
+    if (active == NO_PAGE || pages[active].used + len > page_size) {
+        if (active != NO_PAGE)
+            pages[active].state = PAGE_FULL;
+        if ((active = next_page()) == NO_PAGE) {
+            pthread_mutex_unlock(&ext_lock);
+            pthread_mutex_unlock(&ext_write_lock);
+            return -1;
+        }
+    }
+    p = &pages[active];
+    loc->page_id = active;
+    loc->page_version = p->version;
+    loc->offset = p->used;
+    loc->len = len;
+    pthread_mutex_unlock(&ext_lock);
+
+    written = pwritev(ext_fd, iov, iovcnt,
+                      (off_t)loc->page_id * page_size + loc->offset);
+
+    /* Readers only see the object once used covers it */
+    pthread_mutex_lock(&ext_lock);
+    if (written == (ssize_t)len) {
+        p->used += len;
+        p->live += len;
+        p->objects++;
+        ext_stats.objects_written++;
+        ext_stats.bytes_written += len;
+    }
+    pthread_mutex_unlock(&ext_lock);
+    pthread_mutex_unlock(&ext_write_lock);
+
+    if (written != (ssize_t)len) {
+        if (settings.verbose > 0)
+            fprintf(stderr, "extstore write failed: %s\n",
+                    written < 0 ? strerror(errno) : "short write");
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Reads io->loc into io->iov, and sets io->result to the number of bytes
+ * read, or -1 if the page the object was on has been reused since. Returns
+ * io->result.
+ */
+int extstore_read(ext_io *io) {
+    size_t len = 0;
+    ssize_t got;
+    ext_page *p;
+    int i;
+
+    io->result = -1;
+    if (io->loc.page_id >= page_count)
+        return -1;
+    for (i = 0; i < io->iovcnt; i++)
+        len += io->iov[i].iov_len;
+
+    p = &pages[io->loc.page_id];
+    pthread_mutex_lock(&ext_lock);
+    if (p->state == PAGE_FREE || p->version != io->loc.page_version ||
+        io->loc.offset + len > p->used) {
+        pthread_mutex_unlock(&ext_lock);
+        return -1;
+    }
+    /* Keeps the page from being reused under us */
+    p->refcount++;
+    pthread_mutex_unlock(&ext_lock);
+
+    got = preadv(ext_fd, io->iov, io->iovcnt,
+                 (off_t)io->loc.page_id * page_size + io->loc.offset);
+
+    pthread_mutex_lock(&ext_lock);
+    p->refcount--;
+    if (got == (ssize_t)len) {
+        ext_stats.objects_read++;
+        ext_stats.bytes_read += len;
+    }
+    pthread_mutex_unlock(&ext_lock);
+
+    if (got == (ssize_t)len)
+        io->result = len;
+    return io->result;
+}
+
+/* Queues io for the IO threads. io->cb is called from one when it's done. */
+void extstore_submit(ext_io *io) {
+    io->next = NULL;
+    pthread_mutex_lock(&io_lock);
+    if (io_tail == NULL) {
+        io_head = io;
+    } else {
+        io_tail->next = io;
+    }
+    io_tail = io;
+    pthread_cond_signal(&io_cond);
+    pthread_mutex_unlock(&io_lock);
+}
+
+static void *extstore_io_thread(void *arg) {
+    ext_io *io;
+
+    for (;;) {
+        pthread_mutex_lock(&io_lock);
+        while (io_head == NULL)
+            pthread_cond_wait(&io_cond, &io_lock);
+        io = io_head;
+        io_head = io->next;
+        if (io_head == NULL)
+            io_tail = NULL;
+        pthread_mutex_unlock(&io_lock);
+
+        extstore_read(io);
+        io->cb(io);
+    }
+    return NULL;
+}
+
+/* Marks the object at loc as dead, unless its page was reused already. */
+void extstore_delete(const ext_loc *loc) {
+    ext_page *p;
+
+    if (loc->page_id >= page_count)
+        return;
+    p = &pages[loc->page_id];
+    pthread_mutex_lock(&ext_lock);
+    if (p->state != PAGE_FREE && p->version == loc->page_version &&
+        p->objects > 0 && p->live >= loc->len) {
+        p->live -= loc->len;
+        p->objects--;
+    }
+    pthread_mutex_unlock(&ext_lock);
+}
+
+/*
+ * Finds the full page with the least live data, if that is under under_pct
+ * percent of what was written to it, and hands it to the caller to compact:
+ * page->page_id and page_version say which one, page->len how much of it to
+ * look through. The page stays readable until extstore_compact_done().
+ */
+bool extstore_compact_pick(const int under_pct, ext_loc *page) {
+    unsigned int i, pick = NO_PAGE;
+    uint64_t best = 0;
+
+    pthread_mutex_lock(&ext_lock);
+    for (i = 0; i < page_count; i++) {
+        ext_page *p = &pages[i];
+        uint64_t ratio;
+        if (p->state != PAGE_FULL || p->used == 0 ||
+            (uint64_t)p->live * 100 >= (uint64_t)p->used * under_pct) {
+            continue;
+        }
+        ratio = (uint64_t)p->live * 1000 / p->used;
+        if (pick == NO_PAGE || ratio < best) {
+            pick = i;
+            best = ratio;
+        }
+    }
+    if (pick != NO_PAGE) {
+        pages[pick].state = PAGE_COMPACTING;
+        page->page_id = pick;
+        page->page_version = pages[pick].version;
+        page->offset = 0;
+        page->len = pages[pick].used;
+    }
+    pthread_mutex_unlock(&ext_lock);
+    return pick != NO_PAGE;
+}
+
+/* Frees a page picked by extstore_compact_pick(). */
+void extstore_compact_done(const ext_loc *page) {
+    ext_page *p = &pages[page->page_id];
+
+    pthread_mutex_lock(&ext_lock);
+    if (p->state == PAGE_COMPACTING && p->version == page->page_version) {
+        p->state = PAGE_FREE;
+        p->used = p->live = p->objects = 0;
+    }
+    pthread_mutex_unlock(&ext_lock);
+}
+
+void extstore_get_stats(struct extstore_stats *st) {
+    unsigned int i;
+
+    pthread_mutex_lock(&ext_lock);
+    *st = ext_stats;
+    st->pages_free = 0;
+    st->objects_used = st->bytes_used = st->bytes_fragmented = 0;
+    for (i = 0; i < page_count; i++) {
+        ext_page *p = &pages[i];
+        if (p->state == PAGE_FREE) {
+            st->pages_free++;
+            continue;
+        }
+        st->objects_used += p->objects;
+        st->bytes_used += p->live;
+        st->bytes_fragmented += p->used - p->live;
+    }
+    pthread_mutex_unlock(&ext_lock);
+}
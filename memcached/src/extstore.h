@@ -0,0 +1,50 @@
+/* Append-only flash page store (-o ext_path), see extstore.c */
+#ifndef EXTSTORE_H
+#define EXTSTORE_H
+
+#include <sys/uio.h>
+
+/* Where an object was written. len is only used for space accounting. */
+typedef struct {
+    unsigned int page_id;
+    unsigned int page_version;
+    unsigned int offset;
+    unsigned int len;
+} ext_loc;
+
+/* A read at loc into iov; done by an IO thread, which then calls cb. */
+typedef struct _ext_io {
+    ext_loc loc;
+    struct iovec iov[3];
+    int iovcnt;
+    int result;             /* bytes read, -1 if the object is gone */
+    void (*cb)(struct _ext_io *io);
+    struct _ext_io *next;
+} ext_io;
+
+struct extstore_stats {
+    unsigned int page_size;
+    unsigned int page_count;
+    unsigned int pages_free;
+    uint64_t objects_used;      /* written and not deleted since */
+    uint64_t bytes_used;
+    uint64_t bytes_fragmented;  /* deleted, but on pages still in use */
+    uint64_t objects_written;
+    uint64_t bytes_written;
+    uint64_t objects_read;
+    uint64_t bytes_read;
+    uint64_t pages_dropped;     /* reused while still holding live objects */
+    uint64_t objects_dropped;
+};
+
+int  extstore_init(const char *path, const uint64_t size,
+                   const unsigned int page_size, const int io_threads);
+int  extstore_write(const struct iovec *iov, const int iovcnt, ext_loc *loc);
+int  extstore_read(ext_io *io);
+void extstore_submit(ext_io *io);
+void extstore_delete(const ext_loc *loc);
+bool extstore_compact_pick(const int under_pct, ext_loc *page);
+void extstore_compact_done(const ext_loc *page);
+void extstore_get_stats(struct extstore_stats *st);
+
+#endif
@@ -2,14 +2,20 @@
 /*
  * Hash table
  *
- * The hash function used here is by Bob Jenkins, 1996:
+ * The default hash function used here is by Bob Jenkins, 1996:
  *    <http://burtleburtle.net/bob/hash/doobs.html>
  *       "By Bob Jenkins, 1996.  bob_jenkins@burtleburtle.net.
  *       You may use this code any way you wish, private, educational,
  *       or commercial.  It's free."
  *
+ * The alternatives selectable with -o hash_algorithm are in murmur3_hash.c
+ * and xxh64_hash.c.
  */
 #include "memcached.h"
+#include "murmur3_hash.h"
+#include "xxh64_hash.h"
+
+#include <string.h>
 
 /*
  * Since the hash function does bit manipulation, it needs to know
@@ -122,7 +128,7 @@ and these came close:
 }
 
 #if HASH_LITTLE_ENDIAN == 1
-uint32_t hash(
+uint32_t jenkins_hash(
   const void *key,       /* the key to hash */
   size_t      length,    /* length of the key */
   const uint32_t    initval)   /* initval */
@@ -303,7 +309,7 @@ uint32_t hash(
  * from hashlittle() on all machines.  hashbig() takes advantage of
  * big-endian byte ordering.
  */
-uint32_t hash( const void *key, size_t length, const uint32_t initval)
+uint32_t jenkins_hash( const void *key, size_t length, const uint32_t initval)
 {
   uint32_t a,b,c;
   union { const void *ptr; size_t i; } u; /* to cast key to (size_t) happily */
@@ -429,3 +435,45 @@ uint32_t hash( const void *key, size_t length, const uint32_t initval)
 #else /* HASH_XXX_ENDIAN == 1 */
 #error Must define HASH_BIG_ENDIAN or HASH_LITTLE_ENDIAN
 #endif /* HASH_XXX_ENDIAN == 1 */
+
+/*
+ * The hash function is picked once at startup (-o hash_algorithm) and
+ * called through this pointer from then on.
+ */
+hash_func hash = jenkins_hash;
+
+static const struct {
+    const char *name;
+    hash_func func;
+} hash_funcs[] = {
+    [JENKINS_HASH] = { "jenkins", jenkins_hash },
+    [MURMUR3_HASH] = { "murmur3", murmur3_hash },
+    [XXH64_HASH]   = { "xxh64",   xxh64_hash },
+};
+
+#define HASH_FUNCS_COUNT (sizeof(hash_funcs) / sizeof(hash_funcs[0]))
+
+int hash_init(enum hashfunc_type type) {
+    if ((unsigned int)type >= HASH_FUNCS_COUNT)
+        return -1;
+    hash = hash_funcs[type].func;
+    return 0;
+}
+
+/* Returns 0 and sets *type if name is a known hash function, -1 otherwise. */
+int hash_type_by_name(const char *name, enum hashfunc_type *type) {
+    unsigned int i;
+    for (i = 0; i < HASH_FUNCS_COUNT; i++) {
+        if (strcmp(name, hash_funcs[i].name) == 0) {
+            *type = (enum hashfunc_type) i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+const char *hash_name(enum hashfunc_type type) {
+    if ((unsigned int)type >= HASH_FUNCS_COUNT)
+        return "unknown";
+    return hash_funcs[type].name;
+}
@@ -5,11 +5,23 @@
 extern "C" {
 #endif
 
-uint32_t hash(const void *key, size_t length, const uint32_t initval);
+typedef uint32_t (*hash_func)(const void *key, size_t length,
+                              const uint32_t initval);
+/* Set up by hash_init(); every caller goes through this. */
+extern hash_func hash;
+
+enum hashfunc_type {
+    JENKINS_HASH = 0, MURMUR3_HASH, XXH64_HASH
+};
+
+int hash_init(enum hashfunc_type type);
+int hash_type_by_name(const char *name, enum hashfunc_type *type);
+const char *hash_name(enum hashfunc_type type);
+
+uint32_t jenkins_hash(const void *key, size_t length, const uint32_t initval);
 
 #ifdef    __cplusplus
 }
 #endif
 
 #endif    /* HASH_H */
-
@@ -0,0 +1,175 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * Microbenchmark for the hash functions selectable with -o hash_algorithm.
+ *
+ * Hashes a set of generated keys with each function, for a few key length
+ * distributions, and prints the time per key along with how evenly the keys
+ * spread over a hash table of the default size.
+ *
+ *   ./hashbench [-n keys] [-i iterations]
+ */
+#include "memcached.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_NKEYS 100000
+#define DEFAULT_ITERATIONS 50
+#define TABLE_POWER 16
+#define TABLE_SIZE (1U << TABLE_POWER)
+
+struct key_dist {
+    const char *name;
+    int min_len;
+    int max_len;
+};
+
+/* Lengths memcached keys tend to come in: short ids, "prefix:id:field"
+ * style keys, and the occasional long, hashed or URL-ish one. */
+static const struct key_dist dists[] = {
+    { "short (4-16)",    4,   16 },
+    { "typical (16-48)", 16,  48 },
+    { "long (64-250)",   64,  250 },
+    { "mixed (4-250)",   4,   250 },
+};
+
+static const enum hashfunc_type funcs[] = {
+    JENKINS_HASH, MURMUR3_HASH, XXH64_HASH
+};
+
+#define DISTS_COUNT (sizeof(dists) / sizeof(dists[0]))
+#define FUNCS_COUNT (sizeof(funcs) / sizeof(funcs[0]))
+
+struct bench_key {
+    char *key;
+    size_t nkey;
+};
+
+static double now(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static struct bench_key *make_keys(const struct key_dist *dist, int nkeys) {
+    static const char chars[] =
+        "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789:_-";
+    struct bench_key *keys = calloc(nkeys, sizeof(struct bench_key));
+    int i;
+    size_t j;
+
+    if (keys == NULL) {
+        perror("calloc");
+        exit(1);
+    }
+    for (i = 0; i < nkeys; i++) {
+        /* A random prefix keeps repeated keys out, the rest is filler */
+        int len = dist->min_len + rand() % (dist->max_len - dist->min_len + 1);
+        keys[i].key = malloc(len + 1);
+        if (keys[i].key == NULL) {
+            perror("malloc");
+            exit(1);
+        }
+        snprintf(keys[i].key, len + 1, "%08x", (unsigned int)i * 2654435761U);
+        for (j = strlen(keys[i].key); j < (size_t)len; j++) {
+            keys[i].key[j] = chars[rand() % (sizeof(chars) - 1)];
+        }
+        keys[i].key[len] = '\0';
+        keys[i].nkey = len;
+    }
+    return keys;
+}
+
+static void free_keys(struct bench_key *keys, int nkeys) {
+    int i;
+    for (i = 0; i < nkeys; i++) {
+        free(keys[i].key);
+    }
+    free(keys);
+}
+
+/* Ratio of the observed bucket count variance to the one a perfectly
+ * random hash would give; ~1.0 is what we want. */
+static double spread(const struct bench_key *keys, int nkeys) {
+    unsigned int *buckets = calloc(TABLE_SIZE, sizeof(unsigned int));
+    double mean = (double)nkeys / TABLE_SIZE;
+    double var = 0;
+    unsigned int i;
+
+    if (buckets == NULL) {
+        perror("calloc");
+        exit(1);
+    }
+    for (i = 0; i < (unsigned int)nkeys; i++) {
+        buckets[hash(keys[i].key, keys[i].nkey, 0) & (TABLE_SIZE - 1)]++;
+    }
+    for (i = 0; i < TABLE_SIZE; i++) {
+        var += (buckets[i] - mean) * (buckets[i] - mean);
+    }
+    free(buckets);
+    var /= TABLE_SIZE;
+    return var / mean;
+}
+
+int main(int argc, char **argv) {
+    int nkeys = DEFAULT_NKEYS;
+    int iterations = DEFAULT_ITERATIONS;
+    unsigned int d, f;
+    int c;
+
+    while ((c = getopt(argc, argv, "n:i:")) != -1) {
+        switch (c) {
+        case 'n':
+            nkeys = atoi(optarg);
+            break;
+        case 'i':
+            iterations = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n keys] [-i iterations]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (nkeys <= 0 || iterations <= 0) {
+        fprintf(stderr, "keys and iterations must be positive\n");
+        return 1;
+    }
+
+    printf("%-16s %-8s %10s %10s %8s\n",
+           "keys", "hash", "ns/key", "MB/s", "spread");
+    for (d = 0; d < DISTS_COUNT; d++) {
+        struct bench_key *keys;
+        size_t bytes = 0;
+        int i;
+
+        srand(1);
+        keys = make_keys(&dists[d], nkeys);
+        for (i = 0; i < nkeys; i++) {
+            bytes += keys[i].nkey;
+        }
+
+        for (f = 0; f < FUNCS_COUNT; f++) {
+            volatile uint32_t sink = 0;
+            double start, elapsed;
+            int it;
+
+            hash_init(funcs[f]);
+            start = now();
+            for (it = 0; it < iterations; it++) {
+                for (i = 0; i < nkeys; i++) {
+                    sink += hash(keys[i].key, keys[i].nkey, 0);
+                }
+            }
+            elapsed = now() - start;
+
+            printf("%-16s %-8s %10.2f %10.1f %8.3f\n",
+                   dists[d].name, hash_name(funcs[f]),
+                   elapsed * 1e9 / ((double)nkeys * iterations),
+                   (double)bytes * iterations / elapsed / (1024 * 1024),
+                   spread(keys, nkeys));
+        }
+        free_keys(keys, nkeys);
+    }
+    return 0;
+}
@@ -14,16 +14,11 @@
 #include <assert.h>
 
 /* Forward Declarations */
+static void do_item_link_q(item *it);
+static void do_item_unlink_q(item *it);
 static void item_link_q(item *it);
 static void item_unlink_q(item *it);
 
-/*
- * We only reposition items in the LRU queue if they haven't been repositioned
- * in this many seconds. That saves us from churning on frequently-accessed
- * items.
- */
-#define ITEM_UPDATE_INTERVAL 60
-
 #define LARGEST_ID POWER_LARGEST
 typedef struct {
     uint64_t evicted;
@@ -34,24 +29,44 @@ typedef struct {
     uint64_t tailrepairs;
     uint64_t expired_unfetched;
     uint64_t evicted_unfetched;
+    uint64_t moves_to_cold;
+    uint64_t moves_to_warm;
+    uint64_t moves_within_lru;
+    uint64_t lrutail_reflocked;
 } itemstats_t;
 
-static item *heads[LARGEST_ID];
-static item *tails[LARGEST_ID];
-static itemstats_t itemstats[LARGEST_ID];
-static unsigned int sizes[LARGEST_ID];
+/*
+ * Each slab class has its own HOT, WARM and COLD queue. Every queue and its
+ * itemstats are protected by the matching entry in lru_locks[][].
+ */
+static item *heads[LARGEST_ID][NUM_LRU];
+static item *tails[LARGEST_ID][NUM_LRU];
+static itemstats_t itemstats[LARGEST_ID][NUM_LRU];
+static unsigned int sizes[LARGEST_ID][NUM_LRU];
+
+static pthread_mutex_t cas_id_lock = PTHREAD_MUTEX_INITIALIZER;
 
 void item_stats_reset(void) {
-    mutex_lock(&cache_lock);
-    memset(itemstats, 0, sizeof(itemstats));
-    pthread_mutex_unlock(&cache_lock);
+    int i, lru;
+    for (i = 0; i < LARGEST_ID; i++) {
+        for (lru = 0; lru < NUM_LRU; lru++) {
+            mutex_lock(&lru_locks[i][lru]);
+            memset(&itemstats[i][lru], 0, sizeof(itemstats_t));
+            pthread_mutex_unlock(&lru_locks[i][lru]);
+        }
+    }
 }
 
 
 /* Get the next CAS id for a new item. */
+static uint64_t cas_id = 0;
+
 uint64_t get_cas_id(void) {
-    static uint64_t cas_id = 0;
-    return ++cas_id;
+    uint64_t next_id;
+    pthread_mutex_lock(&cas_id_lock);
+    next_id = ++cas_id;
+    pthread_mutex_unlock(&cas_id_lock);
+    return next_id;
 }
 
 /* Enable this for reference-count debugging. */
@@ -84,105 +99,242 @@ static size_t item_make_header(const uint8_t nkey, const int flags, const int nb
     return sizeof(item) + nkey + *nsuffix + nbytes;
 }
 
-/*@null@*/
-item *do_item_alloc(char *key, const size_t nkey, const int flags, const rel_time_t exptime, const int nbytes) {
-    uint8_t nsuffix;
+static unsigned int lru_total(const unsigned int id) {
+    return sizes[id][HOT_LRU] + sizes[id][WARM_LRU] + sizes[id][COLD_LRU];
+}
+
+/*
+ * Looks at up to five items from the tail of one LRU segment and acts on the
+ * first one it can lock:
+ *
+ * - expired or flushed items are reclaimed,
+ * - HOT and WARM items over their segment's share flow down (active ones go
+ *   to WARM, the rest to COLD),
+ * - COLD items that were fetched get a second chance in WARM,
+ * - otherwise, if do_evict is set, the COLD tail is evicted.
+ *
+ * Reclaimed and evicted items are freed, unless reuse is non-NULL, in which
+ * case the unlinked item is handed back with one reference held.
+ *
+ * Lock order is item_lock -> lru_lock -> slabs_lock, so item locks are only
+ * tried here. Returns the number of items acted on.
+ */
+static int lru_pull_tail(const unsigned int id, const int cur_lru,
+                         const bool do_evict, item **reuse) {
     item *it = NULL;
-    char suffix[40];
-    size_t ntotal = item_make_header(nkey + 1, flags, nbytes, suffix, &nsuffix);
-    if (settings.use_cas) {
-        ntotal += sizeof(uint64_t);
+    item *search;
+    item *prev;
+    int tries = 5;
+    int move_to_lru = -1;
+    void *hold_lock = NULL;
+    uint32_t hv = 0;
+    unsigned int limit = 0;
+    rel_time_t oldest_live = settings.oldest_live;
+    itemstats_t *istats = &itemstats[id][cur_lru];
+
+    if (cur_lru == HOT_LRU) {
+        limit = lru_total(id) * settings.hot_lru_pct / 100;
+    } else if (cur_lru == WARM_LRU) {
+        limit = lru_total(id) * settings.warm_lru_pct / 100;
     }
 
-    unsigned int id = slabs_clsid(ntotal);
-    if (id == 0)
-        return 0;
+    mutex_lock(&lru_locks[id][cur_lru]);
+    for (search = tails[id][cur_lru];
+         tries > 0 && search != NULL;
+         tries--, search = prev) {
+        prev = search->prev;
+        hv = hash(ITEM_key(search), search->nkey, 0);
+        /* Somebody else is working on this item (or one sharing its lock);
+         * skip it rather than invert the lock order. */
+        if ((hold_lock = item_trylock(hv)) == NULL)
+            continue;
 
-    mutex_lock(&cache_lock);
-    /* do a quick check if we have any expired items in the tail.. */
-    item *search;
-    rel_time_t oldest_live = settings.oldest_live;
+        if (refcount_incr(&search->refcount) != 2) {
+            istats->lrutail_reflocked++;
+            /* Last ditch effort. There was a very rare bug which caused
+             * refcount leaks. We leave this just in case they ever happen
+             * again. We can reasonably assume no item can stay locked for
+             * more than three hours, so if we find one in the tail which is
+             * that old, free it anyway.
+             */
+            if (search->time + TAIL_REPAIR_TIME < current_time) {
+                istats->tailrepairs++;
+                search->refcount = 1;
+                do_item_unlink_nolock(search, hv);
+            } else {
+                refcount_decr(&search->refcount);
+            }
+            item_trylock_unlock(hold_lock);
+            continue;
+        }
 
-    search = tails[id];
-    if (search != NULL && (refcount_incr(&search->refcount) == 2)) {
         if ((search->exptime != 0 && search->exptime < current_time)
             || (search->time <= oldest_live && oldest_live <= current_time)) {  // dead by flush
+            istats->reclaimed++;
             STATS_LOCK();
             stats.reclaimed++;
-            STATS_UNLOCK();
-            itemstats[id].reclaimed++;
             if ((search->it_flags & ITEM_FETCHED) == 0) {
-                STATS_LOCK();
                 stats.expired_unfetched++;
-                STATS_UNLOCK();
-                itemstats[id].expired_unfetched++;
+                istats->expired_unfetched++;
             }
+            STATS_UNLOCK();
             it = search;
-            slabs_adjust_mem_requested(it->slabs_clsid, ITEM_ntotal(it), ntotal);
-            do_item_unlink_nolock(it, hash(ITEM_key(it), it->nkey, 0));
-            /* Initialize the item block: */
-            it->slabs_clsid = 0;
-        } else if ((it = slabs_alloc(ntotal, id)) == NULL) {
-            if (settings.evict_to_free == 0) {
-                itemstats[id].outofmemory++;
-                pthread_mutex_unlock(&cache_lock);
-                return NULL;
+        } else if (cur_lru != COLD_LRU) {
+            if (sizes[id][cur_lru] > limit) {
+                if ((search->it_flags & ITEM_ACTIVE) != 0) {
+                    search->it_flags &= ~ITEM_ACTIVE;
+                    if (cur_lru == WARM_LRU) {
+                        istats->moves_within_lru++;
+                    } else {
+                        istats->moves_to_warm++;
+                    }
+                    move_to_lru = WARM_LRU;
+                } else {
+                    istats->moves_to_cold++;
+                    move_to_lru = COLD_LRU;
+                }
+                it = search;
             }
-            itemstats[id].evicted++;
-            itemstats[id].evicted_time = current_time - search->time;
+        } else if (settings.lru_maintainer_thread &&
+                   (search->it_flags & ITEM_ACTIVE) != 0) {
+            /* Fetched while cold: give it another lap through WARM. */
+            search->it_flags &= ~ITEM_ACTIVE;
+            istats->moves_to_warm++;
+            move_to_lru = WARM_LRU;
+            it = search;
+        } else if (do_evict) {
+            istats->evicted++;
+            istats->evicted_time = current_time - search->time;
             if (search->exptime != 0)
-                itemstats[id].evicted_nonzero++;
+                istats->evicted_nonzero++;
+            STATS_LOCK();
+            stats.evictions++;
             if ((search->it_flags & ITEM_FETCHED) == 0) {
-                STATS_LOCK();
                 stats.evicted_unfetched++;
-                STATS_UNLOCK();
-                itemstats[id].evicted_unfetched++;
+                istats->evicted_unfetched++;
             }
-            STATS_LOCK();
-            stats.evictions++;
             STATS_UNLOCK();
             it = search;
-            slabs_adjust_mem_requested(it->slabs_clsid, ITEM_ntotal(it), ntotal);
-            do_item_unlink_nolock(it, hash(ITEM_key(it), it->nkey, 0));
-            /* Initialize the item block: */
-            it->slabs_clsid = 0;
-        } else {
+        }
+
+        if (it == NULL) {
+            /* The tail is fine where it is. */
             refcount_decr(&search->refcount);
+            item_trylock_unlock(hold_lock);
         }
+        break;
+    }
+
+    if (it != NULL) {
+        if (move_to_lru != -1) {
+            do_item_unlink_q(it);
+        } else {
+            do_item_unlink_nolock(it, hv);
+        }
+    }
+    pthread_mutex_unlock(&lru_locks[id][cur_lru]);
+
+    if (it == NULL)
+        return 0;
+
+    if (move_to_lru != -1) {
+        /* The item lock and our reference keep it put while it is off of
+         * every queue. */
+        it->lru = move_to_lru;
+        item_link_q(it);
+        do_item_remove(it);
+    } else if (reuse != NULL && it->refcount == 1) {
+        /* Only our reference is left; a lock-free reader that pins it from
+         * here on finds it unlinked and lets go again. */
+        *reuse = it;
     } else {
-        /* If the LRU is empty or locked, attempt to allocate memory */
-        it = slabs_alloc(ntotal, id);
-        if (search != NULL)
-            refcount_decr(&search->refcount);
+        /* Pinned by a lock-free reader since we checked; it frees the item
+         * when it's done. */
+        do_item_remove(it);
     }
+    item_trylock_unlock(hold_lock);
+    return 1;
+}
 
+/*
+ * Takes a reclaimable (or, with do_evict, evictable) item off of the COLD
+ * tail of a slab class and readies its memory for reuse by do_item_alloc.
+ */
+static item *lru_reuse_tail(const unsigned int id, const size_t ntotal,
+                            const bool do_evict) {
+    item *it = NULL;
+    lru_pull_tail(id, COLD_LRU, do_evict, &it);
+    if (it != NULL) {
+        /* Skips item_free(), which would let go of its value on flash */
+        if ((it->it_flags & ITEM_HDR) != 0)
+            storage_delete(it);
+        slabs_adjust_mem_requested(it->slabs_clsid, ITEM_ntotal(it), ntotal);
+        /* Initialize the item block: */
+        it->slabs_clsid = 0;
+    }
+    return it;
+}
+
+/*@null@*/
+item *do_item_alloc(char *key, const size_t nkey, const int flags, const rel_time_t exptime, const int nbytes) {
+    uint8_t nsuffix;
+    char suffix[40];
+    item_make_header(nkey + 1, flags, nbytes, suffix, &nsuffix);
+    return do_item_alloc_suffix(key, nkey, suffix, nsuffix, exptime, nbytes);
+}
+
+/*
+ * do_item_alloc with the suffix made up already; an ITEM_HDR item keeps the
+ * suffix of the item it stands in for, so its size doesn't match nbytes.
+ */
+/*@null@*/
+item *do_item_alloc_suffix(const char *key, const size_t nkey,
+                           const char *suffix, const uint8_t nsuffix,
+                           const rel_time_t exptime, const int nbytes) {
+    item *it = NULL;
+    int i;
+    size_t ntotal = sizeof(item) + nkey + 1 + nsuffix + nbytes;
+    if (settings.use_cas) {
+        ntotal += sizeof(uint64_t);
+    }
+
+    unsigned int id = slabs_clsid(ntotal);
+    if (id == 0)
+        return 0;
+
+    /* do a quick check if we have any expired items in the tail.. */
+    it = lru_reuse_tail(id, ntotal, false);
     if (it == NULL) {
-        itemstats[id].outofmemory++;
-        /* Last ditch effort. There was a very rare bug which caused
-         * refcount leaks. We leave this just in case they ever happen again.
-         * We can reasonably assume no item can stay locked for more than
-         * three hours, so if we find one in the tail which is that old,
-         * free it anyway.
-         */
-        if (search != NULL &&
-            search->refcount != 2 &&
-            search->time + TAIL_REPAIR_TIME < current_time) {
-            itemstats[id].tailrepairs++;
-            search->refcount = 1;
-            do_item_unlink_nolock(search, hash(ITEM_key(search), search->nkey, 0));
+        it = slabs_alloc(ntotal, id);
+        /* Fresh chunks start unreferenced, and lock-free readers never pin
+         * those, so the plain store is safe. Reused items already come with
+         * our one reference. */
+        if (it != NULL)
+            it->refcount = 1;
+    }
+
+    /* Out of memory: with segments, push the upper queues down first so
+     * COLD has something to evict. */
+    for (i = 0; i < 5 && it == NULL && settings.evict_to_free; i++) {
+        if (settings.lru_maintainer_thread) {
+            lru_pull_tail(id, HOT_LRU, false, NULL);
+            lru_pull_tail(id, WARM_LRU, false, NULL);
         }
-        pthread_mutex_unlock(&cache_lock);
+        it = lru_reuse_tail(id, ntotal, true);
+    }
+
+    if (it == NULL) {
+        mutex_lock(&lru_locks[id][COLD_LRU]);
+        itemstats[id][COLD_LRU].outofmemory++;
+        pthread_mutex_unlock(&lru_locks[id][COLD_LRU]);
         return NULL;
     }
 
     assert(it->slabs_clsid == 0);
-    assert(it != heads[id]);
 
     /* Item initialization can happen outside of the lock; the item's already
-     * been removed from the slab LRU.
+     * been removed from the slab LRU. The caller has the one reference.
      */
-    it->refcount = 1;     /* the caller will have a reference */
-    pthread_mutex_unlock(&cache_lock);
     it->next = it->prev = it->h_next = 0;
     it->slabs_clsid = id;
 
@@ -201,10 +353,16 @@ void item_free(item *it) {
     size_t ntotal = ITEM_ntotal(it);
     unsigned int clsid;
     assert((it->it_flags & ITEM_LINKED) == 0);
-    assert(it != heads[it->slabs_clsid]);
-    assert(it != tails[it->slabs_clsid]);
+    assert(it != heads[it->slabs_clsid][it->lru]);
+    assert(it != tails[it->slabs_clsid][it->lru]);
     assert(it->refcount == 0);
 
+    /* Its value on flash goes with it */
+    if ((it->it_flags & ITEM_HDR) != 0) {
+        storage_delete(it);
+        it->it_flags &= ~ITEM_HDR;
+    }
+
     /* so slab size changer can tell later if item is already free or not */
     clsid = it->slabs_clsid;
     it->slabs_clsid = 0;
@@ -229,13 +387,15 @@ bool item_size_ok(const size_t nkey, const int flags, const int nbytes) {
     return slabs_clsid(ntotal) != 0;
 }
 
-static void item_link_q(item *it) { /* item is the new head */
+/* Caller holds lru_locks[it->slabs_clsid][it->lru]. */
+static void do_item_link_q(item *it) { /* item is the new head */
     item **head, **tail;
     assert(it->slabs_clsid < LARGEST_ID);
+    assert(it->lru < NUM_LRU);
     assert((it->it_flags & ITEM_SLABBED) == 0);
 
-    head = &heads[it->slabs_clsid];
-    tail = &tails[it->slabs_clsid];
+    head = &heads[it->slabs_clsid][it->lru];
+    tail = &tails[it->slabs_clsid][it->lru];
     assert(it != *head);
     assert((*head && *tail) || (*head == 0 && *tail == 0));
     it->prev = 0;
@@ -243,15 +403,24 @@ static void item_link_q(item *it) { /* item is the new head */
     if (it->next) it->next->prev = it;
     *head = it;
     if (*tail == 0) *tail = it;
-    sizes[it->slabs_clsid]++;
+    sizes[it->slabs_clsid][it->lru]++;
     return;
 }
 
-static void item_unlink_q(item *it) {
+static void item_link_q(item *it) {
+    pthread_mutex_t *lock = &lru_locks[it->slabs_clsid][it->lru];
+    mutex_lock(lock);
+    do_item_link_q(it);
+    pthread_mutex_unlock(lock);
+}
+
+/* Caller holds lru_locks[it->slabs_clsid][it->lru]. */
+static void do_item_unlink_q(item *it) {
     item **head, **tail;
     assert(it->slabs_clsid < LARGEST_ID);
-    head = &heads[it->slabs_clsid];
-    tail = &tails[it->slabs_clsid];
+    assert(it->lru < NUM_LRU);
+    head = &heads[it->slabs_clsid][it->lru];
+    tail = &tails[it->slabs_clsid][it->lru];
 
     if (*head == it) {
         assert(it->prev == 0);
@@ -266,14 +435,21 @@ static void item_unlink_q(item *it) {
 
     if (it->next) it->next->prev = it->prev;
     if (it->prev) it->prev->next = it->next;
-    sizes[it->slabs_clsid]--;
+    sizes[it->slabs_clsid][it->lru]--;
     return;
 }
 
-int do_item_link(item *it, const uint32_t hv) {
+static void item_unlink_q(item *it) {
+    pthread_mutex_t *lock = &lru_locks[it->slabs_clsid][it->lru];
+    mutex_lock(lock);
+    do_item_unlink_q(it);
+    pthread_mutex_unlock(lock);
+}
+
+/* Caller holds the item lock for hv. */
+static int item_link_cas(item *it, const uint32_t hv, const uint64_t cas) {
     MEMCACHED_ITEM_LINK(ITEM_key(it), it->nkey, it->nbytes);
     assert((it->it_flags & (ITEM_LINKED|ITEM_SLABBED)) == 0);
-    mutex_lock(&cache_lock);
     it->it_flags |= ITEM_LINKED;
     it->time = current_time;
 
@@ -283,19 +459,26 @@ int do_item_link(item *it, const uint32_t hv) {
     stats.total_items += 1;
     STATS_UNLOCK();
 
-    /* Allocate a new CAS ID on link. */
-    ITEM_set_cas(it, (settings.use_cas) ? get_cas_id() : 0);
+    ITEM_set_cas(it, cas);
     assoc_insert(it, hv);
+    /* Headers stand in for items that went cold already */
+    it->lru = (settings.lru_maintainer_thread && (it->it_flags & ITEM_HDR) == 0)
+        ? HOT_LRU : COLD_LRU;
     item_link_q(it);
     refcount_incr(&it->refcount);
-    pthread_mutex_unlock(&cache_lock);
 
     return 1;
 }
 
+/* Caller holds the item lock for hv. */
+int do_item_link(item *it, const uint32_t hv) {
+    /* Allocate a new CAS ID on link. */
+    return item_link_cas(it, hv, (settings.use_cas) ? get_cas_id() : 0);
+}
+
+/* Caller holds the item lock for hv. */
 void do_item_unlink(item *it, const uint32_t hv) {
     MEMCACHED_ITEM_UNLINK(ITEM_key(it), it->nkey, it->nbytes);
-    mutex_lock(&cache_lock);
     if ((it->it_flags & ITEM_LINKED) != 0) {
         it->it_flags &= ~ITEM_LINKED;
         STATS_LOCK();
@@ -306,10 +489,9 @@ void do_item_unlink(item *it, const uint32_t hv) {
         item_unlink_q(it);
         do_item_remove(it);
     }
-    pthread_mutex_unlock(&cache_lock);
 }
 
-/* FIXME: Is it necessary to keep this copy/pasted code? */
+/* Same as do_item_unlink, for callers already holding the item's LRU lock. */
 void do_item_unlink_nolock(item *it, const uint32_t hv) {
     MEMCACHED_ITEM_UNLINK(ITEM_key(it), it->nkey, it->nbytes);
     if ((it->it_flags & ITEM_LINKED) != 0) {
@@ -319,7 +501,7 @@ void do_item_unlink_nolock(item *it, const uint32_t hv) {
         stats.curr_items -= 1;
         STATS_UNLOCK();
         assoc_delete(ITEM_key(it), it->nkey, hv);
-        item_unlink_q(it);
+        do_item_unlink_q(it);
         do_item_remove(it);
     }
 }
@@ -333,18 +515,112 @@ void do_item_remove(item *it) {
     }
 }
 
+/*
+ * Whether a chunk of class clsid in a restored slab page (see restart.c)
+ * holds an item to link back in: one that was linked at shutdown, looks
+ * intact, and hasn't expired or been flushed since.
+ */
+bool item_restorable(item *it, const unsigned int clsid, const unsigned int size) {
+    if (it->slabs_clsid != clsid ||
+        (it->it_flags & (ITEM_LINKED | ITEM_SLABBED)) != ITEM_LINKED ||
+        ((it->it_flags & ITEM_CAS) != 0) != settings.use_cas ||
+        it->lru >= NUM_LRU || it->nkey == 0 || it->nbytes < 2 ||
+        ITEM_ntotal(it) > size) {
+        return false;
+    }
+    if (ITEM_key(it)[it->nkey] != '\0' ||
+        memcmp(ITEM_data(it) + it->nbytes - 2, "\r\n", 2) != 0) {
+        return false;
+    }
+    if (it->exptime != 0 && it->exptime <= current_time) {
+        return false;
+    }
+    if (settings.oldest_live != 0 && settings.oldest_live <= current_time &&
+        it->time <= settings.oldest_live) {
+        return false;
+    }
+    return true;
+}
+
+static int item_time_cmp(const void *a, const void *b) {
+    const item *ia = *(item * const *)a;
+    const item *ib = *(item * const *)b;
+    return ia->time < ib->time ? -1 : ia->time > ib->time;
+}
+
+/*
+ * Links the items slabs_restore() found back into the hash table and their
+ * LRUs, keeping their CAS, times and segment. Linking oldest first brings
+ * every LRU back in order. The CAS counter resumes past both cas and every
+ * restored CAS value. Returns the number of items linked. Only used during
+ * startup, before any connection is accepted.
+ */
+int items_restore(item **items, const int count, const uint64_t cas) {
+    uint64_t max_cas = cas;
+    int i;
+
+    qsort(items, count, sizeof(item *), item_time_cmp);
+    assoc_presize(count);
+
+    for (i = 0; i < count; i++) {
+        item *it = items[i];
+        uint32_t hv = hash(ITEM_key(it), it->nkey, 0);
+        item *old;
+
+        it->next = it->prev = it->h_next = NULL;
+        it->refcount = 1;
+        if (!settings.lru_maintainer_thread)
+            it->lru = COLD_LRU;
+
+        item_lock(hv);
+        /* Can't happen after a clean shutdown, but the newer copy wins */
+        if ((old = assoc_find(ITEM_key(it), it->nkey, hv)) != NULL)
+            do_item_unlink(old, hv);
+        STATS_LOCK();
+        stats.curr_bytes += ITEM_ntotal(it);
+        stats.curr_items += 1;
+        stats.total_items += 1;
+        STATS_UNLOCK();
+        assoc_insert(it, hv);
+        item_link_q(it);
+        item_unlock(hv);
+
+        if (ITEM_get_cas(it) > max_cas)
+            max_cas = ITEM_get_cas(it);
+    }
+
+    pthread_mutex_lock(&cas_id_lock);
+    cas_id = max_cas;
+    pthread_mutex_unlock(&cas_id_lock);
+
+    STATS_LOCK();
+    i = stats.curr_items;
+    STATS_UNLOCK();
+    return i;
+}
+
 void do_item_update(item *it) {
     MEMCACHED_ITEM_UPDATE(ITEM_key(it), it->nkey, it->nbytes);
     if (it->time < current_time - ITEM_UPDATE_INTERVAL) {
         assert((it->it_flags & ITEM_SLABBED) == 0);
 
-        mutex_lock(&cache_lock);
+        if (settings.lru_maintainer_thread) {
+            /* Hits only mark the item (see do_item_get); the maintainer
+             * thread moves it between segments later. */
+            if ((it->it_flags & ITEM_LINKED) != 0) {
+                it->time = current_time;
+            }
+            return;
+        }
+
+        pthread_mutex_t *lock = &lru_locks[it->slabs_clsid][it->lru];
+        mutex_lock(lock);
         if ((it->it_flags & ITEM_LINKED) != 0) {
-            item_unlink_q(it);
+            do_item_unlink_q(it);
             it->time = current_time;
-            item_link_q(it);
+            do_item_link_q(it);
         }
-        pthread_mutex_unlock(&cache_lock);
+        pthread_mutex_unlock(lock);
     }
 }
 
@@ -357,6 +633,31 @@ int do_item_replace(item *it, item *new_it, const uint32_t hv) {
     return do_item_link(new_it, hv);
 }
 
+/* Size of the value an item holds, wherever it is */
+static int item_value_size(item *it) {
+    if ((it->it_flags & ITEM_HDR) != 0) {
+        item_hdr hdr;
+        storage_hdr(it, &hdr);
+        return hdr.nbytes;
+    }
+    return it->nbytes;
+}
+
+/*
+ * do_item_replace for the same value in another form, an item and its header
+ * on flash (see storage.c): new_it takes over the CAS and the stale state of
+ * it.
+ */
+int do_item_swap(item *it, item *new_it, const uint32_t hv) {
+    uint64_t cas = ITEM_get_cas(it);
+    assert((it->it_flags & ITEM_SLABBED) == 0);
+
+    new_it->it_flags |= it->it_flags & (ITEM_STALE | ITEM_TOKEN_SENT);
+    do_item_unlink(it, hv);
+    return item_link_cas(new_it, hv, cas);
+}
+
+/* Takes each segment's LRU lock in turn; walks HOT, then WARM, then COLD. */
 /*@null@*/
 char *do_item_cachedump(const unsigned int slabs_clsid, const unsigned int limit, unsigned int *bytes) {
     unsigned int memlimit = 2 * 1024 * 1024;   /* 2MB max response size */
@@ -367,27 +668,34 @@ char *do_item_cachedump(const unsigned int slabs_clsid, const unsigned int limit
     unsigned int shown = 0;
     char key_temp[KEY_MAX_LENGTH + 1];
     char temp[512];
-
-    it = heads[slabs_clsid];
+    int lru;
+    bool full = false;
 
     buffer = malloc((size_t)memlimit);
     if (buffer == 0) return NULL;
     bufcurr = 0;
 
-    while (it != NULL && (limit == 0 || shown < limit)) {
-        assert(it->nkey <= KEY_MAX_LENGTH);
-        /* Copy the key since it may not be null-terminated in the struct */
-        strncpy(key_temp, ITEM_key(it), it->nkey);
-        key_temp[it->nkey] = 0x00; /* terminate */
-        len = snprintf(temp, sizeof(temp), "ITEM %s [%d b; %lu s]\r\n",
-                       key_temp, it->nbytes - 2,
-                       (unsigned long)it->exptime + process_started);
-        if (bufcurr + len + 6 > memlimit)  /* 6 is END\r\n\0 */
-            break;
-        memcpy(buffer + bufcurr, temp, len);
-        bufcurr += len;
-        shown++;
-        it = it->next;
+    for (lru = 0; lru < NUM_LRU && !full; lru++) {
+        mutex_lock(&lru_locks[slabs_clsid][lru]);
+        it = heads[slabs_clsid][lru];
+        while (it != NULL && (limit == 0 || shown < limit)) {
+            assert(it->nkey <= KEY_MAX_LENGTH);
+            /* Copy the key since it may not be null-terminated in the struct */
+            strncpy(key_temp, ITEM_key(it), it->nkey);
+            key_temp[it->nkey] = 0x00; /* terminate */
+            len = snprintf(temp, sizeof(temp), "ITEM %s [%d b; %lu s]\r\n",
+                           key_temp, item_value_size(it) - 2,
+                           (unsigned long)it->exptime + process_started);
+            if (bufcurr + len + 6 > memlimit) { /* 6 is END\r\n\0 */
+                full = true;
+                break;
+            }
+            memcpy(buffer + bufcurr, temp, len);
+            bufcurr += len;
+            shown++;
+            it = it->next;
+        }
+        pthread_mutex_unlock(&lru_locks[slabs_clsid][lru]);
     }
 
     memcpy(buffer + bufcurr, "END\r\n", 6);
@@ -397,45 +705,88 @@ char *do_item_cachedump(const unsigned int slabs_clsid, const unsigned int limit
     return buffer;
 }
 
-void item_stats_evictions(uint64_t *evicted) {
+/* For the slab automover: evictions so far and the age of the COLD tail (0
+ * if it's empty) of every class. */
+void item_stats_automove(uint64_t *evicted, rel_time_t *age) {
     int i;
-    mutex_lock(&cache_lock);
     for (i = 0; i < LARGEST_ID; i++) {
-        evicted[i] = itemstats[i].evicted;
+        mutex_lock(&lru_locks[i][COLD_LRU]);
+        evicted[i] = itemstats[i][COLD_LRU].evicted;
+        age[i] = tails[i][COLD_LRU] != NULL
+            ? current_time - tails[i][COLD_LRU]->time : 0;
+        pthread_mutex_unlock(&lru_locks[i][COLD_LRU]);
     }
-    pthread_mutex_unlock(&cache_lock);
 }
 
+/* Takes each segment's LRU lock in turn. */
 void do_item_stats(ADD_STAT add_stats, void *c) {
-    int i;
+    int i, lru;
     for (i = 0; i < LARGEST_ID; i++) {
-        if (tails[i] != NULL) {
+        itemstats_t totals;
+        unsigned int lru_size[NUM_LRU];
+        rel_time_t lru_age[NUM_LRU];
+        memset(&totals, 0, sizeof(totals));
+
+        for (lru = 0; lru < NUM_LRU; lru++) {
+            itemstats_t *s = &itemstats[i][lru];
+            mutex_lock(&lru_locks[i][lru]);
+            lru_size[lru] = sizes[i][lru];
+            lru_age[lru] = tails[i][lru] != NULL ?
+                current_time - tails[i][lru]->time : 0;
+            totals.evicted += s->evicted;
+            totals.evicted_nonzero += s->evicted_nonzero;
+            totals.outofmemory += s->outofmemory;
+            totals.tailrepairs += s->tailrepairs;
+            totals.reclaimed += s->reclaimed;
+            totals.expired_unfetched += s->expired_unfetched;
+            totals.evicted_unfetched += s->evicted_unfetched;
+            totals.moves_to_cold += s->moves_to_cold;
+            totals.moves_to_warm += s->moves_to_warm;
+            totals.moves_within_lru += s->moves_within_lru;
+            totals.lrutail_reflocked += s->lrutail_reflocked;
+            if (lru == COLD_LRU)
+                totals.evicted_time = s->evicted_time;
+            pthread_mutex_unlock(&lru_locks[i][lru]);
+        }
+
+        if (lru_size[HOT_LRU] + lru_size[WARM_LRU] + lru_size[COLD_LRU] != 0) {
             const char *fmt = "items:%d:%s";
             char key_str[STAT_KEY_LEN];
             char val_str[STAT_VAL_LEN];
             int klen = 0, vlen = 0;
-            if (tails[i] == NULL) {
-                /* We removed all of the items in this slab class */
-                continue;
-            }
-            APPEND_NUM_FMT_STAT(fmt, i, "number", "%u", sizes[i]);
-            APPEND_NUM_FMT_STAT(fmt, i, "age", "%u", current_time - tails[i]->time);
+            APPEND_NUM_FMT_STAT(fmt, i, "number", "%u",
+                                lru_size[HOT_LRU] + lru_size[WARM_LRU] +
+                                lru_size[COLD_LRU]);
+            APPEND_NUM_FMT_STAT(fmt, i, "number_hot", "%u", lru_size[HOT_LRU]);
+            APPEND_NUM_FMT_STAT(fmt, i, "number_warm", "%u", lru_size[WARM_LRU]);
+            APPEND_NUM_FMT_STAT(fmt, i, "number_cold", "%u", lru_size[COLD_LRU]);
+            APPEND_NUM_FMT_STAT(fmt, i, "age_hot", "%u", lru_age[HOT_LRU]);
+            APPEND_NUM_FMT_STAT(fmt, i, "age_warm", "%u", lru_age[WARM_LRU]);
+            APPEND_NUM_FMT_STAT(fmt, i, "age", "%u", lru_age[COLD_LRU]);
             APPEND_NUM_FMT_STAT(fmt, i, "evicted",
-                                "%llu", (unsigned long long)itemstats[i].evicted);
+                                "%llu", (unsigned long long)totals.evicted);
             APPEND_NUM_FMT_STAT(fmt, i, "evicted_nonzero",
-                                "%llu", (unsigned long long)itemstats[i].evicted_nonzero);
+                                "%llu", (unsigned long long)totals.evicted_nonzero);
             APPEND_NUM_FMT_STAT(fmt, i, "evicted_time",
-                                "%u", itemstats[i].evicted_time);
+                                "%u", totals.evicted_time);
             APPEND_NUM_FMT_STAT(fmt, i, "outofmemory",
-                                "%llu", (unsigned long long)itemstats[i].outofmemory);
+                                "%llu", (unsigned long long)totals.outofmemory);
             APPEND_NUM_FMT_STAT(fmt, i, "tailrepairs",
-                                "%llu", (unsigned long long)itemstats[i].tailrepairs);
+                                "%llu", (unsigned long long)totals.tailrepairs);
             APPEND_NUM_FMT_STAT(fmt, i, "reclaimed",
-                                "%llu", (unsigned long long)itemstats[i].reclaimed);
+                                "%llu", (unsigned long long)totals.reclaimed);
             APPEND_NUM_FMT_STAT(fmt, i, "expired_unfetched",
-                                "%llu", (unsigned long long)itemstats[i].expired_unfetched);
+                                "%llu", (unsigned long long)totals.expired_unfetched);
             APPEND_NUM_FMT_STAT(fmt, i, "evicted_unfetched",
-                                "%llu", (unsigned long long)itemstats[i].evicted_unfetched);
+                                "%llu", (unsigned long long)totals.evicted_unfetched);
+            APPEND_NUM_FMT_STAT(fmt, i, "moves_to_cold",
+                                "%llu", (unsigned long long)totals.moves_to_cold);
+            APPEND_NUM_FMT_STAT(fmt, i, "moves_to_warm",
+                                "%llu", (unsigned long long)totals.moves_to_warm);
+            APPEND_NUM_FMT_STAT(fmt, i, "moves_within_lru",
+                                "%llu", (unsigned long long)totals.moves_within_lru);
+            APPEND_NUM_FMT_STAT(fmt, i, "lrutail_reflocked",
+                                "%llu", (unsigned long long)totals.lrutail_reflocked);
         }
     }
 
@@ -452,17 +803,21 @@ void do_item_stats_sizes(ADD_STAT add_stats, void *c) {
     unsigned int *histogram = calloc(num_buckets, sizeof(int));
 
     if (histogram != NULL) {
-        int i;
+        int i, lru;
 
         /* build the histogram */
         for (i = 0; i < LARGEST_ID; i++) {
-            item *iter = heads[i];
-            while (iter) {
-                int ntotal = ITEM_ntotal(iter);
-                int bucket = ntotal / 32;
-                if ((ntotal % 32) != 0) bucket++;
-                if (bucket < num_buckets) histogram[bucket]++;
-                iter = iter->next;
+            for (lru = 0; lru < NUM_LRU; lru++) {
+                mutex_lock(&lru_locks[i][lru]);
+                item *iter = heads[i][lru];
+                while (iter) {
+                    int ntotal = ITEM_ntotal(iter);
+                    int bucket = ntotal / 32;
+                    if ((ntotal % 32) != 0) bucket++;
+                    if (bucket < num_buckets) histogram[bucket]++;
+                    iter = iter->next;
+                }
+                pthread_mutex_unlock(&lru_locks[i][lru]);
             }
         }
 
@@ -481,21 +836,19 @@ void do_item_stats_sizes(ADD_STAT add_stats, void *c) {
 
 /** wrapper around assoc_find which does the lazy expiration logic */
 item *do_item_get(const char *key, const size_t nkey, const uint32_t hv) {
-    mutex_lock(&cache_lock);
     item *it = assoc_find(key, nkey, hv);
     if (it != NULL) {
         refcount_incr(&it->refcount);
         /* Optimization for slab reassignment. prevents popular items from
          * jamming in busy wait. Can only do this here to satisfy lock order
-         * of item_lock, cache_lock, slabs_lock. */
+         * of item_lock, lru_lock, slabs_lock. */
         if (slab_rebalance_signal &&
             ((void *)it >= slab_rebal.slab_start && (void *)it < slab_rebal.slab_end)) {
-            do_item_unlink_nolock(it, hv);
+            do_item_unlink(it, hv);
             do_item_remove(it);
             it = NULL;
         }
     }
-    pthread_mutex_unlock(&cache_lock);
     int was_found = 0;
 
     if (settings.verbose > 2) {
@@ -524,7 +877,9 @@ item *do_item_get(const char *key, const size_t nkey, const uint32_t hv) {
                 fprintf(stderr, " -nuked by expire");
             }
         } else {
-            it->it_flags |= ITEM_FETCHED;
+            /* No LRU lock needed for a hit: the flag is picked up when the
+             * item reaches the tail of its segment. */
+            it->it_flags |= ITEM_FETCHED | ITEM_ACTIVE;
             DEBUG_REFCNT(it, '+');
         }
     }
@@ -535,6 +890,60 @@ item *do_item_get(const char *key, const size_t nkey, const uint32_t hv) {
     return it;
 }
 
+#ifdef HAVE_GCC_ATOMICS
+/*
+ * do_item_get for the common case, without the item lock: a live hit or a
+ * clean miss. Returns false if the lookup has to be redone with
+ * do_item_get under the lock, because a writer changed the hash chain while
+ * we walked it, or the item needs lazy expiry or is in a slab page being
+ * moved. Otherwise *itp is the result, with a reference held on a hit.
+ */
+bool do_item_get_lockfree(const char *key, const size_t nkey, const uint32_t hv,
+                          item **itp) {
+    item *it;
+    unsigned int seq;
+
+    /* Leave the debug output to do_item_get */
+    if (settings.verbose > 2)
+        return false;
+
+    seq = item_seq_read(hv);
+    if ((seq & 1) != 0 || !assoc_find_lockfree(key, nkey, hv, seq, &it))
+        return false;
+
+    if (it == NULL) {
+        *itp = NULL;
+        return true;
+    }
+
+    /* Pin it, then make sure it was still linked in our chain when we did,
+     * which also means its key is the one we compared. */
+    if (refcount_incr_nonzero(&it->refcount) == 0)
+        return false;
+    if (item_seq_changed(hv, seq) || (it->it_flags & ITEM_LINKED) == 0) {
+        do_item_remove(it);
+        return false;
+    }
+
+    if ((settings.oldest_live != 0 && settings.oldest_live <= current_time &&
+         it->time <= settings.oldest_live) ||
+        (it->exptime != 0 && it->exptime <= current_time) ||
+        (slab_rebalance_signal &&
+         ((void *)it >= slab_rebal.slab_start && (void *)it < slab_rebal.slab_end))) {
+        do_item_remove(it);
+        return false;
+    }
+
+    /* Other threads update the flags too, under the item lock; ours has to
+     * be atomic. Skip the write once they're set so hot keys stay cheap. */
+    if ((it->it_flags & (ITEM_FETCHED | ITEM_ACTIVE)) != (ITEM_FETCHED | ITEM_ACTIVE))
+        __sync_fetch_and_or(&it->it_flags, ITEM_FETCHED | ITEM_ACTIVE);
+    DEBUG_REFCNT(it, '+');
+    *itp = it;
+    return true;
+}
+#endif
+
 item *do_item_touch(const char *key, size_t nkey, uint32_t exptime,
                     const uint32_t hv) {
     item *it = do_item_get(key, nkey, hv);
@@ -544,28 +953,194 @@ item *do_item_touch(const char *key, size_t nkey, uint32_t exptime,
     return it;
 }
 
+/*
+ * Unlinks the items of one LRU segment that are more recent than the
+ * oldest_live setting. Returns the number of such items whose lock was busy
+ * and that were therefore left in place.
+ */
+static int item_flush_expired_lru(const int id, const int lru) {
+    item *iter, *next;
+    void *hold_lock;
+    int busy = 0;
+
+    mutex_lock(&lru_locks[id][lru]);
+    for (iter = heads[id][lru]; iter != NULL; iter = next) {
+        next = iter->next;
+        if (iter->time >= settings.oldest_live) {
+            uint32_t hv = hash(ITEM_key(iter), iter->nkey, 0);
+            if ((hold_lock = item_trylock(hv)) == NULL) {
+                busy++;
+                continue;
+            }
+            if ((iter->it_flags & ITEM_SLABBED) == 0) {
+                do_item_unlink_nolock(iter, hv);
+            }
+            item_trylock_unlock(hold_lock);
+        } else if (!settings.lru_maintainer_thread) {
+            /* We've hit the first old item. Continue to the next queue. */
+            break;
+        }
+    }
+    pthread_mutex_unlock(&lru_locks[id][lru]);
+    return busy;
+}
+
 /* expires items that are more recent than the oldest_live setting. */
 void do_item_flush_expired(void) {
-    int i;
-    item *iter, *next;
+    int i, lru;
     if (settings.oldest_live == 0)
         return;
     for (i = 0; i < LARGEST_ID; i++) {
-        /* The LRU is sorted in decreasing time order, and an item's timestamp
-         * is never newer than its last access time, so we only need to walk
-         * back until we hit an item older than the oldest_live time.
-         * The oldest_live checking will auto-expire the remaining items.
-         */
-        for (iter = heads[i]; iter != NULL; iter = next) {
-            if (iter->time >= settings.oldest_live) {
-                next = iter->next;
-                if ((iter->it_flags & ITEM_SLABBED) == 0) {
-                    do_item_unlink_nolock(iter, hash(ITEM_key(iter), iter->nkey, 0));
-                }
-            } else {
-                /* We've hit the first old item. Continue to the next queue. */
-                break;
-            }
+        for (lru = 0; lru < NUM_LRU; lru++) {
+            /* The LRU is sorted in decreasing time order, and an item's
+             * timestamp is never newer than its last access time, so we only
+             * need to walk back until we hit an item older than the
+             * oldest_live time. Segmented LRUs bump the time of a hit
+             * without moving the item, so those are walked in full.
+             * The oldest_live checking will auto-expire the remaining items.
+             * Busy items are retried once their holder lets go.
+             */
+            while (item_flush_expired_lru(i, lru) != 0)
+                ;
+        }
+    }
+}
+
+/*************************** LRU MAINTAINER THREAD ***************************/
+
+static volatile int do_run_lru_maintainer_thread = 0;
+static pthread_t lru_maintainer_tid;
+
+#define MAX_LRU_MAINTAINER_SLEEP 1000000
+#define MIN_LRU_MAINTAINER_SLEEP 0
+
+/*
+ * With -o ext_path, looks at up to five items from the COLD tail of a slab
+ * class for one to write to flash (see storage.c): one large enough, that
+ * wasn't fetched since it went cold, once the class runs out of memory or
+ * the item is ext_item_age seconds old. The item is replaced by its header.
+ * Returns the number of items written.
+ */
+static int lru_ext_write(const unsigned int id) {
+    item *search;
+    item *it = NULL;
+    item *hdr_it;
+    void *hold_lock = NULL;
+    uint32_t hv = 0;
+    int tries = 5;
+    bool low_memory = slabs_low_memory(id);
+
+    mutex_lock(&lru_locks[id][COLD_LRU]);
+    for (search = tails[id][COLD_LRU];
+         tries > 0 && search != NULL;
+         tries--, search = search->prev) {
+        if ((search->it_flags & (ITEM_HDR | ITEM_ACTIVE)) != 0 ||
+            search->nbytes < settings.ext_item_size ||
+            (search->exptime != 0 && search->exptime < current_time) ||
+            (!low_memory && current_time - search->time < settings.ext_item_age)) {
+            continue;
+        }
+        hv = hash(ITEM_key(search), search->nkey, 0);
+        if ((hold_lock = item_trylock(hv)) == NULL)
+            continue;
+        /* Nobody else may be using it, its memory goes away */
+        if (refcount_incr(&search->refcount) != 2) {
+            refcount_decr(&search->refcount);
+            item_trylock_unlock(hold_lock);
+            continue;
+        }
+        it = search;
+        break;
+    }
+    /* Writing and allocating the header take locks of their own */
+    pthread_mutex_unlock(&lru_locks[id][COLD_LRU]);
+
+    if (it == NULL)
+        return 0;
+
+    if ((hdr_it = storage_write(it)) != NULL) {
+        do_item_swap(it, hdr_it, hv);
+        do_item_remove(hdr_it);
+    }
+    do_item_remove(it);
+    item_trylock_unlock(hold_lock);
+    return hdr_it != NULL ? 1 : 0;
+}
+
+/* Keeps HOT and WARM of a slab class within their share, gives fetched COLD
+ * items a second chance and reclaims expired ones from the tails. Bounded so
+ * that one busy class can't starve the others.
+ * Returns the number of passes that did anything.
+ */
+static int lru_maintainer_juggle(const int slabs_clsid) {
+    int i;
+    int did_moves = 0;
+
+    for (i = 0; i < 500; i++) {
+        int do_more = 0;
+        do_more += lru_pull_tail(slabs_clsid, HOT_LRU, false, NULL);
+        do_more += lru_pull_tail(slabs_clsid, WARM_LRU, false, NULL);
+        do_more += lru_pull_tail(slabs_clsid, COLD_LRU, false, NULL);
+        if (settings.ext_path != NULL)
+            do_more += lru_ext_write(slabs_clsid);
+        if (do_more == 0)
+            break;
+        did_moves++;
+    }
+    return did_moves;
+}
+
+/* Sleeps up to a second between passes, less while there's work to do. */
+static void *lru_maintainer_thread(void *arg) {
+    int i;
+    useconds_t to_sleep = MIN_LRU_MAINTAINER_SLEEP;
+
+    if (settings.verbose > 2)
+        fprintf(stderr, "Starting LRU maintainer background thread\n");
+    while (do_run_lru_maintainer_thread) {
+        int did_moves = 0;
+        usleep(to_sleep);
+
+        STATS_LOCK();
+        stats.lru_maintainer_juggles++;
+        STATS_UNLOCK();
+
+        for (i = POWER_SMALLEST; i < LARGEST_ID; i++) {
+            did_moves += lru_maintainer_juggle(i);
+        }
+        if (did_moves == 0) {
+            if (to_sleep < MAX_LRU_MAINTAINER_SLEEP)
+                to_sleep += 1000;
+        } else {
+            to_sleep /= 2;
+            if (to_sleep < MIN_LRU_MAINTAINER_SLEEP)
+                to_sleep = MIN_LRU_MAINTAINER_SLEEP;
         }
     }
+    if (settings.verbose > 2)
+        fprintf(stderr, "LRU maintainer thread stopping\n");
+
+    return NULL;
+}
+
+int start_lru_maintainer_thread(void) {
+    int ret;
+
+    do_run_lru_maintainer_thread = 1;
+    if ((ret = pthread_create(&lru_maintainer_tid, NULL,
+                              lru_maintainer_thread, NULL)) != 0) {
+        fprintf(stderr, "Can't create LRU maintainer thread: %s\n",
+            strerror(ret));
+        do_run_lru_maintainer_thread = 0;
+        return -1;
+    }
+    return 0;
+}
+
+void stop_lru_maintainer_thread(void) {
+    if (!do_run_lru_maintainer_thread)
+        return;
+    do_run_lru_maintainer_thread = 0;
+    /* Wait for the maintainer thread to stop */
+    pthread_join(lru_maintainer_tid, NULL);
 }
@@ -1,8 +1,28 @@
+/* LRU segments. Without the LRU maintainer every item lives in COLD_LRU. */
+#define HOT_LRU 0
+#define WARM_LRU 1
+#define COLD_LRU 2
+#define NUM_LRU 3
+
+/*
+ * We only reposition items in the LRU queue if they haven't been repositioned
+ * in this many seconds. That saves us from churning on frequently-accessed
+ * items.
+ */
+#define ITEM_UPDATE_INTERVAL 60
+
+/* Most keys item_get_batch() looks up in one go. */
+#define ITEM_GET_BATCH_MAX 24
+
 /* See items.c */
 uint64_t get_cas_id(void);
 
 /*@null@*/
 item *do_item_alloc(char *key, const size_t nkey, const int flags, const rel_time_t exptime, const int nbytes);
+/*@null@*/
+item *do_item_alloc_suffix(const char *key, const size_t nkey,
+                           const char *suffix, const uint8_t nsuffix,
+                           const rel_time_t exptime, const int nbytes);
 void item_free(item *it);
 bool item_size_ok(const size_t nkey, const int flags, const int nbytes);
 
@@ -11,7 +31,10 @@ void do_item_unlink(item *it, const uint32_t hv);
 void do_item_unlink_nolock(item *it, const uint32_t hv);
 void do_item_remove(item *it);
 void do_item_update(item *it);   /** update LRU time to current and reposition */
+bool item_restorable(item *it, const unsigned int clsid, const unsigned int size);
+int  items_restore(item **items, const int count, const uint64_t cas);
 int  do_item_replace(item *it, item *new_it, const uint32_t hv);
+int  do_item_swap(item *it, item *new_it, const uint32_t hv);
 
 /*@null@*/
 char *do_item_cachedump(const unsigned int slabs_clsid, const unsigned int limit, unsigned int *bytes);
@@ -21,7 +44,14 @@ void do_item_stats_sizes(ADD_STAT add_stats, void *c);
 void do_item_flush_expired(void);
 
 item *do_item_get(const char *key, const size_t nkey, const uint32_t hv);
+#ifdef HAVE_GCC_ATOMICS
+bool do_item_get_lockfree(const char *key, const size_t nkey, const uint32_t hv,
+                          item **itp);
+#endif
 item *do_item_touch(const char *key, const size_t nkey, uint32_t exptime, const uint32_t hv);
 void item_stats_reset(void);
-extern pthread_mutex_t cache_lock;
-void item_stats_evictions(uint64_t *evicted);
+extern pthread_mutex_t lru_locks[POWER_LARGEST][NUM_LRU];
+void item_stats_automove(uint64_t *evicted, rel_time_t *age);
+
+int start_lru_maintainer_thread(void);
+void stop_lru_maintainer_thread(void);
@@ -89,8 +89,12 @@ static void conn_init(void);
 static bool update_event(conn *c, const int new_flags);
 static void complete_nread(conn *c);
 static void process_command(conn *c, char *command);
+static void complete_mset(conn *c, item *it, enum store_item_type ret);
 static void write_and_free(conn *c, char *buf, int bytes);
 static int ensure_iov_space(conn *c);
+static int reserve_iov_space(conn *c, int n);
+static int ensure_item_space(conn *c, int n, bool suffixes);
+static void conn_release_get_items(conn *c);
 static int add_iov(conn *c, const void *buf, int len);
 static int add_msghdr(conn *c);
 
@@ -174,6 +178,7 @@ static void stats_init(void) {
     stats.hash_power_level = stats.hash_bytes = stats.hash_is_expanding = 0;
     stats.expired_unfetched = stats.evicted_unfetched = 0;
     stats.slabs_moved = 0;
+    stats.lru_maintainer_juggles = 0;
     stats.accepting_conns = true; /* assuming we start in this state. */
     stats.slab_reassign_running = false;
 
@@ -225,6 +230,22 @@ static void settings_init(void) {
     settings.hashpower_init = 0;
     settings.slab_reassign = false;
     settings.slab_automove = false;
+    settings.slab_automove_ratio = 0.8;
+    settings.lru_maintainer_thread = false;
+    settings.hot_lru_pct = 32;
+    settings.warm_lru_pct = 32;
+    settings.hash_algorithm = JENKINS_HASH;
+    settings.reuseport = false;
+    settings.memory_file = NULL;
+    settings.ext_path = NULL;
+    settings.ext_size = 0;
+    settings.ext_page_size = 64 * 1024 * 1024;
+    settings.ext_item_size = 512;
+    settings.ext_item_age = UINT_MAX;
+    settings.ext_threads = 1;
+    settings.ext_compact_under = 50;
+    settings.ext_recache_rate = 2000;
+    settings.latency_stats = false;
 }
 
 /*
@@ -448,6 +469,8 @@ conn *conn_new(const int sfd, enum conn_states init_state,
     c->item = 0;
 
     c->noreply = false;
+    c->cmd_start = 0;
+    c->meta = false;
 
     event_set(&c->event, sfd, event_flags, event_handler, (void *)c);
     event_base_set(base, &c->event);
@@ -461,16 +484,33 @@ conn *conn_new(const int sfd, enum conn_states init_state,
         return NULL;
     }
 
-    STATS_LOCK();
-    stats.curr_conns++;
-    stats.total_conns++;
-    STATS_UNLOCK();
+    threadlocal_conn_opened();
 
     MEMCACHED_CONN_ALLOCATE(c->sfd);
 
     return c;
 }
 
+/*
+ * Drops the references and CAS suffixes a get response was holding on to,
+ * once it has been sent or abandoned.
+ */
+static void conn_release_get_items(conn *c) {
+    while (c->ileft > 0) {
+        item *it = *(c->icurr);
+        assert((it->it_flags & ITEM_SLABBED) == 0);
+        item_remove(it);
+        c->icurr++;
+        c->ileft--;
+    }
+    while (c->suffixleft > 0) {
+        char *suffix = *(c->suffixcurr);
+        cache_free(c->thread->suffix_cache, suffix);
+        c->suffixcurr++;
+        c->suffixleft--;
+    }
+}
+
 static void conn_cleanup(conn *c) {
     assert(c != NULL);
 
@@ -545,6 +585,9 @@ static void conn_close(conn *c) {
     pthread_mutex_lock(&conn_lock);
     allow_new_conns = true;
     pthread_mutex_unlock(&conn_lock);
+    if (c->thread != NULL && !IS_UDP(c->transport)) {
+        c->thread->stats.curr_conns--;
+    }
     conn_cleanup(c);
 
     /* if the connection has big buffers, just free it */
@@ -552,9 +595,7 @@ static void conn_close(conn *c) {
         conn_free(c);
     }
 
-    STATS_LOCK();
-    stats.curr_conns--;
-    STATS_UNLOCK();
+    threadlocal_conn_closed();
 
     return;
 }
@@ -630,7 +671,8 @@ static const char *state_text(enum conn_states state) {
                                        "conn_nread",
                                        "conn_swallow",
                                        "conn_closing",
-                                       "conn_mwrite" };
+                                       "conn_mwrite",
+                                       "conn_io_wait" };
     return statenames[state];
 }
 
@@ -639,6 +681,23 @@ static const char *state_text(enum conn_states state) {
  * processing that needs to happen on certain state transitions can
  * happen here.
  */
+/*
+ * Microseconds on a clock that doesn't jump, for "stats latency". Never 0,
+ * which marks a command that isn't being timed.
+ */
+static uint64_t latency_now(void) {
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+        return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000 + 1;
+#endif
+    {
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec + 1;
+    }
+}
+
 static void conn_set_state(conn *c, enum conn_states state) {
     assert(c != NULL);
     assert(state >= conn_listening && state < conn_max_state);
@@ -653,6 +712,15 @@ static void conn_set_state(conn *c, enum conn_states state) {
         if (state == conn_write || state == conn_mwrite) {
             MEMCACHED_PROCESS_COMMAND_END(c->sfd, c->wbuf, c->wbytes);
         }
+        if (state == conn_new_cmd && c->cmd_start != 0) {
+            uint64_t now = latency_now();
+            if (c->thread != NULL) {
+                threadlocal_latency_record(c->thread, c->cmd_class,
+                                           now > c->cmd_start ?
+                                           now - c->cmd_start : 0);
+            }
+            c->cmd_start = 0;
+        }
         c->state = state;
     }
 }
@@ -664,16 +732,29 @@ static void conn_set_state(conn *c, enum conn_states state) {
  * Returns 0 on success, -1 on out-of-memory.
  */
 static int ensure_iov_space(conn *c) {
+    return reserve_iov_space(c, 1);
+}
+
+/*
+ * Ensures the iovec list has room for n more entries, growing it at most
+ * once. Used by multi-gets, which know up front how much they'll add.
+ *
+ * Returns 0 on success, -1 on out-of-memory.
+ */
+static int reserve_iov_space(conn *c, int n) {
+    int size;
     assert(c != NULL);
 
-    if (c->iovused >= c->iovsize) {
+    for (size = c->iovsize; c->iovused + n > size; size *= 2)
+        ;
+    if (size != c->iovsize) {
         int i, iovnum;
         struct iovec *new_iov = (struct iovec *)realloc(c->iov,
-                                (c->iovsize * 2) * sizeof(struct iovec));
+                                size * sizeof(struct iovec));
         if (! new_iov)
             return -1;
         c->iov = new_iov;
-        c->iovsize *= 2;
+        c->iovsize = size;
 
         /* Point all the msghdr structures at the new list. */
         for (i = 0, iovnum = 0; i < c->msgused; i++) {
@@ -685,6 +766,42 @@ static int ensure_iov_space(conn *c) {
     return 0;
 }
 
+/*
+ * Ensures the lists of items (and CAS suffixes, for gets) being sent have
+ * room for n entries.
+ *
+ * Returns 0 on success, -1 on out-of-memory.
+ */
+static int ensure_item_space(conn *c, int n, bool suffixes) {
+    int size;
+    assert(c != NULL);
+
+    for (size = c->isize; n > size; size *= 2)
+        ;
+    if (size != c->isize) {
+        item **new_list = realloc(c->ilist, sizeof(item *) * size);
+        if (! new_list)
+            return -1;
+        c->ilist = new_list;
+        c->isize = size;
+    }
+
+    if (suffixes) {
+        for (size = c->suffixsize; n > size; size *= 2)
+            ;
+        if (size != c->suffixsize) {
+            char **new_suffix_list = realloc(c->suffixlist,
+                                             sizeof(char *) * size);
+            if (! new_suffix_list)
+                return -1;
+            c->suffixlist = new_suffix_list;
+            c->suffixsize = size;
+        }
+    }
+
+    return 0;
+}
+
 
 /*
  * Adds data to the list of pending data that will be written out to a
@@ -833,9 +950,7 @@ static void complete_nread_ascii(conn *c) {
     int comm = c->cmd;
     enum store_item_type ret;
 
-    pthread_mutex_lock(&c->thread->stats.mutex);
     c->thread->stats.slab_stats[it->slabs_clsid].set_cmds++;
-    pthread_mutex_unlock(&c->thread->stats.mutex);
 
     if (strncmp(ITEM_data(it) + it->nbytes - 2, "\r\n", 2) != 0) {
         out_string(c, "CLIENT_ERROR bad data chunk");
@@ -872,25 +987,30 @@ static void complete_nread_ascii(conn *c) {
       }
 #endif
 
-      switch (ret) {
-      case STORED:
-          out_string(c, "STORED");
-          break;
-      case EXISTS:
-          out_string(c, "EXISTS");
-          break;
-      case NOT_FOUND:
-          out_string(c, "NOT_FOUND");
-          break;
-      case NOT_STORED:
-          out_string(c, "NOT_STORED");
-          break;
-      default:
-          out_string(c, "SERVER_ERROR Unhandled storage type.");
+      if (c->meta) {
+          complete_mset(c, it, ret);
+      } else {
+          switch (ret) {
+          case STORED:
+              out_string(c, "STORED");
+              break;
+          case EXISTS:
+              out_string(c, "EXISTS");
+              break;
+          case NOT_FOUND:
+              out_string(c, "NOT_FOUND");
+              break;
+          case NOT_STORED:
+              out_string(c, "NOT_STORED");
+              break;
+          default:
+              out_string(c, "SERVER_ERROR Unhandled storage type.");
+          }
       }
 
     }
 
+    c->meta = false;
     item_remove(c->item);       /* release the c->item reference */
     c->item = 0;
 }
@@ -1104,13 +1224,11 @@ static void complete_incr_bin(conn *c) {
                 write_bin_error(c, PROTOCOL_BINARY_RESPONSE_ENOMEM, 0);
             }
         } else {
-            pthread_mutex_lock(&c->thread->stats.mutex);
             if (c->cmd == PROTOCOL_BINARY_CMD_INCREMENT) {
                 c->thread->stats.incr_misses++;
             } else {
                 c->thread->stats.decr_misses++;
             }
-            pthread_mutex_unlock(&c->thread->stats.mutex);
 
             write_bin_error(c, PROTOCOL_BINARY_RESPONSE_KEY_ENOENT, 0);
         }
@@ -1128,9 +1246,7 @@ static void complete_update_bin(conn *c) {
 
     item *it = c->item;
 
-    pthread_mutex_lock(&c->thread->stats.mutex);
     c->thread->stats.slab_stats[it->slabs_clsid].set_cmds++;
-    pthread_mutex_unlock(&c->thread->stats.mutex);
 
     /* We don't actually receive the trailing two characters in the bin
      * protocol, so we're going to just set them here */
@@ -1211,6 +1327,10 @@ static void process_bin_touch(conn *c) {
     }
 
     it = item_touch(key, nkey, realtime(exptime));
+    if (it && (it->it_flags & ITEM_HDR) != 0 &&
+        c->cmd != PROTOCOL_BINARY_CMD_TOUCH) {
+        it = item_load(it);
+    }
 
     if (it) {
         /* the length has two unnecessary bytes ("\r\n") */
@@ -1218,10 +1338,8 @@ static void process_bin_touch(conn *c) {
         uint32_t bodylen = sizeof(rsp->message.body) + (it->nbytes - 2);
 
         item_update(it);
-        pthread_mutex_lock(&c->thread->stats.mutex);
         c->thread->stats.touch_cmds++;
         c->thread->stats.slab_stats[it->slabs_clsid].touch_hits++;
-        pthread_mutex_unlock(&c->thread->stats.mutex);
 
         MEMCACHED_COMMAND_TOUCH(c->sfd, ITEM_key(it), it->nkey,
                                 it->nbytes, ITEM_get_cas(it));
@@ -1254,10 +1372,8 @@ static void process_bin_touch(conn *c) {
         /* Remember this command so we can garbage collect it later */
         c->item = it;
     } else {
-        pthread_mutex_lock(&c->thread->stats.mutex);
         c->thread->stats.touch_cmds++;
         c->thread->stats.touch_misses++;
-        pthread_mutex_unlock(&c->thread->stats.mutex);
 
         MEMCACHED_COMMAND_TOUCH(c->sfd, key, nkey, -1, 0);
 
@@ -1300,16 +1416,17 @@ static void process_bin_get(conn *c) {
     }
 
     it = item_get(key, nkey);
+    if (it && (it->it_flags & ITEM_HDR) != 0) {
+        it = item_load(it);
+    }
     if (it) {
         /* the length has two unnecessary bytes ("\r\n") */
         uint16_t keylen = 0;
         uint32_t bodylen = sizeof(rsp->message.body) + (it->nbytes - 2);
 
         item_update(it);
-        pthread_mutex_lock(&c->thread->stats.mutex);
         c->thread->stats.get_cmds++;
         c->thread->stats.slab_stats[it->slabs_clsid].get_hits++;
-        pthread_mutex_unlock(&c->thread->stats.mutex);
 
         MEMCACHED_COMMAND_GET(c->sfd, ITEM_key(it), it->nkey,
                               it->nbytes, ITEM_get_cas(it));
@@ -1336,10 +1453,8 @@ static void process_bin_get(conn *c) {
         /* Remember this command so we can garbage collect it later */
         c->item = it;
     } else {
-        pthread_mutex_lock(&c->thread->stats.mutex);
         c->thread->stats.get_cmds++;
         c->thread->stats.get_misses++;
-        pthread_mutex_unlock(&c->thread->stats.mutex);
 
         MEMCACHED_COMMAND_GET(c->sfd, key, nkey, -1, 0);
 
@@ -1737,9 +1852,7 @@ static void process_bin_complete_sasl_auth(conn *c) {
     switch(result) {
     case SASL_OK:
         write_bin_response(c, "Authenticated", 0, 0, strlen("Authenticated"));
-        pthread_mutex_lock(&c->thread->stats.mutex);
         c->thread->stats.auth_cmds++;
-        pthread_mutex_unlock(&c->thread->stats.mutex);
         break;
     case SASL_CONTINUE:
         add_bin_header(c, PROTOCOL_BINARY_RESPONSE_AUTH_CONTINUE, 0, 0, outlen);
@@ -1753,10 +1866,8 @@ static void process_bin_complete_sasl_auth(conn *c) {
         if (settings.verbose)
             fprintf(stderr, "Unknown sasl response:  %d\n", result);
         write_bin_error(c, PROTOCOL_BINARY_RESPONSE_AUTH_ERROR, 0);
-        pthread_mutex_lock(&c->thread->stats.mutex);
         c->thread->stats.auth_cmds++;
         c->thread->stats.auth_errors++;
-        pthread_mutex_unlock(&c->thread->stats.mutex);
     }
 }
 
@@ -1787,6 +1898,34 @@ static bool authenticated(conn *c) {
     return rv;
 }
 
+/* Which "stats latency" group a binary command is counted in. */
+static int latency_class_bin(conn *c) {
+    switch (c->cmd) {
+    case PROTOCOL_BINARY_CMD_GET:
+    case PROTOCOL_BINARY_CMD_GETK:
+        return LAT_GET;
+    case PROTOCOL_BINARY_CMD_SET:
+        return c->binary_header.request.cas != 0 ? LAT_CAS : LAT_SET;
+    case PROTOCOL_BINARY_CMD_ADD:
+    case PROTOCOL_BINARY_CMD_REPLACE:
+    case PROTOCOL_BINARY_CMD_APPEND:
+    case PROTOCOL_BINARY_CMD_PREPEND:
+        return LAT_SET;
+    case PROTOCOL_BINARY_CMD_DELETE:
+        return LAT_DELETE;
+    case PROTOCOL_BINARY_CMD_INCREMENT:
+        return LAT_INCR;
+    case PROTOCOL_BINARY_CMD_DECREMENT:
+        return LAT_DECR;
+    case PROTOCOL_BINARY_CMD_TOUCH:
+    case PROTOCOL_BINARY_CMD_GAT:
+    case PROTOCOL_BINARY_CMD_GATK:
+        return LAT_TOUCH;
+    default:
+        return LAT_OTHER;
+    }
+}
+
 static void dispatch_bin_command(conn *c) {
     int protocol_error = 0;
 
@@ -1856,6 +1995,11 @@ static void dispatch_bin_command(conn *c) {
         c->noreply = false;
     }
 
+    if (settings.latency_stats) {
+        c->cmd_start = latency_now();
+        c->cmd_class = latency_class_bin(c);
+    }
+
     switch (c->cmd) {
         case PROTOCOL_BINARY_CMD_VERSION:
             if (extlen == 0 && keylen == 0 && bodylen == 0) {
@@ -2131,9 +2275,7 @@ static void process_bin_flush(conn *c) {
     }
     item_flush_expired();
 
-    pthread_mutex_lock(&c->thread->stats.mutex);
     c->thread->stats.flush_cmds++;
-    pthread_mutex_unlock(&c->thread->stats.mutex);
 
     write_bin_response(c, NULL, 0, 0, 0);
 }
@@ -2161,9 +2303,7 @@ static void process_bin_delete(conn *c) {
         uint64_t cas = ntohll(req->message.header.request.cas);
         if (cas == 0 || cas == ITEM_get_cas(it)) {
             MEMCACHED_COMMAND_DELETE(c->sfd, ITEM_key(it), it->nkey);
-            pthread_mutex_lock(&c->thread->stats.mutex);
             c->thread->stats.slab_stats[it->slabs_clsid].delete_hits++;
-            pthread_mutex_unlock(&c->thread->stats.mutex);
             item_unlink(it);
             write_bin_response(c, NULL, 0, 0, 0);
         } else {
@@ -2172,9 +2312,7 @@ static void process_bin_delete(conn *c) {
         item_remove(it);      /* release our reference */
     } else {
         write_bin_error(c, PROTOCOL_BINARY_RESPONSE_KEY_ENOENT, 0);
-        pthread_mutex_lock(&c->thread->stats.mutex);
         c->thread->stats.delete_misses++;
-        pthread_mutex_unlock(&c->thread->stats.mutex);
     }
 }
 
@@ -2265,6 +2403,12 @@ enum store_item_type do_store_item(item *it, int comm, conn *c, const uint32_t h
     item *new_it = NULL;
     int flags;
 
+    if (old_it != NULL && (old_it->it_flags & ITEM_HDR) != 0 &&
+        (comm == NREAD_APPEND || comm == NREAD_PREPEND)) {
+        /* What we add to is on flash */
+        old_it = do_storage_get(old_it, hv);
+    }
+
     if (old_it != NULL && comm == NREAD_ADD) {
         /* add only adds a nonexistent item, but promote to head of LRU */
         do_item_update(old_it);
@@ -2277,24 +2421,18 @@ enum store_item_type do_store_item(item *it, int comm, conn *c, const uint32_t h
         if(old_it == NULL) {
             // LRU expired
             stored = NOT_FOUND;
-            pthread_mutex_lock(&c->thread->stats.mutex);
             c->thread->stats.cas_misses++;
-            pthread_mutex_unlock(&c->thread->stats.mutex);
         }
         else if (ITEM_get_cas(it) == ITEM_get_cas(old_it)) {
             // cas validates
             // it and old_it may belong to different classes.
             // I'm updating the stats for the one that's getting pushed out
-            pthread_mutex_lock(&c->thread->stats.mutex);
             c->thread->stats.slab_stats[old_it->slabs_clsid].cas_hits++;
-            pthread_mutex_unlock(&c->thread->stats.mutex);
 
             item_replace(old_it, it, hv);
             stored = STORED;
         } else {
-            pthread_mutex_lock(&c->thread->stats.mutex);
             c->thread->stats.slab_stats[old_it->slabs_clsid].cas_badval++;
-            pthread_mutex_unlock(&c->thread->stats.mutex);
 
             if(settings.verbose > 1) {
                 fprintf(stderr, "CAS:  failure: expected %llu, got %llu\n",
@@ -2383,7 +2521,8 @@ typedef struct token_s {
 #define SUBCOMMAND_TOKEN 1
 #define KEY_TOKEN 1
 
-#define MAX_TOKENS 8
+/* Room for the flags of a meta command */
+#define MAX_TOKENS 24
 
 /*
  * Tokenize the command string by replacing whitespace with '\0' and update
@@ -2525,6 +2664,7 @@ static void server_stats(ADD_STAT add_stats, conn *c) {
     threadlocal_stats_aggregate(&thread_stats);
     struct slab_stats slab_stats;
     slab_stats_aggregate(&thread_stats, &slab_stats);
+    unsigned int curr_conns = threadlocal_curr_conns();
 
 #ifndef WIN32
     struct rusage usage;
@@ -2549,8 +2689,9 @@ static void server_stats(ADD_STAT add_stats, conn *c) {
                 (long)usage.ru_stime.tv_usec);
 #endif /* !WIN32 */
 
-    APPEND_STAT("curr_connections", "%u", stats.curr_conns - 1);
-    APPEND_STAT("total_connections", "%u", stats.total_conns);
+    APPEND_STAT("curr_connections", "%u", curr_conns - 1);
+    APPEND_STAT("total_connections", "%u",
+                stats.total_conns + (unsigned int)thread_stats.total_conns);
     if (settings.maxconns_fast) {
         APPEND_STAT("rejected_connections", "%llu", (unsigned long long)stats.rejected_conns);
     }
@@ -2590,6 +2731,10 @@ static void server_stats(ADD_STAT add_stats, conn *c) {
     if (settings.slab_reassign) {
         APPEND_STAT("slab_reassign_running", "%u", stats.slab_reassign_running);
         APPEND_STAT("slabs_moved", "%llu", stats.slabs_moved);
+        APPEND_STAT("slab_global_page_pool", "%u", slabs_global_page_pool());
+    }
+    if (settings.lru_maintainer_thread) {
+        APPEND_STAT("lru_maintainer_juggles", "%llu", (unsigned long long)stats.lru_maintainer_juggles);
     }
     STATS_UNLOCK();
 }
@@ -2625,6 +2770,23 @@ static void process_stat_settings(ADD_STAT add_stats, void *c) {
     APPEND_STAT("hashpower_init", "%d", settings.hashpower_init);
     APPEND_STAT("slab_reassign", "%s", settings.slab_reassign ? "yes" : "no");
     APPEND_STAT("slab_automove", "%s", settings.slab_automove ? "yes" : "no");
+    APPEND_STAT("slab_automove_ratio", "%.2f", settings.slab_automove_ratio);
+    APPEND_STAT("lru_maintainer_thread", "%s", settings.lru_maintainer_thread ? "yes" : "no");
+    APPEND_STAT("hot_lru_pct", "%d", settings.hot_lru_pct);
+    APPEND_STAT("warm_lru_pct", "%d", settings.warm_lru_pct);
+    APPEND_STAT("hash_algorithm", "%s", hash_name(settings.hash_algorithm));
+    APPEND_STAT("reuseport", "%s", settings.reuseport ? "yes" : "no");
+    APPEND_STAT("memory_file", "%s",
+                settings.memory_file ? settings.memory_file : "NULL");
+    APPEND_STAT("ext_path", "%s",
+                settings.ext_path ? settings.ext_path : "NULL");
+    APPEND_STAT("ext_page_size", "%u", settings.ext_page_size);
+    APPEND_STAT("ext_item_size", "%d", settings.ext_item_size);
+    APPEND_STAT("ext_item_age", "%u", settings.ext_item_age);
+    APPEND_STAT("ext_threads", "%d", settings.ext_threads);
+    APPEND_STAT("ext_compact_under", "%d", settings.ext_compact_under);
+    APPEND_STAT("ext_recache_rate", "%d", settings.ext_recache_rate);
+    APPEND_STAT("latency_stats", "%s", settings.latency_stats ? "yes" : "no");
 }
 
 static void process_stat(conn *c, token_t *tokens, const size_t ntokens) {
@@ -2703,135 +2865,229 @@ static void process_stat(conn *c, token_t *tokens, const size_t ntokens) {
     }
 }
 
+/*
+ * Sets up the flash read for a get hit on the header hdr_it, into a fresh
+ * item that goes into the response in its place. Returns NULL if there's no
+ * memory for it; the caller still has its reference to hdr_it then.
+ */
+static io_wrap *conn_io_new(conn *c, item *hdr_it) {
+    item_hdr hdr;
+    io_wrap *io;
+    item *read_it;
+    int flags;
+
+    if ((io = cache_alloc(c->thread->io_cache)) == NULL)
+        return NULL;
+    storage_hdr(hdr_it, &hdr);
+    flags = (int)strtoul(ITEM_suffix(hdr_it) + 1, NULL, 10);
+    read_it = item_alloc(ITEM_key(hdr_it), hdr_it->nkey, flags,
+                         hdr_it->exptime, hdr.nbytes);
+    if (read_it == NULL) {
+        cache_free(c->thread->io_cache, io);
+        return NULL;
+    }
+    /* For gets; the read checks it against what was written */
+    ITEM_set_cas(read_it, ITEM_get_cas(hdr_it));
+    storage_read_prep(io, hdr_it, read_it);
+    io->c = c;
+    io->next = NULL;
+    return io;
+}
+
+/* Lets go of a flash read that won't be submitted, or is done. */
+static void conn_io_free(conn *c, io_wrap *io) {
+    item_remove(io->hdr_it);
+    cache_free(c->thread->io_cache, io);
+}
+
+/*
+ * Called by the worker once the IO threads are done with a read; the get
+ * response goes out after the last one. A value that couldn't be read back
+ * is left out of it, as a miss.
+ */
+void conn_io_done(io_wrap *io) {
+    conn *c = io->c;
+    int i;
+
+    if (!storage_read_done(io)) {
+        for (i = 0; i < io->iovec_count; i++)
+            c->iov[io->iovec_start + i].iov_len = 0;
+    }
+    conn_io_free(c, io);
+
+    if (--c->io_pending == 0) {
+        conn_set_state(c, conn_mwrite);
+        drive_machine(c);
+    }
+}
+
 /* ntokens is overwritten here... shrug.. */
 static inline void process_get_command(conn *c, token_t *tokens, size_t ntokens, bool return_cas) {
-    char *key;
-    size_t nkey;
+    char *keys[ITEM_GET_BATCH_MAX];
+    size_t nkeys[ITEM_GET_BATCH_MAX];
+    item *items[ITEM_GET_BATCH_MAX];
+    token_t more_tokens[ITEM_GET_BATCH_MAX + 1];
     int i = 0;
+    int j, nbatch, hits;
+    bool oom = false;
+    const char *error = NULL;
     item *it;
+    io_wrap *io, *next;
+    int iov_start;
     token_t *key_token = &tokens[KEY_TOKEN];
     char *suffix;
     assert(c != NULL);
 
     do {
-        while(key_token->length != 0) {
+        for (nbatch = 0; key_token[nbatch].length != 0; nbatch++) {
+            if (key_token[nbatch].length > KEY_MAX_LENGTH) {
+                error = "CLIENT_ERROR bad command line format";
+                break;
+            }
+            keys[nbatch] = key_token[nbatch].value;
+            nkeys[nbatch] = key_token[nbatch].length;
+        }
+        if (error != NULL)
+            break;
 
-            key = key_token->value;
-            nkey = key_token->length;
+        /* Look the whole batch up before building any of the response; see
+         * item_get_batch(). */
+        item_get_batch(keys, nkeys, items, nbatch);
 
-            if(nkey > KEY_MAX_LENGTH) {
-                out_string(c, "CLIENT_ERROR bad command line format");
-                return;
+        hits = 0;
+        for (j = 0; j < nbatch; j++) {
+            if (items[j] != NULL) {
+                c->thread->stats.slab_stats[items[j]->slabs_clsid].get_hits++;
+                hits++;
             }
+        }
+        c->thread->stats.get_misses += nbatch - hits;
+        c->thread->stats.get_cmds += nbatch;
+
+        /* Size the item, suffix and iovec lists for every hit up front
+         * instead of growing them one hit at a time. */
+        if (hits > 0 &&
+            (ensure_item_space(c, i + hits, return_cas) != 0 ||
+             reserve_iov_space(c, hits * (return_cas ? 5 : 3)) != 0)) {
+            oom = true;
+        }
 
-            it = item_get(key, nkey);
+        for (j = 0; j < nbatch; j++) {
+            it = items[j];
             if (settings.detail_enabled) {
-                stats_prefix_record_get(key, nkey, NULL != it);
+                stats_prefix_record_get(keys[j], nkeys[j], NULL != it);
+            }
+            if (it == NULL) {
+                MEMCACHED_COMMAND_GET(c->sfd, keys[j], nkeys[j], -1, 0);
+                continue;
+            }
+            /* item_get_batch() took a reference on every hit; drop the
+             * ones we can't send. */
+            if (oom || error != NULL) {
+                item_remove(it);
+                continue;
             }
-            if (it) {
-                if (i >= c->isize) {
-                    item **new_list = realloc(c->ilist, sizeof(item *) * c->isize * 2);
-                    if (new_list) {
-                        c->isize *= 2;
-                        c->ilist = new_list;
-                    } else {
-                        item_remove(it);
-                        break;
-                    }
-                }
-
-                /*
-                 * Construct the response. Each hit adds three elements to the
-                 * outgoing data list:
-                 *   "VALUE "
-                 *   key
-                 *   " " + flags + " " + data length + "\r\n" + data (with \r\n)
-                 */
-
-                if (return_cas)
-                {
-                  MEMCACHED_COMMAND_GET(c->sfd, ITEM_key(it), it->nkey,
-                                        it->nbytes, ITEM_get_cas(it));
-                  /* Goofy mid-flight realloc. */
-                  if (i >= c->suffixsize) {
-                    char **new_suffix_list = realloc(c->suffixlist,
-                                           sizeof(char *) * c->suffixsize * 2);
-                    if (new_suffix_list) {
-                        c->suffixsize *= 2;
-                        c->suffixlist  = new_suffix_list;
-                    } else {
-                        item_remove(it);
-                        break;
-                    }
-                  }
 
-                  suffix = cache_alloc(c->thread->suffix_cache);
-                  if (suffix == NULL) {
-                    out_string(c, "SERVER_ERROR out of memory making CAS suffix");
+            /* The value is on flash. Over UDP, where the response has to
+             * be laid out in full first, read it right away; otherwise the
+             * response gets built around an item the IO threads read into,
+             * and goes out once they're done. */
+            io = NULL;
+            if ((it->it_flags & ITEM_HDR) != 0) {
+                if (IS_UDP(c->transport)) {
+                    if ((it = item_load(it)) == NULL)
+                        continue;
+                } else if ((io = conn_io_new(c, it)) == NULL) {
                     item_remove(it);
-                    return;
-                  }
-                  *(c->suffixlist + i) = suffix;
-                  int suffix_len = snprintf(suffix, SUFFIX_SIZE,
-                                            " %llu\r\n",
-                                            (unsigned long long)ITEM_get_cas(it));
-                  if (add_iov(c, "VALUE ", 6) != 0 ||
-                      add_iov(c, ITEM_key(it), it->nkey) != 0 ||
-                      add_iov(c, ITEM_suffix(it), it->nsuffix - 2) != 0 ||
-                      add_iov(c, suffix, suffix_len) != 0 ||
-                      add_iov(c, ITEM_data(it), it->nbytes) != 0)
-                      {
-                          item_remove(it);
-                          break;
-                      }
-                }
-                else
-                {
-                  MEMCACHED_COMMAND_GET(c->sfd, ITEM_key(it), it->nkey,
-                                        it->nbytes, ITEM_get_cas(it));
-                  if (add_iov(c, "VALUE ", 6) != 0 ||
-                      add_iov(c, ITEM_key(it), it->nkey) != 0 ||
-                      add_iov(c, ITEM_suffix(it), it->nsuffix + it->nbytes) != 0)
-                      {
-                          item_remove(it);
-                          break;
-                      }
+                    continue;
+                } else {
+                    it = io->read_it;
                 }
+            }
+            iov_start = c->iovused;
 
+            /*
+             * Construct the response. Each hit adds three elements to the
+             * outgoing data list:
+             *   "VALUE "
+             *   key
+             *   " " + flags + " " + data length + "\r\n" + data (with \r\n)
+             */
 
-                if (settings.verbose > 1)
-                    fprintf(stderr, ">%d sending key %s\n", c->sfd, ITEM_key(it));
+            MEMCACHED_COMMAND_GET(c->sfd, ITEM_key(it), it->nkey,
+                                  it->nbytes, ITEM_get_cas(it));
+            if (return_cas)
+            {
+              suffix = cache_alloc(c->thread->suffix_cache);
+              if (suffix == NULL) {
+                error = "SERVER_ERROR out of memory making CAS suffix";
+                item_remove(it);
+                if (io != NULL)
+                    conn_io_free(c, io);
+                continue;
+              }
+              int suffix_len = snprintf(suffix, SUFFIX_SIZE,
+                                        " %llu\r\n",
+                                        (unsigned long long)ITEM_get_cas(it));
+              if (add_iov(c, "VALUE ", 6) != 0 ||
+                  add_iov(c, ITEM_key(it), it->nkey) != 0 ||
+                  add_iov(c, ITEM_suffix(it), it->nsuffix - 2) != 0 ||
+                  add_iov(c, suffix, suffix_len) != 0 ||
+                  add_iov(c, ITEM_data(it), it->nbytes) != 0)
+                  {
+                      cache_free(c->thread->suffix_cache, suffix);
+                      item_remove(it);
+                      if (io != NULL)
+                          conn_io_free(c, io);
+                      oom = true;
+                      continue;
+                  }
+              *(c->suffixlist + i) = suffix;
+            }
+            else
+            {
+              if (add_iov(c, "VALUE ", 6) != 0 ||
+                  add_iov(c, ITEM_key(it), it->nkey) != 0 ||
+                  add_iov(c, ITEM_suffix(it), it->nsuffix + it->nbytes) != 0)
+                  {
+                      item_remove(it);
+                      if (io != NULL)
+                          conn_io_free(c, io);
+                      oom = true;
+                      continue;
+                  }
+            }
 
-                /* item_get() has incremented it->refcount for us */
-                pthread_mutex_lock(&c->thread->stats.mutex);
-                c->thread->stats.slab_stats[it->slabs_clsid].get_hits++;
-                c->thread->stats.get_cmds++;
-                pthread_mutex_unlock(&c->thread->stats.mutex);
-                item_update(it);
-                *(c->ilist + i) = it;
-                i++;
+            if (settings.verbose > 1)
+                fprintf(stderr, ">%d sending key %s\n", c->sfd, ITEM_key(it));
 
+            if (io != NULL) {
+                io->iovec_start = iov_start;
+                io->iovec_count = c->iovused - iov_start;
+                io->next = c->io_queue;
+                c->io_queue = io;
+                c->io_pending++;
+                item_update(io->hdr_it);
             } else {
-                pthread_mutex_lock(&c->thread->stats.mutex);
-                c->thread->stats.get_misses++;
-                c->thread->stats.get_cmds++;
-                pthread_mutex_unlock(&c->thread->stats.mutex);
-                MEMCACHED_COMMAND_GET(c->sfd, key, nkey, -1, 0);
+                item_update(it);
             }
-
-            key_token++;
+            *(c->ilist + i) = it;
+            i++;
         }
 
+        key_token += nbatch;
+
         /*
          * If the command string hasn't been fully processed, get the next set
-         * of tokens.
+         * of tokens. These can hold a full batch, unlike the command's own.
          */
         if(key_token->value != NULL) {
-            ntokens = tokenize_command(key_token->value, tokens, MAX_TOKENS);
-            key_token = tokens;
+            ntokens = tokenize_command(key_token->value, more_tokens,
+                                       ITEM_GET_BATCH_MAX + 1);
+            key_token = more_tokens;
         }
 
-    } while(key_token->value != NULL);
+    } while(!oom && error == NULL && key_token->value != NULL);
 
     c->icurr = c->ilist;
     c->ileft = i;
@@ -2840,21 +3096,45 @@ static inline void process_get_command(conn *c, token_t *tokens, size_t ntokens,
         c->suffixleft = i;
     }
 
-    if (settings.verbose > 1)
-        fprintf(stderr, ">%d END\n", c->sfd);
-
     /*
         If the loop was terminated because of out-of-memory, it is not
         reliable to add END\r\n to the buffer, because it might not end
         in \r\n. So we send SERVER_ERROR instead.
     */
-    if (key_token->value != NULL || add_iov(c, "END\r\n", 5) != 0
-        || (IS_UDP(c->transport) && build_udp_headers(c) != 0)) {
-        out_string(c, "SERVER_ERROR out of memory writing get response");
+    if (error == NULL &&
+        (oom || add_iov(c, "END\r\n", 5) != 0
+         || (IS_UDP(c->transport) && build_udp_headers(c) != 0))) {
+        error = "SERVER_ERROR out of memory writing get response";
+    }
+
+    if (error != NULL) {
+        /* Nothing we collected is going out; let go of it now rather than
+         * leave it for the next get to overwrite. */
+        for (io = c->io_queue; io != NULL; io = next) {
+            next = io->next;
+            conn_io_free(c, io);
+        }
+        c->io_queue = NULL;
+        c->io_pending = 0;
+        conn_release_get_items(c);
+        out_string(c, error);
     }
     else {
-        conn_set_state(c, conn_mwrite);
+        if (settings.verbose > 1)
+            fprintf(stderr, ">%d END\n", c->sfd);
         c->msgcurr = 0;
+        if (c->io_queue != NULL) {
+            conn_set_state(c, conn_io_wait);
+            /* Reads can be done and handed back as soon as they're
+             * submitted, which reuses next. */
+            for (io = c->io_queue; io != NULL; io = next) {
+                next = io->next;
+                thread_io_submit(io);
+            }
+            c->io_queue = NULL;
+        } else {
+            conn_set_state(c, conn_mwrite);
+        }
     }
 
     return;
@@ -2974,18 +3254,14 @@ static void process_touch_command(conn *c, token_t *tokens, const size_t ntokens
     it = item_touch(key, nkey, realtime(exptime_int));
     if (it) {
         item_update(it);
-        pthread_mutex_lock(&c->thread->stats.mutex);
         c->thread->stats.touch_cmds++;
         c->thread->stats.slab_stats[it->slabs_clsid].touch_hits++;
-        pthread_mutex_unlock(&c->thread->stats.mutex);
 
         out_string(c, "TOUCHED");
         item_remove(it);
     } else {
-        pthread_mutex_lock(&c->thread->stats.mutex);
         c->thread->stats.touch_cmds++;
         c->thread->stats.touch_misses++;
-        pthread_mutex_unlock(&c->thread->stats.mutex);
 
         out_string(c, "NOT_FOUND");
     }
@@ -3025,13 +3301,11 @@ static void process_arithmetic_command(conn *c, token_t *tokens, const size_t nt
         out_string(c, "SERVER_ERROR out of memory");
         break;
     case DELTA_ITEM_NOT_FOUND:
-        pthread_mutex_lock(&c->thread->stats.mutex);
         if (incr) {
             c->thread->stats.incr_misses++;
         } else {
             c->thread->stats.decr_misses++;
         }
-        pthread_mutex_unlock(&c->thread->stats.mutex);
 
         out_string(c, "NOT_FOUND");
         break;
@@ -3064,6 +3338,10 @@ enum delta_result_type do_add_delta(conn *c, const char *key, const size_t nkey,
     if (!it) {
         return DELTA_ITEM_NOT_FOUND;
     }
+    if ((it->it_flags & ITEM_HDR) != 0 &&
+        (it = do_storage_get(it, hv)) == NULL) {
+        return DELTA_ITEM_NOT_FOUND;
+    }
 
     if (cas != NULL && *cas != 0 && ITEM_get_cas(it) != *cas) {
         do_item_remove(it);
@@ -3089,13 +3367,11 @@ enum delta_result_type do_add_delta(conn *c, const char *key, const size_t nkey,
         MEMCACHED_COMMAND_DECR(c->sfd, ITEM_key(it), it->nkey, value);
     }
 
-    pthread_mutex_lock(&c->thread->stats.mutex);
     if (incr) {
         c->thread->stats.slab_stats[it->slabs_clsid].incr_hits++;
     } else {
         c->thread->stats.slab_stats[it->slabs_clsid].decr_hits++;
     }
-    pthread_mutex_unlock(&c->thread->stats.mutex);
 
     snprintf(buf, INCR_MAX_STORAGE_LEN, "%llu", (unsigned long long)value);
     res = strlen(buf);
@@ -3116,9 +3392,7 @@ enum delta_result_type do_add_delta(conn *c, const char *key, const size_t nkey,
     } else { /* replace in-place */
         /* When changing the value without replacing the item, we
            need to update the CAS on the existing item. */
-        mutex_lock(&cache_lock); /* FIXME */
         ITEM_set_cas(it, (settings.use_cas) ? get_cas_id() : 0);
-        pthread_mutex_unlock(&cache_lock);
 
         memcpy(ITEM_data(it), buf, res);
         memset(ITEM_data(it) + res, ' ', it->nbytes - res - 2);
@@ -3168,88 +3442,626 @@ static void process_delete_command(conn *c, token_t *tokens, const size_t ntoken
     if (it) {
         MEMCACHED_COMMAND_DELETE(c->sfd, ITEM_key(it), it->nkey);
 
-        pthread_mutex_lock(&c->thread->stats.mutex);
         c->thread->stats.slab_stats[it->slabs_clsid].delete_hits++;
-        pthread_mutex_unlock(&c->thread->stats.mutex);
 
         item_unlink(it);
         item_remove(it);      /* release our reference */
         out_string(c, "DELETED");
     } else {
-        pthread_mutex_lock(&c->thread->stats.mutex);
         c->thread->stats.delete_misses++;
-        pthread_mutex_unlock(&c->thread->stats.mutex);
 
         out_string(c, "NOT_FOUND");
     }
 }
 
-static void process_verbosity_command(conn *c, token_t *tokens, const size_t ntokens) {
-    unsigned int level;
+/*
+ * Meta commands: mg (get), ms (set), md (delete) and mn (no-op). The key is
+ * followed by one-letter flags, with any argument run straight on ("T30",
+ * "Oabc"), and the flags asking for something back are answered in the order
+ * they came. They're parsed in place in the read buffer. Misses (mg) and
+ * successes (ms, md) can be left unanswered with "q"; a client pipelining
+ * them ends the batch with mn and reads up to its "MN".
+ */
 
-    assert(c != NULL);
+/*
+ * Notes an O, k or c flag of an ms or md, to answer with later. Returns false
+ * if an opaque token is too long.
+ */
+static bool meta_ret_flag(conn *c, const token_t *flag) {
+    size_t n = strlen(c->meta_ret);
 
-    set_noreply_maybe(c, tokens, ntokens);
+    if (flag->value[0] == 'O') {
+        if (flag->length - 1 > META_OPAQUE_MAX)
+            return false;
+        memcpy(c->meta_opaque, flag->value + 1, flag->length - 1);
+        c->meta_opaque[flag->length - 1] = '\0';
+    }
+    if (strchr(c->meta_ret, flag->value[0]) == NULL &&
+        n < sizeof(c->meta_ret) - 1) {
+        c->meta_ret[n] = flag->value[0];
+        c->meta_ret[n + 1] = '\0';
+    }
+    return true;
+}
 
-    level = strtoul(tokens[1].value, NULL, 10);
-    settings.verbose = level > MAX_VERBOSITY_LEVEL ? MAX_VERBOSITY_LEVEL : level;
-    out_string(c, "OK");
-    return;
+/* Answers an ms or md with code and the flags meta_ret_flag() noted. */
+static void meta_out(conn *c, const char *code, const char *key,
+                     const size_t nkey, const uint64_t cas) {
+    char buf[META_OPAQUE_MAX + KEY_MAX_LENGTH + 64];
+    char *p = buf;
+    const char *f;
+
+    p += sprintf(p, "%s", code);
+    for (f = c->meta_ret; *f != '\0'; f++) {
+        switch (*f) {
+        case 'O':
+            p += sprintf(p, " O%s", c->meta_opaque);
+            break;
+        case 'k':
+            p += sprintf(p, " k%.*s", (int)nkey, key);
+            break;
+        case 'c':
+            p += sprintf(p, " c%llu", (unsigned long long)cas);
+            break;
+        }
+    }
+    out_string(c, buf);
 }
 
-static void process_slabs_automove_command(conn *c, token_t *tokens, const size_t ntokens) {
-    unsigned int level;
+/*
+ * mg <key> <flags>*
+ *
+ * v returns the value, c the CAS, f the client flags, k the key, s the size,
+ * t the seconds left to live (-1 for none) and O<token> the token. T<ttl>
+ * touches the item, N<ttl> creates an empty one on a miss and R<ttl> hands
+ * out a refresh token when less than that is left. A hit is answered with
+ * "VA <size> <flags>*" and the value, or "HD <flags>*" without v; a miss with
+ * "EN". Holding the token is flagged W, someone else holding it Z, and an
+ * invalidated item X.
+ */
+static void process_mget_command(conn *c, token_t *tokens, const size_t ntokens) {
+    char *key = tokens[KEY_TOKEN].value;
+    size_t nkey = tokens[KEY_TOKEN].length;
+    bool value = false, need_size = false, quiet = false;
+    bool touch = false, vivify = false, recache = false;
+    bool win = false, lost = false, stale = false;
+    int32_t ttl = 0, vivify_ttl = 0, recache_ttl = 0;
+    const char *opaque = NULL;
+    char answered[8] = "";
+    char *p, *end;
+    size_t i, n;
+    item *it;
 
-    assert(c != NULL);
+    if (nkey > KEY_MAX_LENGTH || tokens[ntokens - 1].value != NULL) {
+        out_string(c, "CLIENT_ERROR bad command line format");
+        return;
+    }
 
-    set_noreply_maybe(c, tokens, ntokens);
+    for (i = KEY_TOKEN + 1; i < ntokens - 1; i++) {
+        const char *arg = tokens[i].value + 1;
+        bool ok = true;
 
-    level = strtoul(tokens[2].value, NULL, 10);
-    if (level == 0) {
-        settings.slab_automove = false;
-    } else if (level == 1) {
-        settings.slab_automove = true;
-    } else {
-        out_string(c, "ERROR");
-        return;
+        switch (tokens[i].value[0]) {
+        case 'v':
+            value = true;
+            break;
+        case 's':
+            need_size = true;
+            break;
+        case 'c':
+        case 'f':
+        case 'k':
+        case 't':
+            break;
+        case 'q':
+            quiet = true;
+            break;
+        case 'O':
+            ok = tokens[i].length - 1 <= META_OPAQUE_MAX;
+            opaque = tokens[i].value;
+            break;
+        case 'T':
+            touch = true;
+            ok = safe_strtol(arg, &ttl);
+            break;
+        case 'N':
+            vivify = true;
+            ok = safe_strtol(arg, &vivify_ttl);
+            break;
+        case 'R':
+            recache = true;
+            ok = safe_strtol(arg, &recache_ttl) && recache_ttl >= 0;
+            break;
+        default:
+            out_string(c, "CLIENT_ERROR invalid flag");
+            return;
+        }
+        if (!ok) {
+            out_string(c, "CLIENT_ERROR bad token in command line format");
+            return;
+        }
     }
-    out_string(c, "OK");
-    return;
-}
 
-static void process_command(conn *c, char *command) {
+    if (touch) {
+        it = item_touch(key, nkey, realtime(ttl));
+    } else {
+        it = item_get(key, nkey);
+    }
+    if (it && (it->it_flags & ITEM_HDR) != 0 && (value || need_size)) {
+        it = item_load(it);
+    }
 
-    token_t tokens[MAX_TOKENS];
-    size_t ntokens;
-    int comm;
+    c->thread->stats.get_cmds++;
+    if (touch)
+        c->thread->stats.touch_cmds++;
+    if (it) {
+        c->thread->stats.slab_stats[it->slabs_clsid].get_hits++;
+        if (touch)
+            c->thread->stats.slab_stats[it->slabs_clsid].touch_hits++;
+    } else {
+        c->thread->stats.get_misses++;
+        if (touch)
+            c->thread->stats.touch_misses++;
+    }
+
+    if (it == NULL && vivify) {
+        /* Whoever creates the placeholder is the one to fill it in */
+        it = item_alloc(key, nkey, 0, realtime(vivify_ttl), 2);
+        if (it != NULL) {
+            memcpy(ITEM_data(it), "\r\n", 2);
+            it->it_flags |= ITEM_TOKEN_SENT;
+            if (store_item(it, NREAD_ADD, c) == STORED) {
+                win = true;
+            } else {
+                item_remove(it);
+                it = item_get(key, nkey);
+            }
+        }
+    }
 
-    assert(c != NULL);
+    if (it == NULL) {
+        if (quiet)
+            c->noreply = true;
+        out_string(c, "EN");
+        return;
+    }
 
-    MEMCACHED_PROCESS_COMMAND_START(c->sfd, c->rcurr, c->rbytes);
+    if (!win) {
+        uint32_t hv = hash(ITEM_key(it), it->nkey, 0);
 
-    if (settings.verbose > 1)
-        fprintf(stderr, "<%d %s\n", c->sfd, command);
+        item_lock(hv);
+        stale = (it->it_flags & ITEM_STALE) != 0;
+        if ((it->it_flags & ITEM_TOKEN_SENT) != 0) {
+            lost = true;
+        } else if (stale || (recache && it->exptime != 0 &&
+                             it->exptime - current_time < (rel_time_t)recache_ttl)) {
+            it->it_flags |= ITEM_TOKEN_SENT;
+            win = true;
+        }
+        item_unlock(hv);
+    }
+    item_update(it);
 
     /*
-     * for commands set/add/replace, we build an item and read the data
-     * directly into it, then continue in nread_complete().
+     * The header goes out of wbuf, which nothing else uses for a get. Like
+     * meta_out(), each flag is answered once, in the order it first came, and
+     * O with the last token: repeats can't grow the header past the buffer.
      */
+    p = c->wbuf;
+    end = c->wbuf + c->wsize;
+    if (value) {
+        p += snprintf(p, end - p, "VA %d", it->nbytes - 2);
+    } else {
+        p += snprintf(p, end - p, "HD");
+    }
+    for (i = KEY_TOKEN + 1; i < ntokens - 1; i++) {
+        if (strchr("cfkstO", tokens[i].value[0]) == NULL ||
+            strchr(answered, tokens[i].value[0]) != NULL)
+            continue;
+        n = strlen(answered);
+        answered[n] = tokens[i].value[0];
+        answered[n + 1] = '\0';
+        switch (tokens[i].value[0]) {
+        case 'c':
+            p += snprintf(p, end - p, " c%llu",
+                          (unsigned long long)ITEM_get_cas(it));
+            break;
+        case 'f':
+            p += snprintf(p, end - p, " f%lu",
+                          strtoul(ITEM_suffix(it), NULL, 10));
+            break;
+        case 'k':
+            p += snprintf(p, end - p, " k%.*s", (int)it->nkey, ITEM_key(it));
+            break;
+        case 's':
+            p += snprintf(p, end - p, " s%d", it->nbytes - 2);
+            break;
+        case 't':
+            p += snprintf(p, end - p, " t%ld", it->exptime == 0 ? -1L :
+                          (long)(it->exptime - current_time));
+            break;
+        case 'O':
+            p += snprintf(p, end - p, " %s", opaque);
+            break;
+        }
+    }
+    p += snprintf(p, end - p, "%s%s%s\r\n", win ? " W" : "",
+                  stale ? " X" : "", lost ? " Z" : "");
 
-    c->msgcurr = 0;
-    c->msgused = 0;
-    c->iovused = 0;
-    if (add_msghdr(c) != 0) {
-        out_string(c, "SERVER_ERROR out of memory preparing response");
+    if (add_iov(c, c->wbuf, p - c->wbuf) != 0 ||
+        (value && add_iov(c, ITEM_data(it), it->nbytes) != 0)) {
+        item_remove(it);
+        out_string(c, "SERVER_ERROR out of memory writing get response");
         return;
     }
-
-    ntokens = tokenize_command(command, tokens, MAX_TOKENS);
+    if (value) {
+        *(c->ilist) = it;
+        c->icurr = c->ilist;
+        c->ileft = 1;
+    } else {
+        item_remove(it);
+    }
+    if (settings.verbose > 1)
+        fprintf(stderr, ">%d %.*s", c->sfd, (int)(p - c->wbuf), c->wbuf);
+    c->msgcurr = 0;
+    conn_set_state(c, conn_mwrite);
+}
+
+/*
+ * ms <key> <datalen> <flags>*\r\n<data>\r\n
+ *
+ * F<flags> sets the client flags, T<ttl> the time to live, C<cas> makes it a
+ * compare-and-swap, and M<mode> picks E (add), A (append), P (prepend), R
+ * (replace) or S (set, the default). Answered with HD (stored), NS (not
+ * stored), EX (CAS mismatch) or NF (nothing to CAS, append or replace), with
+ * any O, k and c (the new CAS) asked for.
+ */
+static void process_mset_command(conn *c, token_t *tokens, const size_t ntokens) {
+    char *key = tokens[KEY_TOKEN].value;
+    size_t nkey = tokens[KEY_TOKEN].length;
+    int comm = NREAD_SET;
+    uint32_t flags = 0;
+    int32_t ttl = 0;
+    int32_t vlen;
+    uint64_t req_cas_id = 0;
+    bool has_cas = false;
+    const char *error = NULL;
+    size_t i;
+    item *it;
+
+    c->meta_quiet = false;
+    c->meta_ret[0] = '\0';
+
+    if (nkey > KEY_MAX_LENGTH || tokens[ntokens - 1].value != NULL ||
+        !safe_strtol(tokens[2].value, &vlen) || vlen < 0 || vlen > INT_MAX - 2) {
+        out_string(c, "CLIENT_ERROR bad command line format");
+        return;
+    }
+    vlen += 2;
+
+    for (i = 3; i < ntokens - 1 && error == NULL; i++) {
+        const char *arg = tokens[i].value + 1;
+
+        switch (tokens[i].value[0]) {
+        case 'O':
+        case 'k':
+        case 'c':
+            if (!meta_ret_flag(c, &tokens[i]))
+                error = "CLIENT_ERROR bad token in command line format";
+            break;
+        case 'q':
+            c->meta_quiet = true;
+            break;
+        case 'F':
+            if (!safe_strtoul(arg, &flags))
+                error = "CLIENT_ERROR bad token in command line format";
+            break;
+        case 'T':
+            if (!safe_strtol(arg, &ttl))
+                error = "CLIENT_ERROR bad token in command line format";
+            break;
+        case 'C':
+            if (!safe_strtoull(arg, &req_cas_id))
+                error = "CLIENT_ERROR bad token in command line format";
+            has_cas = true;
+            break;
+        case 'M':
+            switch (tokens[i].length == 2 ? arg[0] : '\0') {
+            case 'E': comm = NREAD_ADD; break;
+            case 'A': comm = NREAD_APPEND; break;
+            case 'P': comm = NREAD_PREPEND; break;
+            case 'R': comm = NREAD_REPLACE; break;
+            case 'S': comm = NREAD_SET; break;
+            default:
+                error = "CLIENT_ERROR invalid mode for ms";
+            }
+            break;
+        default:
+            error = "CLIENT_ERROR invalid flag";
+        }
+    }
+    if (error == NULL && has_cas) {
+        if (comm == NREAD_SET)
+            comm = NREAD_CAS;
+        else
+            error = "CLIENT_ERROR invalid mode for ms";
+    }
+    if (error != NULL) {
+        out_string(c, error);
+        c->write_and_go = conn_swallow;
+        c->sbytes = vlen;
+        return;
+    }
+
+    /* Negative exptimes can underflow and end up immortal, see
+     * process_update_command. */
+    if (ttl < 0)
+        ttl = REALTIME_MAXDELTA + 1;
+
+    if (settings.detail_enabled) {
+        stats_prefix_record_set(key, nkey);
+    }
+
+    it = item_alloc(key, nkey, flags, realtime(ttl), vlen);
+    if (it == 0) {
+        if (! item_size_ok(nkey, flags, vlen))
+            out_string(c, "SERVER_ERROR object too large for cache");
+        else
+            out_string(c, "SERVER_ERROR out of memory storing object");
+        c->write_and_go = conn_swallow;
+        c->sbytes = vlen;
+
+        /* Same as for set: don't leave the old value behind */
+        if (comm == NREAD_SET) {
+            it = item_get(key, nkey);
+            if (it) {
+                item_unlink(it);
+                item_remove(it);
+            }
+        }
+        return;
+    }
+    ITEM_set_cas(it, req_cas_id);
+
+    c->item = it;
+    c->ritem = ITEM_data(it);
+    c->rlbytes = it->nbytes;
+    c->cmd = comm;
+    c->meta = true;
+    conn_set_state(c, conn_nread);
+}
+
+/* Answers a finished ms, see complete_nread_ascii() */
+static void complete_mset(conn *c, item *it, enum store_item_type ret) {
+    c->meta = false;
+    switch (ret) {
+    case STORED:
+        if (c->meta_quiet)
+            c->noreply = true;
+        meta_out(c, "HD", ITEM_key(it), it->nkey, c->cas);
+        break;
+    case EXISTS:
+        meta_out(c, "EX", ITEM_key(it), it->nkey, 0);
+        break;
+    case NOT_FOUND:
+        meta_out(c, "NF", ITEM_key(it), it->nkey, 0);
+        break;
+    case NOT_STORED:
+        meta_out(c, "NS", ITEM_key(it), it->nkey, 0);
+        break;
+    default:
+        out_string(c, "SERVER_ERROR Unhandled storage type.");
+    }
+}
+
+/*
+ * md <key> <flags>*
+ *
+ * C<cas> only deletes that version. I invalidates instead of deleting: the
+ * item stays, marked stale, and the next mg hands out a token to refresh it;
+ * T<ttl> then also resets its time to live. Answered with HD, NF or EX, with
+ * any O and k asked for.
+ */
+static void process_mdelete_command(conn *c, token_t *tokens, const size_t ntokens) {
+    char *key = tokens[KEY_TOKEN].value;
+    size_t nkey = tokens[KEY_TOKEN].length;
+    bool invalidate = false, has_ttl = false, has_cas = false;
+    int32_t ttl = 0;
+    uint64_t req_cas_id = 0;
+    size_t i;
+    item *it;
+
+    c->meta_quiet = false;
+    c->meta_ret[0] = '\0';
+
+    if (nkey > KEY_MAX_LENGTH || tokens[ntokens - 1].value != NULL) {
+        out_string(c, "CLIENT_ERROR bad command line format");
+        return;
+    }
+
+    for (i = KEY_TOKEN + 1; i < ntokens - 1; i++) {
+        const char *arg = tokens[i].value + 1;
+        bool ok = true;
+
+        switch (tokens[i].value[0]) {
+        case 'O':
+        case 'k':
+            ok = meta_ret_flag(c, &tokens[i]);
+            break;
+        case 'q':
+            c->meta_quiet = true;
+            break;
+        case 'I':
+            invalidate = true;
+            break;
+        case 'T':
+            has_ttl = true;
+            ok = safe_strtol(arg, &ttl);
+            break;
+        case 'C':
+            has_cas = true;
+            ok = safe_strtoull(arg, &req_cas_id);
+            break;
+        default:
+            out_string(c, "CLIENT_ERROR invalid flag");
+            return;
+        }
+        if (!ok) {
+            out_string(c, "CLIENT_ERROR bad token in command line format");
+            return;
+        }
+    }
+
+    if (settings.detail_enabled) {
+        stats_prefix_record_delete(key, nkey);
+    }
+
+    it = item_get(key, nkey);
+    if (it == NULL) {
+        c->thread->stats.delete_misses++;
+        meta_out(c, "NF", key, nkey, 0);
+        return;
+    }
+    if (has_cas && req_cas_id != ITEM_get_cas(it)) {
+        item_remove(it);
+        meta_out(c, "EX", key, nkey, 0);
+        return;
+    }
+
+    MEMCACHED_COMMAND_DELETE(c->sfd, ITEM_key(it), it->nkey);
+    c->thread->stats.slab_stats[it->slabs_clsid].delete_hits++;
+    if (invalidate) {
+        uint32_t hv = hash(ITEM_key(it), it->nkey, 0);
+
+        item_lock(hv);
+        it->it_flags |= ITEM_STALE;
+        it->it_flags &= ~ITEM_TOKEN_SENT;
+        if (has_ttl)
+            it->exptime = realtime(ttl);
+        item_unlock(hv);
+    } else {
+        item_unlink(it);
+    }
+    item_remove(it);
+
+    if (c->meta_quiet)
+        c->noreply = true;
+    meta_out(c, "HD", key, nkey, 0);
+}
+
+static void process_verbosity_command(conn *c, token_t *tokens, const size_t ntokens) {
+    unsigned int level;
+
+    assert(c != NULL);
+
+    set_noreply_maybe(c, tokens, ntokens);
+
+    level = strtoul(tokens[1].value, NULL, 10);
+    settings.verbose = level > MAX_VERBOSITY_LEVEL ? MAX_VERBOSITY_LEVEL : level;
+    out_string(c, "OK");
+    return;
+}
+
+static void process_slabs_automove_command(conn *c, token_t *tokens, const size_t ntokens) {
+    unsigned int level;
+
+    assert(c != NULL);
+
+    set_noreply_maybe(c, tokens, ntokens);
+
+    level = strtoul(tokens[2].value, NULL, 10);
+    if (level == 0) {
+        settings.slab_automove = false;
+    } else if (level == 1) {
+        settings.slab_automove = true;
+    } else {
+        out_string(c, "ERROR");
+        return;
+    }
+    out_string(c, "OK");
+    return;
+}
+
+/* Which "stats latency" group a text command is counted in. */
+static int latency_class_ascii(token_t *tokens, const size_t ntokens) {
+    const char *cmd = tokens[COMMAND_TOKEN].value;
+
+    if (ntokens < 2)
+        return LAT_OTHER;
+    if (strcmp(cmd, "get") == 0 || strcmp(cmd, "gets") == 0 ||
+        strcmp(cmd, "bget") == 0 || strcmp(cmd, "mg") == 0)
+        return LAT_GET;
+    if (strcmp(cmd, "set") == 0 || strcmp(cmd, "add") == 0 ||
+        strcmp(cmd, "replace") == 0 || strcmp(cmd, "append") == 0 ||
+        strcmp(cmd, "prepend") == 0 || strcmp(cmd, "ms") == 0)
+        return LAT_SET;
+    if (strcmp(cmd, "cas") == 0)
+        return LAT_CAS;
+    if (strcmp(cmd, "delete") == 0 || strcmp(cmd, "md") == 0)
+        return LAT_DELETE;
+    if (strcmp(cmd, "incr") == 0)
+        return LAT_INCR;
+    if (strcmp(cmd, "decr") == 0)
+        return LAT_DECR;
+    if (strcmp(cmd, "touch") == 0)
+        return LAT_TOUCH;
+    return LAT_OTHER;
+}
+
+static void process_command(conn *c, char *command) {
+
+    token_t tokens[MAX_TOKENS];
+    size_t ntokens;
+    int comm;
+
+    assert(c != NULL);
+
+    MEMCACHED_PROCESS_COMMAND_START(c->sfd, c->rcurr, c->rbytes);
+
+    if (settings.verbose > 1)
+        fprintf(stderr, "<%d %s\n", c->sfd, command);
+
+    /*
+     * for commands set/add/replace, we build an item and read the data
+     * directly into it, then continue in nread_complete().
+     */
+
+    c->msgcurr = 0;
+    c->msgused = 0;
+    c->iovused = 0;
+    if (add_msghdr(c) != 0) {
+        out_string(c, "SERVER_ERROR out of memory preparing response");
+        return;
+    }
+
+    ntokens = tokenize_command(command, tokens, MAX_TOKENS);
+    if (settings.latency_stats) {
+        c->cmd_start = latency_now();
+        c->cmd_class = latency_class_ascii(tokens, ntokens);
+    }
+
     if (ntokens >= 3 &&
         ((strcmp(tokens[COMMAND_TOKEN].value, "get") == 0) ||
          (strcmp(tokens[COMMAND_TOKEN].value, "bget") == 0))) {
 
         process_get_command(c, tokens, ntokens, false);
 
+    } else if (ntokens >= 3 && strcmp(tokens[COMMAND_TOKEN].value, "mg") == 0) {
+
+        process_mget_command(c, tokens, ntokens);
+
+    } else if (ntokens >= 4 && strcmp(tokens[COMMAND_TOKEN].value, "ms") == 0) {
+
+        process_mset_command(c, tokens, ntokens);
+
+    } else if (ntokens >= 3 && strcmp(tokens[COMMAND_TOKEN].value, "md") == 0) {
+
+        process_mdelete_command(c, tokens, ntokens);
+
+    } else if (ntokens == 2 && strcmp(tokens[COMMAND_TOKEN].value, "mn") == 0) {
+
+        out_string(c, "MN");
+
     } else if ((ntokens == 6 || ntokens == 7) &&
                ((strcmp(tokens[COMMAND_TOKEN].value, "add") == 0 && (comm = NREAD_ADD)) ||
                 (strcmp(tokens[COMMAND_TOKEN].value, "set") == 0 && (comm = NREAD_SET)) ||
@@ -3292,9 +4104,7 @@ static void process_command(conn *c, char *command) {
 
         set_noreply_maybe(c, tokens, ntokens);
 
-        pthread_mutex_lock(&c->thread->stats.mutex);
         c->thread->stats.flush_cmds++;
-        pthread_mutex_unlock(&c->thread->stats.mutex);
 
         if(ntokens == (c->noreply ? 3 : 2)) {
             settings.oldest_live = current_time - 1;
@@ -3533,9 +4343,7 @@ static enum try_read_result try_read_udp(conn *c) {
                    0, &c->request_addr, &c->request_addr_size);
     if (res > 8) {
         unsigned char *buf = (unsigned char *)c->rbuf;
-        pthread_mutex_lock(&c->thread->stats.mutex);
         c->thread->stats.bytes_read += res;
-        pthread_mutex_unlock(&c->thread->stats.mutex);
 
         /* Beginning of UDP packet is the request ID; save it. */
         c->request_id = buf[0] * 256 + buf[1];
@@ -3603,9 +4411,7 @@ static enum try_read_result try_read_network(conn *c) {
         int avail = c->rsize - c->rbytes;
         res = read(c->sfd, c->rbuf + c->rbytes, avail);
         if (res > 0) {
-            pthread_mutex_lock(&c->thread->stats.mutex);
             c->thread->stats.bytes_read += res;
-            pthread_mutex_unlock(&c->thread->stats.mutex);
             gotdata = READ_DATA_RECEIVED;
             c->rbytes += res;
             if (res == avail) {
@@ -3676,6 +4482,53 @@ void do_accept_new_conns(const bool do_accept) {
     }
 }
 
+/*
+ * maxconns_handler() for a worker's own listeners: polls on the worker's
+ * event base until connections have been closed again.
+ */
+static void thread_maxconns_handler(const int fd, const short which, void *arg) {
+    LIBEVENT_THREAD *me = arg;
+    struct timeval t = {.tv_sec = 0, .tv_usec = 10000};
+
+    if (fd == -42 || allow_new_conns == false) {
+        /* reschedule in 10ms if we need to keep polling */
+        evtimer_set(&me->listen_retry_event, thread_maxconns_handler, me);
+        event_base_set(me->base, &me->listen_retry_event);
+        evtimer_add(&me->listen_retry_event, &t);
+    } else {
+        evtimer_del(&me->listen_retry_event);
+        thread_accept_new_conns(me, true);
+    }
+}
+
+/*
+ * Sets whether a worker thread accepts on its SO_REUSEPORT listeners. Only
+ * ever called from that thread, so unlike accept_new_conns() it never has to
+ * touch another thread's events. The other workers' listeners stay open and
+ * the kernel keeps sending them connections.
+ */
+void thread_accept_new_conns(LIBEVENT_THREAD *me, const bool do_accept) {
+    conn *next;
+
+    for (next = me->listeners; next; next = next->next) {
+        if (do_accept) {
+            update_event(next, EV_READ | EV_PERSIST);
+        } else {
+            update_event(next, 0);
+        }
+    }
+
+    if (!do_accept) {
+        STATS_LOCK();
+        stats.listen_disabled_num++;
+        STATS_UNLOCK();
+        pthread_mutex_lock(&conn_lock);
+        allow_new_conns = false;
+        pthread_mutex_unlock(&conn_lock);
+        thread_maxconns_handler(-42, 0, me);
+    }
+}
+
 /*
  * Transmit the next chunk of data from our list of msgbuf structures.
  *
@@ -3699,9 +4552,7 @@ static enum transmit_result transmit(conn *c) {
 
         res = sendmsg(c->sfd, m, 0);
         if (res > 0) {
-            pthread_mutex_lock(&c->thread->stats.mutex);
             c->thread->stats.bytes_written += res;
-            pthread_mutex_unlock(&c->thread->stats.mutex);
 
             /* We've written some of the data. Remove the completed
                iovec entries from the list of pending writes. */
@@ -3766,7 +4617,11 @@ static void drive_machine(conn *c) {
                 } else if (errno == EMFILE) {
                     if (settings.verbose > 0)
                         fprintf(stderr, "Too many open connections\n");
-                    accept_new_conns(false);
+                    if (c->thread != NULL) {
+                        thread_accept_new_conns(c->thread, false);
+                    } else {
+                        accept_new_conns(false);
+                    }
                     stop = true;
                 } else {
                     perror("accept()");
@@ -3782,13 +4637,28 @@ static void drive_machine(conn *c) {
             }
 
             if (settings.maxconns_fast &&
-                stats.curr_conns + stats.reserved_fds >= settings.maxconns - 1) {
+                threadlocal_curr_conns() + stats.reserved_fds >= settings.maxconns - 1) {
                 str = "ERROR Too many open connections\r\n";
                 res = write(sfd, str, strlen(str));
                 close(sfd);
                 STATS_LOCK();
                 stats.rejected_conns++;
                 STATS_UNLOCK();
+            } else if (c->thread != NULL) {
+                /* One of a worker's own SO_REUSEPORT listeners; the new
+                 * connection stays on this thread. */
+                conn *nc = conn_new(sfd, conn_new_cmd, EV_READ | EV_PERSIST,
+                                    DATA_BUFFER_SIZE, tcp_transport,
+                                    c->thread->base);
+                if (nc == NULL) {
+                    if (settings.verbose > 0)
+                        fprintf(stderr, "Can't listen for events on fd %d\n", sfd);
+                    close(sfd);
+                } else {
+                    nc->thread = c->thread;
+                    c->thread->stats.accepted_conns++;
+                    c->thread->stats.curr_conns++;
+                }
             } else {
                 dispatch_conn_new(sfd, conn_new_cmd, EV_READ | EV_PERSIST,
                                      DATA_BUFFER_SIZE, tcp_transport);
@@ -3844,9 +4714,7 @@ static void drive_machine(conn *c) {
             if (nreqs >= 0) {
                 reset_cmd_handler(c);
             } else {
-                pthread_mutex_lock(&c->thread->stats.mutex);
                 c->thread->stats.conn_yields++;
-                pthread_mutex_unlock(&c->thread->stats.mutex);
                 if (c->rbytes > 0) {
                     /* We have already read in data into the input buffer,
                        so libevent will most likely not signal read events
@@ -3887,9 +4755,7 @@ static void drive_machine(conn *c) {
             /*  now try reading from the socket */
             res = read(c->sfd, c->ritem, c->rlbytes);
             if (res > 0) {
-                pthread_mutex_lock(&c->thread->stats.mutex);
                 c->thread->stats.bytes_read += res;
-                pthread_mutex_unlock(&c->thread->stats.mutex);
                 if (c->rcurr == c->ritem) {
                     c->rcurr += res;
                 }
@@ -3942,9 +4808,7 @@ static void drive_machine(conn *c) {
             /*  now try reading from the socket */
             res = read(c->sfd, c->rbuf, c->rsize > c->sbytes ? c->sbytes : c->rsize);
             if (res > 0) {
-                pthread_mutex_lock(&c->thread->stats.mutex);
                 c->thread->stats.bytes_read += res;
-                pthread_mutex_unlock(&c->thread->stats.mutex);
                 c->sbytes -= res;
                 break;
             }
@@ -3995,19 +4859,7 @@ static void drive_machine(conn *c) {
             switch (transmit(c)) {
             case TRANSMIT_COMPLETE:
                 if (c->state == conn_mwrite) {
-                    while (c->ileft > 0) {
-                        item *it = *(c->icurr);
-                        assert((it->it_flags & ITEM_SLABBED) == 0);
-                        item_remove(it);
-                        c->icurr++;
-                        c->ileft--;
-                    }
-                    while (c->suffixleft > 0) {
-                        char *suffix = *(c->suffixcurr);
-                        cache_free(c->thread->suffix_cache, suffix);
-                        c->suffixcurr++;
-                        c->suffixleft--;
-                    }
+                    conn_release_get_items(c);
                     /* XXX:  I don't know why this wasn't the general case */
                     if(c->protocol == binary_prot) {
                         conn_set_state(c, c->write_and_go);
@@ -4045,6 +4897,14 @@ static void drive_machine(conn *c) {
             stop = true;
             break;
 
+        case conn_io_wait:
+            /* Nothing to do until the flash reads for the current get are
+             * in; conn_io_done() picks up from there. */
+            event_del(&c->event);
+            c->ev_flags = 0;
+            stop = true;
+            break;
+
         case conn_max_state:
             assert(false);
             break;
@@ -4128,6 +4988,90 @@ static void maximize_sndbuf(const int sfd) {
         fprintf(stderr, "<%d send buffer was %d, now %d\n", sfd, old_size, last_good);
 }
 
+/*
+ * Sets the options every listening socket gets before it is bound.
+ * Returns 0 on success, -1 if the socket can't be used.
+ */
+static int set_socket_options(const int sfd, const struct addrinfo *ai,
+                              enum network_transport transport) {
+    struct linger ling = {0, 0};
+    int flags = 1;
+    int error;
+
+#ifdef IPV6_V6ONLY
+    if (ai->ai_family == AF_INET6) {
+        error = setsockopt(sfd, IPPROTO_IPV6, IPV6_V6ONLY, (char *) &flags, sizeof(flags));
+        if (error != 0) {
+            perror("setsockopt");
+            return -1;
+        }
+    }
+#endif
+
+    setsockopt(sfd, SOL_SOCKET, SO_REUSEADDR, (void *)&flags, sizeof(flags));
+    if (IS_UDP(transport)) {
+        maximize_sndbuf(sfd);
+    } else {
+#ifdef SO_REUSEPORT
+        if (settings.reuseport) {
+            error = setsockopt(sfd, SOL_SOCKET, SO_REUSEPORT, (void *)&flags, sizeof(flags));
+            if (error != 0) {
+                perror("setsockopt(SO_REUSEPORT)");
+                return -1;
+            }
+        }
+#endif
+
+        error = setsockopt(sfd, SOL_SOCKET, SO_KEEPALIVE, (void *)&flags, sizeof(flags));
+        if (error != 0)
+            perror("setsockopt");
+
+        error = setsockopt(sfd, SOL_SOCKET, SO_LINGER, (void *)&ling, sizeof(ling));
+        if (error != 0)
+            perror("setsockopt");
+
+        error = setsockopt(sfd, IPPROTO_TCP, TCP_NODELAY, (void *)&flags, sizeof(flags));
+        if (error != 0)
+            perror("setsockopt");
+    }
+    return 0;
+}
+
+/*
+ * -o reuseport: sfd is bound and listening. Hands it to the first worker
+ * thread, and opens another socket on the same address (and the same port,
+ * should sfd have been given an ephemeral one) for every other worker. The
+ * kernel spreads incoming connections over them.
+ */
+static int server_socket_per_thread(const int sfd, struct addrinfo *ai) {
+    struct sockaddr_storage addr;
+    socklen_t addrlen = sizeof(addr);
+    int t;
+
+    if (getsockname(sfd, (struct sockaddr *)&addr, &addrlen) != 0) {
+        perror("getsockname()");
+        return 1;
+    }
+
+    dispatch_listen_conn(sfd, 0);
+    for (t = 1; t < settings.num_threads; t++) {
+        int tsfd = new_socket(ai);
+        if (tsfd == -1) {
+            perror("server_socket");
+            return 1;
+        }
+        if (set_socket_options(tsfd, ai, tcp_transport) != 0 ||
+            bind(tsfd, (struct sockaddr *)&addr, addrlen) == -1 ||
+            listen(tsfd, settings.backlog) == -1) {
+            perror("SO_REUSEPORT listener");
+            close(tsfd);
+            return 1;
+        }
+        dispatch_listen_conn(tsfd, t);
+    }
+    return 0;
+}
+
 /**
  * Create a socket and bind it to a specific port number
  * @param interface the interface to bind to
@@ -4142,7 +5086,6 @@ static int server_socket(const char *interface,
                          enum network_transport transport,
                          FILE *portnumber_file) {
     int sfd;
-    struct linger ling = {0, 0};
     struct addrinfo *ai;
     struct addrinfo *next;
     struct addrinfo hints = { .ai_flags = AI_PASSIVE,
@@ -4150,7 +5093,6 @@ static int server_socket(const char *interface,
     char port_buf[NI_MAXSERV];
     int error;
     int success = 0;
-    int flags =1;
 
     hints.ai_socktype = IS_UDP(transport) ? SOCK_DGRAM : SOCK_STREAM;
 
@@ -4181,32 +5123,9 @@ static int server_socket(const char *interface,
             continue;
         }
 
-#ifdef IPV6_V6ONLY
-        if (next->ai_family == AF_INET6) {
-            error = setsockopt(sfd, IPPROTO_IPV6, IPV6_V6ONLY, (char *) &flags, sizeof(flags));
-            if (error != 0) {
-                perror("setsockopt");
-                close(sfd);
-                continue;
-            }
-        }
-#endif
-
-        setsockopt(sfd, SOL_SOCKET, SO_REUSEADDR, (void *)&flags, sizeof(flags));
-        if (IS_UDP(transport)) {
-            maximize_sndbuf(sfd);
-        } else {
-            error = setsockopt(sfd, SOL_SOCKET, SO_KEEPALIVE, (void *)&flags, sizeof(flags));
-            if (error != 0)
-                perror("setsockopt");
-
-            error = setsockopt(sfd, SOL_SOCKET, SO_LINGER, (void *)&ling, sizeof(ling));
-            if (error != 0)
-                perror("setsockopt");
-
-            error = setsockopt(sfd, IPPROTO_TCP, TCP_NODELAY, (void *)&flags, sizeof(flags));
-            if (error != 0)
-                perror("setsockopt");
+        if (set_socket_options(sfd, next, transport) != 0) {
+            close(sfd);
+            continue;
         }
 
         if (bind(sfd, next->ai_addr, next->ai_addrlen) == -1) {
@@ -4256,6 +5175,11 @@ static int server_socket(const char *interface,
                 dispatch_conn_new(sfd, conn_read, EV_READ | EV_PERSIST,
                                   UDP_READ_BUFFER_SIZE, transport);
             }
+        } else if (settings.reuseport) {
+            if (server_socket_per_thread(sfd, next) != 0) {
+                freeaddrinfo(ai);
+                return 1;
+            }
         } else {
             if (!(listen_conn_add = conn_new(sfd, conn_listening,
                                              EV_READ | EV_PERSIST, 1,
@@ -4418,12 +5342,13 @@ static void clock_handler(const int fd, const short which, void *arg) {
     } else {
         initialized = true;
         /* process_started is initialized to time() - 2. We initialize to 1 so
-         * flush_all won't underflow during tests. */
+         * flush_all won't underflow during tests. A restart from a memory
+         * file puts it back to when the previous run started. */
 #if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
         struct timespec ts;
         if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0) {
             monotonic = true;
-            monotonic_start = ts.tv_sec - 2;
+            monotonic_start = ts.tv_sec - (time(0) - process_started);
         }
 #endif
     }
@@ -4509,6 +5434,41 @@ static void usage(void) {
            "                table should be. Can be grown at runtime if not big enough.\n"
            "                Set this based on \"STAT hash_power_level\" before a \n"
            "                restart.\n"
+           "              - slab_automove_ratio: The automover moves a page to a\n"
+           "                class that evicts if its oldest items are younger than\n"
+           "                this fraction of the oldest items elsewhere (default: 0.8)\n"
+           "              - lru_maintainer: Split each slab class LRU into hot, warm\n"
+           "                and cold segments, balanced by a background thread.\n"
+           "              - hot_lru_pct: Pct of a slab class's items kept in the hot\n"
+           "                LRU (default: 32)\n"
+           "              - warm_lru_pct: Pct of a slab class's items kept in the warm\n"
+           "                LRU (default: 32)\n"
+           "              - hash_algorithm: The hash table algorithm\n"
+           "                default is jenkins hash. options: jenkins, murmur3, xxh64\n"
+           "              - reuseport: Give every worker thread its own SO_REUSEPORT\n"
+           "                TCP listening socket instead of accepting on the main\n"
+           "                thread and handing connections over\n"
+           "              - memory_file: Keep the item memory in this file (mmap),\n"
+           "                so items survive a restart. Stop with SIGINT, SIGTERM\n"
+           "                or SIGUSR1 and start again with the same settings to\n"
+           "                come back with the cache still warm.\n"
+           "              - ext_path: <file>:<size> (size in k/m/g/t, default m).\n"
+           "                Write the values of large, cold items to this file,\n"
+           "                keeping only their keys in memory. Needs\n"
+           "                lru_maintainer\n"
+           "              - ext_page_size: Size of the pages ext_path is written\n"
+           "                in, in megabytes (default: 64)\n"
+           "              - ext_item_size: Smallest value written to ext_path\n"
+           "                (default: 512)\n"
+           "              - ext_item_age: Write cold items this many seconds old\n"
+           "                to ext_path even with memory to spare (default: only\n"
+           "                when out of memory)\n"
+           "              - ext_threads: Threads reading from ext_path (default: 1)\n"
+           "              - ext_compact_under: Compact ext_path pages with less\n"
+           "                than this percentage still in use (default: 50)\n"
+           "              - ext_recache_rate: Keep every Nth item read from\n"
+           "                ext_path in memory again (default: 2000)\n"
+           "              - latency_stats: Time every command for \"stats latency\"\n"
            );
     return;
 }
@@ -4625,6 +5585,32 @@ static void sig_handler(const int sig) {
     exit(EXIT_SUCCESS);
 }
 
+/*
+ * With -o memory_file, SIGINT, SIGTERM and SIGUSR1 stop the event loop
+ * instead, so main() can save the cache for the next start.
+ */
+static struct event shutdown_events[3];
+static void shutdown_handler(const int sig, const short which, void *arg) {
+    if (settings.verbose > 0)
+        fprintf(stderr, "Signal %d handled, shutting down\n", sig);
+    event_base_loopexit(main_base, NULL);
+}
+
+static void setup_shutdown_events(void) {
+    const int sigs[] = { SIGINT, SIGTERM, SIGUSR1 };
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        event_set(&shutdown_events[i], sigs[i], EV_SIGNAL | EV_PERSIST,
+                  shutdown_handler, NULL);
+        event_base_set(main_base, &shutdown_events[i]);
+        if (event_add(&shutdown_events[i], 0) == -1) {
+            fprintf(stderr, "Failed to handle signal %d\n", sigs[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
 #ifndef HAVE_SIGIGNORE
 static int sigignore(int sig) {
     struct sigaction sa = { .sa_handler = SIG_IGN, .sa_flags = 0 };
@@ -4702,6 +5688,35 @@ static bool sanitycheck(void) {
     return true;
 }
 
+/*
+ * Parses a size like 512k, 64m, 2g or 1t into bytes; a bare number is in
+ * megabytes. Returns false if str isn't one.
+ */
+static bool safe_strtosize(const char *str, uint64_t *out) {
+    char *end;
+    unsigned long long n;
+    int shift;
+
+    errno = 0;
+    n = strtoull(str, &end, 10);
+    if (errno == ERANGE || end == str || strchr(str, '-') != NULL)
+        return false;
+    switch (tolower((unsigned char)*end)) {
+    case 'k': shift = 10; break;
+    case '\0':
+    case 'm': shift = 20; break;
+    case 'g': shift = 30; break;
+    case 't': shift = 40; break;
+    default: return false;
+    }
+    if (*end != '\0' && end[1] != '\0')
+        return false;
+    if (n > (UINT64_MAX >> shift))
+        return false;
+    *out = (uint64_t)n << shift;
+    return true;
+}
+
 int main (int argc, char **argv) {
     int c;
     bool lock_memory = false;
@@ -4730,13 +5745,43 @@ int main (int argc, char **argv) {
         MAXCONNS_FAST = 0,
         HASHPOWER_INIT,
         SLAB_REASSIGN,
-        SLAB_AUTOMOVE
+        SLAB_AUTOMOVE,
+        SLAB_AUTOMOVE_RATIO,
+        LRU_MAINTAINER,
+        HOT_LRU_PCT,
+        WARM_LRU_PCT,
+        HASH_ALGORITHM,
+        REUSEPORT,
+        MEMORY_FILE,
+        EXT_PATH,
+        EXT_PAGE_SIZE,
+        EXT_ITEM_SIZE,
+        EXT_ITEM_AGE,
+        EXT_THREADS,
+        EXT_COMPACT_UNDER,
+        EXT_RECACHE_RATE,
+        LATENCY_STATS
     };
     char *const subopts_tokens[] = {
         [MAXCONNS_FAST] = "maxconns_fast",
         [HASHPOWER_INIT] = "hashpower",
         [SLAB_REASSIGN] = "slab_reassign",
         [SLAB_AUTOMOVE] = "slab_automove",
+        [SLAB_AUTOMOVE_RATIO] = "slab_automove_ratio",
+        [LRU_MAINTAINER] = "lru_maintainer",
+        [HOT_LRU_PCT] = "hot_lru_pct",
+        [WARM_LRU_PCT] = "warm_lru_pct",
+        [HASH_ALGORITHM] = "hash_algorithm",
+        [REUSEPORT] = "reuseport",
+        [MEMORY_FILE] = "memory_file",
+        [EXT_PATH] = "ext_path",
+        [EXT_PAGE_SIZE] = "ext_page_size",
+        [EXT_ITEM_SIZE] = "ext_item_size",
+        [EXT_ITEM_AGE] = "ext_item_age",
+        [EXT_THREADS] = "ext_threads",
+        [EXT_COMPACT_UNDER] = "ext_compact_under",
+        [EXT_RECACHE_RATE] = "ext_recache_rate",
+        [LATENCY_STATS] = "latency_stats",
         NULL
     };
 
@@ -4988,11 +6033,165 @@ int main (int argc, char **argv) {
             case SLAB_AUTOMOVE:
                 settings.slab_automove = true;
                 break;
+            case SLAB_AUTOMOVE_RATIO:
+                if (subopts_value == NULL) {
+                    fprintf(stderr, "Missing slab_automove_ratio argument\n");
+                    return 1;
+                }
+                settings.slab_automove_ratio = atof(subopts_value);
+                if (settings.slab_automove_ratio <= 0 ||
+                    settings.slab_automove_ratio > 1) {
+                    fprintf(stderr, "slab_automove_ratio must be > 0 and <= 1\n");
+                    return 1;
+                }
+                break;
+            case LRU_MAINTAINER:
+                settings.lru_maintainer_thread = true;
+                break;
+            case HOT_LRU_PCT:
+                if (subopts_value == NULL) {
+                    fprintf(stderr, "Missing hot_lru_pct argument\n");
+                    return 1;
+                }
+                settings.hot_lru_pct = atoi(subopts_value);
+                if (settings.hot_lru_pct < 1 || settings.hot_lru_pct >= 80) {
+                    fprintf(stderr, "hot_lru_pct must be > 1 and < 80\n");
+                    return 1;
+                }
+                break;
+            case WARM_LRU_PCT:
+                if (subopts_value == NULL) {
+                    fprintf(stderr, "Missing warm_lru_pct argument\n");
+                    return 1;
+                }
+                settings.warm_lru_pct = atoi(subopts_value);
+                if (settings.warm_lru_pct < 1 || settings.warm_lru_pct >= 80) {
+                    fprintf(stderr, "warm_lru_pct must be > 1 and < 80\n");
+                    return 1;
+                }
+                break;
+            case HASH_ALGORITHM: {
+                enum hashfunc_type type;
+                if (subopts_value == NULL) {
+                    fprintf(stderr, "Missing hash_algorithm argument\n");
+                    return 1;
+                }
+                if (hash_type_by_name(subopts_value, &type) != 0) {
+                    fprintf(stderr, "Unknown hash_algorithm \"%s\"\n", subopts_value);
+                    return 1;
+                }
+                settings.hash_algorithm = type;
+                break;
+            }
+            case REUSEPORT:
+#ifdef SO_REUSEPORT
+                settings.reuseport = true;
+                break;
+#else
+                fprintf(stderr, "This system does not support SO_REUSEPORT\n");
+                return 1;
+#endif
+            case MEMORY_FILE:
+                if (subopts_value == NULL) {
+                    fprintf(stderr, "Missing memory_file argument\n");
+                    return 1;
+                }
+                settings.memory_file = strdup(subopts_value);
+                break;
+            case EXT_PATH: {
+                char *size;
+                if (subopts_value == NULL ||
+                    (size = strrchr(subopts_value, ':')) == NULL) {
+                    fprintf(stderr, "ext_path needs <file>:<size>\n");
+                    return 1;
+                }
+                *size++ = '\0';
+                if (!safe_strtosize(size, &settings.ext_size) ||
+                    settings.ext_size == 0) {
+                    fprintf(stderr, "Bad ext_path size \"%s\"\n", size);
+                    return 1;
+                }
+                settings.ext_path = strdup(subopts_value);
+                break;
+            }
+            case EXT_PAGE_SIZE:
+                if (subopts_value == NULL) {
+                    fprintf(stderr, "Missing ext_page_size argument\n");
+                    return 1;
+                }
+                if (atoi(subopts_value) < 1 || atoi(subopts_value) > 1024) {
+                    fprintf(stderr, "ext_page_size must be 1 to 1024 (megabytes)\n");
+                    return 1;
+                }
+                settings.ext_page_size = atoi(subopts_value) * 1024 * 1024;
+                break;
+            case EXT_ITEM_SIZE:
+                if (subopts_value == NULL) {
+                    fprintf(stderr, "Missing ext_item_size argument\n");
+                    return 1;
+                }
+                settings.ext_item_size = atoi(subopts_value);
+                if (settings.ext_item_size < 1) {
+                    fprintf(stderr, "ext_item_size must be at least 1\n");
+                    return 1;
+                }
+                break;
+            case EXT_ITEM_AGE: {
+                uint32_t age;
+                if (subopts_value == NULL ||
+                    !safe_strtoul(subopts_value, &age)) {
+                    fprintf(stderr, "Missing or bad ext_item_age argument\n");
+                    return 1;
+                }
+                settings.ext_item_age = age;
+                break;
+            }
+            case EXT_THREADS:
+                if (subopts_value == NULL) {
+                    fprintf(stderr, "Missing ext_threads argument\n");
+                    return 1;
+                }
+                settings.ext_threads = atoi(subopts_value);
+                if (settings.ext_threads < 1 || settings.ext_threads > 64) {
+                    fprintf(stderr, "ext_threads must be 1 to 64\n");
+                    return 1;
+                }
+                break;
+            case EXT_COMPACT_UNDER:
+                if (subopts_value == NULL) {
+                    fprintf(stderr, "Missing ext_compact_under argument\n");
+                    return 1;
+                }
+                settings.ext_compact_under = atoi(subopts_value);
+                if (settings.ext_compact_under < 1 ||
+                    settings.ext_compact_under > 100) {
+                    fprintf(stderr, "ext_compact_under must be 1 to 100\n");
+                    return 1;
+                }
+                break;
+            case EXT_RECACHE_RATE:
+                if (subopts_value == NULL) {
+                    fprintf(stderr, "Missing ext_recache_rate argument\n");
+                    return 1;
+                }
+                settings.ext_recache_rate = atoi(subopts_value);
+                if (settings.ext_recache_rate < 0) {
+                    fprintf(stderr, "ext_recache_rate can't be negative\n");
+                    return 1;
+                }
+                break;
+            case LATENCY_STATS:
+                settings.latency_stats = true;
+                break;
             default:
                 printf("Illegal suboption \"%s\"\n", subopts_value);
                 return 1;
             }
 
+            }
+            if (settings.hot_lru_pct + settings.warm_lru_pct > 80) {
+                fprintf(stderr, "hot_lru_pct + warm_lru_pct cannot be more than 80%% combined\n");
+                return 1;
             }
             break;
         default:
@@ -5022,6 +6221,26 @@ int main (int argc, char **argv) {
         }
     }
 
+    if (settings.ext_path != NULL) {
+        /* Items go to flash from the COLD tail, which the maintainer runs */
+        if (!settings.lru_maintainer_thread) {
+            fprintf(stderr, "ERROR: ext_path needs -o lru_maintainer\n");
+            exit(EX_USAGE);
+        }
+        if (settings.memory_file != NULL) {
+            fprintf(stderr, "ERROR: ext_path can't be used with memory_file\n");
+            exit(EX_USAGE);
+        }
+        if ((unsigned int)settings.item_size_max > settings.ext_page_size) {
+            fprintf(stderr, "ERROR: item_size_max can't be larger than ext_page_size\n");
+            exit(EX_USAGE);
+        }
+        if (settings.ext_size / settings.ext_page_size < 2) {
+            fprintf(stderr, "ERROR: ext_path must hold at least two ext_page_size pages\n");
+            exit(EX_USAGE);
+        }
+    }
+
     if (tcp_specified && !udp_specified) {
         settings.udpport = settings.port;
     } else if (udp_specified && !tcp_specified) {
@@ -5121,6 +6340,7 @@ int main (int argc, char **argv) {
     main_base = event_init();
 
     /* initialize other stuff */
+    hash_init(settings.hash_algorithm);
     stats_init();
     assoc_init(settings.hashpower_init);
     conn_init();
@@ -5137,6 +6357,15 @@ int main (int argc, char **argv) {
     /* start up worker threads if MT mode */
     thread_init(settings.num_threads, main_base);
 
+    if (settings.ext_path != NULL && storage_init() != 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    if (settings.memory_file != NULL) {
+        restart_restore();
+        setup_shutdown_events();
+    }
+
     if (start_assoc_maintenance_thread() == -1) {
         exit(EXIT_FAILURE);
     }
@@ -5146,6 +6375,11 @@ int main (int argc, char **argv) {
         exit(EXIT_FAILURE);
     }
 
+    if (settings.lru_maintainer_thread &&
+        start_lru_maintainer_thread() == -1) {
+        exit(EXIT_FAILURE);
+    }
+
     /* initialise clock event */
     clock_handler(0, 0, 0);
 
@@ -5208,7 +6442,7 @@ int main (int argc, char **argv) {
      * is only an advisory.
      */
     usleep(1000);
-    if (stats.curr_conns + stats.reserved_fds >= settings.maxconns - 1) {
+    if (threadlocal_curr_conns() + stats.reserved_fds >= settings.maxconns - 1) {
         fprintf(stderr, "Maxconns setting is too low, use -c to increase.\n");
         exit(EXIT_FAILURE);
     }
@@ -5226,6 +6460,15 @@ int main (int argc, char **argv) {
     }
 
     stop_assoc_maintenance_thread();
+    if (settings.lru_maintainer_thread)
+        stop_lru_maintainer_thread();
+    if (settings.ext_path != NULL)
+        stop_storage_compact_thread();
+    if (settings.memory_file != NULL) {
+        if (settings.slab_reassign)
+            stop_slab_maintenance_thread();
+        restart_save();
+    }
 
     /* remove the PID file if we're a daemon */
     if (do_daemonize)
@@ -38,6 +38,9 @@
  * Plus a few for spaces, \r\n, \0 */
 #define SUFFIX_SIZE 24
 
+/* Longest opaque token a meta command can carry ("O" flag) */
+#define META_OPAQUE_MAX 32
+
 /** Initial size of list of items being returned by "get". */
 #define ITEM_LIST_INITIAL 200
 
@@ -151,6 +154,7 @@ enum conn_states {
     conn_swallow,    /**< swallowing unnecessary bytes w/o storing */
     conn_closing,    /**< closing this connection */
     conn_mwrite,     /**< writing out many items sequentially */
+    conn_io_wait,    /**< waiting on flash reads for a get (-o ext_path) */
     conn_max_state   /**< Max state value (used for assertion) */
 };
 
@@ -213,11 +217,25 @@ struct slab_stats {
     uint64_t  decr_hits;
 };
 
+/* Command groups timed for "stats latency" (-o latency_stats). */
+enum latency_class {
+    LAT_GET, LAT_SET, LAT_CAS, LAT_DELETE, LAT_INCR, LAT_DECR, LAT_TOUCH,
+    LAT_OTHER, LATENCY_CLASSES
+};
+
+/* Microsecond latency histogram: one bucket per value below 16, then 8 per
+ * power of two up to 2^32. */
+#define LATENCY_BUCKETS (16 + 28 * 8)
+
+#define CACHE_LINE_SIZE 64
+
 /**
- * Stats stored per-thread.
+ * Stats stored per-thread. Only the owning worker thread writes them, so
+ * they're updated without locks and summed when a client asks. Everything
+ * here is a uint64_t; on 32-bit systems a reader may see a counter
+ * mid-update.
  */
 struct thread_stats {
-    pthread_mutex_t   mutex;
     uint64_t          get_cmds;
     uint64_t          get_misses;
     uint64_t          touch_cmds;
@@ -232,7 +250,15 @@ struct thread_stats {
     uint64_t          conn_yields; /* # of yields for connections (-R option)*/
     uint64_t          auth_cmds;
     uint64_t          auth_errors;
+    uint64_t          accepted_conns; /* accepted on this thread's own listener */
+    uint64_t          dispatched_conns; /* handed over by the dispatcher */
+    uint64_t          curr_conns;  /* client connections open on this thread */
+    uint64_t          total_conns; /* connections made on this thread */
+    uint64_t          open_conns;  /* of those, still open, less any closed
+                                      here that were made elsewhere */
     struct slab_stats slab_stats[MAX_NUMBER_OF_SLAB_CLASSES];
+    uint64_t          latency_us[LATENCY_CLASSES]; /* summed */
+    uint64_t          latency[LATENCY_CLASSES][LATENCY_BUCKETS];
 };
 
 /**
@@ -267,6 +293,7 @@ struct stats {
     uint64_t      evicted_unfetched; /* items evicted but never touched */
     bool          slab_reassign_running; /* slab reassign in progress */
     uint64_t      slabs_moved;       /* times slabs were moved around */
+    uint64_t      lru_maintainer_juggles; /* number of LRU bg pokes */
 };
 
 #define MAX_VERBOSITY_LEVEL 2
@@ -302,7 +329,23 @@ struct settings {
     bool maxconns_fast;     /* Whether or not to early close connections */
     bool slab_reassign;     /* Whether or not slab reassignment is allowed */
     bool slab_automove;     /* Whether or not to automatically move slabs */
+    double slab_automove_ratio; /* how much younger a tail has to be to win a page */
     int hashpower_init;     /* Starting hash power level */
+    bool lru_maintainer_thread; /* segmented LRU with a background mover */
+    int hot_lru_pct;        /* percentage of a class's items kept in HOT_LRU */
+    int warm_lru_pct;       /* percentage of a class's items kept in WARM_LRU */
+    int hash_algorithm;     /* enum hashfunc_type; see hash.h */
+    bool reuseport;         /* each worker thread accepts on its own socket */
+    char *memory_file;      /* slab arena file to restart from (restart.c) */
+    char *ext_path;         /* flash file for cold item values (storage.c) */
+    uint64_t ext_size;      /* size of the ext_path file */
+    unsigned int ext_page_size; /* ext_path is written a page at a time */
+    int ext_item_size;      /* smallest value worth writing to flash */
+    unsigned int ext_item_age; /* write COLD items this old even with memory to spare */
+    int ext_threads;        /* IO threads reading from flash */
+    int ext_compact_under;  /* compact flash pages less than this % live */
+    int ext_recache_rate;   /* every Nth flash hit goes back into memory */
+    bool latency_stats;     /* time commands for "stats latency" */
 };
 
 extern struct stats stats;
@@ -316,6 +359,14 @@ extern struct settings settings;
 #define ITEM_SLABBED 4
 
 #define ITEM_FETCHED 8
+/* Appended on fetch, removed on LRU shuffling */
+#define ITEM_ACTIVE 16
+/* The value is on flash; ITEM_data holds an item_hdr (see storage.c) */
+#define ITEM_HDR 32
+/* Invalidated with "md <key> I"; served until someone refreshes it */
+#define ITEM_STALE 64
+/* A meta get told a client to refresh it ("W" flag) */
+#define ITEM_TOKEN_SENT 128
 
 /**
  * Structure for storing items within memcached.
@@ -332,6 +383,7 @@ typedef struct _stritem {
     uint8_t         it_flags;   /* ITEM_* above */
     uint8_t         slabs_clsid;/* which slab class we're in */
     uint8_t         nkey;       /* key length, w/terminating null and padding */
+    uint8_t         lru;        /* which LRU segment (HOT/WARM/COLD) we're in */
     /* this odd type prevents type-punning issues when we do
      * the little shuffle to save space when not using CAS. */
     union {
@@ -350,9 +402,17 @@ typedef struct {
     struct event notify_event;  /* listen event for notify pipe */
     int notify_receive_fd;      /* receiving end of notify pipe */
     int notify_send_fd;         /* sending end of notify pipe */
+    char stats_pad[CACHE_LINE_SIZE]; /* keep stats off shared cache lines */
     struct thread_stats stats;  /* Stats generated by this thread */
+    char stats_pad_end[CACHE_LINE_SIZE];
     struct conn_queue *new_conn_queue; /* queue of new connections to handle */
     cache_t *suffix_cache;      /* suffix cache */
+    volatile unsigned int lookups; /* odd while in a lock-free item lookup */
+    struct conn *listeners;     /* SO_REUSEPORT listeners (-o reuseport) */
+    struct event listen_retry_event; /* polls to resume them after EMFILE */
+    cache_t *io_cache;          /* io_wraps for flash reads (-o ext_path) */
+    pthread_mutex_t io_lock;    /* protects io_done */
+    struct _io_wrap *io_done;   /* flash reads done, for the worker to finish */
 } LIBEVENT_THREAD;
 
 typedef struct {
@@ -450,6 +510,15 @@ struct conn {
     int keylen;
     conn   *next;     /* Used for generating a list of conn structures */
     LIBEVENT_THREAD *thread; /* Pointer to the thread object serving this connection */
+    struct _io_wrap *io_queue; /* flash reads of the current get, not submitted yet */
+    int    io_pending; /* flash reads the current get is waiting on */
+    uint64_t cmd_start; /* when the current command began (us), 0 if untimed */
+    int    cmd_class;  /* its latency_class */
+    /* for an ms (meta set) waiting on its value */
+    bool   meta;       /* answer the store in the meta format */
+    bool   meta_quiet; /* leave out the answer if it's HD */
+    char   meta_ret[4]; /* flags to answer with, as asked: O, k and c */
+    char   meta_opaque[META_OPAQUE_MAX + 1];
 };
 
 
@@ -497,6 +566,9 @@ static inline int mutex_lock(pthread_mutex_t *mutex)
 #include "items.h"
 #include "trace.h"
 #include "hash.h"
+#include "restart.h"
+#include "extstore.h"
+#include "storage.h"
 #include "util.h"
 
 /*
@@ -509,6 +581,8 @@ static inline int mutex_lock(pthread_mutex_t *mutex)
 void thread_init(int nthreads, struct event_base *main_base);
 int  dispatch_event_add(int thread, conn *c);
 void dispatch_conn_new(int sfd, enum conn_states init_state, int event_flags, int read_buffer_size, enum network_transport transport);
+void dispatch_listen_conn(int sfd, int tid);
+void thread_accept_new_conns(LIBEVENT_THREAD *me, const bool do_accept);
 
 /* Lock wrappers for cache functions that are called from main loop. */
 enum delta_result_type add_delta(conn *c, const char *key,
@@ -523,7 +597,9 @@ item *item_alloc(char *key, size_t nkey, int flags, rel_time_t exptime, int nbyt
 char *item_cachedump(const unsigned int slabs_clsid, const unsigned int limit, unsigned int *bytes);
 void  item_flush_expired(void);
 item *item_get(const char *key, const size_t nkey);
+void  item_get_batch(char **keys, const size_t *nkeys, item **items, const int count);
 item *item_touch(const char *key, const size_t nkey, uint32_t exptime);
+item *item_load(item *it);
 int   item_link(item *it);
 void  item_remove(item *it);
 int   item_replace(item *it, item *new_it, const uint32_t hv);
@@ -533,14 +609,33 @@ void  item_unlink(item *it);
 void  item_update(item *it);
 
 void item_lock(uint32_t hv);
+void *item_trylock(uint32_t hv);
+void item_trylock_unlock(void *arg);
 void item_unlock(uint32_t hv);
+void item_lock_all(void);
+void item_unlock_all(void);
+unsigned int item_seq_read(uint32_t hv);
+bool item_seq_changed(uint32_t hv, unsigned int seq);
+void item_seq_write_begin(uint32_t hv);
+void item_seq_write_end(uint32_t hv);
+void item_quiesce_lookups(void);
 unsigned short refcount_incr(unsigned short *refcount);
+unsigned short refcount_incr_nonzero(unsigned short *refcount);
 unsigned short refcount_decr(unsigned short *refcount);
 void STATS_LOCK(void);
 void STATS_UNLOCK(void);
 void threadlocal_stats_reset(void);
 void threadlocal_stats_aggregate(struct thread_stats *stats);
+void threadlocal_stats_threads(ADD_STAT add_stats, void *c);
+void threadlocal_stats_latency(ADD_STAT add_stats, void *c);
+void threadlocal_latency_record(LIBEVENT_THREAD *me, const int cls,
+                                const uint64_t us);
+void threadlocal_conn_opened(void);
+void threadlocal_conn_closed(void);
+unsigned int threadlocal_curr_conns(void);
 void slab_stats_aggregate(struct thread_stats *stats, struct slab_stats *out);
+void thread_io_submit(io_wrap *io);
+void conn_io_done(io_wrap *io);
 
 /* Stat processing functions */
 void append_stat(const char *name, ADD_STAT add_stats, conn *c,
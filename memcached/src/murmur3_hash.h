@@ -0,0 +1,6 @@
+#ifndef MURMURHASH3_H
+#define MURMURHASH3_H
+
+uint32_t murmur3_hash(const void *key, size_t length, const uint32_t seed);
+
+#endif /* MURMURHASH3_H */
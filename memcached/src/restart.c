@@ -0,0 +1,294 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * Restartable cache (-o memory_file=<path>).
+ *
+ * The slab arena lives in a file mapped with MAP_SHARED instead of malloc()ed
+ * memory, so the items in it outlive the process. On a graceful shutdown the
+ * workers are stopped and <path>.meta records which slab class every page
+ * belongs to, along with the settings the arena layout depends on. The next
+ * start with the same file and settings walks every page and links the items
+ * it finds back into the hash table and the LRUs, CAS values and expiry times
+ * intact. A missing, stale or mismatched metadata file means a cold start.
+ *
+ * Item headers only hold pointers the restore rebuilds (hash chains, LRU
+ * links), so the file may be mapped somewhere else the next time around.
+ */
+#include "memcached.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Bump when the metadata or the item layout changes */
+#define RESTART_FORMAT 1
+
+struct restart_meta {
+    int format;
+    char version[64];
+    unsigned long long memory_size;
+    int item_size_max;
+    int chunk_size;
+    double factor;
+    int use_cas;
+    unsigned int item_header;
+    long long process_started;
+    unsigned int oldest_live;
+    unsigned long long cas_id;
+    unsigned int npages;
+    unsigned char *classes;     /* slab class of each page */
+    bool complete;              /* got as far as the "end" line */
+};
+
+static void *mmap_base = NULL;
+static size_t mmap_size = 0;
+
+static void meta_path(char *buf, const size_t len, const char *suffix) {
+    snprintf(buf, len, "%s.meta%s", settings.memory_file, suffix);
+}
+
+/*
+ * Maps the arena file, creating it or changing its size as needed. Returns
+ * NULL on failure.
+ */
+void *restart_mmap(const char *path, const size_t size) {
+    struct stat st;
+    void *base;
+    int fd;
+
+    if ((fd = open(path, O_RDWR | O_CREAT, 0600)) == -1) {
+        fprintf(stderr, "Failed to open memory file %s: %s\n",
+                path, strerror(errno));
+        return NULL;
+    }
+    if (fstat(fd, &st) != 0 ||
+        (st.st_size != (off_t)size && ftruncate(fd, (off_t)size) != 0)) {
+        fprintf(stderr, "Failed to size memory file %s: %s\n",
+                path, strerror(errno));
+        close(fd);
+        return NULL;
+    }
+
+    base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "Failed to map memory file %s: %s\n",
+                path, strerror(errno));
+        return NULL;
+    }
+
+    mmap_base = base;
+    mmap_size = size;
+    return base;
+}
+
+static int read_meta(FILE *f, struct restart_meta *m) {
+    char line[256];
+
+    while (fgets(line, sizeof(line), f) != NULL) {
+        char *val = strchr(line, ' ');
+        if (val == NULL) {
+            if (strcmp(line, "end\n") == 0) {
+                m->complete = true;
+                continue;
+            }
+            return -1;
+        }
+        *val++ = '\0';
+        val[strcspn(val, "\n")] = '\0';
+
+        if (strcmp(line, "format") == 0) {
+            m->format = atoi(val);
+        } else if (strcmp(line, "version") == 0) {
+            snprintf(m->version, sizeof(m->version), "%s", val);
+        } else if (strcmp(line, "memory_size") == 0) {
+            m->memory_size = strtoull(val, NULL, 10);
+        } else if (strcmp(line, "item_size_max") == 0) {
+            m->item_size_max = atoi(val);
+        } else if (strcmp(line, "chunk_size") == 0) {
+            m->chunk_size = atoi(val);
+        } else if (strcmp(line, "factor") == 0) {
+            m->factor = strtod(val, NULL);
+        } else if (strcmp(line, "use_cas") == 0) {
+            m->use_cas = atoi(val);
+        } else if (strcmp(line, "item_header") == 0) {
+            m->item_header = strtoul(val, NULL, 10);
+        } else if (strcmp(line, "process_started") == 0) {
+            m->process_started = strtoll(val, NULL, 10);
+        } else if (strcmp(line, "oldest_live") == 0) {
+            m->oldest_live = strtoul(val, NULL, 10);
+        } else if (strcmp(line, "cas_id") == 0) {
+            m->cas_id = strtoull(val, NULL, 10);
+        } else if (strcmp(line, "pages") == 0) {
+            if (m->classes != NULL)
+                return -1;
+            m->npages = strtoul(val, NULL, 10);
+            if ((m->classes = calloc(m->npages + 1, 1)) == NULL)
+                return -1;
+        } else if (strcmp(line, "page") == 0) {
+            unsigned int page, clsid;
+            if (sscanf(val, "%u %u", &page, &clsid) != 2 ||
+                m->classes == NULL || page >= m->npages ||
+                clsid >= MAX_NUMBER_OF_SLAB_CLASSES) {
+                return -1;
+            }
+            m->classes[page] = clsid;
+        } else {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* The arena can only be reused if it is laid out the way we would lay it out */
+static bool meta_matches(const struct restart_meta *m) {
+    return m->complete &&
+        m->format == RESTART_FORMAT &&
+        strcmp(m->version, VERSION) == 0 &&
+        m->memory_size == (unsigned long long)settings.maxbytes &&
+        m->item_size_max == settings.item_size_max &&
+        m->chunk_size == settings.chunk_size &&
+        m->factor == settings.factor &&
+        m->use_cas == (settings.use_cas ? 1 : 0) &&
+        m->item_header == sizeof(item) &&
+        m->classes != NULL;
+}
+
+/*
+ * Called once at startup, after slabs_init() has mapped the arena and before
+ * any connection is accepted. Returns the number of items restored, 0 for a
+ * cold start.
+ */
+int restart_restore(void) {
+    char path[PATH_MAX];
+    struct restart_meta m;
+    item **items = NULL;
+    time_t old_started = process_started;
+    FILE *f;
+    bool ok;
+    int count;
+
+    meta_path(path, sizeof(path), "");
+    if ((f = fopen(path, "r")) == NULL) {
+        if (errno != ENOENT) {
+            fprintf(stderr, "Failed to open %s: %s\n", path, strerror(errno));
+        }
+        return 0;
+    }
+
+    memset(&m, 0, sizeof(m));
+    ok = read_meta(f, &m) == 0 && meta_matches(&m);
+    fclose(f);
+    /* The arena starts changing now; a crash later on must not make the
+     * next start trust this file. */
+    unlink(path);
+
+    if (!ok) {
+        fprintf(stderr, "Ignoring stale or mismatched %s, starting cold\n",
+                path);
+        free(m.classes);
+        return 0;
+    }
+
+    /* Items hold times relative to process_started; keep the old epoch so
+     * they keep their meaning, including expiry during the downtime. */
+    process_started = (time_t)m.process_started;
+    current_time = (rel_time_t)(time(0) - process_started);
+    settings.oldest_live = m.oldest_live;
+
+    count = slabs_restore(m.classes, m.npages, &items);
+    free(m.classes);
+    if (count < 0) {
+        fprintf(stderr, "Failed to restore slab pages, starting cold\n");
+        process_started = old_started;
+        current_time = (rel_time_t)(time(0) - process_started);
+        settings.oldest_live = 0;
+        return 0;
+    }
+
+    count = items_restore(items, count, m.cas_id);
+    free(items);
+
+    if (settings.verbose > 0) {
+        fprintf(stderr, "Restored %d items from %s\n",
+                count, settings.memory_file);
+    }
+    return count;
+}
+
+/*
+ * Graceful shutdown, after the event loop and the maintenance threads have
+ * stopped. Freezes the workers, flushes the arena to disk and writes the
+ * metadata for the next start. The item locks are never given back; the
+ * process is about to exit.
+ */
+void restart_save(void) {
+    char path[PATH_MAX];
+    char tmp[PATH_MAX];
+    unsigned char *classes;
+    int npages, i;
+    FILE *f;
+    int failed;
+
+    /* Workers block on the next item they touch. */
+    item_lock_all();
+
+    if ((npages = slabs_page_classes(&classes)) < 0) {
+        fprintf(stderr, "Failed to save slab page list\n");
+        return;
+    }
+
+    meta_path(path, sizeof(path), "");
+    meta_path(tmp, sizeof(tmp), ".tmp");
+    if ((f = fopen(tmp, "w")) == NULL) {
+        fprintf(stderr, "Failed to write %s: %s\n", tmp, strerror(errno));
+        free(classes);
+        return;
+    }
+
+    fprintf(f, "format %d\n", RESTART_FORMAT);
+    fprintf(f, "version %s\n", VERSION);
+    fprintf(f, "memory_size %llu\n", (unsigned long long)settings.maxbytes);
+    fprintf(f, "item_size_max %d\n", settings.item_size_max);
+    fprintf(f, "chunk_size %d\n", settings.chunk_size);
+    fprintf(f, "factor %.17g\n", settings.factor);
+    fprintf(f, "use_cas %d\n", settings.use_cas ? 1 : 0);
+    fprintf(f, "item_header %u\n", (unsigned int)sizeof(item));
+    fprintf(f, "process_started %lld\n", (long long)process_started);
+    fprintf(f, "oldest_live %u\n", settings.oldest_live);
+    fprintf(f, "cas_id %llu\n", (unsigned long long)get_cas_id());
+    fprintf(f, "pages %d\n", npages);
+    for (i = 0; i < npages; i++) {
+        if (classes[i] != 0)
+            fprintf(f, "page %d %u\n", i, classes[i]);
+    }
+    fprintf(f, "end\n");
+    free(classes);
+
+    failed = ferror(f);
+    if (fclose(f) != 0 || failed) {
+        fprintf(stderr, "Failed to write %s\n", tmp);
+        unlink(tmp);
+        return;
+    }
+
+    /* Only let the metadata appear once the items it describes are on disk */
+    if (msync(mmap_base, mmap_size, MS_SYNC) != 0) {
+        perror("msync");
+        unlink(tmp);
+        return;
+    }
+    if (rename(tmp, path) != 0) {
+        fprintf(stderr, "Failed to rename %s: %s\n", tmp, strerror(errno));
+        unlink(tmp);
+        return;
+    }
+
+    if (settings.verbose > 0) {
+        fprintf(stderr, "Saved %s for restart\n", path);
+    }
+}
@@ -0,0 +1,4 @@
+/* Restartable cache (-o memory_file), see restart.c */
+void *restart_mmap(const char *path, const size_t size);
+int restart_restore(void);
+void restart_save(void);
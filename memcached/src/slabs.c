@@ -101,7 +101,15 @@ void slabs_init(const size_t limit, const double factor, const bool prealloc) {
 
     mem_limit = limit;
 
-    if (prealloc) {
+    if (settings.memory_file != NULL) {
+        /* The arena is a mapped file that can outlive us, see restart.c */
+        mem_base = restart_mmap(settings.memory_file, mem_limit);
+        if (mem_base == NULL) {
+            exit(EXIT_FAILURE);
+        }
+        mem_current = mem_base;
+        mem_avail = mem_limit;
+    } else if (prealloc) {
         /* Allocate everything in a big chunk with malloc */
         mem_base = malloc(mem_limit);
         if (mem_base != NULL) {
@@ -191,10 +199,28 @@ static int grow_slab_list (const unsigned int id) {
 
 static int do_slabs_newslab(const unsigned int id) {
     slabclass_t *p = &slabclass[id];
-    int len = settings.slab_reassign ? settings.item_size_max
-        : p->size * p->perslab;
+    /* Pages in a memory file have to sit item_size_max apart, so the
+     * restart code can find them again. */
+    int len = (settings.slab_reassign || settings.memory_file != NULL)
+        ? settings.item_size_max : p->size * p->perslab;
+    slabclass_t *pool = &slabclass[SLAB_GLOBAL_PAGE_POOL];
     char *ptr;
 
+    /* Pages the slab rebalancer reclaimed come first. They are all
+     * item_size_max long, already zeroed, and already counted as malloced. */
+    if (pool->slabs > 0) {
+        if (grow_slab_list(id) == 0) {
+            MEMCACHED_SLABS_SLABCLASS_ALLOCATE_FAILED(id);
+            return 0;
+        }
+        ptr = pool->slab_list[--pool->slabs];
+        p->end_page_ptr = ptr;
+        p->end_page_free = p->perslab;
+        p->slab_list[p->slabs++] = ptr;
+        MEMCACHED_SLABS_SLABCLASS_ALLOCATE(id);
+        return 1;
+    }
+
     if ((mem_limit && mem_malloced + len > mem_limit && p->slabs > 0) ||
         (grow_slab_list(id) == 0) ||
         ((ptr = memory_allocate((size_t)len)) == 0)) {
@@ -250,6 +276,9 @@ static void *do_slabs_alloc(const size_t size, unsigned int id) {
         it = (item *)p->slots;
         p->slots = it->next;
         if (it->next) it->next->prev = 0;
+        /* Kept in sync with the freelist under slabs_lock, for the slab
+         * rebalancer. */
+        it->it_flags &= ~ITEM_SLABBED;
         p->sl_curr--;
         ret = (void *)it;
     } else {
@@ -303,6 +332,95 @@ static void do_slabs_free(void *ptr, const size_t size, unsigned int id) {
     return;
 }
 
+/*
+ * -o memory_file: the slab class of every page carved out of the arena so
+ * far, (*classes)[n] for the n-th page. Returns the number of pages, -1 if
+ * out of memory. The caller frees *classes.
+ */
+int slabs_page_classes(unsigned char **classes) {
+    unsigned int npages, i, id;
+
+    pthread_mutex_lock(&slabs_lock);
+    npages = ((char *)mem_current - (char *)mem_base) / settings.item_size_max;
+    if ((*classes = calloc(npages + 1, 1)) == NULL) {
+        pthread_mutex_unlock(&slabs_lock);
+        return -1;
+    }
+    for (id = POWER_SMALLEST; id <= power_largest; id++) {
+        slabclass_t *p = &slabclass[id];
+        for (i = 0; i < p->slabs; i++) {
+            size_t page = ((char *)p->slab_list[i] - (char *)mem_base)
+                / settings.item_size_max;
+            if (page < npages)
+                (*classes)[page] = id;
+        }
+    }
+    pthread_mutex_unlock(&slabs_lock);
+    return npages;
+}
+
+/*
+ * -o memory_file: rebuilds the slab classes over an arena a previous run left
+ * behind (see restart.c). Page n goes back to class classes[n], or to the
+ * global page pool if that is SLAB_GLOBAL_PAGE_POOL. Chunks that
+ * item_restorable() accepts are handed back in *items (caller frees) for
+ * items_restore(); all others go on their class's freelist. Returns the
+ * number of items, or -1, with nothing changed, if the page list doesn't fit
+ * this arena.
+ */
+int slabs_restore(const unsigned char *classes, const unsigned int npages,
+                  item ***items) {
+    size_t page_size = settings.item_size_max;
+    unsigned int n, i, maxitems = 0;
+    int count = 0;
+    item **list;
+
+    if (mem_base == NULL || (size_t)npages * page_size > mem_limit)
+        return -1;
+    for (n = 0; n < npages; n++) {
+        if (classes[n] > power_largest)
+            return -1;
+        maxitems += slabclass[classes[n]].perslab;
+    }
+    if ((list = malloc(sizeof(item *) * (maxitems + 1))) == NULL)
+        return -1;
+
+    pthread_mutex_lock(&slabs_lock);
+    for (n = 0; n < npages; n++) {
+        unsigned int id = classes[n];
+        slabclass_t *p = &slabclass[id];
+        char *page = (char *)mem_base + (size_t)n * page_size;
+
+        if (grow_slab_list(id) == 0) {
+            fprintf(stderr, "Out of memory restoring slab pages\n");
+            exit(EXIT_FAILURE);
+        }
+        p->slab_list[p->slabs++] = page;
+        if (id == SLAB_GLOBAL_PAGE_POOL) {
+            memset(page, 0, page_size);
+            continue;
+        }
+
+        for (i = 0; i < p->perslab; i++) {
+            item *it = (item *)(page + (size_t)i * p->size);
+            if (item_restorable(it, id, p->size)) {
+                p->requested += ITEM_ntotal(it);
+                list[count++] = it;
+            } else {
+                memset(it, 0, sizeof(item));
+                do_slabs_free(it, 0, id);
+            }
+        }
+    }
+    mem_current = (char *)mem_base + (size_t)npages * page_size;
+    mem_avail = mem_limit - (size_t)npages * page_size;
+    mem_malloced = (size_t)npages * page_size;
+    pthread_mutex_unlock(&slabs_lock);
+
+    *items = list;
+    return count;
+}
+
 static int nz_strcmp(int nzlength, const char *nz, const char *z) {
     int zlength=strlen(z);
     return (zlength == nzlength) && (strncmp(nz, z, zlength) == 0) ? 0 : -1;
@@ -329,6 +447,13 @@ bool get_stats(const char *stat_type, int nkey, ADD_STAT add_stats, void *c) {
             slabs_stats(add_stats, c);
         } else if (nz_strcmp(nkey, stat_type, "sizes") == 0) {
             item_stats_sizes(add_stats, c);
+        } else if (nz_strcmp(nkey, stat_type, "threads") == 0) {
+            threadlocal_stats_threads(add_stats, c);
+        } else if (nz_strcmp(nkey, stat_type, "latency") == 0) {
+            threadlocal_stats_latency(add_stats, c);
+        } else if (nz_strcmp(nkey, stat_type, "extstore") == 0 &&
+                   settings.ext_path != NULL) {
+            storage_stats(add_stats, c);
         } else {
             ret = false;
         }
@@ -445,6 +570,35 @@ void slabs_stats(ADD_STAT add_stats, void *c) {
     pthread_mutex_unlock(&slabs_lock);
 }
 
+unsigned int slabs_global_page_pool(void) {
+    unsigned int pages;
+    pthread_mutex_lock(&slabs_lock);
+    pages = slabclass[SLAB_GLOBAL_PAGE_POOL].slabs;
+    pthread_mutex_unlock(&slabs_lock);
+    return pages;
+}
+
+/*
+ * Whether class id has about run out of room: it can't get another page, and
+ * what's left of its free chunks won't last. Items leave for flash early then
+ * (see lru_ext_write), instead of being evicted.
+ */
+bool slabs_low_memory(const unsigned int id) {
+    slabclass_t *p = &slabclass[id];
+    /* The size do_slabs_newslab() would ask for */
+    int len = (settings.slab_reassign || settings.memory_file != NULL)
+        ? settings.item_size_max : p->size * p->perslab;
+    bool low;
+
+    pthread_mutex_lock(&slabs_lock);
+    low = mem_limit && p->slabs > 0 &&
+        mem_malloced + len > mem_limit &&
+        slabclass[SLAB_GLOBAL_PAGE_POOL].slabs == 0 &&
+        p->sl_curr + p->end_page_free < p->perslab / 2 + 1;
+    pthread_mutex_unlock(&slabs_lock);
+    return low;
+}
+
 void slabs_adjust_mem_requested(unsigned int id, size_t old, size_t ntotal)
 {
     pthread_mutex_lock(&slabs_lock);
@@ -470,12 +624,11 @@ static int slab_rebalance_start(void) {
     slabclass_t *d_cls;
     int no_go = 0;
 
-    pthread_mutex_lock(&cache_lock);
     pthread_mutex_lock(&slabs_lock);
 
     if (slab_rebal.s_clsid < POWER_SMALLEST ||
         slab_rebal.s_clsid > power_largest  ||
-        slab_rebal.d_clsid < POWER_SMALLEST ||
+        slab_rebal.d_clsid < SLAB_GLOBAL_PAGE_POOL ||
         slab_rebal.d_clsid > power_largest  ||
         slab_rebal.s_clsid == slab_rebal.d_clsid)
         no_go = -2;
@@ -493,7 +646,6 @@ static int slab_rebalance_start(void) {
 
     if (no_go != 0) {
         pthread_mutex_unlock(&slabs_lock);
-        pthread_mutex_unlock(&cache_lock);
         return no_go; /* Should use a wrapper function... */
     }
 
@@ -513,7 +665,6 @@ static int slab_rebalance_start(void) {
     }
 
     pthread_mutex_unlock(&slabs_lock);
-    pthread_mutex_unlock(&cache_lock);
 
     STATS_LOCK();
     stats.slab_reassign_running = true;
@@ -523,22 +674,28 @@ static int slab_rebalance_start(void) {
 }
 
 enum move_status {
-    MOVE_PASS=0, MOVE_DONE, MOVE_BUSY
+    MOVE_PASS=0, MOVE_DONE, MOVE_UNLINK, MOVE_BUSY
 };
 
-/* refcount == 0 is safe since nobody can incr while cache_lock is held.
- * refcount != 0 is impossible since flags/etc can be modified in other
- * threads. instead, note we found a busy one and bail. logic in do_item_get
- * will prevent busy items from continuing to be busy
+/* ITEM_SLABBED is only set or cleared under slabs_lock, and a chunk can't be
+ * freed while we hold it, so free chunks are pulled straight off of the
+ * freelist. Linked items are only touched under their item lock, which keeps
+ * do_item_get from handing out new references; refcount == 2 then means
+ * nobody else is using it, though a lock-free lookup can still pin it until
+ * it is unlinked. The item lock is only tried, since slabs_lock
+ * nests inside it. Anything busy (locked, referenced, or allocated but not
+ * linked yet) gets noted and we come back to it on the next pass. logic in
+ * do_item_get will prevent busy items from continuing to be busy
  */
 static int slab_rebalance_move(void) {
     slabclass_t *s_cls;
     int x;
     int was_busy = 0;
     int refcount = 0;
+    uint32_t hv;
+    void *hold_lock;
     enum move_status status = MOVE_PASS;
 
-    pthread_mutex_lock(&cache_lock);
     pthread_mutex_lock(&slabs_lock);
 
     s_cls = &slabclass[slab_rebal.s_clsid];
@@ -546,42 +703,66 @@ static int slab_rebalance_move(void) {
     for (x = 0; x < slab_bulk_check; x++) {
         item *it = slab_rebal.slab_pos;
         status = MOVE_PASS;
+        hv = 0;
+        hold_lock = NULL;
         if (it->slabs_clsid != 255) {
-            refcount = refcount_incr(&it->refcount);
-            if (refcount == 1) { /* item is unlinked, unused */
-                if (it->it_flags & ITEM_SLABBED) {
-                    /* remove from slab freelist */
-                    if (s_cls->slots == it) {
-                        s_cls->slots = it->next;
-                    }
-                    if (it->next) it->next->prev = it->prev;
-                    if (it->prev) it->prev->next = it->next;
-                    s_cls->sl_curr--;
-                    status = MOVE_DONE;
-                } else {
-                    status = MOVE_BUSY;
+            if (it->it_flags & ITEM_SLABBED) {
+                /* remove from slab freelist */
+                if (s_cls->slots == it) {
+                    s_cls->slots = it->next;
                 }
-            } else if (refcount == 2) { /* item is linked but not busy */
-                if ((it->it_flags & ITEM_LINKED) != 0) {
-                    do_item_unlink_nolock(it, hash(ITEM_key(it), it->nkey, 0));
-                    status = MOVE_DONE;
-                } else {
-                    /* refcount == 1 + !ITEM_LINKED means the item is being
-                     * uploaded to, or was just unlinked but hasn't been freed
-                     * yet. Let it bleed off on its own and try again later */
+                if (it->next) it->next->prev = it->prev;
+                if (it->prev) it->prev->next = it->next;
+                s_cls->sl_curr--;
+                status = MOVE_DONE;
+            } else if ((it->it_flags & ITEM_LINKED) != 0) {
+                hv = hash(ITEM_key(it), it->nkey, 0);
+                if ((hold_lock = item_trylock(hv)) == NULL) {
                     status = MOVE_BUSY;
+                } else {
+                    refcount = refcount_incr(&it->refcount);
+                    /* Double check ITEM_LINKED now that we hold the lock */
+                    if (refcount == 2 && (it->it_flags & ITEM_LINKED) != 0) {
+                        status = MOVE_UNLINK;
+                    } else {
+                        if (settings.verbose > 2) {
+                            fprintf(stderr, "Slab reassign hit a busy item: refcount: %d (%d -> %d)\n",
+                                it->refcount, slab_rebal.s_clsid, slab_rebal.d_clsid);
+                        }
+                        refcount_decr(&it->refcount);
+                        item_trylock_unlock(hold_lock);
+                        status = MOVE_BUSY;
+                    }
                 }
             } else {
-                if (settings.verbose > 2) {
-                    fprintf(stderr, "Slab reassign hit a busy item: refcount: %d (%d -> %d)\n",
-                        it->refcount, slab_rebal.s_clsid, slab_rebal.d_clsid);
-                }
+                /* Allocated but not linked: the item is being uploaded to,
+                 * or was just unlinked but hasn't been freed yet. Let it
+                 * bleed off on its own and try again later */
                 status = MOVE_BUSY;
             }
         }
 
         switch (status) {
+            case MOVE_UNLINK:
+                /* Unlinking takes the item's LRU lock, which nests outside
+                 * of slabs_lock. Our reference keeps the chunk from being
+                 * freed while we let go. */
+                pthread_mutex_unlock(&slabs_lock);
+                do_item_unlink(it, hv);
+                item_trylock_unlock(hold_lock);
+                pthread_mutex_lock(&slabs_lock);
+                /* A lock-free reader may have pinned it before the unlink.
+                 * Then it frees the item when it's done, and we find the
+                 * chunk on the freelist on a later pass. */
+                if (refcount_decr(&it->refcount) != 0) {
+                    slab_rebal.busy_items++;
+                    was_busy++;
+                    break;
+                }
+                /* fall through */
             case MOVE_DONE:
+                if ((it->it_flags & ITEM_HDR) != 0)
+                    storage_delete(it);
                 it->refcount = 0;
                 it->it_flags = 0;
                 it->slabs_clsid = 255;
@@ -589,7 +770,6 @@ static int slab_rebalance_move(void) {
             case MOVE_BUSY:
                 slab_rebal.busy_items++;
                 was_busy++;
-                refcount_decr(&it->refcount);
                 break;
             case MOVE_PASS:
                 break;
@@ -611,7 +791,6 @@ static int slab_rebalance_move(void) {
     }
 
     pthread_mutex_unlock(&slabs_lock);
-    pthread_mutex_unlock(&cache_lock);
 
     return was_busy;
 }
@@ -620,7 +799,11 @@ static void slab_rebalance_finish(void) {
     slabclass_t *s_cls;
     slabclass_t *d_cls;
 
-    pthread_mutex_lock(&cache_lock);
+    /* The page is about to be cut into chunks of another size. Wait out any
+     * lock-free lookup that might still be reading an old item header in it.
+     * Those can free items, so this has to happen before taking slabs_lock. */
+    item_quiesce_lookups();
+
     pthread_mutex_lock(&slabs_lock);
 
     s_cls = &slabclass[slab_rebal.s_clsid];
@@ -634,9 +817,12 @@ static void slab_rebalance_finish(void) {
 
     memset(slab_rebal.slab_start, 0, (size_t)settings.item_size_max);
 
+    /* Pages for the global pool wait there until some class runs out */
     d_cls->slab_list[d_cls->slabs++] = slab_rebal.slab_start;
-    d_cls->end_page_ptr = slab_rebal.slab_start;
-    d_cls->end_page_free = d_cls->perslab;
+    if (slab_rebal.d_clsid != SLAB_GLOBAL_PAGE_POOL) {
+        d_cls->end_page_ptr = slab_rebal.slab_start;
+        d_cls->end_page_free = d_cls->perslab;
+    }
 
     slab_rebal.done       = 0;
     slab_rebal.s_clsid    = 0;
@@ -648,7 +834,6 @@ static void slab_rebalance_finish(void) {
     slab_rebalance_signal = 0;
 
     pthread_mutex_unlock(&slabs_lock);
-    pthread_mutex_unlock(&cache_lock);
 
     STATS_LOCK();
     stats.slab_reassign_running = false;
@@ -660,67 +845,87 @@ static void slab_rebalance_finish(void) {
     }
 }
 
-/* Return 1 means a decision was reached.
- * Move to its own thread (created/destroyed as needed) once automover is more
- * complex.
+/* Evictions per second are averaged over about this many seconds */
+#define AUTOMOVE_DECAY 8
+
+/*
+ * Looks for one page to move, once a second. Returns 1 if it found one.
+ *
+ * Once memory is used up, a class holding more than two and a half pages of
+ * free chunks gives a page back to the global page pool, for whichever class
+ * runs out next. Otherwise the page goes from the class whose COLD tail is
+ * oldest, whose items live longest, to the class evicting the most, as long
+ * as the tail of that one is younger by settings.slab_automove_ratio.
+ * Evictions are averaged, so a short burst doesn't pull pages over, but a
+ * change in the mix of value sizes is followed within seconds.
  */
 static int slab_automove_decision(int *src, int *dst) {
     static uint64_t evicted_old[POWER_LARGEST];
-    static unsigned int slab_zeroes[POWER_LARGEST];
-    static unsigned int slab_winner = 0;
-    static unsigned int slab_wins   = 0;
+    static double evict_rate[POWER_LARGEST];
+    static rel_time_t next_run;
     uint64_t evicted_new[POWER_LARGEST];
-    uint64_t evicted_diff = 0;
-    uint64_t evicted_max  = 0;
-    unsigned int highest_slab = 0;
-    unsigned int total_pages[POWER_LARGEST];
+    rel_time_t age[POWER_LARGEST];
+    unsigned int pages[POWER_LARGEST];
+    unsigned int free_pages[POWER_LARGEST];
+    bool movable[POWER_LARGEST];
+    bool evicting[POWER_LARGEST];
+    bool full;
+    double rate_max = 0;
+    rel_time_t age_max = 0;
+    unsigned int free_max = 0;
     int i;
     int source = 0;
     int dest = 0;
-    static rel_time_t next_run;
+    int reclaim = 0;
 
-    /* Run less frequently than the slabmove tester. */
     if (current_time >= next_run) {
-        next_run = current_time + 10;
+        next_run = current_time + 1;
     } else {
         return 0;
     }
 
-    item_stats_evictions(evicted_new);
-    pthread_mutex_lock(&cache_lock);
+    item_stats_automove(evicted_new, age);
+    pthread_mutex_lock(&slabs_lock);
     for (i = POWER_SMALLEST; i < power_largest; i++) {
-        total_pages[i] = slabclass[i].slabs;
+        slabclass_t *p = &slabclass[i];
+        pages[i] = p->slabs;
+        /* Twice over, so 2.5 pages of free chunks count as 5 */
+        free_pages[i] = (p->sl_curr + p->end_page_free) * 2 / p->perslab;
+        movable[i] = p->end_page_ptr == NULL;
     }
-    pthread_mutex_unlock(&cache_lock);
+    full = mem_limit && mem_malloced + settings.item_size_max > mem_limit &&
+        slabclass[SLAB_GLOBAL_PAGE_POOL].slabs == 0;
+    pthread_mutex_unlock(&slabs_lock);
 
-    /* Find a candidate source; something with zero evicts 3+ times */
     for (i = POWER_SMALLEST; i < power_largest; i++) {
-        evicted_diff = evicted_new[i] - evicted_old[i];
-        if (evicted_diff == 0 && total_pages[i] > 2) {
-            slab_zeroes[i]++;
-            if (source == 0 && slab_zeroes[i] >= 3)
+        double evicted = (double)(evicted_new[i] - evicted_old[i]);
+        evicted_old[i] = evicted_new[i];
+        evict_rate[i] += (evicted - evict_rate[i]) / AUTOMOVE_DECAY;
+        evicting[i] = evicted > 0;
+
+        if (evicting[i] && movable[i] && evict_rate[i] > rate_max) {
+            rate_max = evict_rate[i];
+            dest = i;
+        }
+        if (pages[i] > 2 && movable[i]) {
+            if (full && free_pages[i] >= 5 && free_pages[i] > free_max) {
+                free_max = free_pages[i];
+                reclaim = i;
+            }
+            if (!evicting[i] && age[i] > age_max) {
+                age_max = age[i];
                 source = i;
-        } else {
-            slab_zeroes[i] = 0;
-            if (evicted_diff > evicted_max) {
-                evicted_max = evicted_diff;
-                highest_slab = i;
             }
         }
-        evicted_old[i] = evicted_new[i];
     }
 
-    /* Pick a valid destination */
-    if (slab_winner != 0 && slab_winner == highest_slab) {
-        slab_wins++;
-        if (slab_wins >= 3)
-            dest = slab_winner;
-    } else {
-        slab_wins = 1;
-        slab_winner = highest_slab;
+    if (reclaim) {
+        *src = reclaim;
+        *dst = SLAB_GLOBAL_PAGE_POOL;
+        return 1;
     }
-
-    if (source && dest) {
+    if (source && dest &&
+        age[dest] < (double)age[source] * settings.slab_automove_ratio) {
         *src = source;
         *dst = dest;
         return 1;
@@ -728,15 +933,24 @@ static int slab_automove_decision(int *src, int *dst) {
     return 0;
 }
 
+/* Backoff while a page waits on busy items */
+#define REBAL_BACKOFF_MIN 1000
+#define REBAL_BACKOFF_MAX 1000000
+
 /* Slab rebalancer thread.
- * Does not use spinlocks since it is not timing sensitive. Burn less CPU and
- * go to sleep if locks are contended
+ * Does not use spinlocks since it is not timing sensitive. A page is cleared
+ * slab_bulk_check chunks at a time, letting go of slabs_lock in between, so
+ * workers don't wait on it for long. Items that are in use get a short and
+ * growing backoff to be released, rather than a second each. Idle, the
+ * thread wakes once a second for the automover, or when asked to move a page.
  */
 static void *slab_maintenance_thread(void *arg) {
-    int was_busy = 0;
+    int was_busy;
+    useconds_t backoff = 0;
     int src, dest;
 
     while (do_run_slab_thread) {
+        was_busy = 0;
         if (slab_rebalance_signal == 1) {
             if (slab_rebalance_start() < 0) {
                 /* Handle errors with more specifity as required. */
@@ -755,9 +969,26 @@ static void *slab_maintenance_thread(void *arg) {
             slab_rebalance_finish();
         }
 
-        /* Sleep a bit if no work to do, or waiting on busy objects */
-        if (was_busy || !slab_rebalance_signal)
-            sleep(1);
+        if (was_busy) {
+            backoff = backoff ? backoff * 2 : REBAL_BACKOFF_MIN;
+            if (backoff > REBAL_BACKOFF_MAX)
+                backoff = REBAL_BACKOFF_MAX;
+            usleep(backoff);
+        } else if (!slab_rebalance_signal) {
+            struct timeval tv;
+            struct timespec ts;
+
+            backoff = 0;
+            gettimeofday(&tv, NULL);
+            ts.tv_sec = tv.tv_sec + 1;
+            ts.tv_nsec = tv.tv_usec * 1000;
+            mutex_lock(&slabs_lock);
+            if (do_run_slab_thread && slab_rebalance_signal == 0)
+                pthread_cond_timedwait(&maintenance_cond, &slabs_lock, &ts);
+            pthread_mutex_unlock(&slabs_lock);
+        } else {
+            backoff = 0;
+        }
     }
     return NULL;
 }
@@ -770,7 +1001,7 @@ static enum reassign_result_type do_slabs_reassign(int src, int dst) {
         return REASSIGN_SRC_DST_SAME;
 
     if (src < POWER_SMALLEST || src > power_largest ||
-        dst < POWER_SMALLEST || dst > power_largest)
+        dst < SLAB_GLOBAL_PAGE_POOL || dst > power_largest)
         return REASSIGN_BADCLASS;
 
     if (slabclass[src].slabs < 2)
@@ -786,6 +1017,7 @@ static enum reassign_result_type do_slabs_reassign(int src, int dst) {
     slab_rebal.d_clsid = dst;
 
     slab_rebalance_signal = 1;
+    pthread_cond_signal(&maintenance_cond);
 
     return REASSIGN_OK;
 }
@@ -820,10 +1052,10 @@ int start_slab_maintenance_thread(void) {
 }
 
 void stop_slab_maintenance_thread(void) {
-    mutex_lock(&cache_lock);
+    mutex_lock(&slabs_lock);
     do_run_slab_thread = 0;
     pthread_cond_signal(&maintenance_cond);
-    pthread_mutex_unlock(&cache_lock);
+    pthread_mutex_unlock(&slabs_lock);
 
     /* Wait for the maintenance thread to stop */
     pthread_join(maintenance_tid, NULL);
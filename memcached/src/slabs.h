@@ -24,6 +24,9 @@ void *slabs_alloc(const size_t size, unsigned int id);
 /** Free previously allocated object */
 void slabs_free(void *ptr, size_t size, unsigned int id);
 
+/** Whether a class is out of pages and low on free chunks */
+bool slabs_low_memory(const unsigned int id);
+
 /** Adjust the stats for memory requested */
 void slabs_adjust_mem_requested(unsigned int id, size_t old, size_t ntotal);
 
@@ -36,6 +39,17 @@ void slabs_stats(ADD_STAT add_stats, void *c);
 int start_slab_maintenance_thread(void);
 void stop_slab_maintenance_thread(void);
 
+/** -o memory_file: page to slab class map of the arena, and its restore */
+int slabs_page_classes(unsigned char **classes);
+int slabs_restore(const unsigned char *classes, const unsigned int npages,
+                  item ***items);
+
+/* Class id that stands for the global page pool in slabs_reassign() */
+#define SLAB_GLOBAL_PAGE_POOL 0
+
+/** Pages the rebalancer reclaimed that no class has taken yet */
+unsigned int slabs_global_page_pool(void);
+
 enum reassign_result_type {
     REASSIGN_OK=0, REASSIGN_RUNNING, REASSIGN_BADCLASS, REASSIGN_NOSPARE,
     REASSIGN_DEST_NOT_FULL, REASSIGN_SRC_NOT_SAFE, REASSIGN_SRC_DST_SAME
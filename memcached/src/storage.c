@@ -0,0 +1,435 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * Item values on flash (-o ext_path).
+ *
+ * The LRU maintainer writes large, cold items out to the store in extstore.c
+ * and swaps them for small ITEM_HDR items: the same key, flags, expiry and
+ * CAS, with an item_hdr saying where the rest went as their value. The hash
+ * table and LRUs treat headers like any other item, so expiry, deletes and
+ * evictions work as before; freeing a header frees its space on flash.
+ *
+ * A get that finds a header reads the item back into a fresh item. ASCII gets
+ * on TCP hand the read to the IO threads and finish the response once it's
+ * in; everything else reads synchronously, under the item lock. Reads that
+ * come back wrong, because the page the object was on has been reused since,
+ * count as misses and unlink the header.
+ *
+ * A compaction thread moves the live objects off of mostly dead flash pages,
+ * so the space can be used again before it has to be dropped.
+ */
+#include "memcached.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static struct {
+    pthread_mutex_t lock;
+    uint64_t get_extstore;          /* items read back */
+    uint64_t miss_from_extstore;    /* headers whose object was gone */
+    uint64_t recache_from_extstore; /* read back and kept in memory */
+    uint64_t compact_rescues;       /* live objects moved by compaction */
+    uint64_t compact_skipped;       /* deleted while being moved */
+    uint64_t compact_lost;          /* couldn't be moved */
+} storage_stats_s = { PTHREAD_MUTEX_INITIALIZER, 0, 0, 0, 0, 0, 0 };
+
+#define STORAGE_STAT_INCR(field) do { \
+    pthread_mutex_lock(&storage_stats_s.lock); \
+    storage_stats_s.field++; \
+    pthread_mutex_unlock(&storage_stats_s.lock); \
+} while (0)
+
+static volatile int do_run_storage_compact_thread = 0;
+static pthread_t storage_compact_tid;
+
+static int start_storage_compact_thread(void);
+
+int storage_init(void) {
+    if (extstore_init(settings.ext_path, settings.ext_size,
+                      settings.ext_page_size, settings.ext_threads) != 0) {
+        return -1;
+    }
+    return start_storage_compact_thread();
+}
+
+void storage_hdr(item *it, item_hdr *hdr) {
+    /* The value of an item isn't aligned */
+    memcpy(hdr, ITEM_data(it), sizeof(*hdr));
+}
+
+/*
+ * Caller holds the item lock for key. Allocates a header for the object at
+ * loc, with the key, suffix and expiry of it. Returns NULL if out of memory.
+ */
+static item *storage_hdr_alloc(item *it, const ext_loc *loc, const int nbytes) {
+    item_hdr hdr;
+    item *hdr_it = do_item_alloc_suffix(ITEM_key(it), it->nkey,
+                                        ITEM_suffix(it), it->nsuffix,
+                                        it->exptime, sizeof(item_hdr));
+    if (hdr_it == NULL)
+        return NULL;
+    hdr.loc = *loc;
+    hdr.nbytes = nbytes;
+    memcpy(ITEM_data(hdr_it), &hdr, sizeof(hdr));
+    hdr_it->it_flags |= ITEM_HDR | (it->it_flags & ITEM_FETCHED);
+    ITEM_set_cas(hdr_it, ITEM_get_cas(it));
+    return hdr_it;
+}
+
+/*
+ * Caller holds the item lock for it. Writes everything past its item header
+ * to flash and returns a header for it, with one reference held, or NULL if
+ * either couldn't be done.
+ */
+item *storage_write(item *it) {
+    struct iovec iov[2];
+    ext_obj obj;
+    ext_loc loc;
+    item *hdr_it;
+
+    memset(&obj, 0, sizeof(obj));
+    obj.cas = ITEM_get_cas(it);
+    obj.nbytes = it->nbytes;
+    obj.nkey = it->nkey;
+    obj.nsuffix = it->nsuffix;
+
+    /* Key, suffix and data sit next to each other in the item */
+    iov[0].iov_base = &obj;
+    iov[0].iov_len = sizeof(obj);
+    iov[1].iov_base = ITEM_key(it);
+    iov[1].iov_len = it->nkey + 1 + it->nsuffix + it->nbytes;
+    if (extstore_write(iov, 2, &loc) != 0)
+        return NULL;
+
+    if ((hdr_it = storage_hdr_alloc(it, &loc, it->nbytes)) == NULL) {
+        extstore_delete(&loc);
+        return NULL;
+    }
+    return hdr_it;
+}
+
+/* it is a header being freed; its object on flash is dead now. */
+void storage_delete(item *it) {
+    item_hdr hdr;
+    storage_hdr(it, &hdr);
+    extstore_delete(&hdr.loc);
+}
+
+/*
+ * Sets io up to read what hdr_it points to back into read_it, which has to be
+ * sized for it.
+ */
+void storage_read_prep(io_wrap *io, item *hdr_it, item *read_it) {
+    item_hdr hdr;
+
+    storage_hdr(hdr_it, &hdr);
+    io->io.loc = hdr.loc;
+    io->io.iov[0].iov_base = &io->obj;
+    io->io.iov[0].iov_len = sizeof(io->obj);
+    io->io.iov[1].iov_base = io->key;
+    io->io.iov[1].iov_len = hdr_it->nkey + 1 + hdr_it->nsuffix;
+    io->io.iov[2].iov_base = ITEM_data(read_it);
+    io->io.iov[2].iov_len = hdr.nbytes;
+    io->io.iovcnt = 3;
+    io->io.result = -1;
+    io->hdr_it = hdr_it;
+    io->read_it = read_it;
+}
+
+/* Whether what came back is the object hdr_it was written for */
+static bool storage_read_check(io_wrap *io) {
+    item *hdr_it = io->hdr_it;
+    item_hdr hdr;
+
+    storage_hdr(hdr_it, &hdr);
+    return io->io.result == (int)hdr.loc.len &&
+        io->obj.nkey == hdr_it->nkey &&
+        io->obj.nsuffix == hdr_it->nsuffix &&
+        io->obj.nbytes == (uint32_t)hdr.nbytes &&
+        io->obj.cas == ITEM_get_cas(hdr_it) &&
+        memcmp(io->key, ITEM_key(hdr_it), hdr_it->nkey) == 0;
+}
+
+/*
+ * Caller holds the item lock for hv. Drops the header of an object that is
+ * gone from flash, unless it has been replaced already.
+ */
+static void storage_read_miss(item *hdr_it, const uint32_t hv) {
+    if ((hdr_it->it_flags & ITEM_LINKED) != 0)
+        do_item_unlink(hdr_it, hv);
+    STORAGE_STAT_INCR(miss_from_extstore);
+}
+
+/*
+ * Worker side of an IO thread read: returns whether io->read_it holds the
+ * value. Every ext_recache_rate'th item read back goes back into memory,
+ * in place of its header.
+ */
+bool storage_read_done(io_wrap *io) {
+    static unsigned int recache_counter = 0;
+    item *hdr_it = io->hdr_it;
+    uint32_t hv = hash(ITEM_key(hdr_it), hdr_it->nkey, 0);
+    bool hit = storage_read_check(io);
+
+    item_lock(hv);
+    if (!hit) {
+        storage_read_miss(hdr_it, hv);
+    } else {
+        STORAGE_STAT_INCR(get_extstore);
+        /* Racy, but it only has to come around every so often */
+        if (settings.ext_recache_rate > 0 &&
+            ++recache_counter % settings.ext_recache_rate == 0 &&
+            (hdr_it->it_flags & ITEM_LINKED) != 0) {
+            do_item_swap(hdr_it, io->read_it, hv);
+            STORAGE_STAT_INCR(recache_from_extstore);
+        }
+    }
+    item_unlock(hv);
+    return hit;
+}
+
+/*
+ * Caller holds the item lock for hv and a reference to the header it.
+ * Reads the item back from flash, puts it in place of the header and
+ * returns it with a reference held; the one to the header is dropped.
+ * Returns NULL if the item is gone, or there's no memory to read it into.
+ */
+item *do_storage_get(item *it, const uint32_t hv) {
+    io_wrap io;
+    item_hdr hdr;
+    item *new_it;
+    int flags;
+
+    storage_hdr(it, &hdr);
+    /* Suffix is " <flags> <bytes>\r\n" */
+    flags = (int)strtoul(ITEM_suffix(it) + 1, NULL, 10);
+    new_it = do_item_alloc(ITEM_key(it), it->nkey, flags, it->exptime,
+                           hdr.nbytes);
+    if (new_it == NULL) {
+        do_item_remove(it);
+        return NULL;
+    }
+
+    storage_read_prep(&io, it, new_it);
+    extstore_read(&io.io);
+    if (!storage_read_check(&io)) {
+        storage_read_miss(it, hv);
+        do_item_remove(new_it);
+        do_item_remove(it);
+        return NULL;
+    }
+
+    STORAGE_STAT_INCR(get_extstore);
+    ITEM_set_cas(new_it, ITEM_get_cas(it));
+    if ((it->it_flags & ITEM_LINKED) != 0) {
+        do_item_swap(it, new_it, hv);
+        STORAGE_STAT_INCR(recache_from_extstore);
+    }
+    do_item_remove(it);
+    return new_it;
+}
+
+/************************** EXTSTORE COMPACTION THREAD ************************/
+
+/*
+ * Caller holds the item lock for hv. Returns the header whose object is at
+ * loc, if it's still linked, or NULL.
+ */
+static item *storage_compact_hdr(const char *key, const size_t nkey,
+                                 const uint32_t hv, const ext_loc *loc) {
+    item *it = assoc_find(key, nkey, hv);
+    item_hdr hdr;
+
+    if (it == NULL || (it->it_flags & ITEM_HDR) == 0)
+        return NULL;
+    storage_hdr(it, &hdr);
+    if (hdr.loc.page_id != loc->page_id ||
+        hdr.loc.page_version != loc->page_version ||
+        hdr.loc.offset != loc->offset) {
+        return NULL;
+    }
+    return it;
+}
+
+/*
+ * Walks the objects on page and writes the ones that still have a header
+ * somewhere else. buf holds the largest object there can be.
+ */
+static void storage_compact_page(const ext_loc *page, char *buf,
+                                 const size_t buflen) {
+    unsigned int offset = 0;
+
+    while (do_run_storage_compact_thread &&
+           offset + sizeof(ext_obj) <= page->len) {
+        ext_io io;
+        ext_obj obj;
+        ext_loc newloc;
+        size_t len;
+        char *key;
+        uint32_t hv;
+        item *it;
+
+        io.loc = *page;
+        io.loc.offset = offset;
+        io.iov[0].iov_base = &obj;
+        io.iov[0].iov_len = sizeof(obj);
+        io.iovcnt = 1;
+        if (extstore_read(&io) != sizeof(obj))
+            break;
+
+        len = sizeof(obj) + obj.nkey + 1 + obj.nsuffix + obj.nbytes;
+        if (obj.nkey == 0 || len > page->len - offset || len > buflen)
+            break;
+
+        io.iov[0].iov_base = buf;
+        io.iov[0].iov_len = len;
+        if (extstore_read(&io) != (int)len)
+            break;
+
+        key = buf + sizeof(obj);
+        hv = hash(key, obj.nkey, 0);
+        io.loc.len = len;
+
+        item_lock(hv);
+        it = storage_compact_hdr(key, obj.nkey, hv, &io.loc);
+        item_unlock(hv);
+
+        if (it != NULL) {
+            struct iovec iov;
+            iov.iov_base = buf;
+            iov.iov_len = len;
+            if (extstore_write(&iov, 1, &newloc) != 0) {
+                STORAGE_STAT_INCR(compact_lost);
+            } else {
+                item *new_it = NULL;
+                /* Headers never change; swap in a new one, which also lets
+                 * a read in flight through the old one finish. */
+                item_lock(hv);
+                it = storage_compact_hdr(key, obj.nkey, hv, &io.loc);
+                if (it != NULL &&
+                    (new_it = storage_hdr_alloc(it, &newloc, obj.nbytes)) != NULL) {
+                    do_item_swap(it, new_it, hv);
+                    do_item_remove(new_it);
+                }
+                item_unlock(hv);
+
+                if (new_it != NULL) {
+                    STORAGE_STAT_INCR(compact_rescues);
+                } else {
+                    extstore_delete(&newloc);
+                    if (it != NULL) {
+                        STORAGE_STAT_INCR(compact_lost);
+                    } else {
+                        STORAGE_STAT_INCR(compact_skipped);
+                    }
+                }
+            }
+        }
+        offset += len;
+    }
+    extstore_compact_done(page);
+}
+
+/*
+ * Compacts a page at a time while there are some worth it. Pages only get
+ * compacted below ext_compact_under percent live once free pages run low,
+ * a quarter of them or less; before that, only the ones that are as good as
+ * empty.
+ */
+static void *storage_compact_thread(void *arg) {
+    size_t buflen = settings.item_size_max + sizeof(ext_obj);
+    char *buf = malloc(buflen);
+
+    if (buf == NULL) {
+        fprintf(stderr, "Failed to allocate the extstore compaction buffer\n");
+        return NULL;
+    }
+
+    if (settings.verbose > 2)
+        fprintf(stderr, "Starting extstore compaction thread\n");
+    while (do_run_storage_compact_thread) {
+        struct extstore_stats st;
+        ext_loc page;
+        int under;
+
+        extstore_get_stats(&st);
+        under = st.pages_free <= st.page_count / 4
+            ? settings.ext_compact_under : 1;
+        if (extstore_compact_pick(under, &page)) {
+            storage_compact_page(&page, buf, buflen);
+        } else {
+            sleep(1);
+        }
+    }
+    if (settings.verbose > 2)
+        fprintf(stderr, "Extstore compaction thread stopping\n");
+
+    free(buf);
+    return NULL;
+}
+
+static int start_storage_compact_thread(void) {
+    int ret;
+
+    do_run_storage_compact_thread = 1;
+    if ((ret = pthread_create(&storage_compact_tid, NULL,
+                              storage_compact_thread, NULL)) != 0) {
+        fprintf(stderr, "Can't create extstore compaction thread: %s\n",
+            strerror(ret));
+        do_run_storage_compact_thread = 0;
+        return -1;
+    }
+    return 0;
+}
+
+void stop_storage_compact_thread(void) {
+    if (!do_run_storage_compact_thread)
+        return;
+    do_run_storage_compact_thread = 0;
+    pthread_join(storage_compact_tid, NULL);
+}
+
+void storage_stats(ADD_STAT add_stats, void *c) {
+    struct extstore_stats st;
+
+    extstore_get_stats(&st);
+    APPEND_STAT("extstore_page_size", "%u", st.page_size);
+    APPEND_STAT("extstore_page_count", "%u", st.page_count);
+    APPEND_STAT("extstore_pages_free", "%u", st.pages_free);
+    APPEND_STAT("extstore_objects_used", "%llu",
+                (unsigned long long)st.objects_used);
+    APPEND_STAT("extstore_bytes_used", "%llu",
+                (unsigned long long)st.bytes_used);
+    APPEND_STAT("extstore_bytes_fragmented", "%llu",
+                (unsigned long long)st.bytes_fragmented);
+    APPEND_STAT("extstore_objects_written", "%llu",
+                (unsigned long long)st.objects_written);
+    APPEND_STAT("extstore_bytes_written", "%llu",
+                (unsigned long long)st.bytes_written);
+    APPEND_STAT("extstore_objects_read", "%llu",
+                (unsigned long long)st.objects_read);
+    APPEND_STAT("extstore_bytes_read", "%llu",
+                (unsigned long long)st.bytes_read);
+    APPEND_STAT("extstore_pages_dropped", "%llu",
+                (unsigned long long)st.pages_dropped);
+    APPEND_STAT("extstore_objects_dropped", "%llu",
+                (unsigned long long)st.objects_dropped);
+
+    pthread_mutex_lock(&storage_stats_s.lock);
+    APPEND_STAT("get_extstore", "%llu",
+                (unsigned long long)storage_stats_s.get_extstore);
+    APPEND_STAT("miss_from_extstore", "%llu",
+                (unsigned long long)storage_stats_s.miss_from_extstore);
+    APPEND_STAT("recache_from_extstore", "%llu",
+                (unsigned long long)storage_stats_s.recache_from_extstore);
+    APPEND_STAT("extstore_compact_rescues", "%llu",
+                (unsigned long long)storage_stats_s.compact_rescues);
+    APPEND_STAT("extstore_compact_skipped", "%llu",
+                (unsigned long long)storage_stats_s.compact_skipped);
+    APPEND_STAT("extstore_compact_lost", "%llu",
+                (unsigned long long)storage_stats_s.compact_lost);
+    pthread_mutex_unlock(&storage_stats_s.lock);
+
+    add_stats(NULL, 0, NULL, 0, c);
+}
@@ -0,0 +1,43 @@
+/* Item values on flash (-o ext_path), see storage.c */
+#ifndef STORAGE_H
+#define STORAGE_H
+
+/* Written in front of every object: key, '\0', suffix and data follow. */
+typedef struct {
+    uint64_t cas;
+    uint32_t nbytes;
+    uint8_t nkey;
+    uint8_t nsuffix;
+    uint16_t unused;
+} ext_obj;
+
+/* The value of an ITEM_HDR item: where the rest of the item went. */
+typedef struct {
+    ext_loc loc;
+    int nbytes;         /* of the value on flash, with its \r\n */
+} item_hdr;
+
+/* A get waiting on a flash read. io has to come first. */
+typedef struct _io_wrap {
+    ext_io io;
+    ext_obj obj;
+    char key[KEY_MAX_LENGTH + 1 + 40];  /* key and suffix as read back */
+    conn *c;
+    item *hdr_it;       /* holds a reference */
+    item *read_it;      /* read into; in the connection's item list */
+    int iovec_start;    /* the response's entries in c->iov */
+    int iovec_count;
+    struct _io_wrap *next;
+} io_wrap;
+
+int   storage_init(void);
+void  stop_storage_compact_thread(void);
+item *storage_write(item *it);
+void  storage_delete(item *it);
+void  storage_hdr(item *it, item_hdr *hdr);
+void  storage_read_prep(io_wrap *io, item *hdr_it, item *read_it);
+bool  storage_read_done(io_wrap *io);
+item *do_storage_get(item *it, const uint32_t hv);
+void  storage_stats(ADD_STAT add_stats, void *c);
+
+#endif
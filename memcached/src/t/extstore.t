@@ -0,0 +1,166 @@
+#!/usr/bin/perl
+
+use strict;
+use warnings;
+use Test::More tests => 29;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $file = "/tmp/memcached-extstore.$$";
+
+eval {
+    new_memcached("-o ext_path=$file:64m");
+};
+ok($@ && $@ =~ m/^Failed/, "ext_path needs the lru maintainer");
+
+# Every COLD item goes to flash right away, and stays there when read.
+my $server = new_memcached("-m 32 -o lru_maintainer,ext_path=$file:64m," .
+                           "ext_page_size=1,ext_item_age=0,ext_item_size=16," .
+                           "ext_recache_rate=0");
+my $sock = $server->sock;
+
+my $settings = mem_stats($sock, ' settings');
+is($settings->{ext_path}, $file, "ext_path setting");
+is($settings->{ext_page_size}, 1024 * 1024, "ext_page_size setting");
+
+sub value_of {
+    my $n = shift;
+    return "$n:" . ("x" x 10000);
+}
+
+# Reads one "VALUE" from a get response, without printing it on failure.
+sub read_value {
+    my ($sock, $key) = @_;
+    my $line = <$sock>;
+    return undef unless $line =~ /^VALUE \Q$key\E (\d+) (\d+)/;
+    my $data;
+    read($sock, $data, $2 + 2);
+    $data =~ s/\r\n$//;
+    return $data;
+}
+
+sub read_value_line {
+    my $sock = shift;
+    my $line = <$sock>;
+    $line =~ s/\r\n$//;
+    return $line;
+}
+
+my %cas;
+for my $n (1..200) {
+    my $v = value_of($n);
+    print $sock "set key$n 0 0 " . length($v) . "\r\n$v\r\n";
+    die "failed to store key$n" unless scalar <$sock> eq "STORED\r\n";
+    print $sock "gets key$n\r\n";
+    ($cas{$n}) = scalar(<$sock>) =~ / (\d+)\r\n$/;
+    my $data;
+    read($sock, $data, length($v) + 7);
+}
+print $sock "set counter 0 0 21\r\n000000000000000000041\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored counter");
+print $sock "set tail 0 0 20\r\n01234567890123456789\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored tail");
+
+my $ext;
+for (1..50) {
+    $ext = mem_stats($sock, "extstore");
+    last if $ext->{extstore_objects_written} >= 100;
+    select(undef, undef, undef, 0.2);
+}
+ok($ext->{extstore_objects_written} >= 100, "cold items written to flash");
+is($ext->{extstore_page_count}, 64, "page count");
+
+my $bad = 0;
+for my $n (1..200) {
+    print $sock "get key$n\r\n";
+    my $data = read_value($sock, "key$n");
+    $bad++ unless defined $data && $data eq value_of($n);
+    $bad++ unless scalar <$sock> eq "END\r\n";
+}
+is($bad, 0, "every item reads back");
+
+$ext = mem_stats($sock, "extstore");
+ok($ext->{get_extstore} >= 100, "reads came from flash");
+ok($ext->{extstore_objects_read} >= 100, "objects read");
+is($ext->{miss_from_extstore}, 0, "no misses");
+
+# One response from several flash reads, in order.
+print $sock "get " . join(" ", map { "key$_" } 1..50) . "\r\n";
+$bad = 0;
+for my $n (1..50) {
+    my $data = read_value($sock, "key$n");
+    $bad++ unless defined $data && $data eq value_of($n);
+}
+is($bad, 0, "multiget reads back");
+is(scalar <$sock>, "END\r\n", "multiget end");
+
+$bad = 0;
+for my $n (1..200) {
+    print $sock "gets key$n\r\n";
+    my $line = <$sock>;
+    $bad++ unless $line =~ / (\d+)\r\n$/ && $1 == $cas{$n};
+    my $data;
+    read($sock, $data, length(value_of($n)) + 7);
+}
+is($bad, 0, "cas values survive the trip");
+
+# Binary get, which reads synchronously.
+{
+    my $bsock = $server->new_sock;
+    my $key = "key7";
+    print $bsock pack("CCnCCnNNNN", 0x80, 0x00, length($key), 0, 0, 0,
+                     length($key), 0, 0, 0) . $key;
+    my $hdr;
+    read($bsock, $hdr, 24);
+    my ($magic, $op, $keylen, $extlen, $dt, $status, $bodylen) =
+        unpack("CCnCCnN", $hdr);
+    is($status, 0, "binary get found it");
+    my $body;
+    read($bsock, $body, $bodylen);
+    ok(substr($body, $extlen) eq value_of(7), "binary get value");
+}
+
+# Meta get, with and without the value
+print $sock "mg key8 k\r\n";
+is(scalar <$sock>, "HD kkey8\r\n", "meta get of a header");
+print $sock "mg key8 s v\r\n";
+is(scalar <$sock>, "VA 10002 s10002\r\n", "meta get reads from flash");
+is(read_value_line($sock), value_of(8), "meta get value");
+
+print $sock "incr counter 1\r\n";
+is(scalar <$sock>, "42\r\n", "incr on a value from flash");
+print $sock "append tail 0 0 3\r\nabc\r\n";
+is(scalar <$sock>, "STORED\r\n", "append to a value from flash");
+mem_get_is($sock, "tail", "01234567890123456789abc");
+
+print $sock "delete key3\r\n";
+is(scalar <$sock>, "DELETED\r\n", "deleted key3");
+mem_get_is($sock, "key3", undef);
+
+# Replace everything with small items; the flash pages go dead and get
+# compacted away, but for the one still being written to.
+for my $n (1..200) {
+    print $sock "set key$n 0 0 1\r\nx\r\n";
+    die "failed to store key$n" unless scalar <$sock> eq "STORED\r\n";
+}
+for (1..50) {
+    $ext = mem_stats($sock, "extstore");
+    last if $ext->{extstore_pages_free} >= 63;
+    select(undef, undef, undef, 0.2);
+}
+ok($ext->{extstore_objects_used} <= 2, "only counter and tail left on flash")
+    or diag(join ", ", map { "$_=$ext->{$_}" } sort keys %$ext);
+is($ext->{extstore_pages_free}, 63, "dead pages compacted");
+mem_get_is($sock, "key9", "x");
+mem_get_is($sock, "counter", "42");
+
+$server->stop();
+unlink($file);
+
+# Too small for two pages
+eval {
+    new_memcached("-o lru_maintainer,ext_path=$file:1m");
+};
+ok($@ && $@ =~ m/^Failed/, "ext_path needs room for two pages");
+unlink($file);
@@ -0,0 +1,33 @@
+#!/usr/bin/perl
+
+use strict;
+use warnings;
+use Test::More tests => 10;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $server = new_memcached();
+my $stats = mem_stats($server->sock, ' settings');
+is($stats->{hash_algorithm}, "jenkins", "jenkins is the default");
+
+for my $algo (qw(jenkins murmur3 xxh64)) {
+    my $server = new_memcached("-o hash_algorithm=$algo,hashpower=12");
+    my $sock = $server->sock;
+
+    $stats = mem_stats($sock, ' settings');
+    is($stats->{hash_algorithm}, $algo, "$algo selected");
+
+    # Enough keys of mixed lengths to make the table grow once.
+    my $stored = 1;
+    for my $key (0..6999) {
+        my $k = "k" x ($key % 200) . $key;
+        print $sock "set $k 0 0 1\r\nx\r\n";
+        if (scalar <$sock> ne "STORED\r\n") {
+            $stored = 0;
+            last;
+        }
+    }
+    ok($stored, "$algo: stored keys");
+    mem_get_is($sock, "k" x (6999 % 200) . 6999, "x", "$algo: fetched key");
+}
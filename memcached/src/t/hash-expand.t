@@ -0,0 +1,69 @@
+#!/usr/bin/perl
+
+use strict;
+use warnings;
+use Test::More tests => 6;
+use POSIX ();
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+# Small table so it has to grow a few times while we read from it.
+my $server = new_memcached('-o hashpower=12 -t 4');
+my $sock = $server->sock;
+
+my $stats = mem_stats($sock);
+is($stats->{hash_power_level}, 12, "starting hash power level");
+
+# A fixed set of keys which must never miss while the table grows.
+for my $key (0..99) {
+    my $val = "fixed$key";
+    print $sock "set fixed$key 0 0 " . length($val) . "\r\n$val\r\n";
+    if (scalar <$sock> ne "STORED\r\n") {
+        fail("stored fixed$key");
+    }
+}
+
+my $pid = fork();
+die "fork failed: $!" unless defined $pid;
+if ($pid == 0) {
+    # Reader: hammer the fixed keys until the parent is done, exit with the
+    # number of misses.
+    my $rsock = $server->new_sock;
+    my $misses = 0;
+    for (my $i = 0; $i < 20000; $i++) {
+        my $key = "fixed" . ($i % 100);
+        print $rsock "get $key\r\n";
+        my $line = <$rsock>;
+        if ($line =~ /^VALUE /) {
+            <$rsock>; <$rsock>;
+        } else {
+            $misses++;
+        }
+    }
+    # _exit, so our copy of $server doesn't take the daemon down with it.
+    POSIX::_exit($misses > 255 ? 255 : $misses);
+}
+
+my $stored = 1;
+for my $key (0..29999) {
+    print $sock "set filler$key 0 0 1\r\nx\r\n";
+    if (scalar <$sock> ne "STORED\r\n") {
+        $stored = 0;
+        last;
+    }
+}
+ok($stored, "stored filler keys");
+
+waitpid($pid, 0);
+is($? >> 8, 0, "no misses on live keys during expansion");
+
+# Let the maintenance thread finish moving buckets.
+for (my $i = 0; $i < 50; $i++) {
+    $stats = mem_stats($sock);
+    last unless $stats->{hash_is_expanding};
+    sleep(0.1);
+}
+ok($stats->{hash_power_level} > 12, "hash table grew");
+is($stats->{curr_items}, 30100, "all items still there");
+mem_get_is($sock, "filler29999", "x");
@@ -0,0 +1,85 @@
+#!/usr/bin/perl
+
+use strict;
+use warnings;
+use Test::More tests => 22;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $server = new_memcached('-t 4 -o latency_stats');
+my $sock = $server->sock;
+
+my $settings = mem_stats($sock, ' settings');
+is($settings->{latency_stats}, "yes", "latency_stats enabled");
+
+my $curr = mem_stats($sock)->{curr_connections};
+
+my $lat = mem_stats($sock, "latency");
+is($lat->{"get:count"}, 0, "no gets timed yet");
+is($lat->{"get:p99_us"}, 0, "empty histogram reads as zero");
+
+print $sock "set foo1 0 0 3\r\nbar\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored foo1");
+for my $n (2..100) {
+    print $sock "set foo$n 0 0 3\r\nbar\r\n";
+    <$sock>;
+}
+mem_get_is($sock, "foo1", "bar");
+for my $n (2..50) {
+    print $sock "get foo$n\r\n";
+    <$sock>; <$sock>; <$sock>;
+}
+print $sock "get foo1 foo2 foo3\r\n";
+<$sock> for 1..7;
+print $sock "incr nope 1\r\n";
+is(scalar <$sock>, "NOT_FOUND\r\n", "incr miss");
+print $sock "delete foo1\r\n";
+is(scalar <$sock>, "DELETED\r\n", "delete");
+
+# Commands on other connections, and binary ones, are counted too.
+my $other = $server->new_sock;
+print $other "touch foo2 10\r\n";
+is(scalar <$other>, "TOUCHED\r\n", "touch");
+my $bsock = $server->new_sock;
+print $bsock pack("CCnCCnNNNN", 0x80, 0x00, 4, 0, 0, 0, 4, 0, 0, 0) . "foo3";
+my $hdr;
+read($bsock, $hdr, 24);
+my ($status, $bodylen) = (unpack("CCnCCnN", $hdr))[5, 6];
+is($status, 0, "binary get");
+my $body;
+read($bsock, $body, $bodylen);
+
+# A command is timed once its response is out, which can be just after the
+# client has it.
+select(undef, undef, undef, 0.2);
+
+$lat = mem_stats($sock, "latency");
+is($lat->{"set:count"}, 100, "sets timed");
+is($lat->{"get:count"}, 52, "gets timed, once per command");
+is($lat->{"incr:count"}, 1, "incr timed");
+is($lat->{"delete:count"}, 1, "delete timed");
+is($lat->{"touch:count"}, 1, "touch timed");
+ok($lat->{"other:count"} >= 2, "stats commands timed");
+ok($lat->{"get:p50_us"} <= $lat->{"get:p90_us"} &&
+   $lat->{"get:p90_us"} <= $lat->{"get:p99_us"} &&
+   $lat->{"get:p99_us"} <= $lat->{"get:p999_us"} &&
+   $lat->{"get:p999_us"} <= $lat->{"get:max_us"}, "percentiles in order");
+ok($lat->{"get:max_us"} > 0, "gets took some time");
+ok($lat->{"get:mean_us"} <= $lat->{"get:max_us"}, "mean below max");
+
+print $sock "stats reset\r\n";
+is(scalar <$sock>, "RESET\r\n", "stats reset");
+$lat = mem_stats($sock, "latency");
+is($lat->{"set:count"}, 0, "reset clears the histograms");
+
+# Two more clients now; a third goes away again.
+my $gone = $server->new_sock;
+print $gone "version\r\n";
+<$gone>;
+close($gone);
+select(undef, undef, undef, 0.2);
+my $stats = mem_stats($sock);
+is($stats->{curr_connections}, $curr + 2,
+   "curr_connections summed over threads");
+is($stats->{total_connections}, 1, "total_connections since the reset");
@@ -0,0 +1,61 @@
+#!/usr/bin/perl
+
+use strict;
+use warnings;
+use Test::More tests => 12;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+# Segmented LRU with the background maintainer, small cache so we evict.
+my $server = new_memcached('-m 6 -o lru_maintainer');
+my $sock = $server->sock;
+
+my $settings = mem_stats($sock, ' settings');
+is($settings->{lru_maintainer_thread}, "yes", "lru maintainer enabled");
+is($settings->{hot_lru_pct}, 32, "default hot_lru_pct");
+is($settings->{warm_lru_pct}, 32, "default warm_lru_pct");
+
+my $value = "B"x1024;
+
+# Same size as the filler so it lives in the same slab class.
+print $sock "set canary 0 0 1024\r\n$value\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored canary");
+
+# Overflow the 1k class several times over, fetching the canary often
+# enough that it keeps getting bumped back up out of COLD.
+my $canary_ok = 1;
+for (my $key = 0; $key < 20000; $key++) {
+    print $sock "set key$key 0 0 1024\r\n$value\r\n";
+    if (scalar <$sock> ne "STORED\r\n") {
+        fail("stored key$key");
+        last;
+    }
+    if ($key % 100 == 0) {
+        print $sock "get canary\r\n";
+        my $line = scalar <$sock>;
+        if ($line !~ /^VALUE canary/) {
+            $canary_ok = 0;
+            last;
+        }
+        <$sock>; <$sock>;
+    }
+}
+ok($canary_ok, "active item survived eviction pressure");
+mem_get_is($sock, "canary", $value);
+
+my $stats = mem_stats($sock);
+isnt($stats->{evictions}, 0, "evictions happened");
+ok($stats->{lru_maintainer_juggles} > 0, "lru maintainer is running");
+
+my $items = mem_stats($sock, "items");
+my ($cls) = sort { $items->{"items:$b:number"} <=> $items->{"items:$a:number"} }
+    map { /^items:(\d+):number$/ ? $1 : () } keys %$items;
+my $hot = $items->{"items:$cls:number_hot"};
+my $warm = $items->{"items:$cls:number_warm"};
+my $cold = $items->{"items:$cls:number_cold"};
+is($items->{"items:$cls:number"}, $hot + $warm + $cold,
+    "segment sizes add up to number");
+ok($cold > $hot, "most items pushed down to COLD");
+isnt($items->{"items:$cls:moves_to_cold"}, 0, "items moved to COLD");
+isnt($items->{"items:$cls:moves_to_warm"}, 0, "items moved to WARM");
@@ -0,0 +1,117 @@
+#!/usr/bin/perl
+
+use strict;
+use warnings;
+use Test::More tests => 51;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $server = new_memcached();
+my $sock = $server->sock;
+
+# Sends one line, returns the first line back.
+sub meta {
+    my $cmd = shift;
+    print $sock "$cmd\r\n";
+    return scalar <$sock>;
+}
+
+is(meta("mn"), "MN\r\n", "no-op");
+
+print $sock "ms foo 2 T0 F5\r\nhi\r\n";
+is(scalar <$sock>, "HD\r\n", "stored foo");
+
+is(meta("mg foo"), "HD\r\n", "hit without flags");
+is(meta("mg foo v"), "VA 2\r\n", "value header");
+is(scalar <$sock>, "hi\r\n", "value");
+
+my $res = meta("mg foo s v f t c k Oabc");
+like($res, qr/^VA 2 s2 f5 t-1 c(\d+) kfoo Oabc\r\n$/, "flags answered in order");
+my ($cas) = $res =~ / c(\d+)/;
+is(scalar <$sock>, "hi\r\n", "value after flags");
+
+is(meta("mg foo k c"), "HD kfoo c$cas\r\n", "metadata without the value");
+is(meta("mg nope v"), "EN\r\n", "miss");
+is(meta("mg foo x"), "CLIENT_ERROR invalid flag\r\n", "unknown flag");
+is(meta("mg foo O" . ("x" x 33)), "CLIENT_ERROR bad token in command line format\r\n",
+   "opaque too long");
+
+# Repeated flags are answered once, so the header stays in bounds
+my $long = "l" x 250;
+print $sock "ms $long 2\r\nhi\r\n";
+is(scalar <$sock>, "HD\r\n", "stored a key of the longest length");
+is(meta("mg $long" . (" k" x 21)), "HD k$long\r\n", "repeated k answered once");
+like(meta("mg $long k Oa s k Ob c k"), qr/^HD k$long Ob s2 c\d+\r\n$/,
+     "first position, last opaque");
+
+# Touch on fetch
+like(meta("mg foo T100 t"), qr/^HD t(99|100)\r\n$/, "touched");
+mem_get_is({ sock => $sock, flags => 5 }, "foo", "hi");
+
+# Quiet misses, ended by mn, all in one write
+print $sock "mg nope v q\r\nmg foo v q Oa\r\nmg nope2 q\r\nmn\r\n";
+is(scalar <$sock>, "VA 2 Oa\r\n", "quiet batch: hit");
+is(scalar <$sock>, "hi\r\n", "quiet batch: value");
+is(scalar <$sock>, "MN\r\n", "quiet batch: misses left out");
+
+# Storage modes
+print $sock "ms foo 2 ME\r\nno\r\n";
+is(scalar <$sock>, "NS\r\n", "add over an existing item");
+print $sock "ms foo 3 MA\r\n!!!\r\n";
+is(scalar <$sock>, "HD\r\n", "append");
+mem_get_is({ sock => $sock, flags => 5 }, "foo", "hi!!!");
+print $sock "ms foo 1 MP\r\n>\r\n";
+is(scalar <$sock>, "HD\r\n", "prepend");
+mem_get_is({ sock => $sock, flags => 5 }, "foo", ">hi!!!");
+print $sock "ms nope 1 MR\r\nx\r\n";
+is(scalar <$sock>, "NS\r\n", "replace a missing item");
+print $sock "ms foo 1 MX\r\nx\r\n";
+is(scalar <$sock>, "CLIENT_ERROR invalid mode for ms\r\n", "bad mode");
+is(meta("mn"), "MN\r\n", "value of a bad ms swallowed");
+
+# CAS
+($cas) = meta("mg foo c") =~ / c(\d+)/;
+print $sock "ms foo 3 C" . ($cas + 1) . "\r\nbad\r\n";
+is(scalar <$sock>, "EX\r\n", "cas mismatch");
+print $sock "ms foo 3 C$cas c k\r\nnew\r\n";
+$res = scalar <$sock>;
+like($res, qr/^HD c(\d+) kfoo\r\n$/, "cas stored, new cas returned");
+my ($newcas) = $res =~ / c(\d+)/;
+ok($newcas != $cas, "cas changed");
+is(meta("mg foo c"), "HD c$newcas\r\n", "returned cas is the item's");
+print $sock "ms gone 1 C1\r\nx\r\n";
+is(scalar <$sock>, "NF\r\n", "cas on a missing item");
+
+# Deletes
+is(meta("md nope"), "NF\r\n", "delete miss");
+is(meta("md foo C" . ($newcas + 1)), "EX\r\n", "delete cas mismatch");
+print $sock "md foo q Oxy\r\nmn\r\n";
+is(scalar <$sock>, "MN\r\n", "quiet delete");
+is(meta("mg foo"), "EN\r\n", "deleted");
+
+# Stale-while-revalidate: invalidate, one client gets to refresh
+print $sock "ms swr 3\r\nold\r\n";
+is(scalar <$sock>, "HD\r\n", "stored swr");
+is(meta("md swr I T30 k"), "HD kswr\r\n", "invalidated");
+is(meta("mg swr v t"), "VA 3 t30 W X\r\n", "first fetch wins the refresh");
+is(scalar <$sock>, "old\r\n", "stale value still served");
+is(meta("mg swr v"), "VA 3 X Z\r\n", "others see it's being refreshed");
+is(scalar <$sock>, "old\r\n", "still served");
+print $sock "ms swr 3\r\nnew\r\n";
+is(scalar <$sock>, "HD\r\n", "refreshed");
+is(meta("mg swr"), "HD\r\n", "fresh again");
+
+# Vivify on miss
+is(meta("mg viv N30 s"), "HD s0 W\r\n", "miss creates a placeholder");
+is(meta("mg viv N30 s"), "HD s0 Z\r\n", "placeholder is someone else's");
+
+# Recache ahead of expiry
+print $sock "ms rc 1 T10\r\nx\r\n";
+is(scalar <$sock>, "HD\r\n", "stored rc");
+is(meta("mg rc R5"), "HD\r\n", "plenty of time left");
+is(meta("mg rc R30"), "HD W\r\n", "close to expiry: refresh");
+is(meta("mg rc R30"), "HD Z\r\n", "refresh already handed out");
+
+my $stats = mem_stats($sock);
+ok($stats->{get_hits} > 10, "meta gets counted as gets");
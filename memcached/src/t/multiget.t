@@ -0,0 +1,112 @@
+#!/usr/bin/perl
+
+use strict;
+use warnings;
+use Test::More tests => 11;
+use Time::HiRes qw(time);
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $server = new_memcached();
+my $sock = $server->sock;
+
+my $count = 1000;
+for my $key (0..$count - 1) {
+    my $val = "value$key";
+    print $sock "set key$key $key 0 " . length($val) . "\r\n$val\r\n";
+    if (scalar <$sock> ne "STORED\r\n") {
+        fail("stored key$key");
+    }
+}
+
+# Reads a get response, returns { key => [flags, value, cas] } or undef if
+# it didn't end in END.
+sub read_values {
+    my $sock = shift;
+    my %vals;
+    while (defined(my $line = <$sock>)) {
+        return \%vals if $line eq "END\r\n";
+        return undef unless $line =~ /^VALUE (\S+) (\d+) (\d+)(?: (\d+))?\r\n/;
+        my ($key, $flags, $len, $cas) = ($1, $2, $3, $4);
+        my $data;
+        read($sock, $data, $len + 2);
+        $data =~ s/\r\n$//;
+        $vals{$key} = [$flags, $data, $cas];
+    }
+    return undef;
+}
+
+sub check_values {
+    my ($vals, @keys) = @_;
+    return 0 unless $vals && scalar(keys %$vals) == scalar(@keys);
+    for my $key (@keys) {
+        my ($n) = $key =~ /^key(\d+)$/;
+        return 0 unless $vals->{$key} && $vals->{$key}[0] == $n
+            && $vals->{$key}[1] eq "value$n";
+    }
+    return 1;
+}
+
+# Enough keys for several lookup batches, hits and misses mixed.
+my @keys = map { "key$_" } (0..99);
+my @mixed = map { $_ % 3 ? "key$_" : "missing$_" } (0..99);
+my $stats = mem_stats($sock);
+
+print $sock "get @keys\r\n";
+ok(check_values(read_values($sock), @keys), "100 key get");
+
+print $sock "get @mixed\r\n";
+ok(check_values(read_values($sock), grep { /^key/ } @mixed),
+   "100 key get with misses");
+
+my $after = mem_stats($sock);
+is($after->{cmd_get} - $stats->{cmd_get}, 200, "cmd_get counts every key");
+is($after->{get_hits} - $stats->{get_hits}, 166, "get_hits");
+is($after->{get_misses} - $stats->{get_misses}, 34, "get_misses");
+
+print $sock "gets @keys\r\n";
+my $vals = read_values($sock);
+ok(check_values($vals, @keys), "100 key gets");
+ok(!grep({ !defined $_->[2] } values %$vals), "gets returns every cas");
+
+# The whole cache in one request, and the same key many times over.
+my @all = map { "key$_" } (0..$count - 1);
+print $sock "get @all\r\n";
+ok(check_values(read_values($sock), @all), "$count key get");
+
+print $sock "get " . join(" ", ("key7") x 60) . "\r\n";
+my $n = 0;
+while ((my $line = <$sock>) ne "END\r\n") {
+    $n++ if $line =~ /^VALUE key7 /;
+}
+is($n, 60, "repeated key returned every time");
+
+# A bad key after a few full batches is still an error, and nothing it had
+# already fetched is left pinned.
+print $sock "get @all " . ("x" x 251) . "\r\n";
+is(scalar <$sock>, "CLIENT_ERROR bad command line format\r\n",
+   "too long key in a later batch");
+print $sock "delete key0\r\n";
+is(scalar <$sock>, "DELETED\r\n", "connection still works");
+
+# Benchmark: cost per key of single key gets vs 100 key gets. Informational
+# only, the numbers depend too much on the machine to assert on.
+my $rounds = 100;
+my $start = time;
+for (1..$rounds) {
+    for my $key (@keys) {
+        print $sock "get $key\r\n";
+        read_values($sock);
+    }
+}
+my $single = (time - $start) / ($rounds * @keys);
+
+$start = time;
+for (1..$rounds) {
+    print $sock "get @keys\r\n";
+    read_values($sock);
+}
+my $multi = (time - $start) / ($rounds * @keys);
+diag(sprintf("get: %.1fus/key single, %.1fus/key in 100 key gets",
+             $single * 1e6, $multi * 1e6));
@@ -0,0 +1,83 @@
+#!/usr/bin/perl
+
+use strict;
+use warnings;
+use Test::More tests => 18;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $file = "/tmp/memcached-restart.$$";
+my $args = "-m 64 -o memory_file=$file";
+unlink($file, "$file.meta");
+
+# Stops the server the way an init script would, and waits until it is gone
+# so the metadata file is complete.
+sub stop_server {
+    my $server = shift;
+    kill 'INT', $server->{pid};
+    waitpid($server->{pid}, 0);
+}
+
+my $server = new_memcached($args);
+my $sock = $server->sock;
+
+print $sock "set foo 12 0 3\r\nbar\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored foo");
+print $sock "set short 0 2 4\r\ngone\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored short lived item");
+my $big = "x" x 100000;
+print $sock "set big 0 0 " . length($big) . "\r\n$big\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored big item");
+for my $n (1..100) {
+    print $sock "set key$n 0 0 " . length("value$n") . "\r\nvalue$n\r\n";
+    die "failed to store key$n" unless scalar <$sock> eq "STORED\r\n";
+}
+print $sock "delete key50\r\n";
+is(scalar <$sock>, "DELETED\r\n", "deleted key50");
+
+print $sock "gets foo\r\n";
+my ($cas) = scalar(<$sock>) =~ /^VALUE foo 12 3 (\d+)\r\n/;
+ok(defined $cas, "got cas of foo");
+<$sock>; <$sock>;
+
+stop_server($server);
+ok(-e "$file.meta", "metadata written on shutdown");
+
+sleep(3);
+
+$server = new_memcached($args);
+$sock = $server->sock;
+ok(!-e "$file.meta", "metadata consumed on start");
+
+print $sock "gets foo\r\n";
+is(scalar <$sock>, "VALUE foo 12 3 $cas\r\n", "foo kept its flags and cas");
+is(scalar <$sock>, "bar\r\n", "foo value");
+is(scalar <$sock>, "END\r\n", "foo end");
+print $sock "get big\r\n";
+is(scalar <$sock>, "VALUE big 0 " . length($big) . "\r\n", "big item header");
+my $data;
+read($sock, $data, length($big) + 7);
+ok($data eq "$big\r\nEND\r\n", "big item value");
+mem_get_is($sock, "key42", "value42");
+mem_get_is($sock, "key50", undef);
+mem_get_is($sock, "short", undef);
+
+my $stats = mem_stats($sock);
+is($stats->{curr_items}, 101, "curr_items counts the restored items");
+
+print $sock "set foo 0 0 3\r\nnew\r\ngets foo\r\n";
+<$sock>;
+my ($newcas) = scalar(<$sock>) =~ /^VALUE foo 0 3 (\d+)\r\n/;
+<$sock>; <$sock>;
+ok($newcas > $cas, "cas keeps counting up after the restart");
+
+stop_server($server);
+
+# A different memory limit means a different arena layout; start cold.
+$server = new_memcached("-m 32 -o memory_file=$file");
+$sock = $server->sock;
+mem_get_is($sock, "foo", undef);
+
+stop_server($server);
+unlink($file, "$file.meta");
@@ -0,0 +1,78 @@
+#!/usr/bin/perl
+
+use strict;
+use warnings;
+use Test::More tests => 12;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+# Sums <thread>:<name> over all threads, and counts the threads where it's
+# nonzero.
+sub per_thread {
+    my ($stats, $name) = @_;
+    my ($sum, $threads) = (0, 0);
+    for my $key (keys %$stats) {
+        next unless $key =~ /^\d+:\Q$name\E$/;
+        $sum += $stats->{$key};
+        $threads++ if $stats->{$key};
+    }
+    return ($sum, $threads);
+}
+
+my $server = new_memcached('-t 4 -o reuseport');
+my $sock = $server->sock;
+
+my $settings = mem_stats($sock, ' settings');
+is($settings->{reuseport}, "yes", "reuseport enabled");
+
+my $stats = mem_stats($sock, ' threads');
+my ($listeners, $with_listeners) = per_thread($stats, "listeners");
+is($with_listeners, 4, "every worker has a listener");
+
+# The kernel picks the thread; with this many connections it would take
+# some luck for them all to land on one.
+my @socks;
+my $stored = 0;
+for my $n (1..40) {
+    my $s = $server->new_sock;
+    print $s "set conn$n 0 0 1\r\nx\r\n";
+    $stored++ if scalar <$s> eq "STORED\r\n";
+    push(@socks, $s);
+}
+is($stored, 40, "stored on every connection");
+mem_get_is($socks[0], "conn40", "x");
+
+$stats = mem_stats($sock, ' threads');
+my ($accepted, $accepting) = per_thread($stats, "accepted_conns");
+my ($dispatched) = per_thread($stats, "dispatched_conns");
+my ($curr) = per_thread($stats, "curr_conns");
+is($accepted, 41, "all connections accepted by the workers");
+ok($accepting > 1, "connections spread over threads");
+is($dispatched, 0, "nothing handed over by the main thread");
+is($curr, 41, "connections open");
+
+close($_) for @socks;
+my $closed = 0;
+for (my $i = 0; $i < 50; $i++) {
+    ($curr) = per_thread(mem_stats($sock, ' threads'), "curr_conns");
+    last if ($closed = ($curr == 1));
+    sleep(0.1);
+}
+ok($closed, "closed connections are no longer counted");
+
+# Without the option the main thread accepts and hands everything out.
+$server = new_memcached('-t 4');
+$sock = $server->sock;
+my @more = map { $server->new_sock } (1..8);
+for my $s (@more) {
+    print $s "version\r\n";
+    <$s>;
+}
+$stats = mem_stats($sock, ' threads');
+($listeners) = per_thread($stats, "listeners");
+($accepted) = per_thread($stats, "accepted_conns");
+($dispatched, my $dispatched_to) = per_thread($stats, "dispatched_conns");
+is($listeners, 0, "no per thread listeners");
+is($accepted, 0, "nothing accepted by the workers");
+is($dispatched_to, 4, "connections handed out to every worker");
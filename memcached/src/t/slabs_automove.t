@@ -0,0 +1,67 @@
+#!/usr/bin/perl
+
+use strict;
+use warnings;
+use Test::More tests => 8;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+eval {
+    new_memcached('-o slab_reassign,slab_automove_ratio=1.5');
+};
+ok($@ && $@ =~ m/^Failed/, "slab_automove_ratio above 1 is refused");
+
+my $server = new_memcached('-o slab_reassign,slab_automove -m 4');
+my $sock = $server->sock;
+
+my $stats = mem_stats($sock, ' settings');
+is($stats->{slab_automove}, "yes", "automover on");
+is($stats->{slab_automove_ratio}, "0.80", "default ratio");
+
+# Fill memory with large values, which then go cold
+my $bigdata = 'x' x 70000;
+for (1 .. 60) {
+    print $sock "set bfoo$_ 0 0 70000\r\n", $bigdata, "\r\n";
+    die "failed to store bfoo$_" unless scalar <$sock> eq "STORED\r\n";
+}
+my $slabs_before = mem_stats($sock, "slabs");
+
+# Now only smaller values are written, evicting each other. Pages should
+# follow within a few seconds.
+my $smalldata = 'y' x 20000;
+my $n = 0;
+my $moved = 0;
+for (1 .. 40) {
+    for (1 .. 30) {
+        $n++;
+        print $sock "set sfoo$n 0 0 20000\r\n", $smalldata, "\r\n";
+        die "failed to store sfoo$n" unless scalar <$sock> eq "STORED\r\n";
+    }
+    $stats = mem_stats($sock);
+    if ($stats->{slabs_moved} >= 2) {
+        $moved = 1;
+        last;
+    }
+    select(undef, undef, undef, 0.25);
+}
+ok($moved, "automover moved pages to the evicting class");
+
+my $slabs_after = mem_stats($sock, "slabs");
+ok($slabs_after->{"31:total_pages"} < $slabs_before->{"31:total_pages"},
+   "large class lost pages");
+ok($slabs_after->{"25:total_pages"} > ($slabs_before->{"25:total_pages"} || 0),
+   "small class gained pages");
+
+# Turned off at runtime, nothing moves any more
+print $sock "slabs automove 0\r\n";
+is(scalar <$sock>, "OK\r\n", "automover off");
+sleep 2;
+my $before = mem_stats($sock)->{slabs_moved};
+for (1 .. 200) {
+    $n++;
+    print $sock "set sfoo$n 0 0 20000\r\n", $smalldata, "\r\n";
+    <$sock>;
+}
+sleep 2;
+is(mem_stats($sock)->{slabs_moved}, $before, "no moves with the automover off");
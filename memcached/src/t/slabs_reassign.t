@@ -2,7 +2,7 @@
 
 use strict;
 use warnings;
-use Test::More tests => 131;
+use Test::More tests => 136;
 use FindBin qw($Bin);
 use lib "$Bin/lib";
 use MemcachedTest;
@@ -69,3 +69,20 @@ print $sock "set sfoo51 0 0 20000\r\n", $smalldata, "\r\n";
 is(scalar <$sock>, "STORED\r\n", "stored key");
 
 # Do need to come up with better automated tests for this.
+
+# Give a page back to the global pool, then let another class take it
+$slabs_before = mem_stats($sock, "slabs");
+print $sock "slabs reassign 31 0\r\n";
+is(scalar <$sock>, "OK\r\n", "page scheduled for the global pool");
+sleep 2;
+$stats = mem_stats($sock);
+is($stats->{slab_global_page_pool}, 1, "page waits in the global pool");
+$slabs_after = mem_stats($sock, "slabs");
+is($slabs_after->{"31:total_pages"}, $slabs_before->{"31:total_pages"} - 1,
+    "slab 31 gave up a page");
+
+my $middata = 'z' x 40000;
+print $sock "set mfoo 0 0 40000\r\n", $middata, "\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored key in a class without pages");
+$stats = mem_stats($sock);
+is($stats->{slab_global_page_pool}, 0, "page taken from the global pool");
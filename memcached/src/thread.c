@@ -37,8 +37,8 @@ struct conn_queue {
     pthread_cond_t  cond;
 };
 
-/* Lock for cache operations (item_*, assoc_*) */
-pthread_mutex_t cache_lock;
+/* Locks for the per slab class, per segment LRU queues (see items.c) */
+pthread_mutex_t lru_locks[POWER_LARGEST][NUM_LRU];
 
 /* Connection lock around accepting new connections */
 pthread_mutex_t conn_lock = PTHREAD_MUTEX_INITIALIZER;
@@ -50,6 +50,11 @@ pthread_mutex_t atomics_mutex = PTHREAD_MUTEX_INITIALIZER;
 /* Lock for global stats */
 static pthread_mutex_t stats_lock;
 
+/* Each thread's stats as of the last "stats reset". Readers report the
+ * difference, so resetting never writes to another thread's counters. */
+static struct thread_stats *stats_bases;
+static pthread_mutex_t stats_bases_lock;
+
 /* Free list of CQ_ITEM structs */
 static CQ_ITEM *cqi_freelist;
 static pthread_mutex_t cqi_freelist_lock;
@@ -59,6 +64,13 @@ static pthread_mutex_t *item_locks;
 static uint32_t item_lock_count;
 /* size - 1 for lookup masking */
 static uint32_t item_lock_mask;
+/* One sequence number per item lock. Odd while a hash chain covered by that
+ * lock is being changed; see item_get() for the lock-free readers. */
+static volatile unsigned int *item_lock_seqs;
+
+/* Lets item_get() and the stats code find the LIBEVENT_THREAD they are
+ * running on. */
+static pthread_key_t item_lookup_key;
 
 static LIBEVENT_DISPATCHER_THREAD dispatcher_thread;
 
@@ -93,6 +105,23 @@ unsigned short refcount_incr(unsigned short *refcount) {
 #endif
 }
 
+#ifdef HAVE_GCC_ATOMICS
+/*
+ * Takes a reference on an item found without its item lock. Items with no
+ * references may already be on a slab freelist, so those are left alone.
+ * Returns the new count, or 0 if the item was unreferenced.
+ */
+unsigned short refcount_incr_nonzero(unsigned short *refcount) {
+    unsigned short res;
+    do {
+        res = *refcount;
+        if (res == 0)
+            return 0;
+    } while (!__sync_bool_compare_and_swap(refcount, res, res + 1));
+    return res + 1;
+}
+#endif
+
 unsigned short refcount_decr(unsigned short *refcount) {
 #ifdef HAVE_GCC_ATOMICS
     return __sync_sub_and_fetch(refcount, 1);
@@ -112,10 +141,109 @@ void item_lock(uint32_t hv) {
     mutex_lock(&item_locks[hv & item_lock_mask]);
 }
 
+/*
+ * Tries to take the item lock for hv without blocking. Returns a handle for
+ * item_trylock_unlock(), or NULL if the lock is busy. Used by code that
+ * already holds an LRU lock and so must not wait on an item lock.
+ */
+void *item_trylock(uint32_t hv) {
+    pthread_mutex_t *lock = &item_locks[hv & item_lock_mask];
+    if (pthread_mutex_trylock(lock) == 0) {
+        return lock;
+    }
+    return NULL;
+}
+
+void item_trylock_unlock(void *lock) {
+    mutex_unlock((pthread_mutex_t *) lock);
+}
+
 void item_unlock(uint32_t hv) {
     pthread_mutex_unlock(&item_locks[hv & item_lock_mask]);
 }
 
+/*
+ * Takes every item lock, in order. Used to keep all readers and writers out
+ * of the hash table while it is swapped for a bigger one. Threads only ever
+ * block on one item lock at a time (others are tried), so this can't
+ * deadlock against them. Every chain is marked as changing until
+ * item_unlock_all(), which sends lock-free readers to the locked path.
+ */
+void item_lock_all(void) {
+    uint32_t i;
+    for (i = 0; i < item_lock_count; i++) {
+        mutex_lock(&item_locks[i]);
+        item_seq_write_begin(i);
+    }
+}
+
+void item_unlock_all(void) {
+    uint32_t i;
+    for (i = 0; i < item_lock_count; i++) {
+        item_seq_write_end(i);
+        pthread_mutex_unlock(&item_locks[i]);
+    }
+}
+
+/*
+ * Hash chain sequence numbers. Writers hold the item lock for hv and wrap
+ * every change to the chains it covers in item_seq_write_begin/end. A
+ * lock-free reader takes item_seq_read() before its walk and checks
+ * item_seq_changed() after it; an odd or changed number means the walk may
+ * have seen a half-made change and has to be redone under the lock.
+ */
+unsigned int item_seq_read(uint32_t hv) {
+    unsigned int seq = item_lock_seqs[hv & item_lock_mask];
+#ifdef HAVE_GCC_ATOMICS
+    __sync_synchronize();
+#endif
+    return seq;
+}
+
+bool item_seq_changed(uint32_t hv, unsigned int seq) {
+#ifdef HAVE_GCC_ATOMICS
+    __sync_synchronize();
+#endif
+    return item_lock_seqs[hv & item_lock_mask] != seq;
+}
+
+void item_seq_write_begin(uint32_t hv) {
+    item_lock_seqs[hv & item_lock_mask]++;
+#ifdef HAVE_GCC_ATOMICS
+    __sync_synchronize();
+#endif
+}
+
+void item_seq_write_end(uint32_t hv) {
+#ifdef HAVE_GCC_ATOMICS
+    __sync_synchronize();
+#endif
+    item_lock_seqs[hv & item_lock_mask]++;
+}
+
+/*
+ * Waits until no worker is still inside a lock-free lookup that started
+ * before the call. Memory a reader may hold a bare pointer into (an old hash
+ * table, a slab page about to be cut up for another class) can be reused once
+ * this returns.
+ */
+void item_quiesce_lookups(void) {
+    int i;
+    if (threads == NULL)
+        return;
+#ifdef HAVE_GCC_ATOMICS
+    __sync_synchronize();
+#endif
+    for (i = 0; i < settings.num_threads; i++) {
+        unsigned int lookups = threads[i].lookups;
+        if ((lookups & 1) == 0)
+            continue;
+        while (threads[i].lookups == lookups) {
+            usleep(1);
+        }
+    }
+}
+
 /*
  * Initializes a connection queue.
  */
@@ -265,17 +393,22 @@ static void setup_thread(LIBEVENT_THREAD *me) {
     }
     cq_init(me->new_conn_queue);
 
-    if (pthread_mutex_init(&me->stats.mutex, NULL) != 0) {
-        perror("Failed to initialize mutex");
-        exit(EXIT_FAILURE);
-    }
-
     me->suffix_cache = cache_create("suffix", SUFFIX_SIZE, sizeof(char*),
                                     NULL, NULL);
     if (me->suffix_cache == NULL) {
         fprintf(stderr, "Failed to create suffix cache\n");
         exit(EXIT_FAILURE);
     }
+
+    if (settings.ext_path != NULL) {
+        me->io_cache = cache_create("io", sizeof(io_wrap), sizeof(char*),
+                                    NULL, NULL);
+        if (me->io_cache == NULL) {
+            fprintf(stderr, "Failed to create IO object cache\n");
+            exit(EXIT_FAILURE);
+        }
+        pthread_mutex_init(&me->io_lock, NULL);
+    }
 }
 
 
@@ -288,6 +421,7 @@ static void *worker_libevent(void *arg) {
     /* Any per-thread setup can happen here; thread_init() will block until
      * all threads have finished initializing.
      */
+    pthread_setspecific(item_lookup_key, me);
 
     pthread_mutex_lock(&init_lock);
     init_count++;
@@ -300,17 +434,31 @@ static void *worker_libevent(void *arg) {
 
 
 /*
- * Processes an incoming "handle a new connection" item. This is called when
- * input arrives on the libevent wakeup pipe.
+ * Processes an incoming "handle a new connection" item, or the flash reads
+ * the IO threads are done with ('e'). This is called when input arrives on
+ * the libevent wakeup pipe.
  */
 static void thread_libevent_process(int fd, short which, void *arg) {
     LIBEVENT_THREAD *me = arg;
     CQ_ITEM *item;
     char buf[1];
 
-    if (read(fd, buf, 1) != 1)
+    if (read(fd, buf, 1) != 1) {
         if (settings.verbose > 0)
             fprintf(stderr, "Can't read from libevent pipe\n");
+    } else if (buf[0] == 'e') {
+        io_wrap *io, *next;
+        /* One byte per read; earlier ones may have taken this one's */
+        pthread_mutex_lock(&me->io_lock);
+        io = me->io_done;
+        me->io_done = NULL;
+        pthread_mutex_unlock(&me->io_lock);
+        for (; io != NULL; io = next) {
+            next = io->next;
+            conn_io_done(io);
+        }
+        return;
+    }
 
     item = cq_pop(me->new_conn_queue);
 
@@ -321,6 +469,10 @@ static void thread_libevent_process(int fd, short which, void *arg) {
             if (IS_UDP(item->transport)) {
                 fprintf(stderr, "Can't listen for events on UDP socket\n");
                 exit(1);
+            } else if (item->init_state == conn_listening) {
+                fprintf(stderr, "Can't listen for events on fd %d\n",
+                        item->sfd);
+                exit(1);
             } else {
                 if (settings.verbose > 0) {
                     fprintf(stderr, "Can't listen for events on fd %d\n",
@@ -330,6 +482,13 @@ static void thread_libevent_process(int fd, short which, void *arg) {
             }
         } else {
             c->thread = me;
+            if (item->init_state == conn_listening) {
+                c->next = me->listeners;
+                me->listeners = c;
+            } else if (!IS_UDP(item->transport)) {
+                me->stats.dispatched_conns++;
+                me->stats.curr_conns++;
+            }
         }
         cqi_free(item);
     }
@@ -366,6 +525,29 @@ void dispatch_conn_new(int sfd, enum conn_states init_state, int event_flags,
     }
 }
 
+/*
+ * Hands a listening socket to worker thread tid, which from then on accepts
+ * and serves its connections itself (-o reuseport). Only called from the main
+ * thread during initialization.
+ */
+void dispatch_listen_conn(int sfd, int tid) {
+    CQ_ITEM *item = cqi_new();
+    LIBEVENT_THREAD *thread = threads + (tid % settings.num_threads);
+
+    item->sfd = sfd;
+    item->init_state = conn_listening;
+    item->event_flags = EV_READ | EV_PERSIST;
+    item->read_buffer_size = 1;
+    item->transport = tcp_transport;
+
+    cq_push(thread->new_conn_queue, item);
+
+    MEMCACHED_CONN_DISPATCH(sfd, thread->thread_id);
+    if (write(thread->notify_send_fd, "", 1) != 1) {
+        perror("Writing to thread notify pipe");
+    }
+}
+
 /*
  * Returns true if this is the thread that listens for new TCP connections.
  */
@@ -393,12 +575,126 @@ item *item_get(const char *key, const size_t nkey) {
     item *it;
     uint32_t hv;
     hv = hash(key, nkey, 0);
+#ifdef HAVE_GCC_ATOMICS
+    LIBEVENT_THREAD *me = pthread_getspecific(item_lookup_key);
+    if (me != NULL) {
+        bool done;
+        /* Odd while we walk the hash table without a lock, so memory we might
+         * be looking at isn't freed under us (see item_quiesce_lookups). */
+        me->lookups++;
+        __sync_synchronize();
+        done = do_item_get_lockfree(key, nkey, hv, &it);
+        __sync_synchronize();
+        me->lookups++;
+        if (done)
+            return it;
+    }
+#endif
     item_lock(hv);
     it = do_item_get(key, nkey, hv);
     item_unlock(hv);
     return it;
 }
 
+/*
+ * item_get() for up to ITEM_GET_BATCH_MAX keys at once, as a multi-get needs.
+ * All keys are hashed and their buckets prefetched before the first chain is
+ * walked, so the cache misses on a large table overlap instead of coming one
+ * key at a time. Keys the lock-free path can't answer are grouped by lock
+ * stripe and looked up with each stripe locked once. items[n] gets the hit for
+ * keys[n], with a reference held, or NULL.
+ */
+void item_get_batch(char **keys, const size_t *nkeys, item **items,
+                    const int count) {
+    uint32_t hvs[ITEM_GET_BATCH_MAX];
+    int pending[ITEM_GET_BATCH_MAX];
+    int npending = 0;
+    int i, j;
+
+    assert(count <= ITEM_GET_BATCH_MAX);
+    for (i = 0; i < count; i++) {
+        hvs[i] = hash(keys[i], nkeys[i], 0);
+        assoc_prefetch(hvs[i]);
+    }
+
+#ifdef HAVE_GCC_ATOMICS
+    LIBEVENT_THREAD *me = pthread_getspecific(item_lookup_key);
+    if (me != NULL) {
+        /* One lock-free window for the whole batch, see item_get() */
+        me->lookups++;
+        __sync_synchronize();
+        for (i = 0; i < count; i++) {
+            if (!do_item_get_lockfree(keys[i], nkeys[i], hvs[i], &items[i]))
+                pending[npending++] = i;
+        }
+        __sync_synchronize();
+        me->lookups++;
+    } else
+#endif
+    {
+        for (i = 0; i < count; i++)
+            pending[npending++] = i;
+    }
+
+    /* Insertion sort by stripe; batches are tiny, and order within a stripe
+     * is kept so this stays a plain sequence of item_get()s. */
+    for (i = 1; i < npending; i++) {
+        int k = pending[i];
+        uint32_t stripe = hvs[k] & item_lock_mask;
+        for (j = i; j > 0 && (hvs[pending[j - 1]] & item_lock_mask) > stripe; j--)
+            pending[j] = pending[j - 1];
+        pending[j] = k;
+    }
+
+    for (i = 0; i < npending; ) {
+        uint32_t stripe = hvs[pending[i]] & item_lock_mask;
+        item_lock(hvs[pending[i]]);
+        do {
+            int k = pending[i];
+            items[k] = do_item_get(keys[k], nkeys[k], hvs[k]);
+            i++;
+        } while (i < npending && (hvs[pending[i]] & item_lock_mask) == stripe);
+        item_unlock(hvs[pending[i - 1]]);
+    }
+}
+
+/*
+ * Reads the header it back from flash, see do_storage_get(). Takes over the
+ * reference to it.
+ */
+item *item_load(item *it) {
+    uint32_t hv;
+    hv = hash(ITEM_key(it), it->nkey, 0);
+    item_lock(hv);
+    it = do_storage_get(it, hv);
+    item_unlock(hv);
+    return it;
+}
+
+/* Called from an IO thread; hands the read back to the connection's worker */
+static void thread_io_done(ext_io *eio) {
+    io_wrap *io = (io_wrap *)eio;
+    LIBEVENT_THREAD *me = io->c->thread;
+
+    pthread_mutex_lock(&me->io_lock);
+    io->next = me->io_done;
+    me->io_done = io;
+    pthread_mutex_unlock(&me->io_lock);
+
+    if (write(me->notify_send_fd, "e", 1) != 1) {
+        perror("Writing to thread notify pipe");
+    }
+}
+
+/*
+ * Queues a flash read for a get on the IO threads; the connection's worker
+ * gets it back through conn_io_done().
+ */
+void thread_io_submit(io_wrap *io) {
+    io->io.cb = thread_io_done;
+    extstore_submit(&io->io);
+}
+
 item *item_touch(const char *key, size_t nkey, uint32_t exptime) {
     item *it;
     uint32_t hv;
@@ -461,6 +757,10 @@ void item_unlink(item *item) {
  */
 void item_update(item *item) {
     uint32_t hv;
+    /* do_item_update() ignores items bumped within the last
+     * ITEM_UPDATE_INTERVAL; most hits are, so skip the hash and the lock. */
+    if (item->time >= current_time - ITEM_UPDATE_INTERVAL)
+        return;
     hv = hash(ITEM_key(item), item->nkey, 0);
 
     item_lock(hv);
@@ -503,39 +803,32 @@ enum store_item_type store_item(item *item, int comm, conn* c) {
  * Flushes expired items after a flush_all call
  */
 void item_flush_expired() {
-    mutex_lock(&cache_lock);
+    /* do_item_flush_expired handles its own locks */
     do_item_flush_expired();
-    pthread_mutex_unlock(&cache_lock);
 }
 
 /*
  * Dumps part of the cache
  */
 char *item_cachedump(unsigned int slabs_clsid, unsigned int limit, unsigned int *bytes) {
-    char *ret;
-
-    mutex_lock(&cache_lock);
-    ret = do_item_cachedump(slabs_clsid, limit, bytes);
-    pthread_mutex_unlock(&cache_lock);
-    return ret;
+    /* do_item_cachedump handles its own locks */
+    return do_item_cachedump(slabs_clsid, limit, bytes);
 }
 
 /*
  * Dumps statistics about slab classes
  */
 void  item_stats(ADD_STAT add_stats, void *c) {
-    mutex_lock(&cache_lock);
+    /* do_item_stats handles its own locks */
     do_item_stats(add_stats, c);
-    pthread_mutex_unlock(&cache_lock);
 }
 
 /*
  * Dumps a list of objects of each size in 32-byte increments
  */
 void  item_stats_sizes(ADD_STAT add_stats, void *c) {
-    mutex_lock(&cache_lock);
+    /* do_item_stats_sizes handles its own locks */
     do_item_stats_sizes(add_stats, c);
-    pthread_mutex_unlock(&cache_lock);
 }
 
 /******************************* GLOBAL STATS ******************************/
@@ -549,88 +842,270 @@ void STATS_UNLOCK() {
 }
 
 void threadlocal_stats_reset(void) {
-    int ii, sid;
+    int ii;
+
+    pthread_mutex_lock(&stats_bases_lock);
     for (ii = 0; ii < settings.num_threads; ++ii) {
-        pthread_mutex_lock(&threads[ii].stats.mutex);
-
-        threads[ii].stats.get_cmds = 0;
-        threads[ii].stats.get_misses = 0;
-        threads[ii].stats.touch_cmds = 0;
-        threads[ii].stats.touch_misses = 0;
-        threads[ii].stats.delete_misses = 0;
-        threads[ii].stats.incr_misses = 0;
-        threads[ii].stats.decr_misses = 0;
-        threads[ii].stats.cas_misses = 0;
-        threads[ii].stats.bytes_read = 0;
-        threads[ii].stats.bytes_written = 0;
-        threads[ii].stats.flush_cmds = 0;
-        threads[ii].stats.conn_yields = 0;
-        threads[ii].stats.auth_cmds = 0;
-        threads[ii].stats.auth_errors = 0;
-
-        for(sid = 0; sid < MAX_NUMBER_OF_SLAB_CLASSES; sid++) {
-            threads[ii].stats.slab_stats[sid].set_cmds = 0;
-            threads[ii].stats.slab_stats[sid].get_hits = 0;
-            threads[ii].stats.slab_stats[sid].touch_hits = 0;
-            threads[ii].stats.slab_stats[sid].delete_hits = 0;
-            threads[ii].stats.slab_stats[sid].incr_hits = 0;
-            threads[ii].stats.slab_stats[sid].decr_hits = 0;
-            threads[ii].stats.slab_stats[sid].cas_hits = 0;
-            threads[ii].stats.slab_stats[sid].cas_badval = 0;
+        memcpy(&stats_bases[ii], &threads[ii].stats, sizeof(struct thread_stats));
+        /* Gauges, not counters */
+        stats_bases[ii].curr_conns = 0;
+        stats_bases[ii].open_conns = 0;
+    }
+    pthread_mutex_unlock(&stats_bases_lock);
+}
+
+/*
+ * The stats thread ii has gathered since the last reset. Called with
+ * stats_bases_lock held.
+ */
+static void thread_stats_since_reset(const int ii, struct thread_stats *out) {
+    const struct thread_stats *ts = &threads[ii].stats;
+    const struct thread_stats *base = &stats_bases[ii];
+    int sid, cls, b;
+
+#define SINCE_RESET(f) out->f += ts->f - base->f
+    SINCE_RESET(get_cmds);
+    SINCE_RESET(get_misses);
+    SINCE_RESET(touch_cmds);
+    SINCE_RESET(touch_misses);
+    SINCE_RESET(delete_misses);
+    SINCE_RESET(decr_misses);
+    SINCE_RESET(incr_misses);
+    SINCE_RESET(cas_misses);
+    SINCE_RESET(bytes_read);
+    SINCE_RESET(bytes_written);
+    SINCE_RESET(flush_cmds);
+    SINCE_RESET(conn_yields);
+    SINCE_RESET(auth_cmds);
+    SINCE_RESET(auth_errors);
+    SINCE_RESET(accepted_conns);
+    SINCE_RESET(dispatched_conns);
+    SINCE_RESET(curr_conns);
+    SINCE_RESET(total_conns);
+    SINCE_RESET(open_conns);
+
+    for (sid = 0; sid < MAX_NUMBER_OF_SLAB_CLASSES; sid++) {
+        SINCE_RESET(slab_stats[sid].set_cmds);
+        SINCE_RESET(slab_stats[sid].get_hits);
+        SINCE_RESET(slab_stats[sid].touch_hits);
+        SINCE_RESET(slab_stats[sid].delete_hits);
+        SINCE_RESET(slab_stats[sid].decr_hits);
+        SINCE_RESET(slab_stats[sid].incr_hits);
+        SINCE_RESET(slab_stats[sid].cas_hits);
+        SINCE_RESET(slab_stats[sid].cas_badval);
+    }
+
+    if (settings.latency_stats) {
+        for (cls = 0; cls < LATENCY_CLASSES; cls++) {
+            SINCE_RESET(latency_us[cls]);
+            for (b = 0; b < LATENCY_BUCKETS; b++) {
+                SINCE_RESET(latency[cls][b]);
+            }
         }
+    }
+#undef SINCE_RESET
+}
 
-        pthread_mutex_unlock(&threads[ii].stats.mutex);
+/*
+ * "stats threads": how connections are spread over the worker threads.
+ */
+void threadlocal_stats_threads(ADD_STAT add_stats, void *c) {
+    int ii;
+    char key_str[STAT_KEY_LEN];
+    char val_str[STAT_VAL_LEN];
+    int klen = 0, vlen = 0;
+
+    pthread_mutex_lock(&stats_bases_lock);
+    for (ii = 0; ii < settings.num_threads; ++ii) {
+        const struct thread_stats *ts = &threads[ii].stats;
+        const struct thread_stats *base = &stats_bases[ii];
+        int nlisteners = 0;
+        conn *l;
+
+        for (l = threads[ii].listeners; l != NULL; l = l->next)
+            nlisteners++;
+
+        APPEND_NUM_STAT(ii, "listeners", "%d", nlisteners);
+        APPEND_NUM_STAT(ii, "accepted_conns", "%llu",
+                        (unsigned long long)(ts->accepted_conns -
+                                             base->accepted_conns));
+        APPEND_NUM_STAT(ii, "dispatched_conns", "%llu",
+                        (unsigned long long)(ts->dispatched_conns -
+                                             base->dispatched_conns));
+        APPEND_NUM_STAT(ii, "curr_conns", "%llu",
+                        (unsigned long long)ts->curr_conns);
     }
+    pthread_mutex_unlock(&stats_bases_lock);
+
+    add_stats(NULL, 0, NULL, 0, c);
 }
 
 void threadlocal_stats_aggregate(struct thread_stats *stats) {
-    int ii, sid;
+    int ii;
 
-    /* The struct has a mutex, but we can safely set the whole thing
-     * to zero since it is unused when aggregating. */
     memset(stats, 0, sizeof(*stats));
 
+    pthread_mutex_lock(&stats_bases_lock);
     for (ii = 0; ii < settings.num_threads; ++ii) {
-        pthread_mutex_lock(&threads[ii].stats.mutex);
-
-        stats->get_cmds += threads[ii].stats.get_cmds;
-        stats->get_misses += threads[ii].stats.get_misses;
-        stats->touch_cmds += threads[ii].stats.touch_cmds;
-        stats->touch_misses += threads[ii].stats.touch_misses;
-        stats->delete_misses += threads[ii].stats.delete_misses;
-        stats->decr_misses += threads[ii].stats.decr_misses;
-        stats->incr_misses += threads[ii].stats.incr_misses;
-        stats->cas_misses += threads[ii].stats.cas_misses;
-        stats->bytes_read += threads[ii].stats.bytes_read;
-        stats->bytes_written += threads[ii].stats.bytes_written;
-        stats->flush_cmds += threads[ii].stats.flush_cmds;
-        stats->conn_yields += threads[ii].stats.conn_yields;
-        stats->auth_cmds += threads[ii].stats.auth_cmds;
-        stats->auth_errors += threads[ii].stats.auth_errors;
-
-        for (sid = 0; sid < MAX_NUMBER_OF_SLAB_CLASSES; sid++) {
-            stats->slab_stats[sid].set_cmds +=
-                threads[ii].stats.slab_stats[sid].set_cmds;
-            stats->slab_stats[sid].get_hits +=
-                threads[ii].stats.slab_stats[sid].get_hits;
-            stats->slab_stats[sid].touch_hits +=
-                threads[ii].stats.slab_stats[sid].touch_hits;
-            stats->slab_stats[sid].delete_hits +=
-                threads[ii].stats.slab_stats[sid].delete_hits;
-            stats->slab_stats[sid].decr_hits +=
-                threads[ii].stats.slab_stats[sid].decr_hits;
-            stats->slab_stats[sid].incr_hits +=
-                threads[ii].stats.slab_stats[sid].incr_hits;
-            stats->slab_stats[sid].cas_hits +=
-                threads[ii].stats.slab_stats[sid].cas_hits;
-            stats->slab_stats[sid].cas_badval +=
-                threads[ii].stats.slab_stats[sid].cas_badval;
-        }
+        thread_stats_since_reset(ii, stats);
+    }
+    pthread_mutex_unlock(&stats_bases_lock);
+}
+
+/*
+ * Connections made and closed on the worker threads are counted there; the
+ * few the main thread makes (listeners, mostly) go in the global stats.
+ */
+void threadlocal_conn_opened(void) {
+    LIBEVENT_THREAD *me = threads ? pthread_getspecific(item_lookup_key) : NULL;
+
+    if (me != NULL) {
+        me->stats.open_conns++;
+        me->stats.total_conns++;
+    } else {
+        STATS_LOCK();
+        stats.curr_conns++;
+        stats.total_conns++;
+        STATS_UNLOCK();
+    }
+}
 
-        pthread_mutex_unlock(&threads[ii].stats.mutex);
+void threadlocal_conn_closed(void) {
+    LIBEVENT_THREAD *me = threads ? pthread_getspecific(item_lookup_key) : NULL;
+
+    if (me != NULL) {
+        me->stats.open_conns--;
+    } else {
+        STATS_LOCK();
+        stats.curr_conns--;
+        STATS_UNLOCK();
     }
 }
 
+/*
+ * Connections open right now, listeners included. A thread's open_conns can
+ * wrap below zero when it closes a connection made elsewhere; the sum is
+ * still right.
+ */
+unsigned int threadlocal_curr_conns(void) {
+    uint64_t curr;
+    int ii;
+
+    STATS_LOCK();
+    curr = stats.curr_conns;
+    STATS_UNLOCK();
+    if (threads != NULL) {
+        for (ii = 0; ii < settings.num_threads; ++ii)
+            curr += threads[ii].stats.open_conns;
+    }
+    return (unsigned int)curr;
+}
+
+/*
+ * Latency histogram bucket for us microseconds: exact below 16, then eight
+ * buckets per power of two, so a bucket is never more than 1/8th wide.
+ */
+static int latency_bucket(const uint64_t us) {
+    int log2 = 4;
+
+    if (us < 16)
+        return (int)us;
+    while (log2 < 31 && (us >> (log2 + 1)) != 0)
+        log2++;
+    if ((us >> (log2 + 1)) != 0)
+        return LATENCY_BUCKETS - 1;
+    return 16 + (log2 - 4) * 8 + (int)((us >> (log2 - 3)) & 7);
+}
+
+/* The largest latency that lands in bucket b. */
+static uint64_t latency_bucket_max(const int b) {
+    int log2, sub;
+
+    if (b < 16)
+        return b;
+    log2 = 4 + (b - 16) / 8;
+    sub = (b - 16) % 8;
+    return ((uint64_t)(9 + sub) << (log2 - 3)) - 1;
+}
+
+void threadlocal_latency_record(LIBEVENT_THREAD *me, const int cls,
+                                const uint64_t us) {
+    me->stats.latency_us[cls] += us;
+    me->stats.latency[cls][latency_bucket(us)]++;
+}
+
+/*
+ * "stats latency": per command group, how many were timed, their mean, and
+ * percentiles read off the histogram. A percentile is reported as the top of
+ * the bucket it falls in.
+ */
+void threadlocal_stats_latency(ADD_STAT add_stats, void *c) {
+    static const char *const names[LATENCY_CLASSES] = {
+        [LAT_GET] = "get",
+        [LAT_SET] = "set",
+        [LAT_CAS] = "cas",
+        [LAT_DELETE] = "delete",
+        [LAT_INCR] = "incr",
+        [LAT_DECR] = "decr",
+        [LAT_TOUCH] = "touch",
+        [LAT_OTHER] = "other"
+    };
+    static const struct {
+        const char *name;
+        int per_mille;
+    } pcts[] = {
+        { "p50", 500 }, { "p90", 900 }, { "p99", 990 }, { "p999", 999 }
+    };
+    struct thread_stats *ts;
+    char key_str[STAT_KEY_LEN];
+    char val_str[STAT_VAL_LEN];
+    int klen = 0, vlen = 0;
+    int cls, b, p;
+
+    ts = malloc(sizeof(*ts));
+    if (ts == NULL) {
+        add_stats(NULL, 0, NULL, 0, c);
+        return;
+    }
+    threadlocal_stats_aggregate(ts);
+
+    for (cls = 0; cls < LATENCY_CLASSES; cls++) {
+        uint64_t count = 0, seen = 0, top = 0;
+
+        for (b = 0; b < LATENCY_BUCKETS; b++) {
+            count += ts->latency[cls][b];
+            if (ts->latency[cls][b] != 0)
+                top = latency_bucket_max(b);
+        }
+        APPEND_NUM_FMT_STAT("%s:%s", names[cls], "count", "%llu",
+                            (unsigned long long)count);
+        APPEND_NUM_FMT_STAT("%s:%s", names[cls], "mean_us", "%llu",
+                            (unsigned long long)(count ?
+                                ts->latency_us[cls] / count : 0));
+
+        b = 0;
+        for (p = 0; p < (int)(sizeof(pcts) / sizeof(pcts[0])); p++) {
+            uint64_t want = (count * pcts[p].per_mille + 999) / 1000;
+            uint64_t value = 0;
+
+            if (count != 0) {
+                while (seen + ts->latency[cls][b] < want) {
+                    seen += ts->latency[cls][b];
+                    b++;
+                }
+                value = latency_bucket_max(b);
+            }
+            APPEND_NUM_FMT_STAT("%s:%s_us", names[cls], pcts[p].name,
+                                "%llu", (unsigned long long)value);
+        }
+        APPEND_NUM_FMT_STAT("%s:%s", names[cls], "max_us", "%llu",
+                            (unsigned long long)top);
+    }
+    free(ts);
+
+    add_stats(NULL, 0, NULL, 0, c);
+}
+
 void slab_stats_aggregate(struct thread_stats *stats, struct slab_stats *out) {
     int sid;
 
@@ -662,11 +1137,16 @@ void slab_stats_aggregate(struct thread_stats *stats, struct slab_stats *out) {
  * main_base Event base for main thread
  */
 void thread_init(int nthreads, struct event_base *main_base) {
-    int         i;
+    int         i, lru;
     int         power;
 
-    pthread_mutex_init(&cache_lock, NULL);
+    for (i = 0; i < POWER_LARGEST; i++) {
+        for (lru = 0; lru < NUM_LRU; lru++) {
+            pthread_mutex_init(&lru_locks[i][lru], NULL);
+        }
+    }
     pthread_mutex_init(&stats_lock, NULL);
+    pthread_mutex_init(&stats_bases_lock, NULL);
 
     pthread_mutex_init(&init_lock, NULL);
     pthread_cond_init(&init_cond, NULL);
@@ -686,6 +1166,12 @@ void thread_init(int nthreads, struct event_base *main_base) {
         power = 13;
     }
 
+    /* Every hash bucket must map onto a single item lock, so the lock table
+     * can't be wider than the hash table. assoc_init() has run by now. */
+    if (power >= stats.hash_power_level) {
+        power = stats.hash_power_level - 1;
+    }
+
     item_lock_count = ((unsigned long int)1 << (power));
     item_lock_mask  = item_lock_count - 1;
 
@@ -698,8 +1184,16 @@ void thread_init(int nthreads, struct event_base *main_base) {
         pthread_mutex_init(&item_locks[i], NULL);
     }
 
+    item_lock_seqs = calloc(item_lock_count, sizeof(unsigned int));
+    if (! item_lock_seqs) {
+        perror("Can't allocate item lock sequence numbers");
+        exit(1);
+    }
+    pthread_key_create(&item_lookup_key, NULL);
+
     threads = calloc(nthreads, sizeof(LIBEVENT_THREAD));
-    if (! threads) {
+    stats_bases = calloc(nthreads, sizeof(struct thread_stats));
+    if (! threads || ! stats_bases) {
         perror("Can't allocate thread descriptors");
         exit(1);
     }
@@ -0,0 +1,115 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * XXH64, from Yann Collet's xxHash:
+ *    <https://github.com/Cyan4973/xxHash>
+ *
+ * Works on 64 bit words. Keys of 32 bytes and up are fed through four
+ * independent accumulators, which the CPU can run side by side; shorter keys
+ * (most of them, in memcached) go straight to the 8/4/1 byte tail steps.
+ * The algorithm's output is 64 bits wide; xxh64_hash() folds it down to the
+ * 32 bits the hash table uses.
+ */
+#include "memcached.h"
+#include "xxh64_hash.h"
+
+#include <string.h>
+
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+#define ROTL64(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+/* xxHash is defined on little endian input. Keys only ever get hashed on
+ * this host, so native byte order is fine: the values just differ from the
+ * reference ones on big endian machines. */
+static inline uint64_t read64(const uint8_t *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t read32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t xxh64_round(uint64_t acc, const uint64_t input) {
+    acc += input * PRIME64_2;
+    acc = ROTL64(acc, 31);
+    acc *= PRIME64_1;
+    return acc;
+}
+
+static inline uint64_t xxh64_merge_round(uint64_t acc, uint64_t val) {
+    val = xxh64_round(0, val);
+    acc ^= val;
+    acc = acc * PRIME64_1 + PRIME64_4;
+    return acc;
+}
+
+uint64_t xxh64(const void *key, size_t length, const uint64_t seed) {
+    const uint8_t *p = (const uint8_t *)key;
+    const uint8_t *const end = p + length;
+    uint64_t h64;
+
+    if (length >= 32) {
+        const uint8_t *const limit = end - 32;
+        uint64_t v1 = seed + PRIME64_1 + PRIME64_2;
+        uint64_t v2 = seed + PRIME64_2;
+        uint64_t v3 = seed + 0;
+        uint64_t v4 = seed - PRIME64_1;
+
+        do {
+            v1 = xxh64_round(v1, read64(p)); p += 8;
+            v2 = xxh64_round(v2, read64(p)); p += 8;
+            v3 = xxh64_round(v3, read64(p)); p += 8;
+            v4 = xxh64_round(v4, read64(p)); p += 8;
+        } while (p <= limit);
+
+        h64 = ROTL64(v1, 1) + ROTL64(v2, 7) + ROTL64(v3, 12) + ROTL64(v4, 18);
+        h64 = xxh64_merge_round(h64, v1);
+        h64 = xxh64_merge_round(h64, v2);
+        h64 = xxh64_merge_round(h64, v3);
+        h64 = xxh64_merge_round(h64, v4);
+    } else {
+        h64 = seed + PRIME64_5;
+    }
+
+    h64 += (uint64_t)length;
+
+    while (p + 8 <= end) {
+        const uint64_t k1 = xxh64_round(0, read64(p));
+        h64 ^= k1;
+        h64 = ROTL64(h64, 27) * PRIME64_1 + PRIME64_4;
+        p += 8;
+    }
+
+    if (p + 4 <= end) {
+        h64 ^= (uint64_t)read32(p) * PRIME64_1;
+        h64 = ROTL64(h64, 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+    }
+
+    while (p < end) {
+        h64 ^= (*p) * PRIME64_5;
+        h64 = ROTL64(h64, 11) * PRIME64_1;
+        p++;
+    }
+
+    h64 ^= h64 >> 33;
+    h64 *= PRIME64_2;
+    h64 ^= h64 >> 29;
+    h64 *= PRIME64_3;
+    h64 ^= h64 >> 32;
+
+    return h64;
+}
+
+uint32_t xxh64_hash(const void *key, size_t length, const uint32_t seed) {
+    uint64_t h = xxh64(key, length, seed);
+    return (uint32_t)(h ^ (h >> 32));
+}
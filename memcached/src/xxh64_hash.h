@@ -0,0 +1,7 @@
+#ifndef XXH64_HASH_H
+#define XXH64_HASH_H
+
+uint64_t xxh64(const void *key, size_t length, const uint64_t seed);
+uint32_t xxh64_hash(const void *key, size_t length, const uint32_t seed);
+
+#endif /* XXH64_HASH_H */